@@ -0,0 +1,157 @@
+/*****************************************************************************\
+ *  event_subscribe.c - subscribe to job, node, partition and reservation changes
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "slurm/slurm.h"
+
+#include "src/common/slurm_auth.h"
+#include "src/common/slurm_persist_conn.h"
+#include "src/common/slurm_protocol_api.h"
+#include "src/common/xmalloc.h"
+
+/*
+ * Notifications use the framing of slurm_persist_conn_t, a message length
+ * followed by the message type and body, without per-message credentials
+ */
+struct slurm_event_conn {
+	slurm_persist_conn_t persist_conn;
+};
+
+static time_t shutdown_time = 0;	/* never set, persist_conn needs it */
+
+extern int slurm_event_subscribe(uint16_t event_types, info_filter_t *filter,
+				 slurm_event_conn_t **conn_pptr)
+{
+	slurm_msg_t req_msg, resp_msg;
+	event_subscribe_msg_t req;
+	slurm_event_conn_t *conn;
+	slurm_addr_t ctrl_addr;
+	bool use_backup = false;
+	int fd, rc;
+
+	*conn_pptr = NULL;
+	if ((fd = slurm_open_controller_conn(&ctrl_addr, &use_backup,
+					     working_cluster_rec)) < 0)
+		return SLURM_ERROR;
+
+	slurm_msg_t_init(&req_msg);
+	slurm_msg_t_init(&resp_msg);
+	memset(&req, 0, sizeof(req));
+	req.event_types  = event_types;
+	req.filter       = filter;
+	req_msg.msg_type = REQUEST_EVENT_SUBSCRIBE;
+	req_msg.data     = &req;
+	if (working_cluster_rec)
+		req_msg.flags |= SLURM_GLOBAL_AUTH_KEY;
+
+	if (slurm_send_recv_msg(fd, &req_msg, &resp_msg, 0) < 0) {
+		rc = errno;
+		(void) close(fd);
+		slurm_seterrno_ret(rc);
+	}
+	if (resp_msg.auth_cred)
+		g_slurm_auth_destroy(resp_msg.auth_cred);
+
+	rc = slurm_get_return_code(resp_msg.msg_type, resp_msg.data);
+	slurm_free_msg_data(resp_msg.msg_type, resp_msg.data);
+	if (rc) {
+		(void) close(fd);
+		slurm_seterrno_ret(rc);
+	}
+
+	conn = xmalloc(sizeof(slurm_event_conn_t));
+	conn->persist_conn.fd = fd;
+	conn->persist_conn.shutdown = &shutdown_time;
+	conn->persist_conn.timeout = slurm_get_msg_timeout() * 1000;
+	conn->persist_conn.version = SLURM_PROTOCOL_VERSION;
+	*conn_pptr = conn;
+
+	return SLURM_SUCCESS;
+}
+
+extern int slurm_event_recv(slurm_event_conn_t *conn, int timeout,
+			    event_notify_msg_t **msg)
+{
+	struct pollfd pfd;
+	persist_msg_t persist_msg;
+	Buf buffer;
+	int rc;
+
+	*msg = NULL;
+	pfd.fd = conn->persist_conn.fd;
+	pfd.events = POLLIN;
+	while ((rc = poll(&pfd, 1, timeout)) < 0) {
+		if ((errno != EINTR) && (errno != EAGAIN))
+			return SLURM_ERROR;
+	}
+	if (rc == 0)
+		slurm_seterrno_ret(SLURM_PROTOCOL_SOCKET_IMPL_TIMEOUT);
+
+	/* The rest of the message follows within MessageTimeout */
+	if (!(buffer = slurm_persist_recv_msg(&conn->persist_conn)))
+		slurm_seterrno_ret(SLURM_COMMUNICATIONS_RECEIVE_ERROR);
+
+	memset(&persist_msg, 0, sizeof(persist_msg));
+	rc = slurm_persist_msg_unpack(&conn->persist_conn, &persist_msg,
+				      buffer);
+	free_buf(buffer);
+	if (rc != SLURM_SUCCESS)
+		slurm_seterrno_ret(SLURM_COMMUNICATIONS_RECEIVE_ERROR);
+	if (persist_msg.msg_type != MESSAGE_EVENT_NOTIFY) {
+		slurm_free_msg_data(persist_msg.msg_type, persist_msg.data);
+		slurm_seterrno_ret(SLURM_UNEXPECTED_MSG_ERROR);
+	}
+	*msg = persist_msg.data;
+
+	return SLURM_SUCCESS;
+}
+
+extern int slurm_event_fd(slurm_event_conn_t *conn)
+{
+	return conn->persist_conn.fd;
+}
+
+extern void slurm_event_unsubscribe(slurm_event_conn_t *conn)
+{
+	if (!conn)
+		return;
+	if (conn->persist_conn.fd >= 0)
+		(void) close(conn->persist_conn.fd);
+	xfree(conn);
+}
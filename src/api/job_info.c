@@ -1252,18 +1252,9 @@ extern int slurm_job_batch_script(FILE *out, uint32_t jobid)
 	return rc;
 }
 
-/*
- * slurm_load_jobs - issue RPC to get all job configuration
- *	information if changed since update_time
- * IN update_time - time of current configuration data
- * IN/OUT job_info_msg_pptr - place to store a job configuration pointer
- * IN show_flags -  job filtering option: 0, SHOW_ALL, SHOW_DETAIL or SHOW_LOCAL
- * RET 0 or -1 on error
- * NOTE: free the response using slurm_free_job_info_msg
- */
-extern int
-slurm_load_jobs (time_t update_time, job_info_msg_t **job_info_msg_pptr,
-		 uint16_t show_flags)
+static int _load_jobs(time_t update_time, uint64_t delta_cursor,
+		      info_filter_t *filter,
+		      job_info_msg_t **job_info_msg_pptr, uint16_t show_flags)
 {
 	slurm_msg_t req_msg;
 	job_info_request_msg_t req = {0};
@@ -1281,6 +1272,7 @@ slurm_load_jobs (time_t update_time, job_info_msg_t **job_info_msg_pptr,
 	    cluster_in_federation(ptr, cluster_name)) {
 		/* In federation. Need full info from all clusters */
 		update_time = (time_t) 0;
+		delta_cursor = 0;
 		show_flags &= (~SHOW_LOCAL);
 	} else {
 		/* Report local cluster info only */
@@ -1291,6 +1283,8 @@ slurm_load_jobs (time_t update_time, job_info_msg_t **job_info_msg_pptr,
 	slurm_msg_t_init(&req_msg);
 	req.last_update  = update_time;
 	req.show_flags   = show_flags;
+	req.delta_cursor = delta_cursor;
+	req.filter       = filter;
 	req_msg.msg_type = REQUEST_JOB_INFO;
 	req_msg.data     = &req;
 
@@ -1310,6 +1304,156 @@ slurm_load_jobs (time_t update_time, job_info_msg_t **job_info_msg_pptr,
 	return rc;
 }
 
+/*
+ * slurm_load_jobs - issue RPC to get all job configuration
+ *	information if changed since update_time
+ * IN update_time - time of current configuration data
+ * IN/OUT job_info_msg_pptr - place to store a job configuration pointer
+ * IN show_flags -  job filtering option: 0, SHOW_ALL, SHOW_DETAIL or SHOW_LOCAL
+ * RET 0 or -1 on error
+ * NOTE: free the response using slurm_free_job_info_msg
+ */
+extern int
+slurm_load_jobs (time_t update_time, job_info_msg_t **job_info_msg_pptr,
+		 uint16_t show_flags)
+{
+	return _load_jobs(update_time, 0, NULL, job_info_msg_pptr, show_flags);
+}
+
+typedef struct {
+	uint32_t job_id;
+	uint32_t inx;
+} job_inx_t;
+
+static int _cmp_job_inx(const void *a, const void *b)
+{
+	uint32_t job_id_a = ((job_inx_t *) a)->job_id;
+	uint32_t job_id_b = ((job_inx_t *) b)->job_id;
+
+	if (job_id_a < job_id_b)
+		return -1;
+	if (job_id_a > job_id_b)
+		return 1;
+	return 0;
+}
+
+static int _cmp_job_id(const void *a, const void *b)
+{
+	uint32_t job_id_a = *(uint32_t *) a;
+	uint32_t job_id_b = *(uint32_t *) b;
+
+	if (job_id_a < job_id_b)
+		return -1;
+	if (job_id_a > job_id_b)
+		return 1;
+	return 0;
+}
+
+/*
+ * Merge the job records of old_msg into delta_msg, which holds only the
+ * changed records: changed records replace old ones in place, purged records
+ * are dropped and new jobs are appended. All records of old_msg are moved
+ * or freed.
+ */
+static void _merge_job_changes(job_info_msg_t *old_msg,
+			       job_info_msg_t *delta_msg)
+{
+	slurm_job_info_t *job_array;
+	job_inx_t *changed, key, *found;
+	bool *used;
+	uint32_t i, cnt = 0;
+
+	changed = xmalloc(sizeof(job_inx_t) * (delta_msg->record_count + 1));
+	for (i = 0; i < delta_msg->record_count; i++) {
+		changed[i].job_id = delta_msg->job_array[i].job_id;
+		changed[i].inx = i;
+	}
+	qsort(changed, delta_msg->record_count, sizeof(job_inx_t),
+	      _cmp_job_inx);
+	qsort(delta_msg->purged_job_ids, delta_msg->purged_cnt,
+	      sizeof(uint32_t), _cmp_job_id);
+	used = xmalloc(sizeof(bool) * (delta_msg->record_count + 1));
+
+	job_array = xmalloc(sizeof(slurm_job_info_t) *
+			    (old_msg->record_count + delta_msg->record_count +
+			     1));
+	for (i = 0; i < old_msg->record_count; i++) {
+		key.job_id = old_msg->job_array[i].job_id;
+		found = bsearch(&key, changed, delta_msg->record_count,
+				sizeof(job_inx_t), _cmp_job_inx);
+		if (found) {
+			slurm_free_job_info_members(&old_msg->job_array[i]);
+			job_array[cnt++] = delta_msg->job_array[found->inx];
+			used[found->inx] = true;
+		} else if (bsearch(&key.job_id, delta_msg->purged_job_ids,
+				   delta_msg->purged_cnt, sizeof(uint32_t),
+				   _cmp_job_id)) {
+			slurm_free_job_info_members(&old_msg->job_array[i]);
+		} else {
+			job_array[cnt++] = old_msg->job_array[i];
+		}
+	}
+	for (i = 0; i < delta_msg->record_count; i++) {
+		if (!used[i])
+			job_array[cnt++] = delta_msg->job_array[i];
+	}
+	xfree(changed);
+	xfree(used);
+
+	xfree(old_msg->job_array);
+	old_msg->record_count = 0;
+	xfree(delta_msg->job_array);
+	delta_msg->job_array = job_array;
+	delta_msg->record_count = cnt;
+	delta_msg->delta = false;
+	xfree(delta_msg->purged_job_ids);
+	delta_msg->purged_cnt = 0;
+}
+
+/*
+ * slurm_load_job_changes - issue RPC to get all job configuration
+ *	information if changed since an earlier call, transferring only the
+ *	changed job records when the controller supports it
+ * IN old_job_ptr - job information returned by an earlier call with the
+ *	same show_flags or NULL. Set last_update to 0 to force a full load.
+ *	On success its job records are moved to the new message, but
+ *	old_job_ptr must still be freed with slurm_free_job_info_msg
+ * OUT job_info_msg_pptr - place to store a job configuration pointer
+ * IN show_flags - job filtering options, as for slurm_load_jobs
+ * IN filter - jobs the controller may omit or NULL, must be the same as for
+ *	old_job_ptr
+ * RET 0 or -1 on error, errno is SLURM_NO_CHANGE_IN_DATA if old_job_ptr
+ *	is still current
+ * NOTE: free the response using slurm_free_job_info_msg
+ */
+extern int slurm_load_job_changes(job_info_msg_t *old_job_ptr,
+				  job_info_msg_t **job_info_msg_pptr,
+				  uint16_t show_flags, info_filter_t *filter)
+{
+	time_t update_time = (time_t) 0;
+	uint64_t delta_cursor = JOB_INFO_CURSOR_START;
+	int rc;
+
+	if (old_job_ptr && old_job_ptr->last_update) {
+		update_time = old_job_ptr->last_update;
+		if (old_job_ptr->delta_cursor)
+			delta_cursor = old_job_ptr->delta_cursor;
+	}
+
+	rc = _load_jobs(update_time, delta_cursor, filter, job_info_msg_pptr,
+			show_flags);
+	if ((rc == SLURM_SUCCESS) && (*job_info_msg_pptr)->delta) {
+		if (!old_job_ptr) {
+			slurm_free_job_info_msg(*job_info_msg_pptr);
+			*job_info_msg_pptr = NULL;
+			slurm_seterrno_ret(SLURM_UNEXPECTED_MSG_ERROR);
+		}
+		_merge_job_changes(old_job_ptr, *job_info_msg_pptr);
+	}
+
+	return rc;
+}
+
 /*
  * slurm_load_job_user - issue RPC to get slurm information about all jobs
  *	to be run as the specified user
@@ -490,6 +490,8 @@ static void _set_node_mixed(node_info_msg_t *resp)
 	for (i = 0, node_ptr = resp->node_array;
 	     i < resp->record_count; i++, node_ptr++) {
 		uint16_t used_cpus = 0;
+		if (!node_ptr->select_nodeinfo)
+			continue;	/* not packed due to a filter */
 		select_g_select_nodeinfo_get(node_ptr->select_nodeinfo,
 					     SELECT_NODEDATA_SUBCNT,
 					     NODE_STATE_ALLOCATED, &used_cpus);
@@ -675,9 +677,21 @@ static int _load_fed_nodes(slurm_msg_t *req_msg,
  */
 extern int slurm_load_node(time_t update_time, node_info_msg_t **resp,
 			   uint16_t show_flags)
+{
+	return slurm_load_node_filtered(update_time, resp, show_flags, NULL);
+}
+
+/*
+ * slurm_load_node_filtered - equivalent to slurm_load_node() with a filter
+ *	of nodes and partitions evaluated by the controller. Records of nodes
+ *	not selected are returned with a NULL name.
+ */
+extern int slurm_load_node_filtered(time_t update_time,
+				    node_info_msg_t **resp,
+				    uint16_t show_flags, info_filter_t *filter)
 {
 	slurm_msg_t req_msg;
-	node_info_request_msg_t req;
+	node_info_request_msg_t req = {0};
 	char *cluster_name = NULL;
 	void *ptr = NULL;
 	slurmdb_federation_rec_t *fed;
@@ -702,6 +716,7 @@ extern int slurm_load_node(time_t update_time, node_info_msg_t **resp,
 	slurm_msg_t_init(&req_msg);
 	req.last_update  = update_time;
 	req.show_flags   = show_flags;
+	req.filter       = filter;
 	req_msg.msg_type = REQUEST_NODE_INFO;
 	req_msg.data     = &req;
 
@@ -729,7 +744,7 @@ extern int slurm_load_node2(time_t update_time, node_info_msg_t **resp,
 			    uint16_t show_flags, slurmdb_cluster_rec_t *cluster)
 {
 	slurm_msg_t req_msg;
-	node_info_request_msg_t req;
+	node_info_request_msg_t req = {0};
 
 	slurm_msg_t_init(&req_msg);
 	req.last_update  = update_time;
@@ -40,11 +40,15 @@
 \****************************************************************************/
 
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <netinet/in.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "slurm/slurm_errno.h"
 #include "slurm/slurm.h"
@@ -117,6 +121,7 @@ Buf create_buf(char *data, uint32_t size)
 	my_buf->size = size;
 	my_buf->processed = 0;
 	my_buf->head = data;
+	my_buf->mmaped = false;
 
 	return my_buf;
 }
@@ -127,10 +132,66 @@ void free_buf(Buf my_buf)
 	if (!my_buf)
 		return;
 	assert(my_buf->magic == BUF_MAGIC);
-	xfree(my_buf->head);
+	if (my_buf->mmaped)
+		munmap(my_buf->head, my_buf->size);
+	else
+		xfree(my_buf->head);
 	xfree(my_buf);
 }
 
+/*
+ * create_mmap_buf - create a read-only buffer holding the contents of a file.
+ *	The file is mapped rather than read, so pages are only faulted in as
+ *	they are unpacked. Use for large state files, release with free_buf().
+ * IN file - name of the file to map
+ * RET buffer or NULL on error, errno is set
+ */
+Buf create_mmap_buf(const char *file)
+{
+	Buf my_buf;
+	struct stat stat_buf;
+	void *data = NULL;
+	int fd;
+
+	if ((fd = open(file, O_RDONLY | O_CLOEXEC)) < 0) {
+		debug("%s: Failed to open file `%s`, %m", __func__, file);
+		return NULL;
+	}
+	if (fstat(fd, &stat_buf) < 0) {
+		debug("%s: Failed to fstat file `%s`, %m", __func__, file);
+		close(fd);
+		return NULL;
+	}
+	if (stat_buf.st_size > MAX_BUF_SIZE) {
+		error("%s: Buffer size limit exceeded (%"PRIu64" > %u)",
+		      __func__, (uint64_t) stat_buf.st_size, MAX_BUF_SIZE);
+		close(fd);
+		errno = EFBIG;
+		return NULL;
+	}
+	if (stat_buf.st_size) {
+		data = mmap(NULL, stat_buf.st_size, PROT_READ, MAP_PRIVATE,
+			    fd, 0);
+		if (data == MAP_FAILED) {
+			debug("%s: Failed to mmap file `%s`, %m",
+			      __func__, file);
+			close(fd);
+			return NULL;
+		}
+		(void) madvise(data, stat_buf.st_size, MADV_SEQUENTIAL);
+	}
+	close(fd);
+
+	my_buf = xmalloc_nz(sizeof(struct slurm_buf));
+	my_buf->magic = BUF_MAGIC;
+	my_buf->size = stat_buf.st_size;
+	my_buf->processed = 0;
+	my_buf->head = data;
+	my_buf->mmaped = (data != NULL);
+
+	return my_buf;
+}
+
 /* Grow a buffer by the specified amount */
 void grow_buf (Buf buffer, uint32_t size)
 {
@@ -161,6 +222,7 @@ Buf init_buf(uint32_t size)
 	my_buf->size = size;
 	my_buf->processed = 0;
 	my_buf->head = xmalloc(sizeof(char)*size);
+	my_buf->mmaped = false;
 	return my_buf;
 }
 
@@ -171,6 +233,7 @@ void *xfer_buf_data(Buf my_buf)
 	void *data_ptr;
 
 	assert(my_buf->magic == BUF_MAGIC);
+	assert(!my_buf->mmaped);
 	data_ptr = (void *) my_buf->head;
 	xfree(my_buf);
 	return data_ptr;
@@ -3444,81 +3444,28 @@ endit:
 }
 
 /*
+ * Unpack a message and its forwarded responses, as received from fd by
+ *	slurm_receive_msgs(). buffer (not including the message length)
+ *	is consumed.
  * NOTE: memory is allocated for the returned list
  *       and must be freed at some point using the list_destroy function.
- * IN open_fd	- file descriptor to receive msg on
- * IN steps	- how many steps down the tree we have to wait for
- * IN timeout	- how long to wait in milliseconds
- * RET List	- List containing the responses of the children (if any) we
- *		  forwarded the message to. List containing type
- *		  (ret_data_info_t).
+ * IN fd	- file descriptor the message was received on
+ * IN buffer	- message received
+ * RET List	- List of ret_data_info_t as from slurm_receive_msgs(), or NULL
+ *		  on failure. errno is set to the message's error code.
  */
-List slurm_receive_msgs(int fd, int steps, int timeout)
+extern List slurm_unpack_received_msgs(int fd, Buf buffer)
 {
-	char *buf = NULL;
-	size_t buflen = 0;
 	header_t header;
 	int rc;
 	void *auth_cred = NULL;
 	slurm_msg_t msg;
-	Buf buffer;
 	ret_data_info_t *ret_data_info = NULL;
 	List ret_list = NULL;
-	int orig_timeout = timeout;
-
-	xassert(fd >= 0);
 
 	slurm_msg_t_init(&msg);
 	msg.conn_fd = fd;
 
-	if (timeout <= 0) {
-		/* convert secs to msec */
-		timeout  = slurm_get_msg_timeout() * 1000;
-		orig_timeout = timeout;
-	}
-	if (steps) {
-		if (message_timeout < 0)
-			message_timeout = slurm_get_msg_timeout() * 1000;
-		orig_timeout = (timeout -
-				(message_timeout*(steps-1)))/steps;
-		steps--;
-	}
-
-	debug4("orig_timeout was %d we have %d steps and a timeout of %d",
-	       orig_timeout, steps, timeout);
-	/* we compare to the orig_timeout here because that is really
-	 *  what we are going to wait for each step
-	 */
-	if (orig_timeout >= (slurm_get_msg_timeout() * 10000)) {
-		debug("slurm_receive_msgs: "
-		      "You are sending a message with timeout's greater "
-		      "than %d seconds, your's is %d seconds",
-		      (slurm_get_msg_timeout() * 10),
-		      (timeout/1000));
-	} else if (orig_timeout < 1000) {
-		debug("slurm_receive_msgs: "
-		      "You are sending a message with a very short timeout of "
-		      "%d milliseconds each step in the tree has %d "
-		      "milliseconds", timeout, orig_timeout);
-	}
-
-
-	/*
-	 * Receive a msg. slurm_msg_recvfrom() will read the message
-	 *  length and allocate space on the heap for a buffer containing
-	 *  the message.
-	 */
-	if (slurm_msg_recvfrom_timeout(fd, &buf, &buflen, 0, timeout) < 0) {
-		forward_init(&header.forward, NULL);
-		rc = errno;
-		goto total_return;
-	}
-
-#if	_DEBUG
-	_print_data (buf, buflen);
-#endif
-	buffer = create_buf(buf, buflen);
-
 	if (unpack_header(&header, buffer) == SLURM_ERROR) {
 		free_buf(buffer);
 		rc = SLURM_COMMUNICATIONS_RECEIVE_ERROR;
@@ -3614,8 +3561,6 @@ total_return:
 			ret_data_info->data = NULL;
 			list_push(ret_list, ret_data_info);
 		}
-		error("slurm_receive_msgs: %s", slurm_strerror(rc));
-		usleep(10000);	/* Discourage brute force attack */
 	} else {
 		if (!ret_list)
 			ret_list = list_create(destroy_data_info);
@@ -3627,6 +3572,86 @@ total_return:
 		list_push(ret_list, ret_data_info);
 	}
 
+	errno = rc;
+	return ret_list;
+}
+
+/*
+ * NOTE: memory is allocated for the returned list
+ *       and must be freed at some point using the list_destroy function.
+ * IN open_fd	- file descriptor to receive msg on
+ * IN steps	- how many steps down the tree we have to wait for
+ * IN timeout	- how long to wait in milliseconds
+ * RET List	- List containing the responses of the children (if any) we
+ *		  forwarded the message to. List containing type
+ *		  (ret_data_info_t).
+ */
+List slurm_receive_msgs(int fd, int steps, int timeout)
+{
+	char *buf = NULL;
+	size_t buflen = 0;
+	int rc;
+	Buf buffer;
+	List ret_list = NULL;
+	int orig_timeout = timeout;
+
+	xassert(fd >= 0);
+
+	if (timeout <= 0) {
+		/* convert secs to msec */
+		timeout  = slurm_get_msg_timeout() * 1000;
+		orig_timeout = timeout;
+	}
+	if (steps) {
+		if (message_timeout < 0)
+			message_timeout = slurm_get_msg_timeout() * 1000;
+		orig_timeout = (timeout -
+				(message_timeout*(steps-1)))/steps;
+		steps--;
+	}
+
+	debug4("orig_timeout was %d we have %d steps and a timeout of %d",
+	       orig_timeout, steps, timeout);
+	/* we compare to the orig_timeout here because that is really
+	 *  what we are going to wait for each step
+	 */
+	if (orig_timeout >= (slurm_get_msg_timeout() * 10000)) {
+		debug("slurm_receive_msgs: "
+		      "You are sending a message with timeout's greater "
+		      "than %d seconds, your's is %d seconds",
+		      (slurm_get_msg_timeout() * 10),
+		      (timeout/1000));
+	} else if (orig_timeout < 1000) {
+		debug("slurm_receive_msgs: "
+		      "You are sending a message with a very short timeout of "
+		      "%d milliseconds each step in the tree has %d "
+		      "milliseconds", timeout, orig_timeout);
+	}
+
+
+	/*
+	 * Receive a msg. slurm_msg_recvfrom() will read the message
+	 *  length and allocate space on the heap for a buffer containing
+	 *  the message.
+	 */
+	if (slurm_msg_recvfrom_timeout(fd, &buf, &buflen, 0, timeout) < 0) {
+		rc = errno;
+		goto total_return;
+	}
+
+#if	_DEBUG
+	_print_data (buf, buflen);
+#endif
+	buffer = create_buf(buf, buflen);
+
+	ret_list = slurm_unpack_received_msgs(fd, buffer);
+	rc = errno;
+
+total_return:
+	if (rc != SLURM_SUCCESS) {
+		error("slurm_receive_msgs: %s", slurm_strerror(rc));
+		usleep(10000);	/* Discourage brute force attack */
+	}
 
 	errno = rc;
 	return ret_list;
@@ -3887,13 +3912,90 @@ _pack_msg(slurm_msg_t *msg, header_t *hdr, Buf buffer)
 	set_buf_offset(buffer, tmplen);
 }
 
+/*
+ *  Pack header, auth credential and body of msg into a new buffer,
+ *    consuming auth_cred. Returns NULL and sets errno on failure.
+ */
+static Buf _pack_node_msg(slurm_msg_t *msg, void *auth_cred)
+{
+	header_t header;
+	Buf buffer;
+	int rc;
+
+	if (auth_cred == NULL) {
+		error("authentication: %s",
+		      g_slurm_auth_errstr(g_slurm_auth_errno(NULL)) );
+		slurm_seterrno(SLURM_PROTOCOL_AUTHENTICATION_ERROR);
+		return NULL;
+	}
+
+	init_header(&header, msg, msg->flags);
+
+	/*
+	 * Pack header into buffer for transmission
+	 */
+	buffer = init_buf(BUF_SIZE);
+	pack_header(&header, buffer);
+
+	/*
+	 * Pack auth credential
+	 */
+	rc = g_slurm_auth_pack(auth_cred, buffer);
+	(void) g_slurm_auth_destroy(auth_cred);
+	if (rc) {
+		error("authentication: %s",
+		      g_slurm_auth_errstr(g_slurm_auth_errno(auth_cred)));
+		free_buf(buffer);
+		slurm_seterrno(SLURM_PROTOCOL_AUTHENTICATION_ERROR);
+		return NULL;
+	}
+
+	/*
+	 * Pack message into buffer
+	 */
+	_pack_msg(msg, &header, buffer);
+
+	return buffer;
+}
+
+/*
+ *  Pack a slurm message as slurm_send_node_msg() would send it, without
+ *    the leading message length, for callers writing to non-blocking
+ *    sockets. Forwarding by the sender (msg->forward_struct) is not
+ *    supported. Returns NULL and sets errno on failure.
+ */
+extern Buf slurm_pack_node_msg(slurm_msg_t *msg)
+{
+	void *auth_cred;
+
+	xassert(!msg->conn);
+	xassert(!msg->forward_struct);
+
+	if (msg->flags & SLURM_GLOBAL_AUTH_KEY) {
+		auth_cred = g_slurm_auth_create(_global_auth_key());
+	} else {
+		char *auth_info = slurm_get_auth_info();
+		auth_cred = g_slurm_auth_create(auth_info);
+		xfree(auth_info);
+	}
+
+	if (msg->forward.init != FORWARD_INIT) {
+		forward_init(&msg->forward, NULL);
+		msg->ret_list = NULL;
+	}
+
+	if (!msg->forward.tree_width)
+		msg->forward.tree_width = slurm_get_tree_width();
+
+	return _pack_node_msg(msg, auth_cred);
+}
+
 /*
  *  Send a slurm message over an open file descriptor `fd'
  *    Returns the size of the message sent in bytes, or -1 on failure.
  */
 int slurm_send_node_msg(int fd, slurm_msg_t * msg)
 {
-	header_t header;
 	Buf      buffer;
 	int      rc;
 	void *   auth_cred;
@@ -3968,36 +4070,8 @@ int slurm_send_node_msg(int fd, slurm_msg_t * msg)
 			xfree(auth_info);
 		}
 	}
-	if (auth_cred == NULL) {
-		error("authentication: %s",
-		      g_slurm_auth_errstr(g_slurm_auth_errno(NULL)) );
-		slurm_seterrno_ret(SLURM_PROTOCOL_AUTHENTICATION_ERROR);
-	}
-
-	init_header(&header, msg, msg->flags);
-
-	/*
-	 * Pack header into buffer for transmission
-	 */
-	buffer = init_buf(BUF_SIZE);
-	pack_header(&header, buffer);
-
-	/*
-	 * Pack auth credential
-	 */
-	rc = g_slurm_auth_pack(auth_cred, buffer);
-	(void) g_slurm_auth_destroy(auth_cred);
-	if (rc) {
-		error("authentication: %s",
-		      g_slurm_auth_errstr(g_slurm_auth_errno(auth_cred)));
-		free_buf(buffer);
-		slurm_seterrno_ret(SLURM_PROTOCOL_AUTHENTICATION_ERROR);
-	}
-
-	/*
-	 * Pack message into buffer
-	 */
-	_pack_msg(msg, &header, buffer);
+	if (!(buffer = _pack_node_msg(msg, auth_cred)))
+		return SLURM_ERROR;
 
 #if	_DEBUG
 	_print_data (get_buf_data(buffer),get_buf_offset(buffer));
@@ -4570,6 +4644,27 @@ tryagain:
 			} else {
 				retry = 1;
 			}
+		} else if ((rc == 0)
+		    && (response_msg->msg_type == RESPONSE_SLURM_RC)
+		    && ((((return_code_msg_t *)response_msg->data)->return_code)
+			== ESLURM_CONTROLLER_BUSY)
+		    && (difftime(time(NULL), start_time)
+			< slurm_get_msg_timeout())) {
+			/*
+			 * Low priority request shed by a heavily loaded
+			 * slurmctld, back off and try again
+			 */
+			debug("Controller busy, sleep and retry");
+			slurm_free_return_code_msg(response_msg->data);
+			sleep(1);
+			if ((fd = slurm_open_controller_conn(&ctrl_addr,
+							     &use_backup,
+							     comm_cluster_rec))
+			    < 0) {
+				rc = -1;
+			} else {
+				retry = 1;
+			}
 		}
 
 		if (rc == -1)
@@ -1042,6 +1042,18 @@ int slurm_receive_msg(int fd, slurm_msg_t *msg, int timeout);
  */
 List slurm_receive_msgs(int fd, int steps, int timeout);
 
+/*
+ *  Unpack a message received on "fd" as slurm_receive_msgs() would,
+ *    for callers doing their own (non-blocking) reads. The buffer holds
+ *    the message without its leading length and is consumed.
+ *
+ * IN fd	- file descriptor the message was received on
+ * IN buffer	- message received
+ * RET List	- List of ret_data_info_t as from slurm_receive_msgs(),
+ *                NULL on failure. errno is set.
+ */
+extern List slurm_unpack_received_msgs(int fd, Buf buffer);
+
 /*
  *  Receive a slurm message on the open slurm descriptor "fd" waiting
  *    at most "timeout" seconds for the message data. This will also
@@ -1074,6 +1086,15 @@ int slurm_receive_msg_and_forward(int fd, slurm_addr_t *orig_addr,
  */
 int slurm_send_node_msg(int open_fd, slurm_msg_t *msg);
 
+/* pack a message as slurm_send_node_msg() would send it, less the leading
+ *	message length, for callers doing their own (non-blocking) writes
+ *
+ * IN msg		- a slurm msg struct to be packed, must not
+ *			  have a forward_struct
+ * RET Buf		- packed message, NULL on failure and sets errno
+ */
+extern Buf slurm_pack_node_msg(slurm_msg_t *msg);
+
 /**********************************************************************\
  * msg connection establishment functions used by msg clients
 \**********************************************************************/
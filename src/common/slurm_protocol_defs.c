@@ -754,10 +754,24 @@ extern void slurm_free_job_step_kill_msg(job_step_kill_msg_t * msg)
 	}
 }
 
+extern void slurm_free_info_filter(info_filter_t *filter)
+{
+	if (filter) {
+		xfree(filter->accounts);
+		xfree(filter->names);
+		xfree(filter->nodes);
+		xfree(filter->partitions);
+		xfree(filter->states);
+		xfree(filter->user_ids);
+		xfree(filter);
+	}
+}
+
 extern void slurm_free_job_info_request_msg(job_info_request_msg_t *msg)
 {
 	if (msg) {
 		FREE_NULL_LIST(msg->job_ids);
+		slurm_free_info_filter(msg->filter);
 		xfree(msg);
 	}
 }
@@ -775,7 +789,10 @@ extern void slurm_free_front_end_info_request_msg
 
 extern void slurm_free_node_info_request_msg(node_info_request_msg_t *msg)
 {
-	xfree(msg);
+	if (msg) {
+		slurm_free_info_filter(msg->filter);
+		xfree(msg);
+	}
 }
 
 extern void slurm_free_node_info_single_msg(node_info_single_msg_t *msg)
@@ -786,6 +803,26 @@ extern void slurm_free_node_info_single_msg(node_info_single_msg_t *msg)
 	}
 }
 
+extern void slurm_free_event_subscribe_msg(event_subscribe_msg_t *msg)
+{
+	if (msg) {
+		slurm_free_info_filter(msg->filter);
+		xfree(msg);
+	}
+}
+
+extern void slurm_free_event_notify_msg(event_notify_msg_t *msg)
+{
+	uint32_t i;
+
+	if (msg) {
+		for (i = 0; i < msg->event_cnt; i++)
+			xfree(msg->events[i].name);
+		xfree(msg->events);
+		xfree(msg);
+	}
+}
+
 extern void slurm_free_part_info_request_msg(part_info_request_msg_t *msg)
 {
 	xfree(msg);
@@ -1537,6 +1574,52 @@ extern void slurm_free_stats_response_msg(stats_info_response_msg_t *msg)
 			xfree(msg->rpc_dump_hostlist[i]);
 		}
 		xfree(msg->rpc_dump_hostlist);
+		xfree(msg->rpc_class_max);
+		xfree(msg->rpc_class_active);
+		xfree(msg->rpc_class_queued);
+		xfree(msg->rpc_class_cnt);
+		xfree(msg->rpc_class_shed);
+		xfree(msg->rpc_class_time);
+		xfree(msg->rpc_class_wait);
+		for (i = 0; msg->lock_stat_name && (i < msg->lock_stat_size);
+		     i++)
+			xfree(msg->lock_stat_name[i]);
+		xfree(msg->lock_stat_name);
+		xfree(msg->lock_stat_cnt);
+		xfree(msg->lock_stat_wait);
+		xfree(msg->lock_stat_wait_max);
+		xfree(msg->lock_stat_hold);
+		xfree(msg->lock_stat_hold_max);
+		xfree(msg->lock_stat_wait_hist);
+		xfree(msg->lock_stat_hold_hist);
+		for (i = 0; msg->lock_site_name && (i < msg->lock_site_size);
+		     i++)
+			xfree(msg->lock_site_name[i]);
+		xfree(msg->lock_site_name);
+		xfree(msg->lock_site_cnt);
+		xfree(msg->lock_site_wait);
+		xfree(msg->lock_site_wait_max);
+		xfree(msg->lock_site_hold);
+		xfree(msg->lock_site_hold_max);
+		xfree(msg->lock_site_long);
+		xfree(msg->rpc_type_p50);
+		xfree(msg->rpc_type_p90);
+		xfree(msg->rpc_type_p99);
+		xfree(msg->rpc_type_max);
+		xfree(msg->rpc_user_p50);
+		xfree(msg->rpc_user_p90);
+		xfree(msg->rpc_user_p99);
+		xfree(msg->rpc_user_max);
+		xfree(msg->history_time);
+		xfree(msg->history_sched_cycles);
+		xfree(msg->history_sched_mean);
+		xfree(msg->history_bf_cycles);
+		xfree(msg->history_bf_mean);
+		xfree(msg->history_agent_queue);
+		xfree(msg->history_dbd_queue);
+		xfree(msg->history_server_threads);
+		xfree(msg->history_jobs_pending);
+		xfree(msg->history_jobs_running);
 		xfree(msg);
 	}
 }
@@ -3482,6 +3565,7 @@ extern void slurm_free_job_info_msg(job_info_msg_t * job_buffer_ptr)
 			_free_all_job_info(job_buffer_ptr);
 			xfree(job_buffer_ptr->job_array);
 		}
+		xfree(job_buffer_ptr->purged_job_ids);
 		xfree(job_buffer_ptr);
 	}
 }
@@ -4347,6 +4431,7 @@ extern int slurm_free_msg_data(slurm_msg_type_t type, void *data)
 	case REQUEST_POWERCAP_INFO:
 	case ACCOUNTING_REGISTER_CTLD:
 	case REQUEST_FED_INFO:
+	case REQUEST_STATE_REPL:
 		/* No body to free */
 		break;
 	case RESPONSE_FED_INFO:
@@ -4394,6 +4479,7 @@ extern int slurm_free_msg_data(slurm_msg_type_t type, void *data)
 		break;
 	case MESSAGE_COMPOSITE:
 	case RESPONSE_MESSAGE_COMPOSITE:
+	case REQUEST_COMPOSITE:
 		slurm_free_composite_msg(data);
 		break;
 	case REQUEST_JOB_NOTIFY:
@@ -4478,6 +4564,12 @@ extern int slurm_free_msg_data(slurm_msg_type_t type, void *data)
 	case RESPONSE_BURST_BUFFER_STATUS:
 		slurm_free_bb_status_resp_msg(data);
 		break;
+	case REQUEST_EVENT_SUBSCRIBE:
+		slurm_free_event_subscribe_msg(data);
+		break;
+	case MESSAGE_EVENT_NOTIFY:
+		slurm_free_event_notify_msg(data);
+		break;
 	default:
 		error("invalid type trying to be freed %u", type);
 		break;
@@ -4754,6 +4846,12 @@ rpc_num2string(uint16_t opcode)
 		return "REQUEST_BURST_BUFFER_STATUS";
 	case RESPONSE_BURST_BUFFER_STATUS:
 		return "RESPONSE_BURST_BUFFER_STATUS";
+	case REQUEST_EVENT_SUBSCRIBE:
+		return "REQUEST_EVENT_SUBSCRIBE";
+	case MESSAGE_EVENT_NOTIFY:
+		return "MESSAGE_EVENT_NOTIFY";
+	case REQUEST_STATE_REPL:
+		return "REQUEST_STATE_REPL";
 
 	case REQUEST_UPDATE_JOB:				/* 3001 */
 		return "REQUEST_UPDATE_JOB";
@@ -4962,6 +5060,8 @@ rpc_num2string(uint16_t opcode)
 		return "REQUEST_COMPLETE_PROLOG";
 	case RESPONSE_PROLOG_EXECUTING:				/* 6019 */
 		return "RESPONSE_PROLOG_EXECUTING";
+	case REQUEST_COMPOSITE:					/* 6020 */
+		return "REQUEST_COMPOSITE";
 
 	case SRUN_PING:						/* 7001 */
 		return "SRUN_PING";
@@ -61,6 +61,9 @@
 #define MAX_SLURM_NAME 64
 #define FORWARD_INIT 0xfffe
 
+/* job_info_request_msg_t delta_cursor requesting a cursor for later use */
+#define JOB_INFO_CURSOR_START 1
+
 /* Defined job states */
 #define IS_JOB_PENDING(_X)		\
 	((_X->job_state & JOB_STATE_BASE) == JOB_PENDING)
@@ -275,6 +278,9 @@ typedef enum {
 	RESPONSE_CONTROL_STATUS,
 	REQUEST_BURST_BUFFER_STATUS,
 	RESPONSE_BURST_BUFFER_STATUS,
+	REQUEST_EVENT_SUBSCRIBE,
+	MESSAGE_EVENT_NOTIFY,
+	REQUEST_STATE_REPL,
 
 	REQUEST_UPDATE_JOB = 3001,
 	REQUEST_UPDATE_NODE,
@@ -389,6 +395,7 @@ typedef enum {
 	REQUEST_LAUNCH_PROLOG,
 	REQUEST_COMPLETE_PROLOG,
 	RESPONSE_PROLOG_EXECUTING,	/* 6019 */
+	REQUEST_COMPOSITE,		/* several requests to one slurmd */
 
 	REQUEST_PERSIST_INIT = 6500,
 
@@ -607,6 +614,11 @@ typedef struct job_info_request_msg {
 	uint16_t show_flags;
 	List   job_ids;		/* Optional list of job_ids, otherwise show all
 				 * jobs. */
+	uint64_t delta_cursor;	/* delta_cursor of the client's job_info_msg_t
+				 * to receive only changed jobs,
+				 * JOB_INFO_CURSOR_START to receive all jobs
+				 * plus a cursor, 0 for neither */
+	info_filter_t *filter;	/* Optional, evaluated before packing */
 } job_info_request_msg_t;
 
 typedef struct job_step_info_request_msg {
@@ -619,8 +631,14 @@ typedef struct job_step_info_request_msg {
 typedef struct node_info_request_msg {
 	time_t last_update;
 	uint16_t show_flags;
+	info_filter_t *filter;	/* Optional, evaluated before packing */
 } node_info_request_msg_t;
 
+typedef struct event_subscribe_msg {
+	uint16_t event_types;	/* EVENT_TYPE_* flags */
+	info_filter_t *filter;	/* Optional, evaluated before sending */
+} event_subscribe_msg_t;
+
 typedef struct node_info_single_msg {
 	char *node_name;
 	uint16_t show_flags;
@@ -1350,6 +1368,7 @@ extern void slurm_free_last_update_msg(last_update_msg_t * msg);
 extern void slurm_free_return_code_msg(return_code_msg_t * msg);
 extern void slurm_free_reroute_msg(reroute_msg_t *msg);
 extern void slurm_free_job_alloc_info_msg(job_alloc_info_msg_t * msg);
+extern void slurm_free_info_filter(info_filter_t *filter);
 extern void slurm_free_job_info_request_msg(job_info_request_msg_t *msg);
 extern void slurm_free_job_step_info_request_msg(
 		job_step_info_request_msg_t *msg);
@@ -1357,6 +1376,7 @@ extern void slurm_free_front_end_info_request_msg(
 		front_end_info_request_msg_t *msg);
 extern void slurm_free_node_info_request_msg(node_info_request_msg_t *msg);
 extern void slurm_free_node_info_single_msg(node_info_single_msg_t *msg);
+extern void slurm_free_event_subscribe_msg(event_subscribe_msg_t *msg);
 extern void slurm_free_part_info_request_msg(part_info_request_msg_t *msg);
 extern void slurm_free_sib_msg(sib_msg_t *msg);
 extern void slurm_free_stats_info_request_msg(stats_info_request_msg_t *msg);
@@ -790,6 +790,16 @@ static void _pack_bb_status_resp_msg(bb_status_resp_msg_t *msg, Buf buffer,
 static int _unpack_bb_status_resp_msg(bb_status_resp_msg_t **msg_ptr,
 				      Buf buffer, uint16_t protocol_version);
 
+static void _pack_event_subscribe_msg(event_subscribe_msg_t *msg, Buf buffer,
+				      uint16_t protocol_version);
+static int _unpack_event_subscribe_msg(event_subscribe_msg_t **msg_ptr,
+				       Buf buffer, uint16_t protocol_version);
+
+static void _pack_event_notify_msg(event_notify_msg_t *msg, Buf buffer,
+				   uint16_t protocol_version);
+static int _unpack_event_notify_msg(event_notify_msg_t **msg_ptr,
+				    Buf buffer, uint16_t protocol_version);
+
 /* pack_header
  * packs a slurm protocol header that precedes every slurm message
  * IN header - the header structure to pack
@@ -1021,6 +1031,7 @@ pack_msg(slurm_msg_t const *msg, Buf buffer)
 	case REQUEST_BURST_BUFFER_INFO:
 	case REQUEST_POWERCAP_INFO:
 	case REQUEST_FED_INFO:
+	case REQUEST_STATE_REPL:
 		/* Message contains no body/information */
 		break;
 	case REQUEST_ACCT_GATHER_ENERGY:
@@ -1520,6 +1531,7 @@ pack_msg(slurm_msg_t const *msg, Buf buffer)
 		break;
 	case MESSAGE_COMPOSITE:
 	case RESPONSE_MESSAGE_COMPOSITE:
+	case REQUEST_COMPOSITE:
 		_pack_composite_msg((composite_msg_t *) msg->data, buffer,
 				     msg->protocol_version);
 		break;
@@ -1571,6 +1583,14 @@ pack_msg(slurm_msg_t const *msg, Buf buffer)
 		_pack_bb_status_resp_msg((bb_status_resp_msg_t *)(msg->data),
 					 buffer, msg->protocol_version);
 		break;
+	case REQUEST_EVENT_SUBSCRIBE:
+		_pack_event_subscribe_msg((event_subscribe_msg_t *)(msg->data),
+					  buffer, msg->protocol_version);
+		break;
+	case MESSAGE_EVENT_NOTIFY:
+		_pack_event_notify_msg((event_notify_msg_t *)(msg->data),
+				       buffer, msg->protocol_version);
+		break;
 	default:
 		debug("No pack method for msg type %u", msg->msg_type);
 		return EINVAL;
@@ -1723,6 +1743,7 @@ unpack_msg(slurm_msg_t * msg, Buf buffer)
 	case REQUEST_BURST_BUFFER_INFO:
 	case REQUEST_POWERCAP_INFO:
 	case REQUEST_FED_INFO:
+	case REQUEST_STATE_REPL:
 		/* Message contains no body/information */
 		break;
 	case REQUEST_ACCT_GATHER_ENERGY:
@@ -2268,6 +2289,7 @@ unpack_msg(slurm_msg_t * msg, Buf buffer)
 		break;
 	case MESSAGE_COMPOSITE:
 	case RESPONSE_MESSAGE_COMPOSITE:
+	case REQUEST_COMPOSITE:
 		rc = _unpack_composite_msg((composite_msg_t **) &(msg->data),
 					    buffer, msg->protocol_version);
 		break;
@@ -2327,6 +2349,16 @@ unpack_msg(slurm_msg_t * msg, Buf buffer)
 			(bb_status_resp_msg_t **)&(msg->data), buffer,
 			msg->protocol_version);
 		break;
+	case REQUEST_EVENT_SUBSCRIBE:
+		rc = _unpack_event_subscribe_msg(
+			(event_subscribe_msg_t **)&(msg->data), buffer,
+			msg->protocol_version);
+		break;
+	case MESSAGE_EVENT_NOTIFY:
+		rc = _unpack_event_notify_msg(
+			(event_notify_msg_t **)&(msg->data), buffer,
+			msg->protocol_version);
+		break;
 	default:
 		debug("No unpack method for msg type %u", msg->msg_type);
 		return EINVAL;
@@ -3887,6 +3919,7 @@ static int _unpack_node_info_msg(node_info_msg_t **msg, Buf buffer,
 {
 	int i;
 	node_info_msg_t *tmp_ptr;
+	bitstr_t *packed_bitmap = NULL;
 
 	xassert(msg != NULL);
 	tmp_ptr = xmalloc(sizeof(node_info_msg_t));
@@ -3896,17 +3929,25 @@ static int _unpack_node_info_msg(node_info_msg_t **msg, Buf buffer,
 	if (protocol_version >= SLURM_18_08_PROTOCOL_VERSION) {
 		safe_unpack32(&tmp_ptr->record_count, buffer);
 		safe_unpack_time(&tmp_ptr->last_update, buffer);
+		/* nodes packed, others were excluded by a filter */
+		unpack_bit_str_hex(&packed_bitmap, buffer);
+		if (packed_bitmap &&
+		    (bit_size(packed_bitmap) != tmp_ptr->record_count))
+			goto unpack_error;
 
 		tmp_ptr->node_array = xmalloc(sizeof(node_info_t) *
 					      tmp_ptr->record_count);
 
 		/* load individual job info */
 		for (i = 0; i < tmp_ptr->record_count; i++) {
+			if (packed_bitmap && !bit_test(packed_bitmap, i))
+				continue;
 			if (_unpack_node_info_members(&tmp_ptr->node_array[i],
 						      buffer,
 						      protocol_version))
 				goto unpack_error;
 		}
+		FREE_NULL_BITMAP(packed_bitmap);
 	} else if (protocol_version >= SLURM_MIN_PROTOCOL_VERSION) {
 		uint32_t uint32_tmp;
 		safe_unpack32(&tmp_ptr->record_count, buffer);
@@ -3931,6 +3972,7 @@ static int _unpack_node_info_msg(node_info_msg_t **msg, Buf buffer,
 	return SLURM_SUCCESS;
 
 unpack_error:
+	FREE_NULL_BITMAP(packed_bitmap);
 	slurm_free_node_info_msg(tmp_ptr);
 	*msg = NULL;
 	return SLURM_ERROR;
@@ -5929,13 +5971,34 @@ _unpack_job_info_msg(job_info_msg_t ** msg, Buf buffer,
 		     uint16_t protocol_version)
 {
 	int i;
+	uint8_t uint8_tmp;
 	job_info_t *job = NULL;
 
 	xassert(msg != NULL);
 	*msg = xmalloc(sizeof(job_info_msg_t));
 
 	/* load buffer's header (data structure version and time) */
-	if (protocol_version >= SLURM_MIN_PROTOCOL_VERSION) {
+	if (protocol_version >= SLURM_18_08_PROTOCOL_VERSION) {
+		safe_unpack32(&((*msg)->record_count), buffer);
+		safe_unpack_time(&((*msg)->last_update), buffer);
+
+		if ((*msg)->record_count)
+			job = (*msg)->job_array = xmalloc(sizeof(job_info_t) *
+							  (*msg)->record_count);
+		/* load individual job info */
+		for (i = 0; i < (*msg)->record_count; i++) {
+			if (_unpack_job_info_members(&job[i], buffer,
+						     protocol_version))
+				goto unpack_error;
+		}
+
+		/* incremental update trailer */
+		safe_unpack64(&((*msg)->delta_cursor), buffer);
+		safe_unpack8(&uint8_tmp, buffer);
+		(*msg)->delta = uint8_tmp;
+		safe_unpack32_array(&((*msg)->purged_job_ids),
+				    &((*msg)->purged_cnt), buffer);
+	} else if (protocol_version >= SLURM_MIN_PROTOCOL_VERSION) {
 		safe_unpack32(&((*msg)->record_count), buffer);
 		safe_unpack_time(&((*msg)->last_update), buffer);
 
@@ -11702,6 +11765,51 @@ unpack_error:
 	return SLURM_ERROR;
 }
 
+static void _pack_info_filter(info_filter_t *filter, Buf buffer,
+			      uint16_t protocol_version)
+{
+	if (!filter) {
+		pack8(0, buffer);
+		return;
+	}
+
+	pack8(1, buffer);
+	packstr(filter->accounts, buffer);
+	packstr(filter->names, buffer);
+	packstr(filter->nodes, buffer);
+	packstr(filter->partitions, buffer);
+	pack32_array(filter->states, filter->state_cnt, buffer);
+	pack32_array(filter->user_ids, filter->user_cnt, buffer);
+}
+
+static int _unpack_info_filter(info_filter_t **filter_ptr, Buf buffer,
+			       uint16_t protocol_version)
+{
+	info_filter_t *filter;
+	uint32_t uint32_tmp;
+	uint8_t uint8_tmp;
+
+	*filter_ptr = NULL;
+	safe_unpack8(&uint8_tmp, buffer);
+	if (!uint8_tmp)
+		return SLURM_SUCCESS;
+
+	filter = xmalloc(sizeof(info_filter_t));
+	*filter_ptr = filter;
+	safe_unpackstr_xmalloc(&filter->accounts, &uint32_tmp, buffer);
+	safe_unpackstr_xmalloc(&filter->names, &uint32_tmp, buffer);
+	safe_unpackstr_xmalloc(&filter->nodes, &uint32_tmp, buffer);
+	safe_unpackstr_xmalloc(&filter->partitions, &uint32_tmp, buffer);
+	safe_unpack32_array(&filter->states, &filter->state_cnt, buffer);
+	safe_unpack32_array(&filter->user_ids, &filter->user_cnt, buffer);
+	return SLURM_SUCCESS;
+
+unpack_error:
+	slurm_free_info_filter(*filter_ptr);
+	*filter_ptr = NULL;
+	return SLURM_ERROR;
+}
+
 static void
 _pack_job_info_request_msg(job_info_request_msg_t * msg, Buf buffer,
 			   uint16_t protocol_version)
@@ -11712,7 +11820,24 @@ _pack_job_info_request_msg(job_info_request_msg_t * msg, Buf buffer,
 	xassert(msg);
 	xassert(buffer);
 
-	if (protocol_version >= SLURM_17_11_PROTOCOL_VERSION) {
+	if (protocol_version >= SLURM_18_08_PROTOCOL_VERSION) {
+		pack_time(msg->last_update, buffer);
+		pack16((uint16_t)msg->show_flags, buffer);
+
+		if (msg->job_ids)
+			count = list_count(msg->job_ids);
+
+		pack32(count, buffer);
+		if (count && count != NO_VAL) {
+			itr = list_iterator_create(msg->job_ids);
+			uint32_t *uint32_ptr;
+			while ((uint32_ptr = list_next(itr)))
+				pack32(*uint32_ptr, buffer);
+			list_iterator_destroy(itr);
+		}
+		pack64(msg->delta_cursor, buffer);
+		_pack_info_filter(msg->filter, buffer, protocol_version);
+	} else if (protocol_version >= SLURM_17_11_PROTOCOL_VERSION) {
 		pack_time(msg->last_update, buffer);
 		pack16((uint16_t)msg->show_flags, buffer);
 
@@ -11750,7 +11875,28 @@ _unpack_job_info_request_msg(job_info_request_msg_t** msg,
 	job_info = xmalloc(sizeof(job_info_request_msg_t));
 	*msg = job_info;
 
-	if (protocol_version >= SLURM_17_11_PROTOCOL_VERSION) {
+	if (protocol_version >= SLURM_18_08_PROTOCOL_VERSION) {
+		safe_unpack_time(&job_info->last_update, buffer);
+		safe_unpack16(&job_info->show_flags, buffer);
+
+		safe_unpack32(&count, buffer);
+		if (count > NO_VAL)
+			goto unpack_error;
+		if (count != NO_VAL) {
+			job_info->job_ids =
+				list_create(slurm_destroy_uint32_ptr);
+			for (i = 0; i < count; i++) {
+				uint32_ptr = xmalloc(sizeof(uint32_t));
+				safe_unpack32(uint32_ptr, buffer);
+				list_append(job_info->job_ids, uint32_ptr);
+				uint32_ptr = NULL;
+			}
+		}
+		safe_unpack64(&job_info->delta_cursor, buffer);
+		if (_unpack_info_filter(&job_info->filter, buffer,
+					protocol_version))
+			goto unpack_error;
+	} else if (protocol_version >= SLURM_17_11_PROTOCOL_VERSION) {
 		safe_unpack_time(&job_info->last_update, buffer);
 		safe_unpack16(&job_info->show_flags, buffer);
 
@@ -12054,6 +12200,8 @@ _pack_node_info_request_msg(node_info_request_msg_t * msg, Buf buffer,
 {
 	pack_time(msg->last_update, buffer);
 	pack16(msg->show_flags, buffer);
+	if (protocol_version >= SLURM_18_08_PROTOCOL_VERSION)
+		_pack_info_filter(msg->filter, buffer, protocol_version);
 }
 
 static int
@@ -12067,6 +12215,9 @@ _unpack_node_info_request_msg(node_info_request_msg_t ** msg, Buf buffer,
 
 	safe_unpack_time(&node_info->last_update, buffer);
 	safe_unpack16(&node_info->show_flags, buffer);
+	if ((protocol_version >= SLURM_18_08_PROTOCOL_VERSION) &&
+	    _unpack_info_filter(&node_info->filter, buffer, protocol_version))
+		goto unpack_error;
 	return SLURM_SUCCESS;
 
 unpack_error:
@@ -14496,7 +14647,7 @@ unpack_error:
 static int  _unpack_stats_response_msg(stats_info_response_msg_t **msg_ptr,
 				       Buf buffer, uint16_t protocol_version)
 {
-	uint32_t uint32_tmp = 0;
+	uint32_t i, uint32_tmp = 0;
 	stats_info_response_msg_t * msg;
 	xassert ( msg_ptr != NULL );
 
@@ -14546,6 +14697,21 @@ static int  _unpack_stats_response_msg(stats_info_response_msg_t **msg_ptr,
 
 			safe_unpack32(&msg->bf_active,		buffer);
 			safe_unpack32(&msg->bf_backfilled_pack_jobs, buffer);
+
+			safe_unpack32(&msg->rpc_workers,	buffer);
+			safe_unpack32(&msg->rpc_queue_len,	buffer);
+			safe_unpack32(&msg->rpc_queue_len_max,	buffer);
+			safe_unpack32(&msg->rpc_queue_cnt,	buffer);
+			safe_unpack64(&msg->rpc_queue_wait_sum,	buffer);
+			safe_unpack32(&msg->rpc_queue_wait_max,	buffer);
+
+			safe_unpack32(&msg->bf_parallel,	buffer);
+			safe_unpack32(&msg->bf_last_spec_cnt,	buffer);
+			safe_unpack32(&msg->bf_last_spec_used,	buffer);
+			safe_unpack64(&msg->bf_last_spec_time,	buffer);
+			safe_unpack64(&msg->bf_last_spec_wall,	buffer);
+			safe_unpack32(&msg->bf_plan_jobs,	buffer);
+			safe_unpack_time(&msg->bf_plan_time,	buffer);
 		}
 
 		safe_unpack32(&msg->rpc_type_size,		buffer);
@@ -14574,6 +14740,150 @@ static int  _unpack_stats_response_msg(stats_info_response_msg_t **msg_ptr,
 				     buffer);
 		if (uint32_tmp != msg->rpc_dump_count)
 			goto unpack_error;
+
+		safe_unpack32(&msg->rpc_class_size,		buffer);
+		safe_unpack32_array(&msg->rpc_class_max,    &uint32_tmp, buffer);
+		if (uint32_tmp != msg->rpc_class_size)
+			goto unpack_error;
+		safe_unpack32_array(&msg->rpc_class_active, &uint32_tmp, buffer);
+		if (uint32_tmp != msg->rpc_class_size)
+			goto unpack_error;
+		safe_unpack32_array(&msg->rpc_class_queued, &uint32_tmp, buffer);
+		if (uint32_tmp != msg->rpc_class_size)
+			goto unpack_error;
+		safe_unpack32_array(&msg->rpc_class_cnt,    &uint32_tmp, buffer);
+		if (uint32_tmp != msg->rpc_class_size)
+			goto unpack_error;
+		safe_unpack32_array(&msg->rpc_class_shed,   &uint32_tmp, buffer);
+		if (uint32_tmp != msg->rpc_class_size)
+			goto unpack_error;
+		safe_unpack64_array(&msg->rpc_class_time,   &uint32_tmp, buffer);
+		if (uint32_tmp != msg->rpc_class_size)
+			goto unpack_error;
+		safe_unpack64_array(&msg->rpc_class_wait,   &uint32_tmp, buffer);
+		if (uint32_tmp != msg->rpc_class_size)
+			goto unpack_error;
+
+		safe_unpack32(&msg->lock_hold_warn,		buffer);
+		safe_unpack32(&msg->lock_hist_size,		buffer);
+		safe_unpackstr_array(&msg->lock_stat_name,
+				     &msg->lock_stat_size, buffer);
+		safe_unpack32_array(&msg->lock_stat_cnt, &uint32_tmp, buffer);
+		if (uint32_tmp != msg->lock_stat_size)
+			goto unpack_error;
+		safe_unpack64_array(&msg->lock_stat_wait, &uint32_tmp, buffer);
+		if (uint32_tmp != msg->lock_stat_size)
+			goto unpack_error;
+		safe_unpack32_array(&msg->lock_stat_wait_max, &uint32_tmp,
+				    buffer);
+		if (uint32_tmp != msg->lock_stat_size)
+			goto unpack_error;
+		safe_unpack64_array(&msg->lock_stat_hold, &uint32_tmp, buffer);
+		if (uint32_tmp != msg->lock_stat_size)
+			goto unpack_error;
+		safe_unpack32_array(&msg->lock_stat_hold_max, &uint32_tmp,
+				    buffer);
+		if (uint32_tmp != msg->lock_stat_size)
+			goto unpack_error;
+		safe_unpack32_array(&msg->lock_stat_wait_hist, &uint32_tmp,
+				    buffer);
+		if (uint32_tmp != (msg->lock_stat_size * msg->lock_hist_size))
+			goto unpack_error;
+		safe_unpack32_array(&msg->lock_stat_hold_hist, &uint32_tmp,
+				    buffer);
+		if (uint32_tmp != (msg->lock_stat_size * msg->lock_hist_size))
+			goto unpack_error;
+
+		safe_unpackstr_array(&msg->lock_site_name,
+				     &msg->lock_site_size, buffer);
+		safe_unpack32_array(&msg->lock_site_cnt, &uint32_tmp, buffer);
+		if (uint32_tmp != msg->lock_site_size)
+			goto unpack_error;
+		safe_unpack64_array(&msg->lock_site_wait, &uint32_tmp, buffer);
+		if (uint32_tmp != msg->lock_site_size)
+			goto unpack_error;
+		safe_unpack32_array(&msg->lock_site_wait_max, &uint32_tmp,
+				    buffer);
+		if (uint32_tmp != msg->lock_site_size)
+			goto unpack_error;
+		safe_unpack64_array(&msg->lock_site_hold, &uint32_tmp, buffer);
+		if (uint32_tmp != msg->lock_site_size)
+			goto unpack_error;
+		safe_unpack32_array(&msg->lock_site_hold_max, &uint32_tmp,
+				    buffer);
+		if (uint32_tmp != msg->lock_site_size)
+			goto unpack_error;
+		safe_unpack32_array(&msg->lock_site_long, &uint32_tmp, buffer);
+		if (uint32_tmp != msg->lock_site_size)
+			goto unpack_error;
+
+		safe_unpack32_array(&msg->rpc_type_p50, &uint32_tmp, buffer);
+		if (uint32_tmp != msg->rpc_type_size)
+			goto unpack_error;
+		safe_unpack32_array(&msg->rpc_type_p90, &uint32_tmp, buffer);
+		if (uint32_tmp != msg->rpc_type_size)
+			goto unpack_error;
+		safe_unpack32_array(&msg->rpc_type_p99, &uint32_tmp, buffer);
+		if (uint32_tmp != msg->rpc_type_size)
+			goto unpack_error;
+		safe_unpack32_array(&msg->rpc_type_max, &uint32_tmp, buffer);
+		if (uint32_tmp != msg->rpc_type_size)
+			goto unpack_error;
+		safe_unpack32_array(&msg->rpc_user_p50, &uint32_tmp, buffer);
+		if (uint32_tmp != msg->rpc_user_size)
+			goto unpack_error;
+		safe_unpack32_array(&msg->rpc_user_p90, &uint32_tmp, buffer);
+		if (uint32_tmp != msg->rpc_user_size)
+			goto unpack_error;
+		safe_unpack32_array(&msg->rpc_user_p99, &uint32_tmp, buffer);
+		if (uint32_tmp != msg->rpc_user_size)
+			goto unpack_error;
+		safe_unpack32_array(&msg->rpc_user_max, &uint32_tmp, buffer);
+		if (uint32_tmp != msg->rpc_user_size)
+			goto unpack_error;
+
+		safe_unpack32(&msg->history_size, buffer);
+		if (msg->history_size > MAX_PACK_ARRAY_LEN)
+			goto unpack_error;
+		msg->history_time = xmalloc(sizeof(time_t) *
+					    (msg->history_size + 1));
+		for (i = 0; i < msg->history_size; i++)
+			safe_unpack_time(&msg->history_time[i], buffer);
+		safe_unpack32_array(&msg->history_sched_cycles, &uint32_tmp,
+				    buffer);
+		if (uint32_tmp != msg->history_size)
+			goto unpack_error;
+		safe_unpack32_array(&msg->history_sched_mean, &uint32_tmp,
+				    buffer);
+		if (uint32_tmp != msg->history_size)
+			goto unpack_error;
+		safe_unpack32_array(&msg->history_bf_cycles, &uint32_tmp,
+				    buffer);
+		if (uint32_tmp != msg->history_size)
+			goto unpack_error;
+		safe_unpack32_array(&msg->history_bf_mean, &uint32_tmp, buffer);
+		if (uint32_tmp != msg->history_size)
+			goto unpack_error;
+		safe_unpack32_array(&msg->history_agent_queue, &uint32_tmp,
+				    buffer);
+		if (uint32_tmp != msg->history_size)
+			goto unpack_error;
+		safe_unpack32_array(&msg->history_dbd_queue, &uint32_tmp,
+				    buffer);
+		if (uint32_tmp != msg->history_size)
+			goto unpack_error;
+		safe_unpack32_array(&msg->history_server_threads, &uint32_tmp,
+				    buffer);
+		if (uint32_tmp != msg->history_size)
+			goto unpack_error;
+		safe_unpack32_array(&msg->history_jobs_pending, &uint32_tmp,
+				    buffer);
+		if (uint32_tmp != msg->history_size)
+			goto unpack_error;
+		safe_unpack32_array(&msg->history_jobs_running, &uint32_tmp,
+				    buffer);
+		if (uint32_tmp != msg->history_size)
+			goto unpack_error;
 	} else if (protocol_version >= SLURM_17_11_PROTOCOL_VERSION) {
 		safe_unpack32(&msg->parts_packed,	buffer);
 		if (msg->parts_packed) {
@@ -15160,3 +15470,82 @@ unpack_error:
 	*msg_ptr = NULL;
 	return SLURM_ERROR;
 }
+
+static void _pack_event_subscribe_msg(event_subscribe_msg_t *msg, Buf buffer,
+				      uint16_t protocol_version)
+{
+	pack16(msg->event_types, buffer);
+	_pack_info_filter(msg->filter, buffer, protocol_version);
+}
+
+static int _unpack_event_subscribe_msg(event_subscribe_msg_t **msg_ptr,
+				       Buf buffer, uint16_t protocol_version)
+{
+	event_subscribe_msg_t *msg;
+	xassert(msg_ptr);
+
+	msg = xmalloc(sizeof(event_subscribe_msg_t));
+	*msg_ptr = msg;
+
+	safe_unpack16(&msg->event_types, buffer);
+	if (_unpack_info_filter(&msg->filter, buffer, protocol_version))
+		goto unpack_error;
+	return SLURM_SUCCESS;
+
+unpack_error:
+	slurm_free_event_subscribe_msg(msg);
+	*msg_ptr = NULL;
+	return SLURM_ERROR;
+}
+
+static void _pack_event_notify_msg(event_notify_msg_t *msg, Buf buffer,
+				   uint16_t protocol_version)
+{
+	slurm_event_t *event;
+	uint32_t i;
+
+	pack32(msg->event_cnt, buffer);
+	for (i = 0; i < msg->event_cnt; i++) {
+		event = &msg->events[i];
+		pack16(event->event_type, buffer);
+		pack16(event->change, buffer);
+		pack_time(event->event_time, buffer);
+		pack32(event->job_id, buffer);
+		packstr(event->name, buffer);
+		pack32(event->state, buffer);
+		pack32(event->state_reason, buffer);
+	}
+}
+
+static int _unpack_event_notify_msg(event_notify_msg_t **msg_ptr,
+				    Buf buffer, uint16_t protocol_version)
+{
+	uint32_t i, uint32_tmp;
+	event_notify_msg_t *msg;
+	slurm_event_t *event;
+	xassert(msg_ptr);
+
+	msg = xmalloc(sizeof(event_notify_msg_t));
+	*msg_ptr = msg;
+
+	safe_unpack32(&msg->event_cnt, buffer);
+	if (msg->event_cnt > remaining_buf(buffer))
+		goto unpack_error;
+	msg->events = xmalloc(sizeof(slurm_event_t) * msg->event_cnt);
+	for (i = 0; i < msg->event_cnt; i++) {
+		event = &msg->events[i];
+		safe_unpack16(&event->event_type, buffer);
+		safe_unpack16(&event->change, buffer);
+		safe_unpack_time(&event->event_time, buffer);
+		safe_unpack32(&event->job_id, buffer);
+		safe_unpackstr_xmalloc(&event->name, &uint32_tmp, buffer);
+		safe_unpack32(&event->state, buffer);
+		safe_unpack32(&event->state_reason, buffer);
+	}
+	return SLURM_SUCCESS;
+
+unpack_error:
+	slurm_free_event_notify_msg(msg);
+	*msg_ptr = NULL;
+	return SLURM_ERROR;
+}
@@ -42,6 +42,8 @@
 #include <math.h>
 #include <stdlib.h>
 
+#include "src/slurmctld/job_queue.h"
+
 #include "fair_tree.h"
 
 static int  _ft_decay_apply_new_usage(struct job_record *job, time_t *start);
@@ -69,6 +71,7 @@ extern void fair_tree_decay(List jobs, time_t start)
 	/* assign job priorities */
 	lock_slurmctld(job_write_lock);
 	list_for_each(jobs, (ListForF) decay_apply_weighted_factors, &start);
+	job_queue_invalidate();
 	unlock_slurmctld(job_write_lock);
 }
 
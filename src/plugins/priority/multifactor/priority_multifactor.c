@@ -64,6 +64,7 @@
 #include "src/common/xstring.h"
 #include "src/common/gres.h"
 
+#include "src/slurmctld/job_queue.h"
 #include "src/slurmctld/licenses.h"
 #include "src/slurmctld/read_config.h"
 
@@ -1315,6 +1316,7 @@ static void *_decay_thread(void *no_data)
 				(ListForF) _decay_apply_new_usage_and_weighted_factors,
 				&start_time
 				);
+			job_queue_invalidate();
 			unlock_slurmctld(job_write_lock);
 		}
 
@@ -1690,6 +1692,7 @@ int init ( void )
 			job_list,
 			(ListForF) _decay_apply_new_usage_and_weighted_factors,
 			&start_time);
+		job_queue_invalidate();
 		unlock_slurmctld(job_write_lock);
 	} else if (assoc_mgr_root_assoc) {
 		if (!cluster_cpus)
@@ -79,6 +79,7 @@
 #include "src/common/slurm_accounting_storage.h"
 #include "src/common/slurm_mcs.h"
 #include "src/common/slurm_protocol_api.h"
+#include "src/common/xhash.h"
 #include "src/common/xmalloc.h"
 #include "src/common/xstring.h"
 
@@ -87,6 +88,7 @@
 #include "src/slurmctld/fed_mgr.h"
 #include "src/slurmctld/front_end.h"
 #include "src/slurmctld/job_scheduler.h"
+#include "src/slurmctld/job_shape.h"
 #include "src/slurmctld/licenses.h"
 #include "src/slurmctld/locks.h"
 #include "src/slurmctld/node_scheduler.h"
@@ -95,24 +97,19 @@
 #include "src/slurmctld/slurmctld.h"
 #include "src/slurmctld/srun_comm.h"
 #include "backfill.h"
+#include "limit_count.h"
+#include "node_space.h"
 
 #define BACKFILL_INTERVAL	30
 #define BACKFILL_RESOLUTION	60
 #define BACKFILL_WINDOW		(24 * 60 * 60)
-#define BF_MAX_USERS		5000
 #define BF_MAX_JOB_ARRAY_RESV	20
+#define BF_MAX_PARALLEL		64
 
 #define SLURMCTLD_THREAD_LIMIT	5
 #define SCHED_TIMEOUT		2000000	/* time in micro-seconds */
 #define YIELD_SLEEP		500000;	/* time in micro-seconds */
 
-typedef struct node_space_map {
-	time_t begin_time;
-	time_t end_time;
-	bitstr_t *avail_bitmap;
-	int next;	/* next record, by time, zero termination */
-} node_space_map_t;
-
 /*
  * Pack job scheduling structures
  * NOTE: An individial pack job component can be submitted to multiple
@@ -132,12 +129,66 @@ typedef struct pack_job_map {
 	List pack_job_list;		/* List of pack_job_rec_t */
 } pack_job_map_t;
 
-typedef struct user_part_rec {
-	uint16_t *njobs;
+/*
+ * Candidate job tested in parallel with _try_sched(), the arguments used
+ * for the test followed by its results
+ */
+typedef struct bf_spec {
+	struct job_record *job_ptr;
+	uint32_t job_id;
+	struct part_record *part_ptr;
+	uint32_t gen;			/* bf_spec_gen at test time */
+	uint32_t min_nodes;
+	uint32_t max_nodes;
+	uint32_t req_nodes;
+	uint32_t time_limit;		/* job's time_limit during test */
+	uint32_t no_reserve;		/* TEST_NOW_ONLY or zero */
+	bitstr_t *avail_in;		/* nodes offered to the job */
+	bitstr_t *exc_core_bitmap;
+
+	int rc;
+	bitstr_t *avail_out;		/* nodes selected for the job */
+	time_t start_time;
+	uint32_t total_cpus;
+	uint32_t test_usec;
+} bf_spec_t;
+
+/*
+ * Incremental backfill plan (bf_incremental), kept between cycles: the job
+ * queue records tested since the plan was built, in priority order, with the
+ * reservations made for them in the node_space map
+ */
+typedef struct bf_plan_resv {
+	time_t start_time;		/* job's expected start time */
+	uint32_t resv_start;		/* reservation in node_space map */
+	uint32_t resv_end;
+	bitstr_t *node_bitmap;		/* reserved nodes */
+} bf_plan_resv_t;
+
+typedef struct bf_plan_job {
+	char key[64];			/* job_id, array_task_id and part_ptr */
+	uint32_t job_id;
+	uint32_t array_task_id;
 	struct part_record *part_ptr;
-	uint32_t *uid;
-	int user_cnt;
-} user_part_rec_t;
+	time_t start_time;		/* job's start_time after test */
+	bool retest;			/* reservation due, test job again */
+	bool kept;			/* matched job queue this cycle */
+	int inx;			/* position in plan */
+	int resv_cnt;
+	bf_plan_resv_t *resv;
+} bf_plan_job_t;
+
+typedef struct bf_plan {
+	time_t create_time;		/* zero if no plan */
+	time_t check_time;		/* start of last cycle */
+	time_t config_update;		/* slurmctld_conf.last_update */
+	time_t part_update;		/* last_part_update */
+	time_t resv_update;		/* last_resv_update */
+	int job_cnt;			/* records in job_rec */
+	int job_size;			/* records allocated */
+	int retest_next;		/* first job_rec to consider for retest */
+	bf_plan_job_t **job_rec;
+} bf_plan_t;
 
 typedef struct deadlock_job_struct {
 	uint32_t pack_job_id;
@@ -183,12 +234,37 @@ static int sched_timeout = SCHED_TIMEOUT;
 static int yield_sleep   = YIELD_SLEEP;
 static List pack_job_list = NULL;
 
+static int bf_parallel = 0;
+static pthread_mutex_t bf_spec_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bf_spec_work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t bf_spec_done_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t *bf_spec_tid = NULL;
+static int bf_spec_thread_cnt = 0;
+static bool bf_spec_shutdown = false;
+static bf_spec_t *bf_spec_batch = NULL;	/* candidates of the last batch */
+static int bf_spec_size = 0;		/* records in bf_spec_batch */
+static int bf_spec_cnt = 0;		/* records in use */
+static int bf_spec_next = 0;		/* next record to test */
+static int bf_spec_done = 0;		/* records tested */
+static uint32_t bf_spec_gen = 1;	/* incremented when state changes */
+static int bf_incremental = 0;		/* max plan age, zero to disable */
+static bf_plan_t bf_plan;
+static limit_count_t *bf_assoc_cnt = NULL;	/* jobs tested by assoc */
+static limit_count_t *bf_part_cnt = NULL;	/* jobs tested by partition */
+static limit_count_t *bf_part_resv_cnt = NULL;	/* jobs reserved by partition */
+static limit_count_t *bf_user_cnt = NULL;	/* jobs tested by user */
+static limit_count_t *bf_user_part_cnt = NULL;	/* by user and partition */
+
 /*********************** local functions *********************/
-static void _add_reservation(uint32_t start_time, uint32_t end_reserve,
-			     bitstr_t *res_bitmap,
-			     node_space_map_t *node_space,
-			     int *node_space_recs);
 static int  _attempt_backfill(void);
+static void _bf_spec_fini(void);
+static void _bf_spec_init(void);
+static int  _bf_spec_try_sched(struct job_record *job_ptr,
+			       struct part_record *part_ptr,
+			       bitstr_t **avail_bitmap, uint32_t min_nodes,
+			       uint32_t max_nodes, uint32_t req_nodes,
+			       bitstr_t *exc_core_bitmap, List job_queue,
+			       node_space_map_t *node_space, time_t now);
 static int  _clear_job_start_times(void *x, void *arg);
 static int  _clear_qos_blocked_times(void *x, void *arg);
 static void _do_diag_stats(struct timeval *tv1, struct timeval *tv2);
@@ -196,8 +272,16 @@ static uint32_t _get_job_max_tl(struct job_record *job_ptr, time_t now,
 				node_space_map_t *node_space);
 static void _job_pack_deadlock_fini(void);
 static bool _job_pack_deadlock_test(struct job_record *job_ptr);
+static time_t _job_avail_nodes(struct job_record *job_ptr,
+			       struct part_record *part_ptr, int mcs_select,
+			       time_t start_res, uint32_t end_time,
+			       node_space_map_t *node_space,
+			       bitstr_t *avail_bitmap);
 static bool _job_part_valid(struct job_record *job_ptr,
 			    struct part_record *part_ptr);
+static bool _job_runnable_now(struct job_record *job_ptr);
+static void _limit_count_fini(void);
+static void _limit_count_reset(void);
 static void _load_config(void);
 static bool _many_pending_rpcs(void);
 static bool _more_work(time_t last_backfill_time);
@@ -212,12 +296,20 @@ static time_t _pack_start_find(struct job_record *job_ptr, time_t now);
 static void _pack_start_set(struct job_record *job_ptr, time_t latest_start,
 			    uint32_t comp_time_limit);
 static void _pack_start_test(node_space_map_t *node_space);
+static void _plan_add_resv(bf_plan_job_t *plan_job, time_t start_time,
+			   uint32_t resv_start, uint32_t resv_end,
+			   bitstr_t *node_bitmap);
+static void _plan_clear(void);
+static void _plan_job_abort(bf_plan_job_t *plan_job);
+static void _plan_job_commit(bf_plan_job_t *plan_job);
+static void _plan_job_done(bf_plan_job_t *plan_job, bool tested);
+static bf_plan_job_t *_plan_job_get(uint32_t job_id, uint32_t array_task_id,
+				    struct part_record *part_ptr);
+static void _plan_replay(node_space_map_t *node_space);
+static int  _plan_resume(List job_queue, time_t now);
 static void _reset_job_time_limit(struct job_record *job_ptr, time_t now,
 				  node_space_map_t *node_space);
 static int  _start_job(struct job_record *job_ptr, bitstr_t *avail_bitmap);
-static bool _test_resv_overlap(node_space_map_t *node_space,
-			       bitstr_t *use_bitmap, uint32_t start_time,
-			       uint32_t end_reserve);
 static int  _try_sched(struct job_record *job_ptr, bitstr_t **avail_bitmap,
 		       uint32_t min_nodes, uint32_t max_nodes,
 		       uint32_t req_nodes, bitstr_t *exc_core_bitmap);
@@ -252,25 +344,25 @@ static void _dump_job_test(struct job_record *job_ptr, bitstr_t *avail_bitmap,
 	xfree(node_list);
 }
 
-/* Log resource allocate table */
-static void _dump_node_space_table(node_space_map_t *node_space_ptr)
+static int _dump_node_space_rec(time_t begin_time, time_t end_time,
+				bitstr_t *avail_bitmap, void *arg)
 {
-	int i = 0;
 	char begin_buf[32], end_buf[32], *node_list;
 
+	slurm_make_time_str(&begin_time, begin_buf, sizeof(begin_buf));
+	slurm_make_time_str(&end_time, end_buf, sizeof(end_buf));
+	node_list = bitmap2node_name(avail_bitmap);
+	info("Begin:%s End:%s Nodes:%s", begin_buf, end_buf, node_list);
+	xfree(node_list);
+
+	return 0;
+}
+
+/* Log resource allocate table */
+static void _dump_node_space_table(node_space_map_t *node_space)
+{
 	info("=========================================");
-	while (1) {
-		slurm_make_time_str(&node_space_ptr[i].begin_time,
-				    begin_buf, sizeof(begin_buf));
-		slurm_make_time_str(&node_space_ptr[i].end_time,
-				    end_buf, sizeof(end_buf));
-		node_list = bitmap2node_name(node_space_ptr[i].avail_bitmap);
-		info("Begin:%s End:%s Nodes:%s",
-		     begin_buf, end_buf, node_list);
-		xfree(node_list);
-		if ((i = node_space_ptr[i].next) == 0)
-			break;
-	}
+	(void) node_space_for_each(node_space, _dump_node_space_rec, NULL);
 	info("=========================================");
 }
 
@@ -560,6 +652,772 @@ static int  _try_sched(struct job_record *job_ptr, bitstr_t **avail_bitmap,
 	return rc;
 }
 
+/*
+ * Remove from avail_bitmap the nodes which the job can not use in this
+ * partition between start_res and end_time, including nodes already
+ * reserved for higher priority jobs in node_space
+ * RET end time of the first node_space record after start_res, zero if none
+ */
+static time_t _job_avail_nodes(struct job_record *job_ptr,
+			       struct part_record *part_ptr, int mcs_select,
+			       time_t start_res, uint32_t end_time,
+			       node_space_map_t *node_space,
+			       bitstr_t *avail_bitmap)
+{
+	time_t later_start;
+
+	bit_and(avail_bitmap, part_ptr->node_bitmap);
+	bit_and(avail_bitmap, up_node_bitmap);
+	filter_by_node_owner(job_ptr, avail_bitmap);
+	filter_by_node_mcs(job_ptr, mcs_select, avail_bitmap);
+	later_start = node_space_and(node_space, start_res, end_time,
+				     avail_bitmap);
+	if (job_ptr->details->exc_node_bitmap) {
+		bit_and_not(avail_bitmap,
+			job_ptr->details->exc_node_bitmap);
+	}
+
+	return later_start;
+}
+
+static void _bf_spec_clear(bf_spec_t *spec)
+{
+	FREE_NULL_BITMAP(spec->avail_in);
+	FREE_NULL_BITMAP(spec->avail_out);
+	FREE_NULL_BITMAP(spec->exc_core_bitmap);
+	memset(spec, 0, sizeof(bf_spec_t));
+}
+
+/*
+ * Test one candidate with _try_sched(). The job's fields changed by the
+ * test are recorded in the candidate record and then restored, so that a
+ * result which is never used leaves no trace.
+ */
+static void _bf_spec_test(bf_spec_t *spec)
+{
+	struct job_record *job_ptr = spec->job_ptr;
+	struct part_record *save_part_ptr = job_ptr->part_ptr;
+	uint32_t save_time_limit = job_ptr->time_limit;
+	uint32_t save_total_cpus = job_ptr->total_cpus;
+	uint32_t save_bit_flags = job_ptr->bit_flags;
+	time_t save_start_time = job_ptr->start_time;
+	DEF_TIMERS;
+
+	START_TIMER;
+	job_ptr->part_ptr = spec->part_ptr;
+	job_ptr->time_limit = spec->time_limit;
+	job_ptr->bit_flags &= ~TEST_NOW_ONLY;
+	job_ptr->bit_flags |= (BACKFILL_TEST | spec->no_reserve);
+	spec->avail_out = bit_copy(spec->avail_in);
+	spec->rc = _try_sched(job_ptr, &spec->avail_out, spec->min_nodes,
+			      spec->max_nodes, spec->req_nodes,
+			      spec->exc_core_bitmap);
+	spec->start_time = job_ptr->start_time;
+	spec->total_cpus = job_ptr->total_cpus;
+
+	job_ptr->part_ptr = save_part_ptr;
+	job_ptr->time_limit = save_time_limit;
+	job_ptr->total_cpus = save_total_cpus;
+	job_ptr->bit_flags = save_bit_flags;
+	job_ptr->start_time = save_start_time;
+	END_TIMER;
+	spec->test_usec = DELTA_TIMER;
+}
+
+/* Worker thread testing the candidates of bf_spec_batch */
+static void *_bf_spec_agent(void *args)
+{
+	int i;
+
+#if HAVE_SYS_PRCTL_H
+	if (prctl(PR_SET_NAME, "bckfl_spec", NULL, NULL, NULL) < 0) {
+		error("%s: cannot set my name to %s %m", __func__,
+		      "bckfl_spec");
+	}
+#endif
+	slurm_mutex_lock(&bf_spec_mutex);
+	while (!bf_spec_shutdown) {
+		if (bf_spec_next >= bf_spec_cnt) {
+			slurm_cond_wait(&bf_spec_work_cond, &bf_spec_mutex);
+			continue;
+		}
+		i = bf_spec_next++;
+		slurm_mutex_unlock(&bf_spec_mutex);
+		_bf_spec_test(&bf_spec_batch[i]);
+		slurm_mutex_lock(&bf_spec_mutex);
+		if (++bf_spec_done == bf_spec_cnt)
+			slurm_cond_broadcast(&bf_spec_done_cond);
+	}
+	slurm_mutex_unlock(&bf_spec_mutex);
+
+	return NULL;
+}
+
+/* Stop the worker threads and free the candidate records */
+static void _bf_spec_fini(void)
+{
+	int i;
+
+	if (bf_spec_thread_cnt) {
+		slurm_mutex_lock(&bf_spec_mutex);
+		bf_spec_shutdown = true;
+		slurm_cond_broadcast(&bf_spec_work_cond);
+		slurm_mutex_unlock(&bf_spec_mutex);
+		for (i = 0; i < bf_spec_thread_cnt; i++)
+			pthread_join(bf_spec_tid[i], NULL);
+		xfree(bf_spec_tid);
+		bf_spec_thread_cnt = 0;
+		bf_spec_shutdown = false;
+	}
+	for (i = 0; i < bf_spec_size; i++)
+		_bf_spec_clear(&bf_spec_batch[i]);
+	xfree(bf_spec_batch);
+	bf_spec_size = 0;
+	bf_spec_cnt = 0;
+	bf_spec_next = 0;
+	bf_spec_done = 0;
+}
+
+/* Start or resize the worker threads to match bf_parallel */
+static void _bf_spec_init(void)
+{
+	int i;
+
+	if (bf_spec_size == bf_parallel)
+		return;
+	_bf_spec_fini();
+	if (bf_parallel <= 1)
+		return;
+
+	bf_spec_size = bf_parallel;
+	bf_spec_batch = xmalloc(sizeof(bf_spec_t) * bf_spec_size);
+	/* The backfill thread itself tests one candidate of each batch */
+	bf_spec_thread_cnt = bf_parallel - 1;
+	bf_spec_tid = xmalloc(sizeof(pthread_t) * bf_spec_thread_cnt);
+	for (i = 0; i < bf_spec_thread_cnt; i++)
+		slurm_thread_create(&bf_spec_tid[i], _bf_spec_agent, NULL);
+}
+
+/*
+ * Fill in the _try_sched() arguments a pending job will most likely be
+ * tested with when the backfill loop reaches it, repeating the loop's
+ * computations with the current node_space. Jobs needing any special
+ * handling (reservations, node reboots, etc.) are not predicted.
+ * RET true if spec was filled in
+ */
+static bool _bf_spec_predict(bf_spec_t *spec, job_queue_rec_t *job_queue_rec,
+			     node_space_map_t *node_space, time_t now)
+{
+	struct job_record *job_ptr = job_queue_rec->job_ptr;
+	struct part_record *part_ptr = job_queue_rec->part_ptr;
+	struct part_record *save_part_ptr;
+	uint32_t qos_flags = 0, prio_reserve, part_time_limit, time_limit;
+	uint32_t end_time, save_time_limit;
+	bitstr_t *active_bitmap = NULL;
+	time_t start_res = now;
+	bool resv_overlap = false;
+	int rc;
+	assoc_mgr_lock_t qos_read_lock =
+		{ NO_LOCK, NO_LOCK, READ_LOCK, NO_LOCK,
+		  NO_LOCK, NO_LOCK, NO_LOCK };
+
+	if ((job_ptr->magic != JOB_MAGIC) ||
+	    (job_ptr->job_id != job_queue_rec->job_id) ||
+	    (job_ptr->array_task_id != job_queue_rec->array_task_id) ||
+	    !_job_runnable_now(job_ptr) || !job_ptr->details ||
+	    job_ptr->resv_name || job_ptr->pack_job_id ||
+	    job_ptr->preempt_in_progress ||
+	    (job_ptr->deadline && (job_ptr->deadline != NO_VAL)) ||
+	    !part_ptr || !part_ptr->node_bitmap ||
+	    ((part_ptr->state_up & PARTITION_SCHED) == 0))
+		return false;
+
+	spec->job_ptr = job_ptr;
+	spec->job_id = job_ptr->job_id;
+	spec->part_ptr = part_ptr;
+
+	assoc_mgr_lock(&qos_read_lock);
+	if (job_ptr->qos_ptr)
+		qos_flags = job_ptr->qos_ptr->flags;
+	assoc_mgr_unlock(&qos_read_lock);
+
+	save_part_ptr = job_ptr->part_ptr;
+	job_ptr->part_ptr = part_ptr;
+	rc = get_node_cnts(job_ptr, qos_flags, part_ptr, &spec->min_nodes,
+			   &spec->req_nodes, &spec->max_nodes);
+	if (!(prio_reserve = acct_policy_get_prio_thresh(job_ptr, false)))
+		prio_reserve = bf_min_prio_reserve;
+	job_ptr->part_ptr = save_part_ptr;
+	if (rc != SLURM_SUCCESS)
+		return false;
+
+	spec->no_reserve = 0;
+	if (prio_reserve && (job_queue_rec->priority < prio_reserve)) {
+		spec->no_reserve = TEST_NOW_ONLY;
+	} else if (bf_min_age_reserve && job_ptr->details->begin_time &&
+		   (difftime(now, job_ptr->details->begin_time) <
+		    bf_min_age_reserve)) {
+		spec->no_reserve = TEST_NOW_ONLY;
+	}
+
+	/* Same time limit logic as _attempt_backfill() */
+	if (part_ptr->max_time == INFINITE)
+		part_time_limit = YEAR_MINUTES;
+	else
+		part_time_limit = part_ptr->max_time;
+	if ((job_ptr->time_limit == NO_VAL) ||
+	    (job_ptr->time_limit == INFINITE))
+		time_limit = part_time_limit;
+	else
+		time_limit = MIN(job_ptr->time_limit, part_time_limit);
+	spec->time_limit = job_ptr->time_limit;
+	if ((qos_flags & QOS_FLAG_NO_RESERVE) && slurm_get_preempt_mode())
+		time_limit = spec->time_limit = 1;
+	else if (job_ptr->time_min && (job_ptr->time_min < time_limit))
+		time_limit = spec->time_limit = job_ptr->time_min;
+
+	save_time_limit = job_ptr->time_limit;
+	job_ptr->time_limit = spec->time_limit;
+	rc = job_test_resv(job_ptr, &start_res, true, &spec->avail_in,
+			   &spec->exc_core_bitmap, &resv_overlap, false);
+	job_ptr->time_limit = save_time_limit;
+	if (rc != SLURM_SUCCESS)
+		return false;
+	end_time = (time_limit * 60) + MAX(start_res, now);
+	if (end_time < now)	/* Overflow 32-bits */
+		end_time = INFINITE;
+	(void) _job_avail_nodes(job_ptr, part_ptr,
+				slurm_mcs_get_select(job_ptr), start_res,
+				end_time, node_space, spec->avail_in);
+	if ((bit_set_count(spec->avail_in) < spec->min_nodes) ||
+	    ((job_ptr->details->req_node_bitmap) &&
+	     (!bit_super_set(job_ptr->details->req_node_bitmap,
+			     spec->avail_in))) ||
+	    (job_req_node_filter(job_ptr, spec->avail_in, true)))
+		return false;
+	build_active_feature_bitmap(job_ptr, spec->avail_in, &active_bitmap);
+	if (active_bitmap) {	/* Node reboot may be needed */
+		FREE_NULL_BITMAP(active_bitmap);
+		return false;
+	}
+
+	return true;
+}
+
+/* Test the first bf_spec_cnt records of bf_spec_batch in parallel */
+static void _bf_spec_run(void)
+{
+	int i;
+	DEF_TIMERS;
+
+	START_TIMER;
+	slurm_mutex_lock(&bf_spec_mutex);
+	bf_spec_next = 0;
+	bf_spec_done = 0;
+	slurm_cond_broadcast(&bf_spec_work_cond);
+	while (bf_spec_next < bf_spec_cnt) {
+		i = bf_spec_next++;
+		slurm_mutex_unlock(&bf_spec_mutex);
+		_bf_spec_test(&bf_spec_batch[i]);
+		slurm_mutex_lock(&bf_spec_mutex);
+		bf_spec_done++;
+	}
+	while (bf_spec_done < bf_spec_cnt)
+		slurm_cond_wait(&bf_spec_done_cond, &bf_spec_mutex);
+	slurm_mutex_unlock(&bf_spec_mutex);
+	END_TIMER;
+
+	slurmctld_diag_stats.bf_last_spec_wall += DELTA_TIMER;
+	for (i = 0; i < bf_spec_cnt; i++) {
+		slurmctld_diag_stats.bf_last_spec_time +=
+			bf_spec_batch[i].test_usec;
+	}
+	slurmctld_diag_stats.bf_last_spec_cnt += bf_spec_cnt;
+}
+
+/*
+ * Parallel version of _try_sched() for the backfill loop. The job is tested
+ * together with the next candidates in the job queue, each with the
+ * arguments the loop will most likely use for it. The results are then
+ * used in priority order as the loop reaches those jobs, as long as their
+ * arguments did not change and no job was started or locks released since.
+ * Otherwise the job is tested again, along with a new batch of candidates.
+ */
+static int _bf_spec_try_sched(struct job_record *job_ptr,
+			      struct part_record *part_ptr,
+			      bitstr_t **avail_bitmap, uint32_t min_nodes,
+			      uint32_t max_nodes, uint32_t req_nodes,
+			      bitstr_t *exc_core_bitmap, List job_queue,
+			      node_space_map_t *node_space, time_t now)
+{
+	ListIterator job_iterator;
+	job_queue_rec_t *job_queue_rec;
+	bf_spec_t *spec = NULL;
+	uint32_t no_reserve = job_ptr->bit_flags & TEST_NOW_ONLY;
+	uint32_t spec_cnt = slurmctld_diag_stats.bf_last_spec_cnt;
+	uint32_t spec_used = slurmctld_diag_stats.bf_last_spec_used;
+	int i, k, width;
+
+	for (i = 0; i < bf_spec_cnt; i++) {
+		spec = &bf_spec_batch[i];
+		if ((spec->job_ptr == job_ptr) &&
+		    (spec->job_id == job_ptr->job_id) &&
+		    (spec->gen == bf_spec_gen) &&
+		    (spec->part_ptr == part_ptr) &&
+		    (spec->min_nodes == min_nodes) &&
+		    (spec->max_nodes == max_nodes) &&
+		    (spec->req_nodes == req_nodes) &&
+		    (spec->time_limit == job_ptr->time_limit) &&
+		    (spec->no_reserve == no_reserve) &&
+		    bit_equal(spec->avail_in, *avail_bitmap) &&
+		    ((!spec->exc_core_bitmap && !exc_core_bitmap) ||
+		     (spec->exc_core_bitmap && exc_core_bitmap &&
+		      bit_equal(spec->exc_core_bitmap, exc_core_bitmap))))
+			break;
+		spec = NULL;
+	}
+
+	if (spec) {
+		slurmctld_diag_stats.bf_last_spec_used++;
+	} else {
+		for (i = 0; i < bf_spec_cnt; i++)
+			_bf_spec_clear(&bf_spec_batch[i]);
+
+		/* This job, with its actual arguments */
+		spec = &bf_spec_batch[0];
+		spec->job_ptr = job_ptr;
+		spec->job_id = job_ptr->job_id;
+		spec->part_ptr = part_ptr;
+		spec->min_nodes = min_nodes;
+		spec->max_nodes = max_nodes;
+		spec->req_nodes = req_nodes;
+		spec->time_limit = job_ptr->time_limit;
+		spec->no_reserve = no_reserve;
+		spec->avail_in = bit_copy(*avail_bitmap);
+		if (exc_core_bitmap)
+			spec->exc_core_bitmap = bit_copy(exc_core_bitmap);
+		bf_spec_cnt = 1;
+
+		/*
+		 * Test fewer candidates while most predictions turn out wrong,
+		 * e.g. when each reservation made changes the nodes available
+		 * to the following jobs
+		 */
+		width = bf_spec_size;
+		if (spec_cnt >= (bf_spec_size * 4)) {
+			width = ((2 * bf_spec_size * spec_used) / spec_cnt) + 1;
+			width = MIN(width, bf_spec_size);
+		}
+
+		/* The next candidates in the queue, each job at most once */
+		job_iterator = list_iterator_create(job_queue);
+		while ((bf_spec_cnt < width) &&
+		       (job_queue_rec = list_next(job_iterator))) {
+			for (k = 0; k < bf_spec_cnt; k++) {
+				if (bf_spec_batch[k].job_ptr ==
+				    job_queue_rec->job_ptr)
+					break;
+			}
+			if (k < bf_spec_cnt)
+				continue;
+			if (_bf_spec_predict(&bf_spec_batch[bf_spec_cnt],
+					     job_queue_rec, node_space, now))
+				bf_spec_cnt++;
+			else
+				_bf_spec_clear(&bf_spec_batch[bf_spec_cnt]);
+		}
+		list_iterator_destroy(job_iterator);
+		for (i = 0; i < bf_spec_cnt; i++)
+			bf_spec_batch[i].gen = bf_spec_gen;
+
+		_bf_spec_run();
+		slurmctld_diag_stats.bf_last_spec_used++;
+	}
+
+	FREE_NULL_BITMAP(*avail_bitmap);
+	*avail_bitmap = bit_copy(spec->avail_out);
+	job_ptr->start_time = spec->start_time;
+	job_ptr->total_cpus = spec->total_cpus;
+	spec->gen = 0;		/* Use each result once */
+
+	return spec->rc;
+}
+
+/* Free the reservations recorded for a job in the backfill plan */
+static void _plan_resv_clear(bf_plan_job_t *plan_job)
+{
+	int i;
+
+	for (i = 0; i < plan_job->resv_cnt; i++)
+		FREE_NULL_BITMAP(plan_job->resv[i].node_bitmap);
+	xfree(plan_job->resv);
+	plan_job->resv_cnt = 0;
+}
+
+static void _plan_job_del(bf_plan_job_t *plan_job)
+{
+	_plan_resv_clear(plan_job);
+	xfree(plan_job);
+}
+
+/* Discard the incremental backfill plan */
+static void _plan_clear(void)
+{
+	int i;
+
+	for (i = 0; i < bf_plan.job_cnt; i++)
+		_plan_job_del(bf_plan.job_rec[i]);
+	xfree(bf_plan.job_rec);
+	memset(&bf_plan, 0, sizeof(bf_plan_t));
+}
+
+/* Drop the plan records from job_rec[inx] on */
+static void _plan_truncate(int inx)
+{
+	int i;
+
+	for (i = inx; i < bf_plan.job_cnt; i++)
+		_plan_job_del(bf_plan.job_rec[i]);
+	bf_plan.job_cnt = MIN(bf_plan.job_cnt, inx);
+}
+
+static void _plan_key(char *key, int key_size, uint32_t job_id,
+		      uint32_t array_task_id, struct part_record *part_ptr)
+{
+	snprintf(key, key_size, "%u.%u.%p", job_id, array_task_id,
+		 (void *) part_ptr);
+}
+
+static const char *_plan_job_key(void *x)
+{
+	bf_plan_job_t *plan_job = (bf_plan_job_t *) x;
+
+	return plan_job->key;
+}
+
+/*
+ * Test if the reservations of a job in the plan are still valid
+ * IN plan_job - job in the plan
+ * IN started - running jobs started since the last backfill cycle
+ * IN now - current time
+ * RET 0 if valid, 1 if valid and due so the job should be tested again,
+ *     -1 if a reserved node is no longer available for the job
+ */
+static int _plan_job_test(bf_plan_job_t *plan_job, List started, time_t now)
+{
+	ListIterator iter;
+	struct job_record *job_ptr;
+	bf_plan_resv_t *resv;
+	int i, rc = 0;
+
+	for (i = 0; i < plan_job->resv_cnt; i++) {
+		resv = &plan_job->resv[i];
+		if (!bit_super_set(resv->node_bitmap, avail_node_bitmap))
+			return -1;
+		iter = list_iterator_create(started);
+		while ((job_ptr = (struct job_record *) list_next(iter))) {
+			if ((job_ptr->end_time > resv->start_time) &&
+			    (job_ptr->start_time < resv->resv_end) &&
+			    bit_overlap(job_ptr->node_bitmap,
+					resv->node_bitmap))
+				break;
+		}
+		list_iterator_destroy(iter);
+		if (job_ptr)
+			return -1;
+		if (resv->start_time <= now)
+			rc = 1;
+	}
+
+	return rc;
+}
+
+/* Test if a job in the plan is no longer pending */
+static bool _plan_job_gone(bf_plan_job_t *plan_job)
+{
+	struct job_record *job_ptr = find_job_record(plan_job->job_id);
+
+	if (!job_ptr || !IS_JOB_PENDING(job_ptr) || (job_ptr->priority == 0))
+		return true;
+	return false;
+}
+
+/*
+ * Resume the incremental backfill plan at the start of a cycle. The plan is
+ * rebuilt if too old or after a change in configuration, partitions or
+ * advanced reservations. Otherwise jobs at the head of the job queue which
+ * the plan already has are removed from the queue and keep their
+ * reservations. The plan is truncated at the first job of the queue that
+ * it does not have in the same order, e.g. after a priority change, or for
+ * which a reserved node is no longer available.
+ * Jobs with a reservation now due stay in the queue to be tested again.
+ * IN job_queue - job queue of this cycle, sorted by priority
+ * IN now - start time of this cycle
+ * RET count of jobs removed from job_queue
+ */
+static int _plan_resume(List job_queue, time_t now)
+{
+	ListIterator iter;
+	List started;
+	xhash_t *plan_hash;
+	job_queue_rec_t *job_queue_rec;
+	struct job_record *job_ptr;
+	bf_plan_job_t *plan_job, **job_rec;
+	char key[64];
+	int i, rc, job_cnt = 0, skip_cnt = 0, next_inx = 0;
+
+	if (!bf_incremental) {
+		if (bf_plan.create_time)
+			_plan_clear();
+		return 0;
+	}
+	if (!bf_plan.create_time ||
+	    (difftime(now, bf_plan.create_time) >= bf_incremental) ||
+	    (bf_plan.config_update != slurmctld_conf.last_update) ||
+	    (bf_plan.part_update != last_part_update) ||
+	    (bf_plan.resv_update != last_resv_update)) {
+		_plan_clear();
+		bf_plan.create_time = now;
+		bf_plan.check_time = now;
+		bf_plan.config_update = slurmctld_conf.last_update;
+		bf_plan.part_update = last_part_update;
+		bf_plan.resv_update = last_resv_update;
+		return 0;
+	}
+
+	/* Jobs started outside of the plan, e.g. by the main scheduler */
+	started = list_create(NULL);
+	iter = list_iterator_create(job_list);
+	while ((job_ptr = (struct job_record *) list_next(iter))) {
+		if (IS_JOB_RUNNING(job_ptr) && job_ptr->node_bitmap &&
+		    (job_ptr->start_time >= bf_plan.check_time))
+			list_append(started, job_ptr);
+	}
+	list_iterator_destroy(iter);
+
+	plan_hash = xhash_init(_plan_job_key, NULL);
+	for (i = 0; i < bf_plan.job_cnt; i++) {
+		bf_plan.job_rec[i]->inx = i;
+		xhash_add(plan_hash, bf_plan.job_rec[i]);
+	}
+
+	job_rec = xmalloc(sizeof(bf_plan_job_t *) * bf_plan.job_size);
+	iter = list_iterator_create(job_queue);
+	while ((job_queue_rec = (job_queue_rec_t *) list_next(iter))) {
+		job_ptr = job_queue_rec->job_ptr;
+		if (job_ptr->pack_job_id)
+			break;	/* Pack jobs are tested in every cycle */
+		_plan_key(key, sizeof(key), job_queue_rec->job_id,
+			  job_queue_rec->array_task_id,
+			  job_queue_rec->part_ptr);
+		plan_job = (bf_plan_job_t *) xhash_get(plan_hash, key);
+		if (!plan_job || (plan_job->inx < next_inx))
+			break;
+		/* Jobs planned ahead of it must have left the queue */
+		for (i = next_inx; i < plan_job->inx; i++) {
+			if (!_plan_job_gone(bf_plan.job_rec[i]))
+				break;
+		}
+		if (i < plan_job->inx)
+			break;
+		if ((rc = _plan_job_test(plan_job, started, now)) < 0)
+			break;
+		next_inx = plan_job->inx + 1;
+		plan_job->kept = true;
+		job_rec[job_cnt++] = plan_job;
+		if (rc == 1)
+			plan_job->retest = true;
+		if (plan_job->retest)
+			continue;
+
+		/* build_job_queue() cleared the start time */
+		if (plan_job->start_time &&
+		    (!job_ptr->start_time ||
+		     (plan_job->start_time < job_ptr->start_time)))
+			job_ptr->start_time = plan_job->start_time;
+		list_delete_item(iter);
+		skip_cnt++;
+	}
+	list_iterator_destroy(iter);
+	xhash_free(plan_hash);
+	FREE_NULL_LIST(started);
+
+	for (i = 0; i < bf_plan.job_cnt; i++) {
+		if (!bf_plan.job_rec[i]->kept)
+			_plan_job_del(bf_plan.job_rec[i]);
+	}
+	for (i = 0; i < job_cnt; i++)
+		job_rec[i]->kept = false;
+	xfree(bf_plan.job_rec);
+	bf_plan.job_rec = job_rec;
+	bf_plan.job_cnt = job_cnt;
+	bf_plan.retest_next = 0;
+	bf_plan.check_time = now;
+
+	return skip_cnt;
+}
+
+/* Add the reservations of the plan, except those due, to a node_space map */
+static void _plan_replay(node_space_map_t *node_space)
+{
+	bf_plan_job_t *plan_job;
+	bitstr_t *res_bitmap;
+	int i, j;
+
+	if (!bf_plan.job_cnt)
+		return;
+
+	res_bitmap = bit_alloc(node_record_count);
+	for (i = 0; i < bf_plan.job_cnt; i++) {
+		plan_job = bf_plan.job_rec[i];
+		if (plan_job->retest)
+			continue;
+		for (j = 0; j < plan_job->resv_cnt; j++) {
+			bit_copybits(res_bitmap, plan_job->resv[j].node_bitmap);
+			bit_not(res_bitmap);
+			node_space_add_reservation(node_space,
+						   plan_job->resv[j].resv_start,
+						   plan_job->resv[j].resv_end,
+						   res_bitmap);
+		}
+	}
+	FREE_NULL_BITMAP(res_bitmap);
+}
+
+/*
+ * Get the plan record of a job queue record about to be tested, the plan's
+ * record if the job is to be tested again, otherwise a new record to be
+ * added by _plan_job_commit()
+ * RET plan record or NULL if bf_incremental is not configured
+ */
+static bf_plan_job_t *_plan_job_get(uint32_t job_id, uint32_t array_task_id,
+				    struct part_record *part_ptr)
+{
+	bf_plan_job_t *plan_job;
+	char key[64];
+	int i;
+
+	if (!bf_incremental)
+		return NULL;
+
+	_plan_key(key, sizeof(key), job_id, array_task_id, part_ptr);
+	for (i = bf_plan.retest_next; i < bf_plan.job_cnt; i++) {
+		plan_job = bf_plan.job_rec[i];
+		if (!plan_job->retest)
+			continue;
+		if (!xstrcmp(plan_job->key, key)) {
+			bf_plan.retest_next = i + 1;
+			_plan_resv_clear(plan_job);
+			return plan_job;
+		}
+		/* Not tested in plan order, test everything from here */
+		_plan_truncate(i);
+		break;
+	}
+
+	plan_job = xmalloc(sizeof(bf_plan_job_t));
+	strlcpy(plan_job->key, key, sizeof(plan_job->key));
+	plan_job->job_id = job_id;
+	plan_job->array_task_id = array_task_id;
+	plan_job->part_ptr = part_ptr;
+
+	return plan_job;
+}
+
+/* Record a job as tested in the plan */
+static void _plan_job_commit(bf_plan_job_t *plan_job)
+{
+	struct job_record *job_ptr;
+
+	job_ptr = find_job_record(plan_job->job_id);
+	if (job_ptr && IS_JOB_PENDING(job_ptr))
+		plan_job->start_time = job_ptr->start_time;
+	else
+		plan_job->start_time = 0;
+
+	if (plan_job->retest) {
+		plan_job->retest = false;
+		return;
+	}
+	if (bf_plan.job_cnt >= bf_plan.job_size) {
+		bf_plan.job_size = MAX(bf_plan.job_size * 2, 1024);
+		xrealloc(bf_plan.job_rec,
+			 sizeof(bf_plan_job_t *) * bf_plan.job_size);
+	}
+	bf_plan.job_rec[bf_plan.job_cnt++] = plan_job;
+}
+
+/* Forget a job whose test was not completed */
+static void _plan_job_abort(bf_plan_job_t *plan_job)
+{
+	if (!plan_job->retest)
+		_plan_job_del(plan_job);
+}
+
+/*
+ * Finish with a job's plan record. Only jobs for which _try_sched() gave a
+ * result (start now, start time or reservation, or not runnable on the
+ * partition's resources) are kept. Jobs skipped for anything else (limits,
+ * dependencies, licenses, a partition change, etc.) must be tested again
+ * in the next cycle, so they are left out of the plan.
+ * IN tested - true if the job's test completed
+ */
+static void _plan_job_done(bf_plan_job_t *plan_job, bool tested)
+{
+	if (tested)
+		_plan_job_commit(plan_job);
+	else
+		_plan_job_abort(plan_job);
+}
+
+/* Record a reservation made for a job in the plan */
+static void _plan_add_resv(bf_plan_job_t *plan_job, time_t start_time,
+			   uint32_t resv_start, uint32_t resv_end,
+			   bitstr_t *node_bitmap)
+{
+	bf_plan_resv_t *resv;
+
+	if (!plan_job)
+		return;
+
+	xrealloc(plan_job->resv,
+		 sizeof(bf_plan_resv_t) * (plan_job->resv_cnt + 1));
+	resv = &plan_job->resv[plan_job->resv_cnt++];
+	resv->start_time = start_time;
+	resv->resv_start = resv_start;
+	resv->resv_end = resv_end;
+	resv->node_bitmap = bit_copy(node_bitmap);
+}
+
+/* Reset the per user, association and partition counters for a new cycle */
+static void _limit_count_reset(void)
+{
+	if (!bf_user_cnt) {
+		bf_assoc_cnt = limit_count_create();
+		bf_part_cnt = limit_count_create();
+		bf_part_resv_cnt = limit_count_create();
+		bf_user_cnt = limit_count_create();
+		bf_user_part_cnt = limit_count_create();
+		return;
+	}
+	limit_count_reset(bf_assoc_cnt);
+	limit_count_reset(bf_part_cnt);
+	limit_count_reset(bf_part_resv_cnt);
+	limit_count_reset(bf_user_cnt);
+	limit_count_reset(bf_user_part_cnt);
+}
+
+static void _limit_count_fini(void)
+{
+	limit_count_destroy(bf_assoc_cnt);
+	limit_count_destroy(bf_part_cnt);
+	limit_count_destroy(bf_part_resv_cnt);
+	limit_count_destroy(bf_user_cnt);
+	limit_count_destroy(bf_user_part_cnt);
+	bf_assoc_cnt = bf_part_cnt = bf_part_resv_cnt = NULL;
+	bf_user_cnt = bf_user_part_cnt = NULL;
+}
+
 /* Terminate backfill_agent */
 extern void stop_backfill_agent(void)
 {
@@ -774,11 +1632,6 @@ static void _load_config(void)
 		      "bf_max_job_assoc taking precedence.");
 		max_backfill_job_per_user = 0;
 	}
-	if ((max_backfill_job_per_assoc != 0) &&
-	    (BF_MAX_USERS < g_user_assoc_count)) {
-		info("warning: BF_MAX_USERS < g_user_assoc_count(%u), consider increasing",
-		     g_user_assoc_count);
-	}
 	bf_min_age_reserve = 0;
 	if (sched_params &&
 	    (tmp_ptr = strstr(sched_params, "bf_min_age_reserve="))) {
@@ -803,6 +1656,41 @@ static void _load_config(void)
 		}
 	}
 
+	if (sched_params &&
+	    (tmp_ptr = strstr(sched_params, "bf_parallel="))) {
+		bf_parallel = atoi(tmp_ptr + 12);
+		if ((bf_parallel < 0) || (bf_parallel > BF_MAX_PARALLEL)) {
+			error("Invalid SchedulerParameters bf_parallel: %d",
+			      bf_parallel);
+			bf_parallel = 0;
+		}
+	} else {
+		bf_parallel = 0;
+	}
+	if (bf_parallel > 1) {
+		/* Other plugins can not run will-run tests concurrently */
+		char *select_type = slurm_get_select_type();
+		if (xstrcmp(select_type, "select/cons_res") &&
+		    xstrcmp(select_type, "select/cons_tres")) {
+			error("SchedulerParameters bf_parallel is not supported "
+			      "with SelectType=%s, ignored", select_type);
+			bf_parallel = 0;
+		}
+		xfree(select_type);
+	}
+
+	if (sched_params &&
+	    (tmp_ptr = strstr(sched_params, "bf_incremental="))) {
+		bf_incremental = atoi(tmp_ptr + 15);
+		if (bf_incremental < 0) {
+			error("Invalid SchedulerParameters bf_incremental: %d",
+			      bf_incremental);
+			bf_incremental = 0;
+		}
+	} else {
+		bf_incremental = 0;
+	}
+
 	/* bf_continue makes backfill continue where it was if interrupted */
 	if (sched_params && (strstr(sched_params, "bf_continue"))) {
 		backfill_continue = true;
@@ -959,6 +1847,9 @@ extern void *backfill_agent(void *args)
 		unlock_slurmctld(all_locks);
 		short_sleep = false;
 	}
+	_bf_spec_fini();
+	_plan_clear();
+	_limit_count_fini();
 	FREE_NULL_LIST(pack_job_list);
 
 	return NULL;
@@ -991,6 +1882,7 @@ static int _yield_locks(int usec)
 	part_update = last_part_update;
 
 	unlock_slurmctld(all_locks);
+	bf_spec_gen++;		/* Results of parallel tests now stale */
 	while (!stop_backfill) {
 		bf_sleep_usec += _my_sleep(usec);
 		if ((defer_rpc_cnt == 0) ||
@@ -1065,10 +1957,10 @@ static int _attempt_backfill(void)
 	DEF_TIMERS;
 	List job_queue;
 	job_queue_rec_t *job_queue_rec;
-	int bb, i, j, k, node_space_recs, mcs_select = 0;
+	int bb, i, j, mcs_select = 0;
 	slurmdb_qos_rec_t *qos_ptr = NULL;
 	struct job_record *job_ptr;
-	struct part_record *part_ptr, **bf_part_ptr = NULL;
+	struct part_record *part_ptr;
 	uint32_t end_time, end_reserve, deadline_time_limit, boot_time;
 	uint32_t orig_end_time;
 	uint32_t time_limit, comp_time_limit, orig_time_limit, part_time_limit;
@@ -1078,13 +1970,15 @@ static int _attempt_backfill(void)
 	time_t now, sched_start, later_start, start_res, resv_end, window_end;
 	time_t pack_time, orig_sched_start, orig_start_time = (time_t) 0;
 	node_space_map_t *node_space;
-	user_part_rec_t *bf_user_part_ptr = NULL;
+	uint32_t node_space_base;
+	bf_plan_job_t *plan_job = NULL;
+	bool plan_tested = false;
+	job_shape_cache_t *shape_cache;
+	job_shape_rec_t *shape_rec = NULL;
 	struct timeval bf_time1, bf_time2;
 	int rc = 0, error_code;
 	int job_test_count = 0, test_time_count = 0, pend_time;
-	uint32_t *uid = NULL, nuser = 0, bf_parts = 0;
-	uint32_t *bf_part_jobs = NULL, *bf_part_resv = NULL;
-	uint16_t *njobs = NULL;
+	uint32_t *assoc_cnt, *part_cnt, *resv_cnt, *user_cnt, *user_part_cnt;
 	bool already_counted;
 	uint32_t reject_array_job_id = 0;
 	struct part_record *reject_array_part = NULL;
@@ -1098,8 +1992,6 @@ static int _attempt_backfill(void)
 	bool resv_overlap = false;
 	uint8_t save_share_res = 0, save_whole_node = 0;
 	int test_fini;
-	int user_part_inx1 = -1, user_part_inx2 = -1;
-	int part_inx = -1, user_inx = -1;
 	uint32_t qos_flags = 0;
 	time_t qos_blocked_until = 0, qos_part_blocked_until = 0;
 	/* QOS Read lock */
@@ -1171,55 +2063,33 @@ static int _attempt_backfill(void)
 	slurmctld_diag_stats.bf_last_depth = 0;
 	slurmctld_diag_stats.bf_last_depth_try = 0;
 	slurmctld_diag_stats.bf_when_last_cycle = now;
+	slurmctld_diag_stats.bf_parallel = bf_parallel;
+	slurmctld_diag_stats.bf_last_spec_cnt = 0;
+	slurmctld_diag_stats.bf_last_spec_used = 0;
+	slurmctld_diag_stats.bf_last_spec_time = 0;
+	slurmctld_diag_stats.bf_last_spec_wall = 0;
+	slurmctld_diag_stats.bf_plan_jobs = _plan_resume(job_queue, now);
+	slurmctld_diag_stats.bf_plan_time = bf_plan.create_time;
+	_bf_spec_init();
 	slurmctld_diag_stats.bf_active = 1;
 
-	node_space = xmalloc(sizeof(node_space_map_t) *
-			     (max_backfill_job_cnt * 2 + 1));
-	node_space[0].begin_time = sched_start;
 	window_end = sched_start + backfill_window;
-	node_space[0].end_time = window_end;
-	node_space[0].avail_bitmap = bit_copy(avail_node_bitmap);
-	node_space[0].next = 0;
-	node_space_recs = 1;
+	node_space = node_space_create(sched_start, window_end,
+				       avail_node_bitmap);
+	_plan_replay(node_space);
+	node_space_base = node_space_rec_cnt(node_space);
+	shape_cache = job_shape_cache_create();
 	if (debug_flags & DEBUG_FLAG_BACKFILL_MAP)
 		_dump_node_space_table(node_space);
 
-	if (bf_job_part_count_reserve || max_backfill_job_per_part) {
-		ListIterator part_iterator;
-		struct part_record *part_ptr;
-		bf_parts = list_count(part_list);
-		bf_part_ptr  = xmalloc(sizeof(struct part_record *) * bf_parts);
-		bf_part_jobs = xmalloc(sizeof(uint32_t) * bf_parts);
-		bf_part_resv = xmalloc(sizeof(uint32_t) * bf_parts);
-		part_iterator = list_iterator_create(part_list);
-		i = 0;
-		while ((part_ptr = (struct part_record *)
-				   list_next(part_iterator))) {
-			bf_part_ptr[i++] = part_ptr;
-		}
-		list_iterator_destroy(part_iterator);
-	}
-	if (max_backfill_job_per_user || max_backfill_job_per_assoc) {
-		uid = xmalloc(BF_MAX_USERS * sizeof(uint32_t));
-		njobs = xmalloc(BF_MAX_USERS * sizeof(uint16_t));
-	}
-
-	if (max_backfill_job_per_user_part) {
-		ListIterator part_iterator;
-		struct part_record *part_ptr;
-		bf_parts = list_count(part_list);
-		bf_user_part_ptr = xmalloc(sizeof(user_part_rec_t) * bf_parts);
-		part_iterator = list_iterator_create(part_list);
-		i = 0;
-		while ((part_ptr = (struct part_record *)
-				   list_next(part_iterator))) {
-			bf_user_part_ptr[i].part_ptr = part_ptr;
-			bf_user_part_ptr[i].njobs =
-				xmalloc(BF_MAX_USERS * sizeof(uint16_t));
-			bf_user_part_ptr[i++].uid =
-				xmalloc(BF_MAX_USERS * sizeof(uint32_t));
-		}
-		list_iterator_destroy(part_iterator);
+	_limit_count_reset();
+	/* Reservations kept from earlier cycles */
+	for (i = 0; bf_job_part_count_reserve && (i < bf_plan.job_cnt); i++) {
+		if (bf_plan.job_rec[i]->retest)
+			continue;
+		resv_cnt = limit_count_find(bf_part_resv_cnt, 0,
+					    bf_plan.job_rec[i]->part_ptr);
+		*resv_cnt += bf_plan.job_rec[i]->resv_cnt;
 	}
 
 	if (assoc_limit_stop) {
@@ -1229,11 +2099,14 @@ static int _attempt_backfill(void)
 		assoc_mgr_unlock(&qos_read_lock);
 	}
 
-	sort_job_queue(job_queue);
 	while (1) {
 		uint32_t bf_job_id, bf_array_task_id, bf_job_priority,
 			prio_reserve;
 
+		if (plan_job) {
+			_plan_job_done(plan_job, plan_tested);
+			plan_job = NULL;
+		}
 		job_queue_rec = (job_queue_rec_t *) list_pop(job_queue);
 		if (!job_queue_rec) {
 			if (debug_flags & DEBUG_FLAG_BACKFILL)
@@ -1247,6 +2120,8 @@ static int _attempt_backfill(void)
 		bf_job_priority  = job_queue_rec->priority;
 		bf_array_task_id = job_queue_rec->array_task_id;
 		xfree(job_queue_rec);
+		plan_job = _plan_job_get(bf_job_id, bf_array_task_id, part_ptr);
+		plan_tested = false;
 
 		if (slurmctld_config.shutdown_time ||
 		    (difftime(time(NULL),orig_sched_start) >= bf_max_time)){
@@ -1277,6 +2152,8 @@ static int _attempt_backfill(void)
 			}
 			if (stop_backfill)
 				break;
+			/* Jobs may have ended, earlier results are stale */
+			job_shape_cache_clear(shape_cache);
 			/* Reset backfill scheduling timers, resume testing */
 			sched_start = time(NULL);
 			gettimeofday(&start_tv, NULL);
@@ -1418,14 +2295,10 @@ static int _attempt_backfill(void)
 		}
 
 		if ((job_no_reserve == 0) && bf_job_part_count_reserve) {
-			for (j = 0; j < bf_parts; j++) {
-				if (bf_part_ptr[j] != job_ptr->part_ptr)
-					continue;
-				if (bf_part_resv[j] >=
-				    bf_job_part_count_reserve)
-					job_no_reserve = TEST_NOW_ONLY;
-				break;
-			}
+			resv_cnt = limit_count_find(bf_part_resv_cnt, 0,
+						    job_ptr->part_ptr);
+			if (*resv_cnt >= bf_job_part_count_reserve)
+				job_no_reserve = TEST_NOW_ONLY;
 		}
 
 		orig_start_time = job_ptr->start_time;
@@ -1471,35 +2344,13 @@ next_task:
 		}
 
 		/* Test to see if we've exceeded any per user/partition limit */
+		user_part_cnt = NULL;
 		if (max_backfill_job_per_user_part) {
-			bool skip_job = false;
-			for (j = 0; j < bf_parts; j++) {
-				if (bf_user_part_ptr[j].part_ptr !=
-				    job_ptr->part_ptr)
-					continue;
-				for (k = 0; k < bf_user_part_ptr[j].user_cnt;
-				     k++) {
-					if (bf_user_part_ptr[j].uid[k] !=
-					    job_ptr->user_id)
-						continue;
-					user_part_inx1 = j;
-					user_part_inx2 = k;
-					if ((bf_user_part_ptr[j].njobs[k] + 1)
-					    > max_backfill_job_per_user_part)
-						skip_job = true;
-					break;
-				}
-				if ((k == bf_user_part_ptr[j].user_cnt) &&
-				    (k < BF_MAX_USERS)) {
-					bf_user_part_ptr[j].user_cnt++;
-					bf_user_part_ptr[j].uid[k] =
-						job_ptr->user_id;
-					user_part_inx1 = j;
-					user_part_inx2 = k;
-				}
-				break;
-			}
-			if (skip_job) {
+			user_part_cnt = limit_count_find(bf_user_part_cnt,
+							 job_ptr->user_id,
+							 job_ptr->part_ptr);
+			if ((*user_part_cnt + 1) >
+			    max_backfill_job_per_user_part) {
 				if (debug_flags & DEBUG_FLAG_BACKFILL)
 					info("backfill: have already "
 					     "checked %u jobs for user %u on "
@@ -1512,18 +2363,11 @@ next_task:
 				continue;
 			}
 		}
+		part_cnt = NULL;
 		if (max_backfill_job_per_part) {
-			bool skip_job = false;
-			for (j = 0; j < bf_parts; j++) {
-				if (bf_part_ptr[j] != job_ptr->part_ptr)
-					continue;
-				part_inx = j;
-				if ((bf_part_jobs[j] + 1) >
-				    max_backfill_job_per_part)
-					skip_job = true;
-				break;
-			}
-			if (skip_job) {
+			part_cnt = limit_count_find(bf_part_cnt, 0,
+						    job_ptr->part_ptr);
+			if ((*part_cnt + 1) > max_backfill_job_per_part) {
 				if (debug_flags & DEBUG_FLAG_BACKFILL)
 					info("backfill: have already "
 					     "checked %u jobs for "
@@ -1537,33 +2381,22 @@ next_task:
 		}
 
 		if (max_backfill_job_per_assoc) {
-			for (j = 0; j < nuser; j++) {
-				if (job_ptr->assoc_id == uid[j]) {
-					njobs[j]++;
-					if (debug_flags & DEBUG_FLAG_BACKFILL)
-						debug("backfill: user %u assoc %u: #jobs %u",
-						      job_ptr->user_id,
-						      uid[j], njobs[j]);
-					break;
-				}
-			}
-			if (j == nuser) { /* assoc not found */
-				static bool bf_max_user_msg = true;
-				if (nuser < BF_MAX_USERS) {
-					uid[j] = job_ptr->assoc_id;
-					njobs[j] = 1;
-					nuser++;
-				} else if (bf_max_user_msg) {
-					bf_max_user_msg = false;
-					error("backfill: too many associations in queue. Conside increasing BF_MAX_USERS from %u (g_user_assoc_count=%u)",
-					      nuser, g_user_assoc_count);
-				}
+			assoc_cnt = limit_count_find(bf_assoc_cnt,
+						     job_ptr->assoc_id, NULL);
+			if (*assoc_cnt == 0) {	/* assoc not found */
+				*assoc_cnt = 1;
 				if (debug_flags & DEBUG_FLAG_BACKFILL)
 					debug2("backfill: found new user/assoc %u/%u.  Total #users/assoc now %u",
 					       job_ptr->user_id,
-					       job_ptr->assoc_id, nuser);
+					       job_ptr->assoc_id,
+					       limit_count_size(bf_assoc_cnt));
 			} else {
-				if (njobs[j] >= max_backfill_job_per_assoc) {
+				(*assoc_cnt)++;
+				if (debug_flags & DEBUG_FLAG_BACKFILL)
+					debug("backfill: user %u assoc %u: #jobs %u",
+					      job_ptr->user_id,
+					      job_ptr->assoc_id, *assoc_cnt);
+				if (*assoc_cnt >= max_backfill_job_per_assoc) {
 					/* skip job */
 					if (debug_flags & DEBUG_FLAG_BACKFILL)
 						info("backfill: have already checked %u jobs for user %u, assoc %u; skipping job %u",
@@ -1576,62 +2409,36 @@ next_task:
 			}
 		}
 
+		user_cnt = NULL;
 		if (max_backfill_job_per_user) {
-			for (j = 0; j < nuser; j++) {
-				if (job_ptr->user_id == uid[j]) {
-					user_inx = j;
-					if (debug_flags & DEBUG_FLAG_BACKFILL) {
-						debug("backfill: user %u: "
-						      "#jobs %u",
-						      uid[j], njobs[j]);
-					}
-					break;
-				}
+			user_cnt = limit_count_find(bf_user_cnt,
+						    job_ptr->user_id, NULL);
+			if (debug_flags & DEBUG_FLAG_BACKFILL) {
+				debug("backfill: user %u: #jobs %u",
+				      job_ptr->user_id, *user_cnt);
 			}
-			if (j == nuser) { /* user not found */
-				static bool bf_max_user_msg = true;
-				if (nuser < BF_MAX_USERS) {
-					user_inx = j;
-					uid[j] = job_ptr->user_id;
-					nuser++;
-				} else if (bf_max_user_msg) {
-					bf_max_user_msg = false;
-					error("backfill: too many users in "
-					      "queue. Consider increasing "
-					      "BF_MAX_USERS");
-				}
+			if ((*user_cnt + 1) > max_backfill_job_per_user) {
+				/* skip job */
 				if (debug_flags & DEBUG_FLAG_BACKFILL) {
-					debug2("backfill: found new user %u. "
-					       "Total #users now %u",
-					       job_ptr->user_id, nuser);
-				}
-			} else {
-				if ((njobs[j] + 1) > max_backfill_job_per_user){
-					/* skip job */
-					if (debug_flags & DEBUG_FLAG_BACKFILL) {
-						info("backfill: have already "
-						     "checked %u jobs for "
-						     "user %u; skipping "
-						     "job %u",
-						     max_backfill_job_per_user,
-						     job_ptr->user_id,
-						     job_ptr->job_id);
-					}
-					continue;
+					info("backfill: have already "
+					     "checked %u jobs for "
+					     "user %u; skipping "
+					     "job %u",
+					     max_backfill_job_per_user,
+					     job_ptr->user_id,
+					     job_ptr->job_id);
 				}
+				continue;
 			}
 		}
 
 		/* Increment our user/partition limit counters as needed */
-		if (max_backfill_job_per_user_part &&
-		    (user_part_inx1 != -1) && (user_part_inx2 != -1)) {
-			bf_user_part_ptr[user_part_inx1].
-				njobs[user_part_inx2]++;
-		}
-		if (max_backfill_job_per_part && (part_inx != -1))
-			bf_part_jobs[part_inx]++;
-		if (max_backfill_job_per_user && (user_inx != -1))
-			njobs[user_inx]++;
+		if (user_part_cnt)
+			(*user_part_cnt)++;
+		if (part_cnt)
+			(*part_cnt)++;
+		if (user_cnt)
+			(*user_cnt)++;
 
 		if (((part_ptr->state_up & PARTITION_SCHED) == 0) ||
 		    (part_ptr->node_bitmap == NULL)) {
@@ -1726,6 +2533,30 @@ next_task:
 			}
 		}
 
+		/*
+		 * node_space only loses resources during the cycle, so a job
+		 * with the same request as one tested earlier can not start
+		 * before that job could.
+		 */
+		shape_rec = job_shape_cache_find(shape_cache, job_ptr,
+						 time_limit);
+		if (shape_rec && (shape_rec->start_time == INFINITE)) {
+			if (debug_flags & DEBUG_FLAG_BACKFILL)
+				info("backfill: job %u has the same request as "
+				     "a job which can not start",
+				     job_ptr->job_id);
+			_set_job_time_limit(job_ptr, orig_time_limit);
+			job_ptr->start_time = orig_start_time;
+			continue;
+		}
+		if (shape_rec && (shape_rec->start_time > later_start)) {
+			later_start = shape_rec->start_time;
+			if (debug_flags & DEBUG_FLAG_BACKFILL)
+				info("backfill: job %u has the same request as "
+				     "a job which can not start before %ld",
+				     job_ptr->job_id, later_start);
+		}
+
  TRY_LATER:
 		if (slurmctld_config.shutdown_time ||
 		    (difftime(time(NULL), orig_sched_start) >=
@@ -1763,6 +2594,10 @@ next_task:
 			if (stop_backfill)
 				break;
 
+			/* Jobs may have ended, earlier results are stale */
+			job_shape_cache_clear(shape_cache);
+			shape_rec = NULL;
+
 			/* Reset backfill scheduling timers, resume testing */
 			sched_start = time(NULL);
 			gettimeofday(&start_tv, NULL);
@@ -1816,34 +2651,14 @@ next_task:
 		if (resv_overlap)
 			resv_end = find_resv_end(start_res);
 		/* Identify usable nodes for this job */
-		bit_and(avail_bitmap, part_ptr->node_bitmap);
-		bit_and(avail_bitmap, up_node_bitmap);
-		filter_by_node_owner(job_ptr, avail_bitmap);
-		filter_by_node_mcs(job_ptr, mcs_select, avail_bitmap);
-		for (j = 0; ; ) {
-			if ((node_space[j].end_time > start_res) &&
-			     node_space[j].next && (later_start == 0))
-				later_start = node_space[j].end_time;
-			if (node_space[j].end_time <= start_res)
-				;
-			else if (node_space[j].begin_time <= end_time) {
-				bit_and(avail_bitmap,
-					node_space[j].avail_bitmap);
-			} else
-				break;
-			if ((j = node_space[j].next) == 0)
-				break;
-		}
+		later_start = _job_avail_nodes(job_ptr, part_ptr, mcs_select,
+					       start_res, end_time, node_space,
+					       avail_bitmap);
 		if (resv_end && (++resv_end < window_end) &&
 		    ((later_start == 0) || (resv_end < later_start))) {
 			later_start = resv_end;
 		}
 
-		if (job_ptr->details->exc_node_bitmap) {
-			bit_and_not(avail_bitmap,
-				job_ptr->details->exc_node_bitmap);
-		}
-
 		/* Test if insufficient nodes remain OR
 		 *	required nodes missing OR
 		 *	nodes lack features OR
@@ -1858,6 +2673,8 @@ next_task:
 				job_ptr->start_time = 0;
 				goto TRY_LATER;
 			}
+			if (shape_rec && !job_no_reserve)
+				shape_rec->start_time = INFINITE;
 
 			/* Job can not start until too far in the future */
 			_set_job_time_limit(job_ptr, orig_time_limit);
@@ -1938,21 +2755,17 @@ next_task:
 			orig_end_time = end_time;
 			end_time += boot_time;
 
-			for (j = 0; ; ) {
-				if (node_space[j].end_time <= start_res)
-					;
-				else if (node_space[j].begin_time <= end_time) {
-					if (node_space[j].begin_time >
-					    orig_end_time)
-						bit_and(avail_bitmap,
-						node_space[j].avail_bitmap);
-				} else
-					break;
-				if ((j = node_space[j].next) == 0)
-					break;
-			}
+			node_space_and_after(node_space, start_res, end_time,
+					     orig_end_time, avail_bitmap);
 		}
-		if (test_fini != 1) {
+		if ((test_fini == -1) && bf_spec_size) {
+			/* No node reboot needed, test with other candidates */
+			j = _bf_spec_try_sched(job_ptr, part_ptr,
+					       &avail_bitmap, min_nodes,
+					       max_nodes, req_nodes,
+					       exc_core_bitmap, job_queue,
+					       node_space, now);
+		} else if (test_fini != 1) {
 			/* Either active_bitmap was NULL or not usable by the
 			 * job. Test using avail_bitmap instead */
 			j = _try_sched(job_ptr, &avail_bitmap, min_nodes,
@@ -1972,13 +2785,18 @@ next_task:
 				job_ptr->start_time = 0;
 				goto TRY_LATER;
 			}
+			if (shape_rec && !job_no_reserve)
+				shape_rec->start_time = INFINITE;
 			if (orig_start_time != 0)  /* Can start in other part */
 				job_ptr->start_time = orig_start_time;
 			else
 				job_ptr->start_time = 0;
+			plan_tested = true;
 			continue;	/* not runable in this partition */
 		}
 
+		if (shape_rec && (start_res > shape_rec->start_time))
+			shape_rec->start_time = start_res;
 		if (start_res > job_ptr->start_time) {
 			job_ptr->start_time = start_res;
 			last_job_update = now;
@@ -2032,6 +2850,7 @@ next_task:
 			}
 
 			rc = _start_job(job_ptr, resv_bitmap);
+			bf_spec_gen++;	/* Results of parallel tests now stale */
 
 			if (rc == SLURM_SUCCESS) {
 				/*
@@ -2155,6 +2974,7 @@ skip_start:
 				later_start = 0;
 			} else {
 				/* Started this job, move to next one */
+				plan_tested = true;
 				reject_array_job_id = 0;
 				reject_array_part   = NULL;
 
@@ -2232,10 +3052,12 @@ skip_start:
 				/* Can start earlier in different partition */
 				job_ptr->start_time = orig_start_time;
 			}
+			plan_tested = true;
 			continue;
 		}
 
-		if (node_space_recs >= max_backfill_job_cnt) {
+		if ((node_space_rec_cnt(node_space) - node_space_base) >=
+		    max_backfill_job_cnt) {
 			if (debug_flags & DEBUG_FLAG_BACKFILL) {
 				info("backfill: table size limit of %u reached",
 				     max_backfill_job_cnt);
@@ -2265,7 +3087,7 @@ skip_start:
 		if ((job_ptr->start_time > now) &&
 		    (job_ptr->state_reason != WAIT_BURST_BUFFER_RESOURCE) &&
 		    (job_ptr->state_reason != WAIT_BURST_BUFFER_STAGING) &&
-		    _test_resv_overlap(node_space, avail_bitmap,
+		    node_space_overlap(node_space, avail_bitmap,
 				       start_time, end_reserve)) {
 			/* This job overlaps with an existing reservation for
 			 * job to be backfill scheduled, which the sched
@@ -2344,25 +3166,21 @@ skip_start:
 			continue;
 		}
 		if (bf_job_part_count_reserve) {
-			bool do_reserve = true;
-			for (j = 0; j < bf_parts; j++) {
-				if (bf_part_ptr[j] != job_ptr->part_ptr)
-					continue;
-				if (bf_part_resv[j]++ >=
-				    bf_job_part_count_reserve)
-					do_reserve = false;
-				break;
-			}
-			if (!do_reserve)
+			resv_cnt = limit_count_find(bf_part_resv_cnt, 0,
+						    job_ptr->part_ptr);
+			if ((*resv_cnt)++ >= bf_job_part_count_reserve)
 				continue;
 		}
 		reject_array_job_id = 0;
 		reject_array_part   = NULL;
 		xfree(job_ptr->sched_nodes);
 		job_ptr->sched_nodes = bitmap2node_name(avail_bitmap);
+		_plan_add_resv(plan_job, job_ptr->start_time, start_time,
+			       end_reserve, avail_bitmap);
+		plan_tested = true;
 		bit_not(avail_bitmap);
-		_add_reservation(start_time, end_reserve,
-				 avail_bitmap, node_space, &node_space_recs);
+		node_space_add_reservation(node_space, start_time, end_reserve,
+					   avail_bitmap);
 		if (debug_flags & DEBUG_FLAG_BACKFILL_MAP)
 			_dump_node_space_table(node_space);
 		if ((orig_start_time != 0) &&
@@ -2383,32 +3201,18 @@ skip_start:
 				goto next_task;
 		}
 	}
+	if (plan_job)
+		_plan_job_done(plan_job, plan_tested);
 
 	_job_pack_deadlock_fini();
 	_pack_start_test(node_space);
 
-	xfree(bf_part_jobs);
-	xfree(bf_part_resv);
-	xfree(bf_part_ptr);
-	xfree(uid);
-	xfree(njobs);
-	if (bf_user_part_ptr) {
-		for (i = 0; i < bf_parts; i++) {
-			xfree(bf_user_part_ptr[i].njobs);
-			xfree(bf_user_part_ptr[i].uid);
-		}
-		xfree(bf_user_part_ptr);
-	}
 	FREE_NULL_BITMAP(avail_bitmap);
 	FREE_NULL_BITMAP(exc_core_bitmap);
 	FREE_NULL_BITMAP(resv_bitmap);
 
-	for (i = 0; ; ) {
-		FREE_NULL_BITMAP(node_space[i].avail_bitmap);
-		if ((i = node_space[i].next) == 0)
-			break;
-	}
-	xfree(node_space);
+	node_space_destroy(node_space);
+	job_shape_cache_destroy(shape_cache);
 	FREE_NULL_LIST(job_queue);
 
 	gettimeofday(&bf_time2, NULL);
@@ -2508,25 +3312,20 @@ static int _start_job(struct job_record *job_ptr, bitstr_t *resv_bitmap)
 static uint32_t _get_job_max_tl(struct job_record *job_ptr, time_t now,
 				node_space_map_t *node_space)
 {
-	int32_t j;
-	time_t comp_time = 0;
+	time_t comp_time;
 	uint32_t max_tl = NO_VAL;
 
 	if (job_ptr->time_min == 0)
 		return max_tl;
 
-	for (j = 0; ; ) {
-		if ((node_space[j].begin_time != now) && // No current conflicts
-		    (node_space[j].begin_time < job_ptr->end_time) &&
-		    (!bit_super_set(job_ptr->node_bitmap,
-				    node_space[j].avail_bitmap))) {
-			/* Job overlaps pending job's resource reservation */
-			if ((comp_time == 0) ||
-			    (comp_time > node_space[j].begin_time))
-				comp_time = node_space[j].begin_time;
-		}
-		if ((j = node_space[j].next) == 0)
-			break;
+	/* Job overlaps pending job's resource reservation, excluding any
+	 * beginning now (no current conflicts) */
+	comp_time = node_space_conflict(node_space, job_ptr->node_bitmap,
+					0, now - 1);
+	if (comp_time == 0) {
+		comp_time = node_space_conflict(node_space,
+						job_ptr->node_bitmap, now + 1,
+						job_ptr->end_time - 1);
 	}
 
 	if (comp_time != 0)
@@ -2544,23 +3343,26 @@ static uint32_t _get_job_max_tl(struct job_record *job_ptr, time_t now,
 static void _reset_job_time_limit(struct job_record *job_ptr, time_t now,
 				  node_space_map_t *node_space)
 {
-	int32_t j, resv_delay;
+	int32_t resv_delay;
 	uint32_t orig_time_limit = job_ptr->time_limit;
 	uint32_t new_time_limit;
-
-	for (j = 0; ; ) {
-		if ((node_space[j].begin_time != now) && // No current conflicts
-		    (node_space[j].begin_time < job_ptr->end_time) &&
-		    (!bit_super_set(job_ptr->node_bitmap,
-				    node_space[j].avail_bitmap))) {
-			/* Job overlaps pending job's resource reservation */
-			resv_delay = difftime(node_space[j].begin_time, now);
-			resv_delay /= 60;	/* seconds to minutes */
-			if (resv_delay < job_ptr->time_limit)
-				job_ptr->time_limit = resv_delay;
-		}
-		if ((j = node_space[j].next) == 0)
-			break;
+	time_t resv_time;
+
+	/* Job overlaps pending job's resource reservation, excluding any
+	 * beginning now (no current conflicts). Reservations which began a
+	 * full minute or more ago have a negative delay and are ignored. */
+	resv_time = node_space_conflict(node_space, job_ptr->node_bitmap,
+					now - 59, now - 1);
+	if (resv_time == 0) {
+		resv_time = node_space_conflict(node_space,
+						job_ptr->node_bitmap, now + 1,
+						job_ptr->end_time - 1);
+	}
+	if (resv_time) {
+		resv_delay = difftime(resv_time, now);
+		resv_delay /= 60;	/* seconds to minutes */
+		if (resv_delay < job_ptr->time_limit)
+			job_ptr->time_limit = resv_delay;
 	}
 	new_time_limit = MAX(job_ptr->time_min, job_ptr->time_limit);
 	acct_policy_alter_job(job_ptr, new_time_limit);
@@ -2591,126 +3393,6 @@ static bool _more_work (time_t last_backfill_time)
 	return rc;
 }
 
-/* Create a reservation for a job in the future */
-static void _add_reservation(uint32_t start_time, uint32_t end_reserve,
-			     bitstr_t *res_bitmap,
-			     node_space_map_t *node_space,
-			     int *node_space_recs)
-{
-	bool placed = false;
-	int i, j;
-
-#if 0	
-	info("add job start:%u end:%u", start_time, end_reserve);
-	for (j = 0; ; ) {
-		info("node start:%u end:%u",
-		     (uint32_t) node_space[j].begin_time,
-		     (uint32_t) node_space[j].end_time);
-		if ((j = node_space[j].next) == 0)
-			break;
-	}
-#endif
-
-	start_time = MAX(start_time, node_space[0].begin_time);
-	for (j = 0; ; ) {
-		if (node_space[j].end_time > start_time) {
-			/* insert start entry record */
-			i = *node_space_recs;
-			node_space[i].begin_time = start_time;
-			node_space[i].end_time = node_space[j].end_time;
-			node_space[j].end_time = start_time;
-			node_space[i].avail_bitmap =
-				bit_copy(node_space[j].avail_bitmap);
-			node_space[i].next = node_space[j].next;
-			node_space[j].next = i;
-			(*node_space_recs)++;
-			placed = true;
-		}
-		if (node_space[j].end_time == start_time) {
-			/* no need to insert new start entry record */
-			placed = true;
-		}
-		if (placed == true) {
-			while ((j = node_space[j].next)) {
-				if (end_reserve < node_space[j].end_time) {
-					/* insert end entry record */
-					i = *node_space_recs;
-					node_space[i].begin_time = end_reserve;
-					node_space[i].end_time = node_space[j].
-								 end_time;
-					node_space[j].end_time = end_reserve;
-					node_space[i].avail_bitmap =
-						bit_copy(node_space[j].
-							 avail_bitmap);
-					node_space[i].next = node_space[j].next;
-					node_space[j].next = i;
-					(*node_space_recs)++;
-					break;
-				}
-				if (end_reserve == node_space[j].end_time) {
-					break;
-				}
-			}
-			break;
-		}
-		if ((j = node_space[j].next) == 0)
-			break;
-	}
-
-	for (j = 0; ; ) {
-		if ((node_space[j].begin_time >= start_time) &&
-		    (node_space[j].end_time <= end_reserve))
-			bit_and(node_space[j].avail_bitmap, res_bitmap);
-		if ((node_space[j].begin_time >= end_reserve) ||
-		    ((j = node_space[j].next) == 0))
-			break;
-	}
-
-	/* Drop records with identical bitmaps (up to one record).
-	 * This can significantly improve performance of the backfill tests. */
-	for (i = 0; ; ) {
-		if ((j = node_space[i].next) == 0)
-			break;
-		if (!bit_equal(node_space[i].avail_bitmap,
-			       node_space[j].avail_bitmap)) {
-			i = j;
-			continue;
-		}
-		node_space[i].end_time = node_space[j].end_time;
-		node_space[i].next = node_space[j].next;
-		FREE_NULL_BITMAP(node_space[j].avail_bitmap);
-		break;
-	}
-}
-
-/*
- * Determine if the resource specification for a new job overlaps with a
- *	reservation that the backfill scheduler has made for a job to be
- *	started in the future.
- * IN use_bitmap - nodes to be allocated
- * IN start_time - start time of job
- * IN end_reserve - end time of job
- */
-static bool _test_resv_overlap(node_space_map_t *node_space,
-			       bitstr_t *use_bitmap, uint32_t start_time,
-			       uint32_t end_reserve)
-{
-	bool overlap = false;
-	int j;
-
-	for (j=0; ; ) {
-		if ((node_space[j].end_time   > start_time) &&
-		    (node_space[j].begin_time < end_reserve) &&
-		    (!bit_super_set(use_bitmap, node_space[j].avail_bitmap))) {
-			overlap = true;
-			break;
-		}
-		if ((j = node_space[j].next) == 0)
-			break;
-	}
-	return overlap;
-}
-
 /*
  * Delete pack_job_map_t record from pack_job_list
  */
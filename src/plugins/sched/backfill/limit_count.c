@@ -0,0 +1,183 @@
+/*****************************************************************************\
+ *  limit_count.c - backfill scheduler job counts by user and partition
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+
+/*
+ * Counters are kept in an array chained into hash buckets. Each bucket
+ * records the generation in which its chain was last started, so a reset
+ * only increments the generation and empties the array rather than clearing
+ * every bucket.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "src/common/macros.h"
+#include "src/common/xmalloc.h"
+
+#include "limit_count.h"
+
+#define LIMIT_COUNT_BUCKETS	1024	/* initial bucket count, power of 2 */
+
+typedef struct limit_count_rec {
+	uint32_t id;
+	const void *ptr;
+	uint32_t count;
+	int next;		/* next record in bucket, -1 at end */
+} limit_count_rec_t;
+
+struct limit_count {
+	uint32_t gen;		/* current generation */
+	int bucket_cnt;
+	uint32_t *bucket_gen;	/* generation of bucket_head */
+	int *bucket_head;	/* first record in bucket */
+	limit_count_rec_t *rec;
+	int rec_cnt;
+	int rec_size;
+};
+
+static int _hash(limit_count_t *counts, uint32_t id, const void *ptr)
+{
+	uint64_t key = ((uint64_t) id << 32) ^ (uint64_t) (uintptr_t) ptr;
+
+	key ^= key >> 29;
+	key *= 0xbf58476d1ce4e5b9ULL;
+	key ^= key >> 32;
+	return (int) (key & (counts->bucket_cnt - 1));
+}
+
+static void _bucket_alloc(limit_count_t *counts, int bucket_cnt)
+{
+	xfree(counts->bucket_gen);
+	xfree(counts->bucket_head);
+	counts->bucket_cnt = bucket_cnt;
+	counts->bucket_gen = xmalloc(sizeof(uint32_t) * bucket_cnt);
+	counts->bucket_head = xmalloc(sizeof(int) * bucket_cnt);
+}
+
+static void _bucket_add(limit_count_t *counts, int inx)
+{
+	limit_count_rec_t *rec = &counts->rec[inx];
+	int b = _hash(counts, rec->id, rec->ptr);
+
+	if (counts->bucket_gen[b] != counts->gen) {
+		counts->bucket_gen[b] = counts->gen;
+		rec->next = -1;
+	} else {
+		rec->next = counts->bucket_head[b];
+	}
+	counts->bucket_head[b] = inx;
+}
+
+/* Double the buckets once there are more records than buckets */
+static void _grow(limit_count_t *counts)
+{
+	int i;
+
+	counts->rec_size *= 2;
+	xrealloc(counts->rec, sizeof(limit_count_rec_t) * counts->rec_size);
+
+	_bucket_alloc(counts, counts->bucket_cnt * 2);
+	counts->gen = 1;
+	for (i = 0; i < counts->rec_cnt; i++)
+		_bucket_add(counts, i);
+}
+
+extern limit_count_t *limit_count_create(void)
+{
+	limit_count_t *counts = xmalloc(sizeof(limit_count_t));
+
+	_bucket_alloc(counts, LIMIT_COUNT_BUCKETS);
+	counts->gen = 1;
+	counts->rec_size = LIMIT_COUNT_BUCKETS;
+	counts->rec = xmalloc(sizeof(limit_count_rec_t) * counts->rec_size);
+
+	return counts;
+}
+
+extern void limit_count_destroy(limit_count_t *counts)
+{
+	if (!counts)
+		return;
+
+	xfree(counts->bucket_gen);
+	xfree(counts->bucket_head);
+	xfree(counts->rec);
+	xfree(counts);
+}
+
+extern void limit_count_reset(limit_count_t *counts)
+{
+	counts->rec_cnt = 0;
+	if (++counts->gen == 0) {	/* wrapped, generations now ambiguous */
+		memset(counts->bucket_gen, 0,
+		       sizeof(uint32_t) * counts->bucket_cnt);
+		counts->gen = 1;
+	}
+}
+
+extern uint32_t *limit_count_find(limit_count_t *counts, uint32_t id,
+				  const void *ptr)
+{
+	limit_count_rec_t *rec;
+	int b = _hash(counts, id, ptr), inx;
+
+	if (counts->bucket_gen[b] == counts->gen) {
+		for (inx = counts->bucket_head[b]; inx != -1;
+		     inx = counts->rec[inx].next) {
+			rec = &counts->rec[inx];
+			if ((rec->id == id) && (rec->ptr == ptr))
+				return &rec->count;
+		}
+	}
+
+	if (counts->rec_cnt >= counts->rec_size)
+		_grow(counts);
+	inx = counts->rec_cnt++;
+	rec = &counts->rec[inx];
+	rec->id = id;
+	rec->ptr = ptr;
+	rec->count = 0;
+	_bucket_add(counts, inx);
+
+	return &rec->count;
+}
+
+extern int limit_count_size(limit_count_t *counts)
+{
+	return counts->rec_cnt;
+}
@@ -0,0 +1,69 @@
+/*****************************************************************************\
+ *  limit_count.h - backfill scheduler job counts by user and partition
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+
+#ifndef _SLURM_BACKFILL_LIMIT_COUNT_H
+#define _SLURM_BACKFILL_LIMIT_COUNT_H
+
+#include <stdint.h>
+
+/*
+ * Counters of jobs tested or reserved by the backfill scheduler in a cycle,
+ * keyed by a numeric ID (user ID or association ID) and an optional pointer
+ * (partition). Counters are created at zero when first looked up and all
+ * of them are discarded at once with limit_count_reset().
+ */
+typedef struct limit_count limit_count_t;
+
+/* Create an empty set of counters. Release with limit_count_destroy(). */
+extern limit_count_t *limit_count_create(void);
+
+extern void limit_count_destroy(limit_count_t *counts);
+
+/* Discard all counters, in constant time */
+extern void limit_count_reset(limit_count_t *counts);
+
+/*
+ * Find the counter for an ID and pointer, creating it at zero if needed.
+ * RET pointer to the counter, valid until the next limit_count_find() or
+ *     limit_count_reset() call
+ */
+extern uint32_t *limit_count_find(limit_count_t *counts, uint32_t id,
+				  const void *ptr);
+
+/* RET count of counters in use */
+extern int limit_count_size(limit_count_t *counts);
+
+#endif
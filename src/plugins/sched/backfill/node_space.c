@@ -0,0 +1,512 @@
+/*****************************************************************************\
+ *  node_space.c - backfill scheduler map of future node availability
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+/*
+ * Records are kept both in a time ordered list and in a treap keyed by
+ * begin_time. Each treap node summarizes its subtree with the AND of the
+ * subtree's node bitmaps, the range of begin times covered and the number of
+ * records identical to their successor. This lets the earliest record
+ * containing a time be located, a time span be intersected and the earliest
+ * conflicting record be found by visiting O(log n) records, rather than
+ * walking and ANDing every record from the start of the window.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+
+#include "src/common/macros.h"
+#include "src/common/xmalloc.h"
+
+#include "node_space.h"
+
+typedef struct node_space_rec node_space_rec_t;
+struct node_space_rec {
+	time_t begin_time;
+	time_t end_time;
+	bitstr_t *avail_bitmap;
+	bool eq_next;		/* avail_bitmap identical to next record's */
+
+	node_space_rec_t *prev;	/* previous record by time */
+	node_space_rec_t *next;	/* next record by time */
+
+	node_space_rec_t *left;
+	node_space_rec_t *right;
+	node_space_rec_t *parent;
+	uint32_t priority;
+
+	/* Subtree summary */
+	bitstr_t *sub_bitmap;	/* AND of all avail_bitmap in subtree */
+	time_t sub_first;	/* first begin_time in subtree */
+	time_t sub_last;	/* last begin_time in subtree */
+	int sub_eq_cnt;		/* records with eq_next set in subtree */
+};
+
+struct node_space_map {
+	node_space_rec_t *root;
+	node_space_rec_t *head;
+	int rec_cnt;
+	uint32_t seed;
+};
+
+static node_space_rec_t *_rec_create(node_space_map_t *node_space,
+				     time_t begin_time, time_t end_time,
+				     bitstr_t *avail_bitmap)
+{
+	node_space_rec_t *rec = xmalloc(sizeof(node_space_rec_t));
+
+	/* xorshift32, deterministic so that tree shape is reproducible */
+	node_space->seed ^= node_space->seed << 13;
+	node_space->seed ^= node_space->seed >> 17;
+	node_space->seed ^= node_space->seed << 5;
+
+	rec->begin_time = begin_time;
+	rec->end_time = end_time;
+	rec->avail_bitmap = avail_bitmap;
+	rec->priority = node_space->seed;
+	rec->sub_bitmap = bit_copy(avail_bitmap);
+	rec->sub_first = begin_time;
+	rec->sub_last = begin_time;
+	node_space->rec_cnt++;
+
+	return rec;
+}
+
+static void _rec_free(node_space_rec_t *rec)
+{
+	FREE_NULL_BITMAP(rec->avail_bitmap);
+	FREE_NULL_BITMAP(rec->sub_bitmap);
+	xfree(rec);
+}
+
+/* Recompute the subtree summary of rec from its children */
+static void _update(node_space_rec_t *rec)
+{
+	bit_copybits(rec->sub_bitmap, rec->avail_bitmap);
+	rec->sub_first = rec->begin_time;
+	rec->sub_last = rec->begin_time;
+	rec->sub_eq_cnt = rec->eq_next ? 1 : 0;
+	if (rec->left) {
+		bit_and(rec->sub_bitmap, rec->left->sub_bitmap);
+		rec->sub_first = rec->left->sub_first;
+		rec->sub_eq_cnt += rec->left->sub_eq_cnt;
+	}
+	if (rec->right) {
+		bit_and(rec->sub_bitmap, rec->right->sub_bitmap);
+		rec->sub_last = rec->right->sub_last;
+		rec->sub_eq_cnt += rec->right->sub_eq_cnt;
+	}
+}
+
+static void _update_path(node_space_rec_t *rec)
+{
+	for ( ; rec; rec = rec->parent)
+		_update(rec);
+}
+
+/* Update only sub_eq_cnt, after a change in eq_next */
+static void _update_eq_path(node_space_rec_t *rec)
+{
+	for ( ; rec; rec = rec->parent) {
+		rec->sub_eq_cnt = rec->eq_next ? 1 : 0;
+		if (rec->left)
+			rec->sub_eq_cnt += rec->left->sub_eq_cnt;
+		if (rec->right)
+			rec->sub_eq_cnt += rec->right->sub_eq_cnt;
+	}
+}
+
+/* Rotate rec above its parent */
+static void _rotate_up(node_space_map_t *node_space, node_space_rec_t *rec)
+{
+	node_space_rec_t *parent = rec->parent;
+	node_space_rec_t *grand = parent->parent;
+
+	if (parent->left == rec) {
+		parent->left = rec->right;
+		if (rec->right)
+			rec->right->parent = parent;
+		rec->right = parent;
+	} else {
+		parent->right = rec->left;
+		if (rec->left)
+			rec->left->parent = parent;
+		rec->left = parent;
+	}
+	parent->parent = rec;
+	rec->parent = grand;
+	if (!grand)
+		node_space->root = rec;
+	else if (grand->left == parent)
+		grand->left = rec;
+	else
+		grand->right = rec;
+
+	_update(parent);
+	_update(rec);
+}
+
+static void _tree_insert(node_space_map_t *node_space, node_space_rec_t *rec)
+{
+	node_space_rec_t *parent = NULL, **link = &node_space->root;
+
+	while (*link) {
+		parent = *link;
+		if (rec->begin_time < parent->begin_time)
+			link = &parent->left;
+		else
+			link = &parent->right;
+	}
+	*link = rec;
+	rec->parent = parent;
+
+	while (rec->parent && (rec->parent->priority < rec->priority))
+		_rotate_up(node_space, rec);
+	_update_path(rec);
+}
+
+static void _tree_remove(node_space_map_t *node_space, node_space_rec_t *rec)
+{
+	node_space_rec_t *child, *parent;
+
+	while (rec->left || rec->right) {
+		if (!rec->left)
+			child = rec->right;
+		else if (!rec->right)
+			child = rec->left;
+		else if (rec->left->priority > rec->right->priority)
+			child = rec->left;
+		else
+			child = rec->right;
+		_rotate_up(node_space, child);
+	}
+
+	parent = rec->parent;
+	if (!parent)
+		node_space->root = NULL;
+	else if (parent->left == rec)
+		parent->left = NULL;
+	else
+		parent->right = NULL;
+	rec->parent = NULL;
+	_update_path(parent);
+}
+
+/* Return the last record beginning at or before when, NULL if none */
+static node_space_rec_t *_find(node_space_map_t *node_space, time_t when)
+{
+	node_space_rec_t *rec = node_space->root, *found = NULL;
+
+	while (rec) {
+		if (rec->begin_time <= when) {
+			found = rec;
+			rec = rec->right;
+		} else
+			rec = rec->left;
+	}
+	return found;
+}
+
+/*
+ * Return the begin time of the first record ending after when, or -1 if no
+ * record ends after when
+ */
+static time_t _first_after(node_space_map_t *node_space, time_t when,
+			   node_space_rec_t **rec_ptr)
+{
+	node_space_rec_t *rec = _find(node_space, when);
+
+	if (!rec)
+		rec = node_space->head;
+	else if (rec->end_time <= when)
+		rec = rec->next;
+	if (rec_ptr)
+		*rec_ptr = rec;
+	if (!rec)
+		return (time_t) -1;
+	return rec->begin_time;
+}
+
+/*
+ * Split rec at split_time, which must fall after its begin_time and before
+ * its end_time.
+ * RET the new record beginning at split_time
+ */
+static node_space_rec_t *_split(node_space_map_t *node_space,
+				node_space_rec_t *rec, time_t split_time)
+{
+	node_space_rec_t *new_rec;
+
+	new_rec = _rec_create(node_space, split_time, rec->end_time,
+			      bit_copy(rec->avail_bitmap));
+	new_rec->eq_next = rec->eq_next;
+	new_rec->prev = rec;
+	new_rec->next = rec->next;
+	if (rec->next)
+		rec->next->prev = new_rec;
+	rec->next = new_rec;
+	rec->end_time = split_time;
+	rec->eq_next = true;
+
+	_tree_insert(node_space, new_rec);
+	_update_eq_path(rec);
+
+	return new_rec;
+}
+
+/* AND res_bitmap into every record beginning from first to last */
+static void _and_range(node_space_rec_t *rec, time_t first, time_t last,
+		       bitstr_t *res_bitmap)
+{
+	if (!rec || (rec->sub_last < first) || (rec->sub_first > last))
+		return;
+	_and_range(rec->left, first, last, res_bitmap);
+	if ((rec->begin_time >= first) && (rec->begin_time <= last))
+		bit_and(rec->avail_bitmap, res_bitmap);
+	_and_range(rec->right, first, last, res_bitmap);
+	if ((rec->sub_first >= first) && (rec->sub_last <= last))
+		bit_and(rec->sub_bitmap, res_bitmap);	/* Entire subtree */
+	else
+		_update(rec);
+}
+
+/* Recompute eq_next for every record beginning from first to last */
+static void _eq_range(node_space_rec_t *rec, time_t first, time_t last)
+{
+	if (!rec || (rec->sub_last < first) || (rec->sub_first > last))
+		return;
+	_eq_range(rec->left, first, last);
+	if ((rec->begin_time >= first) && (rec->begin_time <= last)) {
+		rec->eq_next = rec->next &&
+			       bit_equal(rec->avail_bitmap,
+					 rec->next->avail_bitmap);
+	}
+	_eq_range(rec->right, first, last);
+	rec->sub_eq_cnt = rec->eq_next ? 1 : 0;
+	if (rec->left)
+		rec->sub_eq_cnt += rec->left->sub_eq_cnt;
+	if (rec->right)
+		rec->sub_eq_cnt += rec->right->sub_eq_cnt;
+}
+
+/* Merge the first record identical to its successor, if any */
+static void _merge_first_eq(node_space_map_t *node_space)
+{
+	node_space_rec_t *rec = node_space->root, *next;
+
+	if (!rec || !rec->sub_eq_cnt)
+		return;
+	while (1) {
+		if (rec->left && rec->left->sub_eq_cnt)
+			rec = rec->left;
+		else if (rec->eq_next)
+			break;
+		else
+			rec = rec->right;
+	}
+
+	next = rec->next;
+	rec->end_time = next->end_time;
+	rec->eq_next = next->eq_next;
+	rec->next = next->next;
+	if (next->next)
+		next->next->prev = rec;
+	_tree_remove(node_space, next);
+	_update_eq_path(rec);
+	_rec_free(next);
+}
+
+static void _and_query(node_space_rec_t *rec, time_t first, time_t last,
+		       bitstr_t *avail_bitmap)
+{
+	if (!rec || (rec->sub_last < first) || (rec->sub_first > last))
+		return;
+	if ((rec->sub_first >= first) && (rec->sub_last <= last)) {
+		bit_and(avail_bitmap, rec->sub_bitmap);
+		return;
+	}
+	_and_query(rec->left, first, last, avail_bitmap);
+	if ((rec->begin_time >= first) && (rec->begin_time <= last))
+		bit_and(avail_bitmap, rec->avail_bitmap);
+	_and_query(rec->right, first, last, avail_bitmap);
+}
+
+/* Find the first record beginning from first to last lacking use_bitmap */
+static node_space_rec_t *_conflict(node_space_rec_t *rec, time_t first,
+				   time_t last, bitstr_t *use_bitmap)
+{
+	node_space_rec_t *found;
+
+	if (!rec || (rec->sub_last < first) || (rec->sub_first > last) ||
+	    bit_super_set(use_bitmap, rec->sub_bitmap))
+		return NULL;
+	if ((found = _conflict(rec->left, first, last, use_bitmap)))
+		return found;
+	if ((rec->begin_time >= first) && (rec->begin_time <= last) &&
+	    !bit_super_set(use_bitmap, rec->avail_bitmap))
+		return rec;
+	return _conflict(rec->right, first, last, use_bitmap);
+}
+
+extern node_space_map_t *node_space_create(time_t begin_time, time_t end_time,
+					   bitstr_t *avail_bitmap)
+{
+	node_space_map_t *node_space = xmalloc(sizeof(node_space_map_t));
+
+	node_space->seed = 2463534242U;
+	node_space->head = _rec_create(node_space, begin_time, end_time,
+				       bit_copy(avail_bitmap));
+	node_space->root = node_space->head;
+
+	return node_space;
+}
+
+extern void node_space_destroy(node_space_map_t *node_space)
+{
+	node_space_rec_t *rec, *next;
+
+	if (!node_space)
+		return;
+	for (rec = node_space->head; rec; rec = next) {
+		next = rec->next;
+		_rec_free(rec);
+	}
+	xfree(node_space);
+}
+
+extern void node_space_add_reservation(node_space_map_t *node_space,
+				       time_t start_time, time_t end_reserve,
+				       bitstr_t *res_bitmap)
+{
+	node_space_rec_t *rec;
+
+	start_time = MAX(start_time, node_space->head->begin_time);
+	rec = _find(node_space, start_time);
+	if ((end_reserve > start_time) && (rec->end_time > start_time)) {
+		if (rec->begin_time < start_time)
+			rec = _split(node_space, rec, start_time);
+		else if (!rec->prev)
+			node_space->rec_cnt++;	/* Counted as a split */
+
+		rec = _find(node_space, end_reserve);
+		if ((rec->begin_time < end_reserve) &&
+		    (rec->end_time > end_reserve))
+			_split(node_space, rec, end_reserve);
+
+		_and_range(node_space->root, start_time, end_reserve - 1,
+			   res_bitmap);
+		rec = _find(node_space, start_time);
+		if (rec->prev)
+			rec = rec->prev;
+		_eq_range(node_space->root, rec->begin_time, end_reserve - 1);
+	}
+
+	/*
+	 * Drop records with identical bitmaps (up to one record).
+	 * This can significantly improve performance of the backfill tests.
+	 */
+	_merge_first_eq(node_space);
+}
+
+extern time_t node_space_and(node_space_map_t *node_space, time_t start_time,
+			     time_t end_time, bitstr_t *avail_bitmap)
+{
+	node_space_rec_t *rec;
+	time_t first = _first_after(node_space, start_time, &rec);
+
+	if (!rec)
+		return 0;
+	_and_query(node_space->root, first, end_time, avail_bitmap);
+	if (rec->next)
+		return rec->end_time;
+	return 0;
+}
+
+extern void node_space_and_after(node_space_map_t *node_space,
+				 time_t start_time, time_t end_time,
+				 time_t after_time, bitstr_t *avail_bitmap)
+{
+	node_space_rec_t *rec;
+	time_t first = _first_after(node_space, start_time, &rec);
+
+	if (!rec)
+		return;
+	first = MAX(first, after_time + 1);
+	_and_query(node_space->root, first, end_time, avail_bitmap);
+}
+
+extern bool node_space_overlap(node_space_map_t *node_space,
+			       bitstr_t *use_bitmap, time_t start_time,
+			       time_t end_time)
+{
+	node_space_rec_t *rec;
+	time_t first = _first_after(node_space, start_time, &rec);
+
+	if (!rec)
+		return false;
+	return _conflict(node_space->root, first, end_time - 1, use_bitmap);
+}
+
+extern time_t node_space_conflict(node_space_map_t *node_space,
+				  bitstr_t *use_bitmap, time_t first_begin,
+				  time_t last_begin)
+{
+	node_space_rec_t *rec;
+
+	rec = _conflict(node_space->root, first_begin, last_begin, use_bitmap);
+	if (rec)
+		return rec->begin_time;
+	return 0;
+}
+
+extern int node_space_rec_cnt(node_space_map_t *node_space)
+{
+	return node_space->rec_cnt;
+}
+
+extern int node_space_for_each(node_space_map_t *node_space,
+			       node_space_for_f f, void *arg)
+{
+	node_space_rec_t *rec;
+	int n = 0;
+
+	for (rec = node_space->head; rec; rec = rec->next) {
+		if ((*f)(rec->begin_time, rec->end_time, rec->avail_bitmap,
+			 arg) < 0)
+			return -1;
+		n++;
+	}
+	return n;
+}
@@ -0,0 +1,120 @@
+/*****************************************************************************\
+ *  node_space.h - backfill scheduler map of future node availability
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#ifndef _SLURM_BACKFILL_NODE_SPACE_H
+#define _SLURM_BACKFILL_NODE_SPACE_H
+
+#include <stdbool.h>
+#include <time.h>
+
+#include "src/common/bitstring.h"
+
+/*
+ * The node space map records which nodes are available for pending jobs at
+ * each point in time within the backfill window. The window is divided into
+ * contiguous records, each with a bitmap of the nodes which are not reserved
+ * for higher priority jobs during that time.
+ */
+typedef struct node_space_map node_space_map_t;
+
+typedef int (*node_space_for_f) (time_t begin_time, time_t end_time,
+				 bitstr_t *avail_bitmap, void *arg);
+
+/*
+ * Create a map with a single record covering begin_time to end_time
+ * with a copy of avail_bitmap. Release with node_space_destroy().
+ */
+extern node_space_map_t *node_space_create(time_t begin_time, time_t end_time,
+					   bitstr_t *avail_bitmap);
+
+extern void node_space_destroy(node_space_map_t *node_space);
+
+/*
+ * Reserve nodes for a job between start_time and end_reserve. Nodes not set
+ * in res_bitmap are removed from every record in that time span.
+ */
+extern void node_space_add_reservation(node_space_map_t *node_space,
+				       time_t start_time, time_t end_reserve,
+				       bitstr_t *res_bitmap);
+
+/*
+ * Clear from avail_bitmap the nodes reserved in any record which ends after
+ * start_time and begins no later than end_time.
+ * RET end time of the record containing start_time or zero if that is the
+ *     last record in the map
+ */
+extern time_t node_space_and(node_space_map_t *node_space, time_t start_time,
+			     time_t end_time, bitstr_t *avail_bitmap);
+
+/*
+ * As node_space_and(), but only consider records which begin after
+ * after_time.
+ */
+extern void node_space_and_after(node_space_map_t *node_space,
+				 time_t start_time, time_t end_time,
+				 time_t after_time, bitstr_t *avail_bitmap);
+
+/*
+ * Report if any node in use_bitmap is reserved in a record overlapping
+ * start_time to end_time.
+ */
+extern bool node_space_overlap(node_space_map_t *node_space,
+			       bitstr_t *use_bitmap, time_t start_time,
+			       time_t end_time);
+
+/*
+ * Find the earliest record beginning between first_begin and last_begin
+ * (inclusive) in which any node in use_bitmap is reserved.
+ * RET the record's begin time or zero if none
+ */
+extern time_t node_space_conflict(node_space_map_t *node_space,
+				  bitstr_t *use_bitmap, time_t first_begin,
+				  time_t last_begin);
+
+/*
+ * Return the number of records created in the map, including records since
+ * merged with an identical neighbor.
+ */
+extern int node_space_rec_cnt(node_space_map_t *node_space);
+
+/*
+ * Call f for each record in time order, stopping if it returns less than
+ * zero.
+ * RET number of records visited or -1 if stopped early
+ */
+extern int node_space_for_each(node_space_map_t *node_space,
+			       node_space_for_f f, void *arg);
+
+#endif	/* _SLURM_BACKFILL_NODE_SPACE_H */
@@ -149,7 +149,7 @@ static void _load_config(void)
 static void _compute_start_times(void)
 {
 	int j, rc = SLURM_SUCCESS, job_cnt = 0;
-	List job_queue;
+	job_queue_iter_t *job_queue_iter;
 	job_queue_rec_t *job_queue_rec;
 	List preemptee_candidates = NULL;
 	struct job_record *job_ptr;
@@ -163,12 +163,10 @@ static void _compute_start_times(void)
 	sched_start = now;
 	last_job_alloc = now - 1;
 	alloc_bitmap = bit_alloc(node_record_count);
-	job_queue = build_job_queue(true, false);
-	sort_job_queue(job_queue);
-	while ((job_queue_rec = (job_queue_rec_t *) list_pop(job_queue))) {
+	job_queue_iter = job_queue_iter_create(true, false);
+	while ((job_queue_rec = job_queue_iter_next(job_queue_iter))) {
 		job_ptr  = job_queue_rec->job_ptr;
 		part_ptr = job_queue_rec->part_ptr;
-		xfree(job_queue_rec);
 		if (part_ptr != job_ptr->part_ptr)
 			continue;	/* Only test one partition */
 
@@ -242,7 +240,7 @@ static void _compute_start_times(void)
 			break;
 		}
 	}
-	FREE_NULL_LIST(job_queue);
+	job_queue_iter_destroy(job_queue_iter);
 	FREE_NULL_BITMAP(alloc_bitmap);
 }
 
@@ -34,7 +34,9 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
 \*****************************************************************************/
 
+#include <pthread.h>
 #include <string.h>
+
 #include "select_cons_tres.h"
 #include "dist_tasks.h"
 #include "job_test.h"
@@ -57,6 +59,24 @@ struct sort_support {
 	struct job_resources *tmpjobs;
 };
 
+/*
+ * Running and suspended jobs ordered by end time, shared by will_run_test()
+ * calls without preemption so that the job list is not walked and sorted for
+ * every pending job tested. Entries are revalidated against the job table
+ * since an end time can change without the resource state changing.
+ */
+typedef struct {
+	struct job_record *job_ptr;
+	uint32_t job_id;
+	time_t end_time;
+} ending_job_t;
+
+static pthread_mutex_t ending_job_mutex = PTHREAD_MUTEX_INITIALIZER;
+static ending_job_t *ending_job_array = NULL;
+static int ending_job_cnt = 0, ending_job_size = 0;
+static uint32_t ending_job_gen = 0;
+static bool ending_job_valid = false;
+
 /* Local functions */
 static void _block_whole_nodes(bitstr_t *node_bitmap,
 			       bitstr_t **orig_core_bitmap,
@@ -73,7 +93,10 @@ static struct node_use_record *_dup_node_usage(
 					struct node_use_record *orig_ptr);
 static struct part_res_record *_dup_part_data(struct part_res_record *orig_ptr);
 static struct part_row_data *_dup_row_data(struct part_row_data *orig_row,
-					   uint16_t num_rows);
+					   uint16_t num_rows, bool share);
+static List _ending_job_list(void);
+static int _ending_job_sort(const void *x, const void *y);
+static bool _ending_job_test(struct job_record *job_ptr, bool *cleaning);
 static bool _enough_nodes(int avail_nodes, int rem_nodes,
 			  uint32_t min_nodes, uint32_t req_nodes);
 static int _eval_nodes(struct job_record *job_ptr, bitstr_t *node_map,
@@ -101,6 +124,7 @@ static int _job_test(struct job_record *job_ptr, bitstr_t *node_bitmap,
 		     bool qos_preemptor, bool preempt_mode);
 static inline void _log_select_maps(char *loc, bitstr_t *node_map,
 				    bitstr_t **core_map);
+static List _node_gres_list(struct node_use_record *node_usage, int node_inx);
 static int _rm_job_from_res(struct part_res_record *part_record_ptr,
 			    struct node_use_record *node_usage,
 			    struct job_record *job_ptr, int action);
@@ -114,6 +138,7 @@ static avail_res_t **_select_nodes(struct job_record *job_ptr,
 				uint16_t cr_type, bool test_only,
 				bitstr_t **part_core_map,
 				bool prefer_alloc_nodes);
+static void _row_unshare(struct part_row_data *r_ptr, bitstr_t *node_bitmap);
 static int _sort_usable_nodes_dec(void *j1, void *j2);
 static int _verify_node_state(struct part_res_record *cr_part_ptr,
 			      struct job_record *job_ptr,
@@ -246,8 +271,10 @@ extern void add_job_to_row(struct job_resources *job,
 	/* add the job to the row_bitmap */
 	if (r_ptr->row_bitmap && (r_ptr->num_jobs == 0)) {
 		/* if no jobs, clear the existing row_bitmap first */
+		_row_unshare(r_ptr, NULL);
 		clear_core_array(r_ptr->row_bitmap);
-	}
+	} else
+		_row_unshare(r_ptr, job->node_bitmap);
 	add_job_res(job, &r_ptr->row_bitmap);
 
 	/*  add the job to the job_list */
@@ -439,6 +466,7 @@ extern int rm_job_res(struct part_res_record *part_record_ptr,
 	}
 	debug3("cons_tres: %s: job %u action %d", __func__, job_ptr->job_id,
 	       action);
+	select_state_gen++;
 
 	i_first = bit_ffs(job->node_bitmap);
 	if (i_first != -1)
@@ -454,10 +482,7 @@ extern int rm_job_res(struct part_res_record *part_record_ptr,
 
 		node_ptr = node_record_table_ptr + i;
 		if (action != 2) {
-			if (node_usage[i].gres_list)
-				gres_list = node_usage[i].gres_list;
-			else
-				gres_list = node_ptr->gres_list;
+			gres_list = _node_gres_list(node_usage, i);
 			gres_plugin_job_dealloc(job_ptr->gres_list, gres_list,
 						n, job_ptr->job_id,
 						node_ptr->name);
@@ -596,13 +621,17 @@ static void _build_row_bitmaps(struct part_res_record *p_ptr,
 	if (p_ptr->num_rows == 1) {
 		this_row = p_ptr->row;
 		if (this_row->num_jobs == 0) {
+			_row_unshare(this_row, NULL);
 			clear_core_array(this_row->row_bitmap);
 		} else {
 			if (job_ptr) { /* just remove the job */
 				xassert(job_ptr->job_resrcs);
+				_row_unshare(this_row,
+					     job_ptr->job_resrcs->node_bitmap);
 				_rm_job_res(job_ptr->job_resrcs,
 					    &this_row->row_bitmap);
 			} else { /* totally rebuild the bitmap */
+				_row_unshare(this_row, NULL);
 				clear_core_array(this_row->row_bitmap);
 				for (j = 0; j < this_row->num_jobs; j++) {
 					add_job_res(this_row->job_list[j],
@@ -617,6 +646,7 @@ static void _build_row_bitmaps(struct part_res_record *p_ptr,
 	num_jobs = 0;
 	for (i = 0; i < p_ptr->num_rows; i++) {
 		num_jobs += p_ptr->row[i].num_jobs;
+		_row_unshare(&p_ptr->row[i], NULL);
 	}
 	if (num_jobs == 0) {
 		clear_core_array(p_ptr->row[i].row_bitmap);
@@ -630,7 +660,7 @@ static void _build_row_bitmaps(struct part_res_record *p_ptr,
 	debug3("cons_tres: %s reshuffling %u jobs", __func__, num_jobs);
 
 	/* make a copy, in case we cannot do better than this */
-	orig_row = _dup_row_data(p_ptr->row, p_ptr->num_rows);
+	orig_row = _dup_row_data(p_ptr->row, p_ptr->num_rows, false);
 	if (orig_row == NULL)
 		return;
 
@@ -824,11 +854,13 @@ extern int vpus_per_core(struct job_details *details, int node_inx)
 	return vpus_per_core;
 }
 
-/* Create a duplicate part_res_record list */
+/*
+ * Create a copy of the node usage records which shares the GRES state with
+ * the original, see _node_gres_list()
+ */
 static struct node_use_record *_dup_node_usage(struct node_use_record *orig_ptr)
 {
 	struct node_use_record *new_use_ptr, *new_ptr;
-	List gres_list;
 	uint32_t i;
 
 	if (orig_ptr == NULL)
@@ -840,16 +872,38 @@ static struct node_use_record *_dup_node_usage(struct node_use_record *orig_ptr)
 	for (i = 0; i < select_node_cnt; i++) {
 		new_ptr[i].node_state   = orig_ptr[i].node_state;
 		new_ptr[i].alloc_memory = orig_ptr[i].alloc_memory;
-		if (orig_ptr[i].gres_list)
-			gres_list = orig_ptr[i].gres_list;
-		else
-			gres_list = node_record_table_ptr[i].gres_list;
-		new_ptr[i].gres_list = gres_plugin_node_state_dup(gres_list);
+		new_ptr[i].gres_list    = orig_ptr[i].gres_list;
+		new_ptr[i].gres_shared  = true;
 	}
 	return new_use_ptr;
 }
 
-/* Create a duplicate part_res_record list */
+/*
+ * Return the GRES state of a node for modification, copying it first if it
+ * is still shared with the live state
+ */
+static List _node_gres_list(struct node_use_record *node_usage, int node_inx)
+{
+	struct node_use_record *use_ptr = node_usage + node_inx;
+	List gres_list;
+
+	if (use_ptr->gres_list)
+		gres_list = use_ptr->gres_list;
+	else
+		gres_list = node_record_table_ptr[node_inx].gres_list;
+	if (use_ptr->gres_shared) {
+		use_ptr->gres_list = gres_plugin_node_state_dup(gres_list);
+		use_ptr->gres_shared = false;
+		if (use_ptr->gres_list)
+			gres_list = use_ptr->gres_list;
+	}
+	return gres_list;
+}
+
+/*
+ * Create a copy of the partition records whose rows share core bitmaps with
+ * the original, see _row_unshare()
+ */
 static struct part_res_record *_dup_part_data(struct part_res_record *orig_ptr)
 {
 	struct part_res_record *new_part_ptr, *new_ptr;
@@ -864,7 +918,7 @@ static struct part_res_record *_dup_part_data(struct part_res_record *orig_ptr)
 		new_ptr->part_ptr = orig_ptr->part_ptr;
 		new_ptr->num_rows = orig_ptr->num_rows;
 		new_ptr->row = _dup_row_data(orig_ptr->row,
-					     orig_ptr->num_rows);
+					     orig_ptr->num_rows, true);
 		if (orig_ptr->next) {
 			new_ptr->next = xmalloc(sizeof(struct part_res_record));
 			new_ptr = new_ptr->next;
@@ -874,9 +928,13 @@ static struct part_res_record *_dup_part_data(struct part_res_record *orig_ptr)
 	return new_part_ptr;
 }
 
-/* Helper function for _dup_part_data: create a duplicate part_row_data array */
+/*
+ * Helper function for _dup_part_data: create a duplicate part_row_data array
+ * IN share - if set, reference the original core bitmaps rather than copying
+ *	them. The original must not change while the copy exists.
+ */
 static struct part_row_data *_dup_row_data(struct part_row_data *orig_row,
-					   uint16_t num_rows)
+					   uint16_t num_rows, bool share)
 {
 	struct part_row_data *new_row;
 	int i, n;
@@ -891,11 +949,22 @@ static struct part_row_data *_dup_row_data(struct part_row_data *orig_row,
 		if (orig_row[i].row_bitmap) {
 			new_row[i].row_bitmap = xmalloc(sizeof(bitstr_t *) *
 							select_node_cnt);
+			if (share) {
+				new_row[i].row_shared = xmalloc(sizeof(bool) *
+							select_node_cnt);
+			}
 			for (n = 0; n < select_node_cnt; n++) {
 				if (!orig_row[i].row_bitmap[n])
 					continue;
-				new_row[i].row_bitmap[n] =
-					bit_copy(orig_row[i].row_bitmap[n]);
+				if (share) {
+					new_row[i].row_bitmap[n] =
+						orig_row[i].row_bitmap[n];
+					new_row[i].row_shared[n] = true;
+				} else {
+					new_row[i].row_bitmap[n] =
+						bit_copy(orig_row[i].
+							 row_bitmap[n]);
+				}
 			}
 		}
 		if (new_row[i].job_list_size == 0)
@@ -909,6 +978,39 @@ static struct part_row_data *_dup_row_data(struct part_row_data *orig_row,
 	return new_row;
 }
 
+/*
+ * Copy the core bitmaps of a row which are shared with the live state
+ * before they are modified
+ * IN/OUT r_ptr - row to be modified
+ * IN node_bitmap - nodes whose bitmaps will change, NULL for all nodes
+ */
+static void _row_unshare(struct part_row_data *r_ptr, bitstr_t *node_bitmap)
+{
+	int n, n_first, n_last;
+
+	if (!r_ptr->row_shared)
+		return;
+	if (node_bitmap) {
+		n_first = bit_ffs(node_bitmap);
+		if (n_first == -1)
+			return;
+		n_last = bit_fls(node_bitmap);
+	} else {
+		n_first = 0;
+		n_last = select_node_cnt - 1;
+	}
+	for (n = n_first; n <= n_last; n++) {
+		if (!r_ptr->row_shared[n])
+			continue;
+		if (node_bitmap && !bit_test(node_bitmap, n))
+			continue;
+		r_ptr->row_bitmap[n] = bit_copy(r_ptr->row_bitmap[n]);
+		r_ptr->row_shared[n] = false;
+	}
+	if (!node_bitmap)
+		xfree(r_ptr->row_shared);
+}
+
 /*
  * Test if job can fit into the given set of core_bitmaps
  * IN job_resrcs_ptr - resources allocated to a job
@@ -1916,10 +2018,7 @@ static int _rm_job_from_res(struct part_res_record *part_record_ptr,
 
 		node_ptr = node_record_table_ptr + i;
 		if (action != 2) {
-			if (node_usage[i].gres_list)
-				gres_list = node_usage[i].gres_list;
-			else
-				gres_list = node_ptr->gres_list;
+			gres_list = _node_gres_list(node_usage, i);
 			gres_plugin_job_dealloc(job_ptr->gres_list, gres_list,
 						n, job_ptr->job_id,
 						node_ptr->name);
@@ -3443,32 +3542,30 @@ static avail_res_t *_can_job_run_on_node(struct job_record *job_ptr,
 	return avail_res;
 }
 
+/*
+ * NOTE: Jobs of different partitions can be tested at the same time (see
+ * sched_shard and bf_parallel), so nothing is cached between calls.
+ */
 static void _set_gpu_defaults(struct job_record *job_ptr)
 {
-	static struct part_record *last_part_ptr = NULL;
-	static uint64_t last_cpu_per_gpu = NO_VAL64;
-	static uint64_t last_mem_per_gpu = NO_VAL64;
 	uint64_t cpu_per_gpu, mem_per_gpu;
+	uint64_t part_cpu_per_gpu, part_mem_per_gpu;
 
 	if (!job_ptr->gres_list)
 		return;
 
-	if (job_ptr->part_ptr != last_part_ptr) {
-		/* Cache data from last partition referenced */
-		last_part_ptr = job_ptr->part_ptr;
-		last_cpu_per_gpu = get_def_cpu_per_gpu(
-					job_ptr->part_ptr->job_defaults_list);
-		last_mem_per_gpu = get_def_mem_per_gpu(
-					job_ptr->part_ptr->job_defaults_list);
-	}
-	if (last_cpu_per_gpu != NO_VAL64)
-		cpu_per_gpu = last_cpu_per_gpu;
+	part_cpu_per_gpu = get_def_cpu_per_gpu(
+				job_ptr->part_ptr->job_defaults_list);
+	part_mem_per_gpu = get_def_mem_per_gpu(
+				job_ptr->part_ptr->job_defaults_list);
+	if (part_cpu_per_gpu != NO_VAL64)
+		cpu_per_gpu = part_cpu_per_gpu;
 	else if (def_cpu_per_gpu != NO_VAL64)
 		cpu_per_gpu = def_cpu_per_gpu;
 	else
 		cpu_per_gpu = 0;
-	if (last_mem_per_gpu != NO_VAL64)
-		mem_per_gpu = last_mem_per_gpu;
+	if (part_mem_per_gpu != NO_VAL64)
+		mem_per_gpu = part_mem_per_gpu;
 	else if (def_mem_per_gpu != NO_VAL64)
 		mem_per_gpu = def_mem_per_gpu;
 	else
@@ -4035,6 +4132,114 @@ extern int test_only(struct job_record *job_ptr, bitstr_t *node_bitmap,
 	return rc;
 }
 
+static int _ending_job_sort(const void *x, const void *y)
+{
+	const ending_job_t *job1 = x, *job2 = y;
+
+	return (int) SLURM_DIFFTIME(job1->end_time, job2->end_time);
+}
+
+/*
+ * Return true if the job's resources are to be released at its end time
+ * OUT cleaning - set if the job has ended, but its resources are still in use
+ */
+static bool _ending_job_test(struct job_record *job_ptr, bool *cleaning)
+{
+	*cleaning = job_cleaning(job_ptr);
+	if (!*cleaning && IS_JOB_COMPLETING(job_ptr))
+		*cleaning = true;
+	if (!IS_JOB_RUNNING(job_ptr) && !IS_JOB_SUSPENDED(job_ptr) &&
+	    !*cleaning)
+		return false;
+	if (job_ptr->end_time == 0) {
+		if (!*cleaning) {
+			error("%s: Active job %u has zero end_time",
+			      __func__, job_ptr->job_id);
+		}
+		return false;
+	}
+	if (job_ptr->node_bitmap == NULL) {
+		/*
+		 * This should indicate a requeued job was cancelled
+		 * while NHC was running
+		 */
+		if (!*cleaning) {
+			error("%s: Job %u has NULL node_bitmap",
+			      __func__, job_ptr->job_id);
+		}
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Build a list of the jobs whose resources are released at their end time,
+ * sorted by end time. Free the list with FREE_NULL_LIST().
+ */
+static List _ending_job_list(void)
+{
+	struct job_record *job_ptr;
+	ListIterator job_iterator;
+	List cr_job_list = list_create(NULL);
+	bool cleaning;
+	int i;
+
+	slurm_mutex_lock(&ending_job_mutex);
+	if (ending_job_valid && (ending_job_gen != select_state_gen))
+		ending_job_valid = false;
+	for (i = 0; ending_job_valid && (i < ending_job_cnt); i++) {
+		job_ptr = find_job_record(ending_job_array[i].job_id);
+		if ((job_ptr != ending_job_array[i].job_ptr) ||
+		    (job_ptr->end_time != ending_job_array[i].end_time))
+			ending_job_valid = false;
+	}
+
+	if (!ending_job_valid) {
+		ending_job_cnt = 0;
+		job_iterator = list_iterator_create(job_list);
+		while ((job_ptr = list_next(job_iterator))) {
+			if (!_ending_job_test(job_ptr, &cleaning))
+				continue;
+			if (ending_job_cnt >= ending_job_size) {
+				ending_job_size += 1024;
+				xrealloc(ending_job_array, ending_job_size *
+					 sizeof(ending_job_t));
+			}
+			ending_job_array[ending_job_cnt].job_ptr = job_ptr;
+			ending_job_array[ending_job_cnt].job_id =
+				job_ptr->job_id;
+			ending_job_array[ending_job_cnt].end_time =
+				job_ptr->end_time;
+			ending_job_cnt++;
+		}
+		list_iterator_destroy(job_iterator);
+		qsort(ending_job_array, ending_job_cnt, sizeof(ending_job_t),
+		      _ending_job_sort);
+		ending_job_gen = select_state_gen;
+		ending_job_valid = true;
+	}
+
+	for (i = 0; i < ending_job_cnt; i++) {
+		/* State may have changed without touching resources */
+		if (_ending_job_test(ending_job_array[i].job_ptr, &cleaning))
+			list_append(cr_job_list, ending_job_array[i].job_ptr);
+	}
+	slurm_mutex_unlock(&ending_job_mutex);
+
+	return cr_job_list;
+}
+
+/* Release memory used to cache will_run_test() state */
+extern void will_run_test_fini(void)
+{
+	slurm_mutex_lock(&ending_job_mutex);
+	xfree(ending_job_array);
+	ending_job_cnt = 0;
+	ending_job_size = 0;
+	ending_job_valid = false;
+	slurm_mutex_unlock(&ending_job_mutex);
+}
+
 /* List sort function: sort by the job's expected end time */
 static int _cr_job_list_sort(void *x, void *y)
 {
@@ -4136,40 +4341,26 @@ extern int will_run_test(struct job_record *job_ptr, bitstr_t *node_bitmap,
 	}
 
 	/* Build list of running and suspended jobs */
-	cr_job_list = list_create(NULL);
-	job_iterator = list_iterator_create(job_list);
-	while ((tmp_job_ptr = (struct job_record *) list_next(job_iterator))) {
-		bool cleaning = job_cleaning(tmp_job_ptr);
-		if (!cleaning && IS_JOB_COMPLETING(tmp_job_ptr))
-			cleaning = true;
-		if (!IS_JOB_RUNNING(tmp_job_ptr) &&
-		    !IS_JOB_SUSPENDED(tmp_job_ptr) &&
-		    !cleaning)
-			continue;
-		if (tmp_job_ptr->end_time == 0) {
-			if (!cleaning) {
-				error("%s: Active job %u has zero end_time",
-				      __func__, tmp_job_ptr->job_id);
-			}
-			continue;
-		}
-		if (tmp_job_ptr->node_bitmap == NULL) {
-			/*
-			 * This should indicate a requeued job was cancelled
-			 * while NHC was running
-			 */
-			if (!cleaning) {
-				error("%s: Job %u has NULL node_bitmap",
-				      __func__, tmp_job_ptr->job_id);
+	if (!preemptee_candidates) {
+		/* Nothing to preempt, reuse the list sorted by end time */
+		cr_job_list = _ending_job_list();
+	} else {
+		cr_job_list = list_create(NULL);
+		job_iterator = list_iterator_create(job_list);
+		while ((tmp_job_ptr = list_next(job_iterator))) {
+			bool cleaning;
+			uint16_t mode;
+
+			if (!_ending_job_test(tmp_job_ptr, &cleaning))
+				continue;
+			if (cleaning ||
+			    !is_preemptable(tmp_job_ptr, preemptee_candidates)) {
+				/* Queue job for later removal from data
+				 * structures */
+				list_append(cr_job_list, tmp_job_ptr);
+				continue;
 			}
-			continue;
-		}
-		if (cleaning ||
-		    !is_preemptable(tmp_job_ptr, preemptee_candidates)) {
-			/* Queue job for later removal from data structures */
-			list_append(cr_job_list, tmp_job_ptr);
-		} else {
-			uint16_t mode = slurm_job_preempt_mode(tmp_job_ptr);
+			mode = slurm_job_preempt_mode(tmp_job_ptr);
 			if (mode == PREEMPT_MODE_OFF)
 				continue;
 			if (mode == PREEMPT_MODE_SUSPEND) {
@@ -4182,8 +4373,9 @@ extern int will_run_test(struct job_record *job_ptr, bitstr_t *node_bitmap,
 			_rm_job_from_res(future_part, future_usage,
 					 tmp_job_ptr, action);
 		}
+		list_iterator_destroy(job_iterator);
+		list_sort(cr_job_list, _cr_job_list_sort);
 	}
-	list_iterator_destroy(job_iterator);
 
 	/* Test with all preemptable jobs gone */
 	if (preemptee_candidates) {
@@ -4212,7 +4404,6 @@ extern int will_run_test(struct job_record *job_ptr, bitstr_t *node_bitmap,
 		int time_window = 30;
 		bool more_jobs = true;
 		DEF_TIMERS;
-		list_sort(cr_job_list, _cr_job_list_sort);
 		START_TIMER;
 		job_iterator = list_iterator_create(cr_job_list);
 		while (more_jobs) {
@@ -190,4 +190,7 @@ extern int will_run_test(struct job_record *job_ptr, bitstr_t *node_bitmap,
 			 List preemptee_candidates, List *preemptee_job_list,
 			 bitstr_t **exc_cores);
 
+/* Release memory used to cache will_run_test() state */
+extern void will_run_test_fini(void);
+
 #endif /* !_CONS_TRES_JOB_TEST_H */
@@ -149,6 +149,7 @@ struct node_res_record *select_node_record	= NULL;
 struct node_use_record *select_node_usage	= NULL;
 struct part_res_record *select_part_record	= NULL;
 bool       select_state_initializing = true;
+uint32_t   select_state_gen	= 0;
 bool       spec_cores_first	= false;
 bitstr_t **spec_core_res	= NULL;
 bool       topo_optional	= false;
@@ -203,6 +204,7 @@ static int _add_job_to_res(struct job_record *job_ptr, int action)
 
 	debug3("cons_tres: %s: job:%u action:%d ", __func__, job_ptr->job_id,
 	       action);
+	select_state_gen++;
 
 	if (select_debug_flags & DEBUG_FLAG_SELECT_TYPE)
 		log_job_resources(job_ptr->job_id, job);
@@ -453,6 +455,7 @@ static void _create_part_data(void)
 
 	cr_destroy_part_data(select_part_record);
 	select_part_record = NULL;
+	select_state_gen++;
 
 	num_parts = list_count(part_list);
 	if (!num_parts)
@@ -951,6 +954,7 @@ extern int fini(void)
 	select_part_record = NULL;
 	free_core_array(&spec_core_res);
 	cr_fini_global_core_data();
+	will_run_test_fini();
 
 	return SLURM_SUCCESS;
 }
@@ -1073,6 +1077,7 @@ extern int select_p_node_init(struct node_record *node_ptr, int node_cnt)
 				     sizeof(struct node_res_record));
 	select_node_usage  = xmalloc(node_cnt *
 				     sizeof(struct node_use_record));
+	select_state_gen++;
 
 	for (i = 0; i < select_node_cnt; i++) {
 		select_node_record[i].node_ptr = &node_ptr[i];
@@ -2332,7 +2337,8 @@ extern void cr_destroy_node_data(struct node_use_record *node_usage,
 	xfree(node_data);
 	if (node_usage) {
 		for (i = 0; i < select_node_cnt; i++) {
-			FREE_NULL_LIST(node_usage[i].gres_list);
+			if (!node_usage[i].gres_shared)
+				FREE_NULL_LIST(node_usage[i].gres_list);
 		}
 		xfree(node_usage);
 	}
@@ -2363,10 +2369,14 @@ extern void cr_destroy_row_data(struct part_row_data *row, uint16_t num_rows)
 
 	for (r = 0; r < num_rows; r++) {
 		if (row[r].row_bitmap) {
-			for (n = 0; n < select_node_cnt; n++)
+			for (n = 0; n < select_node_cnt; n++) {
+				if (row[r].row_shared && row[r].row_shared[n])
+					continue;
 				FREE_NULL_BITMAP(row[r].row_bitmap[n]);
+			}
 			xfree(row[r].row_bitmap);
 		}
+		xfree(row[r].row_shared);
 		xfree(row[r].job_list);
 	}
 	xfree(row);
@@ -90,6 +90,9 @@ struct node_use_record {
 					 * defined in in src/common/gres.h.
 					 * Local data used only in state copy
 					 * to emulate future node state */
+	bool gres_shared;		/* gres_list (or the node's list if
+					 * NULL) belongs to the live state,
+					 * copy before changing it */
 	uint16_t node_state;		/* see node_cr_state comments */
 };
 
@@ -100,6 +103,9 @@ struct part_row_data {
 	struct job_resources **job_list;/* List of jobs in this row */
 	uint32_t job_list_size;		/* Size of job_list array */
 	uint32_t num_jobs;		/* Number of occupied entries in job_list array */
+	bool *row_shared;		/* set for row_bitmap elements which
+					 * belong to the live state, copy
+					 * before changing them. NULL if none */
 };
 
 /* partition core allocation bitmap arrays (1 bitmap per node) */
@@ -131,6 +137,7 @@ extern struct node_res_record *select_node_record;
 extern struct node_use_record *select_node_usage;
 extern struct part_res_record *select_part_record;
 extern bool	select_state_initializing;
+extern uint32_t	select_state_gen;
 extern bool	spec_cores_first;
 extern bitstr_t **spec_core_res;
 extern bool	topo_optional;
@@ -44,11 +44,13 @@
 #include "src/common/proc_args.h"
 
 #define OPT_LONG_USAGE 0x101
+#define OPT_LONG_JSON  0x102
 
 static void  _help( void );
 static void  _usage( void );
 
 extern int  sdiag_param;
+extern bool json_output;
 extern bool sort_by_id;
 extern bool sort_by_time;
 extern bool sort_by_time2;
@@ -63,6 +65,7 @@ extern void parse_command_line(int argc, char **argv)
 	static struct option long_options[] = {
 		{"all",		no_argument,	0,	'a'},
 		{"help",	no_argument,	0,	'h'},
+		{"json",	no_argument,	0,	OPT_LONG_JSON},
 		{"reset",	no_argument,	0,	'r'},
 		{"sort-by-id",	no_argument,	0,	'i'},
 		{"sort-by-time",no_argument,	0,	't'},
@@ -98,6 +101,9 @@ extern void parse_command_line(int argc, char **argv)
 				print_slurm_version();
 				exit(0);
 				break;
+			case (int)OPT_LONG_JSON:
+				json_output = true;
+				break;
 			case (int)OPT_LONG_USAGE:
 				_usage();
 				exit(0);
@@ -118,6 +124,7 @@ static void _help( void )
 Usage: sdiag [OPTIONS]\n\
   -a              all statistics\n\
   -r              reset statistics\n\
+  --json          print statistics as a JSON object\n\
 \nHelp options:\n\
   --help          show this help message\n\
   --sort-by-id    sort RPCs by id\n\
@@ -41,6 +41,7 @@
 
 #include <slurm.h>
 #include "src/common/macros.h"
+#include "src/common/parse_time.h"
 #include "src/common/read_config.h"
 #include "src/common/slurm_protocol_defs.h"
 #include "src/common/slurm_time.h"
@@ -52,6 +53,7 @@
  * Global Variables *
  ********************/
 int sdiag_param = STAT_COMMAND_GET;
+bool json_output   = false;
 bool sort_by_id    = false;
 bool sort_by_time  = false;
 bool sort_by_time2 = false;
@@ -59,8 +61,13 @@ bool sort_by_time2 = false;
 stats_info_response_msg_t *buf;
 uint32_t *rpc_type_ave_time = NULL, *rpc_user_ave_time = NULL;
 
+static void _print_history(void);
+static int  _print_json(void);
+static void _print_lock_stats(void);
 static int  _print_stats(void);
 static void _sort_rpc(void);
+static void _swap_rpc_type(int i, int j);
+static void _swap_rpc_user(int i, int j);
 
 stats_info_request_msg_t req;
 
@@ -86,7 +93,10 @@ int main(int argc, char **argv)
 					  (stats_info_request_msg_t *)&req);
 		if (rc == SLURM_SUCCESS) {
 			_sort_rpc();
-			rc = _print_stats();
+			if (json_output)
+				rc = _print_json();
+			else
+				rc = _print_stats();
 #ifdef MEMORY_LEAK_DEBUG
 			uid_cache_clear();
 			slurm_free_stats_response_msg(buf);
@@ -120,6 +130,18 @@ static int _print_stats(void)
 	printf("Agent queue size:     %d\n", buf->agent_queue_size);
 	printf("DBD Agent queue size: %d\n\n", buf->dbd_agent_queue_size);
 
+	if (buf->rpc_workers) {
+		printf("RPC worker threads:   %u\n", buf->rpc_workers);
+		printf("RPC queue length:     %u\n", buf->rpc_queue_len);
+		printf("RPC queue length max: %u\n", buf->rpc_queue_len_max);
+		printf("RPC queue wait max:   %u\n", buf->rpc_queue_wait_max);
+		if (buf->rpc_queue_cnt > 0) {
+			printf("RPC queue wait mean:  %"PRIu64"\n",
+			       buf->rpc_queue_wait_sum / buf->rpc_queue_cnt);
+		}
+		printf("\n");
+	}
+
 	printf("Jobs submitted: %d\n", buf->jobs_submitted);
 	printf("Jobs started:   %d\n", buf->jobs_started);
 	printf("Jobs completed: %d\n", buf->jobs_completed);
@@ -182,6 +204,24 @@ static int _print_stats(void)
 		printf("\tQueue length mean: %u\n",
 		       buf->bf_queue_len_sum / buf->bf_cycle_counter);
 	}
+	if (buf->bf_parallel > 1) {
+		printf("\tParallel candidates: %u\n", buf->bf_parallel);
+		printf("\tLast cycle parallel tests: %u\n",
+		       buf->bf_last_spec_cnt);
+		printf("\tLast cycle parallel results used: %u\n",
+		       buf->bf_last_spec_used);
+		if (buf->bf_last_spec_wall) {
+			printf("\tLast cycle parallel speedup: %.2f\n",
+			       (double) buf->bf_last_spec_time /
+			       buf->bf_last_spec_wall);
+		}
+	}
+	if (buf->bf_plan_time) {
+		printf("\tPlan jobs kept from earlier cycles: %u\n",
+		       buf->bf_plan_jobs);
+		printf("\tPlan age: %ld sec\n",
+		       (long) difftime(buf->req_time, buf->bf_plan_time));
+	}
 
 	printf("\nLatency for gettimeofday() (x1000): %d nanoseconds\n",
 	       buf->gettimeofday_latency);
@@ -189,19 +229,52 @@ static int _print_stats(void)
 	printf("\nRemote Procedure Call statistics by message type\n");
 	for (i = 0; i < buf->rpc_type_size; i++) {
 		printf("\t%-40s(%5u) count:%-6u "
-		       "ave_time:%-6u total_time:%"PRIu64"\n",
+		       "ave_time:%-6u total_time:%"PRIu64,
 		       rpc_num2string(buf->rpc_type_id[i]),
 		       buf->rpc_type_id[i], buf->rpc_type_cnt[i],
 		       rpc_type_ave_time[i], buf->rpc_type_time[i]);
+		if (buf->rpc_type_p50) {
+			printf(" p50:%u p90:%u p99:%u max:%u",
+			       buf->rpc_type_p50[i], buf->rpc_type_p90[i],
+			       buf->rpc_type_p99[i], buf->rpc_type_max[i]);
+		}
+		printf("\n");
 	}
 
 	printf("\nRemote Procedure Call statistics by user\n");
 	for (i = 0; i < buf->rpc_user_size; i++) {
 		printf("\t%-16s(%8u) count:%-6u "
-		       "ave_time:%-6u total_time:%"PRIu64"\n",
+		       "ave_time:%-6u total_time:%"PRIu64,
 		       uid_to_string_cached((uid_t)buf->rpc_user_id[i]),
 		       buf->rpc_user_id[i], buf->rpc_user_cnt[i],
 		       rpc_user_ave_time[i], buf->rpc_user_time[i]);
+		if (buf->rpc_user_p50) {
+			printf(" p50:%u p90:%u p99:%u max:%u",
+			       buf->rpc_user_p50[i], buf->rpc_user_p90[i],
+			       buf->rpc_user_p99[i], buf->rpc_user_max[i]);
+		}
+		printf("\n");
+	}
+
+	if (buf->rpc_class_size) {
+		static const char *class_name[] = { "High", "Normal", "Low" };
+		printf("\nRemote Procedure Call statistics by priority class\n");
+		for (i = 0; i < buf->rpc_class_size; i++) {
+			uint32_t ave_time = 0, ave_wait = 0;
+			if (buf->rpc_class_cnt[i]) {
+				ave_time = buf->rpc_class_time[i] /
+					   buf->rpc_class_cnt[i];
+				ave_wait = buf->rpc_class_wait[i] /
+					   buf->rpc_class_cnt[i];
+			}
+			printf("\t%-8s max:%-4u active:%-4u queued:%-4u "
+			       "count:%-6u shed:%-6u ave_time:%-6u "
+			       "ave_wait:%u\n",
+			       (i < 3) ? class_name[i] : "Unknown",
+			       buf->rpc_class_max[i], buf->rpc_class_active[i],
+			       buf->rpc_class_queued[i], buf->rpc_class_cnt[i],
+			       buf->rpc_class_shed[i], ave_time, ave_wait);
+		}
 	}
 
 	printf("\nPending RPC statistics\n");
@@ -225,15 +298,341 @@ static int _print_stats(void)
 		       buf->rpc_dump_hostlist[i]);
 	}
 
+	_print_lock_stats();
+	_print_history();
+
+	return 0;
+}
+
+/* Print the most recent per minute samples kept by slurmctld */
+static void _print_history(void)
+{
+	char time_str[32];
+	uint32_t i, first = 0;
+
+	if (!buf->history_size)
+		return;
+	if (buf->history_size > 15)
+		first = buf->history_size - 15;
+
+	printf("\nStatistics history (per minute, microseconds)\n");
+	printf("\t%-19s %7s %9s %7s %9s %6s %6s %7s %8s %8s\n",
+	       "Time", "Sched", "SchedMean", "BfCycle", "BfMean", "Agent",
+	       "DBD", "Threads", "Pending", "Running");
+	for (i = first; i < buf->history_size; i++) {
+		slurm_make_time_str(&buf->history_time[i], time_str,
+				    sizeof(time_str));
+		printf("\t%-19s %7u %9u %7u %9u %6u %6u %7u %8u %8u\n",
+		       time_str, buf->history_sched_cycles[i],
+		       buf->history_sched_mean[i], buf->history_bf_cycles[i],
+		       buf->history_bf_mean[i], buf->history_agent_queue[i],
+		       buf->history_dbd_queue[i],
+		       buf->history_server_threads[i],
+		       buf->history_jobs_pending[i],
+		       buf->history_jobs_running[i]);
+	}
+}
+
+/* Print a JSON array of uint32_t values */
+static void _print_json_array(const char *name, uint32_t *values,
+			      uint32_t cnt, bool last)
+{
+	uint32_t i;
+
+	printf("    \"%s\": [", name);
+	for (i = 0; values && (i < cnt); i++)
+		printf("%s%u", i ? ", " : "", values[i]);
+	printf("]%s\n", last ? "" : ",");
+}
+
+/*
+ * Print the statistics as a single JSON object, for consumption by
+ * monitoring tools. Times are in microseconds, timestamps in seconds
+ * since the epoch.
+ */
+static int _print_json(void)
+{
+	static const char *class_name[] = { "high", "normal", "low" };
+	int i;
+
+	if (!buf) {
+		printf("No data available. Probably slurmctld is not working\n");
+		return -1;
+	}
+
+	printf("{\n");
+	printf("  \"req_time\": %ld,\n", (long) buf->req_time);
+	printf("  \"req_time_start\": %ld,\n", (long) buf->req_time_start);
+	printf("  \"server_thread_count\": %u,\n", buf->server_thread_count);
+	printf("  \"agent_queue_size\": %u,\n", buf->agent_queue_size);
+	printf("  \"dbd_agent_queue_size\": %u,\n",
+	       buf->dbd_agent_queue_size);
+	printf("  \"jobs_submitted\": %u,\n", buf->jobs_submitted);
+	printf("  \"jobs_started\": %u,\n", buf->jobs_started);
+	printf("  \"jobs_completed\": %u,\n", buf->jobs_completed);
+	printf("  \"jobs_canceled\": %u,\n", buf->jobs_canceled);
+	printf("  \"jobs_failed\": %u,\n", buf->jobs_failed);
+	printf("  \"jobs_pending\": %u,\n", buf->jobs_pending);
+	printf("  \"jobs_running\": %u,\n", buf->jobs_running);
+	printf("  \"schedule\": {\"last\": %u, \"max\": %u, "
+	       "\"cycles\": %u, \"sum\": %u, \"queue_length\": %u},\n",
+	       buf->schedule_cycle_last, buf->schedule_cycle_max,
+	       buf->schedule_cycle_counter, buf->schedule_cycle_sum,
+	       buf->schedule_queue_len);
+	printf("  \"backfill\": {\"last\": %u, \"max\": %u, "
+	       "\"cycles\": %u, \"sum\": %"PRIu64", "
+	       "\"backfilled_jobs\": %u, \"queue_length\": %u, "
+	       "\"parallel\": %u, \"parallel_tests\": %u, "
+	       "\"parallel_used\": %u, \"parallel_time\": %"PRIu64", "
+	       "\"parallel_wall\": %"PRIu64", \"plan_jobs\": %u, "
+	       "\"plan_time\": %ld},\n",
+	       buf->bf_cycle_last, buf->bf_cycle_max, buf->bf_cycle_counter,
+	       buf->bf_cycle_sum, buf->bf_backfilled_jobs, buf->bf_queue_len,
+	       buf->bf_parallel, buf->bf_last_spec_cnt, buf->bf_last_spec_used,
+	       buf->bf_last_spec_time, buf->bf_last_spec_wall,
+	       buf->bf_plan_jobs, (long) buf->bf_plan_time);
+
+	printf("  \"rpc_types\": [");
+	for (i = 0; i < buf->rpc_type_size; i++) {
+		printf("%s\n    {\"type\": \"%s\", \"id\": %u, "
+		       "\"count\": %u, \"total_time\": %"PRIu64,
+		       i ? "," : "", rpc_num2string(buf->rpc_type_id[i]),
+		       buf->rpc_type_id[i], buf->rpc_type_cnt[i],
+		       buf->rpc_type_time[i]);
+		if (buf->rpc_type_p50) {
+			printf(", \"p50\": %u, \"p90\": %u, \"p99\": %u, "
+			       "\"max\": %u",
+			       buf->rpc_type_p50[i], buf->rpc_type_p90[i],
+			       buf->rpc_type_p99[i], buf->rpc_type_max[i]);
+		}
+		printf("}");
+	}
+	printf("\n  ],\n");
+
+	printf("  \"rpc_users\": [");
+	for (i = 0; i < buf->rpc_user_size; i++) {
+		printf("%s\n    {\"user\": \"%s\", \"id\": %u, "
+		       "\"count\": %u, \"total_time\": %"PRIu64,
+		       i ? "," : "",
+		       uid_to_string_cached((uid_t)buf->rpc_user_id[i]),
+		       buf->rpc_user_id[i], buf->rpc_user_cnt[i],
+		       buf->rpc_user_time[i]);
+		if (buf->rpc_user_p50) {
+			printf(", \"p50\": %u, \"p90\": %u, \"p99\": %u, "
+			       "\"max\": %u",
+			       buf->rpc_user_p50[i], buf->rpc_user_p90[i],
+			       buf->rpc_user_p99[i], buf->rpc_user_max[i]);
+		}
+		printf("}");
+	}
+	printf("\n  ],\n");
+
+	printf("  \"rpc_classes\": [");
+	for (i = 0; i < buf->rpc_class_size; i++) {
+		printf("%s\n    {\"class\": \"%s\", \"max\": %u, "
+		       "\"active\": %u, \"queued\": %u, \"count\": %u, "
+		       "\"shed\": %u, \"total_time\": %"PRIu64", "
+		       "\"total_wait\": %"PRIu64"}",
+		       i ? "," : "", (i < 3) ? class_name[i] : "unknown",
+		       buf->rpc_class_max[i], buf->rpc_class_active[i],
+		       buf->rpc_class_queued[i], buf->rpc_class_cnt[i],
+		       buf->rpc_class_shed[i], buf->rpc_class_time[i],
+		       buf->rpc_class_wait[i]);
+	}
+	printf("\n  ],\n");
+
+	printf("  \"history\": {\n");
+	printf("    \"time\": [");
+	for (i = 0; i < buf->history_size; i++)
+		printf("%s%ld", i ? ", " : "", (long) buf->history_time[i]);
+	printf("],\n");
+	_print_json_array("sched_cycles", buf->history_sched_cycles,
+			  buf->history_size, false);
+	_print_json_array("sched_mean", buf->history_sched_mean,
+			  buf->history_size, false);
+	_print_json_array("bf_cycles", buf->history_bf_cycles,
+			  buf->history_size, false);
+	_print_json_array("bf_mean", buf->history_bf_mean,
+			  buf->history_size, false);
+	_print_json_array("agent_queue", buf->history_agent_queue,
+			  buf->history_size, false);
+	_print_json_array("dbd_queue", buf->history_dbd_queue,
+			  buf->history_size, false);
+	_print_json_array("server_threads", buf->history_server_threads,
+			  buf->history_size, false);
+	_print_json_array("jobs_pending", buf->history_jobs_pending,
+			  buf->history_size, false);
+	_print_json_array("jobs_running", buf->history_jobs_running,
+			  buf->history_size, true);
+	printf("  }\n");
+	printf("}\n");
+
+	return 0;
+}
+
+/* Sort lock acquiring functions by total hold time, largest first */
+static int _cmp_lock_site(const void *a, const void *b)
+{
+	uint64_t hold_a = buf->lock_site_hold[*(uint32_t *) a];
+	uint64_t hold_b = buf->lock_site_hold[*(uint32_t *) b];
+
+	if (hold_a > hold_b)
+		return -1;
+	if (hold_a < hold_b)
+		return 1;
 	return 0;
 }
 
+static void _print_lock_stats(void)
+{
+	uint32_t i, j, *order, *hist, limit;
+
+	if (!buf->lock_stat_size)
+		return;
+
+	printf("\nLock statistics by lock (times in microseconds)\n");
+	for (i = 0; i < buf->lock_stat_size; i++) {
+		if (!buf->lock_stat_cnt[i])
+			continue;
+		printf("\t%-10s count:%-8u ave_wait:%-8"PRIu64" "
+		       "max_wait:%-8u ave_hold:%-8"PRIu64" max_hold:%u\n",
+		       buf->lock_stat_name[i], buf->lock_stat_cnt[i],
+		       buf->lock_stat_wait[i] / buf->lock_stat_cnt[i],
+		       buf->lock_stat_wait_max[i],
+		       buf->lock_stat_hold[i] / buf->lock_stat_cnt[i],
+		       buf->lock_stat_hold_max[i]);
+	}
+
+	printf("\nLock wait and hold time histograms\n\t%-16s", "");
+	for (j = 0, limit = 10; j < buf->lock_hist_size; j++, limit *= 10) {
+		if (j == (buf->lock_hist_size - 1))
+			printf(" >=%-8u", limit / 10);
+		else
+			printf(" <%-9u", limit);
+	}
+	printf("\n");
+	for (i = 0; i < buf->lock_stat_size; i++) {
+		if (!buf->lock_stat_cnt[i])
+			continue;
+		hist = buf->lock_stat_wait_hist + (i * buf->lock_hist_size);
+		printf("\t%-10s wait ", buf->lock_stat_name[i]);
+		for (j = 0; j < buf->lock_hist_size; j++)
+			printf(" %-10u", hist[j]);
+		hist = buf->lock_stat_hold_hist + (i * buf->lock_hist_size);
+		printf("\n\t%-10s hold ", buf->lock_stat_name[i]);
+		for (j = 0; j < buf->lock_hist_size; j++)
+			printf(" %-10u", hist[j]);
+		printf("\n");
+	}
+
+	printf("\nLock statistics by acquiring function (times in microseconds)\n");
+	if (buf->lock_hold_warn) {
+		printf("\tlong: holds over %u microseconds\n",
+		       buf->lock_hold_warn);
+	}
+	order = xmalloc(sizeof(uint32_t) * (buf->lock_site_size + 1));
+	for (i = 0; i < buf->lock_site_size; i++)
+		order[i] = i;
+	qsort(order, buf->lock_site_size, sizeof(uint32_t), _cmp_lock_site);
+	for (j = 0; j < buf->lock_site_size; j++) {
+		i = order[j];
+		if (!buf->lock_site_cnt[i])
+			continue;
+		printf("\t%-40s count:%-8u ave_wait:%-8"PRIu64" "
+		       "max_wait:%-8u ave_hold:%-8"PRIu64" max_hold:%-8u "
+		       "total_hold:%"PRIu64,
+		       buf->lock_site_name[i], buf->lock_site_cnt[i],
+		       buf->lock_site_wait[i] / buf->lock_site_cnt[i],
+		       buf->lock_site_wait_max[i],
+		       buf->lock_site_hold[i] / buf->lock_site_cnt[i],
+		       buf->lock_site_hold_max[i], buf->lock_site_hold[i]);
+		if (buf->lock_hold_warn)
+			printf(" long:%u", buf->lock_site_long[i]);
+		printf("\n");
+	}
+	xfree(order);
+}
+
+/* Exchange two entries of the per message type RPC statistics */
+static void _swap_rpc_type(int i, int j)
+{
+	uint16_t id;
+	uint32_t val;
+	uint64_t time;
+
+	id = buf->rpc_type_id[i];
+	buf->rpc_type_id[i] = buf->rpc_type_id[j];
+	buf->rpc_type_id[j] = id;
+
+	val = buf->rpc_type_cnt[i];
+	buf->rpc_type_cnt[i] = buf->rpc_type_cnt[j];
+	buf->rpc_type_cnt[j] = val;
+
+	time = buf->rpc_type_time[i];
+	buf->rpc_type_time[i] = buf->rpc_type_time[j];
+	buf->rpc_type_time[j] = time;
+
+	val = rpc_type_ave_time[i];
+	rpc_type_ave_time[i] = rpc_type_ave_time[j];
+	rpc_type_ave_time[j] = val;
+
+	if (buf->rpc_type_p50) {
+		val = buf->rpc_type_p50[i];
+		buf->rpc_type_p50[i] = buf->rpc_type_p50[j];
+		buf->rpc_type_p50[j] = val;
+		val = buf->rpc_type_p90[i];
+		buf->rpc_type_p90[i] = buf->rpc_type_p90[j];
+		buf->rpc_type_p90[j] = val;
+		val = buf->rpc_type_p99[i];
+		buf->rpc_type_p99[i] = buf->rpc_type_p99[j];
+		buf->rpc_type_p99[j] = val;
+		val = buf->rpc_type_max[i];
+		buf->rpc_type_max[i] = buf->rpc_type_max[j];
+		buf->rpc_type_max[j] = val;
+	}
+}
+
+/* Exchange two entries of the per user RPC statistics */
+static void _swap_rpc_user(int i, int j)
+{
+	uint32_t val;
+	uint64_t time;
+
+	val = buf->rpc_user_id[i];
+	buf->rpc_user_id[i] = buf->rpc_user_id[j];
+	buf->rpc_user_id[j] = val;
+
+	val = buf->rpc_user_cnt[i];
+	buf->rpc_user_cnt[i] = buf->rpc_user_cnt[j];
+	buf->rpc_user_cnt[j] = val;
+
+	time = buf->rpc_user_time[i];
+	buf->rpc_user_time[i] = buf->rpc_user_time[j];
+	buf->rpc_user_time[j] = time;
+
+	val = rpc_user_ave_time[i];
+	rpc_user_ave_time[i] = rpc_user_ave_time[j];
+	rpc_user_ave_time[j] = val;
+
+	if (buf->rpc_user_p50) {
+		val = buf->rpc_user_p50[i];
+		buf->rpc_user_p50[i] = buf->rpc_user_p50[j];
+		buf->rpc_user_p50[j] = val;
+		val = buf->rpc_user_p90[i];
+		buf->rpc_user_p90[i] = buf->rpc_user_p90[j];
+		buf->rpc_user_p90[j] = val;
+		val = buf->rpc_user_p99[i];
+		buf->rpc_user_p99[i] = buf->rpc_user_p99[j];
+		buf->rpc_user_p99[j] = val;
+		val = buf->rpc_user_max[i];
+		buf->rpc_user_max[i] = buf->rpc_user_max[j];
+		buf->rpc_user_max[j] = val;
+	}
+}
+
 static void _sort_rpc(void)
 {
 	int i, j;
-	uint16_t type_id;
-	uint32_t type_ave, type_cnt, user_ave, user_cnt, user_id;
-	uint64_t type_time, user_time;
 
 	rpc_type_ave_time = xmalloc(sizeof(uint32_t) * buf->rpc_type_size);
 	rpc_user_ave_time = xmalloc(sizeof(uint32_t) * buf->rpc_user_size);
@@ -243,15 +642,7 @@ static void _sort_rpc(void)
 			for (j = i+1; j < buf->rpc_type_size; j++) {
 				if (buf->rpc_type_id[i] <= buf->rpc_type_id[j])
 					continue;
-				type_id   = buf->rpc_type_id[i];
-				type_cnt  = buf->rpc_type_cnt[i];
-				type_time = buf->rpc_type_time[i];
-				buf->rpc_type_id[i]   = buf->rpc_type_id[j];
-				buf->rpc_type_cnt[i]  = buf->rpc_type_cnt[j];
-				buf->rpc_type_time[i] = buf->rpc_type_time[j];
-				buf->rpc_type_id[j]   = type_id;
-				buf->rpc_type_cnt[j]  = type_cnt;
-				buf->rpc_type_time[j] = type_time;
+				_swap_rpc_type(i, j);
 			}
 			if (buf->rpc_type_cnt[i]) {
 				rpc_type_ave_time[i] = buf->rpc_type_time[i] /
@@ -262,15 +653,7 @@ static void _sort_rpc(void)
 			for (j = i+1; j < buf->rpc_user_size; j++) {
 				if (buf->rpc_user_id[i] <= buf->rpc_user_id[j])
 					continue;
-				user_id   = buf->rpc_user_id[i];
-				user_cnt  = buf->rpc_user_cnt[i];
-				user_time = buf->rpc_user_time[i];
-				buf->rpc_user_id[i]   = buf->rpc_user_id[j];
-				buf->rpc_user_cnt[i]  = buf->rpc_user_cnt[j];
-				buf->rpc_user_time[i] = buf->rpc_user_time[j];
-				buf->rpc_user_id[j]   = user_id;
-				buf->rpc_user_cnt[j]  = user_cnt;
-				buf->rpc_user_time[j] = user_time;
+				_swap_rpc_user(i, j);
 			}
 			if (buf->rpc_user_cnt[i]) {
 				rpc_user_ave_time[i] = buf->rpc_user_time[i] /
@@ -282,15 +665,7 @@ static void _sort_rpc(void)
 			for (j = i+1; j < buf->rpc_type_size; j++) {
 				if (buf->rpc_type_time[i] >= buf->rpc_type_time[j])
 					continue;
-				type_id   = buf->rpc_type_id[i];
-				type_cnt  = buf->rpc_type_cnt[i];
-				type_time = buf->rpc_type_time[i];
-				buf->rpc_type_id[i]   = buf->rpc_type_id[j];
-				buf->rpc_type_cnt[i]  = buf->rpc_type_cnt[j];
-				buf->rpc_type_time[i] = buf->rpc_type_time[j];
-				buf->rpc_type_id[j]   = type_id;
-				buf->rpc_type_cnt[j]  = type_cnt;
-				buf->rpc_type_time[j] = type_time;
+				_swap_rpc_type(i, j);
 			}
 			if (buf->rpc_type_cnt[i]) {
 				rpc_type_ave_time[i] = buf->rpc_type_time[i] /
@@ -301,15 +676,7 @@ static void _sort_rpc(void)
 			for (j = i+1; j < buf->rpc_user_size; j++) {
 				if (buf->rpc_user_time[i] >= buf->rpc_user_time[j])
 					continue;
-				user_id   = buf->rpc_user_id[i];
-				user_cnt  = buf->rpc_user_cnt[i];
-				user_time = buf->rpc_user_time[i];
-				buf->rpc_user_id[i]   = buf->rpc_user_id[j];
-				buf->rpc_user_cnt[i]  = buf->rpc_user_cnt[j];
-				buf->rpc_user_time[i] = buf->rpc_user_time[j];
-				buf->rpc_user_id[j]   = user_id;
-				buf->rpc_user_cnt[j]  = user_cnt;
-				buf->rpc_user_time[j] = user_time;
+				_swap_rpc_user(i, j);
 			}
 			if (buf->rpc_user_cnt[i]) {
 				rpc_user_ave_time[i] = buf->rpc_user_time[i] /
@@ -327,18 +694,7 @@ static void _sort_rpc(void)
 			for (j = i+1; j < buf->rpc_type_size; j++) {
 				if (rpc_type_ave_time[i] >= rpc_type_ave_time[j])
 					continue;
-				type_ave  = rpc_type_ave_time[i];
-				type_id   = buf->rpc_type_id[i];
-				type_cnt  = buf->rpc_type_cnt[i];
-				type_time = buf->rpc_type_time[i];
-				rpc_type_ave_time[i]  = rpc_type_ave_time[j];
-				buf->rpc_type_id[i]   = buf->rpc_type_id[j];
-				buf->rpc_type_cnt[i]  = buf->rpc_type_cnt[j];
-				buf->rpc_type_time[i] = buf->rpc_type_time[j];
-				rpc_type_ave_time[j]  = type_ave;
-				buf->rpc_type_id[j]   = type_id;
-				buf->rpc_type_cnt[j]  = type_cnt;
-				buf->rpc_type_time[j] = type_time;
+				_swap_rpc_type(i, j);
 			}
 		}
 		for (i = 0; i < buf->rpc_user_size; i++) {
@@ -351,18 +707,7 @@ static void _sort_rpc(void)
 			for (j = i+1; j < buf->rpc_user_size; j++) {
 				if (rpc_user_ave_time[i] >= rpc_user_ave_time[j])
 					continue;
-				user_ave  = rpc_user_ave_time[i];
-				user_id   = buf->rpc_user_id[i];
-				user_cnt  = buf->rpc_user_cnt[i];
-				user_time = buf->rpc_user_time[i];
-				rpc_user_ave_time[i]  = rpc_user_ave_time[j];
-				buf->rpc_user_id[i]   = buf->rpc_user_id[j];
-				buf->rpc_user_cnt[i]  = buf->rpc_user_cnt[j];
-				buf->rpc_user_time[i] = buf->rpc_user_time[j];
-				rpc_user_ave_time[j]  = user_ave;
-				buf->rpc_user_id[j]   = user_id;
-				buf->rpc_user_cnt[j]  = user_cnt;
-				buf->rpc_user_time[j] = user_time;
+				_swap_rpc_user(i, j);
 			}
 		}
 	} else { /* sort by count */
@@ -370,15 +715,7 @@ static void _sort_rpc(void)
 			for (j = i+1; j < buf->rpc_type_size; j++) {
 				if (buf->rpc_type_cnt[i] >= buf->rpc_type_cnt[j])
 					continue;
-				type_id   = buf->rpc_type_id[i];
-				type_cnt  = buf->rpc_type_cnt[i];
-				type_time = buf->rpc_type_time[i];
-				buf->rpc_type_id[i]   = buf->rpc_type_id[j];
-				buf->rpc_type_cnt[i]  = buf->rpc_type_cnt[j];
-				buf->rpc_type_time[i] = buf->rpc_type_time[j];
-				buf->rpc_type_id[j]   = type_id;
-				buf->rpc_type_cnt[j]  = type_cnt;
-				buf->rpc_type_time[j] = type_time;
+				_swap_rpc_type(i, j);
 			}
 			if (buf->rpc_type_cnt[i]) {
 				rpc_type_ave_time[i] = buf->rpc_type_time[i] /
@@ -389,15 +726,7 @@ static void _sort_rpc(void)
 			for (j = i+1; j < buf->rpc_user_size; j++) {
 				if (buf->rpc_user_cnt[i] >= buf->rpc_user_cnt[j])
 					continue;
-				user_id   = buf->rpc_user_id[i];
-				user_cnt  = buf->rpc_user_cnt[i];
-				user_time = buf->rpc_user_time[i];
-				buf->rpc_user_id[i]   = buf->rpc_user_id[j];
-				buf->rpc_user_cnt[i]  = buf->rpc_user_cnt[j];
-				buf->rpc_user_time[i] = buf->rpc_user_time[j];
-				buf->rpc_user_id[j]   = user_id;
-				buf->rpc_user_cnt[j]  = user_cnt;
-				buf->rpc_user_time[j] = user_time;
+				_swap_rpc_user(i, j);
 			}
 			if (buf->rpc_user_cnt[i]) {
 				rpc_user_ave_time[i] = buf->rpc_user_time[i] /
@@ -265,11 +265,20 @@ static List _query_server(bool clear_old)
 	uint16_t show_flags = 0;
 	int cc;
 	node_info_t *node_ptr;
+	info_filter_t filter = {0}, *filter_ptr = NULL;
 	List sinfo_list = NULL;
 
 	if (params.all_flag)
 		show_flags |= SHOW_ALL;
 
+	/* Let the controller skip nodes we would discard anyway */
+	if (params.partition || (params.nodes && !params.node_name_single)) {
+		filter.partitions = params.partition;
+		if (!params.node_name_single)
+			filter.nodes = params.nodes;
+		filter_ptr = &filter;
+	}
+
 	if (old_part_ptr) {
 		if (clear_old)
 			old_part_ptr->last_update = 0;
@@ -299,8 +308,10 @@ static List _query_server(bool clear_old)
 							    params.nodes,
 							    show_flags);
 		} else {
-			error_code = slurm_load_node(old_node_ptr->last_update,
-						     &new_node_ptr, show_flags);
+			error_code = slurm_load_node_filtered(
+						old_node_ptr->last_update,
+						&new_node_ptr, show_flags,
+						filter_ptr);
 		}
 		if (error_code == SLURM_SUCCESS)
 			slurm_free_node_info_msg(old_node_ptr);
@@ -312,8 +323,9 @@ static List _query_server(bool clear_old)
 		error_code = slurm_load_node_single(&new_node_ptr, params.nodes,
 						    show_flags);
 	} else {
-		error_code = slurm_load_node((time_t) NULL, &new_node_ptr,
-					     show_flags);
+		error_code = slurm_load_node_filtered((time_t) NULL,
+						      &new_node_ptr, show_flags,
+						      filter_ptr);
 	}
 	if (error_code) {
 		slurm_perror("slurm_load_node");
@@ -324,7 +336,9 @@ static List _query_server(bool clear_old)
 	/* Set the node state as NODE_STATE_MIXED. */
 	for (cc = 0; cc < new_node_ptr->record_count; cc++) {
 		node_ptr = &(new_node_ptr->node_array[cc]);
-		if (IS_NODE_DRAIN(node_ptr)) {
+		if (!node_ptr->select_nodeinfo) {
+			/* not packed due to a filter */
+		} else if (IS_NODE_DRAIN(node_ptr)) {
 			/* don't worry about mixed since the
 			 * whole node is being drained. */
 		} else {
@@ -722,7 +722,7 @@ static void _adjust_limit_usage(int type, struct job_record *job_ptr)
 	 * This handles removal of the accrual_cnt pending on
 	 * state.  We do not want to call this on add submit as it could push
 	 * other jobs pending waiting in line for the limit.  The main call to
-	 * this that handles the initial call happens in build_job_queue().
+	 * this that handles the initial call happens in job_queue_iter_next().
 	 */
 	if (type != ACCT_POLICY_ADD_SUBMIT)
 		acct_policy_handle_accrue_time(job_ptr, true);
@@ -60,6 +60,19 @@
  *
  *  All the state for each thread is maintained in thd_t struct, which is
  *  used by the watchdog thread as well as the communication threads.
+ *
+ *  With SlurmctldParameters=agent_engine, the main agent thread instead
+ *  hands each thd_t's RPC to the agent engine (see agent_engine.c), which
+ *  drives the connections of all agents from one thread, and acts upon
+ *  the results itself. No watchdog or communication threads are created.
+ *
+ *  With SlurmctldParameters=agent_coalesce_wait=#, job termination requests
+ *  for the same set of nodes which are queued within that many milliseconds
+ *  of each other are sent as one REQUEST_COMPOSITE message. Each slurmd
+ *  acknowledges the composite message as a whole and processes its parts
+ *  as if their connections had been closed after the acknowledgement. About
+ *  MAX_COALESCE_SEND of the held requests are sent per wait period rather
+ *  than all at once, which would bring the replies of all nodes together.
 \*****************************************************************************/
 
 #include "config.h"
@@ -74,6 +87,7 @@
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -84,6 +98,7 @@
 #include "src/common/macros.h"
 #include "src/common/node_select.h"
 #include "src/common/parse_time.h"
+#include "src/common/slurm_auth.h"
 #include "src/common/slurm_protocol_api.h"
 #include "src/common/slurm_protocol_interface.h"
 #include "src/common/uid.h"
@@ -92,6 +107,7 @@
 #include "src/common/xmalloc.h"
 #include "src/common/xstring.h"
 #include "src/slurmctld/agent.h"
+#include "src/slurmctld/agent_engine.h"
 #include "src/slurmctld/front_end.h"
 #include "src/slurmctld/job_scheduler.h"
 #include "src/slurmctld/locks.h"
@@ -105,6 +121,8 @@
 #define RPC_PACK_MAX_AGE	30	/* Rebuild data over 30 seconds old */
 #define DUMP_RPC_COUNT 		25
 #define HOSTLIST_MAX_SIZE 	80
+#define MAX_COALESCE_CNT	128	/* Requests per REQUEST_COMPOSITE */
+#define MAX_COALESCE_SEND	32	/* Held requests sent per wait period */
 
 typedef enum {
 	DSH_NEW,        /* Request not yet started */
@@ -147,6 +165,8 @@ typedef struct agent_info {
 	slurm_msg_type_t msg_type;	/* RPC to be issued */
 	void **msg_args_pptr;		/* RPC data to be used */
 	uint16_t protocol_version;	/* if set, use this version */
+	List done_list;			/* task_info_t completed by the
+					 * agent engine */
 } agent_info_t;
 
 typedef struct task_info {
@@ -160,6 +180,9 @@ typedef struct task_info {
 	slurm_msg_type_t msg_type;	/* RPC to be issued */
 	void *msg_args_ptr;		/* ptr to RPC data to be used */
 	uint16_t protocol_version;	/* if set, use this version */
+	List done_list;			/* agent engine completions */
+	List ret_list;			/* agent engine replies */
+	int rc;				/* agent engine send status */
 } task_info_t;
 
 typedef struct queued_request {
@@ -167,6 +190,8 @@ typedef struct queued_request {
 	time_t       first_attempt;	/* Time of first check for batch
 					 * launch RPC *only* */
 	time_t       last_attempt;	/* Time of last xmit attempt */
+	struct timeval queue_time;	/* Time queued, for coalescing */
+	char *hosts;			/* Ranged hostlist, set if coalescing */
 } queued_request_t;
 
 typedef struct mail_info {
@@ -177,18 +202,32 @@ typedef struct mail_info {
 static void _agent_retry(int min_wait, bool wait_too);
 static int  _batch_launch_defer(queued_request_t *queued_req_ptr);
 static int  _signal_defer(queued_request_t *queued_req_ptr);
+static int  _coalesce_defer(queued_request_t *queued_req_ptr,
+			    struct timeval *now);
+static void _coalesce_requests(queued_request_t *queued_req_ptr,
+			       struct timeval *now);
+static bool _coalesce_type(agent_arg_t *agent_arg_ptr);
+static void _composite_add(composite_msg_t *comp_msg,
+			   agent_arg_t *agent_arg_ptr);
+static void _composite_auth(composite_msg_t *comp_msg);
 static inline int _comm_err(char *node_name, slurm_msg_type_t msg_type);
 static void _list_delete_retry(void *retry_entry);
+static void _agent_notify(agent_info_t *agent_ptr, thd_complete_t *thd_comp);
+static void _agent_tally(agent_info_t *agent_ptr, thd_complete_t *thd_comp);
+static void _clear_job_signaling(task_info_t *task_ptr);
+static void _engine_rpcs(agent_info_t *agent_ptr);
 static agent_info_t *_make_agent_info(agent_arg_t *agent_arg_ptr);
 static task_info_t *_make_task_data(agent_info_t *agent_info_ptr, int inx);
 static void _notify_slurmctld_jobs(agent_info_t *agent_ptr);
 static void _notify_slurmctld_nodes(agent_info_t *agent_ptr,
 		int no_resp_cnt, int retry_cnt);
 static void _purge_agent_args(agent_arg_t *agent_arg_ptr);
+static state_t _process_ret_list(task_info_t *task_ptr, List ret_list);
 static void _queue_agent_retry(agent_info_t * agent_info_ptr, int count);
 static int  _setup_requeue(agent_arg_t *agent_arg_ptr, thd_t *thread_ptr,
 			   int *count, int *spot);
 static void _sig_handler(int dummy);
+static bool _srun_thread_msg(slurm_msg_type_t msg_type);
 static void *_thread_per_group_rpc(void *args);
 static int   _valid_agent_arg(agent_arg_t *agent_arg_ptr);
 static void *_wdog(void *args);
@@ -208,11 +247,16 @@ static pthread_cond_t  agent_cnt_cond  = PTHREAD_COND_INITIALIZER;
 static int agent_cnt = 0;
 static int agent_thread_cnt = 0;
 static uint16_t message_timeout = NO_VAL16;
+static bool use_agent_engine = false;
+static int coalesce_wait = 0;		/* msec, 0 if not coalescing */
+static struct timeval coalesce_period;	/* start of the send period */
+static int coalesce_sent = 0;		/* held requests sent in the period */
 
 static pthread_mutex_t pending_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t  pending_cond = PTHREAD_COND_INITIALIZER;
 static int pending_wait_time = NO_VAL16;
 static bool pending_mail = false;
+static bool pending_coalesce = false;	/* requests held for coalescing */
 static bool pending_thread_running = false;
 
 static bool run_scheduler    = false;
@@ -257,7 +301,11 @@ void *agent(void *args)
 #endif
 	slurm_mutex_lock(&agent_cnt_mutex);
 
-	rpc_thread_cnt = 2 + MIN(agent_arg_ptr->node_count, AGENT_THREAD_COUNT);
+	if (use_agent_engine)
+		rpc_thread_cnt = 1;
+	else
+		rpc_thread_cnt = 2 + MIN(agent_arg_ptr->node_count,
+					 AGENT_THREAD_COUNT);
 	while (1) {
 		if (slurmctld_config.shutdown_time ||
 		    ((agent_thread_cnt+rpc_thread_cnt) <= MAX_SERVER_THREADS)) {
@@ -332,6 +380,16 @@ void *agent(void *args)
 	agent_info_ptr = _make_agent_info(agent_arg_ptr);
 	thread_ptr = agent_info_ptr->thread_struct;
 
+	if (use_agent_engine) {
+		_engine_rpcs(agent_info_ptr);
+		delay = (int) difftime(time(NULL), begin_time);
+		if (delay > (slurm_get_msg_timeout() * 2)) {
+			info("agent msg_type=%u ran for %d seconds",
+			     agent_arg_ptr->msg_type, delay);
+		}
+		goto cleanup;
+	}
+
 	/* start the watchdog thread */
 	slurm_thread_create(&thread_wdog, _wdog, agent_info_ptr);
 
@@ -529,6 +587,7 @@ static task_info_t *_make_task_data(agent_info_t *agent_info_ptr, int inx)
 	task_info_ptr->msg_type          = agent_info_ptr->msg_type;
 	task_info_ptr->msg_args_ptr      = *agent_info_ptr->msg_args_pptr;
 	task_info_ptr->protocol_version  = agent_info_ptr->protocol_version;
+	task_info_ptr->done_list         = agent_info_ptr->done_list;
 
 	return task_info_ptr;
 }
@@ -568,21 +627,52 @@ static void _update_wdog_state(thd_t *thread_ptr,
 }
 
 /*
- * _wdog - Watchdog thread. Send SIGUSR1 to threads which have been active
- *	for too long.
- * IN args - pointer to agent_info_t with info on threads to watch
- * Sleep between polls with exponential times (from 0.125 to 1.0 second)
+ * _agent_tally - Tally the state of each RPC issued by an agent
+ * IN agent_ptr - agent, thread_mutex locked
+ * OUT thd_comp - counts of RPCs by state, max_delay is only raised
  */
-static void *_wdog(void *args)
+static void _agent_tally(agent_info_t *agent_ptr, thd_complete_t *thd_comp)
 {
-	bool srun_agent = false;
-	int i;
-	agent_info_t *agent_ptr = (agent_info_t *) args;
 	thd_t *thread_ptr = agent_ptr->thread_struct;
-	unsigned long usec = 5000;
-	ListIterator itr;
-	thd_complete_t thd_comp;
 	ret_data_info_t *ret_data_info = NULL;
+	ListIterator itr;
+	int i;
+
+	thd_comp->work_done   = true;/* assume all threads complete */
+	thd_comp->fail_cnt    = 0;   /* assume no threads failures */
+	thd_comp->no_resp_cnt = 0;   /* assume all threads respond */
+	thd_comp->retry_cnt   = 0;   /* assume no required retries */
+	thd_comp->now         = time(NULL);
+
+	for (i = 0; i < agent_ptr->thread_count; i++) {
+		//info("thread name %s",thread_ptr[i].node_name);
+		if (!thread_ptr[i].ret_list) {
+			_update_wdog_state(&thread_ptr[i],
+					   &thread_ptr[i].state,
+					   thd_comp);
+		} else {
+			itr = list_iterator_create(thread_ptr[i].ret_list);
+			while ((ret_data_info = list_next(itr))) {
+				_update_wdog_state(&thread_ptr[i],
+						   &ret_data_info->err,
+						   thd_comp);
+			}
+			list_iterator_destroy(itr);
+		}
+	}
+}
+
+/*
+ * _agent_notify - Notify slurmctld of the outcome of an agent's RPCs once
+ *	all are complete and release their replies
+ * IN agent_ptr - agent, thread_mutex locked
+ * IN thd_comp - final tally from _agent_tally()
+ */
+static void _agent_notify(agent_info_t *agent_ptr, thd_complete_t *thd_comp)
+{
+	bool srun_agent = false;
+	thd_t *thread_ptr = agent_ptr->thread_struct;
+	int i;
 
 	if ( (agent_ptr->msg_type == SRUN_JOB_COMPLETE)			||
 	     (agent_ptr->msg_type == SRUN_REQUEST_SUSPEND)		||
@@ -597,57 +687,50 @@ static void *_wdog(void *args)
 	     (agent_ptr->msg_type == RESPONSE_JOB_PACK_ALLOCATION) )
 		srun_agent = true;
 
+	if (srun_agent) {
+		_notify_slurmctld_jobs(agent_ptr);
+	} else {
+		_notify_slurmctld_nodes(agent_ptr,
+					thd_comp->no_resp_cnt,
+					thd_comp->retry_cnt);
+	}
+
+	for (i = 0; i < agent_ptr->thread_count; i++) {
+		FREE_NULL_LIST(thread_ptr[i].ret_list);
+		xfree(thread_ptr[i].nodelist);
+	}
+
+	if (thd_comp->max_delay)
+		debug2("agent maximum delay %d seconds", thd_comp->max_delay);
+}
+
+/*
+ * _wdog - Watchdog thread. Send SIGUSR1 to threads which have been active
+ *	for too long.
+ * IN args - pointer to agent_info_t with info on threads to watch
+ * Sleep between polls with exponential times (from 0.125 to 1.0 second)
+ */
+static void *_wdog(void *args)
+{
+	agent_info_t *agent_ptr = (agent_info_t *) args;
+	unsigned long usec = 5000;
+	thd_complete_t thd_comp;
+
 	thd_comp.max_delay = 0;
 
 	while (1) {
-		thd_comp.work_done   = true;/* assume all threads complete */
-		thd_comp.fail_cnt    = 0;   /* assume no threads failures */
-		thd_comp.no_resp_cnt = 0;   /* assume all threads respond */
-		thd_comp.retry_cnt   = 0;   /* assume no required retries */
-		thd_comp.now         = time(NULL);
-
 		usleep(usec);
 		usec = MIN((usec * 2), 1000000);
 
 		slurm_mutex_lock(&agent_ptr->thread_mutex);
-		for (i = 0; i < agent_ptr->thread_count; i++) {
-			//info("thread name %s",thread_ptr[i].node_name);
-			if (!thread_ptr[i].ret_list) {
-				_update_wdog_state(&thread_ptr[i],
-						   &thread_ptr[i].state,
-						   &thd_comp);
-			} else {
-				itr = list_iterator_create(
-					thread_ptr[i].ret_list);
-				while ((ret_data_info = list_next(itr))) {
-					_update_wdog_state(&thread_ptr[i],
-							   &ret_data_info->err,
-							   &thd_comp);
-				}
-				list_iterator_destroy(itr);
-			}
-		}
+		_agent_tally(agent_ptr, &thd_comp);
 		if (thd_comp.work_done)
 			break;
 
 		slurm_mutex_unlock(&agent_ptr->thread_mutex);
 	}
 
-	if (srun_agent) {
-		_notify_slurmctld_jobs(agent_ptr);
-	} else {
-		_notify_slurmctld_nodes(agent_ptr,
-					thd_comp.no_resp_cnt,
-					thd_comp.retry_cnt);
-	}
-
-	for (i = 0; i < agent_ptr->thread_count; i++) {
-		FREE_NULL_LIST(thread_ptr[i].ret_list);
-		xfree(thread_ptr[i].nodelist);
-	}
-
-	if (thd_comp.max_delay)
-		debug2("agent maximum delay %d seconds", thd_comp.max_delay);
+	_agent_notify(agent_ptr, &thd_comp);
 
 	slurm_mutex_unlock(&agent_ptr->thread_mutex);
 	return (void *) NULL;
@@ -848,33 +931,34 @@ static int _wif_status(void)
 	return rc;
 }
 
+/* Return true if the RPC is sent to srun rather than slurmd */
+static bool _srun_thread_msg(slurm_msg_type_t msg_type)
+{
+	return ((msg_type == SRUN_PING)				||
+		(msg_type == SRUN_EXEC)				||
+		(msg_type == SRUN_JOB_COMPLETE)			||
+		(msg_type == SRUN_STEP_MISSING)			||
+		(msg_type == SRUN_STEP_SIGNAL)			||
+		(msg_type == SRUN_TIMEOUT)			||
+		(msg_type == SRUN_USER_MSG)			||
+		(msg_type == RESPONSE_RESOURCE_ALLOCATION)	||
+		(msg_type == SRUN_NODE_FAIL));
+}
+
 /*
- * _thread_per_group_rpc - thread to issue an RPC for a group of nodes
- *                         sending message out to one and forwarding it to
- *                         others if necessary.
- * IN/OUT args - pointer to task_info_t, xfree'd on completion
+ * _process_ret_list - act upon the replies to a group's RPC
+ * IN task_ptr - RPC issued
+ * IN/OUT ret_list - replies, each err is set to the node's state_t
+ * RET state of the last node processed
  */
-static void *_thread_per_group_rpc(void *args)
+static state_t _process_ret_list(task_info_t *task_ptr, List ret_list)
 {
 	int rc = SLURM_SUCCESS;
-	slurm_msg_t msg;
-	task_info_t *task_ptr = (task_info_t *) args;
-	/* we cache some pointers from task_info_t because we need
-	 * to xfree args before being finished with their use. xfree
-	 * is required for timely termination of this pthread because
-	 * xfree could lock it at the end, preventing a timely
-	 * thread_exit */
-	pthread_mutex_t *thread_mutex_ptr   = task_ptr->thread_mutex_ptr;
-	pthread_cond_t  *thread_cond_ptr    = task_ptr->thread_cond_ptr;
-	uint32_t        *threads_active_ptr = task_ptr->threads_active_ptr;
-	thd_t           *thread_ptr         = task_ptr->thread_struct_ptr;
 	state_t thread_state = DSH_NO_RESP;
 	slurm_msg_type_t msg_type = task_ptr->msg_type;
 	bool is_kill_msg, srun_agent;
-	List ret_list = NULL;
 	ListIterator itr;
 	ret_data_info_t *ret_data_info = NULL;
-	int sig_array[2] = {SIGUSR1, 0};
 	/* Locks: Write job, write node */
 	slurmctld_lock_t job_write_lock = {
 		NO_LOCK, WRITE_LOCK, WRITE_LOCK, NO_LOCK, READ_LOCK };
@@ -886,83 +970,10 @@ static void *_thread_per_group_rpc(void *args)
 		NO_LOCK, NO_LOCK, WRITE_LOCK, NO_LOCK, NO_LOCK };
 	uint32_t job_id;
 
-	xassert(args != NULL);
-	xsignal(SIGUSR1, _sig_handler);
-	xsignal_unblock(sig_array);
 	is_kill_msg = (	(msg_type == REQUEST_KILL_TIMELIMIT)	||
 			(msg_type == REQUEST_KILL_PREEMPTED)	||
 			(msg_type == REQUEST_TERMINATE_JOB) );
-	srun_agent = (	(msg_type == SRUN_PING)			||
-			(msg_type == SRUN_EXEC)			||
-			(msg_type == SRUN_JOB_COMPLETE)		||
-			(msg_type == SRUN_STEP_MISSING)		||
-			(msg_type == SRUN_STEP_SIGNAL)		||
-			(msg_type == SRUN_TIMEOUT)		||
-			(msg_type == SRUN_USER_MSG)		||
-			(msg_type == RESPONSE_RESOURCE_ALLOCATION) ||
-			(msg_type == SRUN_NODE_FAIL) );
-
-	thread_ptr->start_time = time(NULL);
-
-	slurm_mutex_lock(thread_mutex_ptr);
-	thread_ptr->state = DSH_ACTIVE;
-	thread_ptr->end_time = thread_ptr->start_time + message_timeout;
-	slurm_mutex_unlock(thread_mutex_ptr);
-
-	/* send request message */
-	slurm_msg_t_init(&msg);
-
-	if (task_ptr->protocol_version)
-		msg.protocol_version = task_ptr->protocol_version;
-
-	msg.msg_type = msg_type;
-	msg.data     = task_ptr->msg_args_ptr;
-#if 0
-	info("%s: sending %s to %s", __func__, rpc_num2string(msg_type),
-	     thread_ptr->nodelist);
-#endif
-	if (task_ptr->get_reply) {
-		if (thread_ptr->addr) {
-			msg.address = *thread_ptr->addr;
-
-			if (!(ret_list = slurm_send_addr_recv_msgs(
-				     &msg, thread_ptr->nodelist, 0))) {
-				error("%s: no ret_list given", __func__);
-				goto cleanup;
-			}
-		} else {
-			if (!(ret_list = slurm_send_recv_msgs(
-				     thread_ptr->nodelist,
-				     &msg, 0, true))) {
-				error("%s: no ret_list given", __func__);
-				goto cleanup;
-			}
-		}
-	} else {
-		if (thread_ptr->addr) {
-			//info("got the address");
-			msg.address = *thread_ptr->addr;
-		} else {
-			//info("no address given");
-			if (slurm_conf_get_addr(thread_ptr->nodelist,
-					       &msg.address) == SLURM_ERROR) {
-				error("%s: can't find address for host %s, check slurm.conf",
-				      __func__, thread_ptr->nodelist);
-				goto cleanup;
-			}
-		}
-		//info("sending %u to %s", msg_type, thread_ptr->nodelist);
-		if (slurm_send_only_node_msg(&msg) == SLURM_SUCCESS) {
-			thread_state = DSH_DONE;
-		} else {
-			if (!srun_agent) {
-				lock_slurmctld(node_read_lock);
-				_comm_err(thread_ptr->nodelist, msg_type);
-				unlock_slurmctld(node_read_lock);
-			}
-		}
-		goto cleanup;
-	}
+	srun_agent = _srun_thread_msg(msg_type);
 
 	//info("got %d messages back", list_count(ret_list));
 	itr = list_iterator_create(ret_list);
@@ -1159,22 +1170,132 @@ static void *_thread_per_group_rpc(void *args)
 	}
 	list_iterator_destroy(itr);
 
-cleanup:
-	xfree(args);
-	if (!ret_list && (msg_type == REQUEST_SIGNAL_TASKS)) {
-		struct job_record *job_ptr;
-		signal_tasks_msg_t *msg_ptr =
-			task_ptr->msg_args_ptr;
-		if ((msg_ptr->signal == SIGCONT) ||
-		    (msg_ptr->signal == SIGSTOP)) {
-			job_id = msg_ptr->job_id;
-			lock_slurmctld(job_write_lock);
-			job_ptr = find_job_record(job_id);
-			if (job_ptr)
-				job_ptr->job_state &= ~JOB_SIGNALING;
-			unlock_slurmctld(job_write_lock);
+	return thread_state;
+}
+
+/* Clear JOB_SIGNALING of a job whose SIGSTOP/SIGCONT got no reply */
+static void _clear_job_signaling(task_info_t *task_ptr)
+{
+	struct job_record *job_ptr;
+	signal_tasks_msg_t *msg_ptr;
+	/* Locks: Write job, write node */
+	slurmctld_lock_t job_write_lock = {
+		NO_LOCK, WRITE_LOCK, WRITE_LOCK, NO_LOCK, READ_LOCK };
+
+	if (task_ptr->msg_type != REQUEST_SIGNAL_TASKS)
+		return;
+	msg_ptr = task_ptr->msg_args_ptr;
+	if ((msg_ptr->signal == SIGCONT) ||
+	    (msg_ptr->signal == SIGSTOP)) {
+		lock_slurmctld(job_write_lock);
+		job_ptr = find_job_record(msg_ptr->job_id);
+		if (job_ptr)
+			job_ptr->job_state &= ~JOB_SIGNALING;
+		unlock_slurmctld(job_write_lock);
+	}
+}
+
+/*
+ * _thread_per_group_rpc - thread to issue an RPC for a group of nodes
+ *                         sending message out to one and forwarding it to
+ *                         others if necessary.
+ * IN/OUT args - pointer to task_info_t, xfree'd on completion
+ */
+static void *_thread_per_group_rpc(void *args)
+{
+	slurm_msg_t msg;
+	task_info_t *task_ptr = (task_info_t *) args;
+	/* we cache some pointers from task_info_t because we need
+	 * to xfree args before being finished with their use. xfree
+	 * is required for timely termination of this pthread because
+	 * xfree could lock it at the end, preventing a timely
+	 * thread_exit */
+	pthread_mutex_t *thread_mutex_ptr   = task_ptr->thread_mutex_ptr;
+	pthread_cond_t  *thread_cond_ptr    = task_ptr->thread_cond_ptr;
+	uint32_t        *threads_active_ptr = task_ptr->threads_active_ptr;
+	thd_t           *thread_ptr         = task_ptr->thread_struct_ptr;
+	state_t thread_state = DSH_NO_RESP;
+	slurm_msg_type_t msg_type = task_ptr->msg_type;
+	bool srun_agent;
+	List ret_list = NULL;
+	int sig_array[2] = {SIGUSR1, 0};
+	/* Lock: Read node */
+	slurmctld_lock_t node_read_lock = {
+		NO_LOCK, NO_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
+
+	xassert(args != NULL);
+	xsignal(SIGUSR1, _sig_handler);
+	xsignal_unblock(sig_array);
+	srun_agent = _srun_thread_msg(msg_type);
+
+	thread_ptr->start_time = time(NULL);
+
+	slurm_mutex_lock(thread_mutex_ptr);
+	thread_ptr->state = DSH_ACTIVE;
+	thread_ptr->end_time = thread_ptr->start_time + message_timeout;
+	slurm_mutex_unlock(thread_mutex_ptr);
+
+	/* send request message */
+	slurm_msg_t_init(&msg);
+
+	if (task_ptr->protocol_version)
+		msg.protocol_version = task_ptr->protocol_version;
+
+	msg.msg_type = msg_type;
+	msg.data     = task_ptr->msg_args_ptr;
+#if 0
+	info("%s: sending %s to %s", __func__, rpc_num2string(msg_type),
+	     thread_ptr->nodelist);
+#endif
+	if (task_ptr->get_reply) {
+		if (thread_ptr->addr) {
+			msg.address = *thread_ptr->addr;
+
+			if (!(ret_list = slurm_send_addr_recv_msgs(
+				     &msg, thread_ptr->nodelist, 0))) {
+				error("%s: no ret_list given", __func__);
+				goto cleanup;
+			}
+		} else {
+			if (!(ret_list = slurm_send_recv_msgs(
+				     thread_ptr->nodelist,
+				     &msg, 0, true))) {
+				error("%s: no ret_list given", __func__);
+				goto cleanup;
+			}
+		}
+	} else {
+		if (thread_ptr->addr) {
+			//info("got the address");
+			msg.address = *thread_ptr->addr;
+		} else {
+			//info("no address given");
+			if (slurm_conf_get_addr(thread_ptr->nodelist,
+					       &msg.address) == SLURM_ERROR) {
+				error("%s: can't find address for host %s, check slurm.conf",
+				      __func__, thread_ptr->nodelist);
+				goto cleanup;
+			}
 		}
+		//info("sending %u to %s", msg_type, thread_ptr->nodelist);
+		if (slurm_send_only_node_msg(&msg) == SLURM_SUCCESS) {
+			thread_state = DSH_DONE;
+		} else {
+			if (!srun_agent) {
+				lock_slurmctld(node_read_lock);
+				_comm_err(thread_ptr->nodelist, msg_type);
+				unlock_slurmctld(node_read_lock);
+			}
+		}
+		goto cleanup;
 	}
+
+	thread_state = _process_ret_list(task_ptr, ret_list);
+
+cleanup:
+	if (!ret_list)
+		_clear_job_signaling(task_ptr);
+	xfree(args);
 	/* handled at end of thread just in case resend is needed */
 	destroy_forward(&msg.forward);
 	slurm_mutex_lock(thread_mutex_ptr);
@@ -1189,6 +1310,107 @@ cleanup:
 	return (void *) NULL;
 }
 
+/*
+ * _engine_callback - agent engine completion of one group's RPC, hand the
+ *	result to the agent thread. Called from the engine thread.
+ */
+static void _engine_callback(List ret_list, int rc, void *arg)
+{
+	task_info_t *task_ptr = (task_info_t *) arg;
+
+	slurm_mutex_lock(task_ptr->thread_mutex_ptr);
+	task_ptr->ret_list = ret_list;
+	task_ptr->rc = rc;
+	list_append(task_ptr->done_list, task_ptr);
+	slurm_cond_signal(task_ptr->thread_cond_ptr);
+	slurm_mutex_unlock(task_ptr->thread_mutex_ptr);
+}
+
+/*
+ * _engine_rpc_done - act upon the result of a group's RPC issued through
+ *	the agent engine, as _thread_per_group_rpc() does
+ * IN task_ptr - completed RPC, xfree'd
+ */
+static void _engine_rpc_done(task_info_t *task_ptr)
+{
+	thd_t *thread_ptr = task_ptr->thread_struct_ptr;
+	state_t thread_state = DSH_NO_RESP;
+	slurm_msg_type_t msg_type = task_ptr->msg_type;
+	List ret_list = task_ptr->ret_list;
+	/* Lock: Read node */
+	slurmctld_lock_t node_read_lock = {
+		NO_LOCK, NO_LOCK, READ_LOCK, NO_LOCK, NO_LOCK };
+
+	if (task_ptr->get_reply) {
+		if (ret_list)
+			thread_state = _process_ret_list(task_ptr, ret_list);
+		else
+			error("%s: no ret_list given", __func__);
+	} else if (task_ptr->rc == SLURM_SUCCESS) {
+		thread_state = DSH_DONE;
+	} else if ((task_ptr->rc != SLURM_UNKNOWN_FORWARD_ADDR) &&
+		   !_srun_thread_msg(msg_type)) {
+		errno = task_ptr->rc;
+		lock_slurmctld(node_read_lock);
+		_comm_err(thread_ptr->nodelist, msg_type);
+		unlock_slurmctld(node_read_lock);
+	}
+	if (!ret_list)
+		_clear_job_signaling(task_ptr);
+
+	thread_ptr->ret_list = ret_list;
+	thread_ptr->state = thread_state;
+	thread_ptr->end_time = (time_t) difftime(time(NULL),
+						 thread_ptr->start_time);
+	xfree(task_ptr);
+}
+
+/*
+ * _engine_rpcs - issue an agent's RPCs through the agent engine rather
+ *	than _thread_per_group_rpc() threads, act upon each group's result as
+ *	it completes and notify slurmctld once all are done, as _wdog() does
+ * IN agent_ptr - agent to process
+ */
+static void _engine_rpcs(agent_info_t *agent_ptr)
+{
+	thd_t *thread_ptr = agent_ptr->thread_struct;
+	task_info_t *task_ptr;
+	thd_complete_t thd_comp;
+	int i, done_cnt = 0;
+
+	agent_ptr->done_list = list_create(NULL);
+	for (i = 0; i < agent_ptr->thread_count; i++) {
+		task_ptr = _make_task_data(agent_ptr, i);
+		thread_ptr[i].start_time = time(NULL);
+		thread_ptr[i].state = DSH_ACTIVE;
+		agent_engine_send(task_ptr->msg_type, task_ptr->msg_args_ptr,
+				  task_ptr->protocol_version,
+				  thread_ptr[i].nodelist, thread_ptr[i].addr,
+				  task_ptr->get_reply, _engine_callback,
+				  task_ptr);
+	}
+
+	slurm_mutex_lock(&agent_ptr->thread_mutex);
+	while (done_cnt < agent_ptr->thread_count) {
+		if (!(task_ptr = list_dequeue(agent_ptr->done_list))) {
+			slurm_cond_wait(&agent_ptr->thread_cond,
+					&agent_ptr->thread_mutex);
+			continue;
+		}
+		slurm_mutex_unlock(&agent_ptr->thread_mutex);
+		_engine_rpc_done(task_ptr);
+		done_cnt++;
+		slurm_mutex_lock(&agent_ptr->thread_mutex);
+	}
+
+	thd_comp.max_delay = 0;
+	_agent_tally(agent_ptr, &thd_comp);
+	_agent_notify(agent_ptr, &thd_comp);
+	slurm_mutex_unlock(&agent_ptr->thread_mutex);
+
+	FREE_NULL_LIST(agent_ptr->done_list);
+}
+
 /*
  * Signal handler.  We are really interested in interrupting hung communictions
  * and causing them to return EINTR. Multiple interrupts might be required.
@@ -1343,6 +1565,7 @@ static void _list_delete_retry(void *retry_entry)
 
 	queued_req_ptr = (queued_request_t *) retry_entry;
 	_purge_agent_args(queued_req_ptr->agent_arg_ptr);
+	xfree(queued_req_ptr->hosts);
 	xfree(queued_req_ptr);
 }
 
@@ -1352,12 +1575,28 @@ static void *_agent_init(void *arg)
 	int min_wait;
 	bool mail_too;
 	struct timespec ts = {0, 0};
+	struct timeval now;
 
 	while (true) {
 		slurm_mutex_lock(&pending_mutex);
 		while (!slurmctld_config.shutdown_time &&
 		       !pending_mail && (pending_wait_time == NO_VAL16)) {
+			if (pending_coalesce) {
+				/* Send requests held for coalescing once
+				 * their wait is over */
+				gettimeofday(&now, NULL);
+				now.tv_usec += coalesce_wait * 1000;
+				ts.tv_sec  = now.tv_sec + now.tv_usec / 1000000;
+				ts.tv_nsec = (now.tv_usec % 1000000) * 1000;
+				slurm_cond_timedwait(&pending_cond,
+						     &pending_mutex, &ts);
+				pending_coalesce = false;
+				if (pending_wait_time == NO_VAL16)
+					pending_wait_time = 999;
+				continue;
+			}
 			ts.tv_sec  = time(NULL) + 2;
+			ts.tv_nsec = 0;
 			slurm_cond_timedwait(&pending_cond, &pending_mutex,
 					     &ts);
 		}
@@ -1382,6 +1621,19 @@ static void *_agent_init(void *arg)
 
 extern void agent_init(void)
 {
+	char *tmp_ptr;
+
+	use_agent_engine = agent_engine_enabled();
+	if ((tmp_ptr = xstrcasestr(slurmctld_conf.slurmctld_params,
+				   "agent_coalesce_wait="))) {
+		coalesce_wait = atoi(tmp_ptr + 20);
+		if (coalesce_wait < 0) {
+			error("Invalid SlurmctldParameters agent_coalesce_wait=%d",
+			      coalesce_wait);
+			coalesce_wait = 0;
+		}
+	}
+
 	slurm_mutex_lock(&pending_mutex);
 	if (pending_thread_running) {
 		error("%s: thread already running", __func__);
@@ -1491,8 +1743,10 @@ pack_it:
  * This is a separate thread so the job records can be locked */
 static void _agent_retry(int min_wait, bool mail_too)
 {
-	int rc1, rc2;
+	int rc1, rc2, rc3;
+	bool coalesce_deferred = false;
 	time_t now = time(NULL);
+	struct timeval tv_now;
 	queued_request_t *queued_req_ptr = NULL;
 	agent_arg_t *agent_arg_ptr = NULL;
 	ListIterator retry_iter;
@@ -1539,6 +1793,7 @@ static void _agent_retry(int min_wait, bool mail_too)
 	}
 	slurm_mutex_unlock(&agent_cnt_mutex);
 
+	gettimeofday(&tv_now, NULL);
 	if (retry_list) {
 		/* first try to find a new (never tried) record */
 		retry_iter = list_iterator_create(retry_list);
@@ -1546,14 +1801,15 @@ static void _agent_retry(int min_wait, bool mail_too)
 				list_next(retry_iter))) {
 			rc1 = _batch_launch_defer(queued_req_ptr);
 			rc2 = _signal_defer(queued_req_ptr);
+			rc3 = _coalesce_defer(queued_req_ptr, &tv_now);
 			if (rc1 == -1 || rc2  == -1) {		/* abort request */
-				_purge_agent_args(queued_req_ptr->
-						  agent_arg_ptr);
-				xfree(queued_req_ptr);
 				list_remove(retry_iter);
+				_list_delete_retry(queued_req_ptr);
 				continue;
 			}
-			if (rc1 > 0 || rc2 > 0)
+			if (rc3 > 0)
+				coalesce_deferred = true;
+			if (rc1 > 0 || rc2 > 0 || rc3 > 0)
 				continue;
  			if (queued_req_ptr->last_attempt == 0) {
 				list_remove(retry_iter);
@@ -1561,6 +1817,8 @@ static void _agent_retry(int min_wait, bool mail_too)
 			}
 		}
 		list_iterator_destroy(retry_iter);
+		if (queued_req_ptr)
+			_coalesce_requests(queued_req_ptr, &tv_now);
 	}
 
 	if (retry_list && (queued_req_ptr == NULL)) {
@@ -1574,14 +1832,13 @@ static void _agent_retry(int min_wait, bool mail_too)
 				list_next(retry_iter))) {
 			rc1 = _batch_launch_defer(queued_req_ptr);
 			rc2 = _signal_defer(queued_req_ptr);
+			rc3 = _coalesce_defer(queued_req_ptr, &tv_now);
 			if (rc1 == -1 || rc2 == -1) { 	/* abort request */
-				_purge_agent_args(queued_req_ptr->
-						  agent_arg_ptr);
-				xfree(queued_req_ptr);
 				list_remove(retry_iter);
+				_list_delete_retry(queued_req_ptr);
 				continue;
 			}
-			if (rc1 > 0 || rc2 > 0)
+			if (rc1 > 0 || rc2 > 0 || rc3 > 0)
 				continue;
 			age = difftime(now, queued_req_ptr->last_attempt);
 			if (age > min_wait) {
@@ -1594,9 +1851,19 @@ static void _agent_retry(int min_wait, bool mail_too)
 	slurm_mutex_unlock(&retry_mutex);
 	unlock_slurmctld(job_write_lock);
 
+	if (coalesce_deferred) {
+		slurm_mutex_lock(&pending_mutex);
+		pending_coalesce = true;
+		slurm_mutex_unlock(&pending_mutex);
+	}
+
 	if (queued_req_ptr) {
 		agent_arg_ptr = queued_req_ptr->agent_arg_ptr;
+		xfree(queued_req_ptr->hosts);
 		xfree(queued_req_ptr);
+		if (agent_arg_ptr &&
+		    (agent_arg_ptr->msg_type == REQUEST_COMPOSITE))
+			_composite_auth(agent_arg_ptr->msg_args);
 		if (agent_arg_ptr) {
 			debug2("Spawning RPC agent for msg_type %s",
 			       rpc_num2string(agent_arg_ptr->msg_type));
@@ -1648,6 +1915,12 @@ void agent_queue_request(agent_arg_t *agent_arg_ptr)
 	queued_req_ptr = xmalloc(sizeof(queued_request_t));
 	queued_req_ptr->agent_arg_ptr = agent_arg_ptr;
 /*	queued_req_ptr->last_attempt  = 0; Implicit */
+	gettimeofday(&queued_req_ptr->queue_time, NULL);
+	if (_coalesce_type(agent_arg_ptr)) {
+		/* Key to find requests for the same nodes */
+		queued_req_ptr->hosts =
+			hostlist_ranged_string_xmalloc(agent_arg_ptr->hostlist);
+	}
 
 	slurm_mutex_lock(&retry_mutex);
 
@@ -1726,6 +1999,8 @@ static void _purge_agent_args(agent_arg_t *agent_arg_ptr)
 			 (agent_arg_ptr->msg_type == REQUEST_KILL_PREEMPTED) ||
 			 (agent_arg_ptr->msg_type == REQUEST_KILL_TIMELIMIT))
 			slurm_free_kill_job_msg(agent_arg_ptr->msg_args);
+		else if (agent_arg_ptr->msg_type == REQUEST_COMPOSITE)
+			slurm_free_composite_msg(agent_arg_ptr->msg_args);
 		else if (agent_arg_ptr->msg_type == SRUN_USER_MSG)
 			slurm_free_srun_user_msg(agent_arg_ptr->msg_args);
 		else if (agent_arg_ptr->msg_type == SRUN_EXEC)
@@ -2147,6 +2422,139 @@ static int _signal_defer(queued_request_t *queued_req_ptr)
 	return 1;
 }
 
+/* Return true if the request may be sent as part of a REQUEST_COMPOSITE */
+static bool _coalesce_type(agent_arg_t *agent_arg_ptr)
+{
+	if (!coalesce_wait || agent_arg_ptr->addr ||
+	    (agent_arg_ptr->protocol_version != SLURM_PROTOCOL_VERSION))
+		return false;
+
+	return ((agent_arg_ptr->msg_type == REQUEST_TERMINATE_JOB)	||
+		(agent_arg_ptr->msg_type == REQUEST_KILL_TIMELIMIT)	||
+		(agent_arg_ptr->msg_type == REQUEST_KILL_PREEMPTED));
+}
+
+static long _delta_usec(struct timeval *start, struct timeval *end)
+{
+	return ((end->tv_sec - start->tv_sec) * 1000000) +
+	       (end->tv_usec - start->tv_usec);
+}
+
+/* Test if a request should be defered for others to be coalesced with it,
+ * or because MAX_COALESCE_SEND held requests were sent in this period
+ * RET 0: execute the request now
+ *     1: defer the request
+ */
+static int _coalesce_defer(queued_request_t *queued_req_ptr,
+			   struct timeval *now)
+{
+	if (queued_req_ptr->last_attempt || !queued_req_ptr->hosts)
+		return 0;
+
+	if (_delta_usec(&queued_req_ptr->queue_time, now) <
+	    (coalesce_wait * 1000))
+		return 1;
+	if ((coalesce_sent >= MAX_COALESCE_SEND) &&
+	    (_delta_usec(&coalesce_period, now) < (coalesce_wait * 1000)))
+		return 1;
+	return 0;
+}
+
+/* Move a request's RPC into a composite message */
+static void _composite_add(composite_msg_t *comp_msg,
+			   agent_arg_t *agent_arg_ptr)
+{
+	slurm_msg_t *msg = xmalloc(sizeof(slurm_msg_t));
+
+	slurm_msg_t_init(msg);
+	msg->msg_type = agent_arg_ptr->msg_type;
+	msg->protocol_version = SLURM_PROTOCOL_VERSION;
+	msg->data = agent_arg_ptr->msg_args;
+	agent_arg_ptr->msg_args = NULL;
+	list_append(comp_msg->msg_list, msg);
+}
+
+/*
+ * Create fresh credentials for each message in a composite message. This
+ * is done before each transmission of it rather than when packing, so the
+ * agent's threads can pack it concurrently.
+ */
+static void _composite_auth(composite_msg_t *comp_msg)
+{
+	ListIterator iter;
+	slurm_msg_t *msg;
+	char *auth_info = slurm_get_auth_info();
+
+	iter = list_iterator_create(comp_msg->msg_list);
+	while ((msg = list_next(iter))) {
+		if (msg->auth_cred)
+			(void) g_slurm_auth_destroy(msg->auth_cred);
+		msg->auth_cred = g_slurm_auth_create(auth_info);
+	}
+	list_iterator_destroy(iter);
+	xfree(auth_info);
+}
+
+/*
+ * Remove from retry_list the never attempted requests of the same type and
+ * for the same nodes as queued_req_ptr and send them together with it in one
+ * REQUEST_COMPOSITE message. retry_mutex must be locked.
+ * IN/OUT queued_req_ptr - request removed from retry_list, its agent_arg_ptr
+ *	is modified in place
+ * IN now - time the request is sent
+ */
+static void _coalesce_requests(queued_request_t *queued_req_ptr,
+			       struct timeval *now)
+{
+	agent_arg_t *agent_arg_ptr = queued_req_ptr->agent_arg_ptr;
+	agent_arg_t *next_arg_ptr;
+	composite_msg_t *comp_msg = NULL;
+	ListIterator retry_iter;
+	char *hosts = queued_req_ptr->hosts;
+
+	if (queued_req_ptr->last_attempt || !hosts)
+		return;
+
+	if (_delta_usec(&coalesce_period, now) >= (coalesce_wait * 1000)) {
+		coalesce_period = *now;
+		coalesce_sent = 0;
+	}
+	coalesce_sent++;	/* and each request merged below */
+
+	retry_iter = list_iterator_create(retry_list);
+	while ((queued_req_ptr = list_next(retry_iter))) {
+		next_arg_ptr = queued_req_ptr->agent_arg_ptr;
+		if (queued_req_ptr->last_attempt || !queued_req_ptr->hosts ||
+		    (next_arg_ptr->msg_type != agent_arg_ptr->msg_type) ||
+		    (next_arg_ptr->node_count != agent_arg_ptr->node_count) ||
+		    (next_arg_ptr->retry != agent_arg_ptr->retry) ||
+		    xstrcmp(hosts, queued_req_ptr->hosts))
+			continue;
+
+		if (!comp_msg) {
+			comp_msg = xmalloc(sizeof(composite_msg_t));
+			comp_msg->msg_list =
+				list_create(slurm_free_comp_msg_list);
+			_composite_add(comp_msg, agent_arg_ptr);
+		}
+		_composite_add(comp_msg, next_arg_ptr);
+		list_remove(retry_iter);
+		_list_delete_retry(queued_req_ptr);
+		coalesce_sent++;
+		if (list_count(comp_msg->msg_list) >= MAX_COALESCE_CNT)
+			break;
+	}
+	list_iterator_destroy(retry_iter);
+
+	if (comp_msg) {
+		debug2("Coalesced %d %s RPCs to %s",
+		       list_count(comp_msg->msg_list),
+		       rpc_num2string(agent_arg_ptr->msg_type), hosts);
+		agent_arg_ptr->msg_type = REQUEST_COMPOSITE;
+		agent_arg_ptr->msg_args = comp_msg;
+	}
+}
+
 /* Return length of agent's retry_list */
 extern int retry_list_size(void)
 {
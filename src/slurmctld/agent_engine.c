@@ -0,0 +1,878 @@
+/*****************************************************************************\
+ *  agent_engine.c - event driven transmission of agent RPCs
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+/*
+ * Each agent normally creates up to AGENT_THREAD_COUNT threads, each of
+ * which blocks in slurm_send_recv_msgs() while start_msg_tree() creates
+ * another thread for every TreeWidth branch, plus a watchdog thread to
+ * interrupt them. With SlurmctldParameters=agent_engine, the connections
+ * of all agents are instead driven by a single thread from an epoll set.
+ *
+ * The behavior of the thread path is kept: the first node of each branch
+ * that has an address is sent the message, forwarding it to the rest of
+ * the branch, a refused connection is retried once a second for up to
+ * MIN(MessageTimeout, 10) seconds, and the reply is waited for as long as
+ * slurm_receive_msgs() would. If the branch head fails, or replies for
+ * only part of its branch, the nodes not heard from are sent the message
+ * individually. Up to ENGINE_MAX_CONNS connections are open at once, the
+ * rest wait in order.
+ */
+
+#include "config.h"
+
+#if HAVE_SYS_PRCTL_H
+#  include <sys/prctl.h>
+#endif
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "src/common/fd.h"
+#include "src/common/forward.h"
+#include "src/common/hostlist.h"
+#include "src/common/list.h"
+#include "src/common/log.h"
+#include "src/common/macros.h"
+#include "src/common/pack.h"
+#include "src/common/slurm_protocol_api.h"
+#include "src/common/slurm_route.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
+
+#include "src/slurmctld/agent_engine.h"
+#include "src/slurmctld/slurmctld.h"
+
+#define ENGINE_MAX_CONNS	512	/* open connections at most */
+#define MAX_EPOLL_EVENTS	64
+#define MAX_MSG_SIZE		(1024*1024*1024)
+
+typedef enum {
+	CONN_PENDING,		/* waiting for a free connection slot */
+	CONN_CONNECT,		/* non-blocking connect in progress */
+	CONN_WRITE,		/* sending the request */
+	CONN_READ		/* reading the reply */
+} conn_state_t;
+
+/* One agent_engine_send() request */
+typedef struct engine_req {
+	slurm_msg_type_t msg_type;
+	void *msg_args;
+	uint16_t protocol_version;
+	char *nodelist;
+	bool use_addr;
+	slurm_addr_t addr;
+	bool get_reply;
+	agent_engine_cb_t callback;
+	void *cb_arg;
+	int conn_cnt;		/* connections not yet finished */
+	List ret_list;		/* ret_data_info_t if get_reply */
+	int rc;			/* result if !get_reply */
+	int msg_timeout_ms;	/* configuration when the request started */
+	int tcp_timeout_ms;
+	int conn_retry_max;
+	uint16_t tree_width;
+} engine_req_t;
+
+/* One connection, to the head of a branch of the request's nodes */
+typedef struct engine_conn {
+	engine_req_t *req;
+	conn_state_t state;
+	hostlist_t hl;		/* nodes not yet sent to directly */
+	char *name;		/* node connected to */
+	int fwd_cnt;		/* count of nodes it forwards to */
+	slurm_addr_t addr;
+	int fd;
+	int refused_cnt;	/* connection attempts refused */
+	int64_t start_ms;	/* when to retry a refused connection */
+	int64_t deadline_ms;	/* when the current state times out */
+	int timeout_ms;		/* time allowed for the reply */
+	Buf out;		/* packed request, less its length */
+	uint32_t out_len;	/* message length, network order */
+	size_t out_sent;	/* bytes of out_len and out sent */
+	uint32_t msg_len;	/* reply length, host order once read */
+	uint32_t hdr_read;	/* bytes of msg_len read so far */
+	char *data;		/* reply body */
+	uint32_t data_read;	/* bytes of body read so far */
+	struct engine_conn *next;	/* list of open connections */
+	struct engine_conn *prev;
+} engine_conn_t;
+
+static pthread_mutex_t engine_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t engine_thread = 0;
+static bool engine_shutdown = false;
+static List submit_list = NULL;		/* engine_req_t, new requests */
+static int wake_fd[2] = { -1, -1 };
+
+/* Only used by the engine thread */
+static engine_conn_t *open_conns = NULL;
+static int open_cnt = 0;
+static List pend_list = NULL;		/* engine_conn_t ready to start */
+static List retry_list = NULL;		/* engine_conn_t refused earlier */
+
+static int64_t _now_ms(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((int64_t) ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+static void _link_conn(engine_conn_t *conn)
+{
+	conn->prev = NULL;
+	conn->next = open_conns;
+	if (open_conns)
+		open_conns->prev = conn;
+	open_conns = conn;
+	open_cnt++;
+}
+
+static void _unlink_conn(engine_conn_t *conn)
+{
+	if (conn->prev)
+		conn->prev->next = conn->next;
+	else
+		open_conns = conn->next;
+	if (conn->next)
+		conn->next->prev = conn->prev;
+	conn->next = conn->prev = NULL;
+	open_cnt--;
+}
+
+static void _req_complete(engine_req_t *req)
+{
+	(req->callback)(req->ret_list, req->rc, req->cb_arg);
+	xfree(req->nodelist);
+	xfree(req);
+}
+
+/* Fail a request which was never started */
+static void _req_fail(engine_req_t *req, int err)
+{
+	hostlist_t hl;
+	char *name;
+
+	if (req->get_reply) {
+		if ((hl = hostlist_create(req->nodelist))) {
+			while ((name = hostlist_shift(hl))) {
+				mark_as_failed_forward(&req->ret_list, name,
+						       err);
+				free(name);
+			}
+			hostlist_destroy(hl);
+		}
+	} else {
+		req->rc = err;
+	}
+	_req_complete(req);
+}
+
+static engine_conn_t *_conn_create(engine_req_t *req, hostlist_t hl)
+{
+	engine_conn_t *conn = xmalloc(sizeof(engine_conn_t));
+
+	conn->req = req;
+	conn->state = CONN_PENDING;
+	conn->hl = hl;
+	conn->fd = -1;
+	req->conn_cnt++;
+
+	return conn;
+}
+
+/* Release a connection which is not (or no longer) open */
+static void _conn_free(engine_conn_t *conn)
+{
+	engine_req_t *req = conn->req;
+
+	if (conn->hl)
+		hostlist_destroy(conn->hl);
+	xfree(conn->name);
+	FREE_NULL_BUFFER(conn->out);
+	xfree(conn->data);
+	xfree(conn);
+
+	if (--req->conn_cnt == 0)
+		_req_complete(req);
+}
+
+static void _conn_close(int epfd, engine_conn_t *conn)
+{
+	if (conn->fd < 0)
+		return;
+	(void) epoll_ctl(epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+	(void) close(conn->fd);
+	conn->fd = -1;
+	_unlink_conn(conn);
+}
+
+/* Send the message individually to each node left in the connection's
+ * hostlist, as _fwd_tree_thread() does when abandoning a tree */
+static void _conn_split(engine_conn_t *conn)
+{
+	char *name;
+
+	while ((name = hostlist_shift(conn->hl))) {
+		list_append(pend_list,
+			    _conn_create(conn->req, hostlist_create(name)));
+		free(name);
+	}
+}
+
+/* Record the failure of a connection to its head node and fall back to
+ * sending to the rest of its branch directly */
+static void _conn_failed(int epfd, engine_conn_t *conn, int err)
+{
+	engine_req_t *req = conn->req;
+
+	_conn_close(epfd, conn);
+	if (req->get_reply) {
+		mark_as_failed_forward(&req->ret_list, conn->name, err);
+		_conn_split(conn);
+	} else {
+		req->rc = err;
+	}
+	_conn_free(conn);
+}
+
+/*
+ * Pick the first node of the connection's hostlist with an address and
+ * pack the message for it, forwarding to the rest of the hostlist.
+ * RET SLURM_SUCCESS or SLURM_ERROR if the connection was dealt with
+ */
+static int _conn_pack(engine_conn_t *conn)
+{
+	engine_req_t *req = conn->req;
+	slurm_msg_t msg;
+	char *name;
+	int err, steps;
+
+	while ((name = hostlist_shift(conn->hl))) {
+		if (req->use_addr) {
+			memcpy(&conn->addr, &req->addr, sizeof(slurm_addr_t));
+			break;
+		}
+		if (slurm_conf_get_addr(name, &conn->addr) != SLURM_ERROR)
+			break;
+		error("%s: can't find address for host %s, check slurm.conf",
+		      __func__, name);
+		if (req->get_reply) {
+			mark_as_failed_forward(&req->ret_list, name,
+					       SLURM_UNKNOWN_FORWARD_ADDR);
+		} else
+			req->rc = SLURM_UNKNOWN_FORWARD_ADDR;
+		free(name);
+	}
+	if (!name) {
+		_conn_free(conn);
+		return SLURM_ERROR;
+	}
+	conn->name = xstrdup(name);
+	free(name);
+
+	slurm_msg_t_init(&msg);
+	msg.msg_type = req->msg_type;
+	msg.data = req->msg_args;
+	if (req->protocol_version)
+		msg.protocol_version = req->protocol_version;
+	msg.forward.tree_width = req->tree_width;
+
+	conn->timeout_ms = req->msg_timeout_ms;
+	if (req->get_reply) {
+		msg.forward.timeout = req->msg_timeout_ms;
+		conn->fwd_cnt = hostlist_count(conn->hl);
+		if (conn->fwd_cnt) {
+			msg.forward.cnt = conn->fwd_cnt;
+			msg.forward.nodelist =
+				hostlist_ranged_string_xmalloc(conn->hl);
+			debug3("%s: sending %s to %s along with %s", __func__,
+			       rpc_num2string(req->msg_type), conn->name,
+			       msg.forward.nodelist);
+
+			/* As _send_and_recv_msgs(), let the children time
+			 * out before the branch head does */
+			steps = (conn->fwd_cnt + 1) / req->tree_width;
+			conn->timeout_ms = req->msg_timeout_ms * steps;
+			steps++;
+			conn->timeout_ms += msg.forward.timeout * steps;
+		}
+	}
+
+	conn->out = slurm_pack_node_msg(&msg);
+	err = errno;
+	xfree(msg.forward.nodelist);
+	if (!conn->out) {
+		_conn_failed(-1, conn, err);
+		return SLURM_ERROR;
+	}
+	conn->out_len = htonl(get_buf_offset(conn->out));
+
+	return SLURM_SUCCESS;
+}
+
+/* A refused connection is retried while the node's slurmd restarts, as
+ * slurm_send_addr_recv_msgs() does */
+static void _conn_refused(int epfd, engine_conn_t *conn, int err)
+{
+	if (!conn->req->get_reply) {
+		_conn_failed(epfd, conn, err);
+		return;
+	}
+	if ((err != ECONNREFUSED) ||
+	    (conn->refused_cnt >= conn->req->conn_retry_max)) {
+		_conn_failed(epfd, conn, SLURM_COMMUNICATIONS_CONNECTION_ERROR);
+		return;
+	}
+	if (conn->refused_cnt++ == 0)
+		debug3("%s: connect to %s refused, retrying",
+		       __func__, conn->name);
+	_conn_close(epfd, conn);
+	conn->state = CONN_PENDING;
+	conn->start_ms = _now_ms() + 1000;
+	list_append(retry_list, conn);
+}
+
+static void _conn_start(int epfd, engine_conn_t *conn)
+{
+	struct epoll_event ev;
+	int fd;
+
+	if (!conn->out && (_conn_pack(conn) != SLURM_SUCCESS))
+		return;
+
+	conn->out_sent = 0;
+	if ((fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+			 IPPROTO_TCP)) < 0) {
+		error("%s: socket: %m", __func__);
+		_conn_failed(epfd, conn, errno);
+		return;
+	}
+	conn->fd = fd;
+	_link_conn(conn);
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLOUT;
+	ev.data.ptr = conn;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		error("%s: epoll_ctl(ADD, %d): %m", __func__, fd);
+		_conn_failed(epfd, conn, errno);
+		return;
+	}
+
+	if (connect(fd, (struct sockaddr *) &conn->addr,
+		    sizeof(conn->addr)) == 0) {
+		conn->state = CONN_WRITE;
+		conn->deadline_ms = _now_ms() + conn->timeout_ms;
+	} else if (errno == EINPROGRESS) {
+		conn->state = CONN_CONNECT;
+		conn->deadline_ms = _now_ms() + conn->req->tcp_timeout_ms;
+	} else {
+		_conn_refused(epfd, conn, errno);
+	}
+}
+
+/*
+ * Write whatever the socket accepts without blocking.
+ * RET 1 if the message is sent, 0 if more remains, -1 on error
+ */
+static int _write_conn(engine_conn_t *conn)
+{
+	size_t hdr_len = sizeof(conn->out_len);
+	size_t total = hdr_len + get_buf_offset(conn->out);
+	struct iovec iov[2];
+	ssize_t len;
+	int cnt;
+
+	while (conn->out_sent < total) {
+		cnt = 0;
+		if (conn->out_sent < hdr_len) {
+			iov[cnt].iov_base = ((char *) &conn->out_len) +
+					    conn->out_sent;
+			iov[cnt].iov_len = hdr_len - conn->out_sent;
+			cnt++;
+			iov[cnt].iov_base = get_buf_data(conn->out);
+			iov[cnt].iov_len = get_buf_offset(conn->out);
+			cnt++;
+		} else {
+			iov[cnt].iov_base = get_buf_data(conn->out) +
+					    (conn->out_sent - hdr_len);
+			iov[cnt].iov_len = total - conn->out_sent;
+			cnt++;
+		}
+		len = writev(conn->fd, iov, cnt);
+		if (len >= 0) {
+			conn->out_sent += len;
+			continue;
+		}
+		if (errno == EINTR)
+			continue;
+		if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+			return 0;
+		return -1;
+	}
+	return 1;
+}
+
+/*
+ * Read whatever is available on a connection without blocking.
+ * RET 1 if the message is complete, 0 if more data is needed,
+ *     -1 on error or end of file
+ */
+static int _read_conn(engine_conn_t *conn)
+{
+	ssize_t len;
+
+	while (conn->hdr_read < sizeof(conn->msg_len)) {
+		len = read(conn->fd, ((char *) &conn->msg_len) + conn->hdr_read,
+			   sizeof(conn->msg_len) - conn->hdr_read);
+		if (len > 0) {
+			conn->hdr_read += len;
+			continue;
+		}
+		if ((len < 0) && (errno == EINTR))
+			continue;
+		if ((len < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+			return 0;
+		if (len == 0)
+			errno = SLURM_PROTOCOL_SOCKET_ZERO_BYTES_SENT;
+		return -1;
+	}
+	if (!conn->data) {
+		conn->msg_len = ntohl(conn->msg_len);
+		if (conn->msg_len > MAX_MSG_SIZE) {
+			error("%s: Insane message length %u from %s",
+			      __func__, conn->msg_len, conn->name);
+			errno = SLURM_PROTOCOL_INSANE_MSG_LENGTH;
+			return -1;
+		}
+		conn->data = xmalloc_nz(conn->msg_len ? conn->msg_len : 1);
+	}
+	while (conn->data_read < conn->msg_len) {
+		len = read(conn->fd, conn->data + conn->data_read,
+			   conn->msg_len - conn->data_read);
+		if (len > 0) {
+			conn->data_read += len;
+			continue;
+		}
+		if ((len < 0) && (errno == EINTR))
+			continue;
+		if ((len < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+			return 0;
+		if (len == 0)
+			errno = SLURM_PROTOCOL_SOCKET_ZERO_BYTES_SENT;
+		return -1;
+	}
+	return 1;
+}
+
+/* Merge a branch head's reply into the request, as _fwd_tree_thread() */
+static void _conn_replied(int epfd, engine_conn_t *conn, List ret_list)
+{
+	engine_req_t *req = conn->req;
+	ret_data_info_t *ret_data_info;
+	ListIterator itr;
+	int ret_cnt;
+
+	_conn_close(epfd, conn);
+
+	itr = list_iterator_create(ret_list);
+	while ((ret_data_info = list_next(itr))) {
+		if (!ret_data_info->node_name)
+			ret_data_info->node_name = xstrdup(conn->name);
+	}
+	list_iterator_destroy(itr);
+
+	ret_cnt = list_count(ret_list);
+	if (ret_cnt <= conn->fwd_cnt) {
+		error("%s: %s failed to forward the message, expecting %d ret got only %d",
+		      __func__, conn->name, conn->fwd_cnt + 1, ret_cnt);
+		itr = list_iterator_create(ret_list);
+		while ((ret_data_info = list_next(itr)))
+			hostlist_delete_host(conn->hl,
+					     ret_data_info->node_name);
+		list_iterator_destroy(itr);
+		_conn_split(conn);
+	}
+
+	if (!req->ret_list)
+		req->ret_list = list_create(destroy_data_info);
+	list_transfer(req->ret_list, ret_list);
+	FREE_NULL_LIST(ret_list);
+	_conn_free(conn);
+}
+
+static void _conn_event(int epfd, engine_conn_t *conn)
+{
+	struct epoll_event ev;
+	socklen_t len;
+	List ret_list;
+	Buf buffer;
+	int err = 0, rc;
+
+	switch (conn->state) {
+	case CONN_CONNECT:
+		len = sizeof(err);
+		if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+			err = errno;
+		if (err) {
+			_conn_refused(epfd, conn, err);
+			return;
+		}
+		conn->state = CONN_WRITE;
+		conn->deadline_ms = _now_ms() + conn->timeout_ms;
+		/* fall through */
+	case CONN_WRITE:
+		if ((rc = _write_conn(conn)) < 0) {
+			err = errno;
+			debug2("%s: write to %s: %m", __func__, conn->name);
+			_conn_failed(epfd, conn, err);
+			return;
+		} else if (rc == 0)
+			return;
+		FREE_NULL_BUFFER(conn->out);
+		if (!conn->req->get_reply) {
+			_conn_close(epfd, conn);
+			_conn_free(conn);
+			return;
+		}
+		conn->state = CONN_READ;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.ptr = conn;
+		if (epoll_ctl(epfd, EPOLL_CTL_MOD, conn->fd, &ev) < 0) {
+			err = errno;
+			error("%s: epoll_ctl(MOD, %d): %m", __func__, conn->fd);
+			_conn_failed(epfd, conn, err);
+		}
+		return;
+	case CONN_READ:
+		if ((rc = _read_conn(conn)) < 0) {
+			err = errno;
+			debug2("%s: read from %s: %m", __func__, conn->name);
+			_conn_failed(epfd, conn, err);
+			return;
+		} else if (rc == 0)
+			return;
+		buffer = create_buf(conn->data, conn->msg_len);
+		conn->data = NULL;
+		ret_list = slurm_unpack_received_msgs(conn->fd, buffer);
+		err = errno;
+		if (!ret_list) {
+			error("%s: %s: %s", __func__, conn->name,
+			      slurm_strerror(err));
+			_conn_failed(epfd, conn, err);
+		} else
+			_conn_replied(epfd, conn, ret_list);
+		return;
+	case CONN_PENDING:
+		break;
+	}
+}
+
+static void _check_timeouts(int epfd, int64_t now)
+{
+	engine_conn_t *conn, *next;
+
+	for (conn = open_conns; conn; conn = next) {
+		next = conn->next;
+		if (conn->deadline_ms > now)
+			continue;
+		if (conn->state == CONN_CONNECT) {
+			debug2("%s: connect to %s timed out",
+			       __func__, conn->name);
+			_conn_refused(epfd, conn, ETIMEDOUT);
+		} else {
+			debug2("%s: %s to %s timed out", __func__,
+			       (conn->state == CONN_WRITE) ? "write" : "reply",
+			       conn->name);
+			_conn_failed(epfd, conn,
+				     SLURM_PROTOCOL_SOCKET_IMPL_TIMEOUT);
+		}
+	}
+}
+
+/* Return how long epoll_wait() may block, in milliseconds */
+static int _next_timeout(int64_t now)
+{
+	engine_conn_t *conn;
+	ListIterator itr;
+	int64_t next = now + 1000;
+
+	if (list_count(pend_list) && (open_cnt < ENGINE_MAX_CONNS))
+		return 0;
+	for (conn = open_conns; conn; conn = conn->next)
+		next = MIN(next, conn->deadline_ms);
+	itr = list_iterator_create(retry_list);
+	while ((conn = list_next(itr)))
+		next = MIN(next, conn->start_ms);
+	list_iterator_destroy(itr);
+
+	return (next > now) ? (int) (next - now) : 0;
+}
+
+static void _start_conns(int epfd, int64_t now)
+{
+	engine_conn_t *conn;
+	ListIterator itr;
+
+	itr = list_iterator_create(retry_list);
+	while ((conn = list_next(itr))) {
+		if (conn->start_ms > now)
+			continue;
+		list_remove(itr);
+		list_append(pend_list, conn);
+	}
+	list_iterator_destroy(itr);
+
+	while ((open_cnt < ENGINE_MAX_CONNS) &&
+	       (conn = list_dequeue(pend_list)))
+		_conn_start(epfd, conn);
+}
+
+static void _req_start(engine_req_t *req)
+{
+	hostlist_t hl, *sp_hl = NULL;
+	int i, hl_count = 0;
+
+	if (!(hl = hostlist_create(req->nodelist))) {
+		error("%s: invalid hostlist %s", __func__, req->nodelist);
+		req->rc = SLURM_ERROR;
+		_req_complete(req);
+		return;
+	}
+	hostlist_uniq(hl);
+
+	/* Pick up configuration changes */
+	req->msg_timeout_ms = slurm_get_msg_timeout() * 1000;
+	req->tcp_timeout_ms = slurm_get_tcp_timeout() * 1000;
+	req->conn_retry_max = MIN(slurm_get_msg_timeout(), 10);
+	if (!(req->tree_width = slurm_get_tree_width()))
+		req->tree_width = 1;
+
+	/* Count a connection for the request itself so that it can not
+	 * complete before all its branches are queued */
+	req->conn_cnt++;
+	if (req->get_reply && !req->use_addr) {
+		if (route_g_split_hostlist(hl, &sp_hl, &hl_count,
+					   req->tree_width)) {
+			error("%s: unable to split forward hostlist",
+			      __func__);
+			hl_count = 0;
+		}
+		for (i = 0; i < hl_count; i++)
+			list_append(pend_list, _conn_create(req, sp_hl[i]));
+		xfree(sp_hl);
+		hostlist_destroy(hl);
+	} else {
+		list_append(pend_list, _conn_create(req, hl));
+	}
+	if (--req->conn_cnt == 0)
+		_req_complete(req);
+}
+
+static void _drain_wake_fd(void)
+{
+	char buf[64];
+
+	while (read(wake_fd[0], buf, sizeof(buf)) > 0)
+		;
+}
+
+static void *_engine_thread(void *arg)
+{
+	struct epoll_event events[MAX_EPOLL_EVENTS], ev;
+	engine_conn_t *conn;
+	engine_req_t *req;
+	List new_reqs = list_create(NULL);
+	int64_t now;
+	int epfd, i, n;
+	bool fini = false;
+
+#if HAVE_SYS_PRCTL_H
+	if (prctl(PR_SET_NAME, "agent_engine", NULL, NULL, NULL) < 0) {
+		error("%s: cannot set my name to %s %m",
+		      __func__, "agent_engine");
+	}
+#endif
+
+	if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+		fatal("%s: epoll_create1: %m", __func__);
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, wake_fd[0], &ev) < 0)
+		fatal("%s: epoll_ctl(ADD, %d): %m", __func__, wake_fd[0]);
+
+	pend_list = list_create(NULL);
+	retry_list = list_create(NULL);
+
+	while (!fini) {
+		n = epoll_wait(epfd, events, MAX_EPOLL_EVENTS,
+			       _next_timeout(_now_ms()));
+		if ((n < 0) && (errno != EINTR))
+			error("%s: epoll_wait: %m", __func__);
+		for (i = 0; i < n; i++) {
+			if (!(conn = events[i].data.ptr)) {
+				_drain_wake_fd();
+				continue;
+			}
+			_conn_event(epfd, conn);
+		}
+
+		slurm_mutex_lock(&engine_mutex);
+		list_transfer(new_reqs, submit_list);
+		fini = engine_shutdown;
+		slurm_mutex_unlock(&engine_mutex);
+		while ((req = list_dequeue(new_reqs)))
+			_req_start(req);
+
+		now = _now_ms();
+		_check_timeouts(epfd, now);
+		if (!fini)
+			_start_conns(epfd, now);
+	}
+
+	/*
+	 * Fail whatever is left, this may queue more connections. No request
+	 * is submitted once engine_shutdown is set.
+	 */
+	slurm_mutex_lock(&engine_mutex);
+	list_transfer(new_reqs, submit_list);
+	slurm_mutex_unlock(&engine_mutex);
+	while ((req = list_dequeue(new_reqs)))
+		_req_fail(req, SLURM_COMMUNICATIONS_CONNECTION_ERROR);
+	while (open_conns || list_count(pend_list) || list_count(retry_list)) {
+		while ((conn = open_conns))
+			_conn_failed(epfd, conn,
+				     SLURM_COMMUNICATIONS_CONNECTION_ERROR);
+		list_transfer(pend_list, retry_list);
+		while ((conn = list_dequeue(pend_list))) {
+			if (!conn->out &&
+			    (_conn_pack(conn) != SLURM_SUCCESS))
+				continue;
+			_conn_failed(epfd, conn,
+				     SLURM_COMMUNICATIONS_CONNECTION_ERROR);
+		}
+	}
+	FREE_NULL_LIST(pend_list);
+	FREE_NULL_LIST(retry_list);
+	FREE_NULL_LIST(new_reqs);
+	(void) close(epfd);
+
+	return NULL;
+}
+
+extern bool agent_engine_enabled(void)
+{
+	if (xstrcasestr(slurmctld_conf.slurmctld_params, "agent_engine"))
+		return true;
+	return false;
+}
+
+extern void agent_engine_send(slurm_msg_type_t msg_type, void *msg_args,
+			      uint16_t protocol_version, const char *nodelist,
+			      slurm_addr_t *addr, bool get_reply,
+			      agent_engine_cb_t callback, void *cb_arg)
+{
+	engine_req_t *req = xmalloc(sizeof(engine_req_t));
+	char c = 0;
+
+	req->msg_type = msg_type;
+	req->msg_args = msg_args;
+	req->protocol_version = protocol_version;
+	req->nodelist = xstrdup(nodelist);
+	if (addr) {
+		req->use_addr = true;
+		memcpy(&req->addr, addr, sizeof(slurm_addr_t));
+	}
+	req->get_reply = get_reply;
+	req->callback = callback;
+	req->cb_arg = cb_arg;
+	req->rc = SLURM_SUCCESS;
+
+	slurm_mutex_lock(&engine_mutex);
+	if (engine_shutdown) {
+		slurm_mutex_unlock(&engine_mutex);
+		_req_fail(req, SLURM_COMMUNICATIONS_CONNECTION_ERROR);
+		return;
+	}
+	if (!engine_thread) {
+		if (pipe(wake_fd) < 0)
+			fatal("%s: pipe: %m", __func__);
+		fd_set_nonblocking(wake_fd[0]);
+		fd_set_nonblocking(wake_fd[1]);
+		fd_set_close_on_exec(wake_fd[0]);
+		fd_set_close_on_exec(wake_fd[1]);
+		submit_list = list_create(NULL);
+		slurm_thread_create(&engine_thread, _engine_thread, NULL);
+	}
+	list_append(submit_list, req);
+	if ((write(wake_fd[1], &c, 1) < 0) && (errno != EAGAIN))
+		error("%s: write: %m", __func__);
+	slurm_mutex_unlock(&engine_mutex);
+}
+
+extern void agent_engine_fini(void)
+{
+	char c = 0;
+
+	slurm_mutex_lock(&engine_mutex);
+	engine_shutdown = true;		/* reject later requests */
+	if (!engine_thread) {
+		slurm_mutex_unlock(&engine_mutex);
+		return;
+	}
+	if ((write(wake_fd[1], &c, 1) < 0) && (errno != EAGAIN))
+		error("%s: write: %m", __func__);
+	slurm_mutex_unlock(&engine_mutex);
+
+	pthread_join(engine_thread, NULL);
+
+	slurm_mutex_lock(&engine_mutex);
+	engine_thread = 0;
+	FREE_NULL_LIST(submit_list);
+	(void) close(wake_fd[0]);
+	(void) close(wake_fd[1]);
+	wake_fd[0] = wake_fd[1] = -1;
+	slurm_mutex_unlock(&engine_mutex);
+}
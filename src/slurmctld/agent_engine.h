@@ -0,0 +1,89 @@
+/*****************************************************************************\
+ *  agent_engine.h - event driven transmission of agent RPCs
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#ifndef _HAVE_AGENT_ENGINE_H
+#define _HAVE_AGENT_ENGINE_H
+
+#include <stdbool.h>
+
+#include "src/common/list.h"
+#include "src/common/slurm_protocol_defs.h"
+
+/*
+ * Called once all nodes of an agent_engine_send() request have been dealt
+ * with. Runs in the engine thread, so it must not block or take slurmctld
+ * locks; once agent_engine_fini() has been called it runs in the caller of
+ * agent_engine_send() instead.
+ * IN ret_list - if a reply was requested, ret_data_info_t records for each
+ *	node, as from slurm_send_recv_msgs(), otherwise NULL. Ownership
+ *	passes to the callback.
+ * IN rc - if no reply was requested, SLURM_SUCCESS or the error sending
+ *	the message
+ * IN arg - cb_arg of agent_engine_send()
+ */
+typedef void (*agent_engine_cb_t) (List ret_list, int rc, void *arg);
+
+/*
+ * Return true if the "agent_engine" option of SlurmctldParameters is set,
+ * so agents issue their RPCs through agent_engine_send() rather than
+ * creating threads for them.
+ */
+extern bool agent_engine_enabled(void);
+
+/*
+ * Issue an RPC from the engine thread, which multiplexes the connections
+ * of all outstanding requests over non-blocking sockets.
+ * IN msg_type, msg_args, protocol_version - RPC to be issued, msg_args must
+ *	remain valid until the callback
+ * IN nodelist - nodes to send to. With get_reply, the message is fanned out
+ *	over TreeWidth and forwarded by slurmd like slurm_send_recv_msgs().
+ *	Without, this must name a single node.
+ * IN addr - if set, send to this address rather than resolving nodelist,
+ *	which must then name a single node
+ * IN get_reply - wait for a reply from each node
+ * IN callback, cb_arg - completion notification
+ */
+extern void agent_engine_send(slurm_msg_type_t msg_type, void *msg_args,
+			      uint16_t protocol_version, const char *nodelist,
+			      slurm_addr_t *addr, bool get_reply,
+			      agent_engine_cb_t callback, void *cb_arg);
+
+/*
+ * Fail any outstanding requests and stop the engine thread. Requests sent
+ * afterwards fail immediately.
+ */
+extern void agent_engine_fini(void);
+
+#endif	/* !_HAVE_AGENT_ENGINE_H */
@@ -64,6 +64,7 @@
 #include "src/slurmctld/locks.h"
 #include "src/slurmctld/read_config.h"
 #include "src/slurmctld/slurmctld.h"
+#include "src/slurmctld/state_repl.h"
 #include "src/slurmctld/trigger_mgr.h"
 
 #define _DEBUG		0
@@ -125,6 +126,7 @@ void run_backup(slurm_trigger_callbacks_t *callbacks)
 {
 	int error_code, i;
 	time_t last_ping = 0;
+	bool repl_silent;
 	slurmctld_lock_t config_read_lock = {
 		READ_LOCK, NO_LOCK, NO_LOCK, NO_LOCK, NO_LOCK };
 	slurmctld_lock_t config_write_lock = {
@@ -164,6 +166,11 @@ void run_backup(slurm_trigger_callbacks_t *callbacks)
 
 	slurm_thread_create_detached(NULL, _trigger_slurmctld_event, NULL);
 
+	/*
+	 * create attached thread replicating the state of the primary
+	 */
+	state_repl_client_start();
+
 	for (i = 0; ((i < 5) && (slurmctld_config.shutdown_time == 0)); i++) {
 		sleep(1);       /* Give the primary slurmctld set-up time */
 	}
@@ -172,9 +179,10 @@ void run_backup(slurm_trigger_callbacks_t *callbacks)
 	ctld_ping = xmalloc(sizeof(ctld_ping_t) * slurmctld_conf.control_cnt);
 	while (slurmctld_config.shutdown_time == 0) {
 		sleep(1);
+		repl_silent = state_repl_client_silent();
 		/* Lock of slurmctld_conf below not important */
 		if (slurmctld_conf.slurmctld_timeout &&
-		    (takeover == false) &&
+		    (takeover == false) && (repl_silent == false) &&
 		    ((time(NULL) - last_ping) <
 		     (slurmctld_conf.slurmctld_timeout / 3)))
 			continue;
@@ -188,6 +196,14 @@ void run_backup(slurm_trigger_callbacks_t *callbacks)
 			 * primary no longer respond
 			 */
 			break;
+		} else if (repl_silent) {
+			/*
+			 * the primary sent nothing over the state
+			 * replication stream, not even keepalives, could not
+			 * be reconnected and no longer responds, it died,
+			 * no need to wait for SlurmctldTimeout
+			 */
+			break;
 		} else {
 			time_t use_time, last_heartbeat;
 			int server_inx = -1;
@@ -227,6 +243,7 @@ void run_backup(slurm_trigger_callbacks_t *callbacks)
 			verbose("Unable to remove pidfile '%s': %m",
 				slurmctld_conf.slurmctld_pidfile);
 
+		state_repl_client_fini();
 		info("BackupController terminating");
 		pthread_join(slurmctld_config.thread_id_sig, NULL);
 		log_fini();
@@ -248,6 +265,7 @@ void run_backup(slurm_trigger_callbacks_t *callbacks)
 	pthread_kill(slurmctld_config.thread_id_sig, SIGTERM);
 	pthread_join(slurmctld_config.thread_id_sig, NULL);
 	pthread_join(slurmctld_config.thread_id_rpc, NULL);
+	state_repl_client_stop();
 
 	/*
 	 * The job list needs to be freed before we run
@@ -270,6 +288,7 @@ void run_backup(slurm_trigger_callbacks_t *callbacks)
 		error("Unable to recover slurm state");
 		abort();
 	}
+	state_repl_client_fini();
 	slurmctld_config.shutdown_time = (time_t) 0;
 	unlock_slurmctld(config_write_lock);
 	select_g_select_nodeinfo_set_all();
@@ -493,6 +512,10 @@ static int _background_process_msg(slurm_msg_t *msg)
 		} else if (msg->msg_type == REQUEST_CONTROL_STATUS) {
 			_slurm_rpc_control_status(msg);
 			send_rc = false;
+		} else if (msg->msg_type == REQUEST_STATE_REPL) {
+			/* Another backup looking for the primary */
+			debug3("Ignoring RPC: REQUEST_STATE_REPL");
+			error_code = ESLURM_IN_STANDBY_MODE;
 		} else {
 			error("Invalid RPC received %d while in standby mode",
 			      msg->msg_type);
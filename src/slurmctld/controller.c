@@ -93,7 +93,9 @@
 
 #include "src/slurmctld/acct_policy.h"
 #include "src/slurmctld/agent.h"
+#include "src/slurmctld/agent_engine.h"
 #include "src/slurmctld/burst_buffer.h"
+#include "src/slurmctld/event_mgr.h"
 #include "src/slurmctld/fed_mgr.h"
 #include "src/slurmctld/front_end.h"
 #include "src/slurmctld/gang.h"
@@ -110,10 +112,16 @@
 #include "src/slurmctld/proc_req.h"
 #include "src/slurmctld/read_config.h"
 #include "src/slurmctld/reservation.h"
+#include "src/slurmctld/response_cache.h"
+#include "src/slurmctld/rpc_engine.h"
 #include "src/slurmctld/sched_plugin.h"
+#include "src/slurmctld/sched_shard.h"
+#include "src/slurmctld/script_store.h"
 #include "src/slurmctld/slurmctld.h"
 #include "src/slurmctld/slurmctld_plugstack.h"
+#include "src/slurmctld/snapshot.h"
 #include "src/slurmctld/srun_comm.h"
+#include "src/slurmctld/state_repl.h"
 #include "src/slurmctld/state_save.h"
 #include "src/slurmctld/trigger_mgr.h"
 
@@ -756,6 +764,22 @@ int main(int argc, char **argv)
 		slurm_thread_create(&slurmctld_config.thread_id_save,
 				    slurmctld_state_save, NULL);
 
+		/*
+		 * create attached thread for publishing state snapshots
+		 */
+		snapshot_start();
+		response_cache_config();
+
+		/*
+		 * create attached thread for event subscribers
+		 */
+		event_mgr_start();
+
+		/*
+		 * create attached thread for state replication to backups
+		 */
+		state_repl_start();
+
 		/*
 		 * create attached thread for node power management
   		 */
@@ -782,6 +806,10 @@ int main(int argc, char **argv)
 		pthread_join(slurmctld_config.thread_id_sig,  NULL);
 		pthread_join(slurmctld_config.thread_id_rpc,  NULL);
 		pthread_join(slurmctld_config.thread_id_save, NULL);
+		event_mgr_stop();
+		state_repl_stop();
+		snapshot_stop();
+		response_cache_fini();
 		slurmctld_config.thread_id_purge_files = (pthread_t) 0;
 		slurmctld_config.thread_id_sig  = (pthread_t) 0;
 		slurmctld_config.thread_id_rpc  = (pthread_t) 0;
@@ -853,8 +881,10 @@ int main(int argc, char **argv)
 	}
 	if (cnt)
 		error("Left %d agent threads active", cnt);
+	agent_engine_fini();
 
 	slurm_sched_fini();	/* Stop all scheduling */
+	sched_shard_fini();
 
 	/* Purge our local data structures */
 	job_fini();
@@ -1100,7 +1130,8 @@ static void _sig_handler(int signal)
 }
 
 /*
- * _slurmctld_rpc_mgr - Read incoming RPCs and create pthread for each
+ * _slurmctld_rpc_mgr - Read incoming RPCs and create pthread for each,
+ *	or hand them to the RPC engine's worker pool if so configured
  */
 static void *_slurmctld_rpc_mgr(void *no_data)
 {
@@ -1175,6 +1206,11 @@ static void *_slurmctld_rpc_mgr(void *no_data)
 	xsignal(SIGUSR1, _sig_handler);
 	xsignal_unblock(sigarray);
 
+	if (rpc_engine_workers() > 0) {
+		rpc_engine_run(sockfd, nports);
+		goto fini;
+	}
+
 	/*
 	 * Process incoming RPCs until told to shutdown
 	 */
@@ -1235,6 +1271,7 @@ static void *_slurmctld_rpc_mgr(void *no_data)
 		}
 	}
 
+fini:
 	debug3("_slurmctld_rpc_mgr shutting down");
 	for (i = 0; i < nports; i++)
 		(void) slurm_shutdown_msg_engine(sockfd[i]);
@@ -2246,6 +2283,10 @@ static void *_slurmctld_background(void *no_data)
 			assoc_mgr_set_missing_uids();
 		}
 
+		/* Has own locking, writes only every lock_stats_interval */
+		lock_stats_save(now);
+		sample_stats_history(now);
+
 		END_TIMER2("_slurmctld_background");
 	}
 
@@ -3428,7 +3469,8 @@ static void  _set_work_dir(void)
  * problems under high throughput conditions.
  *
  * Uses the purge_cond to wakeup on demand, then works through the global
- * purge_files_list of job_ids and removes their files.
+ * purge_files_list of job_ids and removes their files. Script store data
+ * no longer used by any job is released at the same time.
  */
 static void *_purge_files_thread(void *no_data)
 {
@@ -3453,6 +3495,9 @@ static void *_purge_files_thread(void *no_data)
 	 * pthread_cond_signal isn't required to have the lock. So
 	 * lock it once and hold it until slurmctld shuts down.
 	 */
+	purge_defunct_batch_dirs();
+	script_store_gc();
+
 	slurm_mutex_lock(&purge_thread_lock);
 	while (!slurmctld_config.shutdown_time) {
 		slurm_cond_wait(&purge_thread_cond, &purge_thread_lock);
@@ -3470,6 +3515,7 @@ static void *_purge_files_thread(void *no_data)
 			delete_job_desc_files(*job_id);
 			xfree(job_id);
 		}
+		script_store_gc();
 	}
 	slurm_mutex_unlock(&purge_thread_lock);
 	return NULL;
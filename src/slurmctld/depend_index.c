@@ -0,0 +1,162 @@
+/*****************************************************************************\
+ *  depend_index.c - index of pending jobs by the jobs they depend upon
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+/*
+ * Without this index every pending job with dependencies looks up each job
+ * it depends upon on every scheduling pass, which is a large part of the
+ * pass for workflows of many thousands of jobs. Instead, a job whose
+ * dependencies remain is recorded under the ID of each job it waits on
+ * (the array job ID for job array elements) and is not tested again until
+ * one of them changes state.
+ *
+ * A record holds the IDs, not the pointers, of the waiting jobs. It is
+ * removed when its job changes state, and the waiting jobs add themselves
+ * back when they are next tested, so records never outlive their use and a
+ * waiting job whose dependencies changed in the meantime costs one
+ * unnecessary test at most.
+ */
+
+#include "config.h"
+
+#include "src/common/xmalloc.h"
+
+#include "src/slurmctld/depend_index.h"
+
+#define DEPEND_HASH_MIN	1024
+
+typedef struct depend_rec depend_rec_t;
+struct depend_rec {
+	uint32_t job_id;		/* job (or array job) waited on */
+	uint32_t *wait_ids;		/* IDs of the waiting jobs */
+	int wait_cnt;
+	int wait_size;
+	depend_rec_t *next;		/* next record in hash bucket */
+};
+
+static depend_rec_t **depend_hash = NULL;
+static uint32_t depend_hash_size = 0;
+
+static depend_rec_t **_find_rec(uint32_t job_id)
+{
+	depend_rec_t **rec_pptr;
+
+	rec_pptr = &depend_hash[job_id % depend_hash_size];
+	while (*rec_pptr && ((*rec_pptr)->job_id != job_id))
+		rec_pptr = &(*rec_pptr)->next;
+	return rec_pptr;
+}
+
+static void _add_wait(uint32_t job_id, uint32_t wait_id)
+{
+	depend_rec_t **rec_pptr = _find_rec(job_id), *rec_ptr;
+
+	if (!(rec_ptr = *rec_pptr)) {
+		rec_ptr = xmalloc(sizeof(depend_rec_t));
+		rec_ptr->job_id = job_id;
+		*rec_pptr = rec_ptr;
+	} else if (rec_ptr->wait_ids[rec_ptr->wait_cnt - 1] == wait_id) {
+		return;		/* same job, multiple dependencies */
+	}
+	if (rec_ptr->wait_cnt >= rec_ptr->wait_size) {
+		rec_ptr->wait_size = MAX(rec_ptr->wait_size * 2, 4);
+		xrealloc(rec_ptr->wait_ids,
+			 sizeof(uint32_t) * rec_ptr->wait_size);
+	}
+	rec_ptr->wait_ids[rec_ptr->wait_cnt++] = wait_id;
+}
+
+static void _notify(uint32_t job_id)
+{
+	depend_rec_t **rec_pptr = _find_rec(job_id), *rec_ptr;
+	struct job_record *wait_job_ptr;
+	int i;
+
+	if (!(rec_ptr = *rec_pptr))
+		return;
+	*rec_pptr = rec_ptr->next;
+	for (i = 0; i < rec_ptr->wait_cnt; i++) {
+		wait_job_ptr = find_job_record(rec_ptr->wait_ids[i]);
+		if (wait_job_ptr && wait_job_ptr->details)
+			wait_job_ptr->details->depend_test_time = 0;
+	}
+	xfree(rec_ptr->wait_ids);
+	xfree(rec_ptr);
+}
+
+extern void depend_index_add(struct job_record *job_ptr)
+{
+	ListIterator depend_iter;
+	struct depend_spec *dep_ptr;
+
+	if (!depend_hash) {
+		depend_hash_size = MAX(slurmctld_conf.max_job_cnt,
+				       DEPEND_HASH_MIN);
+		depend_hash = xmalloc(sizeof(depend_rec_t *) *
+				      depend_hash_size);
+	}
+
+	depend_iter = list_iterator_create(job_ptr->details->depend_list);
+	while ((dep_ptr = list_next(depend_iter))) {
+		if (dep_ptr->job_id)
+			_add_wait(dep_ptr->job_id, job_ptr->job_id);
+	}
+	list_iterator_destroy(depend_iter);
+}
+
+extern void depend_index_notify(struct job_record *job_ptr)
+{
+	if (!depend_hash)
+		return;
+
+	_notify(job_ptr->job_id);
+	if (job_ptr->array_job_id && (job_ptr->array_job_id != job_ptr->job_id))
+		_notify(job_ptr->array_job_id);
+}
+
+extern void depend_index_fini(void)
+{
+	depend_rec_t *rec_ptr, *next_ptr;
+	uint32_t i;
+
+	for (i = 0; i < depend_hash_size; i++) {
+		for (rec_ptr = depend_hash[i]; rec_ptr; rec_ptr = next_ptr) {
+			next_ptr = rec_ptr->next;
+			xfree(rec_ptr->wait_ids);
+			xfree(rec_ptr);
+		}
+	}
+	xfree(depend_hash);
+	depend_hash_size = 0;
+}
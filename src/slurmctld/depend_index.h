@@ -0,0 +1,61 @@
+/*****************************************************************************\
+ *  depend_index.h - index of pending jobs by the jobs they depend upon
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#ifndef _HAVE_DEPEND_INDEX_H
+#define _HAVE_DEPEND_INDEX_H
+
+#include "src/slurmctld/slurmctld.h"
+
+/*
+ * Record that a pending job waits on the jobs in its depend_list. Called by
+ * test_job_dependency() when dependencies remain and no dependency in the
+ * list needs testing on every pass. The job's depend_test_time is cleared
+ * when any of those jobs changes state, see depend_index_notify().
+ * NOTE: Caller must hold the job write lock
+ */
+extern void depend_index_add(struct job_record *job_ptr);
+
+/*
+ * A job began running, completed, was requeued or is being purged. Clear
+ * depend_test_time of the jobs waiting on it (or on its job array) so their
+ * dependencies are tested again on the next pass.
+ * NOTE: Caller must hold the job write lock
+ */
+extern void depend_index_notify(struct job_record *job_ptr);
+
+/* Free all memory, called at slurmctld shutdown */
+extern void depend_index_fini(void);
+
+#endif /* !_HAVE_DEPEND_INDEX_H */
@@ -0,0 +1,1064 @@
+/*****************************************************************************\
+ *  event_mgr.c - push state change events to subscribed clients
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+/*
+ * Tools tracking the state of jobs, nodes, partitions or reservations can
+ * subscribe to their changes (REQUEST_EVENT_SUBSCRIBE) instead of polling
+ * the full tables. The RPC handler hands the subscriber's connection over
+ * to the event thread, which keeps a copy of the properties of every record
+ * that events report. When the write lock generations (see locks.c) show
+ * that the data changed, at most once every EVENT_SCAN_INTERVAL seconds, it
+ * compares the records with that copy and queues an event for each record
+ * created, changed or removed to every subscriber entitled to see it and
+ * whose filter it matches. A record that stops matching a subscriber's
+ * filter is reported to it as removed.
+ *
+ * Notifications are written to the subscribers without blocking. While one
+ * is still being written, further events for the same subscriber are
+ * coalesced per record so that a client reading slowly only receives the
+ * latest change of each record. A subscriber with more than
+ * EVENT_PENDING_MAX records queued loses the queue and is sent an
+ * EVENT_TYPE_RESYNC event instead, and one which accepts no data for
+ * EVENT_STALL_TIME seconds is disconnected.
+ */
+
+#include "config.h"
+
+#if HAVE_SYS_PRCTL_H
+#  include <sys/prctl.h>
+#endif
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "src/common/assoc_mgr.h"
+#include "src/common/fd.h"
+#include "src/common/list.h"
+#include "src/common/log.h"
+#include "src/common/macros.h"
+#include "src/common/node_conf.h"
+#include "src/common/pack.h"
+#include "src/common/slurm_mcs.h"
+#include "src/common/slurm_persist_conn.h"
+#include "src/common/xhash.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
+
+#include "src/slurmctld/event_mgr.h"
+#include "src/slurmctld/info_filter.h"
+#include "src/slurmctld/locks.h"
+#include "src/slurmctld/reservation.h"
+#include "src/slurmctld/slurmctld.h"
+
+#define EVENT_PENDING_MAX	10000	/* queued records before a resync */
+#define EVENT_SCAN_INTERVAL	1	/* seconds between comparisons */
+#define EVENT_STALL_TIME	300	/* seconds without a write succeeding */
+
+/*
+ * Properties of one record as last seen by the event thread. Never modified
+ * once built, a change creates a new one, so that queued events can share
+ * it.
+ */
+typedef struct {
+	int refcnt;
+	uint16_t event_type;	/* EVENT_TYPE_* */
+	uint32_t job_id;	/* job records */
+	char *name;		/* node, partition or reservation name */
+	uint32_t state;		/* job_state, node_state or state_up */
+	uint32_t state_reason;	/* job records */
+	uint32_t user_id;	/* job records */
+	char *account;		/* job records */
+	char *job_name;		/* job records */
+	char *mcs_label;	/* job records */
+	char *nodes;		/* job records */
+	char *partition;	/* job records */
+	uint32_t count;		/* nodes of job, partition or reservation */
+	uint64_t flags;		/* partition or reservation flags */
+	uint32_t limit;		/* time limit of job or partition */
+	time_t start_time;	/* reservation start, node reason_time */
+	time_t end_time;	/* reservation end */
+	int node_inx;		/* node records */
+} event_rec_t;
+
+/* A record created, changed or removed by the last scan */
+typedef struct {
+	uint16_t change;	/* EVENT_CHANGE_* */
+	event_rec_t *old_rec;	/* NULL if created */
+	event_rec_t *new_rec;	/* NULL if removed */
+} event_change_t;
+
+/* An event queued for a subscriber, at most one per record */
+typedef struct {
+	char *key;		/* record type and identity */
+	uint16_t change;
+	time_t event_time;
+	event_rec_t *rec;
+} event_pend_t;
+
+typedef struct {
+	int fd;
+	uid_t uid;
+	bool operator;
+	uint16_t protocol_version;
+	uint16_t event_types;
+	info_filter_t *filter;
+	job_filter_t *job_filter;
+	bitstr_t *node_bitmap;	/* nodes matching the filter, NULL if all */
+	xhash_t *pending;	/* event_pend_t */
+	time_t resync_time;	/* events were dropped at this time if set */
+	Buf out;		/* framed notification being written */
+	uint32_t out_sent;	/* bytes of out already written */
+	time_t out_time;	/* last progress writing out */
+} event_sub_t;
+
+static pthread_mutex_t event_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t event_thread = 0;
+static bool event_stop = false;
+static int wake_fd[2] = { -1, -1 };
+static int sub_max = 0;		/* subscribers allowed, 0 if disabled */
+static int sub_reserved = 0;	/* subscribers connected or reserved */
+static List new_subs = NULL;	/* added but not yet seen by the thread */
+
+/* Used only by the event thread */
+static List subs = NULL;
+static bool primed = false;	/* record tables below are current */
+static uint32_t job_gen = 0, node_gen = 0, part_gen = 0;
+static event_rec_t **job_recs = NULL;	/* sorted by job ID */
+static uint32_t job_rec_cnt = 0;
+static event_rec_t **node_recs = NULL;	/* by node index */
+static uint32_t node_rec_cnt = 0;
+static event_rec_t **part_recs = NULL;	/* sorted by name */
+static uint32_t part_rec_cnt = 0;
+static event_rec_t **resv_recs = NULL;	/* sorted by name */
+static uint32_t resv_rec_cnt = 0;
+static event_change_t *changes = NULL;
+static uint32_t change_cnt = 0, change_size = 0;
+
+static void _rec_release(event_rec_t *rec)
+{
+	if (!rec || (--rec->refcnt > 0))
+		return;
+	xfree(rec->name);
+	xfree(rec->account);
+	xfree(rec->job_name);
+	xfree(rec->mcs_label);
+	xfree(rec->nodes);
+	xfree(rec->partition);
+	xfree(rec);
+}
+
+/* Copy a record built on the stack, with its own strings */
+static event_rec_t *_rec_dup(event_rec_t *tmp)
+{
+	event_rec_t *rec = xmalloc(sizeof(event_rec_t));
+
+	memcpy(rec, tmp, sizeof(event_rec_t));
+	rec->refcnt = 1;
+	rec->name = xstrdup(tmp->name);
+	rec->account = xstrdup(tmp->account);
+	rec->job_name = xstrdup(tmp->job_name);
+	rec->mcs_label = xstrdup(tmp->mcs_label);
+	rec->nodes = xstrdup(tmp->nodes);
+	rec->partition = xstrdup(tmp->partition);
+	return rec;
+}
+
+static bool _rec_equal(event_rec_t *a, event_rec_t *b)
+{
+	return ((a->state == b->state) &&
+		(a->state_reason == b->state_reason) &&
+		(a->user_id == b->user_id) &&
+		(a->count == b->count) &&
+		(a->flags == b->flags) &&
+		(a->limit == b->limit) &&
+		(a->start_time == b->start_time) &&
+		(a->end_time == b->end_time) &&
+		!xstrcmp(a->account, b->account) &&
+		!xstrcmp(a->job_name, b->job_name) &&
+		!xstrcmp(a->mcs_label, b->mcs_label) &&
+		!xstrcmp(a->nodes, b->nodes) &&
+		!xstrcmp(a->partition, b->partition));
+}
+
+static void _free_recs(event_rec_t ***recs, uint32_t *cnt)
+{
+	uint32_t i;
+
+	for (i = 0; i < *cnt; i++)
+		_rec_release((*recs)[i]);
+	xfree(*recs);
+	*cnt = 0;
+}
+
+static void _add_change(uint16_t change, event_rec_t *old_rec,
+			event_rec_t *new_rec)
+{
+	if (change_cnt >= change_size) {
+		change_size = (change_size * 2) + 64;
+		xrealloc(changes, sizeof(event_change_t) * change_size);
+	}
+	if (old_rec)
+		old_rec->refcnt++;
+	if (new_rec)
+		new_rec->refcnt++;
+	changes[change_cnt].change = change;
+	changes[change_cnt].old_rec = old_rec;
+	changes[change_cnt].new_rec = new_rec;
+	change_cnt++;
+}
+
+static void _free_changes(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < change_cnt; i++) {
+		_rec_release(changes[i].old_rec);
+		_rec_release(changes[i].new_rec);
+	}
+	change_cnt = 0;
+}
+
+static int _cmp_job_id(const void *a, const void *b)
+{
+	uint32_t job_id_a = (*(event_rec_t **) a)->job_id;
+	uint32_t job_id_b = (*(event_rec_t **) b)->job_id;
+
+	if (job_id_a < job_id_b)
+		return -1;
+	if (job_id_a > job_id_b)
+		return 1;
+	return 0;
+}
+
+static int _cmp_name(const void *a, const void *b)
+{
+	return xstrcmp((*(event_rec_t **) a)->name,
+		       (*(event_rec_t **) b)->name);
+}
+
+/*
+ * Compare a new table of records, sorted with cmp_func, with the previous
+ * one. Records of the new table equal to the previous version are replaced
+ * by it. Records created, changed or removed are added to changes unless
+ * priming.
+ */
+static void _diff_recs(event_rec_t **old_recs, uint32_t old_cnt,
+		       event_rec_t **new_recs, uint32_t new_cnt,
+		       int (*cmp_func)(const void *, const void *),
+		       bool prime)
+{
+	uint32_t i = 0, j = 0;
+	int cmp;
+
+	while ((i < old_cnt) || (j < new_cnt)) {
+		if (i >= old_cnt)
+			cmp = 1;
+		else if (j >= new_cnt)
+			cmp = -1;
+		else
+			cmp = cmp_func(&old_recs[i], &new_recs[j]);
+
+		if (cmp < 0) {
+			if (!prime)
+				_add_change(EVENT_CHANGE_DELETE, old_recs[i],
+					    NULL);
+			i++;
+		} else if (cmp > 0) {
+			if (!prime)
+				_add_change(EVENT_CHANGE_CREATE, NULL,
+					    new_recs[j]);
+			j++;
+		} else {
+			if (_rec_equal(old_recs[i], new_recs[j])) {
+				_rec_release(new_recs[j]);
+				new_recs[j] = old_recs[i];
+				new_recs[j]->refcnt++;
+			} else if (!prime) {
+				_add_change(EVENT_CHANGE_UPDATE, old_recs[i],
+					    new_recs[j]);
+			}
+			i++;
+			j++;
+		}
+	}
+}
+
+/*
+ * Build the record of a job on the stack, pointing at the job's strings.
+ * NOTE: Caller must hold the job read lock
+ */
+static void _job_rec(struct job_record *job_ptr, event_rec_t *rec)
+{
+	memset(rec, 0, sizeof(event_rec_t));
+	rec->event_type = EVENT_TYPE_JOB;
+	rec->job_id = job_ptr->job_id;
+	rec->state = job_ptr->job_state & ~JOB_UPDATE_DB;
+	rec->state_reason = job_ptr->state_reason;
+	rec->user_id = job_ptr->user_id;
+	rec->account = job_ptr->account;
+	rec->job_name = job_ptr->name;
+	rec->mcs_label = job_ptr->mcs_label;
+	rec->nodes = job_ptr->nodes;
+	rec->partition = job_ptr->partition;
+	rec->count = job_ptr->node_cnt;
+	rec->limit = job_ptr->time_limit;
+}
+
+/* NOTE: Caller must hold the job read lock */
+static void _scan_jobs(bool prime)
+{
+	event_rec_t **recs, tmp, *key = &tmp, **found;
+	struct job_record *job_ptr;
+	ListIterator itr;
+	uint32_t cnt = 0;
+
+	recs = xmalloc(sizeof(event_rec_t *) * (list_count(job_list) + 1));
+	itr = list_iterator_create(job_list);
+	while ((job_ptr = list_next(itr))) {
+		if (IS_JOB_REVOKED(job_ptr))
+			continue;
+		_job_rec(job_ptr, &tmp);
+		/* Share the previous record if unchanged, avoiding copies */
+		found = bsearch(&key, job_recs, job_rec_cnt,
+				sizeof(event_rec_t *), _cmp_job_id);
+		if (found && _rec_equal(*found, &tmp)) {
+			recs[cnt] = *found;
+			recs[cnt]->refcnt++;
+		} else {
+			recs[cnt] = _rec_dup(&tmp);
+		}
+		cnt++;
+	}
+	list_iterator_destroy(itr);
+	qsort(recs, cnt, sizeof(event_rec_t *), _cmp_job_id);
+
+	_diff_recs(job_recs, job_rec_cnt, recs, cnt, _cmp_job_id, prime);
+	_free_recs(&job_recs, &job_rec_cnt);
+	job_recs = recs;
+	job_rec_cnt = cnt;
+}
+
+/* NOTE: Caller must hold the node read lock */
+static void _scan_nodes(bool prime)
+{
+	struct node_record *node_ptr;
+	event_rec_t **recs, tmp;
+	int i;
+
+	/* Nodes are only added or removed by a restart, start over */
+	if (node_rec_cnt != node_record_count) {
+		_free_recs(&node_recs, &node_rec_cnt);
+		prime = true;
+	}
+
+	recs = xmalloc(sizeof(event_rec_t *) * (node_record_count + 1));
+	for (i = 0, node_ptr = node_record_table_ptr; i < node_record_count;
+	     i++, node_ptr++) {
+		memset(&tmp, 0, sizeof(event_rec_t));
+		tmp.event_type = EVENT_TYPE_NODE;
+		tmp.name = node_ptr->name;
+		tmp.state = node_ptr->node_state;
+		tmp.start_time = node_ptr->reason_time;
+		tmp.node_inx = i;
+		if (node_recs && _rec_equal(node_recs[i], &tmp)) {
+			recs[i] = node_recs[i];
+			recs[i]->refcnt++;
+		} else {
+			recs[i] = _rec_dup(&tmp);
+			if (node_recs && !prime) {
+				_add_change(EVENT_CHANGE_UPDATE, node_recs[i],
+					    recs[i]);
+			}
+		}
+	}
+	_free_recs(&node_recs, &node_rec_cnt);
+	node_recs = recs;
+	node_rec_cnt = node_record_count;
+}
+
+/* NOTE: Caller must hold the partition read lock */
+static void _scan_parts(bool prime)
+{
+	struct part_record *part_ptr;
+	event_rec_t **recs, tmp;
+	ListIterator itr;
+	uint32_t cnt = 0;
+
+	recs = xmalloc(sizeof(event_rec_t *) * (list_count(part_list) + 1));
+	itr = list_iterator_create(part_list);
+	while ((part_ptr = list_next(itr))) {
+		memset(&tmp, 0, sizeof(event_rec_t));
+		tmp.event_type = EVENT_TYPE_PART;
+		tmp.name = part_ptr->name;
+		tmp.state = part_ptr->state_up;
+		tmp.count = part_ptr->total_nodes;
+		tmp.flags = part_ptr->flags;
+		tmp.limit = part_ptr->max_time;
+		recs[cnt++] = _rec_dup(&tmp);
+	}
+	list_iterator_destroy(itr);
+	qsort(recs, cnt, sizeof(event_rec_t *), _cmp_name);
+
+	_diff_recs(part_recs, part_rec_cnt, recs, cnt, _cmp_name, prime);
+	_free_recs(&part_recs, &part_rec_cnt);
+	part_recs = recs;
+	part_rec_cnt = cnt;
+}
+
+/* NOTE: Caller must hold the node read lock */
+static void _scan_resvs(bool prime)
+{
+	slurmctld_resv_t *resv_ptr;
+	event_rec_t **recs, tmp;
+	ListIterator itr;
+	uint32_t cnt = 0;
+
+	recs = xmalloc(sizeof(event_rec_t *) * (list_count(resv_list) + 1));
+	itr = list_iterator_create(resv_list);
+	while ((resv_ptr = list_next(itr))) {
+		memset(&tmp, 0, sizeof(event_rec_t));
+		tmp.event_type = EVENT_TYPE_RESV;
+		tmp.name = resv_ptr->name;
+		tmp.count = resv_ptr->node_cnt;
+		tmp.flags = resv_ptr->flags;
+		tmp.start_time = resv_ptr->start_time;
+		tmp.end_time = resv_ptr->end_time;
+		recs[cnt++] = _rec_dup(&tmp);
+	}
+	list_iterator_destroy(itr);
+	qsort(recs, cnt, sizeof(event_rec_t *), _cmp_name);
+
+	_diff_recs(resv_recs, resv_rec_cnt, recs, cnt, _cmp_name, prime);
+	_free_recs(&resv_recs, &resv_rec_cnt);
+	resv_recs = recs;
+	resv_rec_cnt = cnt;
+}
+
+/*
+ * Compare the records with the tables if they were modified, or build the
+ * tables if prime is set, and refresh the node bitmaps of subscribers
+ * filtering nodes if nodes or partitions changed
+ */
+static void _scan(bool prime)
+{
+	/* Locks: Read job, node and partition */
+	slurmctld_lock_t read_lock = {
+		NO_LOCK, READ_LOCK, READ_LOCK, READ_LOCK, NO_LOCK };
+	bool jobs, nodes, parts;
+	ListIterator itr;
+	event_sub_t *sub;
+
+	if (!prime &&
+	    (get_lock_write_gen(JOB_LOCK) == job_gen) &&
+	    (get_lock_write_gen(NODE_LOCK) == node_gen) &&
+	    (get_lock_write_gen(PART_LOCK) == part_gen))
+		return;
+
+	lock_slurmctld(read_lock);
+	jobs = prime || (get_lock_write_gen(JOB_LOCK) != job_gen);
+	nodes = prime || (get_lock_write_gen(NODE_LOCK) != node_gen);
+	parts = prime || (get_lock_write_gen(PART_LOCK) != part_gen);
+	job_gen = get_lock_write_gen(JOB_LOCK);
+	node_gen = get_lock_write_gen(NODE_LOCK);
+	part_gen = get_lock_write_gen(PART_LOCK);
+
+	if (jobs)
+		_scan_jobs(prime);
+	if (nodes) {
+		_scan_nodes(prime);
+		_scan_resvs(prime);
+	}
+	if (parts)
+		_scan_parts(prime);
+	if (nodes || parts) {
+		itr = list_iterator_create(subs);
+		while ((sub = list_next(itr))) {
+			if (!sub->filter)
+				continue;
+			FREE_NULL_BITMAP(sub->node_bitmap);
+			sub->node_bitmap = node_filter_bitmap(sub->filter);
+		}
+		list_iterator_destroy(itr);
+	}
+	unlock_slurmctld(read_lock);
+	primed = true;
+}
+
+static void _free_tables(void)
+{
+	_free_recs(&job_recs, &job_rec_cnt);
+	_free_recs(&node_recs, &node_rec_cnt);
+	_free_recs(&part_recs, &part_rec_cnt);
+	_free_recs(&resv_recs, &resv_rec_cnt);
+	_free_changes();
+	xfree(changes);
+	change_size = 0;
+	primed = false;
+}
+
+static const char *_pend_key(void *item)
+{
+	return ((event_pend_t *) item)->key;
+}
+
+static void _pend_free(void *item)
+{
+	event_pend_t *pend = item;
+
+	xfree(pend->key);
+	_rec_release(pend->rec);
+	xfree(pend);
+}
+
+static void _sub_free(void *x)
+{
+	event_sub_t *sub = x;
+
+	if (sub->fd >= 0)
+		(void) close(sub->fd);
+	slurm_free_info_filter(sub->filter);
+	job_filter_destroy(sub->job_filter);
+	FREE_NULL_BITMAP(sub->node_bitmap);
+	xhash_free(sub->pending);
+	FREE_NULL_BUFFER(sub->out);
+	xfree(sub);
+
+	slurm_mutex_lock(&event_mutex);
+	sub_reserved--;
+	slurm_mutex_unlock(&event_mutex);
+}
+
+/* Test if a comma separated list contains a name */
+static bool _name_in_list(char *list, char *name)
+{
+	char *tmp, *tok, *save_ptr = NULL;
+	bool found = false;
+
+	tmp = xstrdup(list);
+	tok = strtok_r(tmp, ",", &save_ptr);
+	while (tok && !found) {
+		found = !xstrcmp(tok, name);
+		tok = strtok_r(NULL, ",", &save_ptr);
+	}
+	xfree(tmp);
+
+	return found;
+}
+
+/* Test if a subscriber is entitled to see a record and wants to */
+static bool _sub_match(event_sub_t *sub, event_rec_t *rec)
+{
+	if (!rec || !(sub->event_types & rec->event_type))
+		return false;
+
+	switch (rec->event_type) {
+	case EVENT_TYPE_JOB:
+		/* Same test as _hide_job() in job_mgr.c */
+		if ((slurmctld_conf.private_data & PRIVATE_DATA_JOBS) &&
+		    (rec->user_id != sub->uid) && !sub->operator &&
+		    (((slurm_mcs_get_privatedata() == 0) &&
+		      !assoc_mgr_is_user_acct_coord(acct_db_conn, sub->uid,
+						    rec->account)) ||
+		     ((slurm_mcs_get_privatedata() == 1) &&
+		      (mcs_g_check_mcs_label(sub->uid, rec->mcs_label) != 0))))
+			return false;
+		return job_filter_test(sub->job_filter, rec->state,
+				       rec->user_id, rec->account,
+				       rec->job_name, rec->partition,
+				       rec->nodes);
+	case EVENT_TYPE_NODE:
+		if ((slurmctld_conf.private_data & PRIVATE_DATA_NODES) &&
+		    !sub->operator)
+			return false;
+		return (!sub->node_bitmap ||
+			((rec->node_inx < bit_size(sub->node_bitmap)) &&
+			 bit_test(sub->node_bitmap, rec->node_inx)));
+	case EVENT_TYPE_PART:
+		if ((slurmctld_conf.private_data & PRIVATE_DATA_PARTITIONS) &&
+		    !sub->operator)
+			return false;
+		return (!sub->filter || !sub->filter->partitions ||
+			_name_in_list(sub->filter->partitions, rec->name));
+	case EVENT_TYPE_RESV:
+		return (!(slurmctld_conf.private_data &
+			  PRIVATE_DATA_RESERVATIONS) || sub->operator);
+	}
+
+	return false;
+}
+
+/* Queue an event for a subscriber, coalescing it with one still queued */
+static void _sub_queue(event_sub_t *sub, uint16_t change, event_rec_t *rec,
+		       time_t now)
+{
+	event_pend_t *pend;
+	char *key = NULL;
+
+	if (rec->event_type == EVENT_TYPE_JOB)
+		xstrfmtcat(key, "j%u", rec->job_id);
+	else
+		xstrfmtcat(key, "%u:%s", rec->event_type, rec->name);
+
+	if ((pend = xhash_get(sub->pending, key))) {
+		xfree(key);
+		if (pend->change == EVENT_CHANGE_CREATE) {
+			if (change == EVENT_CHANGE_DELETE) {
+				/* The subscriber never saw it */
+				xhash_delete(sub->pending, pend->key);
+				return;
+			}
+			change = EVENT_CHANGE_CREATE;
+		} else if ((pend->change == EVENT_CHANGE_DELETE) &&
+			   (change == EVENT_CHANGE_CREATE)) {
+			change = EVENT_CHANGE_UPDATE;
+		}
+		_rec_release(pend->rec);
+		pend->change = change;
+		pend->event_time = now;
+		pend->rec = rec;
+		rec->refcnt++;
+		return;
+	}
+
+	if (xhash_count(sub->pending) >= EVENT_PENDING_MAX) {
+		xfree(key);
+		if (!sub->resync_time) {
+			debug("%s: subscriber uid=%u is too far behind, dropping %u events",
+			      __func__, sub->uid, xhash_count(sub->pending));
+		}
+		xhash_clear(sub->pending);
+		sub->resync_time = now;
+		return;
+	}
+
+	pend = xmalloc(sizeof(event_pend_t));
+	pend->key = key;
+	pend->change = change;
+	pend->event_time = now;
+	pend->rec = rec;
+	rec->refcnt++;
+	xhash_add(sub->pending, pend);
+}
+
+/* Queue the changes found by the last scan to every subscriber */
+static void _queue_changes(void)
+{
+	event_change_t *chg;
+	event_sub_t *sub;
+	ListIterator itr;
+	time_t now = time(NULL);
+	bool old_match, new_match;
+	uint32_t i;
+
+	itr = list_iterator_create(subs);
+	while ((sub = list_next(itr))) {
+		for (i = 0, chg = changes; i < change_cnt; i++, chg++) {
+			old_match = _sub_match(sub, chg->old_rec);
+			new_match = _sub_match(sub, chg->new_rec);
+			if (new_match) {
+				_sub_queue(sub, old_match ? chg->change :
+					   EVENT_CHANGE_CREATE,
+					   chg->new_rec, now);
+			} else if (old_match) {
+				_sub_queue(sub, EVENT_CHANGE_DELETE,
+					   chg->new_rec ? chg->new_rec :
+					   chg->old_rec, now);
+			}
+		}
+	}
+	list_iterator_destroy(itr);
+	_free_changes();
+}
+
+typedef struct {
+	slurm_event_t *events;
+	uint32_t cnt;
+} event_pack_arg_t;
+
+static void _pend_to_event(void *item, void *arg)
+{
+	event_pend_t *pend = item;
+	event_pack_arg_t *pack_arg = arg;
+	slurm_event_t *event = &pack_arg->events[pack_arg->cnt++];
+
+	event->event_type = pend->rec->event_type;
+	event->change = pend->change;
+	event->event_time = pend->event_time;
+	event->job_id = pend->rec->job_id;
+	event->name = pend->rec->name;
+	event->state = pend->rec->state;
+	event->state_reason = pend->rec->state_reason;
+}
+
+static int _cmp_event_time(const void *a, const void *b)
+{
+	time_t time_a = ((slurm_event_t *) a)->event_time;
+	time_t time_b = ((slurm_event_t *) b)->event_time;
+
+	if (time_a < time_b)
+		return -1;
+	if (time_a > time_b)
+		return 1;
+	return 0;
+}
+
+/* Pack everything queued for a subscriber into its output buffer */
+static void _sub_pack(event_sub_t *sub, time_t now)
+{
+	slurm_persist_conn_t persist_conn;
+	persist_msg_t persist_msg;
+	event_notify_msg_t notify;
+	event_pack_arg_t pack_arg;
+	Buf buffer;
+
+	pack_arg.events = xmalloc(sizeof(slurm_event_t) *
+				  (xhash_count(sub->pending) + 1));
+	pack_arg.cnt = 0;
+	if (sub->resync_time) {
+		pack_arg.events[0].event_type = EVENT_TYPE_RESYNC;
+		pack_arg.events[0].event_time = sub->resync_time;
+		pack_arg.cnt++;
+		sub->resync_time = 0;
+	}
+	xhash_walk(sub->pending, _pend_to_event, &pack_arg);
+	qsort(pack_arg.events, pack_arg.cnt, sizeof(slurm_event_t),
+	      _cmp_event_time);
+
+	memset(&persist_conn, 0, sizeof(persist_conn));
+	persist_conn.version = sub->protocol_version;
+	memset(&persist_msg, 0, sizeof(persist_msg));
+	notify.event_cnt = pack_arg.cnt;
+	notify.events = pack_arg.events;
+	persist_msg.msg_type = MESSAGE_EVENT_NOTIFY;
+	persist_msg.data = &notify;
+	buffer = slurm_persist_msg_pack(&persist_conn, &persist_msg);
+	xfree(pack_arg.events);
+	xhash_clear(sub->pending);
+	if (!buffer)
+		return;
+
+	/* Same framing as slurm_persist_send_msg() */
+	sub->out = init_buf(get_buf_offset(buffer) + sizeof(uint32_t));
+	pack32(get_buf_offset(buffer), sub->out);
+	memcpy(get_buf_data(sub->out) + get_buf_offset(sub->out),
+	       get_buf_data(buffer), get_buf_offset(buffer));
+	set_buf_offset(sub->out, size_buf(sub->out));
+	free_buf(buffer);
+	sub->out_sent = 0;
+	sub->out_time = now;
+}
+
+/*
+ * Write as much of the output buffer as the socket accepts
+ * RET SLURM_ERROR if the subscriber is to be closed
+ */
+static int _sub_write(event_sub_t *sub, time_t now)
+{
+	ssize_t len;
+
+	while (sub->out) {
+		len = write(sub->fd, get_buf_data(sub->out) + sub->out_sent,
+			    get_buf_offset(sub->out) - sub->out_sent);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+				break;
+			debug("%s: write to subscriber uid=%u: %m",
+			      __func__, sub->uid);
+			return SLURM_ERROR;
+		}
+		sub->out_sent += len;
+		sub->out_time = now;
+		if (sub->out_sent >= get_buf_offset(sub->out))
+			FREE_NULL_BUFFER(sub->out);
+	}
+
+	if (sub->out && ((now - sub->out_time) > EVENT_STALL_TIME)) {
+		info("%s: subscriber uid=%u not reading, closing its subscription",
+		     __func__, sub->uid);
+		return SLURM_ERROR;
+	}
+
+	return SLURM_SUCCESS;
+}
+
+/* Start serving subscribers added by event_mgr_add() */
+static void _add_new_subs(void)
+{
+	/* Locks: Read node and partition */
+	slurmctld_lock_t read_lock = {
+		NO_LOCK, NO_LOCK, READ_LOCK, READ_LOCK, NO_LOCK };
+	List added;
+	event_sub_t *sub;
+
+	slurm_mutex_lock(&event_mutex);
+	if (!list_count(new_subs)) {
+		slurm_mutex_unlock(&event_mutex);
+		return;
+	}
+	added = list_create(NULL);
+	list_transfer(added, new_subs);
+	slurm_mutex_unlock(&event_mutex);
+
+	/* The first subscriber only sees changes from now on */
+	if (!primed)
+		_scan(true);
+
+	while ((sub = list_dequeue(added))) {
+		if (sub->filter) {
+			lock_slurmctld(read_lock);
+			sub->node_bitmap = node_filter_bitmap(sub->filter);
+			unlock_slurmctld(read_lock);
+		}
+		list_append(subs, sub);
+	}
+	FREE_NULL_LIST(added);
+}
+
+static void *_event_thread(void *no_data)
+{
+	struct pollfd *pfds = NULL;
+	event_sub_t **pfd_subs = NULL;
+	int i, nfds, pfd_size = 0, rc;
+	ssize_t len;
+	time_t now, last_scan = 0;
+	char buf[256];
+	ListIterator itr;
+	event_sub_t *sub;
+
+#if HAVE_SYS_PRCTL_H
+	if (prctl(PR_SET_NAME, "eventmgr", NULL, NULL, NULL) < 0) {
+		error("%s: cannot set my name to %s %m", __func__, "eventmgr");
+	}
+#endif
+
+	while (1) {
+		slurm_mutex_lock(&event_mutex);
+		if (event_stop) {
+			slurm_mutex_unlock(&event_mutex);
+			break;
+		}
+		slurm_mutex_unlock(&event_mutex);
+
+		_add_new_subs();
+
+		nfds = list_count(subs) + 1;
+		if (nfds > pfd_size) {
+			pfd_size = nfds * 2;
+			xrealloc(pfds, sizeof(struct pollfd) * pfd_size);
+			xrealloc(pfd_subs, sizeof(event_sub_t *) * pfd_size);
+		}
+		pfds[0].fd = wake_fd[0];
+		pfds[0].events = POLLIN;
+		nfds = 1;
+		itr = list_iterator_create(subs);
+		while ((sub = list_next(itr))) {
+			pfds[nfds].fd = sub->fd;
+			pfds[nfds].events = POLLIN;
+			if (sub->out)
+				pfds[nfds].events |= POLLOUT;
+			pfd_subs[nfds++] = sub;
+		}
+		list_iterator_destroy(itr);
+
+		rc = poll(pfds, nfds, EVENT_SCAN_INTERVAL * 1000);
+		if ((rc < 0) && (errno != EINTR)) {
+			error("%s: poll: %m", __func__);
+			break;
+		}
+		now = time(NULL);
+
+		for (i = 0; (rc > 0) && (i < nfds); i++) {
+			if (!pfds[i].revents)
+				continue;
+			if (i == 0) {
+				while (read(wake_fd[0], buf, sizeof(buf)) > 0)
+					;
+				continue;
+			}
+			sub = pfd_subs[i];
+			if (!(pfds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+				continue;
+			/* Subscribers send nothing, this is the close */
+			len = read(sub->fd, buf, sizeof(buf));
+			if ((len == 0) || ((len < 0) && (errno != EAGAIN) &&
+					   (errno != EINTR))) {
+				debug2("%s: subscriber uid=%u closed",
+				       __func__, sub->uid);
+				(void) close(sub->fd);
+				sub->fd = -1;
+			}
+		}
+
+		if (list_count(subs) && ((now - last_scan) >=
+					 EVENT_SCAN_INTERVAL)) {
+			_scan(false);
+			last_scan = now;
+		}
+
+		if (change_cnt)
+			_queue_changes();
+
+		itr = list_iterator_create(subs);
+		while ((sub = list_next(itr))) {
+			if (sub->fd < 0) {
+				list_delete_item(itr);
+				continue;
+			}
+			if (!sub->out &&
+			    (xhash_count(sub->pending) || sub->resync_time))
+				_sub_pack(sub, now);
+			if (_sub_write(sub, now) != SLURM_SUCCESS)
+				list_delete_item(itr);
+		}
+		list_iterator_destroy(itr);
+
+		if (!list_count(subs) && primed)
+			_free_tables();
+	}
+
+	xfree(pfds);
+	xfree(pfd_subs);
+	return NULL;
+}
+
+extern void event_mgr_start(void)
+{
+	char *tmp_ptr;
+
+	if (!(tmp_ptr = xstrcasestr(slurmctld_conf.slurmctld_params,
+				    "event_subscribers=")))
+		return;
+	if (atoi(tmp_ptr + 18) <= 0) {
+		error("Invalid SlurmctldParameters event_subscribers=%d",
+		      atoi(tmp_ptr + 18));
+		return;
+	}
+
+	if (pipe(wake_fd) < 0) {
+		error("%s: pipe: %m", __func__);
+		return;
+	}
+	fd_set_nonblocking(wake_fd[0]);
+	fd_set_nonblocking(wake_fd[1]);
+	fd_set_close_on_exec(wake_fd[0]);
+	fd_set_close_on_exec(wake_fd[1]);
+
+	slurm_mutex_lock(&event_mutex);
+	sub_max = atoi(tmp_ptr + 18);
+	event_stop = false;
+	new_subs = list_create(_sub_free);
+	subs = list_create(_sub_free);
+	slurm_thread_create(&event_thread, _event_thread, NULL);
+	slurm_mutex_unlock(&event_mutex);
+	debug("%s: accepting up to %d event subscribers", __func__, sub_max);
+}
+
+extern void event_mgr_stop(void)
+{
+	pthread_t thread_id;
+	char c = 0;
+
+	slurm_mutex_lock(&event_mutex);
+	thread_id = event_thread;
+	event_stop = true;
+	sub_max = 0;
+	slurm_mutex_unlock(&event_mutex);
+	if (!thread_id)
+		return;
+	if (write(wake_fd[1], &c, 1) < 0)
+		debug("%s: write: %m", __func__);
+	pthread_join(thread_id, NULL);
+
+	FREE_NULL_LIST(subs);
+	FREE_NULL_LIST(new_subs);
+	_free_tables();
+	(void) close(wake_fd[0]);
+	(void) close(wake_fd[1]);
+	wake_fd[0] = wake_fd[1] = -1;
+	event_thread = 0;
+}
+
+extern int event_mgr_reserve(void)
+{
+	int rc = SLURM_SUCCESS;
+
+	slurm_mutex_lock(&event_mutex);
+	if (!sub_max)
+		rc = ESLURM_NOT_SUPPORTED;
+	else if (sub_reserved >= sub_max)
+		rc = EAGAIN;
+	else
+		sub_reserved++;
+	slurm_mutex_unlock(&event_mutex);
+
+	return rc;
+}
+
+extern void event_mgr_unreserve(void)
+{
+	slurm_mutex_lock(&event_mutex);
+	sub_reserved--;
+	slurm_mutex_unlock(&event_mutex);
+}
+
+extern void event_mgr_add(int fd, uid_t uid, uint16_t protocol_version,
+			  event_subscribe_msg_t *req)
+{
+	event_sub_t *sub = xmalloc(sizeof(event_sub_t));
+	char c = 0;
+
+	fd_set_nonblocking(fd);
+	sub->fd = fd;
+	sub->uid = uid;
+	sub->operator = validate_operator(uid);
+	sub->protocol_version = protocol_version;
+	sub->event_types = req->event_types;
+	sub->filter = req->filter;
+	req->filter = NULL;
+	sub->job_filter = job_filter_create(sub->filter);
+	sub->pending = xhash_init(_pend_key, _pend_free);
+
+	slurm_mutex_lock(&event_mutex);
+	list_append(new_subs, sub);
+	slurm_mutex_unlock(&event_mutex);
+	if (write(wake_fd[1], &c, 1) < 0)
+		debug("%s: write: %m", __func__);
+}
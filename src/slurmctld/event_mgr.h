@@ -0,0 +1,74 @@
+/*****************************************************************************\
+ *  event_mgr.h - push state change events to subscribed clients
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#ifndef _HAVE_EVENT_MGR_H
+#define _HAVE_EVENT_MGR_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "src/common/slurm_protocol_defs.h"
+
+/*
+ * Read the "event_subscribers=" option of SlurmctldParameters and, if set,
+ * start the thread serving event subscriptions
+ */
+extern void event_mgr_start(void);
+
+/* Stop the event thread and close every subscription */
+extern void event_mgr_stop(void);
+
+/*
+ * Reserve a subscription slot before accepting a REQUEST_EVENT_SUBSCRIBE
+ * RET SLURM_SUCCESS, ESLURM_NOT_SUPPORTED if subscriptions are disabled or
+ *     EAGAIN if the configured number of subscribers is reached
+ */
+extern int event_mgr_reserve(void);
+
+/* Release a slot from event_mgr_reserve() which is not going to be used */
+extern void event_mgr_unreserve(void);
+
+/*
+ * Hand an accepted subscription over to the event thread, using the slot
+ * from event_mgr_reserve(). Events are sent on fd from now on.
+ * IN fd - connection of the subscriber, closed by the event thread
+ * IN uid - user making the request, for job and record visibility
+ * IN protocol_version - version of the subscriber
+ * IN req - the request, the filter is taken over
+ */
+extern void event_mgr_add(int fd, uid_t uid, uint16_t protocol_version,
+			  event_subscribe_msg_t *req);
+
+#endif	/* !_HAVE_EVENT_MGR_H */
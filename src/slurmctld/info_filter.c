@@ -0,0 +1,275 @@
+/*****************************************************************************\
+ *  info_filter.c - filters evaluated before packing job and node information
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+/*
+ * squeue and sinfo filter the records they receive by partition, state,
+ * user and so on. When the request also carries an info_filter_t, the
+ * controller skips records which can not match before packing them, which
+ * saves both the packing and the transfer of records the client would
+ * discard. The tests here may select more records than the client shows
+ * (e.g. any job state flag matches), the client's own filter remains the
+ * authoritative one.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "src/common/hostlist.h"
+#include "src/common/node_conf.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
+
+#include "src/slurmctld/info_filter.h"
+#include "src/slurmctld/slurmctld.h"
+
+/* A comma separated list split into its names */
+typedef struct {
+	char *buf;
+	char **names;
+	int cnt;
+} name_list_t;
+
+struct job_filter {
+	name_list_t accounts;
+	name_list_t names;
+	hostset_t nodes;
+	name_list_t partitions;
+	uint32_t state_cnt;
+	uint32_t *states;
+	uint32_t user_cnt;
+	uint32_t *user_ids;
+};
+
+static void _name_list_init(name_list_t *list, char *str)
+{
+	char *tok, *save_ptr = NULL;
+	int size = 0;
+
+	if (!str || !str[0])
+		return;
+
+	list->buf = xstrdup(str);
+	tok = strtok_r(list->buf, ",", &save_ptr);
+	while (tok) {
+		if (list->cnt >= size) {
+			size = (size * 2) + 8;
+			xrealloc(list->names, sizeof(char *) * size);
+		}
+		list->names[list->cnt++] = tok;
+		tok = strtok_r(NULL, ",", &save_ptr);
+	}
+}
+
+static void _name_list_fini(name_list_t *list)
+{
+	xfree(list->buf);
+	xfree(list->names);
+}
+
+static bool _name_list_find(name_list_t *list, char *name, bool ignore_case)
+{
+	int i;
+
+	if (!name)
+		return false;
+	for (i = 0; i < list->cnt; i++) {
+		if (ignore_case ? !xstrcasecmp(list->names[i], name) :
+				  !xstrcmp(list->names[i], name))
+			return true;
+	}
+	return false;
+}
+
+/* Return true if any of the comma separated partitions is in the list */
+static bool _part_list_find(name_list_t *list, char *partition)
+{
+	char *part_copy, *tok, *save_ptr = NULL;
+	bool found = false;
+
+	if (!partition)
+		return false;
+	if (!strchr(partition, ','))
+		return _name_list_find(list, partition, false);
+
+	part_copy = xstrdup(partition);
+	tok = strtok_r(part_copy, ",", &save_ptr);
+	while (tok && !found) {
+		found = _name_list_find(list, tok, false);
+		tok = strtok_r(NULL, ",", &save_ptr);
+	}
+	xfree(part_copy);
+
+	return found;
+}
+
+extern job_filter_t *job_filter_create(info_filter_t *filter)
+{
+	job_filter_t *job_filter;
+
+	if (!filter ||
+	    (!filter->accounts && !filter->names && !filter->nodes &&
+	     !filter->partitions && !filter->state_cnt && !filter->user_cnt))
+		return NULL;
+
+	job_filter = xmalloc(sizeof(job_filter_t));
+	_name_list_init(&job_filter->accounts, filter->accounts);
+	_name_list_init(&job_filter->names, filter->names);
+	_name_list_init(&job_filter->partitions, filter->partitions);
+	if (filter->nodes && filter->nodes[0] &&
+	    !(job_filter->nodes = hostset_create(filter->nodes)))
+		job_filter->nodes = hostset_create(NULL);
+	if (filter->state_cnt) {
+		job_filter->state_cnt = filter->state_cnt;
+		job_filter->states = xmalloc(sizeof(uint32_t) *
+					     filter->state_cnt);
+		memcpy(job_filter->states, filter->states,
+		       sizeof(uint32_t) * filter->state_cnt);
+	}
+	if (filter->user_cnt) {
+		job_filter->user_cnt = filter->user_cnt;
+		job_filter->user_ids = xmalloc(sizeof(uint32_t) *
+					       filter->user_cnt);
+		memcpy(job_filter->user_ids, filter->user_ids,
+		       sizeof(uint32_t) * filter->user_cnt);
+	}
+
+	return job_filter;
+}
+
+extern void job_filter_destroy(job_filter_t *job_filter)
+{
+	if (!job_filter)
+		return;
+
+	_name_list_fini(&job_filter->accounts);
+	_name_list_fini(&job_filter->names);
+	_name_list_fini(&job_filter->partitions);
+	if (job_filter->nodes)
+		hostset_destroy(job_filter->nodes);
+	xfree(job_filter->states);
+	xfree(job_filter->user_ids);
+	xfree(job_filter);
+}
+
+static bool _state_match(job_filter_t *job_filter, uint32_t job_state)
+{
+	uint32_t i, state;
+
+	for (i = 0; i < job_filter->state_cnt; i++) {
+		state = job_filter->states[i];
+		if (state & JOB_STATE_FLAGS) {
+			if (state & job_state)
+				return true;
+		} else if (state == (job_state & JOB_STATE_BASE)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+extern bool job_filter_test(job_filter_t *job_filter, uint32_t job_state,
+			    uint32_t user_id, char *account, char *name,
+			    char *partition, char *nodes)
+{
+	uint32_t i;
+
+	if (!job_filter)
+		return true;
+
+	if (job_filter->state_cnt && !_state_match(job_filter, job_state))
+		return false;
+
+	if (job_filter->user_cnt) {
+		for (i = 0; i < job_filter->user_cnt; i++) {
+			if (job_filter->user_ids[i] == user_id)
+				break;
+		}
+		if (i >= job_filter->user_cnt)
+			return false;
+	}
+
+	if (job_filter->partitions.cnt &&
+	    !_part_list_find(&job_filter->partitions, partition))
+		return false;
+
+	if (job_filter->accounts.cnt &&
+	    !_name_list_find(&job_filter->accounts, account, true))
+		return false;
+
+	if (job_filter->names.cnt &&
+	    !_name_list_find(&job_filter->names, name, true))
+		return false;
+
+	if (job_filter->nodes &&
+	    (!nodes || !nodes[0] ||
+	     !hostset_intersects(job_filter->nodes, nodes)))
+		return false;
+
+	return true;
+}
+
+extern bitstr_t *node_filter_bitmap(info_filter_t *filter)
+{
+	bitstr_t *node_bitmap = NULL, *part_bitmap;
+	name_list_t partitions = { 0 };
+	struct part_record *part_ptr;
+	int i;
+
+	if (!filter || (!filter->nodes && !filter->partitions))
+		return NULL;
+
+	if (filter->nodes) {
+		(void) node_name2bitmap(filter->nodes, true, &node_bitmap);
+	} else {
+		node_bitmap = bit_alloc(node_record_count);
+		bit_set_all(node_bitmap);
+	}
+
+	if (filter->partitions) {
+		part_bitmap = bit_alloc(node_record_count);
+		_name_list_init(&partitions, filter->partitions);
+		for (i = 0; i < partitions.cnt; i++) {
+			part_ptr = find_part_record(partitions.names[i]);
+			if (part_ptr && part_ptr->node_bitmap)
+				bit_or(part_bitmap, part_ptr->node_bitmap);
+		}
+		_name_list_fini(&partitions);
+		bit_and(node_bitmap, part_bitmap);
+		FREE_NULL_BITMAP(part_bitmap);
+	}
+
+	return node_bitmap;
+}
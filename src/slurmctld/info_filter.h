@@ -0,0 +1,74 @@
+/*****************************************************************************\
+ *  info_filter.h - filters evaluated before packing job and node information
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#ifndef _HAVE_INFO_FILTER_H
+#define _HAVE_INFO_FILTER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "slurm/slurm.h"
+#include "src/common/bitstring.h"
+
+typedef struct job_filter job_filter_t;
+
+/*
+ * Prepare an info_filter_t from a job information request for use by
+ * job_filter_test()
+ * RET the prepared filter, NULL if the filter selects every job.
+ *     Free with job_filter_destroy().
+ */
+extern job_filter_t *job_filter_create(info_filter_t *filter);
+
+extern void job_filter_destroy(job_filter_t *job_filter);
+
+/*
+ * Test the properties of a job, as packed by pack_job(), against a filter
+ * RET true if the job is to be packed
+ */
+extern bool job_filter_test(job_filter_t *job_filter, uint32_t job_state,
+			    uint32_t user_id, char *account, char *name,
+			    char *partition, char *nodes);
+
+/*
+ * Build the bitmap of nodes selected by the filter of a node information
+ * request.
+ * RET bitmap of nodes to pack, NULL if the filter selects every node.
+ *     Free with FREE_NULL_BITMAP().
+ * NOTE: Caller must hold the node and partition read locks
+ */
+extern bitstr_t *node_filter_bitmap(info_filter_t *filter);
+
+#endif	/* !_HAVE_INFO_FILTER_H */
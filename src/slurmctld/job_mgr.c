@@ -86,11 +86,15 @@
 #include "src/slurmctld/acct_policy.h"
 #include "src/slurmctld/agent.h"
 #include "src/slurmctld/burst_buffer.h"
+#include "src/slurmctld/depend_index.h"
 #include "src/slurmctld/fed_mgr.h"
 #include "src/slurmctld/front_end.h"
 #include "src/slurmctld/gang.h"
+#include "src/slurmctld/info_filter.h"
+#include "src/slurmctld/job_queue.h"
 #include "src/slurmctld/job_scheduler.h"
 #include "src/slurmctld/job_submit.h"
+#include "src/slurmctld/job_timer.h"
 #include "src/slurmctld/licenses.h"
 #include "src/slurmctld/locks.h"
 #include "src/slurmctld/node_scheduler.h"
@@ -98,9 +102,11 @@
 #include "src/slurmctld/proc_req.h"
 #include "src/slurmctld/reservation.h"
 #include "src/slurmctld/sched_plugin.h"
+#include "src/slurmctld/script_store.h"
 #include "src/slurmctld/slurmctld.h"
 #include "src/slurmctld/slurmctld_plugstack.h"
 #include "src/slurmctld/srun_comm.h"
+#include "src/slurmctld/state_repl.h"
 #include "src/slurmctld/state_save.h"
 #include "src/slurmctld/trigger_mgr.h"
 
@@ -135,6 +141,7 @@ typedef struct {
 typedef struct {
 	Buf       buffer;
 	uint32_t  filter_uid;
+	job_filter_t *job_filter;
 	uint32_t *jobs_packed;
 	uint16_t  protocol_version;
 	uint16_t  show_flags;
@@ -164,15 +171,22 @@ static uint32_t max_array_size = NO_VAL;
 static bitstr_t *requeue_exit = NULL;
 static bitstr_t *requeue_exit_hold = NULL;
 static int	select_serial = -1;
+static List	batch_dir_index = NULL;	/* batch dirs named in job_state */
+static bool	batch_dir_scan = false;	/* scan deferred by the index */
 
 /* Local functions */
 static void _add_job_hash(struct job_record *job_ptr);
 static void _add_job_array_hash(struct job_record *job_ptr);
+static void _build_data_array(char *buffer, int buf_size, uint32_t rec_cnt,
+			      char *desc, char ***data, uint32_t *size,
+			      struct job_record *job_ptr);
 static int  _checkpoint_job_record (struct job_record *job_ptr,
 				    char *image_dir);
 static void _clear_job_gres_details(struct job_record *job_ptr);
 static int  _copy_job_desc_to_file(job_desc_msg_t * job_desc,
 				   uint32_t job_id);
+static bool _copy_job_desc_to_store(job_desc_msg_t *job_desc,
+				    struct job_record *job_ptr);
 static int  _copy_job_desc_to_job_record(job_desc_msg_t * job_desc,
 					 struct job_record **job_ptr,
 					 bitstr_t ** exc_bitmap,
@@ -181,6 +195,7 @@ static char *_copy_nodelist_no_dup(char *node_list);
 static struct job_record *_create_job_record(uint32_t num_jobs);
 static void _delete_job_details(struct job_record *job_entry);
 static void _del_batch_list_rec(void *x);
+static void _dump_batch_dir_index(Buf buffer);
 static slurmdb_qos_rec_t *_determine_and_validate_qos(
 	char *resv_name, slurmdb_assoc_rec_t *assoc_ptr,
 	bool operator, slurmdb_qos_rec_t *qos_rec, int *error_code,
@@ -209,7 +224,7 @@ static bitstr_t *_make_requeue_array(char *conf_buf);
 static uint32_t _max_switch_wait(uint32_t input_wait);
 static void _notify_srun_missing_step(struct job_record *job_ptr, int node_inx,
 				      time_t now, time_t node_boot_time);
-static int  _open_job_state_file(char **state_file);
+static Buf  _open_job_state_file(char **state_file);
 static time_t _get_last_job_state_write_time(void);
 static void _pack_job_for_ckpt (struct job_record *job_ptr, Buf buffer);
 static void _pack_default_job_details(struct job_record *job_ptr,
@@ -259,7 +274,7 @@ static int  _valid_job_part(job_desc_msg_t * job_desc,
 static int  _validate_job_desc(job_desc_msg_t * job_desc_msg, int allocate,
 			       uid_t submit_uid, struct part_record *part_ptr,
 			       List part_list);
-static void _validate_job_files(List batch_dirs);
+static void _validate_job_files(List batch_dirs, bool indexed);
 static bool _valid_pn_min_mem(struct job_record *job_ptr,
 			      struct part_record *part_ptr);
 static int  _write_data_to_file(char *file_name, char *data);
@@ -490,6 +505,19 @@ static struct job_record *_create_job_record(uint32_t num_jobs)
 }
 
 
+/* Release the script store data referenced by a job's details */
+static void _release_stored_job_files(struct job_details *detail_ptr)
+{
+	if (detail_ptr->env_hash) {
+		script_store_unref(detail_ptr->env_hash);
+		xfree(detail_ptr->env_hash);
+	}
+	if (detail_ptr->script_hash) {
+		script_store_unref(detail_ptr->script_hash);
+		xfree(detail_ptr->script_hash);
+	}
+}
+
 /*
  * _delete_job_details - delete a job's detail record and clear it's pointer
  * IN job_entry - pointer to job_record to clear the record of
@@ -507,12 +535,14 @@ static void _delete_job_details(struct job_record *job_entry)
 	 * Queue up job to have the batch script and environment deleted.
 	 * This is handled by a separate thread to limit the amount of
 	 * time purge_old_job needs to spend holding locks.
+	 * Jobs using the script store have no files of their own.
 	 */
-	if (IS_JOB_FINISHED(job_entry)) {
+	if (IS_JOB_FINISHED(job_entry) && !job_entry->details->script_hash) {
 		uint32_t *job_id = xmalloc(sizeof(uint32_t));
 		*job_id = job_entry->job_id;
 		list_enqueue(purge_files_list, job_id);
 	}
+	_release_stored_job_files(job_entry->details);
 
 	xfree(job_entry->details->acctg_freq);
 	for (i=0; i<job_entry->details->argc; i++)
@@ -664,6 +694,45 @@ static slurmdb_qos_rec_t *_determine_and_validate_qos(
 	return qos_ptr;
 }
 
+static int _pack_batch_dir_id(void *x, void *arg)
+{
+	uint32_t *job_id_ptr = (uint32_t *) x;
+
+	pack32(*job_id_ptr, (Buf) arg);
+	return 0;
+}
+
+/*
+ * Pack the IDs of every job with a batch script directory, jobs flagged with
+ * HAS_STATE_DIR plus those whose files are still waiting to be purged. This
+ * lets sync_job_files() validate the directories on restart without reading
+ * every hash.#/job.# entry.
+ * NOTE: Caller must hold the job read lock
+ */
+static void _dump_batch_dir_index(Buf buffer)
+{
+	ListIterator job_iterator;
+	struct job_record *job_ptr;
+	uint32_t dir_cnt = 0, cnt_offset, end_offset;
+
+	cnt_offset = get_buf_offset(buffer);
+	pack32(dir_cnt, buffer);
+	job_iterator = list_iterator_create(job_list);
+	while ((job_ptr = (struct job_record *) list_next(job_iterator))) {
+		if (!(job_ptr->bit_flags & HAS_STATE_DIR))
+			continue;
+		pack32(job_ptr->job_id, buffer);
+		dir_cnt++;
+	}
+	list_iterator_destroy(job_iterator);
+	dir_cnt += list_for_each(purge_files_list, _pack_batch_dir_id, buffer);
+
+	end_offset = get_buf_offset(buffer);
+	set_buf_offset(buffer, cnt_offset);
+	pack32(dir_cnt, buffer);
+	set_buf_offset(buffer, end_offset);
+}
+
 /*
  * dump_all_job_state - save the state of all jobs to file for checkpoint
  *	Changes here should be reflected in load_last_job_id() and
@@ -685,6 +754,7 @@ int dump_all_job_state(void)
 	Buf buffer = init_buf(high_buffer_size);
 	time_t now = time(NULL);
 	time_t last_state_file_time;
+	uint32_t *rec_off = NULL, rec_cnt = 0;
 	DEF_TIMERS;
 
 	START_TIMER;
@@ -722,10 +792,18 @@ int dump_all_job_state(void)
 	debug3("Writing job id %u to header record of job_state file",
 	       job_id_sequence);
 
-	/* write individual job records */
 	lock_slurmctld(job_read_lock);
+	_dump_batch_dir_index(buffer);
+
+	/* write individual job records */
+	if (state_repl_active()) {
+		rec_off = xmalloc(sizeof(uint32_t) *
+				  (list_count(job_list) + 1));
+	}
 	job_iterator = list_iterator_create(job_list);
 	while ((job_ptr = (struct job_record *) list_next(job_iterator))) {
+		if (rec_off)
+			rec_off[rec_cnt++] = get_buf_offset(buffer);
 		_dump_job_state(job_ptr, buffer);
 	}
 	list_iterator_destroy(job_iterator);
@@ -802,6 +880,9 @@ int dump_all_job_state(void)
 	xfree(new_file);
 	unlock_state_files();
 
+	if (rec_off && !error_code)
+		state_repl_publish(STATE_REPL_JOB, buffer, rec_off, rec_cnt);
+	xfree(rec_off);
 	free_buf(buffer);
 	END_TIMER2("dump_all_job_state");
 	return error_code;
@@ -819,31 +900,28 @@ static int _find_resv_part(void *x, void *key)
 
 /* Open the job state save file, or backup if necessary.
  * state_file IN - the name of the state save file used
- * RET the file description to read from or error code
+ * RET buffer mapping the file contents or NULL on error
  */
-static int _open_job_state_file(char **state_file)
+static Buf _open_job_state_file(char **state_file)
 {
-	int state_fd;
-	struct stat stat_buf;
+	Buf buffer;
 
 	*state_file = xstrdup_printf("%s/job_state",
 				     slurmctld_conf.state_save_location);
-	state_fd = open(*state_file, O_RDONLY);
-	if (state_fd < 0) {
+	if ((buffer = state_repl_open(STATE_REPL_JOB, *state_file)))
+		return buffer;
+	buffer = create_mmap_buf(*state_file);
+	if (!buffer) {
 		error("Could not open job state file %s: %m", *state_file);
-	} else if (fstat(state_fd, &stat_buf) < 0) {
-		error("Could not stat job state file %s: %m", *state_file);
-		(void) close(state_fd);
-	} else if (stat_buf.st_size < 10) {
+	} else if (size_buf(buffer) < 10) {
 		error("Job state file %s too small", *state_file);
-		(void) close(state_fd);
+		free_buf(buffer);
 	} else	/* Success */
-		return state_fd;
+		return buffer;
 
 	error("NOTE: Trying backup state save file. Jobs may be lost!");
 	xstrcat(*state_file, ".old");
-	state_fd = open(*state_file, O_RDONLY);
-	return state_fd;
+	return create_mmap_buf(*state_file);
 }
 
 extern void set_job_tres_req_str(struct job_record *job_ptr,
@@ -900,10 +978,7 @@ extern void backup_slurmctld_restart(void)
  * error */
 static time_t _get_last_job_state_write_time(void)
 {
-	int data_allocated, data_read = 0, error_code = SLURM_SUCCESS;
-	uint32_t data_size = 0;
-	int state_fd;
-	char *data, *state_file;
+	char *state_file;
 	Buf buffer;
 	time_t buf_time = (time_t) 0;
 	char *ver_str = NULL;
@@ -911,37 +986,14 @@ static time_t _get_last_job_state_write_time(void)
 	uint16_t protocol_version = NO_VAL16;
 
 	/* read the file */
-	state_fd = _open_job_state_file(&state_file);
-	if (state_fd < 0) {
+	buffer = _open_job_state_file(&state_file);
+	if (!buffer) {
 		info("No job state file (%s) found", state_file);
-		error_code = ENOENT;
-	} else {
-		data_allocated = 128;
-		data = xmalloc(data_allocated);
-		while (1) {
-			data_read = read(state_fd, &data[data_size],
-					 (data_allocated - data_size));
-			if (data_read < 0) {
-				if (errno == EINTR)
-					continue;
-				else {
-					error("Read error on %s: %m",
-					      state_file);
-					break;
-				}
-			} else if (data_read == 0)	/* eof */
-				break;
-			data_size += data_read;
-			if (data_size >= 128)
-				break;
-		}
-		close(state_fd);
+		xfree(state_file);
+		return buf_time;
 	}
 	xfree(state_file);
-	if (error_code)
-		return buf_time;
 
-	buffer = create_buf(data, data_size);
 	safe_unpackstr_xmalloc(&ver_str, &ver_str_len, buffer);
 	if (ver_str && !xstrcmp(ver_str, JOB_STATE_VERSION))
 		safe_unpack16(&protocol_version, buffer);
@@ -961,10 +1013,9 @@ unpack_error:
  */
 extern int load_all_job_state(void)
 {
-	int data_allocated, data_read = 0, error_code = SLURM_SUCCESS;
-	uint32_t data_size = 0;
-	int state_fd, job_cnt = 0;
-	char *data = NULL, *state_file;
+	int error_code = SLURM_SUCCESS;
+	int job_cnt = 0;
+	char *state_file;
 	Buf buffer;
 	time_t buf_time;
 	uint32_t saved_job_id;
@@ -975,40 +1026,18 @@ extern int load_all_job_state(void)
 
 	/* read the file */
 	lock_state_files();
-	state_fd = _open_job_state_file(&state_file);
-	if (state_fd < 0) {
+	buffer = _open_job_state_file(&state_file);
+	if (!buffer) {
 		info("No job state file (%s) to recover", state_file);
 		xfree(state_file);
 		unlock_state_files();
 		return ENOENT;
-	} else {
-		data_allocated = BUF_SIZE;
-		data = xmalloc(data_allocated);
-		while (1) {
-			data_read = read(state_fd, &data[data_size],
-					 BUF_SIZE);
-			if (data_read < 0) {
-				if (errno == EINTR)
-					continue;
-				else {
-					error("Read error on %s: %m",
-					      state_file);
-					break;
-				}
-			} else if (data_read == 0)	/* eof */
-				break;
-			data_size      += data_read;
-			data_allocated += data_read;
-			xrealloc(data, data_allocated);
-		}
-		close(state_fd);
 	}
 	xfree(state_file);
 	unlock_state_files();
 
 	job_id_sequence = MAX(job_id_sequence, slurmctld_conf.first_job_id);
 
-	buffer = create_buf(data, data_size);
 	safe_unpackstr_xmalloc(&ver_str, &ver_str_len, buffer);
 	debug3("Version string in job_state header is %s", ver_str);
 	if (ver_str && !xstrcmp(ver_str, JOB_STATE_VERSION))
@@ -1031,6 +1060,19 @@ extern int load_all_job_state(void)
 		job_id_sequence = MAX(saved_job_id, job_id_sequence);
 	debug3("Job id in job_state header is %u", saved_job_id);
 
+	FREE_NULL_LIST(batch_dir_index);
+	if (protocol_version >= SLURM_18_08_PROTOCOL_VERSION) {
+		uint32_t dir_cnt, *job_id_ptr, i;
+
+		safe_unpack32(&dir_cnt, buffer);
+		batch_dir_index = list_create(_del_batch_list_rec);
+		for (i = 0; i < dir_cnt; i++) {
+			job_id_ptr = xmalloc(sizeof(uint32_t));
+			list_append(batch_dir_index, job_id_ptr);
+			safe_unpack32(job_id_ptr, buffer);
+		}
+	}
+
 	assoc_mgr_lock(&locks);
 	while (remaining_buf(buffer) > 0) {
 		error_code = _load_job_state(buffer, protocol_version);
@@ -1047,6 +1089,7 @@ extern int load_all_job_state(void)
 
 unpack_error:
 	assoc_mgr_unlock(&locks);
+	FREE_NULL_LIST(batch_dir_index);	/* Scan directories instead */
 	if (!ignore_state_errors)
 		fatal("Incomplete job state save file, start with '-i' to ignore this");
 	error("Incomplete job state save file");
@@ -1062,10 +1105,7 @@ unpack_error:
  */
 extern int load_last_job_id( void )
 {
-	int data_allocated, data_read = 0;
-	uint32_t data_size = 0;
-	int state_fd;
-	char *data = NULL, *state_file;
+	char *state_file;
 	Buf buffer;
 	time_t buf_time;
 	char *ver_str = NULL;
@@ -1076,38 +1116,16 @@ extern int load_last_job_id( void )
 	state_file = xstrdup_printf("%s/job_state",
 				    slurmctld_conf.state_save_location);
 	lock_state_files();
-	state_fd = open(state_file, O_RDONLY);
-	if (state_fd < 0) {
+	buffer = create_mmap_buf(state_file);
+	if (!buffer) {
 		debug("No job state file (%s) to recover", state_file);
 		xfree(state_file);
 		unlock_state_files();
 		return ENOENT;
-	} else {
-		data_allocated = BUF_SIZE;
-		data = xmalloc(data_allocated);
-		while (1) {
-			data_read = read(state_fd, &data[data_size],
-					 BUF_SIZE);
-			if (data_read < 0) {
-				if (errno == EINTR)
-					continue;
-				else {
-					error("Read error on %s: %m",
-					      state_file);
-					break;
-				}
-			} else if (data_read == 0)	/* eof */
-				break;
-			data_size      += data_read;
-			data_allocated += data_read;
-			xrealloc(data, data_allocated);
-		}
-		close(state_fd);
 	}
 	xfree(state_file);
 	unlock_state_files();
 
-	buffer = create_buf(data, data_size);
 	safe_unpackstr_xmalloc(&ver_str, &ver_str_len, buffer);
 	debug3("Version string in job_state header is %s", ver_str);
 	if (ver_str && !xstrcmp(ver_str, JOB_STATE_VERSION))
@@ -2334,8 +2352,8 @@ static int _load_job_state(Buf buffer, uint16_t protocol_version)
 		job_ptr->state_reason = FAIL_ACCOUNT;
 	} else {
 		job_ptr->assoc_id = assoc_rec.id;
-		info("Recovered %s Assoc=%u",
-		     jobid2str(job_ptr, jbuf, sizeof(jbuf)), job_ptr->assoc_id);
+		debug("Recovered %s Assoc=%u",
+		      jobid2str(job_ptr, jbuf, sizeof(jbuf)), job_ptr->assoc_id);
 
 		/* make sure we have started this job in accounting */
 		if (!job_ptr->db_index) {
@@ -2533,6 +2551,8 @@ void _dump_job_details(struct job_details *detail_ptr, Buf buffer)
 			     SLURM_PROTOCOL_VERSION);
 	packstr_array(detail_ptr->argv, detail_ptr->argc, buffer);
 	packstr_array(detail_ptr->env_sup, detail_ptr->env_cnt, buffer);
+	packstr(detail_ptr->env_hash, buffer);
+	packstr(detail_ptr->script_hash, buffer);
 }
 
 /* _load_job_details - Unpack a job details information from buffer */
@@ -2544,6 +2564,7 @@ static int _load_job_details(struct job_record *job_ptr, Buf buffer,
 	char *orig_dependency = NULL, *mem_bind, *cluster_features = NULL;
 	char *err = NULL, *in = NULL, *out = NULL, *work_dir = NULL;
 	char *ckpt_dir = NULL, *restart_dir = NULL;
+	char *env_hash = NULL, *script_hash = NULL;
 	char **argv = (char **) NULL, **env_sup = (char **) NULL;
 	uint32_t min_nodes, max_nodes;
 	uint32_t min_cpus = 1, max_cpus = NO_VAL;
@@ -2620,6 +2641,8 @@ static int _load_job_details(struct job_record *job_ptr, Buf buffer,
 			goto unpack_error;
 		safe_unpackstr_array(&argv, &argc, buffer);
 		safe_unpackstr_array(&env_sup, &env_cnt, buffer);
+		safe_unpackstr_xmalloc(&env_hash, &name_len, buffer);
+		safe_unpackstr_xmalloc(&script_hash, &name_len, buffer);
 	} else if (protocol_version >= SLURM_17_11_PROTOCOL_VERSION) {
 		safe_unpack32(&min_cpus, buffer);
 		safe_unpack32(&max_cpus, buffer);
@@ -2776,6 +2799,7 @@ static int _load_job_details(struct job_record *job_ptr, Buf buffer,
 	xfree(job_ptr->details->work_dir);
 	xfree(job_ptr->details->ckpt_dir);
 	xfree(job_ptr->details->restart_dir);
+	_release_stored_job_files(job_ptr->details);
 
 	/* now put the details into the job record */
 	job_ptr->details->acctg_freq = acctg_freq;
@@ -2831,6 +2855,22 @@ static int _load_job_details(struct job_record *job_ptr, Buf buffer,
 	job_ptr->details->ckpt_dir = ckpt_dir;
 	job_ptr->details->restart_dir = restart_dir;
 
+	/* Reference the job's script and environment in the script store */
+	if (script_hash && env_hash && script_store_ref(script_hash)) {
+		if (script_store_ref(env_hash)) {
+			job_ptr->details->env_hash = env_hash;
+			job_ptr->details->script_hash = script_hash;
+			env_hash = script_hash = NULL;
+		} else {
+			script_store_unref(script_hash);
+		}
+	}
+	if (script_hash || env_hash) {
+		error("Script store data missing for job %u", job_ptr->job_id);
+		xfree(env_hash);
+		xfree(script_hash);
+	}
+
 	return SLURM_SUCCESS;
 
 unpack_error:
@@ -2856,6 +2896,8 @@ unpack_error:
 	xfree(work_dir);
 	xfree(ckpt_dir);
 	xfree(restart_dir);
+	xfree(env_hash);
+	xfree(script_hash);
 	return SLURM_FAILURE;
 }
 
@@ -4404,6 +4446,9 @@ extern struct job_record *job_array_split(struct job_record *job_ptr)
 	job_ptr_pend->details  = save_details;
 	job_ptr_pend->step_list = save_step_list;
 	job_ptr_pend->db_index = save_db_index;
+	job_ptr_pend->queue_node = NULL;
+	job_ptr_pend->timer_inx = 0;
+	job_ptr_pend->bit_flags &= ~HAS_STATE_DIR;
 
 	job_ptr_pend->prio_factors = save_prio_factors;
 	slurm_copy_priority_factors_object(job_ptr_pend->prio_factors,
@@ -4552,6 +4597,7 @@ extern struct job_record *job_array_split(struct job_record *job_ptr)
 	details_new->cpu_freq_max = job_details->cpu_freq_max;
 	details_new->cpu_freq_gov = job_details->cpu_freq_gov;
 	details_new->depend_list = depended_list_copy(job_details->depend_list);
+	details_new->depend_test_time = 0;	/* not in depend_index */
 	details_new->dependency = xstrdup(job_details->dependency);
 	details_new->orig_dependency = xstrdup(job_details->orig_dependency);
 	if (job_details->env_cnt) {
@@ -4562,6 +4608,9 @@ extern struct job_record *job_array_split(struct job_record *job_ptr)
 				xstrdup(job_details->env_sup[i]);
 		}
 	}
+	details_new->env_hash = xstrdup(job_details->env_hash);
+	if (details_new->env_hash)
+		(void) script_store_ref(details_new->env_hash);
 	if (job_details->exc_node_bitmap) {
 		details_new->exc_node_bitmap =
 			bit_copy(job_details->exc_node_bitmap);
@@ -4584,6 +4633,9 @@ extern struct job_record *job_array_split(struct job_record *job_ptr)
 	}
 	details_new->req_nodes = xstrdup(job_details->req_nodes);
 	details_new->restart_dir = xstrdup(job_details->restart_dir);
+	details_new->script_hash = xstrdup(job_details->script_hash);
+	if (details_new->script_hash)
+		(void) script_store_ref(details_new->script_hash);
 	details_new->std_err = xstrdup(job_details->std_err);
 	details_new->std_in = xstrdup(job_details->std_in);
 	details_new->std_out = xstrdup(job_details->std_out);
@@ -4592,6 +4644,8 @@ extern struct job_record *job_array_split(struct job_record *job_ptr)
 	if (job_ptr->fed_details)
 		add_fed_job_info(job_ptr);
 
+	job_queue_update(job_ptr_pend);
+
 	return job_ptr_pend;
 }
 
@@ -5007,6 +5061,8 @@ extern int job_allocate(job_desc_msg_t * job_specs, int immediate,
 		job_ptr->array_recs->task_cnt : 1;
 
 	acct_policy_add_job_submit(job_ptr);
+	job_queue_update(job_ptr);
+	job_queue_split_array_add(job_ptr);
 
 	if ((error_code == ESLURM_REQUESTED_PART_CONFIG_UNAVAILABLE) &&
 	    (slurmctld_conf.enforce_part_limits != PARTITION_ENFORCE_NONE))
@@ -5889,6 +5945,7 @@ static int _job_complete(struct job_record *job_ptr, uid_t uid, bool requeue,
 		/* Since the job completion logger removes the job submit
 		 * information, we need to add it again. */
 		acct_policy_add_job_submit(job_ptr);
+		job_queue_update(job_ptr);
 		if (node_fail) {
 			info("%s: requeue %s due to node failure",
 			     __func__, jobid2str(job_ptr, jbuf, sizeof(jbuf)));
@@ -7042,10 +7099,13 @@ static int _job_create(job_desc_msg_t *job_desc, int allocate, int will_run,
 
 	if (job_desc->script
 	    &&  (!will_run)) {	/* don't bother with copy if just a test */
-		if ((error_code = _copy_job_desc_to_file(job_desc,
-							 job_ptr->job_id))) {
-			error_code = ESLURM_WRITING_TO_FILE;
-			goto cleanup_fail;
+		if (!_copy_job_desc_to_store(job_desc, job_ptr)) {
+			if ((error_code = _copy_job_desc_to_file(job_desc,
+							job_ptr->job_id))) {
+				error_code = ESLURM_WRITING_TO_FILE;
+				goto cleanup_fail;
+			}
+			job_ptr->bit_flags |= HAS_STATE_DIR;
 		}
 		job_ptr->batch_flag = 1;
 	} else
@@ -7373,6 +7433,53 @@ extern int validate_job_create_req(job_desc_msg_t * job_desc, uid_t submit_uid,
 	return SLURM_SUCCESS;
 }
 
+/*
+ * _copy_job_desc_to_store - add the job script and environment from the RPC
+ *	structure to the script store
+ * RET true on success, false if they must be copied into files instead
+ */
+static bool _copy_job_desc_to_store(job_desc_msg_t *job_desc,
+				    struct job_record *job_ptr)
+{
+	struct job_details *detail_ptr = job_ptr->details;
+	char *env_data;
+	uint32_t env_cnt = 0, env_len, i, len, pos;
+	DEF_TIMERS;
+
+	/* Burst buffer plugins read the script file in the job's directory */
+	if (!script_store_enabled() || slurmctld_conf.bb_type)
+		return false;
+
+	START_TIMER;
+	/* Same format as _write_data_array_to_file() */
+	if (job_desc->environment)
+		env_cnt = job_desc->env_size;
+	env_len = sizeof(uint32_t);
+	for (i = 0; i < env_cnt; i++)
+		env_len += strlen(job_desc->environment[i]) + 1;
+	env_data = xmalloc(env_len);
+	memcpy(env_data, &env_cnt, sizeof(uint32_t));
+	pos = sizeof(uint32_t);
+	for (i = 0; i < env_cnt; i++) {
+		len = strlen(job_desc->environment[i]) + 1;
+		memcpy(env_data + pos, job_desc->environment[i], len);
+		pos += len;
+	}
+
+	detail_ptr->script_hash = script_store_add(job_desc->script,
+						   strlen(job_desc->script) + 1);
+	if (detail_ptr->script_hash)
+		detail_ptr->env_hash = script_store_add(env_data, env_len);
+	xfree(env_data);
+	END_TIMER2("_copy_job_desc_to_store");
+
+	if (!detail_ptr->env_hash) {
+		_release_stored_job_files(detail_ptr);
+		return false;
+	}
+	return true;
+}
+
 /* _copy_job_desc_to_file - copy the job script and environment from the RPC
  *	structure into a file */
 static int
@@ -7532,6 +7639,41 @@ static int _write_data_to_file(char *file_name, char *data)
 	return SLURM_SUCCESS;
 }
 
+/* Return a job's environment variables from the script store */
+static char **_get_stored_job_env(struct job_record *job_ptr,
+				  uint32_t *env_size)
+{
+	char *data, **environment = NULL;
+	uint32_t len = 0, rec_cnt;
+
+	*env_size = 0;
+	data = script_store_get(job_ptr->details->env_hash, &len);
+	if (!data || (len < sizeof(uint32_t))) {
+		error("Could not read environment of job %u from script store",
+		      job_ptr->job_id);
+		xfree(data);
+		return NULL;
+	}
+
+	memcpy(&rec_cnt, data, sizeof(uint32_t));
+	if (rec_cnt >= INT_MAX) {
+		error("%s: unreasonable record counter %u for job %u",
+		      __func__, rec_cnt, job_ptr->job_id);
+		xfree(data);
+		return NULL;
+	}
+	len -= sizeof(uint32_t);
+	memmove(data, data + sizeof(uint32_t), len);
+	data[len] = '\0';
+	if (rec_cnt == 0) {
+		xfree(data);
+		return NULL;
+	}
+	_build_data_array(data, len, rec_cnt, job_ptr->details->env_hash,
+			  &environment, env_size, job_ptr);
+	return environment;
+}
+
 /*
  * get_job_env - return the environment variables and their count for a
  *	given job
@@ -7545,6 +7687,9 @@ char **get_job_env(struct job_record *job_ptr, uint32_t * env_size)
 	int cc, fd = -1, hash;
 	uint32_t use_id;
 
+	if (job_ptr->details && job_ptr->details->env_hash)
+		return _get_stored_job_env(job_ptr, env_size);
+
 	use_id = (job_ptr->array_task_id != NO_VAL) ?
 		job_ptr->array_job_id : job_ptr->job_id;
 	hash = use_id % 10;
@@ -7582,6 +7727,17 @@ char *get_job_script(struct job_record *job_ptr)
 	if (!job_ptr->batch_flag)
 		return NULL;
 
+	if (job_ptr->details && job_ptr->details->script_hash) {
+		uint32_t len;
+
+		if (!(script = script_store_get(job_ptr->details->script_hash,
+						&len))) {
+			error("Could not read script of job %u from script "
+			      "store", job_ptr->job_id);
+		}
+		return script;
+	}
+
 	use_id = (job_ptr->array_task_id != NO_VAL) ?
 		job_ptr->array_job_id : job_ptr->job_id;
 	hash = use_id % 10;
@@ -7616,8 +7772,8 @@ static int
 _read_data_array_from_file(int fd, char *file_name, char ***data,
 			    uint32_t * size, struct job_record *job_ptr)
 {
-	int pos, buf_size, amount, i, j;
-	char *buffer, **array_ptr;
+	int pos, buf_size, amount;
+	char *buffer;
 	uint32_t rec_cnt;
 
 	xassert(file_name);
@@ -7665,6 +7821,31 @@ _read_data_array_from_file(int fd, char *file_name, char ***data,
 		xrealloc(buffer, buf_size + 1);
 	}
 
+	_build_data_array(buffer, pos, rec_cnt, file_name, data, size,
+			  job_ptr);
+	return 0;
+}
+
+/*
+ * Build an array of pointers to the strings in a buffer, adding the job's
+ * supplemental environment variables
+ * IN buffer - xmalloc()ed, rec_cnt NUL terminated strings followed by a NUL,
+ *	becomes the storage of the array's strings
+ * IN buf_size - length of the strings in buffer
+ * IN rec_cnt - count of strings in buffer, must not be zero
+ * IN desc - file name or script store key of the data, for error messages
+ * OUT data - pointer to array of pointers to strings
+ * OUT size - number of elements in data
+ * IN job_ptr - job
+ * NOTE: The output format of this must be identical with _xduparray2()
+ */
+static void _build_data_array(char *buffer, int buf_size, uint32_t rec_cnt,
+			      char *desc, char ***data, uint32_t *size,
+			      struct job_record *job_ptr)
+{
+	int pos = buf_size, i, j;
+	char **array_ptr;
+
 	/* Allocate extra space for supplemental environment variables */
 	if (job_ptr->details->env_cnt) {
 		for (j = 0; j < job_ptr->details->env_cnt; j++)
@@ -7679,7 +7860,7 @@ _read_data_array_from_file(int fd, char *file_name, char ***data,
 		array_ptr[i] = &buffer[pos];
 		pos += strlen(&buffer[pos]) + 1;
 		if ((pos > buf_size) && ((i + 1) < rec_cnt)) {
-			error("Bad environment file %s", file_name);
+			error("Bad environment file %s", desc);
 			rec_cnt = i;
 			break;
 		}
@@ -7724,7 +7905,6 @@ _read_data_array_from_file(int fd, char *file_name, char ***data,
 
 	*size = rec_cnt;
 	*data = array_ptr;
-	return 0;
 }
 
 /*
@@ -8590,6 +8770,7 @@ extern void job_config_fini(struct job_record *job_ptr)
 	 */
 	if (slurmctld_conf.prolog_flags & PROLOG_FLAG_ALLOC)
 		launch_prolog(job_ptr);
+	job_timer_arm(job_ptr);
 }
 
 /*
@@ -8683,232 +8864,262 @@ static bool _pack_configuring_test(struct job_record *job_ptr)
 }
 
 /*
- * job_time_limit - terminate jobs which have exceeded their time limit
- * global: job_list - pointer global job list
- *	last_job_update - time of last job table update
+ * Test one job for configuration completion and the limits enforced by
+ * job_time_limit().
+ * RET true if the job was subject to the time limit tests, which can take a
+ * long time on some platforms, false otherwise
  */
-void job_time_limit(void)
+static bool _job_time_limit_test(struct job_record *job_ptr, time_t now,
+				 time_t old, uint32_t resv_over_run)
 {
-	ListIterator job_iterator;
-	struct job_record *job_ptr;
-	time_t now = time(NULL);
-	time_t old = now - ((slurmctld_conf.inactive_limit * 4 / 3) +
-			    slurmctld_conf.msg_timeout + 1);
 	time_t over_run;
 	uint16_t over_time_limit;
 	uint8_t prolog;
-	int job_test_count = 0;
-	uint32_t resv_over_run = slurmctld_conf.resv_over_run;
 
-	xassert(verify_lock(JOB_LOCK, WRITE_LOCK));
+	xassert (job_ptr->magic == JOB_MAGIC);
 
-	if (resv_over_run == INFINITE16)
-		resv_over_run = YEAR_SECONDS;
+	if (job_ptr->details)
+		prolog = job_ptr->details->prolog_running;
 	else
-		resv_over_run *= 60;
+		prolog = 0;
+	if ((prolog == 0) && IS_JOB_CONFIGURING(job_ptr) &&
+	    test_job_nodes_ready(job_ptr)) {
+		char job_id_buf[JBUFSIZ];
+		info("%s: Configuration for %s complete", __func__,
+		     jobid2fmt(job_ptr, job_id_buf,sizeof(job_id_buf)));
+		job_config_fini(job_ptr);
+		if (job_ptr->bit_flags & NODE_REBOOT) {
+			job_ptr->bit_flags &= (~NODE_REBOOT);
+			job_validate_mem(job_ptr);
+			if (job_ptr->batch_flag)
+				launch_job(job_ptr);
+		}
+	}
 
 	/*
-	 * locks same as in _slurmctld_background() (The only current place this
-	 * is called).
+	 * Features have been changed on some node, make job eligiable
+	 * to run and test to see if it can run now
 	 */
-	slurmctld_lock_t job_write_lock = {
-		READ_LOCK, WRITE_LOCK, WRITE_LOCK, READ_LOCK, READ_LOCK };
-	DEF_TIMERS;
-
-	job_iterator = list_iterator_create(job_list);
-	START_TIMER;
-	while ((job_ptr = list_next(job_iterator))) {
-		xassert (job_ptr->magic == JOB_MAGIC);
-		job_test_count++;
-
-		if (job_ptr->details)
-			prolog = job_ptr->details->prolog_running;
-		else
-			prolog = 0;
-		if ((prolog == 0) && IS_JOB_CONFIGURING(job_ptr) &&
-		    test_job_nodes_ready(job_ptr)) {
-			char job_id_buf[JBUFSIZ];
-			info("%s: Configuration for %s complete", __func__,
-			     jobid2fmt(job_ptr, job_id_buf,sizeof(job_id_buf)));
-			job_config_fini(job_ptr);
-			if (job_ptr->bit_flags & NODE_REBOOT) {
-				job_ptr->bit_flags &= (~NODE_REBOOT);
-				job_validate_mem(job_ptr);
-				if (job_ptr->batch_flag)
-					launch_job(job_ptr);
-			}
-		}
-
-		/*
-		 * Features have been changed on some node, make job eligiable
-		 * to run and test to see if it can run now
-		 */
-		if (node_features_updated &&
-		    (job_ptr->state_reason == FAIL_BAD_CONSTRAINTS) &&
-		    IS_JOB_PENDING(job_ptr) && (job_ptr->priority == 0)) {
-			job_ptr->state_reason = WAIT_NO_REASON;
-			set_job_prio(job_ptr);
-			last_job_update = now;
-		}
+	if (node_features_updated &&
+	    (job_ptr->state_reason == FAIL_BAD_CONSTRAINTS) &&
+	    IS_JOB_PENDING(job_ptr) && (job_ptr->priority == 0)) {
+		job_ptr->state_reason = WAIT_NO_REASON;
+		set_job_prio(job_ptr);
+		last_job_update = now;
+	}
 
-		if (_pack_configuring_test(job_ptr))
-			continue;
+	if (_pack_configuring_test(job_ptr))
+		return false;
 
-		if (!IS_JOB_RUNNING(job_ptr) && !IS_JOB_SUSPENDED(job_ptr))
-			continue;
+	if (!IS_JOB_RUNNING(job_ptr) && !IS_JOB_SUSPENDED(job_ptr))
+		return false;
 
-		/*
-		 * everything above here is considered "quick", and skips the
-		 * timeout at the bottom of the loop by using a continue.
-		 * everything below is considered "slow", and needs to jump to
-		 * time_check before the next job is tested
-		 */
-		if (job_ptr->preempt_time &&
-		    (IS_JOB_RUNNING(job_ptr) || IS_JOB_SUSPENDED(job_ptr))) {
-			if ((job_ptr->warn_time) &&
-			    (!(job_ptr->warn_flags & WARN_SENT)) &&
-			    (job_ptr->warn_time + PERIODIC_TIMEOUT + now >=
-			     job_ptr->end_time)) {
-				debug("%s: preempt warning signal %u to job %u ",
-				      __func__, job_ptr->warn_signal,
-				      job_ptr->job_id);
-				(void) job_signal(job_ptr->job_id,
-						  job_ptr->warn_signal,
-						  job_ptr->warn_flags, 0,
-						  false);
+	/*
+	 * everything above here is considered "quick", and returns false.
+	 * everything below is considered "slow", and returns true so the
+	 * caller can yield its locks before the next job is tested
+	 */
+	if (job_ptr->preempt_time &&
+	    (IS_JOB_RUNNING(job_ptr) || IS_JOB_SUSPENDED(job_ptr))) {
+		if ((job_ptr->warn_time) &&
+		    (!(job_ptr->warn_flags & WARN_SENT)) &&
+		    (job_ptr->warn_time + PERIODIC_TIMEOUT + now >=
+		     job_ptr->end_time)) {
+			debug("%s: preempt warning signal %u to job %u ",
+			      __func__, job_ptr->warn_signal,
+			      job_ptr->job_id);
+			(void) job_signal(job_ptr->job_id,
+					  job_ptr->warn_signal,
+					  job_ptr->warn_flags, 0,
+					  false);
 
-				/* mark job as signaled */
-				job_ptr->warn_flags |= WARN_SENT;
-			}
-			if (job_ptr->end_time <= now) {
-				last_job_update = now;
-				info("%s: Preemption GraceTime reached JobId=%u",
-				     __func__, job_ptr->job_id);
-				job_ptr->job_state = JOB_PREEMPTED |
-						     JOB_COMPLETING;
-				_job_timed_out(job_ptr);
-				xfree(job_ptr->state_desc);
-			}
-			goto time_check;
+			/* mark job as signaled */
+			job_ptr->warn_flags |= WARN_SENT;
 		}
-
-		if (slurmctld_conf.inactive_limit &&
-		    (job_ptr->batch_flag == 0)    &&
-		    (job_ptr->time_last_active <= old) &&
-		    (job_ptr->other_port) &&
-		    (job_ptr->part_ptr) &&
-		    (!(job_ptr->part_ptr->flags & PART_FLAG_ROOT_ONLY))) {
-			/* job inactive, kill it */
-			info("%s: inactivity time limit reached for JobId=%u",
+		if (job_ptr->end_time <= now) {
+			last_job_update = now;
+			info("%s: Preemption GraceTime reached JobId=%u",
 			     __func__, job_ptr->job_id);
+			job_ptr->job_state = JOB_PREEMPTED |
+					     JOB_COMPLETING;
 			_job_timed_out(job_ptr);
-			job_ptr->state_reason = FAIL_INACTIVE_LIMIT;
 			xfree(job_ptr->state_desc);
-			goto time_check;
 		}
-		if (job_ptr->time_limit != INFINITE) {
-			if ((job_ptr->warn_time) &&
-			    (!(job_ptr->warn_flags & WARN_SENT)) &&
-			    (job_ptr->warn_time + PERIODIC_TIMEOUT + now >=
-			     job_ptr->end_time)) {
-				/*
-				 * If --signal B option was not specified,
-				 * signal only the steps but not the batch step.
-				 */
-				if (job_ptr->warn_flags == 0)
-					job_ptr->warn_flags = KILL_STEPS_ONLY;
+		return true;
+	}
 
-				debug("%s: warning signal %u to job %u ",
-				      __func__, job_ptr->warn_signal,
-				      job_ptr->job_id);
+	if (slurmctld_conf.inactive_limit &&
+	    (job_ptr->batch_flag == 0)    &&
+	    (job_ptr->time_last_active <= old) &&
+	    (job_ptr->other_port) &&
+	    (job_ptr->part_ptr) &&
+	    (!(job_ptr->part_ptr->flags & PART_FLAG_ROOT_ONLY))) {
+		/* job inactive, kill it */
+		info("%s: inactivity time limit reached for JobId=%u",
+		     __func__, job_ptr->job_id);
+		_job_timed_out(job_ptr);
+		job_ptr->state_reason = FAIL_INACTIVE_LIMIT;
+		xfree(job_ptr->state_desc);
+		return true;
+	}
+	if (job_ptr->time_limit != INFINITE) {
+		if ((job_ptr->warn_time) &&
+		    (!(job_ptr->warn_flags & WARN_SENT)) &&
+		    (job_ptr->warn_time + PERIODIC_TIMEOUT + now >=
+		     job_ptr->end_time)) {
+			/*
+			 * If --signal B option was not specified,
+			 * signal only the steps but not the batch step.
+			 */
+			if (job_ptr->warn_flags == 0)
+				job_ptr->warn_flags = KILL_STEPS_ONLY;
 
-				(void) job_signal(job_ptr->job_id,
-						  job_ptr->warn_signal,
-						  job_ptr->warn_flags, 0,
-						  false);
+			debug("%s: warning signal %u to job %u ",
+			      __func__, job_ptr->warn_signal,
+			      job_ptr->job_id);
 
-				/* mark job as signaled */
-				job_ptr->warn_flags |= WARN_SENT;
-			}
-			if ((job_ptr->mail_type & MAIL_JOB_TIME100) &&
-			    (now >= job_ptr->end_time)) {
-				job_ptr->mail_type &= (~MAIL_JOB_TIME100);
-				mail_job_info(job_ptr, MAIL_JOB_TIME100);
-			}
-			if ((job_ptr->mail_type & MAIL_JOB_TIME90) &&
-			    (now + (job_ptr->time_limit * 60 * 0.1) >=
-			     job_ptr->end_time)) {
-				job_ptr->mail_type &= (~MAIL_JOB_TIME90);
-				mail_job_info(job_ptr, MAIL_JOB_TIME90);
-			}
-			if ((job_ptr->mail_type & MAIL_JOB_TIME80) &&
-			    (now + (job_ptr->time_limit * 60 * 0.2) >=
-			     job_ptr->end_time)) {
-				job_ptr->mail_type &= (~MAIL_JOB_TIME80);
-				mail_job_info(job_ptr, MAIL_JOB_TIME80);
-			}
-			if ((job_ptr->mail_type & MAIL_JOB_TIME50) &&
-			    (now + (job_ptr->time_limit * 60 * 0.5) >=
-			     job_ptr->end_time)) {
-				job_ptr->mail_type &= (~MAIL_JOB_TIME50);
-				mail_job_info(job_ptr, MAIL_JOB_TIME50);
-			}
+			(void) job_signal(job_ptr->job_id,
+					  job_ptr->warn_signal,
+					  job_ptr->warn_flags, 0,
+					  false);
 
-			if (job_ptr->part_ptr &&
-			    (job_ptr->part_ptr->over_time_limit != NO_VAL16)) {
-				over_time_limit =
-					job_ptr->part_ptr->over_time_limit;
-			} else {
-				over_time_limit =
-					slurmctld_conf.over_time_limit;
-			}
-			if (over_time_limit == INFINITE16)
-				over_run = now - YEAR_SECONDS;
-			else
-				over_run = now - (over_time_limit  * 60);
-			if (job_ptr->end_time <= over_run) {
-				last_job_update = now;
-				info("Time limit exhausted for JobId=%u",
-				     job_ptr->job_id);
-				_job_timed_out(job_ptr);
-				job_ptr->state_reason = FAIL_TIMEOUT;
-				xfree(job_ptr->state_desc);
-				goto time_check;
-			}
+			/* mark job as signaled */
+			job_ptr->warn_flags |= WARN_SENT;
+		}
+		if ((job_ptr->mail_type & MAIL_JOB_TIME100) &&
+		    (now >= job_ptr->end_time)) {
+			job_ptr->mail_type &= (~MAIL_JOB_TIME100);
+			mail_job_info(job_ptr, MAIL_JOB_TIME100);
+		}
+		if ((job_ptr->mail_type & MAIL_JOB_TIME90) &&
+		    (now + (job_ptr->time_limit * 60 * 0.1) >=
+		     job_ptr->end_time)) {
+			job_ptr->mail_type &= (~MAIL_JOB_TIME90);
+			mail_job_info(job_ptr, MAIL_JOB_TIME90);
+		}
+		if ((job_ptr->mail_type & MAIL_JOB_TIME80) &&
+		    (now + (job_ptr->time_limit * 60 * 0.2) >=
+		     job_ptr->end_time)) {
+			job_ptr->mail_type &= (~MAIL_JOB_TIME80);
+			mail_job_info(job_ptr, MAIL_JOB_TIME80);
+		}
+		if ((job_ptr->mail_type & MAIL_JOB_TIME50) &&
+		    (now + (job_ptr->time_limit * 60 * 0.5) >=
+		     job_ptr->end_time)) {
+			job_ptr->mail_type &= (~MAIL_JOB_TIME50);
+			mail_job_info(job_ptr, MAIL_JOB_TIME50);
 		}
 
-		if (job_ptr->resv_ptr &&
-		    !(job_ptr->resv_ptr->flags & RESERVE_FLAG_FLEX) &&
-		    (job_ptr->resv_ptr->end_time + resv_over_run) < time(NULL)){
+		if (job_ptr->part_ptr &&
+		    (job_ptr->part_ptr->over_time_limit != NO_VAL16)) {
+			over_time_limit =
+				job_ptr->part_ptr->over_time_limit;
+		} else {
+			over_time_limit =
+				slurmctld_conf.over_time_limit;
+		}
+		if (over_time_limit == INFINITE16)
+			over_run = now - YEAR_SECONDS;
+		else
+			over_run = now - (over_time_limit  * 60);
+		if (job_ptr->end_time <= over_run) {
 			last_job_update = now;
-			info("Reservation ended for JobId=%u",
+			info("Time limit exhausted for JobId=%u",
 			     job_ptr->job_id);
 			_job_timed_out(job_ptr);
 			job_ptr->state_reason = FAIL_TIMEOUT;
 			xfree(job_ptr->state_desc);
-			goto time_check;
+			return true;
 		}
+	}
 
-		/*
-		 * check if any individual job steps have exceeded
-		 * their time limit
-		 */
-		if (job_ptr->step_list &&
-		    (list_count(job_ptr->step_list) > 0))
-			check_job_step_time_limit(job_ptr, now);
+	if (job_ptr->resv_ptr &&
+	    !(job_ptr->resv_ptr->flags & RESERVE_FLAG_FLEX) &&
+	    (job_ptr->resv_ptr->end_time + resv_over_run) < time(NULL)){
+		last_job_update = now;
+		info("Reservation ended for JobId=%u",
+		     job_ptr->job_id);
+		_job_timed_out(job_ptr);
+		job_ptr->state_reason = FAIL_TIMEOUT;
+		xfree(job_ptr->state_desc);
+		return true;
+	}
 
-		acct_policy_job_time_out(job_ptr);
+	/*
+	 * check if any individual job steps have exceeded
+	 * their time limit
+	 */
+	if (job_ptr->step_list &&
+	    (list_count(job_ptr->step_list) > 0))
+		check_job_step_time_limit(job_ptr, now);
 
-		if (job_ptr->state_reason == FAIL_TIMEOUT) {
-			last_job_update = now;
-			_job_timed_out(job_ptr);
-			xfree(job_ptr->state_desc);
-			goto time_check;
-		}
+	acct_policy_job_time_out(job_ptr);
+
+	if (job_ptr->state_reason == FAIL_TIMEOUT) {
+		last_job_update = now;
+		_job_timed_out(job_ptr);
+		xfree(job_ptr->state_desc);
+		return true;
+	}
+
+	/* Give srun command warning message about pending timeout */
+	if (job_ptr->end_time <= (now + PERIODIC_TIMEOUT * 2))
+		srun_timeout (job_ptr);
+
+	return true;
+}
+
+/*
+ * job_time_limit - terminate jobs which have exceeded their time limit
+ *	Only the jobs whose time limits need testing are visited, see
+ *	job_timer.c, unless node features changed or a full pass was
+ *	requested with job_timer_rescan().
+ * global: job_list - pointer global job list
+ *	last_job_update - time of last job table update
+ */
+void job_time_limit(void)
+{
+	ListIterator job_iterator = NULL;
+	struct job_record *job_ptr;
+	time_t now = time(NULL);
+	time_t old = now - ((slurmctld_conf.inactive_limit * 4 / 3) +
+			    slurmctld_conf.msg_timeout + 1);
+	int job_test_count = 0;
+	uint32_t resv_over_run = slurmctld_conf.resv_over_run;
+	bool more_jobs, slow_test;
+
+	xassert(verify_lock(JOB_LOCK, WRITE_LOCK));
+
+	if (resv_over_run == INFINITE16)
+		resv_over_run = YEAR_SECONDS;
+	else
+		resv_over_run *= 60;
 
-		/* Give srun command warning message about pending timeout */
-		if (job_ptr->end_time <= (now + PERIODIC_TIMEOUT * 2))
-			srun_timeout (job_ptr);
+	/*
+	 * locks same as in _slurmctld_background() (The only current place this
+	 * is called).
+	 */
+	slurmctld_lock_t job_write_lock = {
+		READ_LOCK, WRITE_LOCK, WRITE_LOCK, READ_LOCK, READ_LOCK };
+	DEF_TIMERS;
+
+	if (job_timer_rescan_due() || node_features_updated)
+		job_iterator = list_iterator_create(job_list);
+	START_TIMER;
+	while (1) {
+		if (job_iterator)
+			job_ptr = list_next(job_iterator);
+		else
+			job_ptr = job_timer_next(now);
+		if (!job_ptr)
+			break;
+		job_test_count++;
+
+		slow_test = _job_time_limit_test(job_ptr, now, old,
+						 resv_over_run);
+		job_timer_arm(job_ptr);
+		if (!slow_test)
+			continue;
 
 		/*
 		 * _job_timed_out() and other calls can take a long time on
@@ -8923,10 +9134,15 @@ void job_time_limit(void)
 		 * and can be used again once the locks are reacquired.
 		 * list_peek_next is used in the unlikely event the timer has
 		 * expired just as the end of the job_list is reached.
+		 * Jobs are removed from the heap of job_timer_next() when
+		 * purged, so it can also be used again.
 		 */
-time_check:
+		if (job_iterator)
+			more_jobs = (list_peek_next(job_iterator) != NULL);
+		else
+			more_jobs = job_timer_due(now);
 		/* Use a hard-coded 3 second timeout, with a 1 second sleep. */
-		if (slurm_delta_tv(&tv1) >= 3000000 && list_peek_next(job_iterator) ) {
+		if (slurm_delta_tv(&tv1) >= 3000000 && more_jobs) {
 			END_TIMER;
 			debug("%s: yielding locks after testing"
 			      " %d jobs, %s",
@@ -8938,8 +9154,10 @@ time_check:
 			job_test_count = 0;
 		}
 	}
-	list_iterator_destroy(job_iterator);
-	node_features_updated = false;
+	if (job_iterator) {
+		list_iterator_destroy(job_iterator);
+		node_features_updated = false;
+	}
 }
 
 extern void job_set_req_tres(
@@ -9259,6 +9477,9 @@ static void _list_delete_job(void *job_entry)
 
 	xassert(job_entry);
 	xassert (job_ptr->magic == JOB_MAGIC);
+	job_queue_remove(job_ptr);
+	depend_index_notify(job_ptr);
+	job_timer_remove(job_ptr);
 	job_ptr->magic = 0;	/* make sure we don't delete record twice */
 
 	/* Remove record from fed_job_list */
@@ -9525,6 +9746,11 @@ static void _pack_job(struct job_record *job_ptr,
 	    (pack_info->filter_uid != job_ptr->user_id))
 		return;
 
+	if (!job_filter_test(pack_info->job_filter, job_ptr->job_state,
+			     job_ptr->user_id, job_ptr->account,
+			     job_ptr->name, job_ptr->partition, job_ptr->nodes))
+		return;
+
 	if (((pack_info->show_flags & SHOW_ALL) == 0) &&
 	    (pack_info->uid != 0) &&
 	    _all_parts_hidden(job_ptr, pack_info->uid))
@@ -9561,6 +9787,7 @@ static int _foreach_pack_jobid(void *object, void *arg)
  * IN show_flags - job filtering options
  * IN uid - uid of user making request (for partition filtering)
  * IN filter_uid - pack only jobs belonging to this user if not NO_VAL
+ * IN filter - pack only jobs matching this filter if not NULL
  * global: job_list - global list of job records
  * NOTE: the buffer at *buffer_ptr must be xfreed by the caller
  * NOTE: change _unpack_job_desc_msg() in common/slurm_protocol_pack.c
@@ -9568,7 +9795,7 @@ static int _foreach_pack_jobid(void *object, void *arg)
  */
 extern void pack_all_jobs(char **buffer_ptr, int *buffer_size,
 			  uint16_t show_flags, uid_t uid, uint32_t filter_uid,
-			  uint16_t protocol_version)
+			  info_filter_t *filter, uint16_t protocol_version)
 {
 	uint32_t jobs_packed = 0, tmp_offset;
 	_foreach_pack_job_info_t pack_info = {0};
@@ -9589,6 +9816,7 @@ extern void pack_all_jobs(char **buffer_ptr, int *buffer_size,
 	/* write individual job records */
 	pack_info.buffer           = buffer;
 	pack_info.filter_uid       = filter_uid;
+	pack_info.job_filter       = job_filter_create(filter);
 	pack_info.jobs_packed      = &jobs_packed;
 	pack_info.protocol_version = protocol_version;
 	pack_info.show_flags       = show_flags;
@@ -9599,6 +9827,9 @@ extern void pack_all_jobs(char **buffer_ptr, int *buffer_size,
 		_pack_job(job_ptr, &pack_info);
 	}
 	list_iterator_destroy(itr);
+	job_filter_destroy(pack_info.job_filter);
+
+	pack_job_info_trailer(buffer, 0, false, NULL, 0, protocol_version);
 
 	/* put the real record count in the message body header */
 	tmp_offset = get_buf_offset(buffer);
@@ -9654,6 +9885,8 @@ extern void pack_spec_jobs(char **buffer_ptr, int *buffer_size, List job_ids,
 
 	list_for_each(job_ids, _foreach_pack_jobid, &pack_info);
 
+	pack_job_info_trailer(buffer, 0, false, NULL, 0, protocol_version);
+
 	/* put the real record count in the message body header */
 	tmp_offset = get_buf_offset(buffer);
 	set_buf_offset(buffer, 0);
@@ -9766,6 +9999,8 @@ extern int pack_one_job(char **buffer_ptr, int *buffer_size,
 		return ESLURM_INVALID_JOB_ID;
 	}
 
+	pack_job_info_trailer(buffer, 0, false, NULL, 0, protocol_version);
+
 	/* put the real record count in the message body header */
 	tmp_offset = get_buf_offset(buffer);
 	set_buf_offset(buffer, 0);
@@ -9778,6 +10013,18 @@ extern int pack_one_job(char **buffer_ptr, int *buffer_size,
 	return SLURM_SUCCESS;
 }
 
+extern void pack_job_info_trailer(Buf buffer, uint64_t delta_cursor,
+				  bool delta, uint32_t *purged_job_ids,
+				  uint32_t purged_cnt,
+				  uint16_t protocol_version)
+{
+	if (protocol_version >= SLURM_18_08_PROTOCOL_VERSION) {
+		pack64(delta_cursor, buffer);
+		pack8((uint8_t) delta, buffer);
+		pack32_array(purged_job_ids, purged_cnt, buffer);
+	}
+}
+
 static void _pack_job_gres(struct job_record *dump_job_ptr, Buf buffer,
 			   uint16_t protocol_version)
 {
@@ -11260,6 +11507,7 @@ extern void set_job_prio(struct job_record *job_ptr)
 		return;
 	job_ptr->priority = slurm_sched_g_initial_priority(lowest_prio,
 							   job_ptr);
+	job_queue_update(job_ptr);
 	if ((job_ptr->priority == 0) || (job_ptr->direct_set_prio))
 		return;
 
@@ -11293,6 +11541,7 @@ extern void sync_job_priorities(void)
 	}
 	list_iterator_destroy(job_iterator);
 	lowest_prio += prio_boost;
+	job_queue_invalidate();
 }
 
 /*
@@ -13607,6 +13856,9 @@ fini:
 	if ((job_ptr->priority != 0) &&
 	    xstrcmp(slurmctld_conf.priority_type, "priority/basic"))
 		set_job_prio(job_ptr);
+	job_queue_update(job_ptr);
+	job_queue_split_array_add(job_ptr);
+	job_timer_arm(job_ptr);
 
 	if ((error_code == SLURM_SUCCESS) &&
 	    fed_mgr_fed_rec &&
@@ -14513,10 +14765,14 @@ extern int job_alloc_info(uint32_t uid, uint32_t job_id,
  * Synchronize the batch job in the system with their files.
  * All pending batch jobs must have script and environment files
  * No other jobs should have such files
+ * After recovering a job_state file holding a batch directory index, use
+ * that index rather than scanning the state save directory. Directories
+ * missing from the index are left to purge_defunct_batch_dirs().
  */
 int sync_job_files(void)
 {
 	List batch_dirs;
+	bool indexed = false;
 
 	xassert(verify_lock(CONF_LOCK, READ_LOCK));
 	xassert(verify_lock(JOB_LOCK, WRITE_LOCK));
@@ -14524,14 +14780,79 @@ int sync_job_files(void)
 	if (!slurmctld_primary)	/* Don't purge files from backup slurmctld */
 		return SLURM_SUCCESS;
 
+	if (batch_dir_index) {
+		batch_dirs = batch_dir_index;
+		batch_dir_index = NULL;
+		batch_dir_scan = true;
+		indexed = true;
+	} else {
+		batch_dirs = list_create(_del_batch_list_rec);
+		_get_batch_job_dir_ids(batch_dirs);
+	}
+	_validate_job_files(batch_dirs, indexed);
+	_remove_defunct_batch_dirs(batch_dirs);
+	FREE_NULL_LIST(batch_dirs);
+	return SLURM_SUCCESS;
+}
+
+/*
+ * Remove the batch directories of jobs which no longer exist, when
+ * sync_job_files() validated them from the job_state file's index. This
+ * catches directories created after that file was written. Called from the
+ * purge files thread so the directory scan does not delay scheduling.
+ */
+extern void purge_defunct_batch_dirs(void)
+{
+	slurmctld_lock_t config_read_lock =
+		{ READ_LOCK, NO_LOCK, NO_LOCK, NO_LOCK, NO_LOCK };
+	slurmctld_lock_t job_read_lock =
+		{ READ_LOCK, READ_LOCK, NO_LOCK, NO_LOCK, NO_LOCK };
+	List batch_dirs;
+	ListIterator batch_dir_iter;
+	uint32_t *job_id_ptr;
+	DEF_TIMERS;
+
+	START_TIMER;
+	lock_slurmctld(config_read_lock);
+	if (!batch_dir_scan) {
+		unlock_slurmctld(config_read_lock);
+		return;
+	}
+	batch_dir_scan = false;
 	batch_dirs = list_create(_del_batch_list_rec);
 	_get_batch_job_dir_ids(batch_dirs);
-	_validate_job_files(batch_dirs);
+	unlock_slurmctld(config_read_lock);
+
+	lock_slurmctld(job_read_lock);
+	batch_dir_iter = list_iterator_create(batch_dirs);
+	while ((job_id_ptr = list_next(batch_dir_iter))) {
+		if (find_job_record(*job_id_ptr))
+			list_delete_item(batch_dir_iter);
+	}
+	list_iterator_destroy(batch_dir_iter);
 	_remove_defunct_batch_dirs(batch_dirs);
+	unlock_slurmctld(job_read_lock);
 	FREE_NULL_LIST(batch_dirs);
-	return SLURM_SUCCESS;
+	END_TIMER2("purge_defunct_batch_dirs");
+	debug("%s: %s", __func__, TIME_STR);
 }
 
+/* Return true if the batch directory of the given job ID exists */
+static bool _batch_job_dir_exists(uint32_t job_id)
+{
+	char *dir_name;
+	struct stat sbuf;
+	bool rc;
+
+	dir_name = xstrdup_printf("%s/hash.%d/job.%u",
+				  slurmctld_conf.state_save_location,
+				  job_id % 10, job_id);
+	rc = (stat(dir_name, &sbuf) == 0);
+	xfree(dir_name);
+	return rc;
+}
+
+
 /* Append to the batch_dirs list the job_id's associated with
  *	every batch job directory in existence
  */
@@ -14593,9 +14914,17 @@ static int _clear_state_dir_flag(void *x, void *arg)
 static int _test_state_dir_flag(void *x, void *arg)
 {
 	struct job_record *job_ptr = (struct job_record *)x;
+	bool indexed = *(bool *) arg;
+	uint32_t dir_job_id;
 
+	/*
+	 * Job array tasks share the directory of the array's job ID, keep
+	 * the flag only on the record owning it, see _dump_batch_dir_index()
+	 */
 	if (job_ptr->bit_flags & HAS_STATE_DIR) {
-		job_ptr->bit_flags &= ~HAS_STATE_DIR;
+		if (job_ptr->array_job_id &&
+		    (job_ptr->array_job_id != job_ptr->job_id))
+			job_ptr->bit_flags &= ~HAS_STATE_DIR;
 		return 0;
 	}
 
@@ -14603,6 +14932,21 @@ static int _test_state_dir_flag(void *x, void *arg)
 	    (job_ptr->pack_job_offset > 0))
 		return 0;	/* No files expected */
 
+	/* Data referenced when the job was recovered, see _load_job_details */
+	if (job_ptr->details && job_ptr->details->script_hash)
+		return 0;
+
+	/* Job missing from the index, confirm its files are really gone */
+	if (indexed) {
+		dir_job_id = job_ptr->array_job_id ? job_ptr->array_job_id :
+						     job_ptr->job_id;
+		if (_batch_job_dir_exists(dir_job_id)) {
+			if (dir_job_id == job_ptr->job_id)
+				job_ptr->bit_flags |= HAS_STATE_DIR;
+			return 0;
+		}
+	}
+
 	error("Script for job %u lost, state set to FAILED", job_ptr->job_id);
 	job_ptr->job_state = JOB_FAILED;
 	job_ptr->exit_code = 1;
@@ -14617,7 +14961,7 @@ static int _test_state_dir_flag(void *x, void *arg)
  *	otherwise we flag it as FAILED and don't schedule
  * If the batch_dir entry exists for a PENDING or RUNNING batch job,
  *	remove it the list (of directories to be deleted) */
-static void _validate_job_files(List batch_dirs)
+static void _validate_job_files(List batch_dirs, bool indexed)
 {
 	struct job_record *job_ptr;
 	ListIterator batch_dir_iter;
@@ -14644,7 +14988,7 @@ static void _validate_job_files(List batch_dirs)
 	}
 	list_iterator_destroy(batch_dir_iter);
 
-	list_for_each(job_list, _test_state_dir_flag, NULL);
+	list_for_each(job_list, _test_state_dir_flag, &indexed);
 }
 
 /* List entry deletion function, see common/list.h */
@@ -14951,6 +15295,10 @@ void batch_requeue_fini(struct job_record  *job_ptr)
 void job_fini (void)
 {
 	FREE_NULL_LIST(job_list);
+	depend_index_fini();
+	job_timer_fini();
+	script_store_fini();
+	FREE_NULL_LIST(batch_dir_index);
 	xfree(job_hash);
 	xfree(job_array_hash_j);
 	xfree(job_array_hash_t);
@@ -15047,6 +15395,7 @@ extern void job_completion_logger(struct job_record *job_ptr, bool requeue)
 
 	xassert(job_ptr);
 
+	depend_index_notify(job_ptr);
 	acct_policy_remove_job_submit(job_ptr);
 	if (job_ptr->nodes && ((job_ptr->bit_flags & JOB_KILL_HURRY) == 0)
 	    && !IS_JOB_RESIZING(job_ptr)) {
@@ -15729,6 +16078,7 @@ static int _job_suspend_op(struct job_record *job_ptr, uint16_t op,
 	job_ptr->time_last_active = now;
 	job_ptr->suspend_time = now;
 	jobacct_storage_g_job_suspend(acct_db_conn, job_ptr);
+	job_timer_arm(job_ptr);
 
 	return rc;
 }
@@ -16232,6 +16582,7 @@ reply:
 	debug("%s: job %u state 0x%x reason %u priority %d", __func__,
 	      job_ptr->job_id, job_ptr->job_state,
 	      job_ptr->state_reason, job_ptr->priority);
+	job_queue_update(job_ptr);
 
 	return SLURM_SUCCESS;
 }
@@ -16583,6 +16934,7 @@ static int _set_top(List top_job_list, uid_t uid)
 		job_ptr->priority = next_prio;
 		job_ptr->details->nice -= delta_nice;
 		job_ptr->bit_flags &= (~TOP_PRIO_TMP);
+		job_queue_update(job_ptr);
 	}
 	list_iterator_destroy(iter);
 	FREE_NULL_LIST(prio_list);
@@ -16601,6 +16953,7 @@ static int _set_top(List top_job_list, uid_t uid)
 			job_ptr->priority = next_prio;
 			job_ptr->details->nice += delta_nice;
 			job_ptr->bit_flags &= (~TOP_PRIO_TMP);
+			job_queue_update(job_ptr);
 			total_delta -= delta_nice;
 			if (--other_job_cnt == 0)
 				break;	/* Count will match list size anyway */
@@ -17668,6 +18021,7 @@ extern bool job_hold_requeue(struct job_record *job_ptr)
 	debug("%s: job %u state 0x%x reason %u priority %d", __func__,
 	      job_ptr->job_id, job_ptr->job_state,
 	      job_ptr->state_reason, job_ptr->priority);
+	job_queue_update(job_ptr);
 
 	return true;
 }
@@ -0,0 +1,613 @@
+/*****************************************************************************\
+ *  job_queue.c - persistent priority ordered queue of pending jobs
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+/*
+ * Pending jobs are kept in one pairing heap per partition, with an entry
+ * for each job/partition pair, ordered by sort_job_queue2(). Entries are
+ * repositioned when a job is submitted, updated, requeued or split from a
+ * job array (see the callers of job_queue_update()), so a scheduling pass
+ * no longer needs to test and sort every pending job to find the first
+ * ones to start.
+ *
+ * A walk returns the entries of every partition in priority order without
+ * removing them. The walk keeps a binary heap with the roots of the
+ * subtrees not visited yet, initially the root of each partition's heap.
+ * When a node is returned, its children are first combined into a single
+ * subtree as if the node was being deleted from the pairing heap. Walking
+ * the first k entries costs O(k log n) amortized and leaves them as a
+ * sorted chain, so walking the top of a stable queue again is close to
+ * linear.
+ *
+ * Every change of a pending job's priority must be reported through
+ * job_queue_update(). Changes affecting many jobs at once, such as the
+ * periodic recalculation done by the priority plugin or a change of a
+ * partition's PriorityTier, call job_queue_invalidate() instead and the
+ * scheduler rebuilds the queue with job_queue_reset() before its next walk.
+ * A walk refreshes the priority of each entry it returns from the job
+ * record and repositions the entry once the walk ends if it changed.
+ */
+
+#include "config.h"
+
+#include <string.h>
+
+#include "src/common/list.h"
+#include "src/common/macros.h"
+#include "src/common/xassert.h"
+#include "src/common/xmalloc.h"
+
+#include "src/slurmctld/job_queue.h"
+
+typedef struct job_queue_heap {
+	struct part_record *part_ptr;	/* NULL once partition removed */
+	struct job_queue_node *root;
+	uint32_t cnt;
+} job_queue_heap_t;
+
+typedef struct job_queue_node {
+	job_queue_rec_t rec;		/* first, see _cmp_node() */
+	struct job_queue_node *child;	/* first child */
+	struct job_queue_node *next;	/* next sibling */
+	struct job_queue_node *prev;	/* previous sibling, or parent of
+					 * the first child */
+	job_queue_heap_t *heap;		/* heap containing the node */
+	uint32_t heap_gen;		/* heap_gen when inserted */
+	int part_inx;			/* index in part_ptr_list or -1 */
+	struct job_queue_node *job_next;/* next entry of the same job */
+	uint32_t walk_id;		/* walk owning walk_state */
+	int walk_state;			/* see job_queue_walk_state() */
+} job_queue_node_t;
+
+struct job_queue_walk {
+	job_queue_node_t **frontier;	/* binary heap of unvisited subtrees */
+	int frontier_cnt;
+	int frontier_size;
+	uint32_t walk_id;
+	job_queue_rec_t rec;		/* last entry returned, refreshed */
+};
+
+static List heap_list = NULL;
+static uint32_t heap_gen = 1;
+static uint32_t queue_cnt = 0;
+static bool reset_needed = true;
+
+static uint32_t last_walk_id = 0;
+static int walk_active = 0;
+static List deferred_list = NULL;	/* jobs updated during a walk */
+static job_queue_node_t *dead_nodes = NULL; /* jobs removed during a walk */
+
+/*
+ * Compare two entries, entries removed during a walk sort first so that
+ * sort_job_queue2() and the preemption plugins never see them
+ */
+static int _cmp_node(job_queue_node_t *node1, job_queue_node_t *node2)
+{
+	job_queue_rec_t *rec1 = &node1->rec, *rec2 = &node2->rec;
+
+	if (!rec1->job_ptr)
+		return rec2->job_ptr ? -1 : 0;
+	if (!rec2->job_ptr)
+		return 1;
+	return sort_job_queue2(&rec1, &rec2);
+}
+
+/* Meld two heaps, the caller must set next and prev of the result */
+static job_queue_node_t *_meld(job_queue_node_t *node1,
+			       job_queue_node_t *node2)
+{
+	job_queue_node_t *tmp;
+
+	if (!node1)
+		return node2;
+	if (!node2)
+		return node1;
+	if (_cmp_node(node2, node1) < 0) {
+		tmp = node1;
+		node1 = node2;
+		node2 = tmp;
+	}
+	node2->prev = node1;
+	node2->next = node1->child;
+	if (node1->child)
+		node1->child->prev = node2;
+	node1->child = node2;
+	return node1;
+}
+
+/* Combine a list of siblings into one heap using the two pass method */
+static job_queue_node_t *_merge_pairs(job_queue_node_t *first)
+{
+	job_queue_node_t *node1, *node2, *next, *pairs = NULL, *root = NULL;
+
+	while (first) {
+		node1 = first;
+		node2 = first->next;
+		next = node2 ? node2->next : NULL;
+		node1->next = node1->prev = NULL;
+		if (node2) {
+			node2->next = node2->prev = NULL;
+			node1 = _meld(node1, node2);
+		}
+		node1->next = pairs;	/* stack of pairs, last pair first */
+		pairs = node1;
+		first = next;
+	}
+	while (pairs) {
+		next = pairs->next;
+		pairs->next = NULL;
+		root = _meld(pairs, root);
+		root->next = root->prev = NULL;
+		pairs = next;
+	}
+	return root;
+}
+
+static bool _linked(job_queue_node_t *node)
+{
+	return (node->heap && (node->heap_gen == heap_gen));
+}
+
+static void _heap_insert(job_queue_heap_t *heap, job_queue_node_t *node)
+{
+	node->child = node->next = node->prev = NULL;
+	node->heap = heap;
+	node->heap_gen = heap_gen;
+	heap->root = _meld(heap->root, node);
+	heap->root->next = heap->root->prev = NULL;
+	heap->cnt++;
+	queue_cnt++;
+}
+
+static void _heap_remove(job_queue_node_t *node)
+{
+	job_queue_heap_t *heap = node->heap;
+	job_queue_node_t *sub;
+
+	if (node == heap->root) {
+		heap->root = _merge_pairs(node->child);
+	} else {
+		if (node->prev->child == node)
+			node->prev->child = node->next;
+		else
+			node->prev->next = node->next;
+		if (node->next)
+			node->next->prev = node->prev;
+		sub = _merge_pairs(node->child);
+		heap->root = _meld(heap->root, sub);
+		heap->root->next = heap->root->prev = NULL;
+	}
+	node->child = node->next = node->prev = NULL;
+	node->heap = NULL;
+	heap->cnt--;
+	queue_cnt--;
+}
+
+/* Free every node of a heap, splicing children ahead of their siblings */
+static void _free_tree(job_queue_node_t *node)
+{
+	job_queue_node_t *last, *next;
+
+	while (node) {
+		if (node->child) {
+			for (last = node->child; last->next; last = last->next)
+				;
+			last->next = node->next;
+			next = node->child;
+		} else
+			next = node->next;
+		xfree(node);
+		node = next;
+	}
+}
+
+static int _find_heap(void *x, void *key)
+{
+	job_queue_heap_t *heap = (job_queue_heap_t *) x;
+
+	if (heap->part_ptr == (struct part_record *) key)
+		return 1;
+	return 0;
+}
+
+static job_queue_heap_t *_get_heap(struct part_record *part_ptr)
+{
+	job_queue_heap_t *heap;
+
+	if (!heap_list)
+		heap_list = list_create(NULL);
+	heap = list_find_first(heap_list, _find_heap, part_ptr);
+	if (!heap) {
+		heap = xmalloc(sizeof(job_queue_heap_t));
+		heap->part_ptr = part_ptr;
+		list_append(heap_list, heap);
+	}
+	return heap;
+}
+
+/* Remove a node from the list of entries of its job */
+static void _job_unlink(job_queue_node_t *node)
+{
+	job_queue_node_t **node_pptr = &node->rec.job_ptr->queue_node;
+
+	while (*node_pptr) {
+		if (*node_pptr == node) {
+			*node_pptr = node->job_next;
+			break;
+		}
+		node_pptr = &(*node_pptr)->job_next;
+	}
+	node->job_next = NULL;
+}
+
+/* Return the current priority of an entry for its partition */
+static uint32_t _get_priority(job_queue_node_t *node)
+{
+	struct job_record *job_ptr = node->rec.job_ptr;
+
+	if ((node->part_inx >= 0) && job_ptr->priority_array &&
+	    job_ptr->part_ptr_list &&
+	    (node->part_inx < list_count(job_ptr->part_ptr_list)))
+		return job_ptr->priority_array[node->part_inx];
+	return job_ptr->priority;
+}
+
+/* Take the entry for part_ptr from a list of a job's entries, if any */
+static job_queue_node_t *_take_node(job_queue_node_t **node_pptr,
+				    struct part_record *part_ptr)
+{
+	job_queue_node_t *node;
+
+	while ((node = *node_pptr)) {
+		if (node->rec.part_ptr == part_ptr) {
+			*node_pptr = node->job_next;
+			node->job_next = NULL;
+			return node;
+		}
+		node_pptr = &node->job_next;
+	}
+	return xmalloc(sizeof(job_queue_node_t));
+}
+
+static void _add_node(struct job_record *job_ptr, job_queue_node_t **old,
+		      job_queue_node_t ***tail, struct part_record *part_ptr,
+		      int part_inx)
+{
+	job_queue_node_t *node = _take_node(old, part_ptr);
+
+	node->rec.array_task_id = job_ptr->array_task_id;
+	node->rec.job_id = job_ptr->job_id;
+	node->rec.job_ptr = job_ptr;
+	node->rec.part_ptr = part_ptr;
+	node->part_inx = part_inx;
+	node->rec.priority = _get_priority(node);
+	**tail = node;
+	*tail = &node->job_next;
+	_heap_insert(_get_heap(part_ptr), node);
+}
+
+static int _find_ptr(void *x, void *key)
+{
+	if (x == key)
+		return 1;
+	return 0;
+}
+
+extern void job_queue_update(struct job_record *job_ptr)
+{
+	job_queue_node_t *node, *old, **tail;
+	struct part_record *part_ptr;
+	ListIterator part_iterator;
+	int inx = 0;
+
+	xassert(job_ptr->magic == JOB_MAGIC);
+
+	if (walk_active) {
+		if (!deferred_list)
+			deferred_list = list_create(NULL);
+		if (!list_find_first(deferred_list, _find_ptr, job_ptr))
+			list_append(deferred_list, job_ptr);
+		return;
+	}
+
+	for (node = job_ptr->queue_node; node; node = node->job_next) {
+		if (_linked(node))
+			_heap_remove(node);
+	}
+
+	old = job_ptr->queue_node;
+	job_ptr->queue_node = NULL;
+	tail = &job_ptr->queue_node;
+	if (IS_JOB_PENDING(job_ptr) && (job_ptr->priority != 0)) {
+		if (job_ptr->part_ptr_list) {
+			part_iterator = list_iterator_create(
+				job_ptr->part_ptr_list);
+			while ((part_ptr = list_next(part_iterator)))
+				_add_node(job_ptr, &old, &tail, part_ptr, inx++);
+			list_iterator_destroy(part_iterator);
+		} else if (job_ptr->part_ptr) {
+			_add_node(job_ptr, &old, &tail, job_ptr->part_ptr, -1);
+		}
+	}
+
+	while ((node = old)) {
+		old = node->job_next;
+		xfree(node);
+	}
+}
+
+extern void job_queue_remove(struct job_record *job_ptr)
+{
+	job_queue_node_t *node;
+
+	if (deferred_list)
+		list_delete_all(deferred_list, _find_ptr, job_ptr);
+
+	while ((node = job_ptr->queue_node)) {
+		job_ptr->queue_node = node->job_next;
+		if (walk_active && _linked(node)) {
+			/* Still referenced by the walk, free it at the end */
+			node->rec.job_ptr = NULL;
+			node->job_next = dead_nodes;
+			dead_nodes = node;
+			continue;
+		}
+		if (_linked(node))
+			_heap_remove(node);
+		xfree(node);
+	}
+}
+
+extern void job_queue_part_remove(struct part_record *part_ptr)
+{
+	job_queue_heap_t *heap;
+	job_queue_node_t *node, *last, *next;
+
+	if (!heap_list ||
+	    !(heap = list_find_first(heap_list, _find_heap, part_ptr)))
+		return;
+
+	/* Unlink every entry from its job, the same walk as _free_tree() */
+	for (node = heap->root; node; node = next) {
+		if (node->child) {
+			for (last = node->child; last->next; last = last->next)
+				;
+			last->next = node->next;
+			next = node->child;
+			node->child = NULL;
+		} else
+			next = node->next;
+		node->next = next;	/* flattened list of all nodes */
+		if (node->rec.job_ptr) {
+			_job_unlink(node);
+			node->rec.job_ptr = NULL;
+		}
+		node->rec.part_ptr = NULL;
+	}
+
+	queue_cnt -= heap->cnt;
+	heap->cnt = 0;
+	heap->part_ptr = NULL;
+	if (!walk_active) {
+		_free_tree(heap->root);
+		list_delete_all(heap_list, _find_ptr, heap);
+		xfree(heap);
+	}
+
+	/* Jobs of the partition may be moved to another one */
+	reset_needed = true;
+}
+
+extern void job_queue_reset(void)
+{
+	ListIterator heap_iterator;
+	job_queue_heap_t *heap;
+
+	xassert(!walk_active);
+
+	heap_gen++;
+	if (heap_gen == 0)
+		heap_gen = 1;
+	queue_cnt = 0;
+	if (heap_list) {
+		heap_iterator = list_iterator_create(heap_list);
+		while ((heap = list_next(heap_iterator))) {
+			heap->root = NULL;
+			heap->cnt = 0;
+		}
+		list_iterator_destroy(heap_iterator);
+	}
+	reset_needed = false;
+}
+
+extern bool job_queue_reset_needed(void)
+{
+	return reset_needed;
+}
+
+extern void job_queue_invalidate(void)
+{
+	reset_needed = true;
+}
+
+extern uint32_t job_queue_count(void)
+{
+	return queue_cnt;
+}
+
+static void _frontier_push(job_queue_walk_t *walk, job_queue_node_t *node)
+{
+	int inx, parent;
+
+	if (walk->frontier_cnt >= walk->frontier_size) {
+		walk->frontier_size = MAX(64, walk->frontier_size * 2);
+		xrealloc(walk->frontier,
+			 sizeof(job_queue_node_t *) * walk->frontier_size);
+	}
+	inx = walk->frontier_cnt++;
+	while (inx > 0) {
+		parent = (inx - 1) / 2;
+		if (_cmp_node(walk->frontier[parent], node) <= 0)
+			break;
+		walk->frontier[inx] = walk->frontier[parent];
+		inx = parent;
+	}
+	walk->frontier[inx] = node;
+}
+
+static job_queue_node_t *_frontier_pop(job_queue_walk_t *walk)
+{
+	job_queue_node_t *top, *last;
+	int inx = 0, child;
+
+	if (walk->frontier_cnt == 0)
+		return NULL;
+	top = walk->frontier[0];
+	last = walk->frontier[--walk->frontier_cnt];
+	while ((child = (inx * 2) + 1) < walk->frontier_cnt) {
+		if (((child + 1) < walk->frontier_cnt) &&
+		    (_cmp_node(walk->frontier[child + 1],
+			       walk->frontier[child]) < 0))
+			child++;
+		if (_cmp_node(last, walk->frontier[child]) <= 0)
+			break;
+		walk->frontier[inx] = walk->frontier[child];
+		inx = child;
+	}
+	walk->frontier[inx] = last;
+	return top;
+}
+
+extern job_queue_walk_t *job_queue_walk_create(void)
+{
+	job_queue_walk_t *walk = xmalloc(sizeof(job_queue_walk_t));
+	ListIterator heap_iterator;
+	job_queue_heap_t *heap;
+
+	walk_active++;
+	if (++last_walk_id == 0)
+		last_walk_id = 1;
+	walk->walk_id = last_walk_id;
+	if (heap_list) {
+		heap_iterator = list_iterator_create(heap_list);
+		while ((heap = list_next(heap_iterator))) {
+			if (heap->root)
+				_frontier_push(walk, heap->root);
+		}
+		list_iterator_destroy(heap_iterator);
+	}
+	return walk;
+}
+
+extern job_queue_rec_t *job_queue_walk_next(job_queue_walk_t *walk)
+{
+	job_queue_node_t *node;
+	struct job_record *job_ptr;
+
+	while ((node = _frontier_pop(walk))) {
+		if (node->child) {
+			node->child = _merge_pairs(node->child);
+			node->child->prev = node;
+			_frontier_push(walk, node->child);
+		}
+		if (!(job_ptr = node->rec.job_ptr))
+			continue;	/* removed during the walk */
+		/*
+		 * The node's key must not change while it is in the heap,
+		 * return a refreshed copy and reposition the node later
+		 */
+		memcpy(&walk->rec, &node->rec, sizeof(job_queue_rec_t));
+		walk->rec.array_task_id = job_ptr->array_task_id;
+		walk->rec.job_id = job_ptr->job_id;
+		walk->rec.priority = _get_priority(node);
+		if ((walk->rec.array_task_id != node->rec.array_task_id) ||
+		    (walk->rec.job_id != node->rec.job_id) ||
+		    (walk->rec.priority != node->rec.priority))
+			job_queue_update(job_ptr);
+		return &walk->rec;
+	}
+	return NULL;
+}
+
+extern int *job_queue_walk_state(job_queue_walk_t *walk,
+				 struct job_record *job_ptr)
+{
+	job_queue_node_t *node = job_ptr->queue_node;
+
+	xassert(node);
+	if (node->walk_id != walk->walk_id) {
+		node->walk_id = walk->walk_id;
+		node->walk_state = 0;
+	}
+	return &node->walk_state;
+}
+
+extern void job_queue_walk_destroy(job_queue_walk_t *walk)
+{
+	ListIterator heap_iterator;
+	job_queue_heap_t *heap;
+	job_queue_node_t *node;
+	struct job_record *job_ptr;
+
+	if (!walk)
+		return;
+	xfree(walk->frontier);
+	xfree(walk);
+	if (--walk_active)
+		return;
+
+	while ((node = dead_nodes)) {
+		dead_nodes = node->job_next;
+		if (!node->heap->part_ptr)
+			continue;	/* freed with its heap below */
+		_heap_remove(node);
+		xfree(node);
+	}
+	if (heap_list) {
+		heap_iterator = list_iterator_create(heap_list);
+		while ((heap = list_next(heap_iterator))) {
+			if (heap->part_ptr)
+				continue;
+			list_delete_item(heap_iterator);
+			_free_tree(heap->root);
+			xfree(heap);
+		}
+		list_iterator_destroy(heap_iterator);
+	}
+
+	if (deferred_list) {
+		while ((job_ptr = list_pop(deferred_list)))
+			job_queue_update(job_ptr);
+	}
+}
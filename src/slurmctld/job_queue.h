@@ -0,0 +1,104 @@
+/*****************************************************************************\
+ *  job_queue.h - persistent priority ordered queue of pending jobs
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#ifndef _HAVE_JOB_QUEUE_H
+#define _HAVE_JOB_QUEUE_H
+
+#include "src/slurmctld/job_scheduler.h"
+#include "src/slurmctld/slurmctld.h"
+
+typedef struct job_queue_walk job_queue_walk_t;
+
+/*
+ * Add, reposition or remove a job's entries to match its current state,
+ * partitions and priority. Pending jobs which are not held have one entry
+ * per partition. Changes requested during a walk are applied when the walk
+ * ends.
+ * NOTE: Caller must hold the job write lock
+ */
+extern void job_queue_update(struct job_record *job_ptr);
+
+/* Remove a job's entries, the job record is about to be freed */
+extern void job_queue_remove(struct job_record *job_ptr);
+
+/* Remove all entries for a partition, the record is about to be freed */
+extern void job_queue_part_remove(struct part_record *part_ptr);
+
+/*
+ * Discard the queue ordering. The caller is expected to call
+ * job_queue_update() for every job to rebuild it.
+ */
+extern void job_queue_reset(void);
+
+/* Return true if the queue must be rebuilt with job_queue_reset() */
+extern bool job_queue_reset_needed(void);
+
+/*
+ * Request a rebuild of the queue after changing the priority of many jobs
+ * at once, or anything else sort_job_queue2() depends upon, without
+ * calling job_queue_update() for each of them
+ */
+extern void job_queue_invalidate(void);
+
+/* Return the count of job/partition pairs in the queue */
+extern uint32_t job_queue_count(void);
+
+/*
+ * Start walking the queue of all partitions in priority order, as defined
+ * by sort_job_queue2(). Walking the queue partially sorts it in place, so
+ * later walks of the same jobs are cheaper.
+ * NOTE: Caller must hold the job write lock until job_queue_walk_destroy()
+ */
+extern job_queue_walk_t *job_queue_walk_create(void);
+
+/*
+ * Return the next job/partition pair of the walk or NULL at the end.
+ * The priority, job ID and array task ID are refreshed from the job record,
+ * the entry is repositioned when the walk ends if they changed. The record
+ * is valid until the next call.
+ */
+extern job_queue_rec_t *job_queue_walk_next(job_queue_walk_t *walk);
+
+/*
+ * Return per walk scratch space for a job, zero when the walk first
+ * returns one of the job's entries
+ */
+extern int *job_queue_walk_state(job_queue_walk_t *walk,
+				 struct job_record *job_ptr);
+
+/* End a walk and apply the changes requested during it */
+extern void job_queue_walk_destroy(job_queue_walk_t *walk);
+
+#endif	/* !_HAVE_JOB_QUEUE_H */
@@ -76,11 +76,14 @@
 #include "src/slurmctld/acct_policy.h"
 #include "src/slurmctld/agent.h"
 #include "src/slurmctld/burst_buffer.h"
+#include "src/slurmctld/depend_index.h"
 #include "src/slurmctld/fed_mgr.h"
 #include "src/slurmctld/front_end.h"
 #include "src/slurmctld/gang.h"
 #include "src/slurmctld/locks.h"
+#include "src/slurmctld/job_queue.h"
 #include "src/slurmctld/job_scheduler.h"
+#include "src/slurmctld/job_shape.h"
 #include "src/slurmctld/licenses.h"
 #include "src/slurmctld/locks.h"
 #include "src/slurmctld/node_scheduler.h"
@@ -88,6 +91,7 @@
 #include "src/slurmctld/preempt.h"
 #include "src/slurmctld/proc_req.h"
 #include "src/slurmctld/reservation.h"
+#include "src/slurmctld/sched_shard.h"
 #include "src/slurmctld/slurmctld.h"
 #include "src/slurmctld/srun_comm.h"
 #include "src/slurmctld/state_save.h"
@@ -98,7 +102,14 @@
 #  define CORRESPOND_ARRAY_TASK_CNT 10
 #endif
 #define BUILD_TIMEOUT 2000000	/* Max build_job_queue() run time in usec */
+#define QUEUE_REBUILD_INTERVAL 30 /* Seconds between job queue rebuilds */
 #define MAX_FAILED_RESV 10
+#define MAX_SCHED_PARALLEL 64
+#define SCHED_PARALLEL_BATCH 32	/* Jobs read ahead per sched_parallel
+				 * thread */
+#define DEPEND_TEST_MAX_AGE 60	/* Max seconds between tests of a job's
+				 * dependencies, in case a job state change
+				 * missed depend_index_notify() */
 
 typedef struct epilog_arg {
 	char *epilog_slurmctld;
@@ -111,13 +122,23 @@ typedef struct wait_boot_arg {
 	bitstr_t *node_bitmap;
 } wait_boot_arg_t;
 
+struct job_queue_iter {
+	job_queue_walk_t *walk;
+	bool clear_start;
+	bool backfill;
+	time_t now;
+	job_queue_rec_t rec;
+};
+
 static char **	_build_env(struct job_record *job_ptr, bool is_epilog);
 static batch_job_launch_msg_t *_build_launch_job_msg(struct job_record *job_ptr,
 						     uint16_t protocol_version);
 static void	_depend_list_del(void *dep_ptr);
 static void	_job_queue_append(List job_queue, struct job_record *job_ptr,
 				  struct part_record *part_ptr, uint32_t priority);
+static void	_job_queue_rebuild(void);
 static void	_job_queue_rec_del(void *x);
+static void	_job_queue_split_arrays(void);
 static bool	_job_runnable_test1(struct job_record *job_ptr,
 				    bool clear_start);
 static bool	_job_runnable_test2(struct job_record *job_ptr,
@@ -136,7 +157,10 @@ static int	_valid_node_feature(char *feature, bool can_reboot);
 static void *	_wait_boot(void *arg);
 #endif
 static int	build_queue_timeout = BUILD_TIMEOUT;
+static int	queue_rebuild_interval = QUEUE_REBUILD_INTERVAL;
 static int	save_last_part_update = 0;
+static List	split_array_list = NULL;	/* array_job_id of job arrays
+						 * with tasks to split out */
 
 static pthread_mutex_t sched_mutex = PTHREAD_MUTEX_INITIALIZER;
 static int sched_pend_thread = 0;
@@ -377,209 +401,390 @@ static bool _job_runnable_test2(struct job_record *job_ptr, bool check_min_time)
 }
 
 /*
- * build_job_queue - build (non-priority ordered) list of pending jobs
- * IN clear_start - if set then clear the start_time for pending jobs,
- *		    true when called from sched/backfill or sched/builtin
+ * Test if the scheduler must treat the tasks of a pending job array as
+ * separate jobs, either for burst buffer staging or because of a
+ * SLURM_DEPEND_AFTER_CORRESPOND dependency
+ */
+static bool _job_array_split_test(struct job_record *job_ptr, bool *use_bb,
+				  bool *use_corr)
+{
+	ListIterator depend_iter;
+	struct depend_spec *dep_ptr;
+
+	*use_bb = false;
+	*use_corr = false;
+	if (!IS_JOB_PENDING(job_ptr) ||
+	    !job_ptr->array_recs ||
+	    !job_ptr->array_recs->task_id_bitmap ||
+	    (job_ptr->array_task_id != NO_VAL))
+		return false;
+
+	if (job_ptr->burst_buffer)
+		*use_bb = true;
+	if (job_ptr->details && job_ptr->details->depend_list) {
+		depend_iter = list_iterator_create(
+			job_ptr->details->depend_list);
+		while ((dep_ptr = list_next(depend_iter))) {
+			if (dep_ptr->depend_type ==
+			    SLURM_DEPEND_AFTER_CORRESPOND) {
+				*use_corr = true;
+				break;
+			}
+		}
+		list_iterator_destroy(depend_iter);
+	}
+	return (*use_bb || *use_corr);
+}
+
+static int _find_split_array(void *x, void *key)
+{
+	if (*(uint32_t *) x == *(uint32_t *) key)
+		return 1;
+	return 0;
+}
+
+/*
+ * job_queue_split_array_add - note a job array whose tasks may need to be
+ *	split out, called when a job array is submitted or modified. The
+ *	queue rebuild notes all others.
+ */
+extern void job_queue_split_array_add(struct job_record *job_ptr)
+{
+	uint32_t *array_job_id;
+	bool use_bb, use_corr;
+
+	if (!_job_array_split_test(job_ptr, &use_bb, &use_corr))
+		return;
+	if (!split_array_list)
+		split_array_list = list_create(slurm_destroy_uint32_ptr);
+	if (list_find_first(split_array_list, _find_split_array,
+			    &job_ptr->job_id))
+		return;
+	array_job_id = xmalloc(sizeof(uint32_t));
+	*array_job_id = job_ptr->job_id;
+	list_append(split_array_list, array_job_id);
+}
+
+/*
+ * Split the next task out of a job array if needed
+ * RET false if the job array no longer needs splitting
+ */
+static bool _job_queue_split_array(struct job_record *job_ptr)
+{
+	struct job_record *new_job_ptr;
+	bool use_bb, use_corr;
+	int i, pend_cnt;
+	char jobid_buf[32];
+
+	if (!_job_array_split_test(job_ptr, &use_bb, &use_corr))
+		return false;
+	if ((i = bit_ffs(job_ptr->array_recs->task_id_bitmap)) < 0)
+		return false;
+	if (job_ptr->array_recs->task_cnt < 1)
+		return false;
+
+	pend_cnt = num_pending_job_array_tasks(job_ptr->array_job_id);
+	if ((use_bb && (pend_cnt >= bb_array_stage_cnt)) ||
+	    (!use_bb && (pend_cnt >= CORRESPOND_ARRAY_TASK_CNT)))
+		return true;	/* wait for pending tasks to start */
+	if (job_ptr->array_recs->task_cnt == 1) {
+		job_ptr->array_task_id = i;
+		(void) job_array_post_sched(job_ptr);
+		return false;
+	}
+	job_ptr->array_task_id = i;
+	new_job_ptr = job_array_split(job_ptr);
+	if (new_job_ptr) {
+		if (use_bb) {
+			debug("%s: Split out %s for burst buffer use",
+			      __func__,
+			      jobid2fmt(job_ptr, jobid_buf, sizeof(jobid_buf)));
+		} else {
+			info("%s: Split out %s for SLURM_DEPEND_AFTER_CORRESPOND use",
+			     __func__,
+			     jobid2fmt(job_ptr, jobid_buf, sizeof(jobid_buf)));
+		}
+		new_job_ptr->job_state = JOB_PENDING;
+		new_job_ptr->start_time = (time_t) 0;
+		/* Do NOT clear db_index here, it is handled when
+		 * task_id_str is created elsewhere */
+		if (use_bb)
+			(void) bb_g_job_validate2(job_ptr, NULL);
+	} else {
+		error("%s: Unable to copy record for %s", __func__,
+		      jobid2fmt(job_ptr, jobid_buf, sizeof(jobid_buf)));
+	}
+	return true;
+}
+
+/*
+ * Create individual job records for job arrays that the scheduler must
+ * treat as separate jobs. Only the job arrays noted by
+ * job_queue_split_array_add() are tested, rather than all of job_list.
+ */
+static void _job_queue_split_arrays(void)
+{
+	ListIterator split_iterator;
+	struct job_record *job_ptr;
+	uint32_t *array_job_id;
+
+	if (!split_array_list || !list_count(split_array_list))
+		return;
+
+	split_iterator = list_iterator_create(split_array_list);
+	while ((array_job_id = list_next(split_iterator))) {
+		/* The pending meta record keeps the job array's ID */
+		job_ptr = find_job_record(*array_job_id);
+		if (!job_ptr || !_job_queue_split_array(job_ptr))
+			list_delete_item(split_iterator);
+	}
+	list_iterator_destroy(split_iterator);
+}
+
+/* Initialize scheduling state of a pending job before testing it */
+static void _job_queue_prep_job(struct job_record *job_ptr, time_t now)
+{
+	acct_policy_handle_accrue_time(job_ptr, false);
+	job_ptr->preempt_in_progress = false;	/* initialize */
+	if (job_ptr->state_reason != WAIT_NO_REASON) {
+		job_ptr->state_reason_prev = job_ptr->state_reason;
+		last_job_update = now;
+	} else if ((job_ptr->state_reason_prev == WAIT_TIME) &&
+		   job_ptr->details &&
+		   (job_ptr->details->begin_time <= now)) {
+		job_ptr->state_reason_prev = job_ptr->state_reason;
+		last_job_update = now;
+	}
+}
+
+/*
+ * Partition specific test for ability to run now
+ * IN job_ptr - job to test
+ * IN part_ptr - partition to test, one of the job's partitions
  * IN backfill - true if running backfill scheduler, enforce min time limit
- * RET the job queue
- * NOTE: the caller must call FREE_NULL_LIST() on RET value to free memory
+ * IN now - current time
+ * RET true if the job can run in the partition
  */
-extern List build_job_queue(bool clear_start, bool backfill)
+static bool _job_queue_test_part(struct job_record *job_ptr,
+				 struct part_record *part_ptr, bool backfill,
+				 time_t now)
+{
+	int reason;
+
+	if (!job_ptr->part_ptr_list)
+		return _job_runnable_test2(job_ptr, backfill);
+
+	job_ptr->part_ptr = part_ptr;
+	reason = job_limits_check(&job_ptr, backfill);
+	if ((reason != WAIT_NO_REASON) &&
+	    (reason != job_ptr->state_reason)) {
+		job_ptr->state_reason = reason;
+		xfree(job_ptr->state_desc);
+		last_job_update = now;
+	}
+	if (reason != WAIT_NO_REASON)
+		return false;
+	return true;
+}
+
+/*
+ * Rebuild the pending job queue from job_list. This picks up priority
+ * changes made without a job_queue_update() call (e.g. by the priority
+ * plugin's periodic recalculation) and refreshes the state reason of every
+ * pending job, not just those visited by the schedulers. Job arrays with
+ * tasks to split out are noted for _job_queue_split_arrays().
+ */
+static void _job_queue_rebuild(void)
 {
 	static time_t last_log_time = 0;
-	List job_queue;
-	ListIterator depend_iter, job_iterator, part_iterator;
-	struct job_record *job_ptr = NULL, *new_job_ptr;
+	ListIterator job_iterator, part_iterator;
+	struct job_record *job_ptr = NULL;
 	struct part_record *part_ptr;
-	struct depend_spec *dep_ptr;
-	int i, pend_cnt, reason, dep_corr;
 	struct timeval start_tv = {0, 0};
 	int tested_jobs = 0;
-	char jobid_buf[32];
-	int job_part_pairs = 0;
+	bool test_jobs = true;
 	time_t now = time(NULL);
 
 	/* init the timer */
 	(void) slurm_delta_tv(&start_tv);
-	job_queue = list_create(_job_queue_rec_del);
-
-	/* Create individual job records for job arrays that need burst buffer
-	 * staging */
+	job_queue_reset();
 	job_iterator = list_iterator_create(job_list);
 	while ((job_ptr = (struct job_record *) list_next(job_iterator))) {
-		if (!IS_JOB_PENDING(job_ptr) ||
-		    !job_ptr->burst_buffer || !job_ptr->array_recs ||
-		    !job_ptr->array_recs->task_id_bitmap ||
-		    (job_ptr->array_task_id != NO_VAL))
+		if (!IS_JOB_PENDING(job_ptr))
 			continue;
+		if (!job_ptr->part_ptr_list && !job_ptr->part_ptr) {
+			part_ptr = find_part_record(job_ptr->partition);
+			if (part_ptr == NULL) {
+				error("Could not find partition %s "
+				      "for job %u", job_ptr->partition,
+				      job_ptr->job_id);
+				continue;
+			}
+			job_ptr->part_ptr = part_ptr;
+			error("partition pointer reset for job %u, "
+			      "part %s", job_ptr->job_id,
+			      job_ptr->partition);
+		}
+		job_queue_update(job_ptr);
+		job_queue_split_array_add(job_ptr);
 
-		if ((i = bit_ffs(job_ptr->array_recs->task_id_bitmap)) < 0)
+		if (!test_jobs)
 			continue;
-		pend_cnt = num_pending_job_array_tasks(job_ptr->array_job_id);
-		if (pend_cnt >= bb_array_stage_cnt)
-			continue;
-		if (job_ptr->array_recs->task_cnt < 1)
-			continue;
-		if (job_ptr->array_recs->task_cnt == 1) {
-			job_ptr->array_task_id = i;
-			(void) job_array_post_sched(job_ptr);
+		if (((tested_jobs % 100) == 0) &&
+		    (slurm_delta_tv(&start_tv) >= build_queue_timeout)) {
+			if (difftime(now, last_log_time) > 600) {
+				/* Log at most once every 10 minutes */
+				info("%s has run for %d usec, %d of %d jobs "
+				     "tested", __func__, build_queue_timeout,
+				     tested_jobs, list_count(job_list));
+				last_log_time = now;
+			}
+			test_jobs = false;
 			continue;
 		}
-		job_ptr->array_task_id = i;
-		new_job_ptr = job_array_split(job_ptr);
-		if (new_job_ptr) {
-			debug("%s: Split out %s for burst buffer use", __func__,
-			      jobid2fmt(job_ptr, jobid_buf, sizeof(jobid_buf)));
-			new_job_ptr->job_state = JOB_PENDING;
-			new_job_ptr->start_time = (time_t) 0;
-			/* Do NOT clear db_index here, it is handled when
-			 * task_id_str is created elsewhere */
-			(void) bb_g_job_validate2(job_ptr, NULL);
+		tested_jobs++;
+		_job_queue_prep_job(job_ptr, now);
+		if (!_job_runnable_test1(job_ptr, false))
+			continue;
+		if (job_ptr->part_ptr_list) {
+			part_iterator = list_iterator_create(
+				job_ptr->part_ptr_list);
+			while ((part_ptr = (struct part_record *)
+				list_next(part_iterator))) {
+				(void) _job_queue_test_part(job_ptr, part_ptr,
+							    false, now);
+			}
+			list_iterator_destroy(part_iterator);
 		} else {
-			error("%s: Unable to copy record for %s", __func__,
-			      jobid2fmt(job_ptr, jobid_buf, sizeof(jobid_buf)));
+			(void) _job_runnable_test2(job_ptr, false);
 		}
 	}
 	list_iterator_destroy(job_iterator);
+}
 
-	/* Create individual job records for job arrays with
-	 * depend_type == SLURM_DEPEND_AFTER_CORRESPOND */
-	job_iterator = list_iterator_create(job_list);
-	while ((job_ptr = (struct job_record *) list_next(job_iterator))) {
-		if (!IS_JOB_PENDING(job_ptr) ||
-		    !job_ptr->array_recs ||
-		    !job_ptr->array_recs->task_id_bitmap ||
-		    (job_ptr->array_task_id != NO_VAL))
-			continue;
-		if ((i = bit_ffs(job_ptr->array_recs->task_id_bitmap)) < 0)
-			continue;
-		if ((job_ptr->details == NULL) ||
-		    (job_ptr->details->depend_list == NULL) ||
-		    (list_count(job_ptr->details->depend_list) == 0))
-			continue;
-	        depend_iter = list_iterator_create(job_ptr->details->depend_list);
-		dep_corr = 0;
-	        while ((dep_ptr = list_next(depend_iter))) {
-	                if (dep_ptr->depend_type == SLURM_DEPEND_AFTER_CORRESPOND) {
-				dep_corr = 1;
-				break;
+/*
+ * job_queue_iter_create - start a priority ordered walk of the runnable
+ *	pending job/partition pairs
+ */
+extern job_queue_iter_t *job_queue_iter_create(bool clear_start,
+					       bool backfill)
+{
+	static time_t last_rebuild = 0;
+	job_queue_iter_t *iter;
+	time_t now = time(NULL);
+
+	if (job_queue_reset_needed() ||
+	    (difftime(now, last_rebuild) >= queue_rebuild_interval)) {
+		_job_queue_rebuild();
+		last_rebuild = now;
+	}
+	_job_queue_split_arrays();
+
+	iter = xmalloc(sizeof(job_queue_iter_t));
+	iter->walk = job_queue_walk_create();
+	iter->clear_start = clear_start;
+	iter->backfill = backfill;
+	iter->now = now;
+
+	return iter;
+}
+
+/*
+ * job_queue_iter_next - return the next runnable job/partition pair
+ */
+extern job_queue_rec_t *job_queue_iter_next(job_queue_iter_t *iter)
+{
+	job_queue_rec_t *job_queue_rec;
+	struct job_record *job_ptr;
+	int *state;
+
+	while ((job_queue_rec = job_queue_walk_next(iter->walk))) {
+		job_ptr = job_queue_rec->job_ptr;
+		/* Partition independent tests run once per job and walk */
+		state = job_queue_walk_state(iter->walk, job_ptr);
+		if (*state == 0) {
+			if (!IS_JOB_PENDING(job_ptr) ||
+			    (job_ptr->priority == 0)) {
+				/* Started or held since queued */
+				job_queue_update(job_ptr);
+				*state = -1;
+				continue;
 			}
-	        }
-		if (!dep_corr)
-			continue;
-		pend_cnt = num_pending_job_array_tasks(job_ptr->array_job_id);
-		if (pend_cnt >= CORRESPOND_ARRAY_TASK_CNT)
-			continue;
-		if (job_ptr->array_recs->task_cnt < 1)
+			_job_queue_prep_job(job_ptr, iter->now);
+			if (_job_runnable_test1(job_ptr, iter->clear_start))
+				*state = 1;
+			else
+				*state = -1;
+		}
+		if (*state < 0)
 			continue;
-		if (job_ptr->array_recs->task_cnt == 1) {
-			job_ptr->array_task_id = i;
-			(void) job_array_post_sched(job_ptr);
+		if (!job_ptr->part_ptr_list &&
+		    (job_queue_rec->part_ptr != job_ptr->part_ptr)) {
+			/* Partition changed since queued */
+			job_queue_update(job_ptr);
 			continue;
 		}
-		job_ptr->array_task_id = i;
-		new_job_ptr = job_array_split(job_ptr);
-		if (new_job_ptr) {
-			info("%s: Split out %s for SLURM_DEPEND_AFTER_CORRESPOND use",
-			      __func__,
-			      jobid2fmt(job_ptr, jobid_buf, sizeof(jobid_buf)));
-			new_job_ptr->job_state = JOB_PENDING;
-			new_job_ptr->start_time = (time_t) 0;
-			/* Do NOT clear db_index here, it is handled when
-			 * task_id_str is created elsewhere */
-		} else {
-			error("%s: Unable to copy record for %s", __func__,
-			      jobid2fmt(job_ptr, jobid_buf, sizeof(jobid_buf)));
-		}
+		if (!_job_queue_test_part(job_ptr, job_queue_rec->part_ptr,
+					  iter->backfill, iter->now))
+			continue;
+		memcpy(&iter->rec, job_queue_rec, sizeof(job_queue_rec_t));
+		return &iter->rec;
 	}
-	list_iterator_destroy(job_iterator);
 
-	job_iterator = list_iterator_create(job_list);
-	while ((job_ptr = (struct job_record *) list_next(job_iterator))) {
-		if (IS_JOB_PENDING(job_ptr))
-			acct_policy_handle_accrue_time(job_ptr, false);
+	return NULL;
+}
 
-		if (((tested_jobs % 100) == 0) &&
+/*
+ * job_queue_iter_destroy - end a walk of the pending job queue
+ */
+extern void job_queue_iter_destroy(job_queue_iter_t *iter)
+{
+	if (!iter)
+		return;
+	job_queue_walk_destroy(iter->walk);
+	xfree(iter);
+}
+
+/*
+ * build_job_queue - build priority ordered list of runnable pending jobs
+ * IN clear_start - if set then clear the start_time for pending jobs,
+ *		    true when called from sched/backfill or sched/builtin
+ * IN backfill - true if running backfill scheduler, enforce min time limit
+ * RET the job queue
+ * NOTE: the caller must call FREE_NULL_LIST() on RET value to free memory
+ */
+extern List build_job_queue(bool clear_start, bool backfill)
+{
+	static time_t last_log_time = 0;
+	List job_queue;
+	job_queue_iter_t *iter;
+	job_queue_rec_t *job_queue_rec;
+	struct timeval start_tv = {0, 0};
+	int job_part_pairs = 0;
+	time_t now = time(NULL);
+
+	/* init the timer */
+	(void) slurm_delta_tv(&start_tv);
+	job_queue = list_create(_job_queue_rec_del);
+	iter = job_queue_iter_create(clear_start, backfill);
+	while ((job_queue_rec = job_queue_iter_next(iter))) {
+		_job_queue_append(job_queue, job_queue_rec->job_ptr,
+				  job_queue_rec->part_ptr,
+				  job_queue_rec->priority);
+		if (((++job_part_pairs % 100) == 0) &&
 		    (slurm_delta_tv(&start_tv) >= build_queue_timeout)) {
 			if (difftime(now, last_log_time) > 600) {
 				/* Log at most once every 10 minutes */
 				info("%s has run for %d usec, exiting with %d "
-				     "of %d jobs tested, %d job-partition "
-				     "pairs added",
-				     __func__, build_queue_timeout, tested_jobs,
-				     list_count(job_list), job_part_pairs);
+				     "of %u job-partition pairs added",
+				     __func__, build_queue_timeout,
+				     job_part_pairs, job_queue_count());
 				last_log_time = now;
 			}
 			break;
 		}
-		tested_jobs++;
-		job_ptr->preempt_in_progress = false;	/* initialize */
-		if (job_ptr->state_reason != WAIT_NO_REASON) {
-			job_ptr->state_reason_prev = job_ptr->state_reason;
-			last_job_update = now;
-		} else if ((job_ptr->state_reason_prev == WAIT_TIME) &&
-			   job_ptr->details &&
-			   (job_ptr->details->begin_time <= now)) {
-			job_ptr->state_reason_prev = job_ptr->state_reason;
-			last_job_update = now;
-		}
-		if (!_job_runnable_test1(job_ptr, clear_start))
-			continue;
-
-		if (job_ptr->part_ptr_list) {
-			int inx = -1;
-			part_iterator = list_iterator_create(
-				job_ptr->part_ptr_list);
-			while ((part_ptr = (struct part_record *)
-				list_next(part_iterator))) {
-				job_ptr->part_ptr = part_ptr;
-				reason = job_limits_check(&job_ptr, backfill);
-				if ((reason != WAIT_NO_REASON) &&
-				    (reason != job_ptr->state_reason)) {
-					job_ptr->state_reason = reason;
-					xfree(job_ptr->state_desc);
-					last_job_update = now;
-				}
-				/* priority_array index matches part_ptr_list
-				 * position: increment inx */
-				inx++;
-				if (reason != WAIT_NO_REASON)
-					continue;
-				job_part_pairs++;
-				if (job_ptr->priority_array) {
-					_job_queue_append(job_queue, job_ptr,
-							  part_ptr,
-							  job_ptr->
-							  priority_array[inx]);
-				} else {
-					_job_queue_append(job_queue, job_ptr,
-							  part_ptr,
-							  job_ptr->priority);
-				}
-			}
-			list_iterator_destroy(part_iterator);
-		} else {
-			if (job_ptr->part_ptr == NULL) {
-				part_ptr = find_part_record(job_ptr->partition);
-				if (part_ptr == NULL) {
-					error("Could not find partition %s "
-					      "for job %u", job_ptr->partition,
-					      job_ptr->job_id);
-					continue;
-				}
-				job_ptr->part_ptr = part_ptr;
-				error("partition pointer reset for job %u, "
-				      "part %s", job_ptr->job_id,
-				      job_ptr->partition);
-			}
-			if (!_job_runnable_test2(job_ptr, backfill))
-				continue;
-			job_part_pairs++;
-			_job_queue_append(job_queue, job_ptr,
-					  job_ptr->part_ptr, job_ptr->priority);
-		}
 	}
-	list_iterator_destroy(job_iterator);
+	job_queue_iter_destroy(iter);
 
 	return job_queue;
 }
@@ -1170,15 +1375,18 @@ extern bool deadline_ok(struct job_record *job_ptr, char *func)
 static int _schedule(uint32_t job_limit)
 {
 	ListIterator job_iterator = NULL, part_iterator = NULL;
-	List job_queue = NULL;
+	job_queue_iter_t *job_queue_iter = NULL;
+	sched_shard_walk_t *shard_walk = NULL;
 	int failed_part_cnt = 0, failed_resv_cnt = 0, job_cnt = 0;
 	int error_code, i, j, part_cnt, time_limit, pend_time;
-	uint32_t job_depth = 0, array_task_id;
+	uint32_t job_depth = 0, array_task_id, batch_size;
 	job_queue_rec_t *job_queue_rec;
 	struct job_record *job_ptr = NULL;
 	struct part_record *part_ptr, **failed_parts = NULL;
 	struct part_record *skip_part_ptr = NULL;
 	struct slurmctld_resv **failed_resv = NULL;
+	job_shape_cache_t *shape_cache = NULL;
+	job_shape_rec_t *shape_rec;
 	bitstr_t *save_avail_node_bitmap;
 	struct part_record **sched_part_ptr = NULL;
 	int *sched_part_jobs = NULL, bb_wait_cnt = 0;
@@ -1192,6 +1400,7 @@ static int _schedule(uint32_t job_limit)
 	static bool assoc_limit_stop = false;
 	static int sched_timeout = 0;
 	static int sched_max_job_start = 0;
+	static int sched_parallel = 0;
 	static int bf_min_age_reserve = 0;
 	static uint32_t bf_min_prio_reserve = 0;
 	static int def_job_limit = 100;
@@ -1293,6 +1502,19 @@ static int _schedule(uint32_t job_limit)
 			build_queue_timeout = BUILD_TIMEOUT;
 		}
 
+		if (sched_params &&
+		    (tmp_ptr = strstr(sched_params,
+				      "queue_rebuild_interval="))) {
+			queue_rebuild_interval = atoi(tmp_ptr + 23);
+			if (queue_rebuild_interval < 0) {
+				error("Invalid queue_rebuild_interval: %d",
+				      queue_rebuild_interval);
+				queue_rebuild_interval = QUEUE_REBUILD_INTERVAL;
+			}
+		} else {
+			queue_rebuild_interval = QUEUE_REBUILD_INTERVAL;
+		}
+
 		if (sched_params &&
 		    (tmp_ptr = strstr(sched_params, "default_queue_depth="))) {
 			def_job_limit = atoi(tmp_ptr + 20);
@@ -1391,14 +1613,41 @@ static int _schedule(uint32_t job_limit)
 			sched_max_job_start = 0;
 		}
 
+		if (sched_params &&
+		    (tmp_ptr = strstr(sched_params, "sched_parallel="))) {
+			sched_parallel = atoi(tmp_ptr + 15);
+			if ((sched_parallel < 0) ||
+			    (sched_parallel > MAX_SCHED_PARALLEL)) {
+				error("Invalid sched_parallel: %d",
+				      sched_parallel);
+				sched_parallel = 0;
+			}
+		} else {
+			sched_parallel = 0;
+		}
+		if (sched_parallel > 1) {
+			/* Shard threads test jobs with concurrent will-runs */
+			char *select_type = slurm_get_select_type();
+			if (xstrcmp(select_type, "select/cons_res") &&
+			    xstrcmp(select_type, "select/cons_tres")) {
+				error("SchedulerParameters sched_parallel is not "
+				      "supported with SelectType=%s, ignored",
+				      select_type);
+				sched_parallel = 0;
+			}
+			xfree(select_type);
+		}
+		sched_shard_init(sched_parallel);
+
 		xfree(sched_params);
 		sched_update = slurmctld_conf.last_update;
 		info("SchedulerParameters=default_queue_depth=%d,"
 		     "max_rpc_cnt=%d,max_sched_time=%d,partition_job_depth=%d,"
-		     "sched_max_job_start=%d,sched_min_interval=%d",
+		     "queue_rebuild_interval=%d,sched_max_job_start=%d,"
+		     "sched_min_interval=%d,sched_parallel=%d",
 		     def_job_limit, defer_rpc_cnt, sched_timeout,
-		     max_jobs_per_part, sched_max_job_start,
-		     sched_min_interval);
+		     max_jobs_per_part, queue_rebuild_interval,
+		     sched_max_job_start, sched_min_interval, sched_parallel);
 	}
 
 	if ((defer_rpc_cnt > 0) &&
@@ -1466,6 +1715,7 @@ static int _schedule(uint32_t job_limit)
 	part_cnt = list_count(part_list);
 	failed_parts = xmalloc(sizeof(struct part_record *) * part_cnt);
 	failed_resv = xmalloc(sizeof(struct slurmctld_resv*) * MAX_FAILED_RESV);
+	shape_cache = job_shape_cache_create();
 	save_avail_node_bitmap = bit_copy(avail_node_bitmap);
 	bit_and_not(avail_node_bitmap, booting_node_bitmap);
 
@@ -1524,7 +1774,7 @@ static int _schedule(uint32_t job_limit)
 	 * If we are doing FIFO scheduling, use the job records right off the
 	 * job list.
 	 *
-	 * If a job is submitted to multiple partitions then build_job_queue()
+	 * If a job is submitted to multiple partitions then the job queue
 	 * will return a separate record for each job:partition pair.
 	 *
 	 * In both cases, we test each partition associated with the job.
@@ -1533,9 +1783,11 @@ static int _schedule(uint32_t job_limit)
 		slurmctld_diag_stats.schedule_queue_len = list_count(job_list);
 		job_iterator = list_iterator_create(job_list);
 	} else {
-		job_queue = build_job_queue(false, false);
-		slurmctld_diag_stats.schedule_queue_len = list_count(job_queue);
-		sort_job_queue(job_queue);
+		job_queue_iter = job_queue_iter_create(false, false);
+		slurmctld_diag_stats.schedule_queue_len = job_queue_count();
+		/* NULL if all partitions overlap, test jobs sequentially */
+		if (sched_parallel > 1)
+			shard_walk = sched_shard_walk_create(job_queue_iter);
 	}
 	while (1) {
 		if (fifo_sched) {
@@ -1546,7 +1798,7 @@ static int _schedule(uint32_t job_limit)
 			if (!job_ptr)
 				break;
 
-			/* When not fifo we do this in build_job_queue(). */
+			/* When not fifo we do this in job_queue_iter_next(). */
 			if (IS_JOB_PENDING(job_ptr))
 				acct_policy_handle_accrue_time(job_ptr, false);
 
@@ -1578,14 +1830,28 @@ next_part:			part_ptr = (struct part_record *)
 					continue;
 			}
 		} else {
-			job_queue_rec = list_pop(job_queue);
+			if (shard_walk) {
+				/* Read ahead no deeper than the loop goes */
+				batch_size = sched_parallel *
+					     SCHED_PARALLEL_BATCH;
+				if (job_depth < job_limit) {
+					batch_size = MIN(batch_size,
+							 job_limit - job_depth);
+				} else {
+					batch_size = 1;
+				}
+				job_queue_rec = sched_shard_walk_next(
+						shard_walk, batch_size);
+			} else {
+				job_queue_rec = job_queue_iter_next(
+							job_queue_iter);
+			}
 			if (!job_queue_rec)
 				break;
 			array_task_id = job_queue_rec->array_task_id;
 			job_ptr  = job_queue_rec->job_ptr;
 			part_ptr = job_queue_rec->part_ptr;
 			job_ptr->priority = job_queue_rec->priority;
-			xfree(job_queue_rec);
 			if (!avail_front_end(job_ptr)) {
 				job_ptr->state_reason = WAIT_FRONT_END;
 				xfree(job_ptr->state_desc);
@@ -1868,6 +2134,23 @@ next_task:
 			job_ptr->time_limit = deadline_time_limit;
 		}
 
+		/*
+		 * Resources only get scarcer during the cycle, so a job with
+		 * the same request as one which could not start will not start
+		 * either. Handle it as if select_nodes() failed again.
+		 */
+		shape_rec = job_shape_cache_find(shape_cache, job_ptr,
+						 job_ptr->time_limit);
+		if (shape_rec && shape_rec->start_time) {
+			if (job_ptr->state_reason != shape_rec->state_reason) {
+				job_ptr->state_reason = shape_rec->state_reason;
+				xfree(job_ptr->state_desc);
+				last_job_update = now;
+			}
+			error_code = ESLURM_NODES_BUSY;
+			goto skip_start;
+		}
+
 		/* get fed job lock from origin cluster */
 		if (fed_mgr_job_lock(job_ptr)) {
 			error_code = ESLURM_FED_JOB_LOCK;
@@ -1875,6 +2158,11 @@ next_task:
 		}
 
 		error_code = select_nodes(job_ptr, false, NULL, NULL, false);
+		if (shape_rec && (error_code == ESLURM_NODES_BUSY) &&
+		    !job_ptr->preempt_in_progress) {
+			shape_rec->start_time = INFINITE;
+			shape_rec->state_reason = job_ptr->state_reason;
+		}
 
 		if (error_code == SLURM_SUCCESS) {
 			/*
@@ -2087,13 +2375,15 @@ fail_this_part:	if (fail_by_part) {
 	avail_node_bitmap = save_avail_node_bitmap;
 	xfree(failed_parts);
 	xfree(failed_resv);
+	job_shape_cache_destroy(shape_cache);
 	if (fifo_sched) {
 		if (job_iterator)
 			list_iterator_destroy(job_iterator);
 		if (part_iterator)
 			list_iterator_destroy(part_iterator);
-	} else if (job_queue) {
-		FREE_NULL_LIST(job_queue);
+	} else {
+		sched_shard_walk_destroy(shard_walk);
+		job_queue_iter_destroy(job_queue_iter);
 	}
 	xfree(sched_part_ptr);
 	xfree(sched_part_jobs);
@@ -2876,17 +3166,25 @@ extern int test_job_dependency(struct job_record *job_ptr)
 	ListIterator depend_iter, job_iterator;
 	struct depend_spec *dep_ptr;
 	bool failure = false, depends = false, rebuild_str = false;
-	bool or_satisfied = false;
+	bool or_satisfied = false, indexed = true;
  	List job_queue = NULL;
  	bool run_now;
 	int results = 0;
 	struct job_record *qjob_ptr, *djob_ptr, *dcjob_ptr;
+	time_t now = time(NULL);
 
 	if ((job_ptr->details == NULL) ||
 	    (job_ptr->details->depend_list == NULL) ||
 	    (list_count(job_ptr->details->depend_list) == 0))
 		return 0;
 
+	/* No job waited on has changed state since the last test */
+	if (job_ptr->details->depend_test_time &&
+	    ((now - job_ptr->details->depend_test_time) <
+	     DEPEND_TEST_MAX_AGE))
+		return 1;
+	job_ptr->details->depend_test_time = 0;
+
 	depend_iter = list_iterator_create(job_ptr->details->depend_list);
 	while ((dep_ptr = list_next(depend_iter))) {
 		bool clear_dep = false;
@@ -3041,7 +3339,6 @@ extern int test_job_dependency(struct job_record *job_ptr)
 				break;
 			}
 		} else if (dep_ptr->depend_type == SLURM_DEPEND_EXPAND) {
-			time_t now = time(NULL);
 			if (IS_JOB_PENDING(djob_ptr)) {
 				depends = true;
 			} else if (IS_JOB_COMPLETED(djob_ptr)) {
@@ -3073,6 +3370,18 @@ extern int test_job_dependency(struct job_record *job_ptr)
 				break;
 			}
 			list_delete_item(depend_iter);
+		} else if ((dep_ptr->depend_type == SLURM_DEPEND_SINGLETON) ||
+			   (dep_ptr->depend_type == SLURM_DEPEND_EXPAND) ||
+			   (dep_ptr->depend_type ==
+			    SLURM_DEPEND_BURST_BUFFER) ||
+			   ((dep_ptr->depend_type ==
+			     SLURM_DEPEND_AFTER_CORRESPOND) &&
+			    job_ptr->array_recs)) {
+			/*
+			 * Depends upon other jobs, the job's own array
+			 * records or burst buffer state, test every pass
+			 */
+			indexed = false;
 		}
 	}
 	list_iterator_destroy(depend_iter);
@@ -3086,6 +3395,11 @@ extern int test_job_dependency(struct job_record *job_ptr)
 	else if (depends)
 		results = 1;
 
+	if ((results == 1) && indexed && !or_satisfied) {
+		depend_index_add(job_ptr);
+		job_ptr->details->depend_test_time = now;
+	}
+
 	return results;
 }
 
@@ -3181,6 +3495,7 @@ extern int update_job_dependency(struct job_record *job_ptr, char *new_depend)
 
 	/* Clear dependencies on NULL, "0", or empty dependency input */
 	job_ptr->details->expanding_jobid = 0;
+	job_ptr->details->depend_test_time = 0;
 	if ((new_depend == NULL) || (new_depend[0] == '\0') ||
 	    ((new_depend[0] == '0') && (new_depend[1] == '\0'))) {
 		xfree(job_ptr->details->dependency);
@@ -53,6 +53,8 @@ typedef struct job_queue_rec {
 	uint32_t priority;		/* Job priority in THIS partition */
 } job_queue_rec_t;
 
+typedef struct job_queue_iter job_queue_iter_t;
+
 /*
  * build_feature_list - Translate a job's feature string into a feature_list
  * IN  details->features
@@ -62,7 +64,8 @@ typedef struct job_queue_rec {
 extern int build_feature_list(struct job_record *job_ptr);
 
 /*
- * build_job_queue - build (non-priority ordered) list of pending jobs
+ * build_job_queue - build priority ordered list of runnable pending jobs
+ *	from the persistent job queue, see job_queue_iter_create()
  * IN clear_start - if set then clear the start_time for pending jobs
  * IN backfill - true if running backfill scheduler, enforce min time limit
  * RET the job queue
@@ -107,6 +110,36 @@ extern void feature_list_delete(void *x);
  */
 extern bool job_is_completing(bitstr_t *eff_cg_bitmap);
 
+/*
+ * job_queue_iter_create - start a walk of the runnable pending jobs in
+ *	descending priority order, one record per job/partition pair. Only
+ *	the jobs actually visited are tested for their ability to run.
+ * IN clear_start - if set then clear the start_time for pending jobs
+ * IN backfill - true if running backfill scheduler, enforce min time limit
+ * RET iterator, free with job_queue_iter_destroy()
+ * NOTE: The caller must hold the job write lock and partition read lock
+ *	until the iterator is destroyed
+ */
+extern job_queue_iter_t *job_queue_iter_create(bool clear_start,
+					       bool backfill);
+
+/*
+ * job_queue_iter_next - return the next runnable job/partition pair
+ * RET record valid until the next call, or NULL at the end of the queue
+ */
+extern job_queue_rec_t *job_queue_iter_next(job_queue_iter_t *iter);
+
+/* job_queue_iter_destroy - end a walk of the pending job queue */
+extern void job_queue_iter_destroy(job_queue_iter_t *iter);
+
+/*
+ * job_queue_split_array_add - note a pending job array whose tasks the
+ *	scheduler may need to split out into individual job records, for
+ *	burst buffer staging or a SLURM_DEPEND_AFTER_CORRESPOND dependency
+ * NOTE: The caller must hold the job write lock
+ */
+extern void job_queue_split_array_add(struct job_record *job_ptr);
+
 /* Determine if a pending job will run using only the specified nodes
  * (in job_desc_msg->req_nodes), build response message and return
  * SLURM_SUCCESS on success. Otherwise return an error code. Caller
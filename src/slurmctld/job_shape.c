@@ -0,0 +1,194 @@
+/*****************************************************************************\
+ *  job_shape.c - per-cycle cache of pending job shapes
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+/*
+ * Parameter sweeps and job arrays queue many jobs with identical requests.
+ * When one of them can not be allocated resources, the others will fail in
+ * the same way, so the schedulers can skip them (or start their search for
+ * resources where the first job's search ended) without calling the select
+ * plugin again. The shape is built as a string, so jobs which only look
+ * alike never share a record.
+ */
+
+#include "config.h"
+
+#include "src/common/xhash.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
+
+#include "src/slurmctld/job_shape.h"
+
+struct job_shape_cache {
+	bool prio_preempt;		/* preemption depends on job priority */
+	xhash_t *hash;			/* job_shape_rec_t by key */
+};
+
+static const char *_shape_key(void *x)
+{
+	job_shape_rec_t *shape_rec = (job_shape_rec_t *) x;
+
+	return shape_rec->key;
+}
+
+static void _shape_free(void *x)
+{
+	job_shape_rec_t *shape_rec = (job_shape_rec_t *) x;
+
+	xfree(shape_rec->key);
+	xfree(shape_rec);
+}
+
+/*
+ * Append a string with its length, so that separators in the string (e.g.
+ * "|" in a feature expression) can not make two shapes look the same
+ */
+static void _key_str(char **key, const char *str)
+{
+	if (str)
+		xstrfmtcat(*key, "|%zu:%s", strlen(str), str);
+	else
+		xstrcat(*key, "|-");
+}
+
+/* Build the job's shape, NULL if the job has none */
+static char *_shape_build(job_shape_cache_t *cache,
+			  struct job_record *job_ptr, uint32_t time_limit)
+{
+	struct job_details *detail_ptr = job_ptr->details;
+	multi_core_data_t *mc_ptr;
+	char *key = NULL;
+
+	if (!detail_ptr || !job_ptr->part_ptr || detail_ptr->req_node_bitmap ||
+	    detail_ptr->req_nodes || detail_ptr->expanding_jobid ||
+	    job_ptr->resv_name || job_ptr->burst_buffer ||
+	    job_ptr->pack_job_id || job_ptr->fed_details)
+		return NULL;
+
+	xstrfmtcat(key, "%s|%u|%u|%u|%u|%u|%u|%u|%u|%u|%"PRIu64"|%u",
+		   job_ptr->part_ptr->name, job_ptr->qos_id, time_limit,
+		   detail_ptr->min_nodes, detail_ptr->max_nodes,
+		   detail_ptr->min_cpus, detail_ptr->max_cpus,
+		   detail_ptr->num_tasks, detail_ptr->pn_min_cpus,
+		   detail_ptr->pn_min_tmp_disk, detail_ptr->pn_min_memory,
+		   detail_ptr->core_spec);
+	xstrfmtcat(key, "|%u|%u|%u|%u|%u|%u|%u|%u",
+		   detail_ptr->contiguous, detail_ptr->cpus_per_task,
+		   detail_ptr->ntasks_per_node, detail_ptr->overcommit,
+		   detail_ptr->plane_size, detail_ptr->share_res,
+		   detail_ptr->task_dist, detail_ptr->whole_node);
+	if ((mc_ptr = detail_ptr->mc_ptr)) {
+		xstrfmtcat(key, "|%u|%u|%u|%u|%u|%u|%u|%u|%u",
+			   mc_ptr->boards_per_node, mc_ptr->sockets_per_board,
+			   mc_ptr->sockets_per_node, mc_ptr->cores_per_socket,
+			   mc_ptr->threads_per_core, mc_ptr->ntasks_per_board,
+			   mc_ptr->ntasks_per_socket, mc_ptr->ntasks_per_core,
+			   mc_ptr->plane_size);
+	} else
+		xstrcat(key, "|-");
+	xstrfmtcat(key, "|%x|%u|%u|%u",
+		   job_ptr->bit_flags &
+		   (GRES_ENFORCE_BIND | SPREAD_JOB | USE_MIN_NODES),
+		   job_ptr->power_flags, job_ptr->req_switch,
+		   job_ptr->wait4switch);
+	_key_str(&key, detail_ptr->features);
+	_key_str(&key, detail_ptr->cluster_features);
+	_key_str(&key, detail_ptr->exc_nodes);
+	_key_str(&key, job_ptr->licenses);
+	_key_str(&key, job_ptr->mcs_label);
+	_key_str(&key, job_ptr->network);
+	_key_str(&key, job_ptr->cpus_per_tres);
+	_key_str(&key, job_ptr->mem_per_tres);
+	_key_str(&key, job_ptr->tres_per_job);
+	_key_str(&key, job_ptr->tres_per_node);
+	_key_str(&key, job_ptr->tres_per_socket);
+	_key_str(&key, job_ptr->tres_per_task);
+
+	/* Resources shared only between jobs of the same user */
+	if ((detail_ptr->whole_node == WHOLE_NODE_USER) ||
+	    (detail_ptr->whole_node == WHOLE_NODE_MCS) ||
+	    (job_ptr->part_ptr->flags & PART_FLAG_EXCLUSIVE_USER))
+		xstrfmtcat(key, "|u%u", job_ptr->user_id);
+	/* Jobs it may preempt */
+	if (cache->prio_preempt)
+		xstrfmtcat(key, "|p%u", job_ptr->priority);
+
+	return key;
+}
+
+extern job_shape_cache_t *job_shape_cache_create(void)
+{
+	job_shape_cache_t *cache = xmalloc(sizeof(job_shape_cache_t));
+
+	cache->prio_preempt = !xstrcmp(slurmctld_conf.preempt_type,
+				       "preempt/job_prio");
+	cache->hash = xhash_init(_shape_key, _shape_free);
+
+	return cache;
+}
+
+extern void job_shape_cache_clear(job_shape_cache_t *cache)
+{
+	if (cache)
+		xhash_clear(cache->hash);
+}
+
+extern void job_shape_cache_destroy(job_shape_cache_t *cache)
+{
+	if (!cache)
+		return;
+	xhash_free(cache->hash);
+	xfree(cache);
+}
+
+extern job_shape_rec_t *job_shape_cache_find(job_shape_cache_t *cache,
+					     struct job_record *job_ptr,
+					     uint32_t time_limit)
+{
+	job_shape_rec_t *shape_rec;
+	char *key;
+
+	if (!(key = _shape_build(cache, job_ptr, time_limit)))
+		return NULL;
+	if ((shape_rec = xhash_get(cache->hash, key))) {
+		xfree(key);
+		return shape_rec;
+	}
+	shape_rec = xmalloc(sizeof(job_shape_rec_t));
+	shape_rec->key = key;
+	shape_rec->state_reason = WAIT_NO_REASON;
+	xhash_add(cache->hash, shape_rec);
+
+	return shape_rec;
+}
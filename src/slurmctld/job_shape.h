@@ -0,0 +1,82 @@
+/*****************************************************************************\
+ *  job_shape.h - per-cycle cache of pending job shapes
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#ifndef _HAVE_JOB_SHAPE_H
+#define _HAVE_JOB_SHAPE_H
+
+#include "src/slurmctld/slurmctld.h"
+
+typedef struct job_shape_cache job_shape_cache_t;
+
+/* What a scheduling cycle learned about one job shape in one partition */
+typedef struct job_shape_rec {
+	char *key;			/* see job_shape_cache_find() */
+	time_t start_time;		/* no job of this shape can start
+					 * before this time, zero if unknown,
+					 * INFINITE if it can not start */
+	uint32_t state_reason;		/* reason the last job did not start */
+} job_shape_rec_t;
+
+/*
+ * Create an empty cache of job shapes. The cache is only valid while the
+ * resources available to pending jobs can not grow, typically one scheduling
+ * cycle without releasing the job write lock.
+ * NOTE: Caller must hold the configuration read lock
+ */
+extern job_shape_cache_t *job_shape_cache_create(void);
+
+/* Forget everything learned, the resources available may have grown */
+extern void job_shape_cache_clear(job_shape_cache_t *cache);
+
+extern void job_shape_cache_destroy(job_shape_cache_t *cache);
+
+/*
+ * Return the record for the job's shape in its current partition, creating
+ * it if needed. The shape covers everything in the request that decides
+ * where and when the job can be allocated resources: partition, QOS,
+ * features, node, CPU, memory, GRES and TRES counts, task layout, exclusive
+ * use and the time limit. Jobs with a request which is likely unique to them
+ * (required nodes, an advanced reservation, burst buffer, heterogeneous or
+ * federated job) have no shape and NULL is returned.
+ * IN cache - as returned by job_shape_cache_create()
+ * IN job_ptr - pending job with part_ptr set
+ * IN time_limit - time limit the job is being tested with, in minutes
+ * RET record valid until the cache is cleared or destroyed, or NULL
+ */
+extern job_shape_rec_t *job_shape_cache_find(job_shape_cache_t *cache,
+					     struct job_record *job_ptr,
+					     uint32_t time_limit);
+
+#endif /* !_HAVE_JOB_SHAPE_H */
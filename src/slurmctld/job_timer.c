@@ -0,0 +1,293 @@
+/*****************************************************************************\
+ *  job_timer.c - index of running jobs by when their time limits need testing
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+/*
+ * job_time_limit() used to test every job record on each pass, which at
+ * hundreds of thousands of (mostly pending) jobs holds the job write lock
+ * for a noticeable time. Instead, each running or suspended job is kept in
+ * a binary min-heap keyed by the earliest time at which one of the tests in
+ * job_time_limit() could act upon it: warning signals, time limit mail,
+ * srun timeout messages, preemption grace time, the inactivity limit,
+ * reservation end and step time limits. Each pass then tests only the jobs
+ * whose time has come and indexes them again.
+ *
+ * A test time may be early, which costs one unnecessary test, but must never
+ * be late. Changes which only move a job's deadlines later (for example
+ * activity updating time_last_active) do not need to re-index the job.
+ * Usage based limits enforced by acct_policy_job_time_out() can be reached
+ * at any time, so when they are enforced every running job is tested on
+ * every pass, as are configuring jobs and jobs near their end time.
+ */
+
+#include "config.h"
+
+#include "src/common/xmalloc.h"
+
+#include "src/slurmctld/job_timer.h"
+
+#define TIMER_HEAP_MIN	1024
+
+static struct job_record **timer_heap = NULL;	/* index one is the root */
+static uint32_t timer_heap_cnt = 0;
+static uint32_t timer_heap_size = 0;
+static bool rescan = true;
+
+static void _heap_set(uint32_t inx, struct job_record *job_ptr)
+{
+	timer_heap[inx] = job_ptr;
+	job_ptr->timer_inx = inx;
+}
+
+static void _sift_up(uint32_t inx)
+{
+	struct job_record *job_ptr = timer_heap[inx];
+	uint32_t parent;
+
+	while (inx > 1) {
+		parent = inx / 2;
+		if (timer_heap[parent]->timer_time <= job_ptr->timer_time)
+			break;
+		_heap_set(inx, timer_heap[parent]);
+		inx = parent;
+	}
+	_heap_set(inx, job_ptr);
+}
+
+static void _sift_down(uint32_t inx)
+{
+	struct job_record *job_ptr = timer_heap[inx];
+	uint32_t child;
+
+	while ((child = inx * 2) <= timer_heap_cnt) {
+		if ((child < timer_heap_cnt) &&
+		    (timer_heap[child + 1]->timer_time <
+		     timer_heap[child]->timer_time))
+			child++;
+		if (job_ptr->timer_time <= timer_heap[child]->timer_time)
+			break;
+		_heap_set(inx, timer_heap[child]);
+		inx = child;
+	}
+	_heap_set(inx, job_ptr);
+}
+
+static void _heap_remove(struct job_record *job_ptr)
+{
+	uint32_t inx = job_ptr->timer_inx;
+	struct job_record *last_ptr;
+
+	job_ptr->timer_inx = 0;
+	last_ptr = timer_heap[timer_heap_cnt--];
+	if (last_ptr == job_ptr)
+		return;
+	_heap_set(inx, last_ptr);
+	if ((inx > 1) &&
+	    (timer_heap[inx / 2]->timer_time > last_ptr->timer_time))
+		_sift_up(inx);
+	else
+		_sift_down(inx);
+}
+
+static time_t _min_time(time_t time1, time_t time2)
+{
+	return (time1 < time2) ? time1 : time2;
+}
+
+/*
+ * Return the earliest time at which a test in job_time_limit() could act
+ * upon this job, now if it must be tested on every pass, or zero if it need
+ * not be tested at all. Each time is the first at which the corresponding
+ * test in job_time_limit() succeeds.
+ */
+static time_t _job_test_time(struct job_record *job_ptr, time_t now)
+{
+	ListIterator step_iterator;
+	struct step_record *step_ptr;
+	time_t end_time = job_ptr->end_time, test_time, resv_end;
+	uint32_t resv_over_run;
+
+	if (!IS_JOB_RUNNING(job_ptr) && !IS_JOB_SUSPENDED(job_ptr))
+		return (time_t) 0;
+	if (IS_JOB_CONFIGURING(job_ptr))
+		return now;
+
+	if (job_ptr->preempt_time) {
+		test_time = end_time;
+		if (job_ptr->warn_time && !(job_ptr->warn_flags & WARN_SENT)) {
+			test_time = _min_time(test_time, end_time -
+					      job_ptr->warn_time -
+					      PERIODIC_TIMEOUT);
+		}
+		return test_time;
+	}
+
+	if ((accounting_enforce & ACCOUNTING_ENFORCE_LIMITS) &&
+	    !(accounting_enforce & ACCOUNTING_ENFORCE_SAFE))
+		return now;
+
+	/*
+	 * The srun timeout message is sent on every pass from here until the
+	 * job ends, which also covers the end of its time limit and any
+	 * OverTimeLimit.
+	 */
+	test_time = end_time - (PERIODIC_TIMEOUT * 2);
+
+	if (slurmctld_conf.inactive_limit && (job_ptr->batch_flag == 0)) {
+		test_time = _min_time(test_time, job_ptr->time_last_active +
+				      (slurmctld_conf.inactive_limit * 4 / 3) +
+				      slurmctld_conf.msg_timeout + 1);
+	}
+
+	if (job_ptr->time_limit != INFINITE) {
+		if (job_ptr->warn_time && !(job_ptr->warn_flags & WARN_SENT)) {
+			test_time = _min_time(test_time, end_time -
+					      job_ptr->warn_time -
+					      PERIODIC_TIMEOUT);
+		}
+		if (job_ptr->mail_type & MAIL_JOB_TIME50) {
+			test_time = _min_time(test_time, end_time -
+				(time_t) (job_ptr->time_limit * 60 * 0.5));
+		} else if (job_ptr->mail_type & MAIL_JOB_TIME80) {
+			test_time = _min_time(test_time, end_time -
+				(time_t) (job_ptr->time_limit * 60 * 0.2));
+		} else if (job_ptr->mail_type & MAIL_JOB_TIME90) {
+			test_time = _min_time(test_time, end_time -
+				(time_t) (job_ptr->time_limit * 60 * 0.1));
+		}
+	}
+
+	if (job_ptr->resv_ptr &&
+	    !(job_ptr->resv_ptr->flags & RESERVE_FLAG_FLEX)) {
+		resv_over_run = slurmctld_conf.resv_over_run;
+		if (resv_over_run == INFINITE16)
+			resv_over_run = YEAR_SECONDS;
+		else
+			resv_over_run *= 60;
+		resv_end = job_ptr->resv_ptr->end_time + resv_over_run + 1;
+		test_time = _min_time(test_time, resv_end);
+	}
+
+	if ((job_ptr->job_state == JOB_RUNNING) && job_ptr->step_list) {
+		step_iterator = list_iterator_create(job_ptr->step_list);
+		while ((step_ptr = list_next(step_iterator))) {
+			if ((step_ptr->state != JOB_RUNNING) ||
+			    (step_ptr->time_limit == INFINITE) ||
+			    (step_ptr->time_limit == NO_VAL))
+				continue;
+			test_time = _min_time(test_time, step_ptr->start_time +
+					      step_ptr->tot_sus_time +
+					      (step_ptr->time_limit * 60));
+		}
+		list_iterator_destroy(step_iterator);
+	}
+
+	return test_time;
+}
+
+extern void job_timer_arm(struct job_record *job_ptr)
+{
+	time_t now = time(NULL), test_time;
+	time_t old_time = job_ptr->timer_time;
+
+	test_time = _job_test_time(job_ptr, now);
+	if (test_time == 0) {
+		if (job_ptr->timer_inx)
+			_heap_remove(job_ptr);
+		return;
+	}
+	/* Never return a job twice from the same pass */
+	if (test_time <= now)
+		test_time = now + 1;
+	job_ptr->timer_time = test_time;
+
+	if (job_ptr->timer_inx) {
+		if (test_time < old_time)
+			_sift_up(job_ptr->timer_inx);
+		else if (test_time > old_time)
+			_sift_down(job_ptr->timer_inx);
+		return;
+	}
+
+	if (timer_heap_cnt + 1 >= timer_heap_size) {
+		timer_heap_size = MAX(timer_heap_size * 2, TIMER_HEAP_MIN);
+		xrealloc(timer_heap,
+			 sizeof(struct job_record *) * timer_heap_size);
+	}
+	_heap_set(++timer_heap_cnt, job_ptr);
+	_sift_up(timer_heap_cnt);
+}
+
+extern void job_timer_remove(struct job_record *job_ptr)
+{
+	if (job_ptr->timer_inx)
+		_heap_remove(job_ptr);
+}
+
+extern struct job_record *job_timer_next(time_t now)
+{
+	struct job_record *job_ptr;
+
+	if (!job_timer_due(now))
+		return NULL;
+	job_ptr = timer_heap[1];
+	_heap_remove(job_ptr);
+	return job_ptr;
+}
+
+extern bool job_timer_due(time_t now)
+{
+	return (timer_heap_cnt && (timer_heap[1]->timer_time <= now));
+}
+
+extern void job_timer_rescan(void)
+{
+	rescan = true;
+}
+
+extern bool job_timer_rescan_due(void)
+{
+	bool rc = rescan;
+
+	rescan = false;
+	return rc;
+}
+
+extern void job_timer_fini(void)
+{
+	xfree(timer_heap);
+	timer_heap_cnt = 0;
+	timer_heap_size = 0;
+	rescan = true;
+}
@@ -0,0 +1,81 @@
+/*****************************************************************************\
+ *  job_timer.h - index of running jobs by when their time limits need testing
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#ifndef _HAVE_JOB_TIMER_H
+#define _HAVE_JOB_TIMER_H
+
+#include "src/slurmctld/slurmctld.h"
+
+/*
+ * Compute when job_time_limit() next needs to test a job and index it under
+ * that time, or remove it from the index if it is neither running nor
+ * suspended. Call whenever a change may bring that time closer: the job
+ * starts, is resumed or preempted, its time limit, end time, reservation,
+ * mail options or any step time limit changes.
+ * NOTE: Caller must hold the job write lock
+ */
+extern void job_timer_arm(struct job_record *job_ptr);
+
+/*
+ * Remove a job from the index, called when its record is purged
+ * NOTE: Caller must hold the job write lock
+ */
+extern void job_timer_remove(struct job_record *job_ptr);
+
+/*
+ * Remove and return the job with the earliest test time if that time is not
+ * after "now", otherwise return NULL. The job is not indexed again until
+ * job_timer_arm() is called for it.
+ * NOTE: Caller must hold the job write lock
+ */
+extern struct job_record *job_timer_next(time_t now);
+
+/* Return true if job_timer_next() would return a job */
+extern bool job_timer_due(time_t now);
+
+/*
+ * Request that job_time_limit() test every job on its next pass, used when
+ * job state is recovered, configuration parameters change, or a reservation
+ * end time is updated
+ */
+extern void job_timer_rescan(void);
+
+/* Return true once for every job_timer_rescan() request */
+extern bool job_timer_rescan_due(void);
+
+/* Free all memory, called at slurmctld shutdown */
+extern void job_timer_fini(void);
+
+#endif /* !_HAVE_JOB_TIMER_H */
@@ -38,18 +38,84 @@
 \*****************************************************************************/
 
 #include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
 #include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
 
+#include "src/common/pack.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
 #include "src/slurmctld/locks.h"
 #include "src/slurmctld/slurmctld.h"
 
+/*
+ * Lock statistics: every lock_slurmctld() records, per lock and mode, how
+ * long the caller waited for the lock and how long it held it until
+ * unlock_slurmctld(), both as totals, maximums and histograms with one
+ * bucket per decade of microseconds. The same is recorded per acquiring
+ * function (the caller's __func__), which for RPCs identifies the message
+ * type. A lock holder exceeding SlurmctldParameters=lock_hold_warn is
+ * logged. The statistics are reported by sdiag and, with
+ * SlurmctldParameters=lock_stats_interval, periodically written to
+ * StateSaveLocation/lock_stats.
+ */
+#define LOCK_HIST_CNT	7	/* <10us, <100us, ... <1s, >=1s */
+#define LOCK_SITE_MAX	512	/* acquiring functions tracked */
+
+typedef struct {
+	uint32_t cnt;
+	uint64_t wait_time;	/* usec */
+	uint32_t wait_max;
+	uint64_t hold_time;	/* usec */
+	uint32_t hold_max;
+	uint32_t wait_hist[LOCK_HIST_CNT];
+	uint32_t hold_hist[LOCK_HIST_CNT];
+} lock_stat_t;
+
+typedef struct {
+	const char *key;	/* caller's __func__, NULL if unused */
+	char *name;		/* copy, the key may be in a plugin */
+	uint32_t cnt;
+	uint64_t wait_time;	/* usec for all of its locks */
+	uint32_t wait_max;
+	uint64_t hold_time;	/* usec from last lock to unlock */
+	uint32_t hold_max;
+	uint32_t long_cnt;	/* holds over lock_hold_warn */
+} lock_site_t;
+
+/* Locks of the calling thread, kept from lock_slurmctld() to unlock */
+typedef struct {
+	const char *caller;
+	uint64_t start;			/* lock_slurmctld() called */
+	uint64_t acquired[ENTITY_COUNT];
+} lock_thread_t;
+
 static pthread_mutex_t locks_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t locks_cond = PTHREAD_COND_INITIALIZER;
 static pthread_mutex_t state_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 static slurmctld_lock_flags_t slurmctld_locks;
+static uint32_t write_gen[ENTITY_COUNT];	/* write lock releases */
+
+static pthread_key_t lock_thread_key;
+static pthread_once_t lock_thread_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static lock_stat_t lock_stats[ENTITY_COUNT][2];	/* read, write */
+static lock_site_t lock_sites[LOCK_SITE_MAX];
+static lock_site_t lock_site_other;	/* used once lock_sites is full */
+static uint32_t lock_hold_warn = 0;	/* usec, 0 if disabled */
+static int lock_stats_interval = 0;	/* seconds, 0 if disabled */
+static char *lock_stats_file = NULL;
+static time_t lock_stats_saved = 0;
+static const char *lock_names[ENTITY_COUNT] = {
+	"conf", "job", "node", "part", "fed" };
+static const char *level_names[] = { "none", "read", "write" };
 
 static void _wr_rdlock(lock_datatype_t datatype);
 static void _wr_rdunlock(lock_datatype_t datatype);
@@ -117,67 +183,166 @@ void init_locks(void)
 	memset((void *) &slurmctld_locks, 0, sizeof(slurmctld_locks));
 }
 
-/* lock_slurmctld - Issue the required lock requests in a well defined order */
-extern void lock_slurmctld(slurmctld_lock_t lock_levels)
+static void _lock_thread_free(void *x)
+{
+	xfree(x);
+}
+
+static void _lock_thread_key_init(void)
+{
+	if (pthread_key_create(&lock_thread_key, _lock_thread_free))
+		fatal("%s: pthread_key_create: %m", __func__);
+}
+
+static lock_thread_t *_lock_thread(void)
+{
+	lock_thread_t *lock_thread;
+
+	(void) pthread_once(&lock_thread_once, _lock_thread_key_init);
+	if (!(lock_thread = pthread_getspecific(lock_thread_key))) {
+		lock_thread = xmalloc(sizeof(lock_thread_t));
+		(void) pthread_setspecific(lock_thread_key, lock_thread);
+	}
+	return lock_thread;
+}
+
+static uint64_t _now_usec(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t) ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+static int _hist_inx(uint64_t usec)
+{
+	int i;
+
+	for (i = 0; (usec >= 10) && (i < (LOCK_HIST_CNT - 1)); i++)
+		usec /= 10;
+	return i;
+}
+
+/* Find the statistics of an acquiring function, adding it if new */
+static lock_site_t *_lock_site(const char *caller)
 {
+	uint32_t i, inx;
+	lock_site_t *site;
+
+	inx = ((uintptr_t) caller >> 3) % LOCK_SITE_MAX;
+	for (i = 0; i < LOCK_SITE_MAX; i++) {
+		site = &lock_sites[(inx + i) % LOCK_SITE_MAX];
+		if (site->key == caller)
+			return site;
+		if (!site->key) {
+			site->key = caller;
+			site->name = xstrdup(caller);
+			return site;
+		}
+	}
+	return &lock_site_other;
+}
+
+/* Record the wait and hold times of the locks being released */
+static void _lock_stats_record(slurmctld_lock_t *lock_levels,
+			       lock_thread_t *lock_thread, uint64_t now)
+{
+	lock_level_t *levels = (lock_level_t *) lock_levels;
+	uint64_t wait, hold, last = lock_thread->start;
+	lock_stat_t *stat;
+	lock_site_t *site;
+	bool warn = false;
+	int i;
+
+	slurm_mutex_lock(&stats_mutex);
+	for (i = 0; i < ENTITY_COUNT; i++) {
+		if (levels[i] == NO_LOCK)
+			continue;
+		stat = &lock_stats[i][(levels[i] == WRITE_LOCK) ? 1 : 0];
+		wait = lock_thread->acquired[i] - last;
+		hold = now - lock_thread->acquired[i];
+		last = lock_thread->acquired[i];
+		stat->cnt++;
+		stat->wait_time += wait;
+		stat->wait_max = MAX(stat->wait_max, wait);
+		stat->wait_hist[_hist_inx(wait)]++;
+		stat->hold_time += hold;
+		stat->hold_max = MAX(stat->hold_max, hold);
+		stat->hold_hist[_hist_inx(hold)]++;
+	}
+
+	/* last is now the time the final lock was acquired */
+	wait = last - lock_thread->start;
+	hold = now - last;
+	site = _lock_site(lock_thread->caller);
+	site->cnt++;
+	site->wait_time += wait;
+	site->wait_max = MAX(site->wait_max, wait);
+	site->hold_time += hold;
+	site->hold_max = MAX(site->hold_max, hold);
+	if (lock_hold_warn && (hold > lock_hold_warn)) {
+		site->long_cnt++;
+		warn = true;
+	}
+	slurm_mutex_unlock(&stats_mutex);
+
+	if (warn) {
+		info("%s held locks {conf:%s job:%s node:%s part:%s fed:%s} for %"PRIu64" usec",
+		     lock_thread->caller, level_names[levels[CONF_LOCK]],
+		     level_names[levels[JOB_LOCK]],
+		     level_names[levels[NODE_LOCK]],
+		     level_names[levels[PART_LOCK]],
+		     level_names[levels[FED_LOCK]], hold);
+	}
+}
+
+/*
+ * lock_slurmctld_from - Issue the required lock requests in a well defined
+ *	order, recording the wait for caller. Use lock_slurmctld().
+ */
+extern void lock_slurmctld_from(slurmctld_lock_t lock_levels,
+				const char *caller)
+{
+	lock_level_t *levels = (lock_level_t *) &lock_levels;
+	lock_thread_t *lock_thread = _lock_thread();
+	int i;
+
 	xassert(_store_locks(lock_levels));
 
-	if (lock_levels.conf == READ_LOCK)
-		_wr_rdlock(CONF_LOCK);
-	else if (lock_levels.conf == WRITE_LOCK)
-		_wr_wrlock(CONF_LOCK);
-
-	if (lock_levels.job == READ_LOCK)
-		_wr_rdlock(JOB_LOCK);
-	else if (lock_levels.job == WRITE_LOCK)
-		_wr_wrlock(JOB_LOCK);
-
-	if (lock_levels.node == READ_LOCK)
-		_wr_rdlock(NODE_LOCK);
-	else if (lock_levels.node == WRITE_LOCK)
-		_wr_wrlock(NODE_LOCK);
-
-	if (lock_levels.part == READ_LOCK)
-		_wr_rdlock(PART_LOCK);
-	else if (lock_levels.part == WRITE_LOCK)
-		_wr_wrlock(PART_LOCK);
-
-	if (lock_levels.fed == READ_LOCK)
-		_wr_rdlock(FED_LOCK);
-	else if (lock_levels.fed == WRITE_LOCK)
-		_wr_wrlock(FED_LOCK);
+	lock_thread->caller = caller;
+	lock_thread->start = _now_usec();
+	for (i = 0; i < ENTITY_COUNT; i++) {
+		if (levels[i] == READ_LOCK)
+			_wr_rdlock(i);
+		else if (levels[i] == WRITE_LOCK)
+			_wr_wrlock(i);
+		else
+			continue;
+		lock_thread->acquired[i] = _now_usec();
+	}
 }
 
 /* unlock_slurmctld - Issue the required unlock requests in a well
  *	defined order */
 extern void unlock_slurmctld(slurmctld_lock_t lock_levels)
 {
+	lock_level_t *levels = (lock_level_t *) &lock_levels;
+	lock_thread_t *lock_thread = _lock_thread();
+	uint64_t now = _now_usec();
+	int i;
+
 	xassert(_clear_locks(lock_levels));
 
-	if (lock_levels.fed == READ_LOCK)
-		_wr_rdunlock(FED_LOCK);
-	else if (lock_levels.fed == WRITE_LOCK)
-		_wr_wrunlock(FED_LOCK);
-
-	if (lock_levels.part == READ_LOCK)
-		_wr_rdunlock(PART_LOCK);
-	else if (lock_levels.part == WRITE_LOCK)
-		_wr_wrunlock(PART_LOCK);
-
-	if (lock_levels.node == READ_LOCK)
-		_wr_rdunlock(NODE_LOCK);
-	else if (lock_levels.node == WRITE_LOCK)
-		_wr_wrunlock(NODE_LOCK);
-
-	if (lock_levels.job == READ_LOCK)
-		_wr_rdunlock(JOB_LOCK);
-	else if (lock_levels.job == WRITE_LOCK)
-		_wr_wrunlock(JOB_LOCK);
-
-	if (lock_levels.conf == READ_LOCK)
-		_wr_rdunlock(CONF_LOCK);
-	else if (lock_levels.conf == WRITE_LOCK)
-		_wr_wrunlock(CONF_LOCK);
+	for (i = ENTITY_COUNT - 1; i >= 0; i--) {
+		if (levels[i] == READ_LOCK)
+			_wr_rdunlock(i);
+		else if (levels[i] == WRITE_LOCK)
+			_wr_wrunlock(i);
+	}
+
+	if (lock_thread->caller)
+		_lock_stats_record(&lock_levels, lock_thread, now);
+	lock_thread->caller = NULL;
 }
 
 /* _wr_rdlock - Issue a read lock on the specified data type
@@ -238,6 +403,7 @@ static void _wr_wrunlock(lock_datatype_t datatype)
 	slurm_mutex_lock(&locks_mutex);
 	slurmctld_locks.entity[write_lock(datatype)]--;
 	xassert(slurmctld_locks.entity[write_lock(datatype)] >= 0);
+	write_gen[datatype]++;
 	slurm_cond_broadcast(&locks_cond);
 	slurm_mutex_unlock(&locks_mutex);
 }
@@ -251,6 +417,20 @@ void get_lock_values(slurmctld_lock_flags_t * lock_flags)
 	       sizeof(slurmctld_locks));
 }
 
+/* get_lock_write_gen - Get the number of write locks released on the
+ *	specified data type. If this value is unchanged, the data protected
+ *	by that lock has not been modified. */
+extern uint32_t get_lock_write_gen(lock_datatype_t datatype)
+{
+	uint32_t gen;
+
+	slurm_mutex_lock(&locks_mutex);
+	gen = write_gen[datatype];
+	slurm_mutex_unlock(&locks_mutex);
+
+	return gen;
+}
+
 /* un/lock semaphore used for saving state of slurmctld */
 extern void lock_state_files(void)
 {
@@ -260,3 +440,255 @@ extern void unlock_state_files(void)
 {
 	slurm_mutex_unlock(&state_mutex);
 }
+
+/*
+ * lock_stats_config - Read the lock_hold_warn and lock_stats_interval
+ *	options of SlurmctldParameters
+ * NOTE: Caller must hold the config lock
+ */
+extern void lock_stats_config(void)
+{
+	char *tmp_ptr;
+	int hold_warn = 0, interval = 0;
+
+	if ((tmp_ptr = xstrcasestr(slurmctld_conf.slurmctld_params,
+				   "lock_hold_warn="))) {
+		hold_warn = atoi(tmp_ptr + 15);
+		if (hold_warn < 0) {
+			error("Invalid SlurmctldParameters lock_hold_warn=%d",
+			      hold_warn);
+			hold_warn = 0;
+		}
+	}
+	if ((tmp_ptr = xstrcasestr(slurmctld_conf.slurmctld_params,
+				   "lock_stats_interval="))) {
+		interval = atoi(tmp_ptr + 20);
+		if (interval < 0) {
+			error("Invalid SlurmctldParameters lock_stats_interval=%d",
+			      interval);
+			interval = 0;
+		}
+	}
+
+	slurm_mutex_lock(&stats_mutex);
+	lock_hold_warn = (uint32_t) hold_warn * 1000;
+	lock_stats_interval = interval;
+	xfree(lock_stats_file);
+	if (interval) {
+		xstrfmtcat(lock_stats_file, "%s/lock_stats",
+			   slurmctld_conf.state_save_location);
+	}
+	slurm_mutex_unlock(&stats_mutex);
+}
+
+/* reset_lock_stats - Clear the lock statistics */
+extern void reset_lock_stats(void)
+{
+	int i;
+
+	slurm_mutex_lock(&stats_mutex);
+	memset(lock_stats, 0, sizeof(lock_stats));
+	for (i = 0; i < LOCK_SITE_MAX; i++)
+		xfree(lock_sites[i].name);
+	memset(lock_sites, 0, sizeof(lock_sites));
+	memset(&lock_site_other, 0, sizeof(lock_site_t));
+	lock_site_other.name = "other";
+	slurm_mutex_unlock(&stats_mutex);
+}
+
+/* Return the sites with statistics, the last one being lock_site_other */
+static lock_site_t **_lock_sites(uint32_t *site_cnt)
+{
+	lock_site_t **sites;
+	uint32_t cnt = 0;
+	int i;
+
+	sites = xmalloc(sizeof(lock_site_t *) * (LOCK_SITE_MAX + 1));
+	for (i = 0; i < LOCK_SITE_MAX; i++) {
+		if (lock_sites[i].cnt)
+			sites[cnt++] = &lock_sites[i];
+	}
+	if (lock_site_other.cnt) {
+		lock_site_other.name = "other";
+		sites[cnt++] = &lock_site_other;
+	}
+	*site_cnt = cnt;
+	return sites;
+}
+
+/* pack_lock_stats - Pack the lock statistics for sdiag */
+extern void pack_lock_stats(Buf buffer, uint16_t protocol_version)
+{
+	uint32_t i, j, cnt, site_cnt, stat_cnt = ENTITY_COUNT * 2;
+	char *names[LOCK_SITE_MAX + 1];
+	uint32_t u32[LOCK_SITE_MAX + 1], wait_max[LOCK_SITE_MAX + 1];
+	uint64_t u64[LOCK_SITE_MAX + 1];
+	uint32_t wait_hist[ENTITY_COUNT * 2 * LOCK_HIST_CNT];
+	uint32_t hold_hist[ENTITY_COUNT * 2 * LOCK_HIST_CNT];
+	lock_stat_t *stat;
+	lock_site_t **sites;
+
+	if (protocol_version < SLURM_18_08_PROTOCOL_VERSION)
+		return;
+
+	slurm_mutex_lock(&stats_mutex);
+	pack32(lock_hold_warn, buffer);
+	pack32(LOCK_HIST_CNT, buffer);
+
+	/* Lock and mode pairs, "conf read", "conf write", "job read", ... */
+	for (i = 0; i < stat_cnt; i++) {
+		names[i] = NULL;
+		xstrfmtcat(names[i], "%s %s", lock_names[i / 2],
+			   (i % 2) ? "write" : "read");
+	}
+	packstr_array(names, stat_cnt, buffer);
+	for (i = 0; i < stat_cnt; i++)
+		xfree(names[i]);
+	for (i = 0, stat = &lock_stats[0][0]; i < stat_cnt; i++, stat++) {
+		u32[i] = stat->cnt;
+		for (j = 0; j < LOCK_HIST_CNT; j++) {
+			wait_hist[(i * LOCK_HIST_CNT) + j] = stat->wait_hist[j];
+			hold_hist[(i * LOCK_HIST_CNT) + j] = stat->hold_hist[j];
+		}
+	}
+	pack32_array(u32, stat_cnt, buffer);
+	for (i = 0, stat = &lock_stats[0][0]; i < stat_cnt; i++, stat++)
+		u64[i] = stat->wait_time;
+	pack64_array(u64, stat_cnt, buffer);
+	for (i = 0, stat = &lock_stats[0][0]; i < stat_cnt; i++, stat++)
+		u32[i] = stat->wait_max;
+	pack32_array(u32, stat_cnt, buffer);
+	for (i = 0, stat = &lock_stats[0][0]; i < stat_cnt; i++, stat++)
+		u64[i] = stat->hold_time;
+	pack64_array(u64, stat_cnt, buffer);
+	for (i = 0, stat = &lock_stats[0][0]; i < stat_cnt; i++, stat++)
+		u32[i] = stat->hold_max;
+	pack32_array(u32, stat_cnt, buffer);
+	cnt = stat_cnt * LOCK_HIST_CNT;
+	pack32_array(wait_hist, cnt, buffer);
+	pack32_array(hold_hist, cnt, buffer);
+
+	/* Acquiring functions */
+	sites = _lock_sites(&site_cnt);
+	for (i = 0; i < site_cnt; i++)
+		names[i] = sites[i]->name;
+	packstr_array(names, site_cnt, buffer);
+	for (i = 0; i < site_cnt; i++)
+		u32[i] = sites[i]->cnt;
+	pack32_array(u32, site_cnt, buffer);
+	for (i = 0; i < site_cnt; i++) {
+		u64[i] = sites[i]->wait_time;
+		wait_max[i] = sites[i]->wait_max;
+	}
+	pack64_array(u64, site_cnt, buffer);
+	pack32_array(wait_max, site_cnt, buffer);
+	for (i = 0; i < site_cnt; i++)
+		u64[i] = sites[i]->hold_time;
+	pack64_array(u64, site_cnt, buffer);
+	for (i = 0; i < site_cnt; i++)
+		u32[i] = sites[i]->hold_max;
+	pack32_array(u32, site_cnt, buffer);
+	for (i = 0; i < site_cnt; i++)
+		u32[i] = sites[i]->long_cnt;
+	pack32_array(u32, site_cnt, buffer);
+	xfree(sites);
+	slurm_mutex_unlock(&stats_mutex);
+}
+
+static int _cmp_site_hold(const void *a, const void *b)
+{
+	uint64_t hold_a = (*(lock_site_t **) a)->hold_time;
+	uint64_t hold_b = (*(lock_site_t **) b)->hold_time;
+
+	if (hold_a > hold_b)
+		return -1;
+	if (hold_a < hold_b)
+		return 1;
+	return 0;
+}
+
+/*
+ * lock_stats_save - Write the lock statistics to StateSaveLocation/lock_stats
+ *	if lock_stats_interval seconds elapsed since they were last written
+ */
+extern void lock_stats_save(time_t now)
+{
+	char *out = NULL, *new_file = NULL, *file = NULL;
+	lock_stat_t *stat;
+	lock_site_t **sites;
+	uint32_t i, j, site_cnt;
+	int fd;
+
+	slurm_mutex_lock(&stats_mutex);
+	if (!lock_stats_interval ||
+	    ((now - lock_stats_saved) < lock_stats_interval)) {
+		slurm_mutex_unlock(&stats_mutex);
+		return;
+	}
+	lock_stats_saved = now;
+	file = xstrdup(lock_stats_file);
+
+	xstrfmtcat(out, "Lock statistics at %ld (usec)\n", (long) now);
+	xstrcat(out, "lock       count      ave_wait   max_wait   "
+		"ave_hold   max_hold   wait/hold histogram "
+		"<10us <100us <1ms <10ms <100ms <1s >=1s\n");
+	for (i = 0, stat = &lock_stats[0][0]; i < (ENTITY_COUNT * 2);
+	     i++, stat++) {
+		if (!stat->cnt)
+			continue;
+		xstrfmtcat(out, "%-4s %-5s %-10u %-10"PRIu64" %-10u %-10"PRIu64" %-10u",
+			   lock_names[i / 2], (i % 2) ? "write" : "read",
+			   stat->cnt, stat->wait_time / stat->cnt,
+			   stat->wait_max, stat->hold_time / stat->cnt,
+			   stat->hold_max);
+		for (j = 0; j < LOCK_HIST_CNT; j++)
+			xstrfmtcat(out, " %u", stat->wait_hist[j]);
+		xstrcat(out, " /");
+		for (j = 0; j < LOCK_HIST_CNT; j++)
+			xstrfmtcat(out, " %u", stat->hold_hist[j]);
+		xstrcat(out, "\n");
+	}
+
+	xstrfmtcat(out, "\nfunction                                 count      "
+		   "ave_wait   max_wait   ave_hold   max_hold   long(>%u)\n",
+		   lock_hold_warn);
+	sites = _lock_sites(&site_cnt);
+	qsort(sites, site_cnt, sizeof(lock_site_t *), _cmp_site_hold);
+	for (i = 0; i < site_cnt; i++) {
+		xstrfmtcat(out, "%-40s %-10u %-10"PRIu64" %-10u %-10"PRIu64" %-10u %u\n",
+			   sites[i]->name, sites[i]->cnt,
+			   sites[i]->wait_time / sites[i]->cnt,
+			   sites[i]->wait_max,
+			   sites[i]->hold_time / sites[i]->cnt,
+			   sites[i]->hold_max, sites[i]->long_cnt);
+	}
+	xfree(sites);
+	slurm_mutex_unlock(&stats_mutex);
+
+	new_file = xstrdup_printf("%s.new", file);
+	fd = open(new_file, O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		error("Can't save lock statistics, create file %s error %m",
+		      new_file);
+	} else {
+		size_t len = strlen(out), offset = 0;
+		ssize_t rc;
+
+		while (offset < len) {
+			rc = write(fd, out + offset, len - offset);
+			if (rc < 0) {
+				if (errno == EINTR)
+					continue;
+				error("Error writing file %s, %m", new_file);
+				break;
+			}
+			offset += rc;
+		}
+		(void) close(fd);
+		if ((offset == len) && (rename(new_file, file) < 0))
+			error("rename(%s, %s): %m", new_file, file);
+	}
+	xfree(new_file);
+	xfree(file);
+	xfree(out);
+}
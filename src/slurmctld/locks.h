@@ -92,6 +92,10 @@
 #define _SLURMCTLD_LOCKS_H
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "src/common/pack.h"
 
 /* levels of locking required for each data structure */
 typedef enum {
@@ -145,17 +149,45 @@ typedef struct {
  * OUT lock_flags - a copy of the current lock values */
 extern void get_lock_values (slurmctld_lock_flags_t *lock_flags);
 
+/* get_lock_write_gen - Get the number of write locks released on the
+ *	specified data type. If this value is unchanged, the data protected
+ *	by that lock has not been modified. */
+extern uint32_t get_lock_write_gen(lock_datatype_t datatype);
+
 /* init_locks - create locks used for slurmctld data structure access
  *	control */
 extern void init_locks ( void );
 
-/* lock_slurmctld - Issue the required lock requests in a well defined order */
-extern void lock_slurmctld (slurmctld_lock_t lock_levels);
+/* lock_slurmctld - Issue the required lock requests in a well defined order,
+ *	the wait and hold times are recorded for the calling function */
+#define lock_slurmctld(lock_levels) \
+	lock_slurmctld_from(lock_levels, __func__)
+extern void lock_slurmctld_from(slurmctld_lock_t lock_levels,
+				const char *caller);
 
 /* unlock_slurmctld - Issue the required unlock requests in a well
  *	defined order */
 extern void unlock_slurmctld (slurmctld_lock_t lock_levels);
 
+/*
+ * lock_stats_config - Read the lock_hold_warn and lock_stats_interval
+ *	options of SlurmctldParameters
+ * NOTE: Caller must hold the config lock
+ */
+extern void lock_stats_config(void);
+
+/*
+ * lock_stats_save - Write the lock statistics to StateSaveLocation/lock_stats
+ *	if lock_stats_interval seconds elapsed since they were last written
+ */
+extern void lock_stats_save(time_t now);
+
+/* pack_lock_stats - Pack the lock statistics for sdiag */
+extern void pack_lock_stats(Buf buffer, uint16_t protocol_version);
+
+/* reset_lock_stats - Clear the lock statistics */
+extern void reset_lock_stats(void);
+
 /* un/lock semaphore used for saving state of slurmctld */
 extern void lock_state_files ( void );
 extern void unlock_state_files ( void );
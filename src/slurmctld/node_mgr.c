@@ -72,6 +72,7 @@
 
 #include "src/slurmctld/agent.h"
 #include "src/slurmctld/front_end.h"
+#include "src/slurmctld/info_filter.h"
 #include "src/slurmctld/locks.h"
 #include "src/slurmctld/ping_nodes.h"
 #include "src/slurmctld/proc_req.h"
@@ -79,6 +80,7 @@
 #include "src/slurmctld/reservation.h"
 #include "src/slurmctld/slurmctld.h"
 #include "src/slurmctld/slurmctld_plugstack.h"
+#include "src/slurmctld/state_repl.h"
 #include "src/slurmctld/state_save.h"
 #include "src/common/timers.h"
 #include "src/slurmctld/trigger_mgr.h"
@@ -104,7 +106,7 @@ static bool	_is_cloud_hidden(struct node_record *node_ptr);
 static void 	_make_node_down(struct node_record *node_ptr,
 				time_t event_time);
 static bool	_node_is_hidden(struct node_record *node_ptr, uid_t uid);
-static int	_open_node_state_file(char **state_file);
+static Buf	_open_node_state_file(char **state_file);
 static void 	_pack_node(struct node_record *dump_node_ptr, Buf buffer,
 			   uint16_t protocol_version, uint16_t show_flags);
 static void	_sync_bitmaps(struct node_record *node_ptr, int job_count);
@@ -131,6 +133,7 @@ int dump_all_node_state ( void )
 	slurmctld_lock_t node_read_lock = { READ_LOCK, NO_LOCK, READ_LOCK,
 					    NO_LOCK, NO_LOCK };
 	Buf buffer = init_buf(high_buffer_size);
+	uint32_t *rec_off = NULL, rec_cnt = 0;
 	DEF_TIMERS;
 
 	START_TIMER;
@@ -141,10 +144,14 @@ int dump_all_node_state ( void )
 
 	/* write node records to buffer */
 	lock_slurmctld (node_read_lock);
+	if (state_repl_active())
+		rec_off = xmalloc(sizeof(uint32_t) * (node_record_count + 1));
 	for (inx = 0, node_ptr = node_record_table_ptr; inx < node_record_count;
 	     inx++, node_ptr++) {
 		xassert (node_ptr->magic == NODE_MAGIC);
 		xassert (node_ptr->config_ptr->magic == CONFIG_MAGIC);
+		if (rec_off)
+			rec_off[rec_cnt++] = get_buf_offset(buffer);
 		_dump_node_state (node_ptr, buffer);
 	}
 
@@ -199,6 +206,9 @@ int dump_all_node_state ( void )
 	xfree (new_file);
 	unlock_state_files ();
 
+	if (rec_off && !error_code)
+		state_repl_publish(STATE_REPL_NODE, buffer, rec_off, rec_cnt);
+	xfree(rec_off);
 	free_buf (buffer);
 	END_TIMER2("dump_all_node_state");
 	return error_code;
@@ -242,31 +252,27 @@ _dump_node_state (struct node_record *dump_node_ptr, Buf buffer)
 
 /* Open the node state save file, or backup if necessary.
  * state_file IN - the name of the state save file used
- * RET the file description to read from or error code
+ * RET buffer mapping the file contents or NULL on error
  */
-static int _open_node_state_file(char **state_file)
+static Buf _open_node_state_file(char **state_file)
 {
-	int state_fd;
-	struct stat stat_buf;
+	Buf buffer;
 
 	*state_file = xstrdup(slurmctld_conf.state_save_location);
 	xstrcat(*state_file, "/node_state");
-	state_fd = open(*state_file, O_RDONLY);
-	if (state_fd < 0) {
+	if ((buffer = state_repl_open(STATE_REPL_NODE, *state_file)))
+		return buffer;
+	if (!(buffer = create_mmap_buf(*state_file))) {
 		error("Could not open node state file %s: %m", *state_file);
-	} else if (fstat(state_fd, &stat_buf) < 0) {
-		error("Could not stat node state file %s: %m", *state_file);
-		(void) close(state_fd);
-	} else if (stat_buf.st_size < 10) {
+	} else if (size_buf(buffer) < 10) {
 		error("Node state file %s too small", *state_file);
-		(void) close(state_fd);
+		free_buf(buffer);
 	} else 	/* Success */
-		return state_fd;
+		return buffer;
 
 	error("NOTE: Trying backup state save file. Information may be lost!");
 	xstrcat(*state_file, ".old");
-	state_fd = open(*state_file, O_RDONLY);
-	return state_fd;
+	return create_mmap_buf(*state_file);
 }
 
 /*
@@ -280,21 +286,20 @@ static int _open_node_state_file(char **state_file)
 extern int load_all_node_state ( bool state_only )
 {
 	char *comm_name = NULL, *node_hostname = NULL;
-	char *node_name = NULL, *reason = NULL, *data = NULL, *state_file;
+	char *node_name = NULL, *reason = NULL, *state_file;
 	char *features = NULL, *features_act = NULL;
 	char *gres = NULL, *cpu_spec_list = NULL;
 	char *mcs_label = NULL;
-	int data_allocated, data_read = 0, error_code = 0, node_cnt = 0;
+	int error_code = 0, node_cnt = 0;
 	uint16_t core_spec_cnt = 0;
 	uint32_t node_state, cpu_bind = 0;
 	uint16_t cpus = 1, boards = 1, sockets = 1, cores = 1, threads = 1;
 	uint64_t real_memory;
-	uint32_t tmp_disk, data_size = 0, name_len;
+	uint32_t tmp_disk, name_len;
 	uint32_t reason_uid = NO_VAL;
 	time_t boot_req_time = 0, reason_time = 0;
 	List gres_list = NULL;
 	struct node_record *node_ptr;
-	int state_fd;
 	time_t time_stamp, now = time(NULL);
 	Buf buffer;
 	char *ver_str = NULL;
@@ -310,38 +315,14 @@ extern int load_all_node_state ( bool state_only )
 
 	/* read the file */
 	lock_state_files ();
-	state_fd = _open_node_state_file(&state_file);
-	if (state_fd < 0) {
+	if (!(buffer = _open_node_state_file(&state_file))) {
 		info("No node state file (%s) to recover", state_file);
 		xfree(state_file);
 		unlock_state_files();
 		return ENOENT;
 	}
-	else {
-		data_allocated = BUF_SIZE;
-		data = xmalloc(data_allocated);
-		while (1) {
-			data_read = read(state_fd, &data[data_size], BUF_SIZE);
-			if (data_read < 0) {
-				if (errno == EINTR)
-					continue;
-				else {
-					error ("Read error on %s: %m",
-						state_file);
-					break;
-				}
-			} else if (data_read == 0)     /* eof */
-				break;
-			data_size      += data_read;
-			data_allocated += data_read;
-			xrealloc(data, data_allocated);
-		}
-		close (state_fd);
-	}
-	xfree (state_file);
-	unlock_state_files ();
-
-	buffer = create_buf (data, data_size);
+	xfree(state_file);
+	unlock_state_files();
 
 	safe_unpackstr_xmalloc( &ver_str, &name_len, buffer);
 	debug3("Version string in node_state header is %s", ver_str);
@@ -779,6 +760,7 @@ static bool _node_is_hidden(struct node_record *node_ptr, uid_t uid)
  * OUT buffer_size - set to size of the buffer in bytes
  * IN show_flags - node filtering options
  * IN uid - uid of user making request (for partition filtering)
+ * IN filter - pack only nodes matching this filter if not NULL
  * IN protocol_version - slurm protocol version of client
  * global: node_record_table_ptr - pointer to global node table
  * NOTE: the caller must xfree the buffer at *buffer_ptr
@@ -786,13 +768,14 @@ static bool _node_is_hidden(struct node_record *node_ptr, uid_t uid)
  */
 extern void pack_all_node (char **buffer_ptr, int *buffer_size,
 			   uint16_t show_flags, uid_t uid,
-			   uint16_t protocol_version)
+			   info_filter_t *filter, uint16_t protocol_version)
 {
 	int inx;
 	uint32_t nodes_packed, tmp_offset;
 	Buf buffer;
 	time_t now = time(NULL);
 	struct node_record *node_ptr = node_record_table_ptr;
+	bitstr_t *packed_bitmap;
 	bool hidden;
 
 	xassert(verify_lock(CONF_LOCK, READ_LOCK));
@@ -805,15 +788,23 @@ extern void pack_all_node (char **buffer_ptr, int *buffer_size,
 	nodes_packed = 0;
 
 	if (protocol_version >= SLURM_18_08_PROTOCOL_VERSION) {
-		/* write header: count and time */
+		/* write header: count, time and nodes actually packed */
 		pack32(nodes_packed, buffer);
 		pack_time(now, buffer);
+		packed_bitmap = node_filter_bitmap(filter);
+		pack_bit_str_hex(packed_bitmap, buffer);
 
 		/* write node records */
 		for (inx = 0; inx < node_record_count; inx++, node_ptr++) {
 			xassert(node_ptr->magic == NODE_MAGIC);
 			xassert(node_ptr->config_ptr->magic == CONFIG_MAGIC);
 
+			/* Excluded by the filter, only counted */
+			if (packed_bitmap && !bit_test(packed_bitmap, inx)) {
+				nodes_packed++;
+				continue;
+			}
+
 			/*
 			 * We can't avoid packing node records without breaking
 			 * the node index pointers. So pack a node with a name
@@ -844,6 +835,7 @@ extern void pack_all_node (char **buffer_ptr, int *buffer_size,
 			}
 			nodes_packed++;
 		}
+		FREE_NULL_BITMAP(packed_bitmap);
 	} else if (protocol_version >= SLURM_MIN_PROTOCOL_VERSION) {
 		/* write header: count and time */
 		pack32(nodes_packed, buffer);
@@ -933,9 +925,10 @@ extern void pack_one_node (char **buffer_ptr, int *buffer_size,
 	nodes_packed = 0;
 
 	if (protocol_version >= SLURM_18_08_PROTOCOL_VERSION) {
-		/* write header: count and time */
+		/* write header: count, time and no filtered nodes */
 		pack32(nodes_packed, buffer);
 		pack_time(now, buffer);
+		pack_bit_str_hex(NULL, buffer);
 
 		/* write node records */
 		if (node_name)
@@ -73,15 +73,18 @@
 #include "src/slurmctld/acct_policy.h"
 #include "src/slurmctld/agent.h"
 #include "src/slurmctld/burst_buffer.h"
+#include "src/slurmctld/depend_index.h"
 #include "src/slurmctld/front_end.h"
 #include "src/slurmctld/gang.h"
 #include "src/slurmctld/job_scheduler.h"
+#include "src/slurmctld/job_timer.h"
 #include "src/slurmctld/licenses.h"
 #include "src/slurmctld/node_scheduler.h"
 #include "src/slurmctld/powercapping.h"
 #include "src/slurmctld/preempt.h"
 #include "src/slurmctld/proc_req.h"
 #include "src/slurmctld/reservation.h"
+#include "src/slurmctld/sched_shard.h"
 #include "src/slurmctld/slurmctld.h"
 #include "src/slurmctld/slurmctld_plugstack.h"
 
@@ -2064,15 +2067,24 @@ _pick_best_nodes(struct node_set *node_set_ptr, int node_set_size,
 				preemptee_cand = preemptee_candidates;
 
 			job_ptr->details->pn_min_memory = orig_req_mem;
-			pick_code = select_g_job_test(job_ptr,
-						      avail_bitmap,
-						      min_nodes,
-						      max_nodes,
-						      req_nodes,
-						      select_mode,
-						      preemptee_cand,
-						      preemptee_job_list,
-						      exc_core_bitmap);
+			if ((select_mode == SELECT_MODE_RUN_NOW) &&
+			    !preemptee_cand &&
+			    sched_shard_job_busy(job_ptr, avail_bitmap,
+						 min_nodes, max_nodes,
+						 req_nodes)) {
+				/* Already tested by the parallel scheduler */
+				pick_code = ESLURM_NODES_BUSY;
+			} else {
+				pick_code = select_g_job_test(job_ptr,
+							avail_bitmap,
+							min_nodes,
+							max_nodes,
+							req_nodes,
+							select_mode,
+							preemptee_cand,
+							preemptee_job_list,
+							exc_core_bitmap);
+			}
 			if (job_ptr->details->pn_min_memory) {
 				if (job_ptr->details->pn_min_memory <
 				    smallest_min_mem)
@@ -2895,6 +2907,7 @@ extern int select_nodes(struct job_record *job_ptr, bool test_only,
 	configuring = IS_JOB_CONFIGURING(job_ptr);
 
 	job_ptr->job_state = JOB_RUNNING;
+	depend_index_notify(job_ptr);
 
 	if (select_g_select_nodeinfo_set(job_ptr) != SLURM_SUCCESS) {
 		error("select_g_select_nodeinfo_set(%u): %m", job_ptr->job_id);
@@ -2969,6 +2982,7 @@ extern int select_nodes(struct job_record *job_ptr, bool test_only,
 		/* This handles nodes explicitly requesting node reboot */
 		job_ptr->job_state |= JOB_CONFIGURING;
 	}
+	job_timer_arm(job_ptr);
 
 	/*
 	 * Request asynchronous launch of a prolog for a
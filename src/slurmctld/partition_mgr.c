@@ -65,12 +65,14 @@
 #include "src/slurmctld/burst_buffer.h"
 #include "src/slurmctld/gang.h"
 #include "src/slurmctld/groups.h"
+#include "src/slurmctld/job_queue.h"
 #include "src/slurmctld/licenses.h"
 #include "src/slurmctld/locks.h"
 #include "src/slurmctld/proc_req.h"
 #include "src/slurmctld/read_config.h"
 #include "src/slurmctld/reservation.h"
 #include "src/slurmctld/slurmctld.h"
+#include "src/slurmctld/state_repl.h"
 #include "src/slurmctld/state_save.h"
 
 /* No need to change we always pack SLURM_PROTOCOL_VERSION */
@@ -90,7 +92,7 @@ static uid_t *_get_groups_members(char *group_names);
 static time_t _get_group_tlm(void);
 static void   _list_delete_part(void *part_entry);
 static int    _match_part_ptr(void *part_ptr, void *key);
-static int    _open_part_state_file(char **state_file);
+static Buf    _open_part_state_file(char **state_file);
 static int    _uid_list_size(uid_t * uid_list_ptr);
 static void   _unlink_free_nodes(bitstr_t *old_bitmap,
 			struct part_record *part_ptr);
@@ -500,6 +502,8 @@ int dump_all_part_state(void)
 	xfree(new_file);
 	unlock_state_files();
 
+	if (!error_code && state_repl_active())
+		state_repl_publish(STATE_REPL_PART, buffer, NULL, 0);
 	free_buf(buffer);
 	END_TIMER2("dump_all_part_state");
 	return 0;
@@ -558,33 +562,28 @@ static int _dump_part_state(void *x, void *arg)
 
 /* Open the partition state save file, or backup if necessary.
  * state_file IN - the name of the state save file used
- * RET the file description to read from or error code
+ * RET buffer mapping the file contents or NULL on error
  */
-static int _open_part_state_file(char **state_file)
+static Buf _open_part_state_file(char **state_file)
 {
-	int state_fd;
-	struct stat stat_buf;
+	Buf buffer;
 
 	*state_file = xstrdup(slurmctld_conf.state_save_location);
 	xstrcat(*state_file, "/part_state");
-	state_fd = open(*state_file, O_RDONLY);
-	if (state_fd < 0) {
+	if ((buffer = state_repl_open(STATE_REPL_PART, *state_file)))
+		return buffer;
+	if (!(buffer = create_mmap_buf(*state_file))) {
 		error("Could not open partition state file %s: %m",
 		      *state_file);
-	} else if (fstat(state_fd, &stat_buf) < 0) {
-		error("Could not stat partition state file %s: %m",
-		      *state_file);
-		(void) close(state_fd);
-	} else if (stat_buf.st_size < 10) {
+	} else if (size_buf(buffer) < 10) {
 		error("Partition state file %s too small", *state_file);
-		(void) close(state_fd);
+		free_buf(buffer);
 	} else 	/* Success */
-		return state_fd;
+		return buffer;
 
 	error("NOTE: Trying backup partition state save file. Information may be lost!");
 	xstrcat(*state_file, ".old");
-	state_fd = open(*state_file, O_RDONLY);
-	return state_fd;
+	return create_mmap_buf(*state_file);
 }
 
 /*
@@ -597,7 +596,7 @@ int load_all_part_state(void)
 	char *part_name = NULL, *nodes = NULL;
 	char *allow_accounts = NULL, *allow_groups = NULL, *allow_qos = NULL;
 	char *deny_accounts = NULL, *deny_qos = NULL, *qos_char = NULL;
-	char *state_file = NULL, *data = NULL;
+	char *state_file = NULL;
 	uint32_t max_time, default_time, max_nodes, min_nodes;
 	uint32_t max_cpus_per_node = INFINITE, cpu_bind = 0, grace_time = 0;
 	time_t time;
@@ -605,9 +604,8 @@ int load_all_part_state(void)
 	uint16_t max_share, over_time_limit = NO_VAL16, preempt_mode;
 	uint16_t state_up, cr_type;
 	struct part_record *part_ptr;
-	uint32_t data_size = 0, name_len;
-	int data_allocated, data_read = 0, error_code = 0, part_cnt = 0;
-	int state_fd;
+	uint32_t name_len;
+	int error_code = 0, part_cnt = 0;
 	Buf buffer;
 	char *ver_str = NULL;
 	char* allow_alloc_nodes = NULL;
@@ -618,40 +616,16 @@ int load_all_part_state(void)
 
 	/* read the file */
 	lock_state_files();
-	state_fd = _open_part_state_file(&state_file);
-	if (state_fd < 0) {
+	if (!(buffer = _open_part_state_file(&state_file))) {
 		info("No partition state file (%s) to recover",
 		     state_file);
 		xfree(state_file);
 		unlock_state_files();
 		return ENOENT;
-	} else {
-		data_allocated = BUF_SIZE;
-		data = xmalloc(data_allocated);
-		while (1) {
-			data_read = read(state_fd, &data[data_size],
-					 BUF_SIZE);
-			if (data_read < 0) {
-				if  (errno == EINTR)
-					continue;
-				else {
-					error("Read error on %s: %m",
-						state_file);
-					break;
-				}
-			} else if (data_read == 0)     /* eof */
-				break;
-			data_size      += data_read;
-			data_allocated += data_read;
-			xrealloc(data, data_allocated);
-		}
-		close(state_fd);
 	}
 	xfree(state_file);
 	unlock_state_files();
 
-	buffer = create_buf(data, data_size);
-
 	safe_unpackstr_xmalloc(&ver_str, &name_len, buffer);
 	debug3("Version string in part_state header is %s", ver_str);
 	if (ver_str && !xstrcmp(ver_str, PART_STATE_VERSION))
@@ -1051,6 +1025,7 @@ static void _list_delete_part(void *part_entry)
 	int i, j, k;
 
 	part_ptr = (struct part_record *) part_entry;
+	job_queue_part_remove(part_ptr);
 	node_ptr = &node_record_table_ptr[0];
 	for (i = 0; i < node_record_count; i++, node_ptr++) {
 		for (j=0; j<node_ptr->part_cnt; j++) {
@@ -1134,6 +1109,35 @@ extern bool part_is_visible(struct part_record *part_ptr, uid_t uid)
 	return true;
 }
 
+/* part_is_public - is this partition visible to every user (not hidden and
+ *	not restricted by AllowGroups) */
+extern bool part_is_public(struct part_record *part_ptr)
+{
+	return (!(part_ptr->flags & PART_FLAG_HIDDEN) &&
+		!part_ptr->allow_groups);
+}
+
+/* part_all_public - are all partitions visible to every user */
+extern bool part_all_public(void)
+{
+	ListIterator part_iterator;
+	struct part_record *part_ptr;
+	bool rc = true;
+
+	xassert(verify_lock(PART_LOCK, READ_LOCK));
+
+	part_iterator = list_iterator_create(part_list);
+	while ((part_ptr = (struct part_record *) list_next(part_iterator))) {
+		if (!part_is_public(part_ptr)) {
+			rc = false;
+			break;
+		}
+	}
+	list_iterator_destroy(part_iterator);
+
+	return rc;
+}
+
 /*
  * pack_all_part - dump all partition information for all partitions in
  *	machine independent form (for network transmission)
@@ -1557,6 +1561,7 @@ extern int update_part(update_part_msg_t * part_desc, bool create_flag)
 		info("%s: setting PriorityTier to %u for partition %s",
 		     __func__, part_desc->priority_tier, part_desc->name);
 		part_ptr->priority_tier = part_desc->priority_tier;
+		job_queue_invalidate();
 	}
 
 	if (part_desc->priority_job_factor != NO_VAL16) {
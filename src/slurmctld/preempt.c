@@ -47,6 +47,7 @@
 #include "src/common/xstring.h"
 #include "src/slurmctld/slurmctld.h"
 #include "src/slurmctld/job_scheduler.h"
+#include "src/slurmctld/job_timer.h"
 
 typedef struct slurm_preempt_ops {
 	List		(*find_jobs)	      (struct job_record *job_ptr);
@@ -79,6 +80,7 @@ static void _preempt_signal(struct job_record *job_ptr, uint32_t grace_time)
 	job_ptr->preempt_time = time(NULL);
 	job_ptr->end_time = MIN(job_ptr->end_time,
 				(job_ptr->preempt_time + (time_t)grace_time));
+	job_timer_arm(job_ptr);
 
 	/* Signal the job at the beginning of preemption GraceTime */
 	job_signal(job_ptr->job_id, SIGCONT, 0, 0, 0);
@@ -74,6 +74,7 @@
 #include "src/common/slurm_cred.h"
 #include "src/common/slurm_ext_sensors.h"
 #include "src/common/slurm_jobcomp.h"
+#include "src/common/slurm_mcs.h"
 #include "src/common/slurm_priority.h"
 #include "src/common/slurm_protocol_api.h"
 #include "src/common/slurm_protocol_interface.h"
@@ -86,6 +87,7 @@
 #include "src/slurmctld/acct_policy.h"
 #include "src/slurmctld/agent.h"
 #include "src/slurmctld/burst_buffer.h"
+#include "src/slurmctld/event_mgr.h"
 #include "src/slurmctld/fed_mgr.h"
 #include "src/slurmctld/front_end.h"
 #include "src/slurmctld/gang.h"
@@ -97,10 +99,14 @@
 #include "src/slurmctld/proc_req.h"
 #include "src/slurmctld/read_config.h"
 #include "src/slurmctld/reservation.h"
+#include "src/slurmctld/response_cache.h"
+#include "src/slurmctld/rpc_engine.h"
 #include "src/slurmctld/sched_plugin.h"
 #include "src/slurmctld/slurmctld.h"
 #include "src/slurmctld/slurmctld_plugstack.h"
+#include "src/slurmctld/snapshot.h"
 #include "src/slurmctld/srun_comm.h"
+#include "src/slurmctld/state_repl.h"
 #include "src/slurmctld/state_save.h"
 #include "src/slurmctld/trigger_mgr.h"
 
@@ -109,14 +115,46 @@ static int rpc_type_size = 0;	/* Size of rpc_type_* arrays */
 static uint16_t *rpc_type_id = NULL;
 static uint32_t *rpc_type_cnt = NULL;
 static uint64_t *rpc_type_time = NULL;
+static latency_hist_t *rpc_type_hist = NULL;
 static int rpc_user_size = 0;	/* Size of rpc_user_* arrays */
 static uint32_t *rpc_user_id = NULL;
 static uint32_t *rpc_user_cnt = NULL;
 static uint64_t *rpc_user_time = NULL;
+static latency_hist_t *rpc_user_hist = NULL;
 
 static pthread_mutex_t throttle_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t throttle_cond = PTHREAD_COND_INITIALIZER;
 
+/*
+ * RPC priority classes. Each class has its own concurrency limit so that
+ * node and job lifecycle traffic never waits behind information requests.
+ * Limits are set with SlurmctldParameters rpc_max_high, rpc_max_normal and
+ * rpc_max_low (zero means no limit). The rpc_engine defers requests of a
+ * full class without holding a worker until one of its RPCs completes. With
+ * a thread per connection, high and normal priority requests wait for a
+ * slot. Many of them (e.g. MESSAGE_EPILOG_COMPLETE) are sent without
+ * reading the reply, so they are never rejected. Only low priority requests
+ * are rejected with ESLURM_CONTROLLER_BUSY, which the client retries: when
+ * their class is full with a thread per connection, or once rpc_low_shed of
+ * them are already deferred.
+ */
+enum {
+	RPC_CLASS_HIGH = 0,
+	RPC_CLASS_NORMAL,
+	RPC_CLASS_LOW,
+	RPC_CLASS_CNT
+};
+static pthread_mutex_t rpc_class_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t rpc_class_cond = PTHREAD_COND_INITIALIZER;
+static uint32_t rpc_class_max[RPC_CLASS_CNT];
+static uint32_t rpc_low_shed = 0;
+static uint32_t rpc_class_active[RPC_CLASS_CNT];
+static uint32_t rpc_class_queued[RPC_CLASS_CNT];
+static uint32_t rpc_class_cnt[RPC_CLASS_CNT];
+static uint32_t rpc_class_shed[RPC_CLASS_CNT];
+static uint64_t rpc_class_time[RPC_CLASS_CNT];
+static uint64_t rpc_class_wait[RPC_CLASS_CNT];
+
 static void         _fill_ctld_conf(slurm_ctl_conf_t * build_ptr);
 static void         _kill_job_on_msg_fail(uint32_t job_id);
 static int          _is_prolog_finished(uint32_t job_id);
@@ -126,6 +164,11 @@ static int          _make_step_cred(struct step_record *step_rec,
 inline static void  _proc_multi_msg(uint32_t rpc_uid, slurm_msg_t *msg);
 static int          _route_msg_to_origin(slurm_msg_t *msg, char *job_id_str,
 					 uint32_t job_id, uid_t uid);
+static int          _rpc_class(uint16_t msg_type);
+static int          _rpc_class_start(int rpc_class, bool can_defer,
+				     bool can_wait, bool force,
+				     struct timeval *defer_time);
+static void         _rpc_class_fini(int rpc_class, uint64_t usec);
 static void         _throttle_fini(int *active_rpc_cnt);
 static void         _throttle_start(int *active_rpc_cnt);
 
@@ -229,6 +272,9 @@ static void  _slurm_rpc_comp_msg_list(composite_msg_t * comp_msg,
 				      int timeout);
 static void  _slurm_rpc_assoc_mgr_info(slurm_msg_t * msg);
 static void  _slurm_rpc_persist_init(slurm_msg_t *msg, connection_arg_t *arg);
+static void  _slurm_rpc_event_subscribe(slurm_msg_t *msg,
+					connection_arg_t *arg);
+static void  _slurm_rpc_state_repl(slurm_msg_t *msg, connection_arg_t *arg);
 
 extern diag_stats_t slurmctld_diag_stats;
 
@@ -253,6 +299,7 @@ void slurmctld_req(slurm_msg_t *msg, connection_arg_t *arg)
 {
 	DEF_TIMERS;
 	int i, rpc_type_index = -1, rpc_user_index = -1;
+	int rpc_admit, rpc_class;
 	uint32_t rpc_uid;
 
 	if (arg && (arg->newsockfd >= 0))
@@ -269,6 +316,8 @@ void slurmctld_req(slurm_msg_t *msg, connection_arg_t *arg)
 	if (g_slurm_auth_errno(msg->auth_cred) != SLURM_SUCCESS) {
 		error("Bad authentication: %s",
 		      g_slurm_auth_errstr(g_slurm_auth_errno(msg->auth_cred)));
+		if (arg && (arg->rpc_admit == RPC_ADMIT_OK))
+			rpc_class_release(arg->rpc_class);
 		return;
 	}
 	slurm_mutex_lock(&rpc_mutex);
@@ -277,6 +326,8 @@ void slurmctld_req(slurm_msg_t *msg, connection_arg_t *arg)
 		rpc_type_id   = xmalloc(sizeof(uint16_t) * rpc_type_size);
 		rpc_type_cnt  = xmalloc(sizeof(uint32_t) * rpc_type_size);
 		rpc_type_time = xmalloc(sizeof(uint64_t) * rpc_type_size);
+		rpc_type_hist = xmalloc(sizeof(latency_hist_t) *
+					rpc_type_size);
 	}
 	for (i = 0; i < rpc_type_size; i++) {
 		if (rpc_type_id[i] == 0)
@@ -291,6 +342,8 @@ void slurmctld_req(slurm_msg_t *msg, connection_arg_t *arg)
 		rpc_user_id   = xmalloc(sizeof(uint32_t) * rpc_user_size);
 		rpc_user_cnt  = xmalloc(sizeof(uint32_t) * rpc_user_size);
 		rpc_user_time = xmalloc(sizeof(uint64_t) * rpc_user_size);
+		rpc_user_hist = xmalloc(sizeof(latency_hist_t) *
+					rpc_user_size);
 	}
 	for (i = 0; i < rpc_user_size; i++) {
 		if ((rpc_user_id[i] == 0) && (i != 0))
@@ -302,6 +355,25 @@ void slurmctld_req(slurm_msg_t *msg, connection_arg_t *arg)
 	}
 	slurm_mutex_unlock(&rpc_mutex);
 
+	/*
+	 * The rpc_engine admits requests before unpacking them. Requests on
+	 * persistent connections can not be retried and are never rejected.
+	 */
+	if (arg && (arg->rpc_admit != RPC_ADMIT_NONE)) {
+		rpc_admit = arg->rpc_admit;
+		rpc_class = arg->rpc_class;
+	} else {
+		rpc_class = _rpc_class(msg->msg_type);
+		rpc_admit = _rpc_class_start(rpc_class, false, true, !arg,
+					     NULL);
+	}
+	if (rpc_admit != RPC_ADMIT_OK) {
+		debug("%s: shedding %s, controller busy", __func__,
+		      rpc_num2string(msg->msg_type));
+		slurm_send_rc_msg(msg, ESLURM_CONTROLLER_BUSY);
+		return;
+	}
+
 	/* Debug the protocol layer.
 	 */
 	START_TIMER;
@@ -594,6 +666,12 @@ void slurmctld_req(slurm_msg_t *msg, connection_arg_t *arg)
 	case REQUEST_BURST_BUFFER_STATUS:
 		_slurm_rpc_burst_buffer_status(msg);
 		break;
+	case REQUEST_EVENT_SUBSCRIBE:
+		_slurm_rpc_event_subscribe(msg, arg);
+		break;
+	case REQUEST_STATE_REPL:
+		_slurm_rpc_state_repl(msg, arg);
+		break;
 	default:
 		error("invalid RPC msg_type=%u", msg->msg_type);
 		slurm_send_rc_msg(msg, EINVAL);
@@ -601,18 +679,209 @@ void slurmctld_req(slurm_msg_t *msg, connection_arg_t *arg)
 	}
 
 	END_TIMER;
+	_rpc_class_fini(rpc_class, DELTA_TIMER);
 	slurm_mutex_lock(&rpc_mutex);
 	if (rpc_type_index >= 0) {
 		rpc_type_cnt[rpc_type_index]++;
 		rpc_type_time[rpc_type_index] += DELTA_TIMER;
+		latency_hist_add(&rpc_type_hist[rpc_type_index], DELTA_TIMER);
 	}
 	if (rpc_user_index >= 0) {
 		rpc_user_cnt[rpc_user_index]++;
 		rpc_user_time[rpc_user_index] += DELTA_TIMER;
+		latency_hist_add(&rpc_user_hist[rpc_user_index], DELTA_TIMER);
 	}
 	slurm_mutex_unlock(&rpc_mutex);
 }
 
+/* Map a message type to its RPC priority class */
+static int _rpc_class(uint16_t msg_type)
+{
+	switch (msg_type) {
+	case MESSAGE_COMPOSITE:
+	case MESSAGE_EPILOG_COMPLETE:
+	case MESSAGE_NODE_REGISTRATION_STATUS:
+	case REQUEST_COMPLETE_BATCH_JOB:
+	case REQUEST_COMPLETE_BATCH_SCRIPT:
+	case REQUEST_COMPLETE_JOB_ALLOCATION:
+	case REQUEST_COMPLETE_PROLOG:
+	case REQUEST_CONTROL:
+	case REQUEST_CONTROL_STATUS:
+	case REQUEST_PING:
+	case REQUEST_SHUTDOWN:
+	case REQUEST_SHUTDOWN_IMMEDIATE:
+	case REQUEST_STATE_REPL:
+	case REQUEST_STATS_INFO:
+	case REQUEST_STEP_COMPLETE:
+	case REQUEST_TAKEOVER:
+		return RPC_CLASS_HIGH;
+	case REQUEST_ASSOC_MGR_INFO:
+	case REQUEST_BATCH_SCRIPT:
+	case REQUEST_BUILD_INFO:
+	case REQUEST_BURST_BUFFER_INFO:
+	case REQUEST_EVENT_SUBSCRIBE:
+	case REQUEST_FED_INFO:
+	case REQUEST_FRONT_END_INFO:
+	case REQUEST_JOB_INFO:
+	case REQUEST_JOB_INFO_SINGLE:
+	case REQUEST_JOB_STEP_INFO:
+	case REQUEST_JOB_USER_INFO:
+	case REQUEST_LAYOUT_INFO:
+	case REQUEST_LICENSE_INFO:
+	case REQUEST_NODE_INFO:
+	case REQUEST_NODE_INFO_SINGLE:
+	case REQUEST_PARTITION_INFO:
+	case REQUEST_POWERCAP_INFO:
+	case REQUEST_PRIORITY_FACTORS:
+	case REQUEST_RESERVATION_INFO:
+	case REQUEST_SHARE_INFO:
+	case REQUEST_TOPO_INFO:
+	case REQUEST_TRIGGER_GET:
+		return RPC_CLASS_LOW;
+	default:
+		return RPC_CLASS_NORMAL;
+	}
+}
+
+static uint32_t _rpc_class_param(char *params, char *key)
+{
+	char *tmp_ptr;
+
+	if ((tmp_ptr = xstrcasestr(params, key)))
+		return (uint32_t) strtoul(tmp_ptr + strlen(key), NULL, 10);
+	return 0;
+}
+
+extern void rpc_class_config(void)
+{
+	uint32_t class_max[RPC_CLASS_CNT], low_shed;
+	char *params;
+	int i;
+
+	params = slurmctld_conf.slurmctld_params;
+	class_max[RPC_CLASS_HIGH]   = _rpc_class_param(params,
+						       "rpc_max_high=");
+	class_max[RPC_CLASS_NORMAL] = _rpc_class_param(params,
+						       "rpc_max_normal=");
+	class_max[RPC_CLASS_LOW]    = _rpc_class_param(params,
+						       "rpc_max_low=");
+	low_shed = _rpc_class_param(params, "rpc_low_shed=");
+
+	slurm_mutex_lock(&rpc_class_mutex);
+	for (i = 0; i < RPC_CLASS_CNT; i++)
+		rpc_class_max[i] = class_max[i];
+	rpc_low_shed = low_shed;
+	slurm_cond_broadcast(&rpc_class_cond);	/* limits may be higher */
+	slurm_mutex_unlock(&rpc_class_mutex);
+
+	/* Resume requests deferred under a lower limit */
+	for (i = 0; i < RPC_CLASS_CNT; i++) {
+		if (!rpc_class_full(i))
+			rpc_engine_class_free(i);
+	}
+}
+
+static bool _rpc_class_full(int rpc_class)
+{
+	return (rpc_class_max[rpc_class] &&
+		(rpc_class_active[rpc_class] >= rpc_class_max[rpc_class]));
+}
+
+/*
+ * Reserve a slot for an RPC in its class. Only low priority RPCs are ever
+ * shed. High and normal priority RPCs which can not be deferred wait for a
+ * slot, or take one over the limit if can_wait is not set.
+ * IN rpc_class - class of the RPC
+ * IN can_defer - the caller can queue the request until a slot is free
+ * IN can_wait - the caller may block until a slot is free
+ * IN force - take a slot even if the class is full
+ * IN defer_time - when the request was deferred, NULL if never
+ * RET RPC_ADMIT_OK, RPC_ADMIT_DEFER or RPC_ADMIT_SHED
+ */
+static int _rpc_class_start(int rpc_class, bool can_defer, bool can_wait,
+			    bool force, struct timeval *defer_time)
+{
+	struct timeval now, wait_start;
+	int rc = RPC_ADMIT_OK;
+
+	slurm_mutex_lock(&rpc_class_mutex);
+	if (defer_time)
+		rpc_class_queued[rpc_class]--;
+	if (!force && _rpc_class_full(rpc_class)) {
+		if (can_defer &&
+		    !((rpc_class == RPC_CLASS_LOW) && rpc_low_shed &&
+		      (rpc_class_queued[rpc_class] >= rpc_low_shed))) {
+			rpc_class_queued[rpc_class]++;
+			rc = RPC_ADMIT_DEFER;
+		} else if (rpc_class == RPC_CLASS_LOW) {
+			rpc_class_shed[rpc_class]++;
+			rc = RPC_ADMIT_SHED;
+		} else if (can_wait) {
+			gettimeofday(&wait_start, NULL);
+			defer_time = &wait_start;
+			rpc_class_queued[rpc_class]++;
+			while (_rpc_class_full(rpc_class)) {
+				slurm_cond_wait(&rpc_class_cond,
+						&rpc_class_mutex);
+			}
+			rpc_class_queued[rpc_class]--;
+		}
+	}
+	if (rc == RPC_ADMIT_OK) {
+		rpc_class_active[rpc_class]++;
+		if (defer_time) {
+			gettimeofday(&now, NULL);
+			rpc_class_wait[rpc_class] +=
+				(now.tv_sec - defer_time->tv_sec) * 1000000 +
+				(now.tv_usec - defer_time->tv_usec);
+		}
+	}
+	slurm_mutex_unlock(&rpc_class_mutex);
+
+	return rc;
+}
+
+static void _rpc_class_fini(int rpc_class, uint64_t usec)
+{
+	slurm_mutex_lock(&rpc_class_mutex);
+	rpc_class_cnt[rpc_class]++;
+	rpc_class_time[rpc_class] += usec;
+	slurm_mutex_unlock(&rpc_class_mutex);
+
+	rpc_class_release(rpc_class);
+}
+
+extern int rpc_class_admit(uint16_t msg_type, bool can_defer,
+			   struct timeval *defer_time, int *rpc_class)
+{
+	*rpc_class = _rpc_class(msg_type);
+	return _rpc_class_start(*rpc_class, can_defer, false, false,
+				defer_time);
+}
+
+extern void rpc_class_release(int rpc_class)
+{
+	slurm_mutex_lock(&rpc_class_mutex);
+	rpc_class_active[rpc_class]--;
+	if (rpc_class_queued[rpc_class])
+		slurm_cond_broadcast(&rpc_class_cond);
+	slurm_mutex_unlock(&rpc_class_mutex);
+
+	/* Resume a request deferred while the class was full */
+	rpc_engine_class_free(rpc_class);
+}
+
+extern bool rpc_class_full(int rpc_class)
+{
+	bool full;
+
+	slurm_mutex_lock(&rpc_class_mutex);
+	full = _rpc_class_full(rpc_class);
+	slurm_mutex_unlock(&rpc_class_mutex);
+
+	return full;
+}
+
 /* These functions prevent certain RPCs from keeping the slurmctld write locks
  * constantly set, which can prevent other RPCs and system functions from being
  * processed. For example, a steady stream of batch submissions can prevent
@@ -1767,12 +2036,41 @@ static void _slurm_rpc_dump_conf(slurm_msg_t * msg)
 	}
 }
 
+/*
+ * Look for a cached response to a job, node or partition information request
+ * OUT cache_ptr - set to the cached response, release it with
+ *	response_cache_release() after use
+ * OUT dump, dump_size - set to the response data if SLURM_SUCCESS
+ * RET SLURM_SUCCESS, SLURM_NO_CHANGE_IN_DATA or SLURM_ERROR if not cached
+ */
+static int _cached_response(response_cache_type_t type, slurm_msg_t *msg,
+			    uint16_t show_flags, uid_t uid, time_t last_update,
+			    response_cache_t **cache_ptr, char **dump,
+			    int *dump_size)
+{
+	response_cache_t *cache;
+
+	if (!(cache = response_cache_get(type, msg->protocol_version,
+					 show_flags, uid)))
+		return SLURM_ERROR;
+
+	if ((last_update - 1) >= cache->last_update) {
+		response_cache_release(cache);
+		return SLURM_NO_CHANGE_IN_DATA;
+	}
+	*cache_ptr = cache;
+	*dump = cache->data;
+	*dump_size = cache->size;
+	return SLURM_SUCCESS;
+}
+
 /* _slurm_rpc_dump_jobs - process RPC for job state information */
 static void _slurm_rpc_dump_jobs(slurm_msg_t * msg)
 {
 	DEF_TIMERS;
 	char *dump;
-	int dump_size;
+	int dump_size, rc = SLURM_ERROR;
+	response_cache_t *cache = NULL;
 	slurm_msg_t response_msg;
 	job_info_request_msg_t *job_info_request_msg =
 		(job_info_request_msg_t *) msg->data;
@@ -1784,24 +2082,66 @@ static void _slurm_rpc_dump_jobs(slurm_msg_t * msg)
 
 	START_TIMER;
 	debug3("Processing RPC: REQUEST_JOB_INFO from uid=%d", uid);
-	lock_slurmctld(job_read_lock);
 
-	if ((job_info_request_msg->last_update - 1) >= last_job_update) {
-		unlock_slurmctld(job_read_lock);
-		debug3("_slurm_rpc_dump_jobs, no change");
-		slurm_send_rc_msg(msg, SLURM_NO_CHANGE_IN_DATA);
-	} else {
-		if (job_info_request_msg->job_ids) {
+	/*
+	 * Cached responses carry no cursor for incremental updates and are
+	 * never filtered
+	 */
+	if (!job_info_request_msg->job_ids &&
+	    !job_info_request_msg->delta_cursor &&
+	    !job_info_request_msg->filter) {
+		rc = _cached_response(RESPONSE_CACHE_JOB, msg,
+				      job_info_request_msg->show_flags, uid,
+				      job_info_request_msg->last_update,
+				      &cache, &dump, &dump_size);
+	}
+	if ((rc == SLURM_ERROR) && !job_info_request_msg->job_ids) {
+		rc = snapshot_pack_jobs(&dump, &dump_size,
+					job_info_request_msg->show_flags, uid,
+					job_info_request_msg->last_update,
+					job_info_request_msg->delta_cursor,
+					job_info_request_msg->filter,
+					msg->protocol_version);
+	}
+	if (rc == SLURM_ERROR) {
+		lock_slurmctld(job_read_lock);
+		if ((job_info_request_msg->last_update - 1) >=
+		    last_job_update) {
+			rc = SLURM_NO_CHANGE_IN_DATA;
+		} else if (job_info_request_msg->job_ids) {
 			pack_spec_jobs(&dump, &dump_size,
 				       job_info_request_msg->job_ids,
 				       job_info_request_msg->show_flags, uid,
 				       NO_VAL, msg->protocol_version);
+			rc = SLURM_SUCCESS;
+		} else if (job_info_request_msg->filter) {
+			pack_all_jobs(&dump, &dump_size,
+				      job_info_request_msg->show_flags, uid,
+				      NO_VAL, job_info_request_msg->filter,
+				      msg->protocol_version);
+			rc = SLURM_SUCCESS;
 		} else {
 			pack_all_jobs(&dump, &dump_size,
 				      job_info_request_msg->show_flags, uid,
-				      NO_VAL, msg->protocol_version);
+				      NO_VAL, NULL, msg->protocol_version);
+			response_cache_put(RESPONSE_CACHE_JOB,
+				response_cache_gen(RESPONSE_CACHE_JOB),
+				msg->protocol_version,
+				job_info_request_msg->show_flags, uid,
+				(!(slurmctld_conf.private_data &
+				   PRIVATE_DATA_JOBS) &&
+				 ((job_info_request_msg->show_flags &
+				   SHOW_ALL) || part_all_public())),
+				last_job_update, dump, dump_size);
+			rc = SLURM_SUCCESS;
 		}
 		unlock_slurmctld(job_read_lock);
+	}
+
+	if (rc == SLURM_NO_CHANGE_IN_DATA) {
+		debug3("_slurm_rpc_dump_jobs, no change");
+		slurm_send_rc_msg(msg, SLURM_NO_CHANGE_IN_DATA);
+	} else {
 		END_TIMER2("_slurm_rpc_dump_jobs");
 #if 0
 		info("_slurm_rpc_dump_jobs, size=%d %s", dump_size, TIME_STR);
@@ -1819,7 +2159,10 @@ static void _slurm_rpc_dump_jobs(slurm_msg_t * msg)
 
 		/* send message */
 		slurm_send_node_msg(msg->conn_fd, &response_msg);
-		xfree(dump);
+		if (cache)
+			response_cache_release(cache);
+		else
+			xfree(dump);
 	}
 }
 
@@ -1842,7 +2185,8 @@ static void _slurm_rpc_dump_jobs_user(slurm_msg_t * msg)
 	debug3("Processing RPC: REQUEST_JOB_USER_INFO from uid=%d", uid);
 	lock_slurmctld(job_read_lock);
 	pack_all_jobs(&dump, &dump_size, job_info_request_msg->show_flags, uid,
-		      job_info_request_msg->user_id, msg->protocol_version);
+		      job_info_request_msg->user_id, NULL,
+		      msg->protocol_version);
 	unlock_slurmctld(job_read_lock);
 	END_TIMER2("_slurm_rpc_dump_job_user");
 #if 0
@@ -2086,7 +2430,8 @@ static void _slurm_rpc_dump_nodes(slurm_msg_t * msg)
 {
 	DEF_TIMERS;
 	char *dump;
-	int dump_size;
+	int dump_size, rc = SLURM_ERROR;
+	response_cache_t *cache = NULL;
 	slurm_msg_t response_msg;
 	node_info_request_msg_t *node_req_msg =
 		(node_info_request_msg_t *) msg->data;
@@ -2108,18 +2453,53 @@ static void _slurm_rpc_dump_nodes(slurm_msg_t * msg)
 		return;
 	}
 
-	lock_slurmctld(node_write_lock);
+	/* Filtered responses are neither cached nor in snapshots */
+	if (!node_req_msg->filter) {
+		rc = _cached_response(RESPONSE_CACHE_NODE, msg,
+				      node_req_msg->show_flags, uid,
+				      node_req_msg->last_update,
+				      &cache, &dump, &dump_size);
+	}
+	if ((rc == SLURM_ERROR) && !node_req_msg->filter) {
+		rc = snapshot_pack_nodes(&dump, &dump_size,
+					 node_req_msg->show_flags, uid,
+					 node_req_msg->last_update,
+					 msg->protocol_version);
+	}
+	if (rc == SLURM_ERROR) {
+		lock_slurmctld(node_write_lock);
 
-	select_g_select_nodeinfo_set_all();
+		select_g_select_nodeinfo_set_all();
 
-	if ((node_req_msg->last_update - 1) >= last_node_update) {
+		if ((node_req_msg->last_update - 1) >= last_node_update) {
+			rc = SLURM_NO_CHANGE_IN_DATA;
+		} else {
+			pack_all_node(&dump, &dump_size,
+				      node_req_msg->show_flags, uid,
+				      node_req_msg->filter,
+				      msg->protocol_version);
+			rc = SLURM_SUCCESS;
+		}
+		if ((rc == SLURM_SUCCESS) && !node_req_msg->filter) {
+			/* Releasing our node write lock increments the gen */
+			response_cache_put(RESPONSE_CACHE_NODE,
+				response_cache_gen(RESPONSE_CACHE_NODE) + 1,
+				msg->protocol_version,
+				node_req_msg->show_flags, uid,
+				(!((slurmctld_conf.private_data &
+				    PRIVATE_DATA_NODES) &&
+				   (slurm_mcs_get_privatedata() == 1)) &&
+				 ((node_req_msg->show_flags & SHOW_ALL) ||
+				  part_all_public())),
+				last_node_update, dump, dump_size);
+		}
 		unlock_slurmctld(node_write_lock);
+	}
+
+	if (rc == SLURM_NO_CHANGE_IN_DATA) {
 		debug3("_slurm_rpc_dump_nodes, no change");
 		slurm_send_rc_msg(msg, SLURM_NO_CHANGE_IN_DATA);
 	} else {
-		pack_all_node(&dump, &dump_size, node_req_msg->show_flags,
-			      uid, msg->protocol_version);
-		unlock_slurmctld(node_write_lock);
 		END_TIMER2("_slurm_rpc_dump_nodes");
 #if 0
 		info("_slurm_rpc_dump_nodes, size=%d %s", dump_size, TIME_STR);
@@ -2137,7 +2517,10 @@ static void _slurm_rpc_dump_nodes(slurm_msg_t * msg)
 
 		/* send message */
 		slurm_send_node_msg(msg->conn_fd, &response_msg);
-		xfree(dump);
+		if (cache)
+			response_cache_release(cache);
+		else
+			xfree(dump);
 	}
 }
 
@@ -2203,7 +2586,8 @@ static void _slurm_rpc_dump_partitions(slurm_msg_t * msg)
 {
 	DEF_TIMERS;
 	char *dump;
-	int dump_size;
+	int dump_size, rc = SLURM_ERROR;
+	response_cache_t *cache = NULL;
 	slurm_msg_t response_msg;
 	part_info_request_msg_t  *part_req_msg;
 
@@ -2216,22 +2600,54 @@ static void _slurm_rpc_dump_partitions(slurm_msg_t * msg)
 	START_TIMER;
 	debug2("Processing RPC: REQUEST_PARTITION_INFO uid=%d", uid);
 	part_req_msg = (part_info_request_msg_t  *) msg->data;
-	lock_slurmctld(part_read_lock);
 
-	if ((slurmctld_conf.private_data & PRIVATE_DATA_PARTITIONS) &&
-	    !validate_operator(uid)) {
+	if (!(slurmctld_conf.private_data & PRIVATE_DATA_PARTITIONS)) {
+		rc = _cached_response(RESPONSE_CACHE_PART, msg,
+				      part_req_msg->show_flags, uid,
+				      part_req_msg->last_update,
+				      &cache, &dump, &dump_size);
+		if (rc == SLURM_ERROR) {
+			rc = snapshot_pack_parts(&dump, &dump_size,
+						 part_req_msg->show_flags, uid,
+						 part_req_msg->last_update,
+						 msg->protocol_version);
+		}
+	}
+	if (rc == SLURM_ERROR) {
+		lock_slurmctld(part_read_lock);
+		if ((slurmctld_conf.private_data & PRIVATE_DATA_PARTITIONS) &&
+		    !validate_operator(uid)) {
+			rc = ESLURM_ACCESS_DENIED;
+		} else if ((part_req_msg->last_update - 1) >=
+			   last_part_update) {
+			rc = SLURM_NO_CHANGE_IN_DATA;
+		} else {
+			pack_all_part(&dump, &dump_size,
+				      part_req_msg->show_flags, uid,
+				      msg->protocol_version);
+			if (!(slurmctld_conf.private_data &
+			      PRIVATE_DATA_PARTITIONS)) {
+				response_cache_put(RESPONSE_CACHE_PART,
+					response_cache_gen(RESPONSE_CACHE_PART),
+					msg->protocol_version,
+					part_req_msg->show_flags, uid,
+					((part_req_msg->show_flags &
+					  SHOW_ALL) || part_all_public()),
+					last_part_update, dump, dump_size);
+			}
+			rc = SLURM_SUCCESS;
+		}
 		unlock_slurmctld(part_read_lock);
+	}
+
+	if (rc == ESLURM_ACCESS_DENIED) {
 		debug2("Security violation, PARTITION_INFO RPC from uid=%d",
 		       uid);
 		slurm_send_rc_msg(msg, ESLURM_ACCESS_DENIED);
-	} else if ((part_req_msg->last_update - 1) >= last_part_update) {
-		unlock_slurmctld(part_read_lock);
+	} else if (rc == SLURM_NO_CHANGE_IN_DATA) {
 		debug2("_slurm_rpc_dump_partitions, no change");
 		slurm_send_rc_msg(msg, SLURM_NO_CHANGE_IN_DATA);
 	} else {
-		pack_all_part(&dump, &dump_size, part_req_msg->show_flags,
-			      uid, msg->protocol_version);
-		unlock_slurmctld(part_read_lock);
 		END_TIMER2("_slurm_rpc_dump_partitions");
 		debug2("_slurm_rpc_dump_partitions, size=%d %s",
 		       dump_size, TIME_STR);
@@ -2248,7 +2664,10 @@ static void _slurm_rpc_dump_partitions(slurm_msg_t * msg)
 
 		/* send message */
 		slurm_send_node_msg(msg->conn_fd, &response_msg);
-		xfree(dump);
+		if (cache)
+			response_cache_release(cache);
+		else
+			xfree(dump);
 	}
 }
 
@@ -6246,20 +6665,53 @@ static void _clear_rpc_stats(void)
 {
 	int i;
 
+	slurm_mutex_lock(&rpc_class_mutex);
+	for (i = 0; i < RPC_CLASS_CNT; i++) {
+		rpc_class_cnt[i] = 0;
+		rpc_class_shed[i] = 0;
+		rpc_class_time[i] = 0;
+		rpc_class_wait[i] = 0;
+	}
+	slurm_mutex_unlock(&rpc_class_mutex);
+
 	slurm_mutex_lock(&rpc_mutex);
 	for (i = 0; i < rpc_type_size; i++) {
 		rpc_type_cnt[i] = 0;
 		rpc_type_id[i] = 0;
 		rpc_type_time[i] = 0;
+		memset(&rpc_type_hist[i], 0, sizeof(latency_hist_t));
 	}
 	for (i = 0; i < rpc_user_size; i++) {
 		rpc_user_cnt[i] = 0;
 		rpc_user_id[i] = 0;
 		rpc_user_time[i] = 0;
+		memset(&rpc_user_hist[i], 0, sizeof(latency_hist_t));
 	}
 	slurm_mutex_unlock(&rpc_mutex);
 }
 
+/* Pack the 50th, 90th and 99th percentile and maximum of RPC latencies */
+static void _pack_rpc_percentiles(latency_hist_t *hist, uint32_t cnt,
+				  Buf buffer)
+{
+	uint32_t *values = xmalloc(sizeof(uint32_t) * (cnt + 1));
+	uint32_t i;
+
+	for (i = 0; i < cnt; i++)
+		values[i] = latency_hist_percentile(&hist[i], 50);
+	pack32_array(values, cnt, buffer);
+	for (i = 0; i < cnt; i++)
+		values[i] = latency_hist_percentile(&hist[i], 90);
+	pack32_array(values, cnt, buffer);
+	for (i = 0; i < cnt; i++)
+		values[i] = latency_hist_percentile(&hist[i], 99);
+	pack32_array(values, cnt, buffer);
+	for (i = 0; i < cnt; i++)
+		values[i] = hist[i].max;
+	pack32_array(values, cnt, buffer);
+	xfree(values);
+}
+
 static void _pack_rpc_stats(int resp, char **buffer_ptr, int *buffer_size,
 			    uint16_t protocol_version)
 {
@@ -6291,6 +6743,30 @@ static void _pack_rpc_stats(int resp, char **buffer_ptr, int *buffer_size,
 
 		agent_pack_pending_rpc_stats(buffer);
 
+		slurm_mutex_lock(&rpc_class_mutex);
+		pack32(RPC_CLASS_CNT, buffer);
+		pack32_array(rpc_class_max,    RPC_CLASS_CNT, buffer);
+		pack32_array(rpc_class_active, RPC_CLASS_CNT, buffer);
+		pack32_array(rpc_class_queued, RPC_CLASS_CNT, buffer);
+		pack32_array(rpc_class_cnt,    RPC_CLASS_CNT, buffer);
+		pack32_array(rpc_class_shed,   RPC_CLASS_CNT, buffer);
+		pack64_array(rpc_class_time,   RPC_CLASS_CNT, buffer);
+		pack64_array(rpc_class_wait,   RPC_CLASS_CNT, buffer);
+		slurm_mutex_unlock(&rpc_class_mutex);
+
+		pack_lock_stats(buffer, protocol_version);
+
+		for (i = 0; i < rpc_type_size; i++) {
+			if (rpc_type_id[i] == 0)
+				break;
+		}
+		_pack_rpc_percentiles(rpc_type_hist, i, buffer);
+		for (i = 1; i < rpc_user_size; i++) {
+			if (rpc_user_id[i] == 0)
+				break;
+		}
+		_pack_rpc_percentiles(rpc_user_hist, i, buffer);
+		pack_stats_history(buffer, protocol_version);
 	} else if (protocol_version >= SLURM_17_11_PROTOCOL_VERSION) {
 		for (i = 0; i < rpc_type_size; i++) {
 			if (rpc_type_id[i] == 0)
@@ -6384,6 +6860,7 @@ inline static void _slurm_rpc_dump_stats(slurm_msg_t * msg)
 	if (request_msg->command_id == STAT_COMMAND_RESET) {
 		reset_stats(1);
 		_clear_rpc_stats();
+		reset_lock_stats();
 		pack_all_stat(0, &dump, &dump_size, msg->protocol_version);
 		_pack_rpc_stats(0, &dump, &dump_size, msg->protocol_version);
 		response_msg.data = dump;
@@ -7164,3 +7641,72 @@ inline static void  _slurm_rpc_set_fs_dampening_factor(slurm_msg_t *msg)
 	info("Set FairShareDampeningFactor to %u", factor);
 	slurm_send_rc_msg(msg, SLURM_SUCCESS);
 }
+
+/*
+ * Hand the connection over to the event manager, which sends the events
+ * subscribed to over it until the client closes it
+ */
+static void _slurm_rpc_event_subscribe(slurm_msg_t *msg,
+				       connection_arg_t *arg)
+{
+	event_subscribe_msg_t *req = (event_subscribe_msg_t *) msg->data;
+	uid_t uid = g_slurm_auth_get_uid(msg->auth_cred,
+					 slurmctld_config.auth_info);
+	int rc;
+
+	debug2("Processing RPC: REQUEST_EVENT_SUBSCRIBE from uid=%d", uid);
+	/* Not possible through a persistent or composite connection */
+	if (!arg || (arg->newsockfd < 0))
+		rc = ESLURM_NOT_SUPPORTED;
+	else
+		rc = event_mgr_reserve();
+	if (rc != SLURM_SUCCESS) {
+		debug("%s: subscription from uid=%d refused: %s",
+		      __func__, uid, slurm_strerror(rc));
+		slurm_send_rc_msg(msg, rc);
+		return;
+	}
+
+	if (slurm_send_rc_msg(msg, SLURM_SUCCESS) < 0) {
+		event_mgr_unreserve();
+		return;
+	}
+	event_mgr_add(arg->newsockfd, uid, msg->protocol_version, req);
+	arg->newsockfd = -1;
+}
+
+/* Stream state to a backup controller over this connection */
+static void _slurm_rpc_state_repl(slurm_msg_t *msg, connection_arg_t *arg)
+{
+	uid_t uid = g_slurm_auth_get_uid(msg->auth_cred,
+					 slurmctld_config.auth_info);
+	slurm_addr_t peer_addr;
+	char host[32] = "unknown";
+	uint16_t port;
+	int rc = SLURM_SUCCESS;
+
+	debug2("Processing RPC: REQUEST_STATE_REPL from uid=%d", uid);
+	if (!validate_slurm_user(uid)) {
+		error("Security violation, REQUEST_STATE_REPL from uid=%d",
+		      uid);
+		rc = ESLURM_USER_ID_MISSING;
+	} else if (!arg || (arg->newsockfd < 0)) {
+		/* Not possible through a persistent or composite connection */
+		rc = ESLURM_NOT_SUPPORTED;
+	} else if (msg->protocol_version != SLURM_PROTOCOL_VERSION) {
+		rc = SLURM_PROTOCOL_VERSION_ERROR;
+	} else if (!state_repl_enabled()) {
+		rc = ESLURM_NOT_SUPPORTED;
+	}
+	if (rc != SLURM_SUCCESS) {
+		slurm_send_rc_msg(msg, rc);
+		return;
+	}
+
+	if (slurm_get_peer_addr(msg->conn_fd, &peer_addr) == 0)
+		slurm_get_ip_str(&peer_addr, &port, host, sizeof(host));
+	if (slurm_send_rc_msg(msg, SLURM_SUCCESS) < 0)
+		return;
+	state_repl_add(arg->newsockfd, host);
+	arg->newsockfd = -1;
+}
@@ -42,6 +42,15 @@
 #include <sys/time.h>
 
 #include "src/common/slurm_protocol_api.h"
+#include "src/slurmctld/slurmctld.h"
+
+/* Admission of an RPC in its priority class, see rpc_class_admit() */
+enum {
+	RPC_ADMIT_NONE = 0,	/* not checked yet */
+	RPC_ADMIT_OK,		/* slot taken in the RPC's class */
+	RPC_ADMIT_DEFER,	/* class full, retry once a slot is free */
+	RPC_ADMIT_SHED		/* reject with ESLURM_CONTROLLER_BUSY */
+};
 
 /* Each TCP/IP client connection has a socket
  * and address with port
@@ -49,11 +58,42 @@
 typedef struct connection_arg {
 	int newsockfd;
 	slurm_addr_t cli_addr;
+	int rpc_admit;		/* RPC_ADMIT_* set by the rpc_engine */
+	int rpc_class;		/* class of the slot taken if RPC_ADMIT_OK */
 } connection_arg_t;
 
 /* Free memory used to track RPC usage by type and user */
 extern void free_rpc_stats(void);
 
+/*
+ * rpc_class_admit - take a slot for a request in its RPC priority class,
+ *	see the rpc_max_* options of SlurmctldParameters. The slot is
+ *	released when slurmctld_req() processes the request with
+ *	connection_arg_t rpc_admit and rpc_class set from this call.
+ * IN msg_type - message type of the request
+ * IN can_defer - the caller can queue the request until a slot is free
+ * IN defer_time - when the request was deferred, NULL if never
+ * OUT rpc_class - priority class of the request
+ * RET RPC_ADMIT_OK, RPC_ADMIT_DEFER or RPC_ADMIT_SHED
+ */
+extern int rpc_class_admit(uint16_t msg_type, bool can_defer,
+			   struct timeval *defer_time, int *rpc_class);
+
+/*
+ * rpc_class_release - release a slot taken with rpc_class_admit() for a
+ *	request which slurmctld_req() will not process
+ */
+extern void rpc_class_release(int rpc_class);
+
+/* rpc_class_full - return true if an RPC priority class has no free slot */
+extern bool rpc_class_full(int rpc_class);
+
+/*
+ * rpc_class_config - set RPC priority class limits from SlurmctldParameters
+ * NOTE: Caller must hold the config write lock
+ */
+extern void rpc_class_config(void);
+
 /*
  * slurmctld_req  - Process an individual RPC request
  * IN/OUT msg - the request message, data associated with the message is freed
@@ -71,12 +71,15 @@
 #include "src/common/xstring.h"
 
 #include "src/slurmctld/burst_buffer.h"
+#include "src/slurmctld/job_queue.h"
 #include "src/slurmctld/job_scheduler.h"
+#include "src/slurmctld/job_timer.h"
 #include "src/slurmctld/licenses.h"
 #include "src/slurmctld/locks.h"
 #include "src/slurmctld/node_scheduler.h"
 #include "src/slurmctld/reservation.h"
 #include "src/slurmctld/slurmctld.h"
+#include "src/slurmctld/state_repl.h"
 #include "src/slurmctld/state_save.h"
 
 #define _DEBUG		0
@@ -152,7 +155,7 @@ static bool _job_overlap(time_t start_time, uint32_t flags,
 			 bitstr_t *node_bitmap, char *resv_name);
 static int _job_resv_check(void *x, void *arg);
 static List _list_dup(List license_list);
-static int  _open_resv_state_file(char **state_file);
+static Buf  _open_resv_state_file(char **state_file);
 static void _pack_resv(slurmctld_resv_t *resv_ptr, Buf buffer,
 		       bool internal, uint16_t protocol_version);
 static bitstr_t *_pick_idle_nodes(bitstr_t *avail_nodes,
@@ -2815,6 +2818,11 @@ extern int update_resv(resv_desc_msg_t *resv_desc_ptr)
 
 	_set_tres_cnt(resv_ptr, resv_backup);
 
+	/* Running jobs may now reach the end of the reservation sooner */
+	if ((resv_ptr->end_time < resv_backup->end_time) ||
+	    (resv_ptr->flags != resv_backup->flags))
+		job_timer_rescan();
+
 	_del_resv_rec(resv_backup);
 	(void) set_node_maint_mode(true);
 	last_resv_update = now;
@@ -2877,6 +2885,7 @@ static void _clear_job_resv(slurmctld_resv_t *resv_ptr)
 				    resv_ptr->name);
 			job_ptr->priority = 0;	/* Hold job */
 		}
+		job_queue_update(job_ptr);
 	}
 	list_iterator_destroy(job_iterator);
 }
@@ -3162,6 +3171,8 @@ extern int dump_all_resv_state(void)
 	xfree(new_file);
 	unlock_state_files();
 
+	if (!error_code && state_repl_active())
+		state_repl_publish(STATE_REPL_RESV, buffer, NULL, 0);
 	free_buf(buffer);
 	END_TIMER2("dump_all_resv_state");
 	return 0;
@@ -3322,6 +3333,7 @@ static void _validate_all_reservations(void)
 			       job_ptr->job_id, job_ptr->resv_name);
 			job_ptr->resv_id = 0;
 			xfree(job_ptr->resv_name);
+			job_queue_update(job_ptr);
 		}
 	}
 	list_iterator_destroy(iter);
@@ -3476,33 +3488,28 @@ static void _validate_node_choice(slurmctld_resv_t *resv_ptr)
 
 /* Open the reservation state save file, or backup if necessary.
  * state_file IN - the name of the state save file used
- * RET the file description to read from or error code
+ * RET buffer mapping the file contents or NULL on error
  */
-static int _open_resv_state_file(char **state_file)
+static Buf _open_resv_state_file(char **state_file)
 {
-	int state_fd;
-	struct stat stat_buf;
+	Buf buffer;
 
 	*state_file = xstrdup(slurmctld_conf.state_save_location);
 	xstrcat(*state_file, "/resv_state");
-	state_fd = open(*state_file, O_RDONLY);
-	if (state_fd < 0) {
+	if ((buffer = state_repl_open(STATE_REPL_RESV, *state_file)))
+		return buffer;
+	if (!(buffer = create_mmap_buf(*state_file))) {
 		error("Could not open reservation state file %s: %m",
 		      *state_file);
-	} else if (fstat(state_fd, &stat_buf) < 0) {
-		error("Could not stat reservation state file %s: %m",
-		      *state_file);
-		(void) close(state_fd);
-	} else if (stat_buf.st_size < 10) {
+	} else if (size_buf(buffer) < 10) {
 		error("Reservation state file %s too small", *state_file);
-		(void) close(state_fd);
+		free_buf(buffer);
 	} else 	/* Success */
-		return state_fd;
+		return buffer;
 
 	error("NOTE: Trying backup state save file. Reservations may be lost");
 	xstrcat(*state_file, ".old");
-	state_fd = open(*state_file, O_RDONLY);
-	return state_fd;
+	return create_mmap_buf(*state_file);
 }
 
 /*
@@ -3517,10 +3524,10 @@ static int _open_resv_state_file(char **state_file)
  */
 extern int load_all_resv_state(int recover)
 {
-	char *state_file, *data = NULL, *ver_str = NULL;
+	char *state_file, *ver_str = NULL;
 	time_t now;
-	uint32_t data_size = 0, uint32_tmp;
-	int data_allocated, data_read = 0, error_code = 0, state_fd;
+	uint32_t uint32_tmp;
+	int error_code = 0;
 	Buf buffer;
 	slurmctld_resv_t *resv_ptr = NULL;
 	uint16_t protocol_version = NO_VAL16;
@@ -3539,40 +3546,16 @@ extern int load_all_resv_state(int recover)
 
 	/* read the file */
 	lock_state_files();
-	state_fd = _open_resv_state_file(&state_file);
-	if (state_fd < 0) {
+	if (!(buffer = _open_resv_state_file(&state_file))) {
 		info("No reservation state file (%s) to recover",
 		     state_file);
 		xfree(state_file);
 		unlock_state_files();
 		return ENOENT;
-	} else {
-		data_allocated = BUF_SIZE;
-		data = xmalloc(data_allocated);
-		while (1) {
-			data_read = read(state_fd, &data[data_size],
-					BUF_SIZE);
-			if (data_read < 0) {
-				if  (errno == EINTR)
-					continue;
-				else {
-					error("Read error on %s: %m",
-						state_file);
-					break;
-				}
-			} else if (data_read == 0)     /* eof */
-				break;
-			data_size      += data_read;
-			data_allocated += data_read;
-			xrealloc(data, data_allocated);
-		}
-		close(state_fd);
 	}
 	xfree(state_file);
 	unlock_state_files();
 
-	buffer = create_buf(data, data_size);
-
 	safe_unpackstr_xmalloc( &ver_str, &uint32_tmp, buffer);
 	debug3("Version string in resv_state header is %s", ver_str);
 	if (ver_str && !xstrcmp(ver_str, RESV_STATE_VERSION))
@@ -5073,6 +5056,7 @@ extern int job_test_resv(struct job_record *job_ptr, time_t *when,
 				     (job_ptr->details->begin_time >
 				      resv_ptr->end_time)))
 					job_ptr->priority = 0;	/* admin hold */
+				job_queue_update(job_ptr);
 				return ESLURM_RESERVATION_INVALID;
 			}
 			if (job_ptr->details->req_node_bitmap &&
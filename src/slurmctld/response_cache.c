@@ -0,0 +1,271 @@
+/*****************************************************************************\
+ *  response_cache.c - cache of packed job, node and partition information responses
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+/*
+ * Monitoring tools often issue identical job, node and partition
+ * information requests many times between state changes. With
+ * SlurmctldParameters=response_cache_mb=# the packed response is kept and
+ * returned for identical requests (same protocol version, show_flags and
+ * user visibility) until the write lock generation of the data behind it
+ * changes. The generation includes the configuration lock, so a change of
+ * PrivateData also invalidates every response.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "src/common/list.h"
+#include "src/common/log.h"
+#include "src/common/macros.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
+
+#include "src/slurmctld/locks.h"
+#include "src/slurmctld/response_cache.h"
+#include "src/slurmctld/slurmctld.h"
+
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static List cache_list = NULL;
+static uint64_t cache_size = 0;		/* bytes of cached responses */
+static uint64_t cache_max = 0;		/* bytes, 0 if disabled */
+
+extern uint32_t response_cache_gen(response_cache_type_t type)
+{
+	switch (type) {
+	case RESPONSE_CACHE_JOB:
+		return get_lock_write_gen(CONF_LOCK) +
+		       get_lock_write_gen(JOB_LOCK) +
+		       get_lock_write_gen(PART_LOCK) +
+		       get_lock_write_gen(FED_LOCK);
+	case RESPONSE_CACHE_NODE:
+		return get_lock_write_gen(CONF_LOCK) +
+		       get_lock_write_gen(JOB_LOCK) +
+		       get_lock_write_gen(NODE_LOCK) +
+		       get_lock_write_gen(PART_LOCK);
+	case RESPONSE_CACHE_PART:
+		return get_lock_write_gen(CONF_LOCK) +
+		       get_lock_write_gen(PART_LOCK);
+	default:
+		return 0;
+	}
+}
+
+static void _free_resp(response_cache_t *resp)
+{
+	xfree(resp->data);
+	xfree(resp);
+}
+
+/* Remove a response from the cache, the caller must hold cache_mutex */
+static void _remove_resp(response_cache_t *resp)
+{
+	cache_size -= resp->size;
+	if (--resp->refcnt == 0)
+		_free_resp(resp);
+}
+
+extern void response_cache_config(void)
+{
+	char *tmp_ptr;
+	int cache_mb = 0;
+
+	if ((tmp_ptr = xstrcasestr(slurmctld_conf.slurmctld_params,
+				   "response_cache_mb="))) {
+		cache_mb = atoi(tmp_ptr + 18);
+		if (cache_mb < 0) {
+			error("Invalid SlurmctldParameters response_cache_mb=%d",
+			      cache_mb);
+			cache_mb = 0;
+		}
+	}
+
+	slurm_mutex_lock(&cache_mutex);
+	cache_max = (uint64_t) cache_mb * 1024 * 1024;
+	if (cache_max && !cache_list)
+		cache_list = list_create(NULL);
+	slurm_mutex_unlock(&cache_mutex);
+}
+
+extern void response_cache_fini(void)
+{
+	response_cache_t *resp;
+
+	slurm_mutex_lock(&cache_mutex);
+	if (cache_list) {
+		while ((resp = list_pop(cache_list)))
+			_remove_resp(resp);
+		FREE_NULL_LIST(cache_list);
+	}
+	cache_max = 0;
+	slurm_mutex_unlock(&cache_mutex);
+}
+
+static response_cache_priv_t _priv(uid_t uid)
+{
+	if (uid == 0)
+		return RESPONSE_CACHE_PRIV_ROOT;
+	if (validate_slurm_user(uid))
+		return RESPONSE_CACHE_PRIV_SLURM_USER;
+	return RESPONSE_CACHE_PRIV_USER;
+}
+
+static bool _visible(response_cache_t *resp, uid_t uid)
+{
+	/* Nothing is hidden by partition with SHOW_ALL */
+	bool same_priv = ((resp->show_flags & SHOW_ALL) ||
+			  (resp->priv == _priv(uid)));
+
+	switch (resp->visibility) {
+	case RESPONSE_CACHE_VIS_PUBLIC:
+		return same_priv;
+	case RESPONSE_CACHE_VIS_SLURM_USER:
+		return (validate_slurm_user(uid) && same_priv);
+	default:
+		return (resp->uid == uid);
+	}
+}
+
+extern response_cache_t *response_cache_get(response_cache_type_t type,
+					     uint16_t protocol_version,
+					     uint16_t show_flags, uid_t uid)
+{
+	ListIterator iter;
+	response_cache_t *resp = NULL;
+	uint32_t gen;
+
+	if (!cache_max)
+		return NULL;
+
+	gen = response_cache_gen(type);
+	slurm_mutex_lock(&cache_mutex);
+	if (cache_list) {
+		iter = list_iterator_create(cache_list);
+		while ((resp = list_next(iter))) {
+			if ((resp->type == type) && (resp->gen == gen) &&
+			    (resp->protocol_version == protocol_version) &&
+			    (resp->show_flags == show_flags) &&
+			    _visible(resp, uid))
+				break;
+		}
+		list_iterator_destroy(iter);
+	}
+	if (resp) {
+		resp->refcnt++;
+		resp->last_used = time(NULL);
+	}
+	slurm_mutex_unlock(&cache_mutex);
+
+	return resp;
+}
+
+extern void response_cache_release(response_cache_t *resp)
+{
+	slurm_mutex_lock(&cache_mutex);
+	if (--resp->refcnt == 0)
+		_free_resp(resp);
+	slurm_mutex_unlock(&cache_mutex);
+}
+
+static int _sort_by_last_used(void *x, void *y)
+{
+	response_cache_t *resp1 = *(response_cache_t **) x;
+	response_cache_t *resp2 = *(response_cache_t **) y;
+
+	return (int) (resp1->last_used - resp2->last_used);
+}
+
+extern void response_cache_put(response_cache_type_t type, uint32_t gen,
+			       uint16_t protocol_version, uint16_t show_flags,
+			       uid_t uid, bool public, time_t last_update,
+			       char *data, int size)
+{
+	response_cache_t *resp, *old_resp;
+	ListIterator iter;
+	uint32_t cur_gen[RESPONSE_CACHE_CNT];
+	int i;
+
+	if (!cache_max || (size <= 0) || (size > cache_max))
+		return;
+
+	resp = xmalloc(sizeof(response_cache_t));
+	resp->type = type;
+	resp->gen = gen;
+	resp->protocol_version = protocol_version;
+	resp->show_flags = show_flags;
+	resp->uid = uid;
+	resp->priv = _priv(uid);
+	if (public)
+		resp->visibility = RESPONSE_CACHE_VIS_PUBLIC;
+	else if (validate_slurm_user(uid))
+		resp->visibility = RESPONSE_CACHE_VIS_SLURM_USER;
+	else
+		resp->visibility = RESPONSE_CACHE_VIS_UID;
+	resp->last_update = last_update;
+	resp->last_used = time(NULL);
+	resp->refcnt = 1;
+	resp->size = size;
+	resp->data = xmalloc(size);
+	memcpy(resp->data, data, size);
+
+	for (i = 0; i < RESPONSE_CACHE_CNT; i++)
+		cur_gen[i] = response_cache_gen(i);
+
+	slurm_mutex_lock(&cache_mutex);
+	if (!cache_list) {
+		slurm_mutex_unlock(&cache_mutex);
+		_free_resp(resp);
+		return;
+	}
+	/* Responses for data which has changed since can never be used */
+	iter = list_iterator_create(cache_list);
+	while ((old_resp = list_next(iter))) {
+		if (old_resp->gen != cur_gen[old_resp->type]) {
+			list_remove(iter);
+			_remove_resp(old_resp);
+		}
+	}
+	list_iterator_destroy(iter);
+	if (cache_size + size > cache_max) {
+		list_sort(cache_list, (ListCmpF) _sort_by_last_used);
+		while ((cache_size + size > cache_max) &&
+		       (old_resp = list_pop(cache_list)))
+			_remove_resp(old_resp);
+	}
+	list_append(cache_list, resp);
+	cache_size += size;
+	slurm_mutex_unlock(&cache_mutex);
+}
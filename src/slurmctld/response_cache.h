@@ -0,0 +1,120 @@
+/*****************************************************************************\
+ *  response_cache.h - cache of packed job, node and partition information responses
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#ifndef _HAVE_RESPONSE_CACHE_H
+#define _HAVE_RESPONSE_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+typedef enum {
+	RESPONSE_CACHE_JOB,	/* RESPONSE_JOB_INFO */
+	RESPONSE_CACHE_NODE,	/* RESPONSE_NODE_INFO */
+	RESPONSE_CACHE_PART,	/* RESPONSE_PARTITION_INFO */
+	RESPONSE_CACHE_CNT
+} response_cache_type_t;
+
+/* Which users besides the requester may share a cached response */
+typedef enum {
+	RESPONSE_CACHE_VIS_UID,		/* only the same user */
+	RESPONSE_CACHE_VIS_SLURM_USER,	/* root and SlurmUser see everything */
+	RESPONSE_CACHE_VIS_PUBLIC	/* not filtered by user identity */
+} response_cache_vis_t;
+
+/*
+ * Privilege of the user a response was packed for. Without SHOW_ALL, only
+ * root sees everything, SlurmUser sees every partition and other users see
+ * the partitions they may use, so responses are only shared within a class.
+ */
+typedef enum {
+	RESPONSE_CACHE_PRIV_USER,
+	RESPONSE_CACHE_PRIV_SLURM_USER,
+	RESPONSE_CACHE_PRIV_ROOT
+} response_cache_priv_t;
+
+/* One cached response, returned by response_cache_get() */
+typedef struct {
+	response_cache_type_t type;
+	uint32_t gen;		/* response_cache_gen() when packed */
+	uint16_t protocol_version;
+	uint16_t show_flags;
+	uid_t uid;		/* user the response was packed for */
+	response_cache_vis_t visibility;
+	response_cache_priv_t priv;	/* privilege of uid */
+	time_t last_update;	/* last_job/node/part_update when packed */
+	time_t last_used;
+	int refcnt;
+	char *data;
+	int size;
+} response_cache_t;
+
+/*
+ * Return the generation of the data behind a response type, the sum of the
+ * write lock generations of every entity the response is packed from.
+ * If unchanged, a response packed earlier is still correct.
+ */
+extern uint32_t response_cache_gen(response_cache_type_t type);
+
+/* Read the "response_cache_mb=" option of SlurmctldParameters */
+extern void response_cache_config(void);
+
+/* Free all cached responses */
+extern void response_cache_fini(void);
+
+/*
+ * Find a cached response for this request which is still current.
+ * RET the response, release with response_cache_release(), or NULL
+ */
+extern response_cache_t *response_cache_get(response_cache_type_t type,
+					     uint16_t protocol_version,
+					     uint16_t show_flags, uid_t uid);
+
+/* Release a response returned by response_cache_get() */
+extern void response_cache_release(response_cache_t *resp);
+
+/*
+ * Add a copy of a newly packed response to the cache.
+ * IN gen - response_cache_gen() while holding the locks used for packing
+ * IN public - true if the response was not filtered by the user's
+ *	identity, so that any user of the same privilege can share it
+ */
+extern void response_cache_put(response_cache_type_t type, uint32_t gen,
+			       uint16_t protocol_version, uint16_t show_flags,
+			       uid_t uid, bool public, time_t last_update,
+			       char *data, int size);
+
+#endif	/* !_HAVE_RESPONSE_CACHE_H */
@@ -0,0 +1,553 @@
+/*****************************************************************************\
+ *  rpc_engine.c - event driven RPC front end for slurmctld
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#include "config.h"
+
+#if HAVE_SYS_PRCTL_H
+#  include <sys/prctl.h>
+#endif
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "src/common/fd.h"
+#include "src/common/list.h"
+#include "src/common/log.h"
+#include "src/common/macros.h"
+#include "src/common/pack.h"
+#include "src/common/slurm_protocol_api.h"
+#include "src/common/slurm_protocol_interface.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
+
+#include "src/slurmctld/proc_req.h"
+#include "src/slurmctld/rpc_engine.h"
+#include "src/slurmctld/slurmctld.h"
+
+#define MAX_EPOLL_EVENTS 64
+#define MAX_MSG_SIZE     (1024*1024*1024)
+#define RPC_QUEUE_MAX    1024	/* Stop accepting with this many queued */
+
+/*
+ * State of one accepted connection while its request is being read.
+ * A listening socket is also represented by one of these with
+ * "listener" set so that the epoll event can be dispatched directly.
+ */
+typedef struct rpc_conn {
+	bool listener;
+	int fd;
+	slurm_addr_t cli_addr;
+	time_t start_time;	/* when accepted, for timeouts */
+	uint32_t msg_len;	/* message length, host order once read */
+	uint32_t hdr_read;	/* bytes of msg_len read so far */
+	char *data;		/* message body */
+	uint32_t data_read;	/* bytes of body read so far */
+	struct timeval queue_time;	/* when handed off to a worker */
+	bool deferred;		/* waited for a slot in its RPC class */
+	struct timeval defer_time;	/* when deferred */
+	int rpc_class;		/* RPC priority class, see rpc_class_admit() */
+	struct rpc_conn *next;	/* list of connections being read */
+	struct rpc_conn *prev;
+} rpc_conn_t;
+
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  queue_cond  = PTHREAD_COND_INITIALIZER;
+static List rpc_queue = NULL;	/* complete requests, rpc_conn_t */
+static List deferred_list = NULL;	/* requests of a full RPC class */
+static bool workers_shutdown = false;
+static rpc_conn_t *read_conns = NULL;	/* only used by the epoll thread */
+
+static void _link_conn(rpc_conn_t *conn)
+{
+	conn->prev = NULL;
+	conn->next = read_conns;
+	if (read_conns)
+		read_conns->prev = conn;
+	read_conns = conn;
+}
+
+static void _unlink_conn(rpc_conn_t *conn)
+{
+	if (conn->prev)
+		conn->prev->next = conn->next;
+	else
+		read_conns = conn->next;
+	if (conn->next)
+		conn->next->prev = conn->prev;
+	conn->next = conn->prev = NULL;
+}
+
+static void _conn_close(rpc_conn_t *conn)
+{
+	if (conn->fd >= 0)
+		(void) close(conn->fd);
+	xfree(conn->data);
+	xfree(conn);
+}
+
+extern int rpc_engine_workers(void)
+{
+	char *tmp_ptr;
+	int workers = 0;
+
+	if ((tmp_ptr = xstrcasestr(slurmctld_conf.slurmctld_params,
+				   "rpc_workers="))) {
+		workers = atoi(tmp_ptr + 12);
+		if (workers < 0) {
+			error("Invalid SlurmctldParameters rpc_workers=%d",
+			      workers);
+			workers = 0;
+		}
+	}
+	return workers;
+}
+
+/* Process one complete request, same as _service_connection() does for
+ * the thread per connection model */
+static void _service_request(rpc_conn_t *conn, int rpc_admit)
+{
+	connection_arg_t conn_arg;
+	slurm_msg_t msg;
+	Buf buffer;
+
+	slurm_msg_t_init(&msg);
+	msg.flags |= SLURM_MSG_KEEP_BUFFER;
+	msg.conn_fd = conn->fd;
+	conn_arg.newsockfd = conn->fd;
+	memcpy(&conn_arg.cli_addr, &conn->cli_addr, sizeof(slurm_addr_t));
+	conn_arg.rpc_admit = rpc_admit;
+	conn_arg.rpc_class = conn->rpc_class;
+
+	buffer = create_buf(conn->data, conn->msg_len);
+	conn->data = NULL;	/* now owned by buffer */
+	msg.buffer = buffer;
+	if (slurm_unpack_received_msg(&msg, conn->fd, buffer) != 0) {
+		char addr_buf[32];
+		int err = errno;
+		slurm_print_slurm_addr(&conn->cli_addr, addr_buf,
+				       sizeof(addr_buf));
+		error("slurm_receive_msg [%s]: %s", addr_buf,
+		      slurm_strerror(err));
+		/* Tell clients of an unsupported version, as
+		 * _service_connection() does */
+		if (err == SLURM_PROTOCOL_VERSION_ERROR)
+			slurm_send_rc_msg(&msg, SLURM_PROTOCOL_VERSION_ERROR);
+		if (rpc_admit == RPC_ADMIT_OK)
+			rpc_class_release(conn->rpc_class);
+	} else {
+		slurmctld_req(&msg, &conn_arg);
+	}
+
+	/* slurmctld_req() may take ownership of the socket (persist_init) */
+	if ((conn_arg.newsockfd >= 0) && (close(conn_arg.newsockfd) < 0))
+		error("close(%d): %m", conn_arg.newsockfd);
+	conn->fd = -1;
+	slurm_free_msg_members(&msg);
+}
+
+/*
+ * Take a slot in the request's RPC priority class before unpacking it, the
+ * message type follows the version, flags and msg_index of the header (see
+ * pack_header())
+ */
+static int _admit_request(rpc_conn_t *conn, bool can_defer)
+{
+	uint16_t msg_type;
+
+	if (conn->msg_len < (sizeof(uint16_t) * 4))
+		return RPC_ADMIT_NONE;	/* let slurmctld_req() decide */
+	memcpy(&msg_type, conn->data + (sizeof(uint16_t) * 3),
+	       sizeof(msg_type));
+	return rpc_class_admit(ntohs(msg_type), can_defer,
+			       conn->deferred ? &conn->defer_time : NULL,
+			       &conn->rpc_class);
+}
+
+/* Hold a request until a slot of its RPC class is released */
+static void _defer_request(rpc_conn_t *conn)
+{
+	conn->deferred = true;
+	gettimeofday(&conn->defer_time, NULL);
+	slurm_mutex_lock(&queue_mutex);
+	if (workers_shutdown) {
+		/* Reprocessed without deferral, see rpc_engine_run() */
+		list_enqueue(rpc_queue, conn);
+		slurm_cond_signal(&queue_cond);
+		slurm_mutex_unlock(&queue_mutex);
+		return;
+	}
+	list_append(deferred_list, conn);
+	slurm_mutex_unlock(&queue_mutex);
+
+	/* A slot may have been released before the request was deferred */
+	if (!rpc_class_full(conn->rpc_class))
+		rpc_engine_class_free(conn->rpc_class);
+}
+
+static int _find_class(void *x, void *key)
+{
+	rpc_conn_t *conn = (rpc_conn_t *) x;
+
+	if (conn->rpc_class == *(int *) key)
+		return 1;
+	return 0;
+}
+
+extern void rpc_engine_class_free(int rpc_class)
+{
+	ListIterator iter;
+	rpc_conn_t *conn = NULL;
+
+	slurm_mutex_lock(&queue_mutex);
+	if (deferred_list) {
+		iter = list_iterator_create(deferred_list);
+		if ((conn = list_find(iter, _find_class, &rpc_class)))
+			(void) list_remove(iter);
+		list_iterator_destroy(iter);
+	}
+	if (conn) {
+		/* Ahead of requests which have not been deferred */
+		gettimeofday(&conn->queue_time, NULL);
+		list_push(rpc_queue, conn);
+		slurm_cond_signal(&queue_cond);
+	}
+	slurm_mutex_unlock(&queue_mutex);
+}
+
+static void *_rpc_worker(void *arg)
+{
+	rpc_conn_t *conn;
+	struct timeval now;
+	uint32_t wait_usec;
+	bool can_defer;
+	int rpc_admit;
+
+#if HAVE_SYS_PRCTL_H
+	if (prctl(PR_SET_NAME, "rpcwrk", NULL, NULL, NULL) < 0) {
+		error("%s: cannot set my name to %s %m", __func__, "rpcwrk");
+	}
+#endif
+
+	while (1) {
+		slurm_mutex_lock(&queue_mutex);
+		while (!(conn = list_dequeue(rpc_queue)) && !workers_shutdown)
+			slurm_cond_wait(&queue_cond, &queue_mutex);
+		if (!conn) {	/* Shutdown with an empty queue */
+			slurm_mutex_unlock(&queue_mutex);
+			break;
+		}
+		gettimeofday(&now, NULL);
+		wait_usec = (now.tv_sec - conn->queue_time.tv_sec) * 1000000 +
+			    (now.tv_usec - conn->queue_time.tv_usec);
+		slurmctld_diag_stats.rpc_queue_len = list_count(rpc_queue) +
+						     list_count(deferred_list);
+		slurmctld_diag_stats.rpc_queue_cnt++;
+		slurmctld_diag_stats.rpc_queue_wait_sum += wait_usec;
+		if (wait_usec > slurmctld_diag_stats.rpc_queue_wait_max)
+			slurmctld_diag_stats.rpc_queue_wait_max = wait_usec;
+		can_defer = !workers_shutdown;
+		slurm_mutex_unlock(&queue_mutex);
+
+		rpc_admit = _admit_request(conn, can_defer);
+		if (rpc_admit == RPC_ADMIT_DEFER) {
+			_defer_request(conn);
+			continue;
+		}
+		_service_request(conn, rpc_admit);
+		_conn_close(conn);
+		server_thread_decr();
+	}
+
+	return NULL;
+}
+
+/* Hand a complete request off to the worker pool */
+static void _queue_request(rpc_conn_t *conn)
+{
+	uint32_t queue_len;
+
+	server_thread_incr();
+	gettimeofday(&conn->queue_time, NULL);
+	slurm_mutex_lock(&queue_mutex);
+	list_enqueue(rpc_queue, conn);
+	/* Deferred requests count too, they hold connections open */
+	queue_len = list_count(rpc_queue) + list_count(deferred_list);
+	slurmctld_diag_stats.rpc_queue_len = queue_len;
+	if (queue_len > slurmctld_diag_stats.rpc_queue_len_max)
+		slurmctld_diag_stats.rpc_queue_len_max = queue_len;
+	slurm_cond_signal(&queue_cond);
+	slurm_mutex_unlock(&queue_mutex);
+}
+
+/*
+ * Read whatever is available on a connection without blocking.
+ * RET 1 if the message is complete, 0 if more data is needed,
+ *     -1 on error or end of file
+ */
+static int _read_conn(rpc_conn_t *conn)
+{
+	ssize_t len;
+
+	while (conn->hdr_read < sizeof(conn->msg_len)) {
+		len = read(conn->fd, ((char *) &conn->msg_len) + conn->hdr_read,
+			   sizeof(conn->msg_len) - conn->hdr_read);
+		if (len > 0) {
+			conn->hdr_read += len;
+			continue;
+		}
+		if ((len < 0) && (errno == EINTR))
+			continue;
+		if ((len < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+			return 0;
+		return -1;
+	}
+	if (!conn->data) {
+		conn->msg_len = ntohl(conn->msg_len);
+		if (conn->msg_len > MAX_MSG_SIZE) {
+			error("%s: Insane message length %u",
+			      __func__, conn->msg_len);
+			return -1;
+		}
+		conn->data = xmalloc_nz(conn->msg_len ? conn->msg_len : 1);
+	}
+	while (conn->data_read < conn->msg_len) {
+		len = read(conn->fd, conn->data + conn->data_read,
+			   conn->msg_len - conn->data_read);
+		if (len > 0) {
+			conn->data_read += len;
+			continue;
+		}
+		if ((len < 0) && (errno == EINTR))
+			continue;
+		if ((len < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+			return 0;
+		return -1;
+	}
+	return 1;
+}
+
+static void _accept_conn(int epfd, rpc_conn_t *listener)
+{
+	struct epoll_event ev;
+	rpc_conn_t *conn;
+	slurm_addr_t cli_addr;
+	int newsockfd;
+
+	if ((newsockfd = slurm_accept_msg_conn(listener->fd, &cli_addr)) ==
+	    SLURM_SOCKET_ERROR) {
+		if ((errno != EINTR) && (errno != EAGAIN) &&
+		    (errno != EWOULDBLOCK))
+			error("slurm_accept_msg_conn: %m");
+		return;
+	}
+	fd_set_close_on_exec(newsockfd);
+	fd_set_nonblocking(newsockfd);
+
+	if (slurmctld_conf.debug_flags & DEBUG_FLAG_PROTOCOL) {
+		char inetbuf[64];
+		slurm_print_slurm_addr(&cli_addr, inetbuf, sizeof(inetbuf));
+		info("%s: accept() connection from %s", __func__, inetbuf);
+	}
+
+	conn = xmalloc(sizeof(rpc_conn_t));
+	conn->fd = newsockfd;
+	conn->start_time = time(NULL);
+	memcpy(&conn->cli_addr, &cli_addr, sizeof(slurm_addr_t));
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = conn;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, newsockfd, &ev) < 0) {
+		error("%s: epoll_ctl(ADD, %d): %m", __func__, newsockfd);
+		_conn_close(conn);
+		return;
+	}
+	_link_conn(conn);
+}
+
+/* Add or remove the listening sockets from the epoll set so that new
+ * connections wait in the kernel backlog while the queue is full */
+static void _set_listen(int epfd, rpc_conn_t **listeners, int nports,
+			bool enable)
+{
+	struct epoll_event ev;
+	int i;
+
+	for (i = 0; i < nports; i++) {
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.ptr = listeners[i];
+		if (epoll_ctl(epfd, enable ? EPOLL_CTL_ADD : EPOLL_CTL_DEL,
+			      listeners[i]->fd, &ev) < 0)
+			error("%s: epoll_ctl(%d): %m", __func__,
+			      listeners[i]->fd);
+	}
+}
+
+/* Drop connections which have not delivered a complete request within
+ * MessageTimeout */
+static void _purge_stale_conns(int epfd, time_t now)
+{
+	rpc_conn_t *conn, *next;
+	int timeout = slurm_get_msg_timeout();
+
+	for (conn = read_conns; conn; conn = next) {
+		next = conn->next;
+		if (difftime(now, conn->start_time) <= timeout)
+			continue;
+		debug("%s: closing connection fd=%d after %d seconds without a complete message",
+		      __func__, conn->fd, timeout);
+		(void) epoll_ctl(epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+		_unlink_conn(conn);
+		_conn_close(conn);
+	}
+}
+
+extern void rpc_engine_run(int *sockfd, int nports)
+{
+	struct epoll_event events[MAX_EPOLL_EVENTS];
+	rpc_conn_t **listeners, *conn;
+	pthread_t *worker_ids;
+	bool listening = true;
+	int epfd, i, n, rc, worker_cnt;
+	time_t now, last_purge = time(NULL);
+
+	worker_cnt = rpc_engine_workers();
+	xassert(worker_cnt > 0);
+
+	if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+		fatal("%s: epoll_create1: %m", __func__);
+
+	slurm_mutex_lock(&queue_mutex);
+	rpc_queue = list_create(NULL);
+	deferred_list = list_create(NULL);
+	workers_shutdown = false;
+	slurmctld_diag_stats.rpc_workers = worker_cnt;
+	slurm_mutex_unlock(&queue_mutex);
+
+	worker_ids = xmalloc(sizeof(pthread_t) * worker_cnt);
+	for (i = 0; i < worker_cnt; i++)
+		slurm_thread_create(&worker_ids[i], _rpc_worker, NULL);
+	verbose("%s: servicing RPCs with %d worker threads",
+		__func__, worker_cnt);
+
+	listeners = xmalloc(sizeof(rpc_conn_t *) * nports);
+	for (i = 0; i < nports; i++) {
+		listeners[i] = xmalloc(sizeof(rpc_conn_t));
+		listeners[i]->listener = true;
+		listeners[i]->fd = sockfd[i];
+		fd_set_nonblocking(sockfd[i]);
+	}
+	_set_listen(epfd, listeners, nports, true);
+
+	while (!slurmctld_config.shutdown_time) {
+		n = epoll_wait(epfd, events, MAX_EPOLL_EVENTS, 1000);
+		if (n < 0) {
+			if (errno != EINTR)
+				error("%s: epoll_wait: %m", __func__);
+			continue;
+		}
+		for (i = 0; i < n; i++) {
+			conn = events[i].data.ptr;
+			if (conn->listener) {
+				_accept_conn(epfd, conn);
+				continue;
+			}
+			rc = _read_conn(conn);
+			if (rc == 0)
+				continue;
+			(void) epoll_ctl(epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+			_unlink_conn(conn);
+			if (rc < 0) {
+				_conn_close(conn);
+				continue;
+			}
+			slurmctld_diag_stats.proc_req_raw++;
+			_queue_request(conn);
+		}
+
+		if (listening &&
+		    (slurmctld_diag_stats.rpc_queue_len >= RPC_QUEUE_MAX)) {
+			_set_listen(epfd, listeners, nports, false);
+			listening = false;
+		} else if (!listening &&
+			   (slurmctld_diag_stats.rpc_queue_len <
+			    (RPC_QUEUE_MAX / 2))) {
+			_set_listen(epfd, listeners, nports, true);
+			listening = true;
+		}
+
+		now = time(NULL);
+		if (difftime(now, last_purge) >= 1) {
+			_purge_stale_conns(epfd, now);
+			last_purge = now;
+		}
+	}
+
+	/*
+	 * Let the workers drain whatever was already queued, deferred
+	 * requests are processed or rejected without waiting for a slot
+	 */
+	slurm_mutex_lock(&queue_mutex);
+	list_transfer(rpc_queue, deferred_list);
+	workers_shutdown = true;
+	slurm_cond_broadcast(&queue_cond);
+	slurm_mutex_unlock(&queue_mutex);
+	for (i = 0; i < worker_cnt; i++)
+		pthread_join(worker_ids[i], NULL);
+	xfree(worker_ids);
+
+	while ((conn = read_conns)) {
+		_unlink_conn(conn);
+		_conn_close(conn);
+	}
+	for (i = 0; i < nports; i++)
+		xfree(listeners[i]);	/* Sockets closed by caller */
+	xfree(listeners);
+	(void) close(epfd);
+
+	slurm_mutex_lock(&queue_mutex);
+	FREE_NULL_LIST(rpc_queue);
+	FREE_NULL_LIST(deferred_list);
+	slurmctld_diag_stats.rpc_workers = 0;
+	slurmctld_diag_stats.rpc_queue_len = 0;
+	slurm_mutex_unlock(&queue_mutex);
+}
@@ -0,0 +1,64 @@
+/*****************************************************************************\
+ *  rpc_engine.h - event driven RPC front end for slurmctld
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#ifndef _HAVE_RPC_ENGINE_H
+#define _HAVE_RPC_ENGINE_H
+
+#include <stdbool.h>
+
+/*
+ * Return the number of RPC worker threads configured through the
+ * "rpc_workers=" option of SlurmctldParameters. Zero means the engine is
+ * disabled and a thread is created for each incoming connection.
+ */
+extern int rpc_engine_workers(void);
+
+/*
+ * Service incoming RPCs on the given listening sockets until slurmctld
+ * shutdown. Connections are accepted and read by a single epoll thread
+ * (the caller), complete messages are queued and processed by a pool of
+ * rpc_engine_workers() threads.
+ * IN sockfd - array of listening sockets
+ * IN nports - count of elements in sockfd
+ */
+extern void rpc_engine_run(int *sockfd, int nports);
+
+/*
+ * Resume one request deferred because its RPC priority class was full,
+ * called when a slot of the class is released
+ */
+extern void rpc_engine_class_free(int rpc_class);
+
+#endif	/* !_HAVE_RPC_ENGINE_H */
@@ -0,0 +1,544 @@
+/*****************************************************************************\
+ *  sched_shard.c - parallel evaluation of jobs in node-disjoint partitions
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+
+/*
+ * The main scheduling loop tests one job at a time in priority order, and
+ * most of its time goes to select plugin tests of jobs which can not start.
+ * Jobs in partitions which share no nodes can not affect each other's tests,
+ * so when the partitions form several such groups (shards) the loop reads
+ * ahead in the job queue and the select plugin tests of the jobs read are
+ * run in parallel, one thread per shard, with will-run tests limited to the
+ * current resource allocations (TEST_NOW_ONLY).
+ *
+ * Jobs are still allocated resources by select_nodes() in the scheduling
+ * thread, in the same order as before, so everything select_nodes() does
+ * for a job (accounting, licenses, burst buffers, etc.) is unchanged. Only
+ * the select plugin test of a job which was found unable to start is
+ * replaced by that result, see sched_shard_job_busy(). When all partitions
+ * overlap there is a single shard and jobs are tested sequentially.
+ */
+
+#include "config.h"
+
+#include <pthread.h>
+
+#if HAVE_SYS_PRCTL_H
+#  include <sys/prctl.h>
+#endif
+
+#include "src/common/assoc_mgr.h"
+#include "src/common/node_select.h"
+#include "src/common/timers.h"
+#include "src/common/xmalloc.h"
+
+#include "src/slurmctld/node_scheduler.h"
+#include "src/slurmctld/preempt.h"
+#include "src/slurmctld/sched_shard.h"
+
+#define SHARD_NONE	-1
+
+/* Job queue record read ahead of the scheduling loop */
+typedef struct shard_rec {
+	job_queue_rec_t rec;
+	int next;			/* next record of the same shard */
+	bool tested;
+	bool busy;			/* job can not start on avail_in */
+	bitstr_t *avail_in;		/* nodes offered to the job */
+	uint32_t min_nodes;
+	uint32_t max_nodes;
+	uint32_t req_nodes;
+	/* Job fields at the time of the test, the result depends upon them */
+	uint32_t min_cpus;
+	uint32_t num_tasks;
+	uint32_t time_limit;
+	uint64_t pn_min_memory;
+	uint64_t pn_min_memory_out;	/* as changed by the select plugin */
+} shard_rec_t;
+
+struct sched_shard_walk {
+	job_queue_iter_t *iter;
+	shard_rec_t *recs;		/* records of the current batch */
+	int rec_size;
+	int rec_cnt;
+	int rec_next;			/* next record to return */
+	int *shard_first;		/* first record of each shard */
+	int eval_cnt;			/* records tested */
+	int busy_cnt;			/* records which can not start */
+	int used_cnt;			/* results used by select_nodes() */
+	uint32_t eval_usec;
+};
+
+/* Thread pool */
+static pthread_mutex_t shard_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t shard_work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t shard_done_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t *shard_tid = NULL;
+static int shard_thread_cnt = 0;
+static bool shard_shutdown = false;
+static sched_shard_walk_t *shard_batch = NULL;	/* walk being evaluated */
+static int shard_next = 0;			/* next shard to evaluate */
+static int shard_done = 0;			/* shards evaluated */
+
+/* Partition grouping, rebuilt when partitions change */
+static time_t shard_part_update = (time_t) 0;
+static int shard_cnt = 0;
+static bitstr_t **shard_node_bitmap = NULL;	/* nodes of each shard */
+static struct part_record **shard_part = NULL;	/* partitions with nodes */
+static int *shard_part_inx = NULL;		/* shard of each partition */
+static int shard_part_cnt = 0;
+
+/* Record last returned by sched_shard_walk_next() */
+static sched_shard_walk_t *shard_cur_walk = NULL;
+static shard_rec_t *shard_cur = NULL;
+
+static void _shard_grouping_free(void)
+{
+	int i;
+
+	for (i = 0; i < shard_cnt; i++)
+		FREE_NULL_BITMAP(shard_node_bitmap[i]);
+	xfree(shard_node_bitmap);
+	xfree(shard_part);
+	xfree(shard_part_inx);
+	shard_cnt = 0;
+	shard_part_cnt = 0;
+	shard_part_update = (time_t) 0;
+}
+
+/* Group the partitions into shards, the smallest node-disjoint groups */
+static void _shard_grouping_build(void)
+{
+	ListIterator part_iterator;
+	struct part_record *part_ptr;
+	int i, j, k, part_cnt;
+
+	if (shard_node_bitmap && (shard_part_update == last_part_update))
+		return;
+	_shard_grouping_free();
+
+	part_cnt = list_count(part_list);
+	shard_node_bitmap = xmalloc(sizeof(bitstr_t *) * MAX(part_cnt, 1));
+	shard_part = xmalloc(sizeof(struct part_record *) * MAX(part_cnt, 1));
+	shard_part_inx = xmalloc(sizeof(int) * MAX(part_cnt, 1));
+	part_iterator = list_iterator_create(part_list);
+	while ((part_ptr = list_next(part_iterator))) {
+		if (!part_ptr->node_bitmap ||
+		    (bit_ffs(part_ptr->node_bitmap) == -1))
+			continue;
+		/* New shard, absorbing every shard it overlaps */
+		k = shard_cnt++;
+		shard_node_bitmap[k] = bit_copy(part_ptr->node_bitmap);
+		for (i = 0; i < k; i++) {
+			if (!shard_node_bitmap[i] ||
+			    !bit_overlap(shard_node_bitmap[i],
+					 shard_node_bitmap[k]))
+				continue;
+			bit_or(shard_node_bitmap[k], shard_node_bitmap[i]);
+			FREE_NULL_BITMAP(shard_node_bitmap[i]);
+			for (j = 0; j < shard_part_cnt; j++) {
+				if (shard_part_inx[j] == i)
+					shard_part_inx[j] = k;
+			}
+		}
+		shard_part[shard_part_cnt] = part_ptr;
+		shard_part_inx[shard_part_cnt++] = k;
+	}
+	list_iterator_destroy(part_iterator);
+
+	/* Remove the shards absorbed by others */
+	for (i = 0, k = 0; i < shard_cnt; i++) {
+		if (!shard_node_bitmap[i])
+			continue;
+		shard_node_bitmap[k] = shard_node_bitmap[i];
+		for (j = 0; j < shard_part_cnt; j++) {
+			if (shard_part_inx[j] == i)
+				shard_part_inx[j] = k;
+		}
+		k++;
+	}
+	shard_cnt = k;
+	shard_part_update = last_part_update;
+	debug("sched: %d partitions with nodes form %d node-disjoint shards",
+	      shard_part_cnt, shard_cnt);
+}
+
+static int _part_shard(struct part_record *part_ptr)
+{
+	int i;
+
+	for (i = 0; i < shard_part_cnt; i++) {
+		if (shard_part[i] == part_ptr)
+			return shard_part_inx[i];
+	}
+	return SHARD_NONE;
+}
+
+/*
+ * Fill in the select plugin arguments of a record which can be tested in
+ * parallel. Jobs needing special handling by select_nodes() or which may
+ * be tested in more than one partition are not.
+ * RET shard of the record or SHARD_NONE if it is not to be tested
+ */
+static int _shard_rec_prep(shard_rec_t *rec)
+{
+	struct job_record *job_ptr = rec->rec.job_ptr;
+	struct part_record *part_ptr = rec->rec.part_ptr;
+	struct job_details *details = job_ptr->details;
+	uint32_t qos_flags = 0;
+	int rc, shard;
+	assoc_mgr_lock_t qos_read_lock =
+		{ .assoc = READ_LOCK, .qos = READ_LOCK };
+
+	if (!details || job_ptr->part_ptr_list || job_ptr->resv_name ||
+	    job_ptr->pack_job_id || job_ptr->preempt_in_progress ||
+	    job_ptr->burst_buffer || details->req_node_bitmap ||
+	    (job_ptr->deadline && (job_ptr->deadline != NO_VAL)) ||
+	    ((details->min_nodes == 0) && (details->max_nodes == 0)) ||
+	    (part_ptr != job_ptr->part_ptr))
+		return SHARD_NONE;
+	if ((shard = _part_shard(part_ptr)) == SHARD_NONE)
+		return SHARD_NONE;
+
+	assoc_mgr_lock(&qos_read_lock);
+	if (job_ptr->qos_ptr)
+		qos_flags = job_ptr->qos_ptr->flags;
+	assoc_mgr_unlock(&qos_read_lock);
+	rc = get_node_cnts(job_ptr, qos_flags, part_ptr, &rec->min_nodes,
+			   &rec->req_nodes, &rec->max_nodes);
+	if (rc != SLURM_SUCCESS)
+		return SHARD_NONE;
+
+	rec->avail_in = bit_copy(part_ptr->node_bitmap);
+	bit_and(rec->avail_in, avail_node_bitmap);
+	if (details->exc_node_bitmap)
+		bit_and_not(rec->avail_in, details->exc_node_bitmap);
+	if (bit_set_count(rec->avail_in) < rec->min_nodes) {
+		FREE_NULL_BITMAP(rec->avail_in);
+		return SHARD_NONE;
+	}
+	rec->min_cpus = details->min_cpus;
+	rec->num_tasks = details->num_tasks;
+	rec->time_limit = job_ptr->time_limit;
+	rec->pn_min_memory = details->pn_min_memory;
+
+	return shard;
+}
+
+/*
+ * Test whether a job can start now. The job's fields changed by the test
+ * are restored, so that a result which is never used leaves no trace.
+ */
+static void _shard_rec_test(shard_rec_t *rec)
+{
+	struct job_record *job_ptr = rec->rec.job_ptr;
+	struct job_details *details = job_ptr->details;
+	uint32_t save_total_cpus = job_ptr->total_cpus;
+	uint32_t save_bit_flags = job_ptr->bit_flags;
+	time_t save_start_time = job_ptr->start_time;
+	bitstr_t *node_bitmap = bit_copy(rec->avail_in);
+	List preemptee_job_list = NULL;
+	int rc;
+
+	job_ptr->bit_flags |= TEST_NOW_ONLY;
+	rc = select_g_job_test(job_ptr, node_bitmap, rec->min_nodes,
+			       rec->max_nodes, rec->req_nodes,
+			       SELECT_MODE_WILL_RUN, NULL,
+			       &preemptee_job_list, NULL);
+	FREE_NULL_LIST(preemptee_job_list);
+	FREE_NULL_BITMAP(node_bitmap);
+	rec->tested = true;
+	rec->busy = (rc != SLURM_SUCCESS);
+	rec->pn_min_memory_out = details->pn_min_memory;
+
+	job_ptr->total_cpus = save_total_cpus;
+	job_ptr->bit_flags = save_bit_flags;
+	job_ptr->start_time = save_start_time;
+	details->pn_min_memory = rec->pn_min_memory;
+}
+
+/*
+ * Test the records of one shard in priority order. Once a job can not
+ * start, the nodes of its partition are removed from the shard-local node
+ * bitmap and jobs which can no longer get enough nodes are not tested,
+ * since the scheduling loop will likely skip them. The tests themselves
+ * use the nodes available when the batch was read, a superset of the nodes
+ * select_nodes() will offer.
+ */
+static void _shard_eval(sched_shard_walk_t *walk, int shard)
+{
+	bitstr_t *shard_avail = NULL;
+	shard_rec_t *rec;
+	int i;
+
+	for (i = walk->shard_first[shard]; i != -1; i = rec->next) {
+		rec = &walk->recs[i];
+		if (!shard_avail) {
+			shard_avail = bit_copy(shard_node_bitmap[shard]);
+			bit_and(shard_avail, avail_node_bitmap);
+		}
+		if (bit_overlap(shard_avail, rec->rec.part_ptr->node_bitmap) <
+		    rec->min_nodes)
+			continue;
+		_shard_rec_test(rec);
+		if (rec->busy) {
+			bit_and_not(shard_avail,
+				    rec->rec.part_ptr->node_bitmap);
+		}
+	}
+	FREE_NULL_BITMAP(shard_avail);
+}
+
+static void *_shard_agent(void *args)
+{
+	sched_shard_walk_t *walk;
+	int i;
+
+#if HAVE_SYS_PRCTL_H
+	if (prctl(PR_SET_NAME, "sched_shard", NULL, NULL, NULL) < 0) {
+		error("%s: cannot set my name to %s %m", __func__,
+		      "sched_shard");
+	}
+#endif
+	slurm_mutex_lock(&shard_mutex);
+	while (!shard_shutdown) {
+		if (!shard_batch || (shard_next >= shard_cnt)) {
+			slurm_cond_wait(&shard_work_cond, &shard_mutex);
+			continue;
+		}
+		walk = shard_batch;
+		i = shard_next++;
+		slurm_mutex_unlock(&shard_mutex);
+		_shard_eval(walk, i);
+		slurm_mutex_lock(&shard_mutex);
+		if (++shard_done == shard_cnt)
+			slurm_cond_broadcast(&shard_done_cond);
+	}
+	slurm_mutex_unlock(&shard_mutex);
+
+	return NULL;
+}
+
+/* Evaluate the shards of the current batch, the caller evaluates some too */
+static void _shard_run(sched_shard_walk_t *walk)
+{
+	int i;
+	DEF_TIMERS;
+
+	START_TIMER;
+	slurm_mutex_lock(&shard_mutex);
+	shard_batch = walk;
+	shard_next = 0;
+	shard_done = 0;
+	slurm_cond_broadcast(&shard_work_cond);
+	while (shard_next < shard_cnt) {
+		i = shard_next++;
+		slurm_mutex_unlock(&shard_mutex);
+		_shard_eval(walk, i);
+		slurm_mutex_lock(&shard_mutex);
+		shard_done++;
+	}
+	while (shard_done < shard_cnt)
+		slurm_cond_wait(&shard_done_cond, &shard_mutex);
+	shard_batch = NULL;
+	slurm_mutex_unlock(&shard_mutex);
+	END_TIMER;
+	walk->eval_usec += DELTA_TIMER;
+}
+
+static void _shard_recs_clear(sched_shard_walk_t *walk)
+{
+	int i;
+
+	for (i = 0; i < walk->rec_cnt; i++)
+		FREE_NULL_BITMAP(walk->recs[i].avail_in);
+	walk->rec_cnt = 0;
+	walk->rec_next = 0;
+}
+
+/* Read the next batch of records from the job queue and evaluate them */
+static void _shard_read(sched_shard_walk_t *walk, int batch_size)
+{
+	job_queue_rec_t *job_queue_rec;
+	shard_rec_t *rec;
+	int *shard_last, i, shard, prep_cnt = 0;
+
+	_shard_recs_clear(walk);
+	shard_last = xmalloc(sizeof(int) * shard_cnt);
+	for (i = 0; i < shard_cnt; i++) {
+		walk->shard_first[i] = -1;
+		shard_last[i] = -1;
+	}
+	while ((walk->rec_cnt < batch_size) &&
+	       (job_queue_rec = job_queue_iter_next(walk->iter))) {
+		if (walk->rec_cnt >= walk->rec_size) {
+			walk->rec_size = MAX(walk->rec_size * 2, 64);
+			xrealloc(walk->recs,
+				 sizeof(shard_rec_t) * walk->rec_size);
+		}
+		i = walk->rec_cnt++;
+		rec = &walk->recs[i];
+		memset(rec, 0, sizeof(shard_rec_t));
+		memcpy(&rec->rec, job_queue_rec, sizeof(job_queue_rec_t));
+		rec->next = -1;
+		if ((shard = _shard_rec_prep(rec)) == SHARD_NONE)
+			continue;
+		if (shard_last[shard] == -1)
+			walk->shard_first[shard] = i;
+		else
+			walk->recs[shard_last[shard]].next = i;
+		shard_last[shard] = i;
+		prep_cnt++;
+	}
+	xfree(shard_last);
+	if (!prep_cnt)
+		return;
+
+	_shard_run(walk);
+	for (i = 0; i < walk->rec_cnt; i++) {
+		if (walk->recs[i].tested)
+			walk->eval_cnt++;
+		if (walk->recs[i].busy)
+			walk->busy_cnt++;
+	}
+}
+
+extern void sched_shard_init(int thread_cnt)
+{
+	int i;
+
+	if (shard_thread_cnt == MAX(thread_cnt - 1, 0))
+		return;
+	if (shard_thread_cnt) {
+		slurm_mutex_lock(&shard_mutex);
+		shard_shutdown = true;
+		slurm_cond_broadcast(&shard_work_cond);
+		slurm_mutex_unlock(&shard_mutex);
+		for (i = 0; i < shard_thread_cnt; i++)
+			pthread_join(shard_tid[i], NULL);
+		xfree(shard_tid);
+		shard_thread_cnt = 0;
+		shard_shutdown = false;
+	}
+	if (thread_cnt <= 1)
+		return;
+
+	/* The scheduling thread itself evaluates shards too */
+	shard_thread_cnt = thread_cnt - 1;
+	shard_tid = xmalloc(sizeof(pthread_t) * shard_thread_cnt);
+	for (i = 0; i < shard_thread_cnt; i++)
+		slurm_thread_create(&shard_tid[i], _shard_agent, NULL);
+}
+
+extern void sched_shard_fini(void)
+{
+	sched_shard_init(0);
+	_shard_grouping_free();
+}
+
+extern sched_shard_walk_t *sched_shard_walk_create(job_queue_iter_t *iter)
+{
+	sched_shard_walk_t *walk;
+
+	if (!shard_thread_cnt || slurm_preemption_enabled())
+		return NULL;
+	_shard_grouping_build();
+	if (shard_cnt < 2)
+		return NULL;
+
+	walk = xmalloc(sizeof(sched_shard_walk_t));
+	walk->iter = iter;
+	walk->shard_first = xmalloc(sizeof(int) * shard_cnt);
+
+	return walk;
+}
+
+extern job_queue_rec_t *sched_shard_walk_next(sched_shard_walk_t *walk,
+					      int batch_size)
+{
+	if (walk->rec_next >= walk->rec_cnt)
+		_shard_read(walk, MAX(batch_size, 1));
+	if (walk->rec_next >= walk->rec_cnt) {
+		shard_cur_walk = NULL;
+		shard_cur = NULL;
+		return NULL;
+	}
+	shard_cur_walk = walk;
+	shard_cur = &walk->recs[walk->rec_next++];
+
+	return &shard_cur->rec;
+}
+
+extern void sched_shard_walk_destroy(sched_shard_walk_t *walk)
+{
+	if (!walk)
+		return;
+	if (walk->eval_cnt) {
+		debug("sched: tested %d jobs in %d partition shards in %u usec, "
+		      "%d could not start, %d results used",
+		      walk->eval_cnt, shard_cnt, walk->eval_usec,
+		      walk->busy_cnt, walk->used_cnt);
+	}
+	_shard_recs_clear(walk);
+	xfree(walk->recs);
+	xfree(walk->shard_first);
+	xfree(walk);
+	shard_cur_walk = NULL;
+	shard_cur = NULL;
+}
+
+extern bool sched_shard_job_busy(struct job_record *job_ptr,
+				 bitstr_t *node_bitmap, uint32_t min_nodes,
+				 uint32_t max_nodes, uint32_t req_nodes)
+{
+	shard_rec_t *rec = shard_cur;
+	struct job_details *details = job_ptr->details;
+
+	if (!rec || !rec->busy || (rec->rec.job_ptr != job_ptr) ||
+	    (rec->rec.part_ptr != job_ptr->part_ptr) ||
+	    details->req_node_bitmap ||
+	    (rec->min_nodes != min_nodes) || (rec->max_nodes != max_nodes) ||
+	    (rec->req_nodes != req_nodes) ||
+	    (rec->min_cpus != details->min_cpus) ||
+	    (rec->num_tasks != details->num_tasks) ||
+	    (rec->time_limit != job_ptr->time_limit) ||
+	    (rec->pn_min_memory != details->pn_min_memory) ||
+	    !bit_super_set(node_bitmap, rec->avail_in))
+		return false;
+
+	details->pn_min_memory = rec->pn_min_memory_out;
+	shard_cur_walk->used_cnt++;
+	return true;
+}
@@ -0,0 +1,90 @@
+/*****************************************************************************\
+ *  sched_shard.h - parallel evaluation of jobs in node-disjoint partitions
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+
+#ifndef _HAVE_SCHED_SHARD_H
+#define _HAVE_SCHED_SHARD_H
+
+#include "src/slurmctld/job_scheduler.h"
+#include "src/slurmctld/slurmctld.h"
+
+typedef struct sched_shard_walk sched_shard_walk_t;
+
+/*
+ * Start or resize the pool of threads used to evaluate jobs, thread_cnt
+ * includes the scheduling thread itself. Values below 2 stop the pool.
+ */
+extern void sched_shard_init(int thread_cnt);
+
+/* Stop the threads and free all memory, called at slurmctld shutdown */
+extern void sched_shard_fini(void);
+
+/*
+ * Start a parallel walk of the job queue. Partitions are grouped into
+ * shards, the smallest groups which share no nodes with each other.
+ * RET the walk or NULL if jobs must be evaluated sequentially, because
+ *     the thread pool is stopped, all partitions share nodes with each
+ *     other (there is a single shard) or job preemption is enabled
+ * NOTE: Caller must hold the job write lock until sched_shard_walk_destroy()
+ */
+extern sched_shard_walk_t *sched_shard_walk_create(job_queue_iter_t *iter);
+
+/*
+ * Return the next job/partition pair of the walk in the order of
+ * job_queue_iter_next(), or NULL at the end. When the records read ahead
+ * are exhausted, up to batch_size more are read and whether each can start
+ * now is evaluated by the threads in parallel, one shard per thread. Each
+ * thread tests its shard's jobs in priority order against a shard-local
+ * copy of the available nodes and, like _schedule(), stops testing jobs of
+ * a partition once one of them can not start.
+ */
+extern job_queue_rec_t *sched_shard_walk_next(sched_shard_walk_t *walk,
+					      int batch_size);
+
+extern void sched_shard_walk_destroy(sched_shard_walk_t *walk);
+
+/*
+ * Return true if the select plugin would fail to allocate node_bitmap to
+ * the job now, because the parallel evaluation of the record last returned
+ * by sched_shard_walk_next() found it could not start with a superset of
+ * those nodes and the same request. Allocations only increase while the job
+ * write lock is held, so such a result remains valid for the whole walk.
+ * Restores the job fields the select plugin would have changed.
+ */
+extern bool sched_shard_job_busy(struct job_record *job_ptr,
+				 bitstr_t *node_bitmap, uint32_t min_nodes,
+				 uint32_t max_nodes, uint32_t req_nodes);
+
+#endif /* !_HAVE_SCHED_SHARD_H */
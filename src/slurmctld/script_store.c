@@ -0,0 +1,1020 @@
+/*****************************************************************************\
+ *  script_store.c - deduplicated store of batch scripts and environments
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+/*
+ * The jobs of a job array or parameter sweep usually share their batch
+ * script and most often their environment too. Rather than writing both to
+ * a new directory of StateSaveLocation for every job, each distinct script
+ * or environment is stored once, optionally compressed, in the append-only
+ * segment files of StateSaveLocation/script_store. Data is keyed by a hash
+ * of its content and compared byte for byte before being shared. Should two
+ * different contents hash alike, the job falls back to its own directory.
+ *
+ * Job records hold the keys of their data (job_details.script_hash and
+ * env_hash) and the reference counts are rebuilt from them as the job state
+ * is recovered, so nothing but the data itself is ever written. Data no
+ * longer referenced by any job is dropped from the index, segment files
+ * left without data in use are unlinked and mostly unused ones are
+ * compacted by copying the data still in use to new segment files, which
+ * are synced to disk before the old file is unlinked. Compaction reads and
+ * writes the files without holding store_mutex, which is only taken to
+ * switch the index over to the new copies. Recently used data is also kept
+ * in memory (up to STORE_CACHE_MAX bytes), so that new jobs of a parameter
+ * sweep are compared with it rather than with the segment file.
+ *
+ * A segment file starts with the protocol version, followed by records of
+ * a header (magic, content hash, compression type, original and stored
+ * length) and the stored data. A record cut short by a crash ends the file.
+ */
+
+#include "config.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#if HAVE_LIBZ
+# include <zlib.h>
+#endif
+
+#if HAVE_LZ4
+# include <lz4.h>
+#endif
+
+#include "src/common/list.h"
+#include "src/common/log.h"
+#include "src/common/macros.h"
+#include "src/common/pack.h"
+#include "src/common/proc_args.h"
+#include "src/common/slurm_protocol_defs.h"
+#include "src/common/xhash.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
+
+#include "src/slurmctld/script_store.h"
+#include "src/slurmctld/slurmctld.h"
+#include "src/slurmctld/state_save.h"
+
+#define STORE_VERSION	"PROTOCOL_VERSION"
+#define STORE_MAGIC	0x53435354
+#define STORE_HDR_SIZE	22	/* packed size of a record header */
+#define STORE_SEG_MAX	(16 * 1024 * 1024)
+#define STORE_CACHE_MAX	(8 * 1024 * 1024)
+
+typedef struct {
+	uint32_t id;			/* file is "seg.<id>" */
+	uint32_t size;			/* bytes of complete records */
+	uint32_t live_bytes;		/* bytes of records in blob_hash */
+	uint32_t live_cnt;		/* count of records in blob_hash */
+	bool compact;			/* being compacted */
+} store_seg_t;
+
+typedef struct {
+	char key[17];			/* hash as hexadecimal string */
+	char *cache;			/* copy of the original data or NULL */
+	uint16_t compress;		/* compress_type of stored data */
+	uint64_t hash;
+	uint32_t offset;		/* of the stored data in seg */
+	uint32_t raw_len;		/* length of the original data */
+	uint32_t refcnt;		/* job records using the data */
+	store_seg_t *seg;
+	uint32_t stored_len;		/* length of the stored data */
+} store_blob_t;
+
+/* Serializes script_store_gc(), which alone changes blob->seg and ->offset */
+static pthread_mutex_t gc_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t store_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool store_enable = false;
+static uint16_t store_compress = COMPRESS_OFF;
+
+/* The following are protected by store_mutex */
+static bool store_loaded = false;
+static bool store_sweep = false;	/* look for unused data recovered */
+static char *store_dir = NULL;
+static xhash_t *blob_hash = NULL;	/* store_blob_t by key */
+static List seg_list = NULL;		/* store_seg_t sorted by id */
+static List unref_list = NULL;		/* keys of data without references */
+static store_seg_t *active_seg = NULL;	/* segment appended to */
+static int active_fd = -1;
+static uint32_t next_seg_id = 0;	/* id of the next segment created */
+static List cache_list = NULL;		/* store_blob_t cached, oldest first */
+static uint32_t cache_bytes = 0;
+
+/* FNV-1a hash */
+static uint64_t _hash_data(const char *data, uint32_t len)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	uint32_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= (uint8_t) data[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static const char *_blob_key(void *x)
+{
+	store_blob_t *blob = (store_blob_t *) x;
+
+	return blob->key;
+}
+
+static void _blob_free(void *x)
+{
+	store_blob_t *blob = (store_blob_t *) x;
+
+	xfree(blob->cache);
+	xfree(blob);
+}
+
+static void _seg_free(void *x)
+{
+	xfree(x);
+}
+
+static void _move_free(void *x)
+{
+	xfree(x);
+}
+
+static int _seg_cmp(void *x, void *y)
+{
+	store_seg_t *seg1 = *(store_seg_t **) x;
+	store_seg_t *seg2 = *(store_seg_t **) y;
+
+	if (seg1->id < seg2->id)
+		return -1;
+	if (seg1->id > seg2->id)
+		return 1;
+	return 0;
+}
+
+static int _find_ptr(void *x, void *key)
+{
+	return (x == key);
+}
+
+static char *_seg_path(store_seg_t *seg)
+{
+	return xstrdup_printf("%s/seg.%u", store_dir, seg->id);
+}
+
+static store_blob_t *_add_blob(store_seg_t *seg, uint64_t hash,
+			       uint16_t compress, uint32_t raw_len,
+			       uint32_t stored_len, uint32_t offset)
+{
+	store_blob_t *blob = xmalloc(sizeof(store_blob_t));
+
+	snprintf(blob->key, sizeof(blob->key), "%016"PRIx64, hash);
+	blob->compress = compress;
+	blob->hash = hash;
+	blob->offset = offset;
+	blob->raw_len = raw_len;
+	blob->seg = seg;
+	blob->stored_len = stored_len;
+	xhash_add(blob_hash, blob);
+	seg->live_bytes += STORE_HDR_SIZE + stored_len;
+	seg->live_cnt++;
+	return blob;
+}
+
+/* Keep a copy of the original data of a blob, evicting the oldest ones */
+static void _cache_blob(store_blob_t *blob, const char *data)
+{
+	store_blob_t *old;
+
+	if (blob->cache || (blob->raw_len > (STORE_CACHE_MAX / 16)))
+		return;
+	while (((cache_bytes + blob->raw_len) > STORE_CACHE_MAX) &&
+	       (old = list_pop(cache_list))) {
+		cache_bytes -= old->raw_len;
+		xfree(old->cache);
+	}
+	blob->cache = xmalloc_nz(blob->raw_len);
+	memcpy(blob->cache, data, blob->raw_len);
+	cache_bytes += blob->raw_len;
+	list_append(cache_list, blob);
+}
+
+/* Remove an unused blob from the index, its segment keeps the bytes */
+static void _drop_blob(store_blob_t *blob)
+{
+	if (blob->cache) {
+		list_delete_all(cache_list, _find_ptr, blob);
+		cache_bytes -= blob->raw_len;
+	}
+	blob->seg->live_bytes -= STORE_HDR_SIZE + blob->stored_len;
+	blob->seg->live_cnt--;
+	xhash_delete(blob_hash, blob->key);
+}
+
+/* Index the records of a segment file, truncating an incomplete last one */
+static void _load_seg(store_seg_t *seg, bool last)
+{
+	char *path = _seg_path(seg), *ver_str = NULL;
+	Buf buffer;
+	uint16_t compress, protocol_version = NO_VAL16;
+	uint32_t magic, offset = 0, raw_len, stored_len, ver_str_len;
+	uint64_t hash;
+	char key[17];
+
+	if (!(buffer = create_mmap_buf(path))) {
+		error("%s: Unable to read %s: %m", __func__, path);
+		xfree(path);
+		return;
+	}
+
+	safe_unpackstr_xmalloc(&ver_str, &ver_str_len, buffer);
+	if (ver_str && !xstrcmp(ver_str, STORE_VERSION))
+		safe_unpack16(&protocol_version, buffer);
+	if ((protocol_version == NO_VAL16) ||
+	    (protocol_version < SLURM_MIN_PROTOCOL_VERSION)) {
+		error("%s: Incompatible data in %s", __func__, path);
+		goto unpack_error;
+	}
+	offset = get_buf_offset(buffer);
+
+	while (remaining_buf(buffer) >= STORE_HDR_SIZE) {
+		safe_unpack32(&magic, buffer);
+		safe_unpack64(&hash, buffer);
+		safe_unpack16(&compress, buffer);
+		safe_unpack32(&raw_len, buffer);
+		safe_unpack32(&stored_len, buffer);
+		if ((magic != STORE_MAGIC) ||
+		    (stored_len > remaining_buf(buffer)))
+			break;
+		snprintf(key, sizeof(key), "%016"PRIx64, hash);
+		/* A second copy is left by an interrupted compaction */
+		if (!xhash_get(blob_hash, key)) {
+			(void) _add_blob(seg, hash, compress, raw_len,
+					 stored_len, get_buf_offset(buffer));
+		}
+		set_buf_offset(buffer, get_buf_offset(buffer) + stored_len);
+		offset = get_buf_offset(buffer);
+	}
+
+unpack_error:
+	seg->size = offset;
+	if (offset < size_buf(buffer)) {
+		error("%s: Ignoring incomplete data at offset %u of %s",
+		      __func__, offset, path);
+		if (last && truncate(path, offset))
+			error("%s: truncate(%s): %m", __func__, path);
+	}
+	xfree(ver_str);
+	free_buf(buffer);
+	xfree(path);
+}
+
+/* Read the index of the store from its segment files on first use */
+static void _load_store(void)
+{
+	DIR *dir;
+	struct dirent *dir_ent;
+	store_seg_t *seg;
+	ListIterator seg_iter;
+	char *endptr;
+	unsigned long id;
+	DEF_TIMERS;
+
+	if (store_loaded)
+		return;
+	store_loaded = true;
+	store_sweep = true;
+
+	START_TIMER;
+	store_dir = xstrdup_printf("%s/script_store",
+				   slurmctld_conf.state_save_location);
+	blob_hash = xhash_init(_blob_key, _blob_free);
+	seg_list = list_create(_seg_free);
+	unref_list = list_create(slurm_destroy_char);
+	cache_list = list_create(NULL);
+
+	if (!(dir = opendir(store_dir))) {
+		if (errno != ENOENT)
+			error("%s: opendir(%s): %m", __func__, store_dir);
+		return;
+	}
+	while ((dir_ent = readdir(dir))) {
+		if (xstrncmp(dir_ent->d_name, "seg.", 4))
+			continue;
+		id = strtoul(dir_ent->d_name + 4, &endptr, 10);
+		if ((endptr == dir_ent->d_name + 4) || (endptr[0] != '\0') ||
+		    (id > UINT32_MAX))
+			continue;
+		seg = xmalloc(sizeof(store_seg_t));
+		seg->id = id;
+		list_append(seg_list, seg);
+	}
+	closedir(dir);
+	list_sort(seg_list, _seg_cmp);
+
+	seg_iter = list_iterator_create(seg_list);
+	while ((seg = list_next(seg_iter))) {
+		_load_seg(seg, (list_peek_next(seg_iter) == NULL));
+		active_seg = seg;
+		next_seg_id = seg->id + 1;
+	}
+	list_iterator_destroy(seg_iter);
+	END_TIMER2("script_store_load");
+	debug("%s: %u stored scripts and environments in %d files %s",
+	      __func__, xhash_count(blob_hash), list_count(seg_list),
+	      TIME_STR);
+}
+
+/*
+ * Write the header of a new segment file
+ * RET SLURM_SUCCESS or SLURM_ERROR, with the file truncated
+ */
+static int _write_seg_header(int fd, store_seg_t *seg)
+{
+	Buf buffer = init_buf(BUF_SIZE);
+
+	packstr(STORE_VERSION, buffer);
+	pack16(SLURM_PROTOCOL_VERSION, buffer);
+	safe_write(fd, get_buf_data(buffer), get_buf_offset(buffer));
+	seg->size = get_buf_offset(buffer);
+	free_buf(buffer);
+	return SLURM_SUCCESS;
+
+rwfail:
+	error("%s: Error writing segment %u: %m", __func__, seg->id);
+	free_buf(buffer);
+	(void) ftruncate(fd, 0);
+	return SLURM_ERROR;
+}
+
+/* Open the segment file to append to, starting a new one when it is full */
+static int _open_active(uint32_t rec_size)
+{
+	char *path;
+
+	if (active_seg && (active_seg->size > STORE_HDR_SIZE) &&
+	    ((active_seg->size + rec_size) > STORE_SEG_MAX)) {
+		active_seg = NULL;
+		if (active_fd >= 0) {
+			(void) close(active_fd);
+			active_fd = -1;
+		}
+	}
+	if (!active_seg) {
+		active_seg = xmalloc(sizeof(store_seg_t));
+		active_seg->id = next_seg_id++;
+		list_append(seg_list, active_seg);
+	}
+	if (active_fd >= 0)
+		return SLURM_SUCCESS;
+
+	(void) mkdir(store_dir, 0700);
+	path = _seg_path(active_seg);
+	active_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+			 0600);
+	if (active_fd < 0) {
+		error("%s: open(%s): %m", __func__, path);
+		xfree(path);
+		return SLURM_ERROR;
+	}
+	xfree(path);
+
+	if ((active_seg->size == 0) &&
+	    (_write_seg_header(active_fd, active_seg) != SLURM_SUCCESS)) {
+		(void) close(active_fd);
+		active_fd = -1;
+		return SLURM_ERROR;
+	}
+	return SLURM_SUCCESS;
+}
+
+/*
+ * Write a record at the end of a segment file
+ * OUT offset - offset of the stored data in the segment
+ * RET SLURM_SUCCESS or SLURM_ERROR, in which case nothing must be appended
+ *	to the file if seg->size was set to STORE_SEG_MAX
+ */
+static int _write_rec(int fd, store_seg_t *seg, uint64_t hash,
+		      uint16_t compress, uint32_t raw_len, const char *stored,
+		      uint32_t stored_len, uint32_t *offset)
+{
+	uint32_t rec_size = STORE_HDR_SIZE + stored_len;
+	Buf buffer;
+
+	buffer = init_buf(rec_size);
+	pack32(STORE_MAGIC, buffer);
+	pack64(hash, buffer);
+	pack16(compress, buffer);
+	pack32(raw_len, buffer);
+	pack32(stored_len, buffer);
+	memcpy(get_buf_data(buffer) + STORE_HDR_SIZE, stored, stored_len);
+	set_buf_offset(buffer, rec_size);
+	safe_write(fd, get_buf_data(buffer), rec_size);
+	free_buf(buffer);
+
+	*offset = seg->size + STORE_HDR_SIZE;
+	seg->size += rec_size;
+	return SLURM_SUCCESS;
+
+rwfail:
+	error("%s: Error writing segment %u: %m", __func__, seg->id);
+	free_buf(buffer);
+	if (ftruncate(fd, seg->size)) {
+		/* Do not append after a partial record */
+		seg->size = STORE_SEG_MAX;
+	}
+	return SLURM_ERROR;
+}
+
+/*
+ * Append a record to the active segment file
+ * OUT offset - offset of the stored data in the segment
+ * RET segment written to or NULL on error
+ */
+static store_seg_t *_append_rec(uint64_t hash, uint16_t compress,
+				uint32_t raw_len, const char *stored,
+				uint32_t stored_len, uint32_t *offset)
+{
+	if (_open_active(STORE_HDR_SIZE + stored_len) != SLURM_SUCCESS)
+		return NULL;
+
+	if (_write_rec(active_fd, active_seg, hash, compress, raw_len, stored,
+		       stored_len, offset) != SLURM_SUCCESS) {
+		if (active_seg->size == STORE_SEG_MAX) {
+			(void) close(active_fd);
+			active_fd = -1;
+		}
+		return NULL;
+	}
+	return active_seg;
+}
+
+/*
+ * Return a compressed copy of data, or NULL if compression is disabled or
+ * does not make the data any shorter
+ */
+static char *_compress_data(uint16_t compress, const char *data,
+			    uint32_t len, uint32_t *stored_len)
+{
+	char *stored = NULL;
+
+#if HAVE_LIBZ
+	if (compress == COMPRESS_ZLIB) {
+		uLongf out_len = compressBound(len);
+
+		stored = xmalloc(out_len);
+		if ((compress2((Bytef *) stored, &out_len, (const Bytef *) data,
+			       len, Z_DEFAULT_COMPRESSION) == Z_OK) &&
+		    (out_len < len)) {
+			*stored_len = out_len;
+			return stored;
+		}
+		xfree(stored);
+	}
+#endif
+#if HAVE_LZ4
+	if (compress == COMPRESS_LZ4) {
+		int out_len, max_len = LZ4_compressBound(len);
+
+		stored = xmalloc(max_len);
+		out_len = LZ4_compress_default(data, stored, len, max_len);
+		if ((out_len > 0) && (out_len < len)) {
+			*stored_len = out_len;
+			return stored;
+		}
+		xfree(stored);
+	}
+#endif
+	return stored;
+}
+
+/* Read the data of a record as stored, RET xmalloc()ed data or NULL */
+static char *_read_stored(store_blob_t *blob)
+{
+	char *path = _seg_path(blob->seg), *stored;
+	uint32_t pos = 0;
+	ssize_t amount;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+		error("%s: open(%s): %m", __func__, path);
+		xfree(path);
+		return NULL;
+	}
+
+	stored = xmalloc(blob->stored_len + 1);
+	while (pos < blob->stored_len) {
+		amount = pread(fd, stored + pos, blob->stored_len - pos,
+			       blob->offset + pos);
+		if ((amount < 0) && (errno == EINTR))
+			continue;
+		if (amount <= 0) {
+			error("%s: Error reading %s: %m", __func__, path);
+			xfree(stored);
+			break;
+		}
+		pos += amount;
+	}
+	(void) close(fd);
+	xfree(path);
+	return stored;
+}
+
+/* Read and uncompress the data of a record, RET xmalloc()ed data or NULL */
+static char *_read_blob(store_blob_t *blob)
+{
+	char *stored, *data;
+
+	if (!(stored = _read_stored(blob)))
+		return NULL;
+	if (blob->compress == COMPRESS_OFF)
+		return stored;
+
+	data = xmalloc(blob->raw_len + 1);
+#if HAVE_LIBZ
+	if (blob->compress == COMPRESS_ZLIB) {
+		uLongf out_len = blob->raw_len;
+
+		if ((uncompress((Bytef *) data, &out_len, (Bytef *) stored,
+				blob->stored_len) == Z_OK) &&
+		    (out_len == blob->raw_len)) {
+			xfree(stored);
+			return data;
+		}
+	}
+#endif
+#if HAVE_LZ4
+	if (blob->compress == COMPRESS_LZ4) {
+		if (LZ4_decompress_safe(stored, data, blob->stored_len,
+					blob->raw_len) == blob->raw_len) {
+			xfree(stored);
+			return data;
+		}
+	}
+#endif
+	error("%s: Unable to uncompress %s (compress type %u)",
+	      __func__, blob->key, blob->compress);
+	xfree(stored);
+	xfree(data);
+	return NULL;
+}
+
+/* A record copied out of a segment file being compacted */
+typedef struct {
+	store_blob_t *blob;
+	store_seg_t *new_seg;		/* NULL if not copied */
+	uint32_t new_offset;
+} store_move_t;
+
+static void _find_seg_blobs(void *x, void *arg)
+{
+	store_blob_t *blob = (store_blob_t *) x;
+	List move_list = (List) arg;
+	store_move_t *move;
+
+	if (!blob->seg->compact)
+		return;
+	move = xmalloc(sizeof(store_move_t));
+	move->blob = blob;
+	list_append(move_list, move);
+}
+
+static void _find_unused_blobs(void *x, void *arg)
+{
+	store_blob_t *blob = (store_blob_t *) x;
+
+	if (!blob->refcnt)
+		list_append(unref_list, xstrdup(blob->key));
+}
+
+/* Make the creation and removal of segment files durable */
+static void _sync_dir(void)
+{
+	int fd;
+
+	if ((fd = open(store_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) {
+		error("%s: open(%s): %m", __func__, store_dir);
+		return;
+	}
+	if (fsync(fd))
+		error("%s: fsync(%s): %m", __func__, store_dir);
+	(void) close(fd);
+}
+
+/*
+ * Start a segment file receiving compacted data, which is not appended to
+ * by script_store_add()
+ * OUT fd - the open file
+ * RET the segment, not yet in seg_list, or NULL on error
+ */
+static store_seg_t *_create_seg(int *fd)
+{
+	store_seg_t *seg = xmalloc(sizeof(store_seg_t));
+	char *path;
+
+	slurm_mutex_lock(&store_mutex);
+	seg->id = next_seg_id++;
+	slurm_mutex_unlock(&store_mutex);
+
+	path = _seg_path(seg);
+	*fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	if (*fd < 0) {
+		error("%s: open(%s): %m", __func__, path);
+	} else if (_write_seg_header(*fd, seg) != SLURM_SUCCESS) {
+		(void) close(*fd);
+		(void) unlink(path);
+		*fd = -1;
+	}
+	xfree(path);
+	if (*fd < 0)
+		xfree(seg);
+	return seg;
+}
+
+/*
+ * Sync a segment file written by _copy_blobs() to disk and close it. If that
+ * fails, the copies it holds are not used.
+ */
+static int _close_seg(int fd, store_seg_t *seg, List move_list)
+{
+	ListIterator move_iter;
+	store_move_t *move;
+
+	if (fsync_and_close(fd, "script store") == SLURM_SUCCESS)
+		return SLURM_SUCCESS;
+
+	move_iter = list_iterator_create(move_list);
+	while ((move = list_next(move_iter))) {
+		if (move->new_seg == seg)
+			move->new_seg = NULL;
+	}
+	list_iterator_destroy(move_iter);
+	return SLURM_ERROR;
+}
+
+/*
+ * Copy the records of move_list to new segment files and sync them to disk.
+ * Called without store_mutex, the blobs are neither moved nor freed by
+ * anything but script_store_gc().
+ * IN/OUT move_list - store_move_t, new_seg and new_offset are set for the
+ *	records copied
+ * IN/OUT new_segs - segments created
+ */
+static void _copy_blobs(List move_list, List new_segs)
+{
+	ListIterator move_iter;
+	store_move_t *move;
+	store_blob_t *blob;
+	store_seg_t *seg = NULL;
+	int fd = -1;
+	char *stored;
+	bool done = false;
+
+	move_iter = list_iterator_create(move_list);
+	while (!done && (move = list_next(move_iter))) {
+		blob = move->blob;
+		if (!(stored = _read_stored(blob)))
+			continue;
+		if (seg && ((seg->size + STORE_HDR_SIZE + blob->stored_len) >
+			    STORE_SEG_MAX)) {
+			done = (_close_seg(fd, seg, move_list) !=
+				SLURM_SUCCESS);
+			seg = NULL;
+			if (done) {
+				xfree(stored);
+				break;
+			}
+		}
+		if (!seg) {
+			if (!(seg = _create_seg(&fd))) {
+				xfree(stored);
+				break;
+			}
+			list_append(new_segs, seg);
+		}
+		if (_write_rec(fd, seg, blob->hash, blob->compress,
+			       blob->raw_len, stored, blob->stored_len,
+			       &move->new_offset) == SLURM_SUCCESS)
+			move->new_seg = seg;
+		else
+			done = true;
+		xfree(stored);
+	}
+	list_iterator_destroy(move_iter);
+
+	if (seg)
+		(void) _close_seg(fd, seg, move_list);
+	if (list_count(new_segs))
+		_sync_dir();
+}
+
+/*
+ * Switch the index over to the copies made by _copy_blobs()
+ * NOTE: Caller must hold store_mutex
+ */
+static void _move_blobs(List move_list, List new_segs)
+{
+	ListIterator move_iter;
+	store_move_t *move;
+	store_blob_t *blob;
+	store_seg_t *seg;
+
+	while ((seg = list_pop(new_segs)))
+		list_append(seg_list, seg);
+	list_sort(seg_list, _seg_cmp);
+
+	move_iter = list_iterator_create(move_list);
+	while ((move = list_next(move_iter))) {
+		if (!move->new_seg)
+			continue;
+		blob = move->blob;
+		blob->seg->live_bytes -= STORE_HDR_SIZE + blob->stored_len;
+		blob->seg->live_cnt--;
+		move->new_seg->live_bytes += STORE_HDR_SIZE + blob->stored_len;
+		move->new_seg->live_cnt++;
+		blob->seg = move->new_seg;
+		blob->offset = move->new_offset;
+	}
+	list_iterator_destroy(move_iter);
+}
+
+extern void script_store_config(void)
+{
+	char *tmp_ptr, *end_ptr, *type = NULL;
+
+	store_enable = false;
+	if (!(tmp_ptr = xstrcasestr(slurmctld_conf.slurmctld_params,
+				    "script_store")))
+		return;
+	store_enable = true;
+	if (tmp_ptr[12] == '=') {
+		type = xstrdup(tmp_ptr + 13);
+		if ((end_ptr = strchr(type, ',')))
+			end_ptr[0] = '\0';
+	}
+	store_compress = parse_compress_type(type);
+#if !HAVE_LIBZ
+	if (store_compress == COMPRESS_ZLIB) {
+		error("SlurmctldParameters script_store=%s: zlib not available",
+		      type);
+		store_compress = COMPRESS_OFF;
+	}
+#endif
+#if !HAVE_LZ4
+	if (store_compress == COMPRESS_LZ4) {
+		error("SlurmctldParameters script_store=%s: lz4 not available",
+		      type);
+		store_compress = parse_compress_type(NULL);
+	}
+#endif
+	xfree(type);
+}
+
+extern bool script_store_enabled(void)
+{
+	return store_enable;
+}
+
+extern char *script_store_add(const char *data, uint32_t len)
+{
+	store_blob_t *blob;
+	store_seg_t *seg;
+	uint64_t hash = _hash_data(data, len);
+	uint32_t offset, stored_len = len;
+	char key[17], *stored, *key_ptr = NULL;
+
+	snprintf(key, sizeof(key), "%016"PRIx64, hash);
+
+	slurm_mutex_lock(&store_mutex);
+	_load_store();
+	if ((blob = xhash_get(blob_hash, key))) {
+		/* The segment file is only read if the data is not cached */
+		if ((blob->raw_len == len) && !blob->cache &&
+		    (stored = _read_blob(blob))) {
+			_cache_blob(blob, stored);
+			xfree(stored);
+		}
+		if ((blob->raw_len == len) && blob->cache &&
+		    !memcmp(blob->cache, data, len)) {
+			blob->refcnt++;
+			key_ptr = xstrdup(key);
+		} else {
+			debug("%s: data differs from that stored as %s",
+			      __func__, key);
+		}
+		slurm_mutex_unlock(&store_mutex);
+		return key_ptr;
+	}
+
+	stored = _compress_data(store_compress, data, len, &stored_len);
+	seg = _append_rec(hash, stored ? store_compress : COMPRESS_OFF, len,
+			  stored ? stored : data, stored_len, &offset);
+	if (seg) {
+		blob = _add_blob(seg, hash,
+				 stored ? store_compress : COMPRESS_OFF,
+				 len, stored_len, offset);
+		blob->refcnt = 1;
+		_cache_blob(blob, data);
+		key_ptr = xstrdup(key);
+	}
+	slurm_mutex_unlock(&store_mutex);
+	xfree(stored);
+
+	return key_ptr;
+}
+
+extern bool script_store_ref(const char *key)
+{
+	store_blob_t *blob;
+
+	slurm_mutex_lock(&store_mutex);
+	_load_store();
+	if ((blob = xhash_get(blob_hash, key)))
+		blob->refcnt++;
+	slurm_mutex_unlock(&store_mutex);
+
+	return (blob != NULL);
+}
+
+extern void script_store_unref(const char *key)
+{
+	store_blob_t *blob;
+
+	if (!key)
+		return;
+
+	slurm_mutex_lock(&store_mutex);
+	if (store_loaded && (blob = xhash_get(blob_hash, key)) &&
+	    blob->refcnt && (--blob->refcnt == 0))
+		list_append(unref_list, xstrdup(key));
+	slurm_mutex_unlock(&store_mutex);
+}
+
+extern char *script_store_get(const char *key, uint32_t *len)
+{
+	store_blob_t *blob;
+	char *data = NULL;
+
+	slurm_mutex_lock(&store_mutex);
+	_load_store();
+	if (!(blob = xhash_get(blob_hash, key))) {
+		;
+	} else if (blob->cache) {
+		data = xmalloc_nz(blob->raw_len + 1);
+		memcpy(data, blob->cache, blob->raw_len);
+		data[blob->raw_len] = '\0';
+		*len = blob->raw_len;
+	} else if ((data = _read_blob(blob))) {
+		_cache_blob(blob, data);
+		*len = blob->raw_len;
+	}
+	slurm_mutex_unlock(&store_mutex);
+
+	return data;
+}
+
+extern void script_store_gc(void)
+{
+	ListIterator seg_iter;
+	List move_list, new_segs, rm_list;
+	store_blob_t *blob;
+	store_seg_t *seg;
+	char *key, *path;
+	int drop_cnt = 0, move_cnt = 0;
+	bool removed = false;
+
+	slurm_mutex_lock(&gc_mutex);
+	slurm_mutex_lock(&store_mutex);
+	if (!store_loaded) {
+		slurm_mutex_unlock(&store_mutex);
+		slurm_mutex_unlock(&gc_mutex);
+		return;
+	}
+
+	if (store_sweep) {
+		xhash_walk(blob_hash, _find_unused_blobs, NULL);
+		store_sweep = false;
+	}
+	while ((key = list_pop(unref_list))) {
+		if ((blob = xhash_get(blob_hash, key)) && !blob->refcnt) {
+			_drop_blob(blob);
+			drop_cnt++;
+		}
+		xfree(key);
+	}
+
+	seg_iter = list_iterator_create(seg_list);
+	while ((seg = list_next(seg_iter))) {
+		seg->compact = ((seg != active_seg) && seg->live_cnt &&
+				(seg->live_bytes < (seg->size / 2)));
+		if (seg->compact)
+			move_cnt++;
+	}
+	list_iterator_destroy(seg_iter);
+	move_list = list_create(_move_free);
+	if (move_cnt)
+		xhash_walk(blob_hash, _find_seg_blobs, move_list);
+	slurm_mutex_unlock(&store_mutex);
+
+	/* Copy the data still in use without blocking script_store_add() */
+	new_segs = list_create(NULL);
+	if (list_count(move_list)) {
+		debug2("%s: moving %d records out of %d segments",
+		       __func__, list_count(move_list), move_cnt);
+		_copy_blobs(move_list, new_segs);
+	}
+
+	rm_list = list_create(slurm_destroy_char);
+	slurm_mutex_lock(&store_mutex);
+	_move_blobs(move_list, new_segs);
+	seg_iter = list_iterator_create(seg_list);
+	while ((seg = list_next(seg_iter))) {
+		seg->compact = false;
+		if ((seg == active_seg) || seg->live_cnt)
+			continue;
+		list_append(rm_list, _seg_path(seg));
+		list_delete_item(seg_iter);
+	}
+	list_iterator_destroy(seg_iter);
+	if (drop_cnt) {
+		debug("%s: %d scripts and environments removed, %u remain",
+		      __func__, drop_cnt, xhash_count(blob_hash));
+	}
+	slurm_mutex_unlock(&store_mutex);
+
+	/* Nothing refers to these files any more */
+	while ((path = list_pop(rm_list))) {
+		debug2("%s: removing %s", __func__, path);
+		if (unlink(path) && (errno != ENOENT))
+			error("%s: unlink(%s): %m", __func__, path);
+		else
+			removed = true;
+		xfree(path);
+	}
+	if (removed)
+		_sync_dir();
+
+	FREE_NULL_LIST(rm_list);
+	FREE_NULL_LIST(new_segs);
+	FREE_NULL_LIST(move_list);
+	slurm_mutex_unlock(&gc_mutex);
+}
+
+extern void script_store_fini(void)
+{
+	slurm_mutex_lock(&gc_mutex);
+	slurm_mutex_lock(&store_mutex);
+	if (active_fd >= 0) {
+		(void) close(active_fd);
+		active_fd = -1;
+	}
+	active_seg = NULL;
+	next_seg_id = 0;
+	FREE_NULL_LIST(cache_list);
+	cache_bytes = 0;
+	xhash_free(blob_hash);
+	FREE_NULL_LIST(seg_list);
+	FREE_NULL_LIST(unref_list);
+	xfree(store_dir);
+	store_loaded = false;
+	store_sweep = false;
+	slurm_mutex_unlock(&store_mutex);
+	slurm_mutex_unlock(&gc_mutex);
+}
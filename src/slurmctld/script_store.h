@@ -0,0 +1,89 @@
+/*****************************************************************************\
+ *  script_store.h - deduplicated store of batch scripts and environments
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#ifndef _HAVE_SCRIPT_STORE_H
+#define _HAVE_SCRIPT_STORE_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+/*
+ * Read the script_store option of SlurmctldParameters
+ * NOTE: Caller must hold the config lock
+ */
+extern void script_store_config(void);
+
+/* Return true if new batch scripts and environments are to be stored */
+extern bool script_store_enabled(void);
+
+/*
+ * Store data, or add a reference to identical data already stored
+ * IN data - data to store
+ * IN len - length of data in bytes
+ * RET key of the data, must be xfreed, or NULL on error
+ */
+extern char *script_store_add(const char *data, uint32_t len);
+
+/*
+ * Add a reference to stored data, e.g. from a recovered or copied job record
+ * RET false if no data is stored with this key
+ */
+extern bool script_store_ref(const char *key);
+
+/*
+ * Remove a reference to stored data. Data no longer referenced is removed
+ * by the next script_store_gc().
+ */
+extern void script_store_unref(const char *key);
+
+/*
+ * Return a copy of stored data
+ * IN key - as returned by script_store_add()
+ * OUT len - length of the data in bytes
+ * RET xmalloc()ed data with a NUL appended, or NULL on error
+ */
+extern char *script_store_get(const char *key, uint32_t *len);
+
+/*
+ * Remove data no longer referenced, unlink segment files left empty and
+ * compact mostly empty ones. Call only after all job records referencing
+ * stored data have been recovered.
+ */
+extern void script_store_gc(void);
+
+/* Free all memory, the store is read again on its next use */
+extern void script_store_fini(void);
+
+#endif /* !_HAVE_SCRIPT_STORE_H */
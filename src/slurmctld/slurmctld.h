@@ -191,10 +191,36 @@ typedef struct diag_stats {
 	uint32_t bf_queue_len_sum;
 	time_t   bf_when_last_cycle;
 	uint32_t bf_active;
+	uint32_t bf_parallel;		/* backfill candidates tested at once */
+	uint32_t bf_last_spec_cnt;	/* candidates tested in parallel */
+	uint32_t bf_last_spec_used;	/* parallel test results used */
+	uint64_t bf_last_spec_time;	/* usec spent in parallel tests */
+	uint64_t bf_last_spec_wall;	/* usec waiting for parallel tests */
+	uint32_t bf_plan_jobs;		/* jobs kept from earlier cycles */
+	time_t   bf_plan_time;		/* incremental plan creation time */
 
 	uint32_t latency;
+
+	uint32_t rpc_workers;		/* RPC engine worker threads */
+	uint32_t rpc_queue_len;		/* RPCs waiting for a worker */
+	uint32_t rpc_queue_len_max;
+	uint32_t rpc_queue_cnt;		/* RPCs dequeued by workers */
+	uint64_t rpc_queue_wait_sum;	/* usec spent waiting for a worker */
+	uint32_t rpc_queue_wait_max;
 } diag_stats_t;
 
+/*
+ * Latency histogram with 8 buckets per power of two microseconds, giving
+ * percentiles within 12.5% of the actual values, see latency_hist_add()
+ */
+#define LATENCY_SUB_BITS	3
+#define LATENCY_BUCKETS		((32 - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS)
+typedef struct {
+	uint32_t cnt;
+	uint32_t max;		/* usec */
+	uint32_t bucket[LATENCY_BUCKETS];
+} latency_hist_t;
+
 /* This is used to point out constants that exist in the
  * curr_tres_array in tres_info_t  This should be the same order as
  * the tres_types_t enum that is defined in src/common/slurmdb_defs.h
@@ -507,8 +533,13 @@ struct job_details {
 					 * each task */
 	List depend_list;		/* list of job_ptr:state pairs */
 	char *dependency;		/* wait for other jobs */
+	time_t depend_test_time;	/* when dependencies were last found
+					 * to remain, zero to test them again,
+					 * see depend_index.c */
 	char *orig_dependency;		/* original value (for archiving) */
 	uint16_t env_cnt;		/* size of env_sup (see below) */
+	char *env_hash;			/* script store key of the batch
+					 * environment, see script_store.h */
 	char **env_sup;			/* supplemental environment variables */
 	bitstr_t *exc_node_bitmap;	/* bitmap of excluded nodes */
 	char *exc_nodes;		/* excluded nodes */
@@ -552,6 +583,8 @@ struct job_details {
 	uint16_t requeue;		/* controls ability requeue job */
 	char *restart_dir;		/* restart execution from ckpt images
 					 * in this dir */
+	char *script_hash;		/* script store key of the batch
+					 * script, see script_store.h */
 	uint8_t share_res;		/* set if job can share resources with
 					 * other jobs */
 	char *std_err;			/* pathname of job's stderr file */
@@ -766,6 +799,8 @@ struct job_record {
 					 * this job, confirm the
 					 * value before use */
 	void *qos_blocking_ptr;		/* internal use only, DON'T PACK */
+	struct job_queue_node *queue_node; /* entries in the pending job
+					 * queue, see job_queue.c, DON'T PACK */
 	uint8_t reboot;			/* node reboot requested before start */
 	uint16_t restart_cnt;		/* count of restarts */
 	time_t resize_time;		/* time of latest size change */
@@ -803,6 +838,11 @@ struct job_record {
 	uint32_t time_min;		/* minimum time_limit minutes or
 					 * INFINITE,
 					 * zero implies same as time_limit */
+	uint32_t timer_inx;		/* position in the time limit heap,
+					 * zero if not present, see
+					 * job_timer.c, DON'T PACK */
+	time_t timer_time;		/* when job_time_limit() next needs
+					 * to test the job, see job_timer.c */
 	time_t tot_sus_time;		/* total time in suspend state */
 	uint32_t total_cpus;		/* number of allocated cpus,
 					 * for accounting */
@@ -1898,6 +1938,7 @@ extern int num_pending_job_array_tasks(uint32_t array_job_id);
  * IN show_flags - job filtering options
  * IN uid - uid of user making request (for partition filtering)
  * IN filter_uid - pack only jobs belonging to this user if not NO_VAL
+ * IN filter - pack only jobs matching this filter if not NULL
  * IN protocol_version - slurm protocol version of client
  * global: job_list - global list of job records
  * NOTE: the buffer at *buffer_ptr must be xfreed by the caller
@@ -1906,7 +1947,7 @@ extern int num_pending_job_array_tasks(uint32_t array_job_id);
  */
 extern void pack_all_jobs(char **buffer_ptr, int *buffer_size,
 			  uint16_t show_flags, uid_t uid, uint32_t filter_uid,
-			  uint16_t protocol_version);
+			  info_filter_t *filter, uint16_t protocol_version);
 
 /*
  * pack_spec_jobs - dump job information for specified jobs in
@@ -1933,6 +1974,7 @@ extern void pack_spec_jobs(char **buffer_ptr, int *buffer_size, List job_ids,
  * OUT buffer_size - set to size of the buffer in bytes
  * IN show_flags - node filtering options
  * IN uid - uid of user making request (for partition filtering)
+ * IN filter - pack only nodes matching this filter if not NULL
  * IN protocol_version - slurm protocol version of client
  * global: node_record_table_ptr - pointer to global node table
  * NOTE: the caller must xfree the buffer at *buffer_ptr
@@ -1941,12 +1983,24 @@ extern void pack_spec_jobs(char **buffer_ptr, int *buffer_size, List job_ids,
  */
 extern void pack_all_node (char **buffer_ptr, int *buffer_size,
 			   uint16_t show_flags, uid_t uid,
-			   uint16_t protocol_version);
+			   info_filter_t *filter, uint16_t protocol_version);
+
+/* Record a latency in microseconds in a histogram */
+extern void latency_hist_add(latency_hist_t *hist, uint64_t usec);
+
+/*
+ * Return the latency in microseconds under which pct percent of those in
+ * the histogram are, or 0 if it is empty
+ */
+extern uint32_t latency_hist_percentile(latency_hist_t *hist, uint32_t pct);
 
 /* Pack all scheduling statistics */
 extern void pack_all_stat(int resp, char **buffer_ptr, int *buffer_size,
 			  uint16_t protocol_version);
 
+/* Pack the per minute statistics history, oldest first */
+extern void pack_stats_history(Buf buffer, uint16_t protocol_version);
+
 /*
  * pack_ctld_job_step_info_response_msg - packs job step info
  * IN job_id - specific id or NO_VAL for all
@@ -1992,6 +2046,21 @@ extern void pack_all_part(char **buffer_ptr, int *buffer_size,
 extern void pack_job (struct job_record *dump_job_ptr, uint16_t show_flags,
 		      Buf buffer, uint16_t protocol_version, uid_t uid);
 
+/*
+ * pack_job_info_trailer - complete a RESPONSE_JOB_INFO message body after
+ *	the job records with the incremental update information
+ * IN/OUT buffer - buffer in which data is placed
+ * IN delta_cursor - cursor for the client's next request, 0 if none
+ * IN delta - set if the records are only those changed since the cursor
+ *	of the request
+ * IN purged_job_ids - jobs the client must remove if delta is set
+ * IN purged_cnt - number of purged_job_ids
+ */
+extern void pack_job_info_trailer(Buf buffer, uint64_t delta_cursor,
+				  bool delta, uint32_t *purged_job_ids,
+				  uint32_t purged_cnt,
+				  uint16_t protocol_version);
+
 /*
  * pack_part - dump all configuration information about a specific partition
  *	in machine independent form (for network transmission)
@@ -2043,6 +2112,13 @@ extern void pack_one_node (char **buffer_ptr, int *buffer_size,
 /* part_is_visible - should user be able to see this partition */
 extern bool part_is_visible(struct part_record *part_ptr, uid_t uid);
 
+/* part_is_public - is this partition visible to every user (not hidden and
+ *	not restricted by AllowGroups) */
+extern bool part_is_public(struct part_record *part_ptr);
+
+/* part_all_public - are all partitions visible to every user */
+extern bool part_all_public(void);
+
 /* part_fini - free all memory associated with partition records */
 extern void part_fini (void);
 
@@ -2173,6 +2249,12 @@ extern void reset_node_free_mem(char *node_name, uint64_t free_mem);
  * level IN - clear backfilled_jobs count if set */
 extern void reset_stats(int level);
 
+/*
+ * Record the scheduling and queue statistics of the last minute in the
+ * history reported by sdiag, if a minute elapsed since the last sample
+ */
+extern void sample_stats_history(time_t now);
+
 /*
  * restore_node_features - Make node and config (from slurm.conf) fields
  *	consistent for Features, Gres and Weight
@@ -2391,6 +2473,13 @@ extern bool test_job_nodes_ready(struct job_record *job_ptr);
  */
 extern int sync_job_files(void);
 
+/*
+ * Remove batch job directories left without a job record after
+ * sync_job_files() used the job_state file's batch directory index.
+ * Scans the state save directory, do not call with slurmctld locks held.
+ */
+extern void purge_defunct_batch_dirs(void);
+
 /* After recovering job state, if using priority/basic then we increment the
  * priorities of all jobs to avoid decrementing the base down to zero */
 extern void sync_job_priorities(void);
@@ -0,0 +1,851 @@
+/*****************************************************************************\
+ *  snapshot.c - versioned read-only snapshots of job, node and partition state
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+/*
+ * The job, node and partition information RPCs normally hold read locks on
+ * the global data structures while every record is packed, which delays
+ * the scheduler and any RPC needing a write lock for the full duration of
+ * each poll. With SlurmctldParameters=snapshot_max_age=# a dedicated thread
+ * instead packs the records once after they have been modified (as
+ * detected by the write lock generation counters in locks.c) and publishes
+ * the result as an immutable snapshot. The information RPCs then build
+ * their response from the newest snapshot without any slurmctld locks.
+ *
+ * Each published snapshot is a new generation. A reader pins the generation
+ * current when it starts by taking a reference and the publisher never
+ * modifies a snapshot after publication, so superseded generations are
+ * reclaimed once the last reader pinned to them has finished.
+ *
+ * Each job snapshot also records in which build every packed job record
+ * last changed and which jobs were purged, so that a client presenting the
+ * cursor of an earlier response (see slurm_load_job_changes()) receives only
+ * the records changed since then plus the IDs of jobs to remove. A cursor is
+ * the snapshot epoch (the time snapshots were started) in the upper 32 bits
+ * and the build sequence number and variant in the lower 32 bits. Cursors
+ * from another epoch or older than the purge history fall back to a full
+ * response.
+ *
+ * Snapshots are only used for the current protocol version. Requests which
+ * a snapshot can not answer exactly (older clients, partition visibility
+ * that depends upon group membership or has changed since the snapshot was
+ * built, snapshots older than snapshot_max_age while the data is changing)
+ * fall back to the locked path.
+ */
+
+#include "config.h"
+
+#if HAVE_SYS_PRCTL_H
+#  include <sys/prctl.h>
+#endif
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "src/common/assoc_mgr.h"
+#include "src/common/list.h"
+#include "src/common/log.h"
+#include "src/common/macros.h"
+#include "src/common/node_conf.h"
+#include "src/common/node_select.h"
+#include "src/common/pack.h"
+#include "src/common/slurm_mcs.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
+
+#include "src/slurmctld/info_filter.h"
+#include "src/slurmctld/locks.h"
+#include "src/slurmctld/response_cache.h"
+#include "src/slurmctld/slurmctld.h"
+#include "src/slurmctld/snapshot.h"
+
+#define SNAP_JOB_VARIANTS  2	/* without and with SHOW_DETAIL */
+#define SNAP_NODE_VARIANTS 4	/* SHOW_DETAIL and SHOW_FUTURE combinations */
+#define SNAP_PURGE_MAX 65536	/* purged job IDs remembered for deltas */
+
+/* Visibility and filter information for one packed job record */
+typedef struct {
+	uint32_t user_id;
+	bool revoked;		/* IS_JOB_REVOKED() */
+	bool part_open;		/* in a partition visible to every user */
+	bool part_any;		/* in any partition */
+	char *account;
+	char *mcs_label;
+	uint32_t job_state;
+	char *name;
+	char *nodes;
+	char *partition;
+	uint32_t job_id;
+	uint32_t change_seq;	/* build in which the packed record changed */
+	uint32_t offset;	/* location of the record in snapshot buffer */
+	uint32_t size;
+} snap_job_t;
+
+/* A job removed from job_list */
+typedef struct {
+	uint32_t job_id;
+	uint32_t seq;		/* build in which the job was purged */
+} snap_purge_t;
+
+typedef struct {
+	int refcnt;		/* publisher plus active readers */
+	uint32_t gen;		/* sum of write lock generations at build */
+	time_t build_time;
+	time_t last_update;	/* last_job/node/part_update at build */
+	bool part_open;		/* no hidden or group restricted partitions */
+	uint32_t part_gen;	/* _part_gen() at build, part_open is valid
+				 * while unchanged */
+	Buf buffer;		/* job records or complete response */
+	uint32_t job_cnt;
+	snap_job_t *jobs;
+	uint32_t seq;		/* job build sequence number */
+	uint32_t min_seq;	/* oldest cursor a delta can be built from */
+	uint32_t purge_cnt;
+	snap_purge_t *purged;	/* purged since min_seq, oldest first */
+} snapshot_t;
+
+static pthread_mutex_t snap_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  snap_cond  = PTHREAD_COND_INITIALIZER;
+static pthread_t snap_thread = 0;
+static bool snap_stop = false;
+static int snap_max_age = 0;
+static uint32_t snap_epoch = 0;
+static uint32_t job_seq = 0;	/* used only by the snapshot thread */
+
+/* Variants requested at least once, only those are built */
+static bool job_want[SNAP_JOB_VARIANTS];
+static bool node_want[SNAP_NODE_VARIANTS];
+static bool part_want = false;
+
+static snapshot_t *job_snap[SNAP_JOB_VARIANTS];
+static snapshot_t *node_snap[SNAP_NODE_VARIANTS];
+static snapshot_t *part_snap = NULL;
+
+static uint32_t _job_gen(void)
+{
+	return response_cache_gen(RESPONSE_CACHE_JOB);
+}
+
+static uint32_t _node_gen(void)
+{
+	return response_cache_gen(RESPONSE_CACHE_NODE);
+}
+
+static uint32_t _part_gen(void)
+{
+	return response_cache_gen(RESPONSE_CACHE_PART);
+}
+
+/*
+ * Test if partition visibility may differ from when a snapshot was built.
+ * An outdated snapshot may still be used for up to snap_max_age seconds,
+ * but never with a stale view of what a user is permitted to see.
+ */
+static bool _part_changed(snapshot_t *snap)
+{
+	return (snap->part_gen != _part_gen());
+}
+
+static void _snap_free(snapshot_t *snap)
+{
+	uint32_t i;
+
+	for (i = 0; i < snap->job_cnt; i++) {
+		xfree(snap->jobs[i].account);
+		xfree(snap->jobs[i].mcs_label);
+		xfree(snap->jobs[i].name);
+		xfree(snap->jobs[i].nodes);
+		xfree(snap->jobs[i].partition);
+	}
+	xfree(snap->jobs);
+	xfree(snap->purged);
+	free_buf(snap->buffer);
+	xfree(snap);
+}
+
+/* Drop a reference, the caller must hold snap_mutex */
+static void _snap_release_locked(snapshot_t *snap)
+{
+	if (snap && (--snap->refcnt == 0))
+		_snap_free(snap);
+}
+
+static void _snap_release(snapshot_t *snap)
+{
+	slurm_mutex_lock(&snap_mutex);
+	_snap_release_locked(snap);
+	slurm_mutex_unlock(&snap_mutex);
+}
+
+/* Replace the published snapshot at *slot with snap */
+static void _snap_publish(snapshot_t **slot, snapshot_t *snap)
+{
+	slurm_mutex_lock(&snap_mutex);
+	_snap_release_locked(*slot);
+	snap->refcnt = 1;
+	*slot = snap;
+	slurm_mutex_unlock(&snap_mutex);
+}
+
+/*
+ * Pin the snapshot at *slot, or mark it wanted if there is none yet.
+ * RET the snapshot, release with _snap_release(), or NULL if none is usable
+ */
+static snapshot_t *_snap_acquire(snapshot_t **slot, bool *want,
+				 uint32_t (*gen_func)(void))
+{
+	snapshot_t *snap;
+
+	slurm_mutex_lock(&snap_mutex);
+	if (!snap_thread) {
+		slurm_mutex_unlock(&snap_mutex);
+		return NULL;
+	}
+	if (!(snap = *slot)) {
+		if (!*want) {
+			*want = true;
+			slurm_cond_signal(&snap_cond);
+		}
+		slurm_mutex_unlock(&snap_mutex);
+		return NULL;
+	}
+	snap->refcnt++;
+	slurm_mutex_unlock(&snap_mutex);
+
+	/* An outdated snapshot is only acceptable for snap_max_age seconds */
+	if (((time(NULL) - snap->build_time) > snap_max_age) &&
+	    (snap->gen != gen_func())) {
+		_snap_release(snap);
+		return NULL;
+	}
+
+	return snap;
+}
+
+/* Append raw data, already packed, to a buffer */
+static void _append_buf(Buf buffer, char *data, uint32_t size)
+{
+	if (remaining_buf(buffer) < size)
+		grow_buf(buffer, size);
+	memcpy(&buffer->head[get_buf_offset(buffer)], data, size);
+	set_buf_offset(buffer, get_buf_offset(buffer) + size);
+}
+
+static bool _job_part_open(struct job_record *job_ptr)
+{
+	ListIterator part_iterator;
+	struct part_record *part_ptr;
+	bool rc = false;
+
+	if (!job_ptr->part_ptr_list)
+		return (job_ptr->part_ptr && part_is_public(job_ptr->part_ptr));
+
+	part_iterator = list_iterator_create(job_ptr->part_ptr_list);
+	while ((part_ptr = (struct part_record *) list_next(part_iterator))) {
+		if (part_is_public(part_ptr)) {
+			rc = true;
+			break;
+		}
+	}
+	list_iterator_destroy(part_iterator);
+
+	return rc;
+}
+
+static int _cmp_job_id(const void *a, const void *b)
+{
+	uint32_t job_id_a = (*(snap_job_t **) a)->job_id;
+	uint32_t job_id_b = (*(snap_job_t **) b)->job_id;
+
+	if (job_id_a < job_id_b)
+		return -1;
+	if (job_id_a > job_id_b)
+		return 1;
+	return 0;
+}
+
+/*
+ * Set change_seq of every record in a new job snapshot and its purge
+ * history by comparing it with the previously published snapshot
+ */
+static void _track_job_changes(snapshot_t *snap, snapshot_t *prev)
+{
+	snap_job_t **sorted = NULL, **found, *job_snap_ptr, *key;
+	bool *seen;
+	uint32_t i, drop, purge_cnt;
+
+	if (!prev) {
+		for (i = 0; i < snap->job_cnt; i++)
+			snap->jobs[i].change_seq = snap->seq;
+		snap->min_seq = snap->seq;
+		return;
+	}
+
+	/* Index the previous records by job ID */
+	sorted = xmalloc(sizeof(snap_job_t *) * (prev->job_cnt + 1));
+	for (i = 0; i < prev->job_cnt; i++)
+		sorted[i] = &prev->jobs[i];
+	qsort(sorted, prev->job_cnt, sizeof(snap_job_t *), _cmp_job_id);
+	seen = xmalloc(sizeof(bool) * (prev->job_cnt + 1));
+
+	for (i = 0; i < snap->job_cnt; i++) {
+		job_snap_ptr = &snap->jobs[i];
+		key = job_snap_ptr;
+		found = bsearch(&key, sorted, prev->job_cnt,
+				sizeof(snap_job_t *), _cmp_job_id);
+		if (!found) {
+			job_snap_ptr->change_seq = snap->seq;
+			continue;
+		}
+		seen[*found - prev->jobs] = true;
+		if (((*found)->size == job_snap_ptr->size) &&
+		    !memcmp(&prev->buffer->head[(*found)->offset],
+			    &snap->buffer->head[job_snap_ptr->offset],
+			    job_snap_ptr->size))
+			job_snap_ptr->change_seq = (*found)->change_seq;
+		else
+			job_snap_ptr->change_seq = snap->seq;
+	}
+	xfree(sorted);
+
+	/* Carry the purge history forward and add newly purged jobs */
+	purge_cnt = prev->purge_cnt;
+	for (i = 0; i < prev->job_cnt; i++) {
+		if (!seen[i])
+			purge_cnt++;
+	}
+	snap->purged = xmalloc(sizeof(snap_purge_t) * (purge_cnt + 1));
+	if (prev->purge_cnt) {
+		memcpy(snap->purged, prev->purged,
+		       sizeof(snap_purge_t) * prev->purge_cnt);
+	}
+	snap->purge_cnt = prev->purge_cnt;
+	for (i = 0; i < prev->job_cnt; i++) {
+		if (seen[i])
+			continue;
+		snap->purged[snap->purge_cnt].job_id = prev->jobs[i].job_id;
+		snap->purged[snap->purge_cnt].seq = snap->seq;
+		snap->purge_cnt++;
+	}
+	snap->min_seq = prev->min_seq;
+	if (snap->purge_cnt > SNAP_PURGE_MAX) {
+		/* Cursors older than the last forgotten purge are invalid */
+		drop = snap->purge_cnt - SNAP_PURGE_MAX;
+		snap->min_seq = MAX(snap->min_seq, snap->purged[drop - 1].seq);
+		memmove(snap->purged, &snap->purged[drop],
+			sizeof(snap_purge_t) * SNAP_PURGE_MAX);
+		snap->purge_cnt = SNAP_PURGE_MAX;
+	}
+	xfree(seen);
+}
+
+static void _build_jobs(void)
+{
+	/* Locks: Read config, job, partition and federation */
+	slurmctld_lock_t job_read_lock = {
+		READ_LOCK, READ_LOCK, NO_LOCK, READ_LOCK, READ_LOCK };
+	snapshot_t *snap[SNAP_JOB_VARIANTS] = { NULL };
+	ListIterator itr;
+	struct job_record *job_ptr;
+	snap_job_t *job_snap_ptr;
+	uint32_t gen, i, job_cnt, offset;
+	bool want[SNAP_JOB_VARIANTS];
+	int v;
+
+	slurm_mutex_lock(&snap_mutex);
+	memcpy(want, job_want, sizeof(want));
+	slurm_mutex_unlock(&snap_mutex);
+
+	lock_slurmctld(job_read_lock);
+	gen = _job_gen();
+	job_cnt = list_count(job_list);
+	for (v = 0; v < SNAP_JOB_VARIANTS; v++) {
+		if (!want[v] || (job_snap[v] && (job_snap[v]->gen == gen)))
+			continue;
+		snap[v] = xmalloc(sizeof(snapshot_t));
+		snap[v]->gen = gen;
+		snap[v]->build_time = time(NULL);
+		snap[v]->last_update = last_job_update;
+		snap[v]->part_gen = _part_gen();
+		snap[v]->buffer = init_buf(BUF_SIZE);
+		snap[v]->jobs = xmalloc(sizeof(snap_job_t) * job_cnt);
+	}
+	if (!snap[0] && !snap[1]) {
+		unlock_slurmctld(job_read_lock);
+		return;
+	}
+	job_seq++;
+
+	itr = list_iterator_create(job_list);
+	for (i = 0; (job_ptr = list_next(itr)) && (i < job_cnt); i++) {
+		for (v = 0; v < SNAP_JOB_VARIANTS; v++) {
+			if (!snap[v])
+				continue;
+			job_snap_ptr = &snap[v]->jobs[i];
+			job_snap_ptr->user_id = job_ptr->user_id;
+			job_snap_ptr->revoked = IS_JOB_REVOKED(job_ptr);
+			job_snap_ptr->part_open = _job_part_open(job_ptr);
+			job_snap_ptr->part_any = (job_ptr->part_ptr ||
+						  job_ptr->part_ptr_list);
+			job_snap_ptr->account = xstrdup(job_ptr->account);
+			job_snap_ptr->mcs_label = xstrdup(job_ptr->mcs_label);
+			job_snap_ptr->job_state = job_ptr->job_state;
+			job_snap_ptr->name = xstrdup(job_ptr->name);
+			job_snap_ptr->nodes = xstrdup(job_ptr->nodes);
+			job_snap_ptr->partition = xstrdup(job_ptr->partition);
+			job_snap_ptr->job_id = job_ptr->job_id;
+			offset = get_buf_offset(snap[v]->buffer);
+			pack_job(job_ptr, v ? SHOW_DETAIL : 0, snap[v]->buffer,
+				 SLURM_PROTOCOL_VERSION, 0);
+			job_snap_ptr->offset = offset;
+			job_snap_ptr->size = get_buf_offset(snap[v]->buffer) -
+					     offset;
+			snap[v]->job_cnt++;
+		}
+	}
+	list_iterator_destroy(itr);
+	unlock_slurmctld(job_read_lock);
+
+	for (v = 0; v < SNAP_JOB_VARIANTS; v++) {
+		if (!snap[v])
+			continue;
+		snap[v]->seq = job_seq;
+		_track_job_changes(snap[v], job_snap[v]);
+		_snap_publish(&job_snap[v], snap[v]);
+	}
+}
+
+static void _build_nodes(void)
+{
+	/* Locks: Read config, read job, write node (reset allocated CPU count
+	 * in some select plugins), read part */
+	slurmctld_lock_t node_write_lock = {
+		READ_LOCK, READ_LOCK, WRITE_LOCK, READ_LOCK, NO_LOCK };
+	snapshot_t *snap[SNAP_NODE_VARIANTS] = { NULL };
+	bool want[SNAP_NODE_VARIANTS], any = false;
+	char *dump;
+	int dump_size, v;
+	uint16_t show_flags;
+	uint32_t gen;
+
+	slurm_mutex_lock(&snap_mutex);
+	memcpy(want, node_want, sizeof(want));
+	slurm_mutex_unlock(&snap_mutex);
+
+	/*
+	 * Unlike jobs, the generation can change between this test and
+	 * taking the locks. That only results in an extra rebuild later.
+	 */
+	gen = _node_gen();
+	for (v = 0; v < SNAP_NODE_VARIANTS; v++) {
+		if (want[v] && (!node_snap[v] || (node_snap[v]->gen != gen)))
+			any = true;
+	}
+	if (!any)
+		return;
+
+	lock_slurmctld(node_write_lock);
+	select_g_select_nodeinfo_set_all();
+	/* Releasing our own node write lock below increments the generation */
+	gen = _node_gen() + 1;
+	for (v = 0; v < SNAP_NODE_VARIANTS; v++) {
+		if (!want[v])
+			continue;
+		show_flags = SHOW_ALL;
+		if (v & 1)
+			show_flags |= SHOW_DETAIL;
+		if (v & 2)
+			show_flags |= SHOW_FUTURE;
+		pack_all_node(&dump, &dump_size, show_flags, 0, NULL,
+			      SLURM_PROTOCOL_VERSION);
+		snap[v] = xmalloc(sizeof(snapshot_t));
+		snap[v]->gen = gen;
+		snap[v]->build_time = time(NULL);
+		snap[v]->last_update = last_node_update;
+		snap[v]->part_gen = _part_gen();
+		snap[v]->part_open = part_all_public() &&
+			!((slurmctld_conf.private_data & PRIVATE_DATA_NODES) &&
+			  (slurm_mcs_get_privatedata() == 1));
+		snap[v]->buffer = create_buf(dump, dump_size);
+	}
+	unlock_slurmctld(node_write_lock);
+
+	for (v = 0; v < SNAP_NODE_VARIANTS; v++) {
+		if (snap[v])
+			_snap_publish(&node_snap[v], snap[v]);
+	}
+}
+
+static void _build_parts(void)
+{
+	/* Locks: Read configuration and partition */
+	slurmctld_lock_t part_read_lock = {
+		READ_LOCK, NO_LOCK, NO_LOCK, READ_LOCK, NO_LOCK };
+	snapshot_t *snap;
+	char *dump;
+	int dump_size;
+	bool want;
+
+	slurm_mutex_lock(&snap_mutex);
+	want = part_want;
+	slurm_mutex_unlock(&snap_mutex);
+	if (!want)
+		return;
+
+	lock_slurmctld(part_read_lock);
+	if (part_snap && (part_snap->gen == _part_gen())) {
+		unlock_slurmctld(part_read_lock);
+		return;
+	}
+	pack_all_part(&dump, &dump_size, SHOW_ALL, 0, SLURM_PROTOCOL_VERSION);
+	snap = xmalloc(sizeof(snapshot_t));
+	snap->gen = _part_gen();
+	snap->build_time = time(NULL);
+	snap->last_update = last_part_update;
+	snap->part_gen = snap->gen;
+	snap->part_open = part_all_public();
+	snap->buffer = create_buf(dump, dump_size);
+	unlock_slurmctld(part_read_lock);
+
+	_snap_publish(&part_snap, snap);
+}
+
+static void *_snapshot_thread(void *no_data)
+{
+	struct timespec ts = {0, 0};
+
+#if HAVE_SYS_PRCTL_H
+	if (prctl(PR_SET_NAME, "snapshot", NULL, NULL, NULL) < 0) {
+		error("%s: cannot set my name to %s %m", __func__, "snapshot");
+	}
+#endif
+
+	slurm_mutex_lock(&snap_mutex);
+	while (!snap_stop) {
+		slurm_mutex_unlock(&snap_mutex);
+		_build_jobs();
+		_build_nodes();
+		_build_parts();
+		slurm_mutex_lock(&snap_mutex);
+		if (snap_stop)
+			break;
+		/* Rebuild at most once per second while data changes */
+		ts.tv_sec = time(NULL) + 1;
+		slurm_cond_timedwait(&snap_cond, &snap_mutex, &ts);
+	}
+	slurm_mutex_unlock(&snap_mutex);
+
+	return NULL;
+}
+
+extern void snapshot_start(void)
+{
+	char *tmp_ptr;
+
+	if (!(tmp_ptr = xstrcasestr(slurmctld_conf.slurmctld_params,
+				    "snapshot_max_age=")))
+		return;
+	snap_max_age = atoi(tmp_ptr + 17);
+	if (snap_max_age <= 0) {
+		error("Invalid SlurmctldParameters snapshot_max_age=%d",
+		      snap_max_age);
+		return;
+	}
+
+	slurm_mutex_lock(&snap_mutex);
+	snap_stop = false;
+	snap_epoch = (uint32_t) time(NULL);
+	slurm_thread_create(&snap_thread, _snapshot_thread, NULL);
+	slurm_mutex_unlock(&snap_mutex);
+	debug("%s: publishing state snapshots, max age %d seconds",
+	      __func__, snap_max_age);
+}
+
+extern void snapshot_stop(void)
+{
+	pthread_t thread_id;
+	int v;
+
+	slurm_mutex_lock(&snap_mutex);
+	thread_id = snap_thread;
+	snap_stop = true;
+	slurm_cond_signal(&snap_cond);
+	slurm_mutex_unlock(&snap_mutex);
+	if (!thread_id)
+		return;
+	pthread_join(thread_id, NULL);
+
+	slurm_mutex_lock(&snap_mutex);
+	snap_thread = 0;
+	for (v = 0; v < SNAP_JOB_VARIANTS; v++) {
+		_snap_release_locked(job_snap[v]);
+		job_snap[v] = NULL;
+		job_want[v] = false;
+	}
+	for (v = 0; v < SNAP_NODE_VARIANTS; v++) {
+		_snap_release_locked(node_snap[v]);
+		node_snap[v] = NULL;
+		node_want[v] = false;
+	}
+	_snap_release_locked(part_snap);
+	part_snap = NULL;
+	part_want = false;
+	slurm_mutex_unlock(&snap_mutex);
+}
+
+/* Same test as _hide_job() in job_mgr.c, from the snapshot data */
+static bool _hide_job(snap_job_t *job_snap_ptr, uid_t uid,
+		      uint16_t show_flags, bool operator)
+{
+	if (!(show_flags & SHOW_ALL) && job_snap_ptr->revoked)
+		return true;
+
+	if ((slurmctld_conf.private_data & PRIVATE_DATA_JOBS) &&
+	    (job_snap_ptr->user_id != uid) && !operator &&
+	    (((slurm_mcs_get_privatedata() == 0) &&
+	      !assoc_mgr_is_user_acct_coord(acct_db_conn, uid,
+					    job_snap_ptr->account)) ||
+	     ((slurm_mcs_get_privatedata() == 1) &&
+	      (mcs_g_check_mcs_label(uid, job_snap_ptr->mcs_label) != 0))))
+		return true;
+	return false;
+}
+
+static uint64_t _job_cursor(snapshot_t *snap, int v)
+{
+	return (((uint64_t) snap_epoch) << 32) | (snap->seq << 1) | v;
+}
+
+/*
+ * Return the build sequence number of the client's data if the job records
+ * changed since then can be computed from snap, otherwise 0
+ */
+static uint32_t _cursor_seq(snapshot_t *snap, uint64_t delta_cursor, int v)
+{
+	uint32_t seq;
+
+	if ((delta_cursor >> 32) != snap_epoch)
+		return 0;
+	if ((delta_cursor & 1) != v)
+		return 0;
+	seq = (delta_cursor & 0xffffffff) >> 1;
+	if ((seq < snap->min_seq) || (seq > snap->seq))
+		return 0;
+	return seq;
+}
+
+/* Append a job ID to an xmalloc'ed array */
+static void _add_job_id(uint32_t **job_ids, uint32_t *cnt, uint32_t *size,
+			uint32_t job_id)
+{
+	if (*cnt >= *size) {
+		*size = (*size * 2) + 64;
+		xrealloc(*job_ids, sizeof(uint32_t) * *size);
+	}
+	(*job_ids)[(*cnt)++] = job_id;
+}
+
+extern int snapshot_pack_jobs(char **buffer_ptr, int *buffer_size,
+			      uint16_t show_flags, uid_t uid,
+			      time_t last_update, uint64_t delta_cursor,
+			      info_filter_t *filter, uint16_t protocol_version)
+{
+	snapshot_t *snap;
+	snap_job_t *job_snap_ptr;
+	job_filter_t *job_filter;
+	uint32_t i, jobs_packed = 0, tmp_offset, since = 0;
+	uint32_t *purged = NULL, purged_cnt = 0, purged_size = 0;
+	bool all_parts, slurm_user, part_changed, operator;
+	Buf buffer;
+	int v = (show_flags & SHOW_DETAIL) ? 1 : 0;
+
+	if (protocol_version != SLURM_PROTOCOL_VERSION)
+		return SLURM_ERROR;
+	if (!(snap = _snap_acquire(&job_snap[v], &job_want[v], _job_gen)))
+		return SLURM_ERROR;
+
+	if ((last_update - 1) >= snap->last_update) {
+		_snap_release(snap);
+		return SLURM_NO_CHANGE_IN_DATA;
+	}
+
+	/*
+	 * Same as the partition test in _pack_job(): SlurmUser sees every
+	 * partition, but like other users not jobs without a partition
+	 */
+	all_parts = (show_flags & SHOW_ALL) || (uid == 0);
+	slurm_user = validate_slurm_user(uid);
+	part_changed = _part_changed(snap);
+	operator = validate_operator(uid);
+	if (delta_cursor)
+		since = _cursor_seq(snap, delta_cursor, v);
+	job_filter = job_filter_create(filter);
+
+	buffer = init_buf((since ? 0 : get_buf_offset(snap->buffer)) +
+			  BUF_SIZE);
+	pack32(jobs_packed, buffer);
+	pack_time(snap->build_time, buffer);
+
+	for (i = 0; i < snap->job_cnt; i++) {
+		job_snap_ptr = &snap->jobs[i];
+		if (!all_parts &&
+		    !(slurm_user ? job_snap_ptr->part_any :
+		      (job_snap_ptr->part_open && !part_changed))) {
+			/* Visibility depends upon partition group membership */
+			job_filter_destroy(job_filter);
+			xfree(purged);
+			free_buf(buffer);
+			_snap_release(snap);
+			return SLURM_ERROR;
+		}
+		if (since && (job_snap_ptr->change_seq <= since))
+			continue;
+		/*
+		 * A changed record the user may no longer see or which no
+		 * longer matches the filter is removed from the client's
+		 * table. Visibility changes not reflected in the record
+		 * (e.g. coordinator status) apply once the job changes or on
+		 * the client's next full request.
+		 */
+		if (_hide_job(job_snap_ptr, uid, show_flags, operator) ||
+		    !job_filter_test(job_filter, job_snap_ptr->job_state,
+				     job_snap_ptr->user_id,
+				     job_snap_ptr->account, job_snap_ptr->name,
+				     job_snap_ptr->partition,
+				     job_snap_ptr->nodes)) {
+			if (since)
+				_add_job_id(&purged, &purged_cnt, &purged_size,
+					    job_snap_ptr->job_id);
+			continue;
+		}
+		_append_buf(buffer,
+			    &snap->buffer->head[job_snap_ptr->offset],
+			    job_snap_ptr->size);
+		jobs_packed++;
+	}
+	job_filter_destroy(job_filter);
+	for (i = 0; since && (i < snap->purge_cnt); i++) {
+		if (snap->purged[i].seq > since)
+			_add_job_id(&purged, &purged_cnt, &purged_size,
+				    snap->purged[i].job_id);
+	}
+	pack_job_info_trailer(buffer, delta_cursor ? _job_cursor(snap, v) : 0,
+			      (since != 0), purged, purged_cnt,
+			      protocol_version);
+	xfree(purged);
+	_snap_release(snap);
+
+	/* put the real record count in the message body header */
+	tmp_offset = get_buf_offset(buffer);
+	set_buf_offset(buffer, 0);
+	pack32(jobs_packed, buffer);
+	set_buf_offset(buffer, tmp_offset);
+
+	*buffer_size = get_buf_offset(buffer);
+	buffer_ptr[0] = xfer_buf_data(buffer);
+
+	return SLURM_SUCCESS;
+}
+
+/* Copy a complete response from a node or partition snapshot */
+static int _snap_copy(snapshot_t *snap, char **buffer_ptr, int *buffer_size,
+		      time_t last_update)
+{
+	int rc = SLURM_SUCCESS;
+
+	if ((last_update - 1) >= snap->last_update) {
+		rc = SLURM_NO_CHANGE_IN_DATA;
+	} else {
+		*buffer_size = size_buf(snap->buffer);
+		buffer_ptr[0] = xmalloc(*buffer_size);
+		memcpy(buffer_ptr[0], get_buf_data(snap->buffer),
+		       *buffer_size);
+	}
+	_snap_release(snap);
+
+	return rc;
+}
+
+extern int snapshot_pack_nodes(char **buffer_ptr, int *buffer_size,
+			       uint16_t show_flags, uid_t uid,
+			       time_t last_update, uint16_t protocol_version)
+{
+	snapshot_t *snap;
+	int v = 0;
+
+	if (protocol_version != SLURM_PROTOCOL_VERSION)
+		return SLURM_ERROR;
+	if (show_flags & SHOW_DETAIL)
+		v |= 1;
+	if (show_flags & SHOW_FUTURE)
+		v |= 2;
+	if (!(snap = _snap_acquire(&node_snap[v], &node_want[v], _node_gen)))
+		return SLURM_ERROR;
+
+	/*
+	 * Same as the hidden node test in pack_all_node(). The snapshot is
+	 * packed with SHOW_ALL, so it is used without SHOW_ALL only while
+	 * no node is hidden from the user.
+	 */
+	if (!(show_flags & SHOW_ALL) && (uid != 0) &&
+	    !validate_slurm_user(uid) &&
+	    (!snap->part_open || _part_changed(snap))) {
+		_snap_release(snap);
+		return SLURM_ERROR;
+	}
+
+	return _snap_copy(snap, buffer_ptr, buffer_size, last_update);
+}
+
+extern int snapshot_pack_parts(char **buffer_ptr, int *buffer_size,
+			       uint16_t show_flags, uid_t uid,
+			       time_t last_update, uint16_t protocol_version)
+{
+	snapshot_t *snap;
+
+	if (protocol_version != SLURM_PROTOCOL_VERSION)
+		return SLURM_ERROR;
+	if (!(snap = _snap_acquire(&part_snap, &part_want, _part_gen)))
+		return SLURM_ERROR;
+
+	/* Same as the partition test in pack_all_part() */
+	if (!(show_flags & SHOW_ALL) && !validate_slurm_user(uid) &&
+	    (!snap->part_open || _part_changed(snap))) {
+		_snap_release(snap);
+		return SLURM_ERROR;
+	}
+
+	return _snap_copy(snap, buffer_ptr, buffer_size, last_update);
+}
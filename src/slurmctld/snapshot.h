@@ -0,0 +1,86 @@
+/*****************************************************************************\
+ *  snapshot.h - versioned read-only snapshots of job, node and partition state
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#ifndef _HAVE_SNAPSHOT_H
+#define _HAVE_SNAPSHOT_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "slurm/slurm.h"
+
+/*
+ * Start the thread publishing snapshots of job, node and partition state
+ * if the "snapshot_max_age=" option of SlurmctldParameters is set.
+ */
+extern void snapshot_start(void);
+
+/* Stop the snapshot thread and release all published snapshots */
+extern void snapshot_stop(void);
+
+/*
+ * Build a RESPONSE_JOB_INFO message body from the newest job snapshot
+ * without taking any slurmctld locks.
+ * OUT buffer_ptr - the pointer is set to the allocated buffer.
+ * OUT buffer_size - set to size of the buffer in bytes
+ * IN show_flags - job filtering options
+ * IN uid - uid of user making request
+ * IN last_update - time of the client's copy of the data
+ * IN delta_cursor - cursor of the client's copy of the data to pack only
+ *	jobs changed since then, JOB_INFO_CURSOR_START for all jobs plus a
+ *	cursor, 0 for all jobs without a cursor
+ * IN filter - pack only jobs matching this filter if not NULL
+ * IN protocol_version - slurm protocol version of client
+ * RET SLURM_SUCCESS, SLURM_NO_CHANGE_IN_DATA or SLURM_ERROR if no suitable
+ *     snapshot exists and the caller must use pack_all_jobs()
+ * NOTE: the buffer at *buffer_ptr must be xfreed by the caller
+ */
+extern int snapshot_pack_jobs(char **buffer_ptr, int *buffer_size,
+			      uint16_t show_flags, uid_t uid,
+			      time_t last_update, uint64_t delta_cursor,
+			      info_filter_t *filter, uint16_t protocol_version);
+
+/* As snapshot_pack_jobs(), for RESPONSE_NODE_INFO and pack_all_node() */
+extern int snapshot_pack_nodes(char **buffer_ptr, int *buffer_size,
+			       uint16_t show_flags, uid_t uid,
+			       time_t last_update, uint16_t protocol_version);
+
+/* As snapshot_pack_jobs(), for RESPONSE_PARTITION_INFO and pack_all_part() */
+extern int snapshot_pack_parts(char **buffer_ptr, int *buffer_size,
+			       uint16_t show_flags, uid_t uid,
+			       time_t last_update, uint16_t protocol_version);
+
+#endif	/* !_HAVE_SNAPSHOT_H */
@@ -0,0 +1,1150 @@
+/*****************************************************************************\
+ *  state_repl.c - stream saved state to standby controllers
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+/*
+ * A backup controller taking over has to recover the state of the primary
+ * from StateSaveLocation, which at scale means reading and parsing a large
+ * job_state file from a shared file system at the worst possible moment.
+ * With SlurmctldParameters=state_replication, backup controllers instead
+ * keep a replica of the state files in memory (REQUEST_STATE_REPL). The RPC
+ * handler hands the connection of the backup over to the replication
+ * thread of the primary, which sends every state file in full, then the
+ * changes of each later save. Job and node records are identified by the
+ * hash of their packed form, so that after a save only the records which
+ * were created or changed are sent along with the hashes of those removed.
+ * Partition and reservation files are small and always sent in full.
+ *
+ * Messages are queued per backup and written without blocking. A backup
+ * with more than REPL_QUEUE_MAX bytes queued, or which accepts no data for
+ * REPL_STALL_TIME seconds, is disconnected and gets full copies again once
+ * it reconnects. At shutdown, what remains queued is sent along with a
+ * clean close. The replication thread sends a keepalive every
+ * REPL_KEEPALIVE_TIME seconds to backups with nothing else queued. It holds
+ * none of the slurmctld locks, so it keeps sending while the primary is
+ * busy. A backup which has heard nothing from the primary for
+ * REPL_DEAD_TIME seconds, and could not reconnect in that time, knows that
+ * the primary died or is unreachable. It checks the primary right away
+ * rather than after SlurmctldTimeout.
+ *
+ * When taking over, the state files are read from the replica unless the
+ * copy in StateSaveLocation is newer. Batch scripts and the other state
+ * files are still read from StateSaveLocation.
+ */
+
+#include "config.h"
+
+#if HAVE_SYS_PRCTL_H
+#  include <sys/prctl.h>
+#endif
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "src/common/fd.h"
+#include "src/common/list.h"
+#include "src/common/log.h"
+#include "src/common/macros.h"
+#include "src/common/pack.h"
+#include "src/common/slurm_auth.h"
+#include "src/common/slurm_persist_conn.h"
+#include "src/common/slurm_protocol_api.h"
+#include "src/common/xhash.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
+
+#include "src/slurmctld/locks.h"
+#include "src/slurmctld/slurmctld.h"
+#include "src/slurmctld/state_repl.h"
+#include "src/slurmctld/state_save.h"
+
+#define REPL_FLUSH_TIME	5	/* seconds to send queued data at shutdown */
+#define REPL_QUEUE_MAX	((uint64_t) 1024 * 1024 * 1024)	/* bytes */
+#define REPL_STALL_TIME	60	/* seconds without a write succeeding */
+#define REPL_KEEPALIVE_TIME 1	/* seconds between keepalives */
+#define REPL_DEAD_TIME	5	/* seconds without data from the primary */
+
+#define REPL_MSG_FULL	1	/* replaces the replica of a file */
+#define REPL_MSG_DELTA	2	/* changes to the replica of a file */
+#define REPL_MSG_CLOSE	3	/* the primary is shutting down */
+#define REPL_MSG_ALIVE	4	/* keepalive */
+
+static const char *file_names[STATE_REPL_CNT] = {
+	"job_state", "node_state", "part_state", "resv_state"
+};
+
+/* A framed message, shared by the queues of all backups */
+typedef struct {
+	int refcnt;
+	Buf buf;
+} repl_msg_t;
+
+typedef struct {
+	int fd;
+	char *host;
+	bool synced[STATE_REPL_CNT];	/* got a full copy of the file */
+	List msgs;		/* repl_msg_t queued, the first being written */
+	uint64_t queued;	/* bytes in msgs */
+	uint32_t out_sent;	/* bytes of the first message written */
+	time_t out_time;	/* last progress writing msgs */
+	bool drop;		/* disconnect */
+} repl_peer_t;
+
+/* A record held by the backups */
+typedef struct {
+	char key[17];		/* hash of the record as hex */
+	uint32_t gen;		/* last publish including the record */
+} repl_key_t;
+
+/* A record of the replica */
+typedef struct {
+	char key[17];
+	char *data;
+	uint32_t len;
+} repl_rec_t;
+
+/* Primary controller */
+static pthread_mutex_t repl_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t repl_thread = 0;
+static bool repl_enabled = false;
+static bool repl_stop = false;
+static time_t repl_stop_time = 0;
+static int wake_fd[2] = { -1, -1 };
+static List peers = NULL;		/* repl_peer_t */
+
+/* Serializes state_repl_publish(), protects the tables below */
+static pthread_mutex_t publish_mutex = PTHREAD_MUTEX_INITIALIZER;
+static xhash_t *sent[STATE_REPL_CNT];	/* repl_key_t */
+static uint32_t sent_gen = 0;
+
+/* Backup controller */
+static pthread_mutex_t client_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t client_thread = 0;
+static time_t client_shutdown = 0;
+static time_t client_alive = 0;		/* last data from the primary */
+static bool client_closed = false;	/* the primary shut down */
+static bool client_receiving = false;	/* reading a message */
+static int client_wake_fd[2] = { -1, -1 };
+
+/* Used only by the client thread until it is stopped */
+static Buf rep_hdr[STATE_REPL_CNT];	/* file header, NULL if no replica */
+static time_t rep_time[STATE_REPL_CNT];	/* save time from the header */
+static xhash_t *rep_recs[STATE_REPL_CNT];	/* repl_rec_t */
+
+static bool _configured(void)
+{
+	return (xstrcasestr(slurmctld_conf.slurmctld_params,
+			    "state_replication") != NULL);
+}
+
+/* FNV-1a hash */
+static uint64_t _hash_data(const char *data, uint32_t len)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	uint32_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= (uint8_t) data[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+static void _hash_key(uint64_t hash, char *key)
+{
+	snprintf(key, 17, "%016"PRIx64, hash);
+}
+
+static const char *_key_id(void *item)
+{
+	return ((repl_key_t *) item)->key;
+}
+
+static void _key_free(void *item)
+{
+	xfree(item);
+}
+
+static const char *_rec_id(void *item)
+{
+	return ((repl_rec_t *) item)->key;
+}
+
+static void _rec_free(void *item)
+{
+	repl_rec_t *rec = (repl_rec_t *) item;
+
+	xfree(rec->data);
+	xfree(rec);
+}
+
+static void _msg_release(void *x)
+{
+	repl_msg_t *msg = (repl_msg_t *) x;
+
+	if (!msg || (--msg->refcnt > 0))
+		return;
+	free_buf(msg->buf);
+	xfree(msg);
+}
+
+static void _peer_free(void *x)
+{
+	repl_peer_t *peer = (repl_peer_t *) x;
+
+	if (peer->fd >= 0)
+		(void) close(peer->fd);
+	FREE_NULL_LIST(peer->msgs);
+	xfree(peer->host);
+	xfree(peer);
+}
+
+static void _wake(void)
+{
+	char c = 0;
+
+	if ((wake_fd[1] >= 0) && (write(wake_fd[1], &c, 1) < 0))
+		debug("%s: write: %m", __func__);
+}
+
+/*
+ * Start a message, same framing as slurm_persist_send_msg()
+ * IN size - expected size of the message, to avoid growing the buffer
+ */
+static Buf _msg_start(state_repl_file_t file, uint16_t type, uint32_t size)
+{
+	Buf buffer = init_buf(size + 64);
+
+	pack32(0, buffer);	/* length, set by _msg_finish() */
+	pack16((uint16_t) file, buffer);
+	pack16(type, buffer);
+	return buffer;
+}
+
+static repl_msg_t *_msg_finish(Buf buffer)
+{
+	repl_msg_t *msg = xmalloc(sizeof(repl_msg_t));
+	uint32_t end = get_buf_offset(buffer);
+
+	set_buf_offset(buffer, 0);
+	pack32(end - sizeof(uint32_t), buffer);
+	set_buf_offset(buffer, end);
+	msg->buf = buffer;
+	return msg;
+}
+
+/* Queue a message to a backup, disconnecting it if it is not reading */
+static void _peer_queue(repl_peer_t *peer, repl_msg_t *msg)
+{
+	if (peer->drop)
+		return;
+	if ((peer->queued + get_buf_offset(msg->buf)) > REPL_QUEUE_MAX) {
+		error("%s: backup controller %s not reading, closing its state replication",
+		      __func__, peer->host);
+		peer->drop = true;
+		return;
+	}
+	if (!list_count(peer->msgs))
+		peer->out_time = time(NULL);
+	msg->refcnt++;
+	list_append(peer->msgs, msg);
+	peer->queued += get_buf_offset(msg->buf);
+}
+
+typedef struct {
+	uint32_t gen;
+	List removed;
+} find_removed_arg_t;
+
+static void _find_removed(void *item, void *arg)
+{
+	repl_key_t *key = (repl_key_t *) item;
+	find_removed_arg_t *find_arg = (find_removed_arg_t *) arg;
+
+	if (key->gen != find_arg->gen)
+		list_append(find_arg->removed, xstrdup(key->key));
+}
+
+/*
+ * Make sent[file] hold the records of this save
+ * OUT added - indexes of the records which are new
+ * OUT removed - keys of the records which are gone
+ */
+static void _sent_update(state_repl_file_t file, uint64_t *hashes,
+			 uint32_t rec_cnt, uint32_t *added, uint32_t *add_cnt,
+			 List removed)
+{
+	find_removed_arg_t find_arg;
+	repl_key_t *key;
+	char key_str[17], *tmp;
+	ListIterator itr;
+	uint32_t i;
+
+	if (!sent[file])
+		sent[file] = xhash_init(_key_id, _key_free);
+	sent_gen++;
+	*add_cnt = 0;
+	for (i = 0; i < rec_cnt; i++) {
+		_hash_key(hashes[i], key_str);
+		if ((key = xhash_get(sent[file], key_str))) {
+			key->gen = sent_gen;
+			continue;
+		}
+		key = xmalloc(sizeof(repl_key_t));
+		memcpy(key->key, key_str, sizeof(key->key));
+		key->gen = sent_gen;
+		xhash_add(sent[file], key);
+		added[(*add_cnt)++] = i;
+	}
+
+	find_arg.gen = sent_gen;
+	find_arg.removed = removed;
+	xhash_walk(sent[file], _find_removed, &find_arg);
+	itr = list_iterator_create(removed);
+	while ((tmp = list_next(itr)))
+		xhash_delete(sent[file], tmp);
+	list_iterator_destroy(itr);
+}
+
+static void _sent_clear(void)
+{
+	int i;
+
+	for (i = 0; i < STATE_REPL_CNT; i++) {
+		if (sent[i])
+			xhash_free(sent[i]);
+	}
+}
+
+static Buf _msg_full(state_repl_file_t file, char *data, uint32_t size,
+		     uint32_t hdr_len, uint32_t *rec_off, uint64_t *hashes,
+		     uint32_t rec_cnt)
+{
+	Buf buffer;
+	uint32_t i, end;
+
+	buffer = _msg_start(file, REPL_MSG_FULL, size + (rec_cnt * 12));
+	packmem(data, hdr_len, buffer);
+	pack32(0, buffer);		/* records removed */
+	pack32(rec_cnt, buffer);
+	for (i = 0; i < rec_cnt; i++) {
+		end = (i + 1 < rec_cnt) ? rec_off[i + 1] : size;
+		pack64(hashes[i], buffer);
+		packmem(data + rec_off[i], end - rec_off[i], buffer);
+	}
+	return buffer;
+}
+
+static Buf _msg_delta(state_repl_file_t file, char *data, uint32_t size,
+		      uint32_t hdr_len, uint32_t *rec_off, uint64_t *hashes,
+		      uint32_t rec_cnt, uint32_t *added, uint32_t add_cnt,
+		      List removed)
+{
+	Buf buffer;
+	uint32_t i, end, msg_size = hdr_len;
+	ListIterator itr;
+	char *key;
+
+	for (i = 0; i < add_cnt; i++) {
+		end = (added[i] + 1 < rec_cnt) ? rec_off[added[i] + 1] : size;
+		msg_size += end - rec_off[added[i]] + 12;
+	}
+	msg_size += list_count(removed) * 8;
+
+	buffer = _msg_start(file, REPL_MSG_DELTA, msg_size);
+	packmem(data, hdr_len, buffer);
+	pack32(list_count(removed), buffer);
+	itr = list_iterator_create(removed);
+	while ((key = list_next(itr)))
+		pack64(strtoull(key, NULL, 16), buffer);
+	list_iterator_destroy(itr);
+	pack32(add_cnt, buffer);
+	for (i = 0; i < add_cnt; i++) {
+		end = (added[i] + 1 < rec_cnt) ? rec_off[added[i] + 1] : size;
+		pack64(hashes[added[i]], buffer);
+		packmem(data + rec_off[added[i]], end - rec_off[added[i]],
+			buffer);
+	}
+	return buffer;
+}
+
+extern void state_repl_publish(state_repl_file_t file, Buf buffer,
+			       uint32_t *rec_off, uint32_t rec_cnt)
+{
+	char *data = get_buf_data(buffer);
+	uint32_t size = get_buf_offset(buffer), hdr_len, add_cnt = 0, i;
+	uint32_t *added = NULL;
+	uint64_t *hashes = NULL;
+	bool need_full = false, need_delta = false;
+	repl_msg_t *full = NULL, *delta = NULL;
+	List removed;
+	ListIterator itr;
+	repl_peer_t *peer;
+	DEF_TIMERS;
+
+	START_TIMER;
+	slurm_mutex_lock(&publish_mutex);
+	slurm_mutex_lock(&repl_mutex);
+	if (peers) {
+		itr = list_iterator_create(peers);
+		while ((peer = list_next(itr))) {
+			if (peer->synced[file])
+				need_delta = true;
+			else
+				need_full = true;
+		}
+		list_iterator_destroy(itr);
+	}
+	slurm_mutex_unlock(&repl_mutex);
+	if (!need_full && !need_delta) {
+		_sent_clear();
+		slurm_mutex_unlock(&publish_mutex);
+		return;
+	}
+
+	if (!rec_off)
+		rec_cnt = 0;
+	hdr_len = rec_cnt ? rec_off[0] : size;
+	hashes = xmalloc(sizeof(uint64_t) * (rec_cnt + 1));
+	added = xmalloc(sizeof(uint32_t) * (rec_cnt + 1));
+	for (i = 0; i < rec_cnt; i++) {
+		uint32_t end = (i + 1 < rec_cnt) ? rec_off[i + 1] : size;
+		hashes[i] = _hash_data(data + rec_off[i], end - rec_off[i]);
+	}
+	removed = list_create(slurm_destroy_char);
+	_sent_update(file, hashes, rec_cnt, added, &add_cnt, removed);
+
+	if (need_full)
+		full = _msg_finish(_msg_full(file, data, size, hdr_len,
+					     rec_off, hashes, rec_cnt));
+	if (need_delta)
+		delta = _msg_finish(_msg_delta(file, data, size, hdr_len,
+					       rec_off, hashes, rec_cnt,
+					       added, add_cnt, removed));
+
+	slurm_mutex_lock(&repl_mutex);
+	if (full)
+		full->refcnt = 1;
+	if (delta)
+		delta->refcnt = 1;
+	if (peers) {
+		itr = list_iterator_create(peers);
+		while ((peer = list_next(itr))) {
+			if (peer->synced[file]) {
+				if (delta)
+					_peer_queue(peer, delta);
+			} else if (full) {
+				_peer_queue(peer, full);
+				peer->synced[file] = true;
+			}
+		}
+		list_iterator_destroy(itr);
+	}
+	_msg_release(full);
+	_msg_release(delta);
+	slurm_mutex_unlock(&repl_mutex);
+	_wake();
+
+	slurm_mutex_unlock(&publish_mutex);
+	END_TIMER2("state_repl_publish");
+	debug2("%s: %s: %u records, %u sent, %d removed",
+	       __func__, file_names[file], rec_cnt,
+	       need_full ? rec_cnt : add_cnt, list_count(removed));
+	FREE_NULL_LIST(removed);
+	xfree(hashes);
+	xfree(added);
+}
+
+/*
+ * Write as much of the queued messages as the socket accepts
+ * RET SLURM_ERROR if the backup is to be disconnected
+ */
+static int _peer_write(repl_peer_t *peer, time_t now)
+{
+	repl_msg_t *msg;
+	ssize_t len;
+
+	while ((msg = list_peek(peer->msgs))) {
+		len = write(peer->fd, get_buf_data(msg->buf) + peer->out_sent,
+			    get_buf_offset(msg->buf) - peer->out_sent);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+				break;
+			debug("%s: write to backup controller %s: %m",
+			      __func__, peer->host);
+			return SLURM_ERROR;
+		}
+		peer->out_sent += len;
+		peer->out_time = now;
+		if (peer->out_sent >= get_buf_offset(msg->buf)) {
+			msg = list_dequeue(peer->msgs);
+			peer->queued -= get_buf_offset(msg->buf);
+			peer->out_sent = 0;
+			_msg_release(msg);
+		}
+	}
+
+	if (list_count(peer->msgs) &&
+	    ((now - peer->out_time) > REPL_STALL_TIME)) {
+		error("%s: backup controller %s not reading, closing its state replication",
+		      __func__, peer->host);
+		return SLURM_ERROR;
+	}
+
+	return SLURM_SUCCESS;
+}
+
+/* RET true if the thread is to exit */
+static bool _repl_done(time_t now)
+{
+	ListIterator itr;
+	repl_peer_t *peer;
+	bool done = true;
+
+	if (!repl_stop)
+		return false;
+	if ((now - repl_stop_time) >= REPL_FLUSH_TIME)
+		return true;
+	itr = list_iterator_create(peers);
+	while ((peer = list_next(itr))) {
+		if (!peer->drop && list_count(peer->msgs)) {
+			done = false;
+			break;
+		}
+	}
+	list_iterator_destroy(itr);
+	return done;
+}
+
+static void *_repl_thread(void *no_data)
+{
+	struct pollfd *pfds = NULL;
+	repl_peer_t **pfd_peers = NULL;
+	int i, nfds, pfd_size = 0, rc;
+	ssize_t len;
+	time_t now, alive_time = 0;
+	char buf[256];
+	ListIterator itr;
+	repl_peer_t *peer;
+	repl_msg_t *alive;
+
+#if HAVE_SYS_PRCTL_H
+	if (prctl(PR_SET_NAME, "staterepl", NULL, NULL, NULL) < 0) {
+		error("%s: cannot set my name to %s %m", __func__, "staterepl");
+	}
+#endif
+
+	alive = _msg_finish(_msg_start(0, REPL_MSG_ALIVE, 0));
+	alive->refcnt = 1;
+	while (1) {
+		slurm_mutex_lock(&repl_mutex);
+		if (_repl_done(time(NULL))) {
+			slurm_mutex_unlock(&repl_mutex);
+			break;
+		}
+		nfds = list_count(peers) + 1;
+		if (nfds > pfd_size) {
+			pfd_size = nfds * 2;
+			xrealloc(pfds, sizeof(struct pollfd) * pfd_size);
+			xrealloc(pfd_peers, sizeof(repl_peer_t *) * pfd_size);
+		}
+		pfds[0].fd = wake_fd[0];
+		pfds[0].events = POLLIN;
+		nfds = 1;
+		itr = list_iterator_create(peers);
+		while ((peer = list_next(itr))) {
+			pfds[nfds].fd = peer->fd;
+			pfds[nfds].events = POLLIN;
+			if (list_count(peer->msgs))
+				pfds[nfds].events |= POLLOUT;
+			pfd_peers[nfds++] = peer;
+		}
+		list_iterator_destroy(itr);
+		slurm_mutex_unlock(&repl_mutex);
+
+		rc = poll(pfds, nfds, 1000);
+		if ((rc < 0) && (errno != EINTR)) {
+			error("%s: poll: %m", __func__);
+			break;
+		}
+		now = time(NULL);
+
+		/* Peers are only removed by this thread */
+		slurm_mutex_lock(&repl_mutex);
+		for (i = 0; (rc > 0) && (i < nfds); i++) {
+			if (!pfds[i].revents)
+				continue;
+			if (i == 0) {
+				while (read(wake_fd[0], buf, sizeof(buf)) > 0)
+					;
+				continue;
+			}
+			peer = pfd_peers[i];
+			if (!(pfds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+				continue;
+			/* Backups send nothing, this is the close */
+			len = read(peer->fd, buf, sizeof(buf));
+			if ((len == 0) || ((len < 0) && (errno != EAGAIN) &&
+					   (errno != EINTR))) {
+				info("%s: backup controller %s closed its state replication",
+				     __func__, peer->host);
+				peer->drop = true;
+			}
+		}
+
+		/* Backups with data queued know the primary is alive */
+		if (!repl_stop &&
+		    ((now - alive_time) >= REPL_KEEPALIVE_TIME)) {
+			alive_time = now;
+			itr = list_iterator_create(peers);
+			while ((peer = list_next(itr))) {
+				if (!list_count(peer->msgs))
+					_peer_queue(peer, alive);
+			}
+			list_iterator_destroy(itr);
+		}
+
+		itr = list_iterator_create(peers);
+		while ((peer = list_next(itr))) {
+			if (peer->drop || (_peer_write(peer, now) !=
+					   SLURM_SUCCESS))
+				list_delete_item(itr);
+		}
+		list_iterator_destroy(itr);
+		slurm_mutex_unlock(&repl_mutex);
+	}
+
+	_msg_release(alive);
+	xfree(pfds);
+	xfree(pfd_peers);
+	return NULL;
+}
+
+extern void state_repl_start(void)
+{
+	if (!_configured())
+		return;
+
+	if (pipe(wake_fd) < 0) {
+		error("%s: pipe: %m", __func__);
+		return;
+	}
+	fd_set_nonblocking(wake_fd[0]);
+	fd_set_nonblocking(wake_fd[1]);
+	fd_set_close_on_exec(wake_fd[0]);
+	fd_set_close_on_exec(wake_fd[1]);
+
+	slurm_mutex_lock(&repl_mutex);
+	repl_enabled = true;
+	repl_stop = false;
+	peers = list_create(_peer_free);
+	slurm_thread_create(&repl_thread, _repl_thread, NULL);
+	slurm_mutex_unlock(&repl_mutex);
+	debug("%s: accepting backup controllers for state replication",
+	      __func__);
+}
+
+extern void state_repl_stop(void)
+{
+	pthread_t thread_id;
+	ListIterator itr;
+	repl_peer_t *peer;
+	repl_msg_t *msg;
+
+	slurm_mutex_lock(&repl_mutex);
+	thread_id = repl_thread;
+	repl_enabled = false;
+	if (!thread_id) {
+		slurm_mutex_unlock(&repl_mutex);
+		return;
+	}
+	repl_stop = true;
+	repl_stop_time = time(NULL);
+	msg = _msg_finish(_msg_start(0, REPL_MSG_CLOSE, 0));
+	msg->refcnt = 1;
+	itr = list_iterator_create(peers);
+	while ((peer = list_next(itr)))
+		_peer_queue(peer, msg);
+	list_iterator_destroy(itr);
+	_msg_release(msg);
+	slurm_mutex_unlock(&repl_mutex);
+	_wake();
+	pthread_join(thread_id, NULL);
+
+	slurm_mutex_lock(&publish_mutex);
+	slurm_mutex_lock(&repl_mutex);
+	FREE_NULL_LIST(peers);
+	_sent_clear();
+	(void) close(wake_fd[0]);
+	(void) close(wake_fd[1]);
+	wake_fd[0] = wake_fd[1] = -1;
+	repl_thread = 0;
+	slurm_mutex_unlock(&repl_mutex);
+	slurm_mutex_unlock(&publish_mutex);
+}
+
+extern bool state_repl_enabled(void)
+{
+	bool enabled;
+
+	slurm_mutex_lock(&repl_mutex);
+	enabled = repl_enabled;
+	slurm_mutex_unlock(&repl_mutex);
+
+	return enabled;
+}
+
+extern void state_repl_add(int fd, char *host)
+{
+	repl_peer_t *peer;
+
+	slurm_mutex_lock(&repl_mutex);
+	if (!repl_enabled) {
+		slurm_mutex_unlock(&repl_mutex);
+		(void) close(fd);
+		return;
+	}
+	fd_set_nonblocking(fd);
+	peer = xmalloc(sizeof(repl_peer_t));
+	peer->fd = fd;
+	peer->host = xstrdup(host);
+	peer->msgs = list_create(_msg_release);
+	list_append(peers, peer);
+	slurm_mutex_unlock(&repl_mutex);
+	_wake();
+	info("Backup controller %s connected for state replication", host);
+
+	/* Full copies go out with the next save of each file */
+	schedule_job_save();
+	schedule_node_save();
+	schedule_part_save();
+	schedule_resv_save();
+}
+
+extern bool state_repl_active(void)
+{
+	bool active;
+
+	slurm_mutex_lock(&repl_mutex);
+	active = (peers && list_count(peers));
+	slurm_mutex_unlock(&repl_mutex);
+
+	return active;
+}
+
+/* RET the save time in the header of a state file, 0 if not found */
+static time_t _header_time(Buf buffer)
+{
+	char *ver_str;
+	uint32_t len;
+	uint16_t protocol_version;
+	time_t save_time = 0;
+
+	set_buf_offset(buffer, 0);
+	if ((unpackmem_ptr(&ver_str, &len, buffer) != SLURM_SUCCESS) ||
+	    (unpack16(&protocol_version, buffer) != SLURM_SUCCESS) ||
+	    (unpack_time(&save_time, buffer) != SLURM_SUCCESS))
+		save_time = 0;
+	set_buf_offset(buffer, 0);
+	return save_time;
+}
+
+static void _replica_free(state_repl_file_t file)
+{
+	FREE_NULL_BUFFER(rep_hdr[file]);
+	rep_time[file] = 0;
+	if (rep_recs[file])
+		xhash_free(rep_recs[file]);
+}
+
+/*
+ * Apply a message of the primary controller to the replica
+ * OUT closed - set if the primary is shutting down
+ */
+static int _client_apply(Buf buffer, bool *closed)
+{
+	uint16_t file, type;
+	uint32_t hdr_len, rm_cnt, add_cnt, i;
+	uint64_t hash;
+	char *hdr = NULL, key[17];
+	repl_rec_t *rec = NULL;
+
+	safe_unpack16(&file, buffer);
+	safe_unpack16(&type, buffer);
+	if (type == REPL_MSG_CLOSE) {
+		*closed = true;
+		return SLURM_SUCCESS;
+	}
+	if (type == REPL_MSG_ALIVE)
+		return SLURM_SUCCESS;
+	if ((file >= STATE_REPL_CNT) ||
+	    ((type != REPL_MSG_FULL) && (type != REPL_MSG_DELTA)))
+		goto unpack_error;
+	if ((type == REPL_MSG_FULL) || !rep_recs[file]) {
+		if (type == REPL_MSG_DELTA)
+			goto unpack_error;	/* no full copy yet */
+		_replica_free(file);
+		rep_recs[file] = xhash_init(_rec_id, _rec_free);
+	}
+
+	safe_unpackmem_xmalloc(&hdr, &hdr_len, buffer);
+	FREE_NULL_BUFFER(rep_hdr[file]);
+	rep_hdr[file] = create_buf(hdr, hdr_len);
+	hdr = NULL;
+	rep_time[file] = _header_time(rep_hdr[file]);
+
+	safe_unpack32(&rm_cnt, buffer);
+	for (i = 0; i < rm_cnt; i++) {
+		safe_unpack64(&hash, buffer);
+		_hash_key(hash, key);
+		xhash_delete(rep_recs[file], key);
+	}
+	safe_unpack32(&add_cnt, buffer);
+	for (i = 0; i < add_cnt; i++) {
+		rec = xmalloc(sizeof(repl_rec_t));
+		safe_unpack64(&hash, buffer);
+		_hash_key(hash, rec->key);
+		safe_unpackmem_xmalloc(&rec->data, &rec->len, buffer);
+		if (xhash_get(rep_recs[file], rec->key))
+			_rec_free(rec);
+		else
+			xhash_add(rep_recs[file], rec);
+		rec = NULL;
+	}
+	debug3("%s: %s: %u records, %u added, %u removed", __func__,
+	       file_names[file], xhash_count(rep_recs[file]), add_cnt, rm_cnt);
+
+	return SLURM_SUCCESS;
+
+unpack_error:
+	error("%s: malformed state replication message", __func__);
+	if (rec)
+		_rec_free(rec);
+	xfree(hdr);
+	if (file < STATE_REPL_CNT)
+		_replica_free(file);
+	return SLURM_ERROR;
+}
+
+/* Connect to the active controller with a priority higher than ours */
+static int _client_connect(void)
+{
+	/* Locks: Read config */
+	slurmctld_lock_t config_read_lock = {
+		READ_LOCK, NO_LOCK, NO_LOCK, NO_LOCK, NO_LOCK };
+	slurm_addr_t addr;
+	slurm_msg_t req_msg, resp_msg;
+	char *host = NULL;
+	int fd = -1, i, rc;
+
+	for (i = 0; (i < backup_inx) && (fd < 0); i++) {
+		lock_slurmctld(config_read_lock);
+		slurm_set_addr(&addr, slurmctld_conf.slurmctld_port,
+			       slurmctld_conf.control_addr[i]);
+		host = xstrdup(slurmctld_conf.control_machine[i]);
+		unlock_slurmctld(config_read_lock);
+
+		if ((fd = slurm_open_msg_conn(&addr)) < 0) {
+			xfree(host);
+			continue;
+		}
+		slurm_msg_t_init(&req_msg);
+		slurm_msg_t_init(&resp_msg);
+		req_msg.msg_type = REQUEST_STATE_REPL;
+		if (slurm_send_recv_msg(fd, &req_msg, &resp_msg, 0) < 0) {
+			rc = errno ? errno : SLURM_ERROR;
+		} else {
+			if (resp_msg.auth_cred)
+				g_slurm_auth_destroy(resp_msg.auth_cred);
+			rc = slurm_get_return_code(resp_msg.msg_type,
+						   resp_msg.data);
+			slurm_free_msg_data(resp_msg.msg_type, resp_msg.data);
+		}
+		if (rc != SLURM_SUCCESS) {
+			debug2("%s: %s refused state replication: %s",
+			       __func__, host, slurm_strerror(rc));
+			(void) close(fd);
+			fd = -1;
+		} else {
+			info("Replicating the state of controller %s", host);
+		}
+		xfree(host);
+	}
+
+	return fd;
+}
+
+/* Note data from the primary or that a message is being read */
+static void _client_alive(bool receiving)
+{
+	slurm_mutex_lock(&client_mutex);
+	client_alive = time(NULL);
+	client_receiving = receiving;
+	slurm_mutex_unlock(&client_mutex);
+}
+
+static bool _client_stopped(void)
+{
+	bool stopped;
+
+	slurm_mutex_lock(&client_mutex);
+	stopped = (client_shutdown != 0);
+	slurm_mutex_unlock(&client_mutex);
+
+	return stopped;
+}
+
+/*
+ * Wait for data on fd or for state_repl_client_stop()
+ * IN fd - connection to the primary, -1 to only sleep
+ * RET 1 if fd is readable, 0 on timeout or stop, -1 on error
+ */
+static int _client_wait(int fd, int timeout)
+{
+	struct pollfd pfds[2];
+	int nfds = 1, rc;
+	char buf[16];
+
+	pfds[0].fd = client_wake_fd[0];
+	pfds[0].events = POLLIN;
+	if (fd >= 0) {
+		pfds[1].fd = fd;
+		pfds[1].events = POLLIN;
+		nfds = 2;
+	}
+	if ((rc = poll(pfds, nfds, timeout)) < 0)
+		return ((errno == EINTR) || (errno == EAGAIN)) ? 0 : -1;
+	if (pfds[0].revents) {
+		while (read(client_wake_fd[0], buf, sizeof(buf)) > 0)
+			;
+		return 0;
+	}
+	return ((nfds == 2) && pfds[1].revents) ? 1 : 0;
+}
+
+static void *_client_thread(void *no_data)
+{
+	slurm_persist_conn_t persist_conn;
+	Buf buffer;
+	bool closed;
+	int rc;
+
+#if HAVE_SYS_PRCTL_H
+	if (prctl(PR_SET_NAME, "staterepl", NULL, NULL, NULL) < 0) {
+		error("%s: cannot set my name to %s %m", __func__, "staterepl");
+	}
+#endif
+
+	while (!_client_stopped()) {
+		memset(&persist_conn, 0, sizeof(persist_conn));
+		if ((persist_conn.fd = _client_connect()) < 0) {
+			(void) _client_wait(-1, 1000);
+			continue;
+		}
+		persist_conn.shutdown = &client_shutdown;
+		persist_conn.timeout = slurm_get_msg_timeout() * 1000;
+		persist_conn.version = SLURM_PROTOCOL_VERSION;
+
+		closed = false;
+		slurm_mutex_lock(&client_mutex);
+		client_closed = false;
+		slurm_mutex_unlock(&client_mutex);
+		_client_alive(false);
+		while (!_client_stopped()) {
+			if ((rc = _client_wait(persist_conn.fd, 1000)) == 0)
+				continue;
+			if (rc < 0)
+				break;
+			/* The rest of the message follows within MessageTimeout */
+			_client_alive(true);
+			buffer = slurm_persist_recv_msg(&persist_conn);
+			_client_alive(false);
+			if (!buffer)
+				break;
+			rc = _client_apply(buffer, &closed);
+			free_buf(buffer);
+			if ((rc != SLURM_SUCCESS) || closed)
+				break;
+		}
+		(void) close(persist_conn.fd);
+
+		slurm_mutex_lock(&client_mutex);
+		if (closed) {
+			info("Primary controller shut down, state replication closed");
+			client_closed = true;
+		} else if (!client_shutdown) {
+			info("State replication stream lost");
+		}
+		slurm_mutex_unlock(&client_mutex);
+		if (closed)
+			(void) _client_wait(-1, 1000);
+	}
+
+	return NULL;
+}
+
+extern void state_repl_client_start(void)
+{
+	/* Locks: Read config */
+	slurmctld_lock_t config_read_lock = {
+		READ_LOCK, NO_LOCK, NO_LOCK, NO_LOCK, NO_LOCK };
+	bool configured;
+
+	lock_slurmctld(config_read_lock);
+	configured = _configured();
+	unlock_slurmctld(config_read_lock);
+	if (!configured || (backup_inx <= 0))
+		return;
+
+	if (pipe(client_wake_fd) < 0) {
+		error("%s: pipe: %m", __func__);
+		return;
+	}
+	fd_set_nonblocking(client_wake_fd[0]);
+	fd_set_nonblocking(client_wake_fd[1]);
+	fd_set_close_on_exec(client_wake_fd[0]);
+	fd_set_close_on_exec(client_wake_fd[1]);
+
+	slurm_mutex_lock(&client_mutex);
+	client_shutdown = 0;
+	client_alive = 0;
+	client_closed = false;
+	client_receiving = false;
+	slurm_thread_create(&client_thread, _client_thread, NULL);
+	slurm_mutex_unlock(&client_mutex);
+}
+
+extern bool state_repl_client_silent(void)
+{
+	bool silent;
+
+	slurm_mutex_lock(&client_mutex);
+	silent = (!client_shutdown && client_alive && !client_closed &&
+		  !client_receiving &&
+		  ((time(NULL) - client_alive) > REPL_DEAD_TIME));
+	slurm_mutex_unlock(&client_mutex);
+
+	return silent;
+}
+
+extern void state_repl_client_stop(void)
+{
+	pthread_t thread_id;
+	char c = 0;
+
+	slurm_mutex_lock(&client_mutex);
+	thread_id = client_thread;
+	client_shutdown = time(NULL);
+	slurm_mutex_unlock(&client_mutex);
+	if (!thread_id)
+		return;
+	if (write(client_wake_fd[1], &c, 1) < 0)
+		debug("%s: write: %m", __func__);
+	pthread_join(thread_id, NULL);
+	client_thread = 0;
+	(void) close(client_wake_fd[0]);
+	(void) close(client_wake_fd[1]);
+	client_wake_fd[0] = client_wake_fd[1] = -1;
+}
+
+typedef struct {
+	char *data;
+	uint32_t offset;
+} copy_rec_arg_t;
+
+static void _copy_rec(void *item, void *arg)
+{
+	repl_rec_t *rec = (repl_rec_t *) item;
+	copy_rec_arg_t *copy_arg = (copy_rec_arg_t *) arg;
+
+	memcpy(copy_arg->data + copy_arg->offset, rec->data, rec->len);
+	copy_arg->offset += rec->len;
+}
+
+static void _sum_rec(void *item, void *arg)
+{
+	*(uint64_t *) arg += ((repl_rec_t *) item)->len;
+}
+
+extern Buf state_repl_open(state_repl_file_t file, char *state_file)
+{
+	copy_rec_arg_t copy_arg;
+	uint64_t size = 0;
+	time_t file_time;
+	Buf buffer;
+
+	if (!rep_hdr[file] || !rep_time[file])
+		return NULL;
+
+	if ((buffer = create_mmap_buf(state_file))) {
+		file_time = _header_time(buffer);
+		free_buf(buffer);
+		if (file_time > rep_time[file]) {
+			info("%s was saved after the last state replication, reading it",
+			     state_file);
+			return NULL;
+		}
+	}
+
+	xhash_walk(rep_recs[file], _sum_rec, &size);
+	size += size_buf(rep_hdr[file]);
+	if (size > MAX_BUF_SIZE) {
+		error("%s: %s replica too large", __func__, file_names[file]);
+		return NULL;
+	}
+	copy_arg.data = xmalloc_nz(size);
+	memcpy(copy_arg.data, get_buf_data(rep_hdr[file]),
+	       size_buf(rep_hdr[file]));
+	copy_arg.offset = size_buf(rep_hdr[file]);
+	xhash_walk(rep_recs[file], _copy_rec, &copy_arg);
+
+	info("Recovering %s from the state replica (%u records)",
+	     file_names[file], xhash_count(rep_recs[file]));
+	return create_buf(copy_arg.data, size);
+}
+
+extern void state_repl_client_fini(void)
+{
+	int i;
+
+	state_repl_client_stop();
+	for (i = 0; i < STATE_REPL_CNT; i++)
+		_replica_free(i);
+}
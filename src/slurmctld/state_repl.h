@@ -0,0 +1,126 @@
+/*****************************************************************************\
+ *  state_repl.h - stream saved state to standby controllers
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  In addition, as a special exception, the copyright holders give permission
+ *  to link the code of portions of this program with the OpenSSL library under
+ *  certain conditions as described in each individual source file, and
+ *  distribute linked combinations including the two. You must obey the GNU
+ *  General Public License in all respects for all of the code used other than
+ *  OpenSSL. If you modify file(s) with this exception, you may extend this
+ *  exception to your version of the file(s), but you are not obligated to do
+ *  so. If you do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source files in
+ *  the program, then also delete it here.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#ifndef _HAVE_STATE_REPL_H
+#define _HAVE_STATE_REPL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "src/common/pack.h"
+
+/* State save files replicated to the backup controllers */
+typedef enum {
+	STATE_REPL_JOB,
+	STATE_REPL_NODE,
+	STATE_REPL_PART,
+	STATE_REPL_RESV,
+	STATE_REPL_CNT
+} state_repl_file_t;
+
+/*
+ * Primary controller: read the "state_replication" option of
+ * SlurmctldParameters and, if set, start the thread streaming state to
+ * backup controllers
+ */
+extern void state_repl_start(void);
+
+/*
+ * Send what remains queued and a clean close to every backup controller,
+ * then stop the thread. Call after the final state save.
+ */
+extern void state_repl_stop(void);
+
+/* RET true if the primary accepts REQUEST_STATE_REPL */
+extern bool state_repl_enabled(void);
+
+/*
+ * Hand the connection of a backup controller which sent REQUEST_STATE_REPL
+ * over to the replication thread. It first receives every state file in
+ * full, then the changes of each later save.
+ * IN fd - connection of the backup, closed by the replication thread
+ * IN host - name of the backup, for logging
+ */
+extern void state_repl_add(int fd, char *host);
+
+/*
+ * RET true if a backup controller is connected, in which case the callers
+ * of state_repl_publish() should find the offsets of their records
+ */
+extern bool state_repl_active(void);
+
+/*
+ * Queue the content of a state file just written to the backup controllers.
+ * Records which did not change since the last call are not sent again.
+ * IN file - the state file
+ * IN buffer - the content of the file
+ * IN rec_off - offset in buffer of each record, which ends where the next
+ *	one starts or at the end of the buffer. Everything before the first
+ *	record is the file header. NULL if the buffer is sent as one header.
+ * IN rec_cnt - count of records in rec_off
+ */
+extern void state_repl_publish(state_repl_file_t file, Buf buffer,
+			       uint32_t *rec_off, uint32_t rec_cnt);
+
+/*
+ * Backup controller: if "state_replication" is configured, start the thread
+ * maintaining a replica of the state of the primary controller
+ */
+extern void state_repl_client_start(void);
+
+/*
+ * RET true if the replication stream was established but nothing, not even
+ * a keepalive, was received from the primary controller for several seconds
+ * and it could not be reconnected, which is what happens if the primary
+ * died or is unreachable. False after the primary announced its shutdown.
+ */
+extern bool state_repl_client_silent(void);
+
+/* Stop updating the replica, which is kept for state_repl_open() */
+extern void state_repl_client_stop(void);
+
+/*
+ * Get a state file from the replica rather than from StateSaveLocation
+ * IN file - the state file
+ * IN state_file - path of the file, used if it was saved after the replica
+ *	was last updated
+ * RET buffer with the content of the file or NULL to read state_file
+ */
+extern Buf state_repl_open(state_repl_file_t file, char *state_file);
+
+/* Free the replica once the state of the primary controller is recovered */
+extern void state_repl_client_fini(void);
+
+#endif	/* !_HAVE_STATE_REPL_H */
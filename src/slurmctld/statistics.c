@@ -36,17 +36,97 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 
 #include "src/slurmctld/agent.h"
 #include "src/slurmctld/slurmctld.h"
 #include "src/common/list.h"
 #include "src/common/pack.h"
+#include "src/common/xmalloc.h"
 #include "src/common/xstring.h"
 #include "src/common/slurmdbd_defs.h"
 
+#define STATS_HISTORY_CNT	1440	/* one day of per minute samples */
+
+typedef struct {
+	time_t sample_time;
+	uint32_t sched_cycles;		/* main scheduler cycles run */
+	uint32_t sched_mean;		/* their mean time, usec */
+	uint32_t bf_cycles;		/* backfill cycles run */
+	uint32_t bf_mean;		/* their mean time, usec */
+	uint32_t agent_queue;		/* at sample time */
+	uint32_t dbd_queue;
+	uint32_t server_threads;
+	uint32_t jobs_pending;
+	uint32_t jobs_running;
+} stats_sample_t;
+
+static pthread_mutex_t history_mutex = PTHREAD_MUTEX_INITIALIZER;
+static stats_sample_t history[STATS_HISTORY_CNT];
+static uint32_t history_cnt = 0;	/* valid samples */
+static uint32_t history_next = 0;	/* next sample to write */
+
 extern int retry_list_size(void);
 
+static int _latency_inx(uint64_t usec)
+{
+	int msb;
+
+	if (usec > UINT32_MAX)
+		usec = UINT32_MAX;
+	if (usec < (1 << LATENCY_SUB_BITS))
+		return usec;
+	msb = 63 - __builtin_clzll(usec);
+	return ((msb - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS) +
+	       ((usec >> (msb - LATENCY_SUB_BITS)) &
+		((1 << LATENCY_SUB_BITS) - 1));
+}
+
+/* Highest latency falling in a histogram bucket */
+static uint32_t _latency_bucket_max(int inx)
+{
+	int shift;
+	uint64_t usec;
+
+	if (inx < (1 << LATENCY_SUB_BITS))
+		return inx;
+	shift = (inx >> LATENCY_SUB_BITS) - 1;
+	usec = ((uint64_t) ((1 << LATENCY_SUB_BITS) +
+			    (inx & ((1 << LATENCY_SUB_BITS) - 1))) << shift) +
+	       (1 << shift) - 1;
+	return MIN(usec, UINT32_MAX);
+}
+
+/* Record a latency in microseconds in a histogram */
+extern void latency_hist_add(latency_hist_t *hist, uint64_t usec)
+{
+	hist->cnt++;
+	hist->bucket[_latency_inx(usec)]++;
+	if (usec > hist->max)
+		hist->max = MIN(usec, UINT32_MAX);
+}
+
+/*
+ * Return the latency in microseconds under which pct percent of those in
+ * the histogram are, or 0 if it is empty
+ */
+extern uint32_t latency_hist_percentile(latency_hist_t *hist, uint32_t pct)
+{
+	uint64_t target, sum = 0;
+	int i;
+
+	if (!hist->cnt)
+		return 0;
+	target = (((uint64_t) hist->cnt * pct) + 99) / 100;
+	for (i = 0; i < LATENCY_BUCKETS; i++) {
+		sum += hist->bucket[i];
+		if (sum >= target)
+			return MIN(_latency_bucket_max(i), hist->max);
+	}
+	return hist->max;
+}
+
 /* Pack all scheduling statistics */
 extern void pack_all_stat(int resp, char **buffer_ptr, int *buffer_size,
 			  uint16_t protocol_version)
@@ -131,6 +211,21 @@ extern void pack_all_stat(int resp, char **buffer_ptr, int *buffer_size,
 			pack32(slurmctld_diag_stats.bf_active, buffer);
 			pack32(slurmctld_diag_stats.backfilled_pack_jobs,
 			       buffer);
+
+			pack32(slurmctld_diag_stats.rpc_workers, buffer);
+			pack32(slurmctld_diag_stats.rpc_queue_len, buffer);
+			pack32(slurmctld_diag_stats.rpc_queue_len_max, buffer);
+			pack32(slurmctld_diag_stats.rpc_queue_cnt, buffer);
+			pack64(slurmctld_diag_stats.rpc_queue_wait_sum, buffer);
+			pack32(slurmctld_diag_stats.rpc_queue_wait_max, buffer);
+
+			pack32(slurmctld_diag_stats.bf_parallel, buffer);
+			pack32(slurmctld_diag_stats.bf_last_spec_cnt, buffer);
+			pack32(slurmctld_diag_stats.bf_last_spec_used, buffer);
+			pack64(slurmctld_diag_stats.bf_last_spec_time, buffer);
+			pack64(slurmctld_diag_stats.bf_last_spec_wall, buffer);
+			pack32(slurmctld_diag_stats.bf_plan_jobs, buffer);
+			pack_time(slurmctld_diag_stats.bf_plan_time, buffer);
 		}
 	} else if (protocol_version >= SLURM_17_11_PROTOCOL_VERSION) {
 		parts_packed = resp;
@@ -286,6 +381,126 @@ extern void reset_stats(int level)
 	slurmctld_diag_stats.bf_last_depth = 0;
 	slurmctld_diag_stats.bf_last_depth_try = 0;
 	slurmctld_diag_stats.bf_active = 0;
+	slurmctld_diag_stats.bf_last_spec_cnt = 0;
+	slurmctld_diag_stats.bf_last_spec_used = 0;
+	slurmctld_diag_stats.bf_last_spec_time = 0;
+	slurmctld_diag_stats.bf_last_spec_wall = 0;
+	slurmctld_diag_stats.bf_plan_jobs = 0;
+
+	slurmctld_diag_stats.rpc_queue_len_max = 0;
+	slurmctld_diag_stats.rpc_queue_cnt = 0;
+	slurmctld_diag_stats.rpc_queue_wait_sum = 0;
+	slurmctld_diag_stats.rpc_queue_wait_max = 0;
 
 	last_proc_req_start = time(NULL);
 }
+
+/*
+ * Record the scheduling and queue statistics of the last minute in the
+ * history reported by sdiag, if a minute elapsed since the last sample
+ */
+extern void sample_stats_history(time_t now)
+{
+	static time_t last_sample = 0;
+	static uint32_t last_sched_cycles = 0, last_sched_sum = 0;
+	static uint32_t last_bf_cycles = 0;
+	static uint64_t last_bf_sum = 0;
+	uint32_t sched_cycles, sched_sum, bf_cycles;
+	uint64_t bf_sum;
+	stats_sample_t *sample;
+	int dbd_queue = 0;
+
+	if (!last_sample) {
+		last_sample = now;
+		last_sched_cycles = slurmctld_diag_stats.schedule_cycle_counter;
+		last_sched_sum = slurmctld_diag_stats.schedule_cycle_sum;
+		last_bf_cycles = slurmctld_diag_stats.bf_cycle_counter;
+		last_bf_sum = slurmctld_diag_stats.bf_cycle_sum;
+		return;
+	}
+	if (difftime(now, last_sample) < 60)
+		return;
+	last_sample = now;
+
+	/* The counters restart from zero when the statistics are reset */
+	sched_cycles = slurmctld_diag_stats.schedule_cycle_counter;
+	sched_sum = slurmctld_diag_stats.schedule_cycle_sum;
+	if (sched_cycles >= last_sched_cycles) {
+		sched_cycles -= last_sched_cycles;
+		sched_sum -= last_sched_sum;
+	}
+	bf_cycles = slurmctld_diag_stats.bf_cycle_counter;
+	bf_sum = slurmctld_diag_stats.bf_cycle_sum;
+	if (bf_cycles >= last_bf_cycles) {
+		bf_cycles -= last_bf_cycles;
+		bf_sum -= last_bf_sum;
+	}
+	last_sched_cycles = slurmctld_diag_stats.schedule_cycle_counter;
+	last_sched_sum = slurmctld_diag_stats.schedule_cycle_sum;
+	last_bf_cycles = slurmctld_diag_stats.bf_cycle_counter;
+	last_bf_sum = slurmctld_diag_stats.bf_cycle_sum;
+
+	if (acct_storage_g_get_data(acct_db_conn,
+				    ACCT_STORAGE_INFO_AGENT_COUNT,
+				    &dbd_queue) != SLURM_SUCCESS)
+		dbd_queue = 0;
+
+	slurm_mutex_lock(&history_mutex);
+	sample = &history[history_next];
+	sample->sample_time = now;
+	sample->sched_cycles = sched_cycles;
+	sample->sched_mean = sched_cycles ? (sched_sum / sched_cycles) : 0;
+	sample->bf_cycles = bf_cycles;
+	sample->bf_mean = bf_cycles ? (bf_sum / bf_cycles) : 0;
+	sample->agent_queue = retry_list_size();
+	sample->dbd_queue = dbd_queue;
+	sample->server_threads = slurmctld_config.server_thread_count;
+	sample->jobs_pending = slurmctld_diag_stats.jobs_pending;
+	sample->jobs_running = slurmctld_diag_stats.jobs_running;
+	history_next = (history_next + 1) % STATS_HISTORY_CNT;
+	if (history_cnt < STATS_HISTORY_CNT)
+		history_cnt++;
+	slurm_mutex_unlock(&history_mutex);
+}
+
+/* Pack the per minute statistics history, oldest first */
+extern void pack_stats_history(Buf buffer, uint16_t protocol_version)
+{
+	uint32_t i, first, *values;
+	stats_sample_t *sample;
+
+	if (protocol_version < SLURM_18_08_PROTOCOL_VERSION)
+		return;
+
+	slurm_mutex_lock(&history_mutex);
+	first = (history_next + STATS_HISTORY_CNT - history_cnt) %
+		STATS_HISTORY_CNT;
+	pack32(history_cnt, buffer);
+	for (i = 0; i < history_cnt; i++) {
+		sample = &history[(first + i) % STATS_HISTORY_CNT];
+		pack_time(sample->sample_time, buffer);
+	}
+
+#define PACK_HISTORY(field)						\
+	do {								\
+		for (i = 0; i < history_cnt; i++) {			\
+			sample = &history[(first + i) % STATS_HISTORY_CNT]; \
+			values[i] = sample->field;			\
+		}							\
+		pack32_array(values, history_cnt, buffer);		\
+	} while (0)
+
+	values = xmalloc(sizeof(uint32_t) * (history_cnt + 1));
+	PACK_HISTORY(sched_cycles);
+	PACK_HISTORY(sched_mean);
+	PACK_HISTORY(bf_cycles);
+	PACK_HISTORY(bf_mean);
+	PACK_HISTORY(agent_queue);
+	PACK_HISTORY(dbd_queue);
+	PACK_HISTORY(server_threads);
+	PACK_HISTORY(jobs_pending);
+	PACK_HISTORY(jobs_running);
+	xfree(values);
+#undef PACK_HISTORY
+	slurm_mutex_unlock(&history_mutex);
+}
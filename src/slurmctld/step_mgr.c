@@ -71,6 +71,7 @@
 #include "src/common/xstring.h"
 
 #include "src/slurmctld/agent.h"
+#include "src/slurmctld/job_timer.h"
 #include "src/slurmctld/locks.h"
 #include "src/slurmctld/node_scheduler.h"
 #include "src/slurmctld/port_mgr.h"
@@ -2745,6 +2746,8 @@ step_create(job_step_create_request_msg_t *step_specs,
 	step_set_alloc_tres(step_ptr, node_count, false, true);
 
 	jobacct_storage_g_step_start(acct_db_conn, step_ptr);
+	if (step_ptr->time_limit != INFINITE)
+		job_timer_arm(job_ptr);
 	return SLURM_SUCCESS;
 }
 
@@ -4625,8 +4628,10 @@ extern int update_step(step_update_request_msg_t *req, uid_t uid)
 			     req->job_id, req->step_id, req->time_limit);
 		}
 	}
-	if (mod_cnt)
+	if (mod_cnt) {
 		last_job_update = time(NULL);
+		job_timer_arm(job_ptr);
+	}
 	if (new_step) {
 		/*
 		 * This was a temporary step record, never linked to the job,
@@ -173,6 +173,8 @@ static int  _terminate_all_steps(uint32_t jobid, bool batch);
 static int  _receive_fd(int socket);
 static void _rpc_launch_tasks(slurm_msg_t *);
 static void _rpc_abort_job(slurm_msg_t *);
+static void _rpc_composite(slurm_msg_t *msg);
+static void *_rpc_composite_part(void *arg);
 static void _rpc_batch_job(slurm_msg_t *msg, bool new_msg);
 static void _rpc_prolog(slurm_msg_t *msg);
 static void _rpc_job_notify(slurm_msg_t *);
@@ -355,6 +357,11 @@ slurmd_req(slurm_msg_t *msg)
 		last_slurmctld_msg = time(NULL);
 		_rpc_terminate_job(msg);
 		break;
+	case REQUEST_COMPOSITE:
+		debug2("Processing RPC: REQUEST_COMPOSITE");
+		last_slurmctld_msg = time(NULL);
+		_rpc_composite(msg);
+		break;
 	case REQUEST_COMPLETE_BATCH_SCRIPT:
 		debug2("Processing RPC: REQUEST_COMPLETE_BATCH_SCRIPT");
 		_rpc_complete_batch(msg);
@@ -5583,6 +5590,68 @@ done:
 	_epilog_complete(req->job_id, rc);
 }
 
+/*
+ * Requests which slurmctld coalesces into REQUEST_COMPOSITE. Their handlers
+ * all cope with having no connection to reply on, as happens to them anyway
+ * once they have acknowledged the request and start waiting for the job's
+ * steps and epilog.
+ */
+static bool _composite_part_type(uint16_t msg_type)
+{
+	return ((msg_type == REQUEST_TERMINATE_JOB)	||
+		(msg_type == REQUEST_KILL_TIMELIMIT)	||
+		(msg_type == REQUEST_KILL_PREEMPTED));
+}
+
+/*
+ * Acknowledge a REQUEST_COMPOSITE from slurmctld as a whole, then process
+ * each of the requests it carries in a thread of its own, just as if each
+ * had arrived on a connection that was already closed.
+ */
+static void
+_rpc_composite(slurm_msg_t *msg)
+{
+	composite_msg_t *comp_msg = msg->data;
+	slurm_msg_t *part_msg;
+	uid_t uid = g_slurm_auth_get_uid(msg->auth_cred, conf->auth_info);
+
+	if (!_slurm_authorized_user(uid)) {
+		error("Security violation: composite req from uid %d", uid);
+		slurm_send_rc_msg(msg, ESLURM_USER_ID_MISSING);
+		return;
+	}
+
+	slurm_send_rc_msg(msg, SLURM_SUCCESS);
+	if (!comp_msg->msg_list)
+		return;
+
+	debug2("%s: %d requests", __func__, list_count(comp_msg->msg_list));
+	while ((part_msg = list_pop(comp_msg->msg_list))) {
+		if (!_composite_part_type(part_msg->msg_type)) {
+			error("%s: invalid request msg type %u", __func__,
+			      part_msg->msg_type);
+			slurm_free_comp_msg_list(part_msg);
+			continue;
+		}
+		part_msg->conn_fd = -1;
+		memcpy(&part_msg->address, &msg->address,
+		       sizeof(slurm_addr_t));
+		memcpy(&part_msg->orig_addr, &msg->orig_addr,
+		       sizeof(slurm_addr_t));
+		slurm_thread_create_detached(NULL, _rpc_composite_part,
+					     part_msg);
+	}
+}
+
+static void *_rpc_composite_part(void *arg)
+{
+	slurm_msg_t *msg = arg;
+
+	slurmd_req(msg);
+	slurm_free_comp_msg_list(msg);
+	return NULL;
+}
+
 /* On a parallel job, every slurmd may send the EPILOG_COMPLETE
  * message to the slurmctld at the same time, resulting in lost
  * messages. We add a delay here to spead out the message traffic
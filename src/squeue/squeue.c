@@ -65,6 +65,8 @@ static int  _get_info(bool clear_old);
 static int  _get_window_width( void );
 static void _print_date( void );
 static int  _multi_cluster(List clusters);
+static void _build_info_filter(info_filter_t *filter);
+static uint32_t *_list_to_array(List list, uint32_t *cnt);
 static int  _print_job ( bool clear_old );
 static int  _print_job_steps( bool clear_old );
 
@@ -163,15 +165,73 @@ _get_window_width( void )
 }
 
 
+static uint32_t *_list_to_array(List list, uint32_t *cnt)
+{
+	ListIterator iter;
+	uint32_t *array, *value;
+	int i = 0;
+
+	*cnt = list_count(list);
+	array = xmalloc(sizeof(uint32_t) * (*cnt));
+	iter = list_iterator_create(list);
+	while ((value = list_next(iter)))
+		array[i++] = *value;
+	list_iterator_destroy(iter);
+
+	return array;
+}
+
+/*
+ * _build_info_filter - describe the jobs selected by the command line so the
+ *	controller can leave out the others, _filter_job() still applies
+ */
+static void _build_info_filter(info_filter_t *filter)
+{
+	static uint32_t default_states[] = {
+		JOB_PENDING, JOB_RUNNING, JOB_SUSPENDED,
+		JOB_STAGE_OUT, JOB_COMPLETING };
+
+	filter->accounts = params.accounts;
+	filter->names = params.names;
+	filter->partitions = params.partitions;
+	if (params.nodes) {
+		char hostlist[8192];
+
+		/* Leave a truncated list to _filter_job() */
+		if (hostset_ranged_string(params.nodes, sizeof(hostlist),
+					  hostlist) >= 0)
+			filter->nodes = xstrdup(hostlist);
+	}
+	if (params.state_list) {
+		filter->states = _list_to_array(params.state_list,
+						&filter->state_cnt);
+	} else {
+		filter->states = default_states;
+		filter->state_cnt = sizeof(default_states) /
+				    sizeof(default_states[0]);
+	}
+	if (params.user_list) {
+		filter->user_ids = _list_to_array(params.user_list,
+						  &filter->user_cnt);
+	}
+}
+
 /* _print_job - print the specified job's information */
 static int
 _print_job ( bool clear_old )
 {
 	static job_info_msg_t *old_job_ptr;
+	static info_filter_t filter;
+	static bool filter_set = false;
 	job_info_msg_t *new_job_ptr = NULL;
 	int error_code;
 	uint16_t show_flags = 0;
 
+	if (!filter_set) {
+		_build_info_filter(&filter);
+		filter_set = true;
+	}
+
 	if (params.all_flag || (params.job_list && list_count(params.job_list)))
 		show_flags |= SHOW_ALL;
 	if (params.federation_flag)
@@ -199,9 +259,9 @@ _print_job ( bool clear_old )
 		} else {
 			if (params.clusters)
 				show_flags |= SHOW_LOCAL;
-			error_code = slurm_load_jobs(
-				old_job_ptr->last_update,
-				&new_job_ptr, show_flags);
+			error_code = slurm_load_job_changes(
+				old_job_ptr, &new_job_ptr, show_flags,
+				&filter);
 		}
 		if (error_code ==  SLURM_SUCCESS)
 			slurm_free_job_info_msg( old_job_ptr );
@@ -216,8 +276,8 @@ _print_job ( bool clear_old )
 		error_code = slurm_load_job_user(&new_job_ptr, params.user_id,
 						 show_flags);
 	} else {
-		error_code = slurm_load_jobs((time_t) NULL, &new_job_ptr,
-					     show_flags);
+		error_code = slurm_load_job_changes(NULL, &new_job_ptr,
+						    show_flags, &filter);
 	}
 
 	if (error_code) {
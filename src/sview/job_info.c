@@ -3485,8 +3485,9 @@ extern int get_new_info_job(job_info_msg_t **info_ptr,
 	if (g_job_info_ptr) {
 		if (show_flags != last_flags)
 			g_job_info_ptr->last_update = 0;
-		error_code = slurm_load_jobs(g_job_info_ptr->last_update,
-					     &new_job_ptr, show_flags);
+		error_code = slurm_load_job_changes(g_job_info_ptr,
+						    &new_job_ptr, show_flags,
+						    NULL);
 		if (error_code == SLURM_SUCCESS) {
 			slurm_free_job_info_msg(g_job_info_ptr);
 			changed = 1;
@@ -3497,8 +3498,8 @@ extern int get_new_info_job(job_info_msg_t **info_ptr,
 		}
 	} else {
 		new_job_ptr = NULL;
-		error_code = slurm_load_jobs((time_t) NULL, &new_job_ptr,
-					     show_flags);
+		error_code = slurm_load_job_changes(NULL, &new_job_ptr,
+						    show_flags, NULL);
 		changed = 1;
 	}
 
@@ -0,0 +1,593 @@
+/*****************************************************************************\
+ *  agent_fanout-tst.c - measure how fast slurmctld agents reach many nodes
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <slurm/slurm.h>
+#include <slurm/slurm_errno.h>
+
+#include "src/common/slurm_xlator.h"
+#include "src/common/pack.h"
+#include "src/common/slurm_protocol_api.h"
+#include "src/common/slurm_protocol_defs.h"
+
+/*
+ * Emulate the slurmd of every node in slurm.conf from this one process and
+ * time how long slurmctld takes to broadcast REQUEST_RECONFIGURE to all of
+ * them, then to launch and cancel jobs spanning all nodes (the cancel
+ * fans REQUEST_TERMINATE_JOB out over TreeWidth and waits for each node's
+ * epilog complete message). Run it once with SlurmctldParameters=
+ * agent_engine and once without to compare the agent engine with the
+ * thread per node group model. If the pid of slurmctld is given, its peak
+ * thread count during each phase is reported as well.
+ *
+ * With -s, a number of single CPU jobs per node is then started and all of
+ * them cancelled at once, reporting how long the nodes take to become idle
+ * and how many connections that took. This requires a select plugin which
+ * shares nodes between jobs (e.g. select/cons_res with CR_CPU) and is meant
+ * to compare SlurmctldParameters=agent_coalesce_wait=# with the default.
+ *
+ * Nodes need distinct addresses on this host which all reach SlurmdPort,
+ * for example:
+ *   NodeName=n[0001-1000] NodeAddr=127.1.[0-3].[0-249] ...
+ * Start slurmctld, then this program, which waits for all nodes to be
+ * marked responding before starting.
+ *
+ * Usage: agent_fanout-tst [-j jobs] [-r reconfigures] [-s jobs_per_node]
+ *			   [-p slurmctld_pid]
+ */
+
+typedef struct node_addr {
+	char *addr;
+	char *name;
+	node_info_t *info;
+} node_addr_t;
+
+static node_addr_t *nodes = NULL;
+static int node_cnt = 0;
+static node_info_msg_t *node_table = NULL;
+
+static pthread_mutex_t cnt_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cnt_cond = PTHREAD_COND_INITIALIZER;
+static int reconfig_cnt = 0, terminate_cnt = 0, msg_cnt = 0;
+
+static pid_t ctld_pid = 0;
+static int peak_threads = 0;
+static volatile int sampling = 1;
+
+static double _now(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+static int _sort_addr(const void *a, const void *b)
+{
+	return strcmp(((node_addr_t *) a)->addr, ((node_addr_t *) b)->addr);
+}
+
+static node_addr_t *_node(int fd)
+{
+	struct sockaddr_in sin;
+	socklen_t len = sizeof(sin);
+	node_addr_t key, *match;
+	char buf[INET_ADDRSTRLEN];
+
+	if (getsockname(fd, (struct sockaddr *) &sin, &len) < 0)
+		return NULL;
+	key.addr = (char *) inet_ntop(AF_INET, &sin.sin_addr, buf, sizeof(buf));
+	if (!key.addr)
+		return NULL;
+	match = bsearch(&key, nodes, node_cnt, sizeof(node_addr_t), _sort_addr);
+	return match;
+}
+
+/* Register the node with its configured resources and our version, so
+ * slurmctld treats it as a current slurmd */
+static void _register(node_addr_t *node)
+{
+	slurm_node_registration_status_msg_t req;
+	acct_gather_energy_t energy;
+	slurm_msg_t msg;
+	int rc;
+
+	memset(&req, 0, sizeof(req));
+	memset(&energy, 0, sizeof(energy));
+	req.timestamp = time(NULL);
+	req.slurmd_start_time = req.timestamp;
+	req.node_name = node->name;
+	req.cpus = node->info->cpus;
+	req.boards = node->info->boards;
+	req.sockets = node->info->sockets;
+	req.cores = node->info->cores;
+	req.threads = node->info->threads;
+	req.real_memory = node->info->real_memory;
+	req.tmp_disk = node->info->tmp_disk;
+	req.up_time = 1000;
+	req.hash_val = NO_VAL;
+	req.energy = &energy;
+	/* Empty GRES configuration, as packed by a slurmd without gres.conf */
+	req.gres_info = init_buf(64);
+	pack16(SLURM_PROTOCOL_VERSION, req.gres_info);
+	pack16(0, req.gres_info);
+
+	slurm_msg_t_init(&msg);
+	msg.msg_type = MESSAGE_NODE_REGISTRATION_STATUS;
+	msg.data = &req;
+	if (slurm_send_recv_controller_rc_msg(&msg, &rc, NULL) < 0)
+		fprintf(stderr, "register %s: %m\n", node->name);
+	free_buf(req.gres_info);
+}
+
+static void _epilog_complete(uint32_t job_id, char *node_name)
+{
+	epilog_complete_msg_t req;
+	slurm_msg_t msg;
+
+	memset(&req, 0, sizeof(req));
+	req.job_id = job_id;
+	req.return_code = 0;
+	req.node_name = node_name;
+
+	slurm_msg_t_init(&msg);
+	msg.msg_type = MESSAGE_EPILOG_COMPLETE;
+	msg.data = &req;
+	/* As in slurmd, slurmctld does not reply to this message */
+	if (slurm_send_only_controller_msg(&msg, NULL) < 0)
+		fprintf(stderr, "epilog complete %s: %m\n", node_name);
+}
+
+/* Service one connection as slurmd would, forwarding down the tree */
+static void *_slurmd_conn(void *arg)
+{
+	int fd = (int) (long) arg;
+	slurm_addr_t cli_addr;
+	slurm_msg_t msg, *part_msg;
+	composite_msg_t *comp_msg;
+	uint32_t job_id = 0, *job_ids = NULL;
+	int i, job_id_cnt = 0;
+	ListIterator iter;
+	node_addr_t *node;
+	char *node_name = NULL;
+	bool reg = false;
+
+	slurm_msg_t_init(&msg);
+	if (slurm_get_peer_addr(fd, &cli_addr) ||
+	    slurm_receive_msg_and_forward(fd, &cli_addr, &msg, 0)) {
+		close(fd);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&cnt_mutex);
+	msg_cnt++;
+	if (msg.msg_type == REQUEST_RECONFIGURE)
+		reconfig_cnt++;
+	pthread_mutex_unlock(&cnt_mutex);
+
+	if ((node = _node(fd)))
+		node_name = node->name;
+	switch (msg.msg_type) {
+	case REQUEST_RECONFIGURE:
+	case REQUEST_SHUTDOWN:
+		break;	/* no reply expected */
+	case REQUEST_NODE_REGISTRATION_STATUS:
+		reg = true;
+		slurm_send_rc_msg(&msg, SLURM_SUCCESS);
+		break;
+	case REQUEST_TERMINATE_JOB:
+	case REQUEST_KILL_TIMELIMIT:
+	case REQUEST_KILL_PREEMPTED:
+		job_id = ((kill_job_msg_t *) msg.data)->job_id;
+		job_ids = &job_id;
+		job_id_cnt = 1;
+		slurm_send_rc_msg(&msg, SLURM_SUCCESS);
+		break;
+	case REQUEST_COMPOSITE:
+		/* Terminate requests coalesced by slurmctld */
+		comp_msg = msg.data;
+		job_ids = calloc(slurm_list_count(comp_msg->msg_list),
+				 sizeof(uint32_t));
+		iter = slurm_list_iterator_create(comp_msg->msg_list);
+		while ((part_msg = slurm_list_next(iter))) {
+			job_ids[job_id_cnt++] =
+				((kill_job_msg_t *) part_msg->data)->job_id;
+		}
+		slurm_list_iterator_destroy(iter);
+		/* fall through */
+	default:
+		slurm_send_rc_msg(&msg, SLURM_SUCCESS);
+		break;
+	}
+	close(fd);
+
+	if (reg && node)
+		_register(node);
+	for (i = 0; node_name && (i < job_id_cnt); i++) {
+		_epilog_complete(job_ids[i], node_name);
+		pthread_mutex_lock(&cnt_mutex);
+		terminate_cnt++;
+		pthread_mutex_unlock(&cnt_mutex);
+	}
+	if (job_ids != &job_id)
+		free(job_ids);
+	pthread_mutex_lock(&cnt_mutex);
+	pthread_cond_broadcast(&cnt_cond);
+	pthread_mutex_unlock(&cnt_mutex);
+
+	slurm_free_msg_members(&msg);
+	return NULL;
+}
+
+static void *_slurmd_listen(void *arg)
+{
+	int listen_fd = (int) (long) arg, fd;
+	pthread_attr_t attr;
+	pthread_t tid;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	pthread_attr_setstacksize(&attr, 256 * 1024);
+	while (1) {
+		if ((fd = accept(listen_fd, NULL, NULL)) < 0) {
+			if (errno != EINTR)
+				perror("accept");
+			continue;
+		}
+		while (pthread_create(&tid, &attr, _slurmd_conn,
+				      (void *) (long) fd))
+			usleep(1000);
+	}
+	return NULL;
+}
+
+/* Track the peak thread count of slurmctld */
+static void *_sample_threads(void *arg)
+{
+	char path[64], line[128];
+	FILE *fp;
+	int cnt;
+
+	snprintf(path, sizeof(path), "/proc/%d/status", (int) ctld_pid);
+	while (sampling) {
+		if ((fp = fopen(path, "r"))) {
+			while (fgets(line, sizeof(line), fp)) {
+				if ((sscanf(line, "Threads: %d", &cnt) == 1) &&
+				    (cnt > peak_threads))
+					peak_threads = cnt;
+			}
+			fclose(fp);
+		}
+		usleep(5000);
+	}
+	return NULL;
+}
+
+static int _reset_peak(void)
+{
+	int peak = peak_threads;
+
+	peak_threads = 0;
+	return peak;
+}
+
+static void _load_nodes(void)
+{
+	int i;
+
+	if (slurm_load_node(0, &node_table, SHOW_ALL)) {
+		slurm_perror("slurm_load_node");
+		exit(1);
+	}
+	node_cnt = node_table->record_count;
+	nodes = calloc(node_cnt, sizeof(node_addr_t));
+	for (i = 0; i < node_cnt; i++) {
+		nodes[i].addr = strdup(node_table->node_array[i].node_addr);
+		nodes[i].name = strdup(node_table->node_array[i].name);
+		nodes[i].info = &node_table->node_array[i];
+	}
+	qsort(nodes, node_cnt, sizeof(node_addr_t), _sort_addr);
+}
+
+/* Wait for every node to be idle and responding, RET seconds waited */
+static double _wait_nodes_idle(int max_secs)
+{
+	node_info_msg_t *node_info = NULL;
+	double start = _now();
+	uint32_t state;
+	int i, idle;
+
+	while ((_now() - start) < max_secs) {
+		if (slurm_load_node(0, &node_info, SHOW_ALL) == SLURM_SUCCESS) {
+			idle = 0;
+			for (i = 0; i < node_info->record_count; i++) {
+				state = node_info->node_array[i].node_state;
+				if (((state & NODE_STATE_BASE) ==
+				     NODE_STATE_IDLE) &&
+				    !(state & (NODE_STATE_NO_RESPOND |
+					       NODE_STATE_COMPLETING)))
+					idle++;
+			}
+			slurm_free_node_info_msg(node_info);
+			if (idle == node_cnt)
+				return _now() - start;
+		}
+		usleep(10000);
+	}
+	return -1.0;
+}
+
+static uint32_t _submit(int min_nodes)
+{
+	job_desc_msg_t desc;
+	submit_response_msg_t *resp = NULL;
+	char *env[] = { "PATH=/bin:/usr/bin", NULL };
+	uint32_t job_id;
+
+	slurm_init_job_desc_msg(&desc);
+	desc.name = "agent_fanout";
+	desc.min_nodes = min_nodes;
+	if (min_nodes == 1) {
+		desc.num_tasks = 1;
+		desc.min_cpus = 1;
+	}
+	desc.user_id = getuid();
+	desc.group_id = getgid();
+	desc.work_dir = "/tmp";
+	desc.std_out = "/dev/null";
+	desc.script = "#!/bin/sh\nsleep 1000\n";
+	desc.environment = env;
+	desc.env_size = 1;
+	if (slurm_submit_batch_job(&desc, &resp)) {
+		slurm_perror("slurm_submit_batch_job");
+		exit(1);
+	}
+	job_id = resp->job_id;
+	slurm_free_submit_response_response_msg(resp);
+	return job_id;
+}
+
+static int _job_state(uint32_t job_id, uint32_t *state)
+{
+	job_info_msg_t *job_info = NULL;
+
+	if (slurm_load_job(&job_info, job_id, SHOW_ALL) ||
+	    (job_info->record_count < 1))
+		return -1;
+	*state = job_info->job_array[0].job_state;
+	slurm_free_job_info_msg(job_info);
+	return 0;
+}
+
+/* Return the count of running jobs with IDs from first_id to last_id */
+static int _running_jobs(uint32_t first_id, uint32_t last_id)
+{
+	job_info_msg_t *job_info = NULL;
+	slurm_job_info_t *job;
+	int i, cnt = 0;
+
+	if (slurm_load_jobs(0, &job_info, SHOW_ALL))
+		return -1;
+	for (i = 0, job = job_info->job_array; i < job_info->record_count;
+	     i++, job++) {
+		if ((job->job_id >= first_id) && (job->job_id <= last_id) &&
+		    ((job->job_state & JOB_STATE_BASE) == JOB_RUNNING))
+			cnt++;
+	}
+	slurm_free_job_info_msg(job_info);
+	return cnt;
+}
+
+int main(int argc, char *argv[])
+{
+	struct sockaddr_in sin;
+	pthread_t tid;
+	int c, i, listen_fd, one = 1, job_cnt = 5, reconf_cnt = 5;
+	double start, t, reconf_sum = 0.0, launch_sum = 0.0, kill_sum = 0.0;
+	int reconf_peak = 0, job_peak = 0, storm_peak = 0;
+	int per_node = 0, storm_jobs = 0, storm_conns = 0, storm_kills = 0;
+	double storm_secs = 0.0;
+	uint32_t job_id = 0, first_id = 0, state;
+
+	while ((c = getopt(argc, argv, "j:p:r:s:")) != -1) {
+		switch (c) {
+		case 'j':
+			job_cnt = atoi(optarg);
+			break;
+		case 'p':
+			ctld_pid = atoi(optarg);
+			break;
+		case 'r':
+			reconf_cnt = atoi(optarg);
+			break;
+		case 's':
+			per_node = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-j jobs] [-r reconfigures] [-s jobs_per_node] [-p slurmctld_pid]\n",
+				argv[0]);
+			exit(1);
+		}
+	}
+	signal(SIGPIPE, SIG_IGN);
+
+	_load_nodes();
+
+	listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_ANY);
+	sin.sin_port = htons(slurm_get_slurmd_port());
+	if (bind(listen_fd, (struct sockaddr *) &sin, sizeof(sin)) ||
+	    listen(listen_fd, 4096)) {
+		perror("bind/listen");
+		exit(1);
+	}
+	pthread_create(&tid, NULL, _slurmd_listen, (void *) (long) listen_fd);
+	if (ctld_pid)
+		pthread_create(&tid, NULL, _sample_threads, NULL);
+
+	printf("emulating %d nodes, waiting for them to respond\n", node_cnt);
+	if ((t = _wait_nodes_idle(600)) < 0) {
+		fprintf(stderr, "nodes not idle after 600 seconds\n");
+		exit(1);
+	}
+	printf("nodes idle after %.2f seconds\n", t);
+	_reset_peak();
+
+	for (i = 0; i < reconf_cnt; i++) {
+		pthread_mutex_lock(&cnt_mutex);
+		reconfig_cnt = 0;
+		pthread_mutex_unlock(&cnt_mutex);
+		start = _now();
+		if (slurm_reconfigure()) {
+			slurm_perror("slurm_reconfigure");
+			exit(1);
+		}
+		pthread_mutex_lock(&cnt_mutex);
+		while (reconfig_cnt < node_cnt)
+			pthread_cond_wait(&cnt_cond, &cnt_mutex);
+		pthread_mutex_unlock(&cnt_mutex);
+		t = _now() - start;
+		reconf_sum += t;
+		printf("reconfigure %d reached %d nodes in %.3f seconds\n",
+		       i, node_cnt, t);
+		sleep(1);
+	}
+	reconf_peak = _reset_peak();
+
+	for (i = 0; i < job_cnt; i++) {
+		start = _now();
+		job_id = _submit(node_cnt);
+		while (!_job_state(job_id, &state) &&
+		       ((state & JOB_STATE_BASE) == JOB_PENDING))
+			usleep(5000);
+		if ((state & JOB_STATE_BASE) != JOB_RUNNING) {
+			fprintf(stderr, "job %u not running, state %u\n",
+				job_id, state);
+			exit(1);
+		}
+		t = _now() - start;
+		launch_sum += t;
+
+		pthread_mutex_lock(&cnt_mutex);
+		terminate_cnt = 0;
+		pthread_mutex_unlock(&cnt_mutex);
+		start = _now();
+		if (slurm_kill_job(job_id, SIGKILL, 0)) {
+			slurm_perror("slurm_kill_job");
+			exit(1);
+		}
+		while (!_job_state(job_id, &state) &&
+		       (state & JOB_COMPLETING))
+			usleep(5000);
+		if (_wait_nodes_idle(600) < 0) {
+			fprintf(stderr, "nodes not idle after job %u\n",
+				job_id);
+			exit(1);
+		}
+		kill_sum += _now() - start;
+		printf("job %u launched in %.3f, completed on %d nodes in %.3f seconds\n",
+		       job_id, t, terminate_cnt, _now() - start);
+	}
+	job_peak = _reset_peak();
+
+	storm_jobs = per_node * node_cnt;
+	if (storm_jobs) {
+		for (i = 0; i < storm_jobs; i++) {
+			job_id = _submit(1);
+			if (i == 0)
+				first_id = job_id;
+		}
+		start = _now();
+		while (_running_jobs(first_id, job_id) < storm_jobs) {
+			if ((_now() - start) > 600) {
+				fprintf(stderr, "jobs not running after 600 seconds\n");
+				exit(1);
+			}
+			usleep(100000);
+		}
+		printf("%d single CPU jobs running\n", storm_jobs);
+		sleep(1);
+		_reset_peak();
+
+		pthread_mutex_lock(&cnt_mutex);
+		storm_conns = msg_cnt;
+		terminate_cnt = 0;
+		pthread_mutex_unlock(&cnt_mutex);
+		start = _now();
+		for (job_id = first_id; job_id < first_id + storm_jobs;
+		     job_id++) {
+			if (slurm_kill_job(job_id, SIGKILL, 0))
+				slurm_perror("slurm_kill_job");
+		}
+		if (_wait_nodes_idle(600) < 0) {
+			fprintf(stderr, "nodes not idle after cancelling jobs\n");
+			exit(1);
+		}
+		storm_secs = _now() - start;
+		pthread_mutex_lock(&cnt_mutex);
+		storm_conns = msg_cnt - storm_conns;
+		storm_kills = terminate_cnt;
+		pthread_mutex_unlock(&cnt_mutex);
+		storm_peak = _reset_peak();
+	}
+	sampling = 0;
+
+	printf("nodes:                     %d\n", node_cnt);
+	if (reconf_cnt)
+		printf("mean reconfigure seconds:  %.3f\n",
+		       reconf_sum / reconf_cnt);
+	if (job_cnt) {
+		printf("mean job launch seconds:   %.3f\n",
+		       launch_sum / job_cnt);
+		printf("mean job complete seconds: %.3f\n",
+		       kill_sum / job_cnt);
+	}
+	if (storm_jobs) {
+		printf("cancel %d jobs seconds: %.3f\n", storm_jobs,
+		       storm_secs);
+		printf("cancel connections:        %d for %d terminate requests\n",
+		       storm_conns, storm_kills);
+	}
+	if (ctld_pid) {
+		printf("slurmctld peak threads:    %d reconfigure, %d jobs, %d cancel\n",
+		       reconf_peak, job_peak, storm_peak);
+	}
+	printf("messages received:         %d\n", msg_cnt);
+
+	return 0;
+}
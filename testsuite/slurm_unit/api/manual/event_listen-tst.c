@@ -0,0 +1,129 @@
+/*****************************************************************************\
+ *  event_listen-tst.c - print the events pushed by slurmctld
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <slurm/slurm.h>
+#include <slurm/slurm_errno.h>
+
+/*
+ * Subscribe to all job, node, partition and reservation events and print
+ * them as they arrive, optionally limited to one partition. Requires
+ * SlurmctldParameters=event_subscribers=# to be configured.
+ *
+ * Usage: event_listen-tst [seconds [partition]]
+ */
+
+static const char *_type_str(uint16_t event_type)
+{
+	switch (event_type) {
+	case EVENT_TYPE_JOB:
+		return "job";
+	case EVENT_TYPE_NODE:
+		return "node";
+	case EVENT_TYPE_PART:
+		return "partition";
+	case EVENT_TYPE_RESV:
+		return "reservation";
+	case EVENT_TYPE_RESYNC:
+		return "resync";
+	}
+	return "unknown";
+}
+
+static const char *_change_str(uint16_t change)
+{
+	switch (change) {
+	case EVENT_CHANGE_CREATE:
+		return "create";
+	case EVENT_CHANGE_UPDATE:
+		return "update";
+	case EVENT_CHANGE_DELETE:
+		return "delete";
+	}
+	return "-";
+}
+
+int main(int argc, char *argv[])
+{
+	slurm_event_conn_t *conn = NULL;
+	event_notify_msg_t *msg = NULL;
+	info_filter_t filter = { 0 };
+	slurm_event_t *event;
+	time_t end_time;
+	int run_secs = 60;
+	long event_cnt = 0;
+	uint32_t i;
+
+	if (argc > 1)
+		run_secs = atoi(argv[1]);
+	if (argc > 2)
+		filter.partitions = argv[2];
+	if (run_secs < 1) {
+		fprintf(stderr, "Usage: %s [seconds [partition]]\n", argv[0]);
+		exit(1);
+	}
+
+	if (slurm_event_subscribe(EVENT_TYPE_JOB | EVENT_TYPE_NODE |
+				  EVENT_TYPE_PART | EVENT_TYPE_RESV,
+				  (argc > 2) ? &filter : NULL, &conn) !=
+	    SLURM_SUCCESS) {
+		slurm_perror("slurm_event_subscribe");
+		exit(1);
+	}
+
+	end_time = time(NULL) + run_secs;
+	while (time(NULL) < end_time) {
+		if (slurm_event_recv(conn, 1000, &msg) != SLURM_SUCCESS) {
+			if (slurm_get_errno() ==
+			    SLURM_PROTOCOL_SOCKET_IMPL_TIMEOUT)
+				continue;
+			slurm_perror("slurm_event_recv");
+			break;
+		}
+		for (i = 0, event = msg->events; i < msg->event_cnt;
+		     i++, event++) {
+			printf("%ld %-11s %-6s ", (long) event->event_time,
+			       _type_str(event->event_type),
+			       _change_str(event->change));
+			if (event->event_type == EVENT_TYPE_JOB)
+				printf("%u state=%u reason=%u\n",
+				       event->job_id, event->state,
+				       event->state_reason);
+			else
+				printf("%s state=%u\n",
+				       event->name ? event->name : "-",
+				       event->state);
+		}
+		event_cnt += msg->event_cnt;
+		slurm_free_event_notify_msg(msg);
+	}
+
+	slurm_event_unsubscribe(conn);
+	printf("events: %ld\n", event_cnt);
+
+	return 0;
+}
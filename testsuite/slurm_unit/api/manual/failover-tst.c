@@ -0,0 +1,195 @@
+/*****************************************************************************\
+ *  failover-tst.c - measure backup controller takeover time
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <slurm/slurm.h>
+#include <slurm/slurm_errno.h>
+
+#include "src/common/slurm_protocol_api.h"
+#include "src/common/slurm_protocol_defs.h"
+
+/*
+ * Kill the primary slurmctld and measure how long the backup controller
+ * takes to assume control, to answer RPCs with the recovered jobs and to
+ * complete its first scheduling cycle.
+ *
+ * Both controllers can run on one host. As SlurmctldPort is the same for
+ * every controller and slurmctld listens on all addresses, run the backup
+ * in its own network namespace, and give each controller its host name
+ * with a UTS namespace:
+ *
+ *   ip netns add ctl2
+ *   ip link add veth1 type veth peer name veth2
+ *   ip link set veth2 netns ctl2
+ *   ip addr add 10.99.0.1/24 dev veth1; ip link set veth1 up
+ *   ip netns exec ctl2 ip addr add 10.99.0.2/24 dev veth2
+ *   ip netns exec ctl2 ip link set veth2 up
+ *
+ * slurm.conf holds "SlurmctldHost=ctl1(10.99.0.1)" and
+ * "SlurmctldHost=ctl2(10.99.0.2)" and a StateSaveLocation shared by both,
+ * for scale one created with restart_time-tst. The controllers need their
+ * own SlurmctldPidFile and SlurmctldLogFile, so use a copy of slurm.conf
+ * differing only in these for the backup:
+ *
+ *   unshare -u sh -c 'hostname ctl1; exec slurmctld'
+ *   SLURM_CONF=slurm2.conf ip netns exec ctl2 \
+ *	unshare -u sh -c 'hostname ctl2; exec slurmctld'
+ *
+ * Once the job state was saved with the backup connected (with
+ * SlurmctldParameters=state_replication it logs "Replicating the state of
+ * controller ctl1"), run "failover-tst PID" with the process ID of the
+ * primary. Compare with and without state_replication.
+ *
+ * Usage: failover-tst PRIMARY_PID [timeout_secs]
+ */
+
+static double _elapsed(struct timeval *start, struct timeval *end)
+{
+	return (end->tv_sec - start->tv_sec) +
+	       ((end->tv_usec - start->tv_usec) / 1000000.0);
+}
+
+/* RET time the backup controller assumed control, 0 if in standby */
+static time_t _backup_control_time(void)
+{
+	slurm_msg_t req_msg, resp_msg;
+	time_t control_time = 0;
+	int fd;
+
+	if ((fd = slurm_open_controller_conn_spec(1, NULL)) < 0)
+		return 0;
+	slurm_msg_t_init(&req_msg);
+	slurm_msg_t_init(&resp_msg);
+	req_msg.msg_type = REQUEST_CONTROL_STATUS;
+	if ((slurm_send_recv_msg(fd, &req_msg, &resp_msg, 0) == 0) &&
+	    (resp_msg.msg_type == RESPONSE_CONTROL_STATUS)) {
+		control_time = ((control_status_msg_t *) resp_msg.data)->
+			       control_time;
+	}
+	slurm_free_msg_data(resp_msg.msg_type, resp_msg.data);
+	(void) close(fd);
+
+	return control_time;
+}
+
+static uint32_t _job_cnt(void)
+{
+	job_info_msg_t *jobs = NULL;
+	uint32_t cnt;
+
+	if (slurm_load_jobs((time_t) 0, &jobs, SHOW_ALL) != SLURM_SUCCESS)
+		return NO_VAL;
+	cnt = jobs->record_count;
+	slurm_free_job_info_msg(jobs);
+	return cnt;
+}
+
+int main(int argc, char *argv[])
+{
+	stats_info_request_msg_t req;
+	stats_info_response_msg_t *stats = NULL;
+	struct timeval start, now;
+	pid_t pid;
+	uint32_t job_cnt, job_cnt2;
+	int timeout;
+
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s PRIMARY_PID [timeout_secs]\n",
+			argv[0]);
+		return 1;
+	}
+	pid = (pid_t) atoi(argv[1]);
+	timeout = (argc > 2) ? atoi(argv[2]) : 3600;
+
+	if (slurm_ping(1) != SLURM_SUCCESS) {
+		slurm_perror("backup controller");
+		return 1;
+	}
+	if ((job_cnt = _job_cnt()) == NO_VAL) {
+		slurm_perror("slurm_load_jobs");
+		return 1;
+	}
+	printf("jobs before failover:  %u\n", job_cnt);
+
+	gettimeofday(&start, NULL);
+	if (kill(pid, SIGKILL) < 0) {
+		perror("kill");
+		return 1;
+	}
+
+	while (!_backup_control_time()) {
+		gettimeofday(&now, NULL);
+		if (_elapsed(&start, &now) > timeout) {
+			fprintf(stderr, "No takeover in %d seconds\n",
+				timeout);
+			return 1;
+		}
+		usleep(10000);
+	}
+	gettimeofday(&now, NULL);
+	printf("backup in control:     %.2f seconds\n",
+	       _elapsed(&start, &now));
+
+	while ((job_cnt2 = _job_cnt()) == NO_VAL)
+		usleep(10000);
+	gettimeofday(&now, NULL);
+	printf("first job info:        %.2f seconds, %u jobs\n",
+	       _elapsed(&start, &now), job_cnt2);
+
+	req.command_id = STAT_COMMAND_GET;
+	while (1) {
+		gettimeofday(&now, NULL);
+		if (_elapsed(&start, &now) > timeout) {
+			fprintf(stderr, "No scheduling cycle in %d seconds\n",
+				timeout);
+			return 1;
+		}
+		if (slurm_get_statistics(&stats, &req) == SLURM_SUCCESS) {
+			if (stats->schedule_cycle_counter) {
+				printf("first schedule cycle:  %.2f seconds\n",
+				       _elapsed(&start, &now));
+				slurm_free_stats_response_msg(stats);
+				break;
+			}
+			slurm_free_stats_response_msg(stats);
+		}
+		usleep(10000);
+	}
+
+	if (job_cnt2 != job_cnt) {
+		fprintf(stderr, "%u jobs recovered, %u expected\n",
+			job_cnt2, job_cnt);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,342 @@
+/*****************************************************************************\
+ *  restart_time-tst.c - measure slurmctld restart time with many saved jobs
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <slurm/slurm.h>
+#include <slurm/slurm_errno.h>
+
+#include "src/common/slurm_protocol_defs.h"
+
+/*
+ * Build a synthetic StateSaveLocation holding many pending batch jobs, then
+ * measure how long a restarted slurmctld takes to answer RPCs and to
+ * complete its first scheduling cycle.
+ *
+ * 1. Start slurmctld with an empty StateSaveLocation, submit one batch job
+ *    which remains pending (e.g. "sbatch -N 99 --wrap hostname"), then
+ *    shut slurmctld down so its state is saved. This is the seed.
+ * 2. "restart_time-tst generate SEED_DIR STATE_DIR [jobs]" copies the seed
+ *    and replicates its job (default 500000 times) with consecutive job IDs,
+ *    hard linking the batch script and environment of every copy.
+ * 3. Set StateSaveLocation to STATE_DIR and run
+ *    "slurmctld && restart_time-tst wait".
+ *
+ * Usage: restart_time-tst generate SEED_DIR STATE_DIR [jobs]
+ *        restart_time-tst wait [timeout_secs]
+ */
+
+#define JOB_ID_OFFSET	24	/* offset of job_id in a job state record */
+#define NO_VAL32	0xfffffffe
+
+static double _elapsed(struct timeval *start, struct timeval *end)
+{
+	return (end->tv_sec - start->tv_sec) +
+	       ((end->tv_usec - start->tv_usec) / 1000000.0);
+}
+
+static char *_read_file(const char *path, size_t *size)
+{
+	struct stat stat_buf;
+	char *data;
+	size_t pos = 0;
+	ssize_t len;
+	int fd;
+
+	if (((fd = open(path, O_RDONLY)) < 0) || (fstat(fd, &stat_buf) < 0)) {
+		perror(path);
+		exit(1);
+	}
+	data = malloc(stat_buf.st_size + 1);
+	while (pos < stat_buf.st_size) {
+		len = read(fd, data + pos, stat_buf.st_size - pos);
+		if ((len < 0) && (errno == EINTR))
+			continue;
+		if (len <= 0) {
+			perror(path);
+			exit(1);
+		}
+		pos += len;
+	}
+	close(fd);
+	*size = pos;
+	return data;
+}
+
+static void _write_all(int fd, const char *path, const void *data,
+		       size_t size)
+{
+	const char *ptr = data;
+	ssize_t len;
+
+	while (size) {
+		len = write(fd, ptr, size);
+		if ((len < 0) && (errno == EINTR))
+			continue;
+		if (len < 0) {
+			perror(path);
+			exit(1);
+		}
+		ptr += len;
+		size -= len;
+	}
+}
+
+static void _copy_file(const char *src, const char *dst)
+{
+	char *data;
+	size_t size;
+	int fd;
+
+	data = _read_file(src, &size);
+	if ((fd = open(dst, O_CREAT | O_WRONLY | O_TRUNC, 0600)) < 0) {
+		perror(dst);
+		exit(1);
+	}
+	_write_all(fd, dst, data, size);
+	close(fd);
+	free(data);
+}
+
+/* Link dst to src, on reaching the link limit make dst a copy and link
+ * later files to it instead */
+static void _link_file(char *src, const char *dst)
+{
+	int link_errno;
+
+	if (link(src, dst) == 0)
+		return;
+	link_errno = errno;
+	if ((link_errno != EXDEV) && (link_errno != EMLINK)) {
+		perror(dst);
+		exit(1);
+	}
+	_copy_file(src, dst);
+	if (link_errno == EMLINK)
+		snprintf(src, PATH_MAX, "%s", dst);
+}
+
+/* Copy every state file except job_state and the batch job directories */
+static void _copy_seed(const char *seed_dir, const char *state_dir)
+{
+	char src[PATH_MAX], dst[PATH_MAX];
+	struct dirent *ent;
+	struct stat stat_buf;
+	DIR *dir;
+
+	if ((mkdir(state_dir, 0700) < 0) && (errno != EEXIST)) {
+		perror(state_dir);
+		exit(1);
+	}
+	if (!(dir = opendir(seed_dir))) {
+		perror(seed_dir);
+		exit(1);
+	}
+	while ((ent = readdir(dir))) {
+		if (!strncmp(ent->d_name, "job_state", 9))
+			continue;
+		snprintf(src, sizeof(src), "%s/%s", seed_dir, ent->d_name);
+		if ((stat(src, &stat_buf) < 0) || !S_ISREG(stat_buf.st_mode))
+			continue;
+		snprintf(dst, sizeof(dst), "%s/%s", state_dir, ent->d_name);
+		_copy_file(src, dst);
+	}
+	closedir(dir);
+}
+
+static int _generate(const char *seed_dir, const char *state_dir,
+		     uint32_t job_cnt)
+{
+	char path[PATH_MAX], seed_job_dir[PATH_MAX];
+	char script[PATH_MAX], env[PATH_MAX];
+	char *data, *rec;
+	size_t size, hdr_size, index_size, rec_size;
+	uint32_t str_len, seed_id, job_id, tmp32, i;
+	struct timeval start, end;
+	int fd;
+
+	gettimeofday(&start, NULL);
+	snprintf(path, sizeof(path), "%s/job_state", seed_dir);
+	data = _read_file(path, &size);
+
+	/*
+	 * Header: version string, protocol version, time, next job ID and
+	 * the batch directory index (count plus job IDs)
+	 */
+	memcpy(&tmp32, data, sizeof(tmp32));
+	str_len = ntohl(tmp32);
+	hdr_size = sizeof(uint32_t) + str_len + sizeof(uint16_t) +
+		   sizeof(int64_t) + sizeof(uint32_t);
+	if (hdr_size + sizeof(uint32_t) > size) {
+		fprintf(stderr, "%s is truncated\n", path);
+		exit(1);
+	}
+	memcpy(&tmp32, data + hdr_size, sizeof(tmp32));
+	index_size = sizeof(uint32_t) * (1 + ntohl(tmp32));
+	if (hdr_size + index_size + JOB_ID_OFFSET + sizeof(uint32_t) > size) {
+		fprintf(stderr, "%s holds no job\n", path);
+		exit(1);
+	}
+	rec = data + hdr_size + index_size;
+	rec_size = size - hdr_size - index_size;
+
+	/* Only a single job which is not a job array can be replicated */
+	memcpy(&tmp32, rec, sizeof(tmp32));
+	if (tmp32 != 0) {
+		fprintf(stderr, "Seed job may not be a job array\n");
+		exit(1);
+	}
+	memcpy(&tmp32, rec + 8, sizeof(tmp32));
+	if (ntohl(tmp32) != NO_VAL32) {
+		fprintf(stderr, "Seed job may not be a job array\n");
+		exit(1);
+	}
+	memcpy(&tmp32, rec + JOB_ID_OFFSET, sizeof(tmp32));
+	seed_id = ntohl(tmp32);
+	snprintf(seed_job_dir, sizeof(seed_job_dir), "%s/hash.%d/job.%u",
+		 seed_dir, seed_id % 10, seed_id);
+	if (access(seed_job_dir, R_OK) < 0) {
+		fprintf(stderr, "%s: %s, seed must hold one batch job\n",
+			seed_job_dir, strerror(errno));
+		exit(1);
+	}
+
+	_copy_seed(seed_dir, state_dir);
+	snprintf(script, sizeof(script), "%s/script", seed_job_dir);
+	snprintf(env, sizeof(env), "%s/environment", seed_job_dir);
+
+	snprintf(path, sizeof(path), "%s/job_state", state_dir);
+	if ((fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0600)) < 0) {
+		perror(path);
+		exit(1);
+	}
+	tmp32 = htonl(seed_id + job_cnt);
+	memcpy(data + hdr_size - sizeof(uint32_t), &tmp32, sizeof(tmp32));
+	_write_all(fd, path, data, hdr_size);
+	tmp32 = htonl(job_cnt);
+	_write_all(fd, path, &tmp32, sizeof(tmp32));
+	for (i = 0; i < job_cnt; i++) {
+		tmp32 = htonl(seed_id + i);
+		_write_all(fd, path, &tmp32, sizeof(tmp32));
+	}
+
+	for (i = 0; i < 10; i++) {
+		snprintf(path, sizeof(path), "%s/hash.%u", state_dir, i);
+		if ((mkdir(path, 0700) < 0) && (errno != EEXIST)) {
+			perror(path);
+			exit(1);
+		}
+	}
+	for (i = 0; i < job_cnt; i++) {
+		job_id = seed_id + i;
+		tmp32 = htonl(job_id);
+		memcpy(rec + JOB_ID_OFFSET, &tmp32, sizeof(tmp32));
+		_write_all(fd, "job_state", rec, rec_size);
+
+		snprintf(path, sizeof(path), "%s/hash.%d/job.%u",
+			 state_dir, job_id % 10, job_id);
+		if ((mkdir(path, 0700) < 0) && (errno != EEXIST)) {
+			perror(path);
+			exit(1);
+		}
+		snprintf(path, sizeof(path), "%s/hash.%d/job.%u/script",
+			 state_dir, job_id % 10, job_id);
+		_link_file(script, path);
+		snprintf(path, sizeof(path), "%s/hash.%d/job.%u/environment",
+			 state_dir, job_id % 10, job_id);
+		_link_file(env, path);
+	}
+	if (fsync(fd) < 0)
+		perror("fsync");
+	close(fd);
+	free(data);
+	gettimeofday(&end, NULL);
+
+	printf("generated %u jobs (IDs %u-%u) in %s, %.1f seconds\n",
+	       job_cnt, seed_id, seed_id + job_cnt - 1, state_dir,
+	       _elapsed(&start, &end));
+	return 0;
+}
+
+static int _wait(int timeout)
+{
+	stats_info_request_msg_t req;
+	stats_info_response_msg_t *stats = NULL;
+	struct timeval start, now;
+	double rpc_secs = -1.0;
+
+	req.command_id = STAT_COMMAND_GET;
+	gettimeofday(&start, NULL);
+	while (1) {
+		gettimeofday(&now, NULL);
+		if (_elapsed(&start, &now) > timeout) {
+			fprintf(stderr, "No scheduling cycle in %d seconds\n",
+				timeout);
+			return 1;
+		}
+		if (slurm_get_statistics(&stats, &req) != SLURM_SUCCESS) {
+			usleep(10000);
+			continue;
+		}
+		if (rpc_secs < 0.0)
+			rpc_secs = _elapsed(&start, &now);
+		if (stats->schedule_cycle_counter) {
+			printf("first RPC response:    %.2f seconds\n",
+			       rpc_secs);
+			printf("first schedule cycle:  %.2f seconds\n",
+			       _elapsed(&start, &now));
+			printf("schedule cycle length: %u usec\n",
+			       stats->schedule_cycle_last);
+			slurm_free_stats_response_msg(stats);
+			return 0;
+		}
+		slurm_free_stats_response_msg(stats);
+		usleep(10000);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	if ((argc >= 4) && !strcmp(argv[1], "generate"))
+		return _generate(argv[2], argv[3],
+				 (argc > 4) ? atoi(argv[4]) : 500000);
+	if ((argc >= 2) && !strcmp(argv[1], "wait"))
+		return _wait((argc > 2) ? atoi(argv[2]) : 3600);
+
+	fprintf(stderr, "Usage: %s generate SEED_DIR STATE_DIR [jobs]\n"
+		"       %s wait [timeout_secs]\n", argv[0], argv[0]);
+	return 1;
+}
@@ -0,0 +1,111 @@
+/*****************************************************************************\
+ *  rpc_rate-tst.c - measure the rate at which slurmctld services RPCs
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include <slurm/slurm.h>
+#include <slurm/slurm_errno.h>
+
+/*
+ * Issue REQUEST_PING RPCs to the primary slurmctld from many client threads
+ * at once and report the number of RPCs serviced per second. Run it once
+ * with SlurmctldParameters=rpc_workers=# configured and once without to
+ * compare the RPC engine with the thread per connection model.
+ *
+ * Usage: rpc_rate-tst [client_threads [seconds]]
+ */
+
+static pthread_mutex_t cnt_mutex = PTHREAD_MUTEX_INITIALIZER;
+static long rpc_cnt = 0, err_cnt = 0;
+static struct timeval end_time;
+
+static void *_client(void *arg)
+{
+	struct timeval now;
+	long good = 0, bad = 0;
+
+	while (1) {
+		gettimeofday(&now, NULL);
+		if (timercmp(&now, &end_time, >=))
+			break;
+		if (slurm_ping(0) == SLURM_SUCCESS)
+			good++;
+		else
+			bad++;
+	}
+
+	pthread_mutex_lock(&cnt_mutex);
+	rpc_cnt += good;
+	err_cnt += bad;
+	pthread_mutex_unlock(&cnt_mutex);
+
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	int i, thread_cnt = 64, run_secs = 10;
+	pthread_t *threads;
+	struct timeval start_time, now;
+	double elapsed;
+
+	if (argc > 1)
+		thread_cnt = atoi(argv[1]);
+	if (argc > 2)
+		run_secs = atoi(argv[2]);
+	if ((thread_cnt < 1) || (run_secs < 1)) {
+		fprintf(stderr, "Usage: %s [client_threads [seconds]]\n",
+			argv[0]);
+		exit(1);
+	}
+
+	gettimeofday(&start_time, NULL);
+	end_time = start_time;
+	end_time.tv_sec += run_secs;
+
+	threads = calloc(thread_cnt, sizeof(pthread_t));
+	for (i = 0; i < thread_cnt; i++) {
+		if (pthread_create(&threads[i], NULL, _client, NULL)) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	for (i = 0; i < thread_cnt; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+
+	gettimeofday(&now, NULL);
+	elapsed = (now.tv_sec - start_time.tv_sec) +
+		  ((now.tv_usec - start_time.tv_usec) / 1000000.0);
+	printf("client threads:  %d\n", thread_cnt);
+	printf("elapsed seconds: %.2f\n", elapsed);
+	printf("RPCs completed:  %ld\n", rpc_cnt);
+	printf("RPC errors:      %ld\n", err_cnt);
+	printf("RPCs per second: %.1f\n", rpc_cnt / elapsed);
+
+	return (err_cnt ? 1 : 0);
+}
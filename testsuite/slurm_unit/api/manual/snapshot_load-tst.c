@@ -0,0 +1,189 @@
+/*****************************************************************************\
+ *  snapshot_load-tst.c - measure write lock latency under job info load
+ *****************************************************************************
+ *  Copyright (C) 2018 SchedMD LLC.
+ *
+ *  This file is part of Slurm, a resource management program.
+ *  For details, see <https://slurm.schedmd.com/>.
+ *  Please also read the included file: DISCLAIMER.
+ *
+ *  Slurm is free software; you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ *  Slurm is distributed in the hope that it will be useful, but WITHOUT ANY
+ *  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ *  FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ *  details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with Slurm; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA.
+\*****************************************************************************/
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <slurm/slurm.h>
+#include <slurm/slurm_errno.h>
+
+/*
+ * Submit one held job, then repeatedly update its comment, which requires
+ * a job write lock in slurmctld, and report the update latency. This is
+ * done first without other load and then while many client threads load
+ * the full job table as squeue does. Run it once with
+ * SlurmctldParameters=snapshot_max_age=# configured and once without to
+ * compare lock free snapshot reads with the locked path. Load the
+ * controller with many jobs first (e.g. held job arrays) so that packing
+ * the job table takes a significant time.
+ *
+ * Usage: snapshot_load-tst [reader_threads [seconds]]
+ */
+
+static pthread_mutex_t cnt_mutex = PTHREAD_MUTEX_INITIALIZER;
+static long load_cnt = 0, err_cnt = 0;
+static struct timeval end_time;
+
+static double _elapsed(struct timeval *start, struct timeval *end)
+{
+	return (end->tv_sec - start->tv_sec) +
+	       ((end->tv_usec - start->tv_usec) / 1000000.0);
+}
+
+static void *_reader(void *arg)
+{
+	job_info_msg_t *job_info_msg;
+	struct timeval now;
+	long good = 0, bad = 0;
+
+	while (1) {
+		gettimeofday(&now, NULL);
+		if (timercmp(&now, &end_time, >=))
+			break;
+		if (slurm_load_jobs((time_t) 0, &job_info_msg, SHOW_DETAIL) ==
+		    SLURM_SUCCESS) {
+			slurm_free_job_info_msg(job_info_msg);
+			good++;
+		} else
+			bad++;
+	}
+
+	pthread_mutex_lock(&cnt_mutex);
+	load_cnt += good;
+	err_cnt += bad;
+	pthread_mutex_unlock(&cnt_mutex);
+
+	return NULL;
+}
+
+/* Update the job's comment until end_time and report latency */
+static void _run_updates(uint32_t job_id, const char *label)
+{
+	job_desc_msg_t job_desc;
+	struct timeval start, now;
+	double delta, sum = 0.0, max = 0.0;
+	long cnt = 0;
+	char comment[64];
+
+	while (1) {
+		gettimeofday(&start, NULL);
+		if (timercmp(&start, &end_time, >=))
+			break;
+		slurm_init_job_desc_msg(&job_desc);
+		job_desc.job_id = job_id;
+		snprintf(comment, sizeof(comment), "snapshot_load %ld", cnt);
+		job_desc.comment = comment;
+		if (slurm_update_job(&job_desc) != SLURM_SUCCESS) {
+			slurm_perror("slurm_update_job");
+			pthread_mutex_lock(&cnt_mutex);
+			err_cnt++;
+			pthread_mutex_unlock(&cnt_mutex);
+			break;
+		}
+		gettimeofday(&now, NULL);
+		delta = _elapsed(&start, &now) * 1000.0;
+		sum += delta;
+		if (delta > max)
+			max = delta;
+		cnt++;
+		usleep(10000);
+	}
+
+	printf("%-12s updates: %-6ld mean: %8.3f ms  max: %8.3f ms\n",
+	       label, cnt, cnt ? (sum / cnt) : 0.0, max);
+}
+
+int main(int argc, char *argv[])
+{
+	int i, thread_cnt = 32, run_secs = 10;
+	pthread_t *threads;
+	job_desc_msg_t job_desc;
+	submit_response_msg_t *resp = NULL;
+	struct timeval start_time, now;
+	char *script = "#!/bin/sh\nexit 0\n";
+	char *env[] = { "PATH=/bin:/usr/bin", NULL };
+
+	if (argc > 1)
+		thread_cnt = atoi(argv[1]);
+	if (argc > 2)
+		run_secs = atoi(argv[2]);
+	if ((thread_cnt < 1) || (run_secs < 1)) {
+		fprintf(stderr, "Usage: %s [reader_threads [seconds]]\n",
+			argv[0]);
+		exit(1);
+	}
+
+	slurm_init_job_desc_msg(&job_desc);
+	job_desc.name = "snapshot_load";
+	job_desc.priority = 0;		/* held */
+	job_desc.min_nodes = 1;
+	job_desc.user_id = getuid();
+	job_desc.group_id = getgid();
+	job_desc.script = script;
+	job_desc.environment = env;
+	job_desc.env_size = 1;
+	job_desc.work_dir = "/tmp";
+	if (slurm_submit_batch_job(&job_desc, &resp) != SLURM_SUCCESS) {
+		slurm_perror("slurm_submit_batch_job");
+		exit(1);
+	}
+
+	/* Baseline without reader load */
+	gettimeofday(&now, NULL);
+	end_time = now;
+	end_time.tv_sec += run_secs;
+	_run_updates(resp->job_id, "idle:");
+
+	/* Same again while reader threads load the job table */
+	gettimeofday(&start_time, NULL);
+	end_time = start_time;
+	end_time.tv_sec += run_secs;
+	threads = calloc(thread_cnt, sizeof(pthread_t));
+	for (i = 0; i < thread_cnt; i++) {
+		if (pthread_create(&threads[i], NULL, _reader, NULL)) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+	_run_updates(resp->job_id, "loaded:");
+	for (i = 0; i < thread_cnt; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+	gettimeofday(&now, NULL);
+
+	printf("reader threads: %d\n", thread_cnt);
+	printf("job loads:      %ld (%.1f per second)\n", load_cnt,
+	       load_cnt / _elapsed(&start_time, &now));
+	printf("errors:         %ld\n", err_cnt);
+
+	slurm_kill_job(resp->job_id, SIGKILL, 0);
+	slurm_free_submit_response_response_msg(resp);
+
+	return (err_cnt ? 1 : 0);
+}
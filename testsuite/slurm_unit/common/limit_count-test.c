@@ -0,0 +1,152 @@
+/* Test of src/plugins/sched/backfill/limit_count.c against a reference
+ * model, counting jobs of many distinct users in per user and per user and
+ * partition counters with a job limit on each. The limit checks follow
+ * those of _attempt_backfill(), but that function itself is not run.
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "src/plugins/sched/backfill/limit_count.h"
+#include <testsuite/dejagnu.h>
+
+#define TEST(_tst, _msg) do {		\
+	if (! (_tst))			\
+		fail( _msg );		\
+	else				\
+		pass( _msg );		\
+} while (0)
+
+#define USER_CNT	20000
+#define PART_CNT	4
+#define JOB_CNT		200000
+#define CYCLE_CNT	5
+#define MAX_JOB_USER	5
+#define MAX_JOB_USER_PART 2
+
+/* Reference model, indexed by user and partition */
+static uint32_t user_jobs[USER_CNT];
+static uint32_t user_part_jobs[USER_CNT][PART_CNT];
+static bool user_seen[USER_CNT];
+static bool user_part_seen[USER_CNT][PART_CNT];
+static char part_name[PART_CNT];	/* addresses used as partition pointers */
+
+int
+main(int argc, char *argv[])
+{
+	limit_count_t *user_cnt, *user_part_cnt;
+	uint32_t *cnt, *cnt2, *cnt3;
+	struct timeval tv1, tv2;
+	int bad_find = 0, bad_skip = 0, bad_size = 0, bad_reset = 0;
+	int cycle, i, j, uid, part, users, tested, keys, part_keys;
+	bool skip;
+
+	note("Testing basic counters");
+	user_cnt = limit_count_create();
+	TEST(limit_count_size(user_cnt) == 0, "create empty");
+	cnt = limit_count_find(user_cnt, 1000, NULL);
+	TEST(cnt && (*cnt == 0), "new counter is zero");
+	(*cnt)++;
+	cnt = limit_count_find(user_cnt, 1000, NULL);
+	TEST(*cnt == 1, "counter found again");
+	cnt2 = limit_count_find(user_cnt, 1000, &part_name[0]);
+	cnt3 = limit_count_find(user_cnt, 1001, NULL);
+	TEST((*cnt2 == 0) && (*cnt3 == 0) &&
+	     (limit_count_size(user_cnt) == 3), "keys distinct");
+	limit_count_reset(user_cnt);
+	TEST(limit_count_size(user_cnt) == 0, "reset empties");
+	cnt = limit_count_find(user_cnt, 1000, NULL);
+	TEST(*cnt == 0, "counter zero after reset");
+	limit_count_destroy(user_cnt);
+
+	note("Testing job limits with %d users", USER_CNT);
+	user_cnt = limit_count_create();
+	user_part_cnt = limit_count_create();
+	srand(42);
+	gettimeofday(&tv1, NULL);
+	for (cycle = 0; cycle < CYCLE_CNT; cycle++) {
+		limit_count_reset(user_cnt);
+		limit_count_reset(user_part_cnt);
+		for (i = 0; i < USER_CNT; i++) {
+			user_jobs[i] = 0;
+			user_seen[i] = false;
+			for (j = 0; j < PART_CNT; j++) {
+				user_part_jobs[i][j] = 0;
+				user_part_seen[i][j] = false;
+			}
+		}
+		if (limit_count_size(user_cnt) ||
+		    limit_count_size(user_part_cnt))
+			bad_reset++;
+
+		/* Per user and partition limit first, then per user */
+		tested = keys = part_keys = 0;
+		for (i = 0; i < JOB_CNT; i++) {
+			uid = 1000 + (rand() % USER_CNT);
+			part = rand() % PART_CNT;
+
+			if (!user_part_seen[uid - 1000][part]) {
+				user_part_seen[uid - 1000][part] = true;
+				part_keys++;
+			}
+			cnt = limit_count_find(user_part_cnt, uid,
+					       &part_name[part]);
+			if (*cnt != user_part_jobs[uid - 1000][part])
+				bad_find++;
+			skip = ((*cnt + 1) > MAX_JOB_USER_PART);
+			if (skip != ((user_part_jobs[uid - 1000][part] + 1) >
+				     MAX_JOB_USER_PART))
+				bad_skip++;
+			if (skip)
+				continue;
+
+			if (!user_seen[uid - 1000]) {
+				user_seen[uid - 1000] = true;
+				keys++;
+			}
+			cnt2 = limit_count_find(user_cnt, uid, NULL);
+			if (*cnt2 != user_jobs[uid - 1000])
+				bad_find++;
+			if ((*cnt2 + 1) > MAX_JOB_USER)
+				continue;
+
+			(*cnt)++;
+			(*cnt2)++;
+			user_part_jobs[uid - 1000][part]++;
+			user_jobs[uid - 1000]++;
+			tested++;
+		}
+
+		/* One counter for each distinct key looked up */
+		if ((limit_count_size(user_cnt) != keys) ||
+		    (limit_count_size(user_part_cnt) != part_keys))
+			bad_size++;
+
+		users = 0;
+		for (i = 0; i < USER_CNT; i++) {
+			if (user_jobs[i] > MAX_JOB_USER)
+				bad_skip++;
+			if (user_jobs[i])
+				users++;
+			cnt = limit_count_find(user_cnt, 1000 + i, NULL);
+			if (*cnt != user_jobs[i])
+				bad_find++;
+		}
+		note("cycle %d: %d jobs tested for %d users", cycle, tested,
+		     users);
+	}
+	gettimeofday(&tv2, NULL);
+	note("%d cycles of %d jobs in %ld usec", CYCLE_CNT, JOB_CNT,
+	     (long) ((tv2.tv_sec - tv1.tv_sec) * 1000000 +
+		     (tv2.tv_usec - tv1.tv_usec)));
+	TEST(bad_find == 0, "counters match model");
+	TEST(bad_skip == 0, "limits match model");
+	TEST(bad_size == 0, "one counter per key");
+	TEST(bad_reset == 0, "reset between cycles");
+	limit_count_destroy(user_cnt);
+	limit_count_destroy(user_part_cnt);
+
+	totals();
+	return failed;
+}
@@ -0,0 +1,250 @@
+/* Benchmark of src/plugins/sched/backfill/node_space.c against the linked
+ * array the backfill scheduler used before. Not run by "make check".
+ *
+ * Usage: node_space-bench [jobs [nodes [window_hours]]]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "src/common/bitstring.h"
+#include "src/common/macros.h"
+#include "src/common/xmalloc.h"
+#include "src/plugins/sched/backfill/node_space.h"
+
+#define RESOLUTION	60
+
+/* Copied from src/plugins/sched/backfill/backfill.c before node_space.c */
+typedef struct node_space_array {
+	time_t begin_time;
+	time_t end_time;
+	bitstr_t *avail_bitmap;
+	int next;	/* next record, by time, zero termination */
+} node_space_array_t;
+
+static void _array_add_reservation(uint32_t start_time, uint32_t end_reserve,
+				   bitstr_t *res_bitmap,
+				   node_space_array_t *node_space,
+				   int *node_space_recs)
+{
+	bool placed = false;
+	int i, j;
+
+	start_time = MAX(start_time, node_space[0].begin_time);
+	for (j = 0; ; ) {
+		if (node_space[j].end_time > start_time) {
+			/* insert start entry record */
+			i = *node_space_recs;
+			node_space[i].begin_time = start_time;
+			node_space[i].end_time = node_space[j].end_time;
+			node_space[j].end_time = start_time;
+			node_space[i].avail_bitmap =
+				bit_copy(node_space[j].avail_bitmap);
+			node_space[i].next = node_space[j].next;
+			node_space[j].next = i;
+			(*node_space_recs)++;
+			placed = true;
+		}
+		if (node_space[j].end_time == start_time) {
+			/* no need to insert new start entry record */
+			placed = true;
+		}
+		if (placed == true) {
+			while ((j = node_space[j].next)) {
+				if (end_reserve < node_space[j].end_time) {
+					/* insert end entry record */
+					i = *node_space_recs;
+					node_space[i].begin_time = end_reserve;
+					node_space[i].end_time = node_space[j].
+								 end_time;
+					node_space[j].end_time = end_reserve;
+					node_space[i].avail_bitmap =
+						bit_copy(node_space[j].
+							 avail_bitmap);
+					node_space[i].next = node_space[j].next;
+					node_space[j].next = i;
+					(*node_space_recs)++;
+					break;
+				}
+				if (end_reserve == node_space[j].end_time) {
+					break;
+				}
+			}
+			break;
+		}
+		if ((j = node_space[j].next) == 0)
+			break;
+	}
+
+	for (j = 0; ; ) {
+		if ((node_space[j].begin_time >= start_time) &&
+		    (node_space[j].end_time <= end_reserve))
+			bit_and(node_space[j].avail_bitmap, res_bitmap);
+		if ((node_space[j].begin_time >= end_reserve) ||
+		    ((j = node_space[j].next) == 0))
+			break;
+	}
+
+	/* Drop records with identical bitmaps (up to one record).
+	 * This can significantly improve performance of the backfill tests. */
+	for (i = 0; ; ) {
+		if ((j = node_space[i].next) == 0)
+			break;
+		if (!bit_equal(node_space[i].avail_bitmap,
+			       node_space[j].avail_bitmap)) {
+			i = j;
+			continue;
+		}
+		node_space[i].end_time = node_space[j].end_time;
+		node_space[i].next = node_space[j].next;
+		FREE_NULL_BITMAP(node_space[j].avail_bitmap);
+		break;
+	}
+}
+
+/* The start time search of _attempt_backfill() */
+static time_t _array_and(node_space_array_t *node_space, time_t start_res,
+			 time_t end_time, bitstr_t *avail_bitmap)
+{
+	time_t later_start = 0;
+	int j;
+
+	for (j = 0; ; ) {
+		if ((node_space[j].end_time > start_res) &&
+		     node_space[j].next && (later_start == 0))
+			later_start = node_space[j].end_time;
+		if (node_space[j].end_time <= start_res)
+			;
+		else if (node_space[j].begin_time <= end_time) {
+			bit_and(avail_bitmap,
+				node_space[j].avail_bitmap);
+		} else
+			break;
+		if ((j = node_space[j].next) == 0)
+			break;
+	}
+	return later_start;
+}
+
+/* Clear all but up to cnt randomly selected nodes in avail_bitmap */
+static void _pick_nodes(bitstr_t *avail_bitmap, int cnt)
+{
+	bitstr_t *pick = bit_alloc(bit_size(avail_bitmap));
+	int i, j, k;
+
+	for (k = 0; k < cnt; k++) {
+		j = bit_set_count(avail_bitmap);
+		if (j == 0)
+			break;
+		j = rand() % j;
+		for (i = 0; ; i++) {
+			if (bit_test(avail_bitmap, i) && (j-- == 0))
+				break;
+		}
+		bit_clear(avail_bitmap, i);
+		bit_set(pick, i);
+	}
+	bit_copybits(avail_bitmap, pick);
+	FREE_NULL_BITMAP(pick);
+}
+
+static long _delta_usec(struct timeval *tv1, struct timeval *tv2)
+{
+	return (tv2->tv_sec - tv1->tv_sec) * 1000000 +
+	       (tv2->tv_usec - tv1->tv_usec);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int job_cnt = (argc > 1) ? atoi(argv[1]) : 5000;
+	int node_cnt = (argc > 2) ? atoi(argv[2]) : 10000;
+	int window = ((argc > 3) ? atoi(argv[3]) : 24) * 60 * 60;
+	time_t begin = 1500000000, start, end;
+	node_space_array_t *array;
+	node_space_map_t *tree;
+	bitstr_t *all, *avail1, *avail2;
+	struct timeval tv1, tv2;
+	long array_add = 0, array_query = 0, tree_add = 0, tree_query = 0;
+	int array_recs = 1, i, mismatch = 0;
+
+	if ((job_cnt < 1) || (node_cnt < 1) || (window < RESOLUTION)) {
+		fprintf(stderr, "Usage: %s [jobs [nodes [window_hours]]]\n",
+			argv[0]);
+		exit(1);
+	}
+
+	all = bit_alloc(node_cnt);
+	bit_nset(all, 0, node_cnt - 1);
+	avail1 = bit_alloc(node_cnt);
+	avail2 = bit_alloc(node_cnt);
+
+	array = xmalloc(sizeof(node_space_array_t) * (job_cnt * 2 + 1));
+	array[0].begin_time = begin;
+	array[0].end_time = begin + window;
+	array[0].avail_bitmap = bit_copy(all);
+	tree = node_space_create(begin, begin + window, all);
+
+	srand(1);
+	for (i = 0; i < job_cnt; i++) {
+		start = begin + (rand() % (window / RESOLUTION)) * RESOLUTION;
+		end = start + (1 + rand() % (12 * 60)) * 60;
+
+		bit_copybits(avail1, all);
+		gettimeofday(&tv1, NULL);
+		_array_and(array, start, end, avail1);
+		gettimeofday(&tv2, NULL);
+		array_query += _delta_usec(&tv1, &tv2);
+
+		bit_copybits(avail2, all);
+		gettimeofday(&tv1, NULL);
+		node_space_and(tree, start, end, avail2);
+		gettimeofday(&tv2, NULL);
+		tree_query += _delta_usec(&tv1, &tv2);
+
+		if (!bit_equal(avail1, avail2))
+			mismatch++;
+
+		/* Reserve up to 16 of the available nodes */
+		_pick_nodes(avail1, 1 + (rand() % 16));
+		if (bit_ffs(avail1) == -1)
+			continue;	/* No nodes available, job can't run */
+		bit_not(avail1);
+		end = start + (1 + rand() % (12 * 60)) * 60;
+
+		gettimeofday(&tv1, NULL);
+		_array_add_reservation(start, end, avail1, array, &array_recs);
+		gettimeofday(&tv2, NULL);
+		array_add += _delta_usec(&tv1, &tv2);
+
+		gettimeofday(&tv1, NULL);
+		node_space_add_reservation(tree, start, end, avail1);
+		gettimeofday(&tv2, NULL);
+		tree_add += _delta_usec(&tv1, &tv2);
+	}
+
+	printf("jobs:%d nodes:%d window:%d sec records:%d/%d\n",
+	       job_cnt, node_cnt, window, array_recs,
+	       node_space_rec_cnt(tree));
+	printf("array: add %ld usec query %ld usec\n", array_add, array_query);
+	printf("tree:  add %ld usec query %ld usec\n", tree_add, tree_query);
+	printf("speedup: add %.2f query %.2f total %.2f\n",
+	       (double) array_add / MAX(tree_add, 1),
+	       (double) array_query / MAX(tree_query, 1),
+	       (double) (array_add + array_query) /
+	       MAX(tree_add + tree_query, 1));
+	printf("mismatches: %d\n", mismatch);
+
+	for (i = 0; ; ) {
+		FREE_NULL_BITMAP(array[i].avail_bitmap);
+		if ((i = array[i].next) == 0)
+			break;
+	}
+	xfree(array);
+	node_space_destroy(tree);
+	FREE_NULL_BITMAP(all);
+	FREE_NULL_BITMAP(avail1);
+	FREE_NULL_BITMAP(avail2);
+
+	return (mismatch != 0);
+}
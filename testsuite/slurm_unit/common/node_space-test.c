@@ -0,0 +1,281 @@
+/* Test of src/plugins/sched/backfill/node_space.c
+ */
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "src/common/bitstring.h"
+#include "src/common/macros.h"
+#include "src/plugins/sched/backfill/node_space.h"
+#include <testsuite/dejagnu.h>
+
+#define TEST(_tst, _msg) do {		\
+	if (! (_tst))			\
+		fail( _msg );		\
+	else				\
+		pass( _msg );		\
+} while (0)
+
+#define NODE_CNT	24
+#define BEGIN_TIME	10000
+#define END_TIME	(BEGIN_TIME + 2000)
+
+/* Reference model: available nodes for every second of the window */
+static bitstr_t *oracle[END_TIME - BEGIN_TIME];
+
+typedef struct {
+	time_t begin_time[END_TIME - BEGIN_TIME];
+	time_t end_time[END_TIME - BEGIN_TIME];
+	bitstr_t *avail_bitmap[END_TIME - BEGIN_TIME];
+	int cnt;
+} recs_t;
+
+static int _get_rec(time_t begin_time, time_t end_time, bitstr_t *avail_bitmap,
+		    void *arg)
+{
+	recs_t *recs = arg;
+
+	recs->begin_time[recs->cnt] = begin_time;
+	recs->end_time[recs->cnt] = end_time;
+	recs->avail_bitmap[recs->cnt] = avail_bitmap;
+	recs->cnt++;
+	return 0;
+}
+
+static void _oracle_reserve(time_t start_time, time_t end_reserve,
+			    bitstr_t *res_bitmap)
+{
+	time_t t;
+
+	for (t = MAX(start_time, BEGIN_TIME);
+	     (t < end_reserve) && (t < END_TIME); t++)
+		bit_and(oracle[t - BEGIN_TIME], res_bitmap);
+}
+
+/* AND of every second from first to last within the window */
+static void _oracle_and(time_t first, time_t last, bitstr_t *avail_bitmap)
+{
+	time_t t;
+
+	for (t = MAX(first, BEGIN_TIME); (t <= last) && (t < END_TIME); t++)
+		bit_and(avail_bitmap, oracle[t - BEGIN_TIME]);
+}
+
+static bool _oracle_overlap(bitstr_t *use_bitmap, time_t start_time,
+			    time_t end_time)
+{
+	time_t t;
+
+	for (t = MAX(start_time, BEGIN_TIME);
+	     (t < end_time) && (t < END_TIME); t++) {
+		if (!bit_super_set(use_bitmap, oracle[t - BEGIN_TIME]))
+			return true;
+	}
+	return false;
+}
+
+/* Records must tile the window and match the reference model */
+static bool _check_recs(recs_t *recs)
+{
+	time_t t;
+	int i;
+
+	if ((recs->cnt < 1) || (recs->begin_time[0] != BEGIN_TIME) ||
+	    (recs->end_time[recs->cnt - 1] != END_TIME))
+		return false;
+	for (i = 0; i < recs->cnt; i++) {
+		if (recs->begin_time[i] >= recs->end_time[i])
+			return false;
+		if ((i > 0) && (recs->begin_time[i] != recs->end_time[i - 1]))
+			return false;
+		for (t = recs->begin_time[i]; t < recs->end_time[i]; t++) {
+			if (!bit_equal(recs->avail_bitmap[i],
+				       oracle[t - BEGIN_TIME]))
+				return false;
+		}
+	}
+	return true;
+}
+
+static bitstr_t *_random_bitmap(int density)
+{
+	bitstr_t *bitmap = bit_alloc(NODE_CNT);
+	int i;
+
+	for (i = 0; i < NODE_CNT; i++) {
+		if ((rand() % 100) < density)
+			bit_set(bitmap, i);
+	}
+	return bitmap;
+}
+
+int
+main(int argc, char *argv[])
+{
+	node_space_map_t *node_space;
+	bitstr_t *avail, *res, *use, *expect;
+	recs_t *recs = calloc(1, sizeof(recs_t));
+	time_t later, start, end, after, conflict, want;
+	int i, j, k, n;
+	int bad_recs = 0, bad_and = 0, bad_after = 0, bad_later = 0;
+	int bad_overlap = 0, bad_conflict = 0, bad_cnt = 0;
+
+	note("Testing basic reservation");
+	avail = bit_alloc(NODE_CNT);
+	bit_nset(avail, 0, NODE_CNT - 1);
+	node_space = node_space_create(BEGIN_TIME, END_TIME, avail);
+	TEST(node_space_rec_cnt(node_space) == 1, "create single record");
+
+	res = bit_alloc(NODE_CNT);
+	bit_nset(res, 4, NODE_CNT - 1);		/* reserve nodes 0-3 */
+	node_space_add_reservation(node_space, BEGIN_TIME + 100,
+				   BEGIN_TIME + 200, res);
+	recs->cnt = 0;
+	node_space_for_each(node_space, _get_rec, recs);
+	TEST(recs->cnt == 3, "reservation splits window in three");
+	TEST((recs->end_time[0] == BEGIN_TIME + 100) &&
+	     (recs->end_time[1] == BEGIN_TIME + 200),
+	     "reservation boundaries");
+	TEST(bit_equal(recs->avail_bitmap[1], res), "reserved nodes removed");
+	TEST(bit_equal(recs->avail_bitmap[0], avail) &&
+	     bit_equal(recs->avail_bitmap[2], avail), "other records intact");
+
+	use = bit_alloc(NODE_CNT);
+	bit_set(use, 2);
+	TEST(node_space_overlap(node_space, use, BEGIN_TIME + 150,
+				BEGIN_TIME + 160), "overlap inside reservation");
+	TEST(!node_space_overlap(node_space, use, BEGIN_TIME, BEGIN_TIME + 100),
+	     "no overlap ending at reservation start");
+	TEST(node_space_conflict(node_space, use, 0, END_TIME) ==
+	     BEGIN_TIME + 100, "first conflict at reservation start");
+	TEST(node_space_conflict(node_space, use, BEGIN_TIME + 101, END_TIME)
+	     == 0, "no conflict beginning after reservation start");
+
+	expect = bit_copy(avail);
+	later = node_space_and(node_space, BEGIN_TIME + 50, BEGIN_TIME + 150,
+			       expect);
+	TEST(bit_equal(expect, res), "and across reservation");
+	TEST(later == BEGIN_TIME + 100, "later start at end of first record");
+	bit_copybits(expect, avail);
+	later = node_space_and(node_space, BEGIN_TIME + 250, END_TIME, expect);
+	TEST(bit_equal(expect, avail) && (later == 0),
+	     "and after reservation");
+
+	/* Same nodes again over the same time merges nothing new */
+	node_space_add_reservation(node_space, BEGIN_TIME + 200,
+				   BEGIN_TIME + 300, avail);
+	recs->cnt = 0;
+	node_space_for_each(node_space, _get_rec, recs);
+	TEST(recs->cnt == 3, "identical neighbors merged");
+	TEST(recs->end_time[1] == BEGIN_TIME + 200, "merge keeps boundaries");
+	node_space_destroy(node_space);
+	FREE_NULL_BITMAP(use);
+	FREE_NULL_BITMAP(res);
+	FREE_NULL_BITMAP(expect);
+
+	note("Testing random reservations against reference model");
+	srand(1234);
+	expect = bit_alloc(NODE_CNT);
+	for (n = 0; n < 20; n++) {
+		for (i = 0; i < (END_TIME - BEGIN_TIME); i++) {
+			FREE_NULL_BITMAP(oracle[i]);
+			oracle[i] = bit_copy(avail);
+		}
+		node_space = node_space_create(BEGIN_TIME, END_TIME, avail);
+		for (i = 0; i < 200; i++) {
+			start = BEGIN_TIME - 50 + (rand() % 2100);
+			end = start + 1 + (rand() % 400);
+			if ((rand() % 4) == 0)	/* reuse existing boundary */
+				start = BEGIN_TIME + (rand() % 20) * 100;
+			res = _random_bitmap(85);
+			node_space_add_reservation(node_space, start, end, res);
+			_oracle_reserve(start, end, res);
+			FREE_NULL_BITMAP(res);
+
+			recs->cnt = 0;
+			node_space_for_each(node_space, _get_rec, recs);
+			if (!_check_recs(recs))
+				bad_recs++;
+			if (node_space_rec_cnt(node_space) < recs->cnt)
+				bad_cnt++;
+
+			for (j = 0; j < 10; j++) {
+				start = BEGIN_TIME + (rand() % 2100);
+				end = start + (rand() % 500);
+
+				bit_nset(avail, 0, NODE_CNT - 1);
+				bit_nset(expect, 0, NODE_CNT - 1);
+				later = node_space_and(node_space, start, end,
+						       avail);
+				_oracle_and(start, end, expect);
+				if (!bit_equal(avail, expect))
+					bad_and++;
+
+				want = 0;
+				for (k = 0; k < recs->cnt - 1; k++) {
+					if (recs->end_time[k] > start) {
+						want = recs->end_time[k];
+						break;
+					}
+				}
+				if (later != want)
+					bad_later++;
+
+				after = start + (rand() % 300);
+				bit_nset(avail, 0, NODE_CNT - 1);
+				bit_nset(expect, 0, NODE_CNT - 1);
+				node_space_and_after(node_space, start, end,
+						     after, avail);
+				for (k = 0; k < recs->cnt; k++) {
+					if ((recs->end_time[k] > start) &&
+					    (recs->begin_time[k] > after) &&
+					    (recs->begin_time[k] <= end)) {
+						bit_and(expect,
+							recs->avail_bitmap[k]);
+					}
+				}
+				if (!bit_equal(avail, expect))
+					bad_after++;
+
+				use = _random_bitmap(10);
+				if (node_space_overlap(node_space, use, start,
+						       end + 1) !=
+				    _oracle_overlap(use, start, end + 1))
+					bad_overlap++;
+
+				conflict = node_space_conflict(node_space, use,
+							       start, end);
+				want = 0;
+				for (k = 0; k < recs->cnt; k++) {
+					if ((recs->begin_time[k] >= start) &&
+					    (recs->begin_time[k] <= end) &&
+					    !bit_super_set(use,
+							recs->avail_bitmap[k])) {
+						want = recs->begin_time[k];
+						break;
+					}
+				}
+				if (conflict != want)
+					bad_conflict++;
+				FREE_NULL_BITMAP(use);
+			}
+		}
+		node_space_destroy(node_space);
+		bit_nset(avail, 0, NODE_CNT - 1);
+	}
+	TEST(bad_recs == 0, "records tile window and match model");
+	TEST(bad_cnt == 0, "record count");
+	TEST(bad_and == 0, "node_space_and matches model");
+	TEST(bad_later == 0, "node_space_and later start");
+	TEST(bad_after == 0, "node_space_and_after");
+	TEST(bad_overlap == 0, "node_space_overlap matches model");
+	TEST(bad_conflict == 0, "node_space_conflict");
+
+	for (i = 0; i < (END_TIME - BEGIN_TIME); i++)
+		FREE_NULL_BITMAP(oracle[i]);
+	FREE_NULL_BITMAP(avail);
+	FREE_NULL_BITMAP(expect);
+	free(recs);
+
+	totals();
+	return failed;
+}